@@ -0,0 +1,435 @@
+#!/usr/bin/env python3
+"""\
+
+Reference g-code streamer and stream path benchmark for grblHAL
+
+Streams a g-code file over a serial port, a Telnet (raw TCP) or a
+WebSocket connection and reports the throughput, the distribution
+of the time from a line is sent until it is acknowledged and how
+close the planner came to run dry.
+
+Protocols:
+- simple: send-response, one line in flight.
+- count:  character counting, lines are sent as long as the characters
+          not yet acknowledged fit in the controller receive buffer.
+- framed: lines are prefixed by @<sequence>: and acknowledged cumulatively
+          by [ACK:<sequence>,<rx free>,<planner free>], requires the
+          controller to be built with ENABLE_FRAMED_STREAMING.
+
+Ack latency is the time from a line is sent until the ok or error
+for it is received, in framed mode until the first acknowledge
+covering it is received.
+
+Planner starvation is measured from the real-time reports polled during
+the job, the buffer state report must be enabled ($10 bit 1) for this.
+A report in Run state with no blocks queued behind the one executing
+is counted as starved, Bt: (planned time left in ms) below the threshold
+set by --starve-ms is counted as near starvation.
+
+Examples:
+  stream_bench.py job.nc serial:///dev/ttyACM0
+  stream_bench.py job.nc telnet://192.168.5.1:23 -p framed
+  stream_bench.py job.nc ws://192.168.5.1:81 -p count --json run.json
+
+Requires Python 3, pySerial for serial ports only.
+
+---------------------
+The MIT License (MIT)
+
+Copyright (c) 2020 Terje Io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+---------------------
+"""
+
+import argparse
+import base64
+import collections
+import json
+import os
+import re
+import select
+import socket
+import sys
+import time
+from urllib.parse import urlparse, parse_qs
+
+RX_BUFFER_SIZE = 128  # Used when the receive buffer size cannot be read from the controller
+
+# Transports, read() returns the bytes available or b'' after timeout seconds.
+
+class SerialTransport:
+
+    def __init__(self, url):
+        import serial
+        baud = int(parse_qs(url.query).get('baud', ['115200'])[0])
+        self.port = serial.Serial(url.path, baud, timeout=0)
+
+    def write(self, data):
+        self.port.write(data)
+
+    def read(self, timeout):
+        self.port.timeout = timeout
+        data = self.port.read(max(1, self.port.in_waiting))
+        return data
+
+    def close(self):
+        self.port.close()
+
+
+class TelnetTransport:
+
+    def __init__(self, url):
+        self.sock = socket.create_connection((url.hostname, url.port or 23))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def write(self, data):
+        self.sock.sendall(data)
+
+    def read(self, timeout):
+        if select.select([self.sock], [], [], timeout)[0]:
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError('connection closed by controller')
+            return data
+        return b''
+
+    def close(self):
+        self.sock.close()
+
+
+class WebSocketTransport(TelnetTransport):
+
+    def __init__(self, url, protocol):
+        self.sock = socket.create_connection((url.hostname, url.port or 80))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.opcode = 0x02 if protocol == 'arduino' else 0x01  # grblHAL uses binary frames for the arduino protocol
+        self.rxbuf = b''
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = 'GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n' \
+                  'Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n' % (url.path or '/', url.netloc, key)
+        if protocol:
+            request += 'Sec-WebSocket-Protocol: %s\r\n' % protocol
+        self.sock.sendall((request + '\r\n').encode())
+        response = b''
+        while b'\r\n\r\n' not in response:
+            data = self.sock.recv(1024)
+            if not data:
+                raise ConnectionError('websocket handshake failed')
+            response += data
+        header, self.rxbuf = response.split(b'\r\n\r\n', 1)
+        if b' 101 ' not in header.split(b'\r\n')[0]:
+            raise ConnectionError('websocket handshake failed: ' + header.split(b'\r\n')[0].decode())
+
+    def send_frame(self, opcode, payload):
+        mask = os.urandom(4)
+        length = len(payload)
+        if length < 126:
+            header = bytes([0x80 | opcode, 0x80 | length])
+        elif length < 65536:
+            header = bytes([0x80 | opcode, 0x80 | 126]) + length.to_bytes(2, 'big')
+        else:
+            header = bytes([0x80 | opcode, 0x80 | 127]) + length.to_bytes(8, 'big')
+        self.sock.sendall(header + mask + bytes(b ^ mask[i & 3] for i, b in enumerate(payload)))
+
+    def write(self, data):
+        self.send_frame(self.opcode, data)
+
+    # Returns the payload of the complete data frames received, control frames are handled here.
+    def read(self, timeout):
+        data = b''
+        self.rxbuf += TelnetTransport.read(self, timeout)
+        while len(self.rxbuf) >= 2:
+            opcode, length, offset = self.rxbuf[0] & 0x0F, self.rxbuf[1] & 0x7F, 2
+            if length == 126:
+                length, offset = int.from_bytes(self.rxbuf[2:4], 'big'), 4
+            elif length == 127:
+                length, offset = int.from_bytes(self.rxbuf[2:10], 'big'), 10
+            if self.rxbuf[1] & 0x80:
+                offset += 4  # Servers do not mask frames, skip the key if present anyway
+            if len(self.rxbuf) < offset + length:
+                break
+            payload, self.rxbuf = self.rxbuf[offset:offset + length], self.rxbuf[offset + length:]
+            if opcode == 0x08:
+                raise ConnectionError('connection closed by controller')
+            elif opcode == 0x09:
+                self.send_frame(0x0A, payload)
+            elif opcode in (0x00, 0x01, 0x02):
+                data += payload
+        return data
+
+
+def open_transport(args):
+    url = urlparse(args.device)
+    if url.scheme == 'serial':
+        return SerialTransport(url)
+    if url.scheme == 'telnet':
+        return TelnetTransport(url)
+    if url.scheme == 'ws':
+        return WebSocketTransport(url, args.ws_protocol)
+    sys.exit('unsupported device %s, use serial://<port>[?baud=<n>], telnet://<host>[:port] or ws://<host>[:port]' % args.device)
+
+
+# Streamer
+
+class Streamer:
+
+    status_re = re.compile(r'<([A-Za-z]+)[^>]*?\|Bf:(\d+),(\d+)(?:\|Bt:(\d+))?')
+    ack_re = re.compile(r'\[ACK:(\d+),(\d+),(\d+)\]')
+    nak_re = re.compile(r'\[NAK:(\d+),(\d+)\]')
+
+    def __init__(self, transport, args):
+        self.transport = transport
+        self.args = args
+        self.rxdata = b''
+        self.inflight = collections.deque()  # (sequence, length, time sent) of lines not yet acknowledged
+        self.inflight_chars = 0
+        self.latency = []
+        self.errors = []
+        self.state = None
+        self.buffer_state = None             # (planner free, rx free) from the last real-time report
+        self.run_reports = 0
+        self.starved = 0
+        self.near_starved = 0
+        self.bt = []
+
+    def lines(self):
+        self.rxdata += self.transport.read(0.002)
+        while b'\n' in self.rxdata:
+            line, self.rxdata = self.rxdata.split(b'\n', 1)
+            line = line.strip().decode(errors='replace')
+            if line:
+                yield line
+
+    def status(self, line, planner_max):
+        m = self.status_re.match(line)
+        if not m:
+            self.state = line[1:].split('|')[0].split(':')[0].split('>')[0]
+            return
+        self.state = m.group(1)
+        self.buffer_state = (int(m.group(2)), int(m.group(3)))
+        if planner_max and self.state == 'Run':
+            self.run_reports += 1
+            if self.buffer_state[0] >= planner_max - 1:
+                self.starved += 1
+            if m.group(4) is not None:
+                bt = int(m.group(4))
+                self.bt.append(bt)
+                if bt < self.args.starve_ms:
+                    self.near_starved += 1
+
+    def retire(self, seq=None, error=None):
+        now = time.perf_counter()
+        while self.inflight and (seq is None or self.inflight[0][0] <= seq):
+            line_seq, length, sent = self.inflight.popleft()
+            self.inflight_chars -= length
+            self.latency.append(now - sent)
+            if error is not None and (seq is None or line_seq == seq):
+                self.errors.append((line_seq, error))
+            if seq is None:
+                break
+
+    def handle(self, line, planner_max=0):
+        if line.startswith('<'):
+            self.status(line, planner_max)
+        elif self.args.protocol == 'framed' and line.startswith('[ACK:'):
+            m = self.ack_re.match(line)
+            if m:
+                self.retire(int(m.group(1)))
+        elif self.args.protocol == 'framed' and line.startswith('[NAK:'):
+            m = self.nak_re.match(line)
+            if m:
+                self.retire(int(m.group(1)), 'error:' + m.group(2))
+        elif self.args.protocol != 'framed' and (line == 'ok' or line.startswith('error')):
+            self.retire(None, None if line == 'ok' else line)
+        elif self.args.verbose:
+            print('  MSG:', line)
+
+    # Reads the buffer sizes from a real-time report while the controller is idle.
+    def probe(self):
+        self.transport.write(b'?')
+        deadline = time.perf_counter() + 1.0
+        while time.perf_counter() < deadline:
+            for line in self.lines():
+                self.handle(line)
+                if line.startswith('<'):
+                    return self.buffer_state
+        return None
+
+    def run(self, blocks):
+        args = self.args
+        state = self.probe()
+        if state is None:
+            print('WARNING: no buffer state in real-time report, enable it with $10, planner starvation is not measured.')
+        planner_max = state[0] if state else 0
+        rx_size = args.rx_size or (state[1] if state else RX_BUFFER_SIZE)
+        window = rx_size - args.rx_margin
+
+        seq, sent_chars, next_status = 0, 0, 0.0
+        start = time.perf_counter()
+        pending = iter(blocks)
+        block = next(pending, None)
+
+        while block is not None or self.inflight:
+            now = time.perf_counter()
+
+            while block is not None:
+                if args.protocol == 'framed':
+                    data = ('@%d:%s\n' % (seq + 1, block)).encode()
+                else:
+                    data = (block + '\n').encode()
+                if self.inflight and (args.protocol == 'simple' or self.inflight_chars + len(data) > window):
+                    break
+                seq += 1
+                self.transport.write(data)
+                self.inflight.append((seq, len(data), time.perf_counter()))
+                self.inflight_chars += len(data)
+                sent_chars += len(data)
+                if args.verbose:
+                    print('SND: %d: %s' % (seq, block))
+                block = next(pending, None)
+
+            if args.status_interval > 0 and now >= next_status:
+                self.transport.write(b'?')
+                next_status = now + args.status_interval
+
+            for line in self.lines():
+                self.handle(line, planner_max)
+
+        streamed = time.perf_counter() - start
+
+        # Wait for the controller to complete the motion buffered.
+        if args.wait_idle:
+            deadline = time.perf_counter() + args.wait_idle
+            self.state = None
+            while self.state != 'Idle' and time.perf_counter() < deadline:
+                if time.perf_counter() >= next_status:
+                    self.transport.write(b'?')
+                    next_status = time.perf_counter() + max(args.status_interval, 0.05)
+                for line in self.lines():
+                    self.handle(line)
+
+        return {
+            'protocol': args.protocol,
+            'device': args.device,
+            'lines': seq,
+            'chars': sent_chars,
+            'rx_window': window,
+            'stream_time': streamed,
+            'job_time': time.perf_counter() - start,
+            'lines_per_s': seq / streamed if streamed > 0 else 0.0,
+            'chars_per_s': sent_chars / streamed if streamed > 0 else 0.0,
+            'latency_ms': percentiles([t * 1000.0 for t in self.latency]),
+            'errors': len(self.errors),
+            'run_reports': self.run_reports,
+            'starved_reports': self.starved,
+            'near_starved_reports': self.near_starved,
+            'buffer_time_ms': percentiles(self.bt)
+        }
+
+
+def percentiles(values):
+    if not values:
+        return {}
+    values = sorted(values)
+    pick = lambda p: values[min(len(values) - 1, int(p * len(values)))]
+    return {
+        'min': values[0], 'p50': pick(0.5), 'p90': pick(0.9), 'p99': pick(0.99), 'max': values[-1],
+        'mean': sum(values) / len(values)
+    }
+
+
+def load_blocks(f, strip):
+    for line in f:
+        line = line.strip()
+        if strip:
+            line = re.sub(r'\s|\(.*?\)|;.*', '', line).upper()  # Strip comments and spaces, capitalize
+        if line and line != '%':
+            yield line
+
+
+def print_summary(r):
+    print('\nProtocol: %s, %s' % (r['protocol'], r['device']))
+    print('Lines: %d, characters: %d, receive window: %d' % (r['lines'], r['chars'], r['rx_window']))
+    print('Streaming time: %.3f s, job time: %.3f s' % (r['stream_time'], r['job_time']))
+    print('Throughput: %.1f lines/s, %.0f characters/s' % (r['lines_per_s'], r['chars_per_s']))
+    for name, key in (('Ack latency (ms)', 'latency_ms'), ('Planner buffer time in Run (ms)', 'buffer_time_ms')):
+        p = r[key]
+        if p:
+            print('%s: min %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f, mean %.2f' %
+                  (name, p['min'], p['p50'], p['p90'], p['p99'], p['max'], p['mean']))
+    if r['run_reports']:
+        print('Planner starved in %d of %d reports in Run, near starved in %d' %
+              (r['starved_reports'], r['run_reports'], r['near_starved_reports']))
+    print('Errors: %d' % r['errors'])
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Stream g-code file to grblHAL and report stream path performance.')
+    parser.add_argument('gcode_file', type=argparse.FileType('r'),
+            help='g-code filename to be streamed')
+    parser.add_argument('device',
+            help='serial://<port>[?baud=<n>], telnet://<host>[:<port>] or ws://<host>[:<port>][/<path>]')
+    parser.add_argument('-p', '--protocol', choices=('simple', 'count', 'framed'), default='count',
+            help='streaming protocol, default count')
+    parser.add_argument('--rx-size', type=int, default=0,
+            help='controller receive buffer size, default read from the real-time report when idle')
+    parser.add_argument('--rx-margin', type=int, default=1,
+            help='receive buffer characters kept free, default 1')
+    parser.add_argument('--status-interval', type=float, default=0.1,
+            help='real-time report polling interval in seconds, 0 to disable, default 0.1')
+    parser.add_argument('--starve-ms', type=int, default=50,
+            help='planner buffer time counted as near starvation in ms, default 50')
+    parser.add_argument('--wait-idle', type=float, default=600.0,
+            help='max seconds to wait for the job to complete after streaming, 0 to not wait, default 600')
+    parser.add_argument('--ws-protocol', default='',
+            help='WebSocket subprotocol, arduino selects binary frames')
+    parser.add_argument('--settle', type=float, default=1.0,
+            help='seconds to wait for the controller to start up before streaming, default 1')
+    parser.add_argument('-s', '--strip', action='store_true', default=False,
+            help='strip comments and spaces')
+    parser.add_argument('-v', '--verbose', action='store_true', default=False,
+            help='print lines sent and messages received')
+    parser.add_argument('--json',
+            help='write the results to this file as JSON')
+    args = parser.parse_args()
+
+    transport = open_transport(args)
+
+    # Wake up the controller and discard startup messages
+    transport.write(b'\r\n\r\n')
+    deadline = time.perf_counter() + args.settle
+    while time.perf_counter() < deadline:
+        transport.read(0.05)
+
+    try:
+        result = Streamer(transport, args).run(load_blocks(args.gcode_file, args.strip))
+    finally:
+        transport.close()
+        args.gcode_file.close()
+
+    print_summary(result)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(result, f, indent=2)
+
+
+if __name__ == '__main__':
+    main()
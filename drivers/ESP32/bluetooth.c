@@ -48,8 +48,8 @@
 #define SPP_CONNECTED    (1 << 1)
 #define SPP_CONGESTED    (1 << 2)
 #define SPP_DISCONNECTED (1 << 3)
-#define BT_TX_QUEUE_ENTRIES 32
-#define BT_TX_BUFFER_SIZE 250
+#define BT_TX_BUFFER_SIZE 2048 // must be a power of 2
+#define BT_TX_CHUNK_SIZE ESP_SPP_MAX_MTU
 
 #define USE_BT_MUTEX 0
 
@@ -64,24 +64,20 @@ static SemaphoreHandle_t lock = NULL;
 
 #define SPP_TAG "BLUETOOTH"
 
+// Static TX ring buffer, lines are made available for transmission when complete.
 typedef struct {
-    volatile uint16_t head;
+    volatile uint16_t head;     // End of complete lines
+    volatile uint16_t tail;     // Start of data not yet handed to the SPP stack
+    uint16_t next;              // Write position of the line being added
     char data[BT_TX_BUFFER_SIZE];
 } bt_tx_buffer_t;
 
-typedef struct {
-    uint16_t length;
-    uint8_t data[1];
-} tx_chunk_t;
-
 static uint32_t connection = 0;
 static bool is_second_attempt = false;
 static bluetooth_settings_t *bluetooth, *bluetooth;
 static SemaphoreHandle_t tx_busy = NULL;
 static EventGroupHandle_t event_group = NULL;
 static TaskHandle_t polltask = NULL;
-static xQueueHandle tx_queue = NULL;
-static portMUX_TYPE tx_flush_mux = portMUX_INITIALIZER_UNLOCKED;
 static char client_mac[18];
 
 static bt_tx_buffer_t txbuffer;
@@ -130,33 +126,25 @@ int16_t BTStreamGetC (void)
     return data;
 }
 
-static inline bool enqueue_tx_chunk (uint16_t length, uint8_t *data)
-{
-    tx_chunk_t *chunk;
-
-    if((chunk = malloc(sizeof(tx_chunk_t) + length))) {
-        chunk->length = length;
-        memcpy(&chunk->data, data, length);
-        if (xQueueSendToBack(tx_queue, &chunk, portMAX_DELAY) != pdPASS) {
-            free(chunk);
-            chunk = NULL;
-        }
-    }
-
-    return chunk != NULL;
-}
-
 // Since grbl always sends cr/lf terminated strings we can send complete strings to improve throughput
 bool BTStreamPutC (const char c)
 {
-    if(txbuffer.head < BT_TX_BUFFER_SIZE)
-        txbuffer.data[txbuffer.head++] = c;
+    uint16_t next = (txbuffer.next + 1) & (BT_TX_BUFFER_SIZE - 1);
 
-    if(c == '\n') {
-        enqueue_tx_chunk(txbuffer.head, (uint8_t *)txbuffer.data);
-        txbuffer.head = 0;
+    while(next == txbuffer.tail) {          // Buffer full,
+        if(!connection)                     // drop data if not connected
+            return false;
+        if(txbuffer.head == txbuffer.tail)  // or make the partial line available
+            txbuffer.head = txbuffer.next;  // if there are no complete lines
+        vTaskDelay(1);                      // and wait for room
     }
 
+    txbuffer.data[txbuffer.next] = c;
+    txbuffer.next = next;
+
+    if(c == '\n')
+        txbuffer.head = next;
+
     return true;
 }
 
@@ -234,21 +222,9 @@ bool BTStreamSuspendInput (bool suspend)
     return rxbuffer.tail != rxbuffer.head;
 }
 
-static void flush_tx_queue (void)
+static void flush_tx_buffer (void)
 {
-    if(uxQueueMessagesWaiting(tx_queue)) {
-
-        tx_chunk_t *chunk;
-
-        portENTER_CRITICAL(&tx_flush_mux);
-
-        while(uxQueueMessagesWaiting(tx_queue)) {
-            if(xQueueReceive(tx_queue, &chunk, (TickType_t)0) == pdTRUE)
-                free(chunk);
-        }
-
-        portEXIT_CRITICAL(&tx_flush_mux);
-    }
+    txbuffer.head = txbuffer.tail = txbuffer.next = 0;
 }
 
 static void esp_spp_cb (esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
@@ -264,7 +240,7 @@ static void esp_spp_cb (esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
         case ESP_SPP_SRV_OPEN_EVT:
             if(connection == 0) {
                 connection = param->open.handle;
-                txbuffer.head = 0;
+                flush_tx_buffer();
                 uint8_t *mac = param->srv_open.rem_bda;
                 sprintf(client_mac, "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
                 selectStream(StreamType_Bluetooth);
@@ -287,7 +263,7 @@ static void esp_spp_cb (esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
             else { // flush TX queue and reenable serial stream
                 connection = 0;
                 client_mac[0] = '\0';
-                flush_tx_queue();
+                flush_tx_buffer();
                 selectStream(StreamType_Serial);
             }
             break;
@@ -384,52 +360,32 @@ void esp_bt_gap_cb(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t *param)
     }
 }
 
+// Sends the complete lines in the TX buffer in chunks of up to BT_TX_CHUNK_SIZE bytes when not congested.
+// The SPP stack copies the data so the buffer space is released when the write is accepted.
 static void pollTX (void * arg)
 {
-    tx_chunk_t *chunk = NULL;
-    bool data_sent = false;
-    uint8_t buffer[256], *ptr;
-    size_t remaining;
+    uint16_t head, tail, length;
 
     while(true) {
 
         if(connection &&
             xEventGroupWaitBits(event_group, SPP_CONGESTED, pdFALSE, pdTRUE, 0) &&
-             uxQueueMessagesWaiting(tx_queue) &&
+             (head = txbuffer.head) != (tail = txbuffer.tail) &&
               xSemaphoreTake(tx_busy, (TickType_t)0)) {
 
-            data_sent = false;
-
-            if(chunk || xQueueReceive(tx_queue, &chunk, (TickType_t)0) == pdTRUE) {
-
-                remaining = sizeof(buffer);
-                ptr = buffer;
-
-                if(chunk->length >= remaining) {
-                    data_sent = esp_spp_write(connection, chunk->length, chunk->data) == ESP_OK;
-                    free(chunk);
-                    chunk = NULL;
-                } else while(chunk && chunk->length < remaining) {
-
-                    memcpy(ptr, chunk->data, chunk->length);
-                    ptr += chunk->length;
-                    remaining -= chunk->length;
-                    free(chunk);
+            length = head > tail ? head - tail : BT_TX_BUFFER_SIZE - tail; // Contiguous data only, the rest is sent next
 
-                    if(xQueueReceive(tx_queue, &chunk, (TickType_t)0) != pdTRUE)
-                        chunk = NULL;
-                }
-
-                if(remaining != sizeof(buffer))
-                    data_sent = esp_spp_write(connection, sizeof(buffer) - remaining, buffer) == ESP_OK;
-            }
+            if(length > BT_TX_CHUNK_SIZE)
+                length = BT_TX_CHUNK_SIZE;
 
-            if(!data_sent)
-               xSemaphoreGive(tx_busy);
+            if(esp_spp_write(connection, length, (uint8_t *)&txbuffer.data[tail]) == ESP_OK)
+                txbuffer.tail = (tail + length) & (BT_TX_BUFFER_SIZE - 1);
+            else
+                xSemaphoreGive(tx_busy);
         }
 
-        if(connection)
-            vTaskDelay(pdMS_TO_TICKS(10));
+        if(connection) // Lines are collected for 10 ms, unless more data is pending
+            vTaskDelay(txbuffer.head != txbuffer.tail ? 1 : pdMS_TO_TICKS(10));
         else
             vTaskSuspend(NULL);
     }
@@ -450,16 +406,13 @@ bool bluetooth_start (void)
         return false;
 #endif
 
-    if(!(tx_queue || (tx_queue = xQueueCreate(BT_TX_QUEUE_ENTRIES, sizeof(tx_chunk_t *)))))
-        return false;
-
     if(!(tx_busy || (tx_busy = xSemaphoreCreateBinary())))
         return false;
 
     xSemaphoreGive(tx_busy);
 
     if(polltask == NULL) {
-        if(xTaskCreatePinnedToCore(pollTX, "btTX", 4096, NULL, 2, &polltask, 1) == pdPASS)
+        if(xTaskCreatePinnedToCore(pollTX, "btTX", 4096, NULL, 2, &polltask, COMMS_CORE) == pdPASS)
             vTaskSuspend(polltask);
         else
             return false;
@@ -560,12 +513,11 @@ bool bluetooth_disable (void)
         }
 
         if(polltask) {
-            flush_tx_queue();
+            flush_tx_buffer();
             vTaskDelete(polltask);
             vEventGroupDelete(event_group);
             vSemaphoreDelete(tx_busy);
-            vQueueDelete(tx_queue);
-            polltask = event_group = tx_busy = tx_queue = NULL;
+            polltask = event_group = tx_busy = NULL;
 #if USE_BT_MUTEX
             vSemaphoreDelete(lock);
             lock = NULL;
@@ -182,6 +182,7 @@ void tcpStreamWriteS (const char *data)
 const io_stream_t telnet_stream = {
     .type = StreamType_Telnet,
     .read = TCPStreamGetC,
+    .read_block = TCPStreamReadBlock,
     .write = TCPStreamWriteS,
     .write_all = tcpStreamWriteS,
     .get_rx_buffer_available = TCPStreamRxFree,
@@ -387,6 +388,14 @@ void selectStream (stream_type_t stream)
     active_stream = stream;
 }
 
+#ifndef USE_I2S_OUT
+
+// Step pulse delay in RMT ticks, only applied to the first step after a direction change.
+static uint32_t rmt_pulse_delay = 0;
+static bool rmt_delay_armed = false, rmt_delay_pulsed = false;
+
+#endif
+
 void initRMT (settings_t *settings)
 {
     rmt_item32_t rmtItem[2];
@@ -403,7 +412,7 @@ void initRMT (settings_t *settings)
         .tx_config.idle_output_en = true
     };
 
-    rmtItem[0].duration0 = (uint32_t)(settings->steppers.pulse_delay_microseconds > 0.0f ? 4.0f * settings->steppers.pulse_delay_microseconds : 1.0f);
+    rmtItem[0].duration0 = 1;
     rmtItem[0].duration1 = (uint32_t)(4.0f * settings->steppers.pulse_microseconds);
     rmtItem[1].duration0 = 0;
     rmtItem[1].duration1 = 0;
@@ -432,6 +441,11 @@ void initRMT (settings_t *settings)
         rmt_config(&rmtConfig);
         rmt_fill_tx_items(rmtConfig.channel, &rmtItem[0], 2, 0);
     }
+
+#ifndef USE_I2S_OUT
+    rmt_pulse_delay = settings->steppers.pulse_delay_microseconds > 0.0f ? (uint32_t)(4.0f * settings->steppers.pulse_delay_microseconds) : 0;
+    rmt_delay_armed = rmt_delay_pulsed = false;
+#endif
 }
 
 void vTimerCallback (TimerHandle_t xTimer)
@@ -515,6 +529,7 @@ static void stepperEnable (axes_signals_t enable)
     iopins.stepper_enable_y = enable.y;
     iopins.stepper_enable_z = enable.z;
     ioexpand_out(iopins);
+    ioexpand_flush(); // Steppers must be enabled before motion starts
 #elif defined(STEPPERS_DISABLE_PIN)
     DIGITAL_OUT(STEPPERS_DISABLE_PIN, enable.x);
 #else
@@ -572,7 +587,7 @@ IRAM_ATTR static void I2S_stepperCyclesPerTick (uint32_t cycles_per_tick)
 // Sets stepper direction and pulse pins and starts a step pulse
 IRAM_ATTR static void I2S_stepperPulseStart (stepper_t *stepper)
 {
-    if(stepper->dir_change) {
+    if(stepper->dir_change)
         set_dir_outputs(stepper->dir_outbits);
 
     if(stepper->step_outbits.value) {
@@ -582,6 +597,57 @@ IRAM_ATTR static void I2S_stepperPulseStart (stepper_t *stepper)
     }
 }
 
+// Returns the expanded port bits to pulse for the step bits, step inversion is handled by the idle port state
+inline __attribute__((always_inline)) IRAM_ATTR static uint32_t i2s_step_mask (axes_signals_t step_outbits)
+{
+    uint32_t mask = 0;
+
+    if(step_outbits.x)
+        mask |= bit(X_STEP_PIN);
+    if(step_outbits.y)
+        mask |= bit(Y_STEP_PIN);
+    if(step_outbits.z)
+        mask |= bit(Z_STEP_PIN);
+#ifdef A_AXIS
+    if(step_outbits.a)
+        mask |= bit(A_STEP_PIN);
+#endif
+#ifdef B_AXIS
+    if(step_outbits.b)
+        mask |= bit(B_STEP_PIN);
+#endif
+#ifdef C_AXIS
+    if(step_outbits.c)
+        mask |= bit(C_STEP_PIN);
+#endif
+
+    return mask;
+}
+
+// Fetches the step patterns for the current segment, called when the I2S DMA buffer is filled.
+// Steps are then generated directly in the DMA buffer without a stepper interrupt per step.
+IRAM_ATTR static uint32_t I2S_stepperStream (uint32_t *pattern, uint32_t max, uint64_t *period)
+{
+    static axes_signals_t steps[I2S_OUT_STREAM_BATCH];
+
+    uint32_t cycles_per_tick;
+    uint_fast16_t count = max > I2S_OUT_STREAM_BATCH ? I2S_OUT_STREAM_BATCH : max, idx;
+    stepper_t *stepper = st_stream_segment(steps, &count, &cycles_per_tick);
+
+    if(stepper == NULL)
+        return 0;
+
+    if(stepper->dir_change)
+        set_dir_outputs(stepper->dir_outbits);
+
+    for(idx = 0; idx < count; idx++)
+        pattern[idx] = i2s_step_mask(steps[idx]);
+
+    *period = cycles_per_tick;
+
+    return count;
+}
+
 // Starts stepper driver ISR timer and forces a stepper driver interrupt callback
 static void I2S_stepperWakeUp (void)
 {
@@ -611,6 +677,14 @@ inline IRAM_ATTR static void set_step_outputs (axes_signals_t step_outbits)
     }
 }
 
+// Set duration of the leading idle level of the step pulse, i.e. the delay from the pulse is started until the step output changes.
+inline IRAM_ATTR static void set_step_delay (uint32_t duration)
+{
+    RMTMEM.chan[0].data32[0].duration0 = duration;
+    RMTMEM.chan[1].data32[0].duration0 = duration;
+    RMTMEM.chan[2].data32[0].duration0 = duration;
+}
+
 #endif
 
 // Starts stepper driver ISR timer and forces a stepper driver interrupt callback
@@ -655,10 +729,25 @@ IRAM_ATTR static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 }
 
 // Sets stepper direction and pulse pins and starts a step pulse
+// With RMT output the step pulse delay is only inserted on direction changes, it is removed again
+// from the pulse items on the next step after the delayed pulse has been output.
 IRAM_ATTR static void stepperPulseStart (stepper_t *stepper)
 {
+#ifdef USE_I2S_OUT
     if(stepper->dir_change)
         set_dir_outputs(stepper->dir_outbits);
+#else
+    if(stepper->dir_change) {
+        set_dir_outputs(stepper->dir_outbits);
+        if(rmt_pulse_delay && !rmt_delay_armed) {
+            set_step_delay(rmt_pulse_delay);
+            rmt_delay_armed = true;
+        }
+    } else if(rmt_delay_pulsed) {
+        set_step_delay(1);
+        rmt_delay_armed = rmt_delay_pulsed = false;
+    }
+#endif
 
     if(stepper->step_outbits.value) {
 #ifdef USE_I2S_OUT
@@ -670,6 +759,7 @@ IRAM_ATTR static void stepperPulseStart (stepper_t *stepper)
         i2s_set_step_outputs((axes_signals_t){0});
 #else
         set_step_outputs(stepper->step_outbits);
+        rmt_delay_pulsed = rmt_delay_armed;
 #endif
     }
 }
@@ -1012,6 +1102,12 @@ IRAM_ATTR static uint_fast16_t valueSetAtomic (volatile uint_fast16_t *ptr, uint
     return prev;
 }
 
+// Yields to other tasks for a tick when the main loop has nothing to do
+static void idleWait (void)
+{
+    vTaskDelay(1);
+}
+
 #if MPG_MODE_ENABLE
 
 IRAM_ATTR static void modeSelect (bool mpg_mode)
@@ -1028,15 +1124,15 @@ IRAM_ATTR static void modeSelect (bool mpg_mode)
         memcpy(&prev_stream, &hal.stream, sizeof(io_stream_t));
         hal.stream.type = StreamType_MPG;
         hal.stream.read = serial2Read;
+        hal.stream.read_block = NULL;
         hal.stream.write = serial_stream.write;
         hal.stream.get_rx_buffer_available = serial2RXFree;
         hal.stream.reset_read_buffer = serial2Flush;
         hal.stream.cancel_read_buffer = serial2Cancel;
         hal.stream.suspend_read = serial2SuspendInput;
+        hal.stream.reset_read_buffer(); // Discard stale MPG input
     } else if(hal.stream.read != NULL)
-        memcpy(&hal.stream, &prev_stream, sizeof(io_stream_t));
-
-    hal.stream.reset_read_buffer();
+        memcpy(&hal.stream, &prev_stream, sizeof(io_stream_t)); // Input buffered while in MPG mode is kept
 
     sys.mpg_mode = mpg_mode;
     sys.report.mpg_mode = On;
@@ -1160,6 +1256,7 @@ static void settings_changed (settings_t *settings)
         if(i2s_step_length < I2S_OUT_USEC_PER_PULSE)
             i2s_step_length = I2S_OUT_USEC_PER_PULSE;
         i2s_step_samples = i2s_step_length / I2S_OUT_USEC_PER_PULSE; // round up?
+        i2s_out_set_pulse_samples(i2s_step_samples);
 #else
         initRMT(settings);
 #endif
@@ -1451,6 +1548,33 @@ static bool driver_setup (settings_t *settings)
     return IOInitDone;
 }
 
+#if SEGMENT_PREP_TASK
+
+static TaskHandle_t prep_task = NULL;
+
+// Step segment prep task, woken when the segment buffer runs low and from the Grbl task.
+// NOTE: Runs on the same core and with higher priority than the Grbl task, so it preempts it.
+static void vSegmentPrepTask (void *arg)
+{
+    while(true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        hal.stepper.prep_callback();
+    }
+}
+
+IRAM_ATTR static void stepperPrepTrigger (void)
+{
+    if(xPortInIsrContext()) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(prep_task, &xHigherPriorityTaskWoken);
+        if(xHigherPriorityTaskWoken)
+            portYIELD_FROM_ISR();
+    } else
+        xTaskNotifyGive(prep_task);
+}
+
+#endif
+
 #if MODBUS_ENABLE
 static void vModBusPollCallback (TimerHandle_t xTimer)
 {
@@ -1495,6 +1619,12 @@ bool driver_init (void)
     hal.stepper.pulse_start = I2S_stepperPulseStart;
     i2s_out_init();
     i2s_out_set_pulse_callback(hal.stepper.interrupt_callback);
+    i2s_out_set_stream_callback(I2S_stepperStream);
+#endif
+
+#if SEGMENT_PREP_TASK
+    if(xTaskCreatePinnedToCore(vSegmentPrepTask, "Prep", 4096, NULL, 1, &prep_task, GRBL_CORE) == pdPASS)
+        hal.stepper.prep_trigger = stepperPrepTrigger;
 #endif
 
     hal.limits.enable = limitsEnable;
@@ -1539,6 +1669,7 @@ bool driver_init (void)
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
     hal.get_elapsed_ticks = xTaskGetTickCountFromISR;
+    hal.idle_wait = idleWait;
 
 #ifdef DEBUGOUT
     hal.debug_out = debug_out;
@@ -1565,6 +1696,9 @@ bool driver_init (void)
 #endif
     hal.driver_cap.software_debounce = On;
     hal.driver_cap.step_pulse_delay = On;
+#ifndef USE_I2S_OUT
+    hal.driver_cap.step_pulse_delay_dir_only = On;
+#endif
     hal.driver_cap.amass_level = 3;
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
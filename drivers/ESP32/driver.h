@@ -67,6 +67,11 @@
 #define AUTH_ENABLE 1
 #endif
 
+#ifdef FLASHFS_LITTLEFS
+#undef FLASHFS_LITTLEFS
+#define FLASHFS_LITTLEFS 1
+#endif
+
 #ifdef SDCARD_ENABLE
 #undef SDCARD_ENABLE
 #define SDCARD_ENABLE 1
@@ -141,6 +146,13 @@ static const DRAM_ATTR float FZERO = 0.0f;
 #define WIFI_SOFTAP      0
 #endif
 
+// Set to 0 to keep Wi-Fi power save enabled when a job is running. When enabled modem sleep is turned off
+// and the network streams are polled more often while in cycle, hold, jog, homing or tool change state,
+// avoiding 100+ ms latency spikes for commands such as feed hold and jog cancel. Restored when idle.
+#ifndef WIFI_LATENCY_MODE
+#define WIFI_LATENCY_MODE 1
+#endif
+
 #ifndef KEYPAD_ENABLE
 #define KEYPAD_ENABLE    0
 #endif
@@ -160,6 +172,10 @@ static const DRAM_ATTR float FZERO = 0.0f;
 #define AUTH_ENABLE      0
 #endif
 
+#ifndef SEGMENT_PREP_TASK
+#define SEGMENT_PREP_TASK 0
+#endif
+
 #ifndef SDCARD_ENABLE
 #define SDCARD_ENABLE    0
 #endif
@@ -168,11 +184,27 @@ static const DRAM_ATTR float FZERO = 0.0f;
 #define WEBUI_ENABLE     0
 #endif
 
+#ifndef FLASHFS_LITTLEFS
+#define FLASHFS_LITTLEFS 0
+#endif
+
 #ifndef TRINAMIC_ENABLE
 #define TRINAMIC_ENABLE  0
 #define TRINAMIC_I2C     0
 #endif
 
+// Core partitioning: the Grbl task (parser, planner and motion control), segment prep and the
+// stepper interrupt run on GRBL_CORE, the Wi-Fi and Bluetooth stacks, lwIP, the HTTP daemon and
+// other communication tasks run on COMMS_CORE so that network traffic does not preempt motion.
+// NOTE: the Wi-Fi, Bluetooth and lwIP task affinity is set in sdkconfig and has to match COMMS_CORE.
+#ifndef GRBL_CORE
+#define GRBL_CORE        1
+#endif
+
+#ifndef COMMS_CORE
+#define COMMS_CORE       0
+#endif
+
 // end configuration
 
 #if !WIFI_ENABLE
@@ -104,7 +104,7 @@ IRAM_ATTR static void _uart1_isr (void *arg)
 
         c = uart1->dev->fifo.rw_byte;
 
-        if(c == ESP_CMD_TOOL_ACK && !rxbuffer.backup) {
+        if(c == ESP_CMD_TOOL_ACK && !rxbuffer.backup && hal.stream.type != StreamType_MPG) {
 
             memcpy(&rxbackup, &rxbuffer, sizeof(stream_rx_buffer_t));
             rxbuffer.backup = true;
@@ -399,25 +399,28 @@ IRAM_ATTR void serial2Direction(bool tx)
 
 #else
 
+// Enables or disables MPG input. The main stream is kept enabled, input received while in MPG mode
+// is buffered and read when MPG mode is left, realtime commands are acted upon from both.
 IRAM_ATTR void serialSelect(bool mpg_mode)
 {
-    uart_t *uart_on = mpg_mode ? uart2 : uart1;
-    uart_t *uart_off = mpg_mode ? uart1 : uart2;
-
-    // Disable interrupts
-    uart_off->dev->int_ena.rxfifo_full = 0;
-    uart_off->dev->int_ena.frm_err = 0;
-    uart_off->dev->int_ena.rxfifo_tout = 0;
-
-    flush(uart_on);
-
-    // Clear and enable interrupts
-    uart_on->dev->int_clr.rxfifo_full = 1;
-    uart_on->dev->int_clr.frm_err = 1;
-    uart_on->dev->int_clr.rxfifo_tout = 1;
-    uart_on->dev->int_ena.rxfifo_full = 1;
-    uart_on->dev->int_ena.frm_err = 1;
-    uart_on->dev->int_ena.rxfifo_tout = 1;
+    if(mpg_mode) {
+
+        flush(uart2);
+
+        // Clear and enable interrupts
+        uart2->dev->int_clr.rxfifo_full = 1;
+        uart2->dev->int_clr.frm_err = 1;
+        uart2->dev->int_clr.rxfifo_tout = 1;
+        uart2->dev->int_ena.rxfifo_full = 1;
+        uart2->dev->int_ena.frm_err = 1;
+        uart2->dev->int_ena.rxfifo_tout = 1;
+
+    } else {
+        // Disable interrupts
+        uart2->dev->int_ena.rxfifo_full = 0;
+        uart2->dev->int_ena.frm_err = 0;
+        uart2->dev->int_ena.rxfifo_tout = 0;
+    }
 }
 
 #endif
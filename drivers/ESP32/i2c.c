@@ -57,21 +57,8 @@ void I2CTask (void *queue)
         }
 #endif
 #if IOEXPAND_ENABLE
-        if(task.action == 2) { // Write to I/O expander (from ISR)
-            if(i2cBusy != NULL && xSemaphoreTake(i2cBusy, 5 / portTICK_PERIOD_MS) == pdTRUE) {
-
-                i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-                i2c_master_start(cmd);
-                i2c_master_write_byte(cmd, IOEX_ADDRESS|I2C_MASTER_WRITE, true);
-                i2c_master_write_byte(cmd, RW_OUTPUT, true);
-                i2c_master_write_byte(cmd, (uint8_t)((uint32_t)task.params & 0xFF), true);
-                i2c_master_stop(cmd);
-                i2c_master_cmd_begin(I2C_PORT, cmd, 1000 / portTICK_PERIOD_MS);
-                i2c_cmd_link_delete(cmd);
-
-                xSemaphoreGive(i2cBusy);
-            }
-        }
+        if(task.action == 2) // Write I/O expander shadow register
+            ioexpand_write();
 #endif
     }
 }
@@ -101,7 +88,7 @@ void I2CInit (void)
 
         TaskHandle_t I2CTaskHandle;
 
-        xTaskCreatePinnedToCore(I2CTask, "I2C", 2048, (void *)i2cQueue, configMAX_PRIORITIES, &I2CTaskHandle, 1);
+        xTaskCreatePinnedToCore(I2CTask, "I2C", 2048, (void *)i2cQueue, configMAX_PRIORITIES, &I2CTaskHandle, COMMS_CORE);
 
         xSemaphoreGive(i2cBusy);
     }
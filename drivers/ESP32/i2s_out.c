@@ -122,6 +122,15 @@ static int i2s_out_initialized = 0;
 static volatile uint64_t             i2s_out_pulse_period;
 static uint64_t                      i2s_out_remain_time_until_next_pulse;  // Time remaining until the next pulse (usec)
 static volatile i2s_out_pulse_func_t i2s_out_pulse_func;
+static volatile i2s_out_stream_func_t i2s_out_stream_func;
+static uint32_t                      i2s_out_pulse_samples = 1;
+
+// Step patterns fetched from the stream callback, not yet written to the DMA buffer
+static struct {
+    uint32_t pattern[I2S_OUT_STREAM_BATCH];
+    uint32_t count;
+    uint32_t pos;
+} i2s_out_stream;
 #    endif
 
 static uint8_t i2s_out_ws_pin   = 255;
@@ -363,8 +372,38 @@ static int IRAM_ATTR i2s_fillout_dma_buffer(lldesc_t* dma_desc) {
         while (o_dma.rw_pos < (DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT)) {
             // no data to read (buffer empty)
             if (i2s_out_remain_time_until_next_pulse < I2S_OUT_USEC_PER_PULSE) {
+                // fetch the next batch of step patterns when the previous one is written to the buffer
+                if (i2s_out_pulser_status == STEPPING && i2s_out_stream_func != NULL && i2s_out_stream.pos == i2s_out_stream.count) {
+                    uint64_t period = 0;
+                    I2S_OUT_PULSER_EXIT_CRITICAL();   // Temporarily unlocked status lock as it may be locked in stream callback.
+                    i2s_out_stream.count = (*i2s_out_stream_func)(i2s_out_stream.pattern, I2S_OUT_STREAM_BATCH, &period);
+                    I2S_OUT_PULSER_ENTER_CRITICAL();  // Lock again.
+                    i2s_out_stream.pos = 0;
+                    if (i2s_out_stream.count) {
+                        i2s_out_pulse_period = period * 1000000 / F_STEPPER_TIMER;
+                    }
+                    if (i2s_out_pulser_status == WAITING) {
+                        // Segment buffer is empty, i2s_out_set_passthrough() has called from the stream callback.
+                        dma_desc->qe.stqe_next = NULL;  // Cut the DMA descriptor ring. This allow us to identify the tail of the buffer.
+                    } else if (i2s_out_pulser_status == PASSTHROUGH) {
+                        i2s_out_remain_time_until_next_pulse = 0;                 // There is no need to fill the current buffer.
+                        o_dma.rw_pos                         = DMA_SAMPLE_COUNT;  // The buffer is full.
+                        break;
+                    }
+                }
+                // output the next step pulse from the stream, every pulse fits in the SAMPLE_SAFE_COUNT margin
+                if (i2s_out_pulser_status == STEPPING && i2s_out_stream.pos < i2s_out_stream.count) {
+                    uint32_t port_data = atomic_load(&i2s_out_port_data);
+                    uint32_t mask      = i2s_out_stream.pattern[i2s_out_stream.pos++];
+                    uint32_t n         = 0;
+                    do {
+                        buf[o_dma.rw_pos++] = port_data ^ mask;
+                    } while (++n < i2s_out_pulse_samples);
+                    i2s_out_remain_time_until_next_pulse += i2s_out_pulse_period - I2S_OUT_USEC_PER_PULSE * n;
+                    continue;
+                }
                 // pulser status may change in pulse phase func, so I need to check it every time.
-                if (i2s_out_pulser_status == STEPPING) {
+                if (i2s_out_pulser_status == STEPPING && (i2s_out_stream_func == NULL || i2s_out_stream.count == 0)) {
                     // fillout future DMA buffer (tail of the DMA buffer chains)
                     if (i2s_out_pulse_func != NULL) {
                         uint32_t old_rw_pos = o_dma.rw_pos;
@@ -410,6 +449,7 @@ static int IRAM_ATTR i2s_fillout_dma_buffer(lldesc_t* dma_desc) {
         i2s_clear_dma_buffer(dma_desc, 0);  // Essentially, no clearing is required. I'll make sure I know when I've written something.
         o_dma.rw_pos                         = 0;  // If someone calls i2s_out_push_sample, make sure there is no buffer overflow
         i2s_out_remain_time_until_next_pulse = 0;
+        i2s_out_stream.count = i2s_out_stream.pos = 0;
     }
     I2S_OUT_PULSER_EXIT_CRITICAL();  // Unlock pulser status
 
@@ -544,10 +584,15 @@ void IRAM_ATTR i2s_out_delay() {
 
 void IRAM_ATTR i2s_out_write(uint8_t pin, uint8_t val) {
     uint32_t bit = bit(pin);
+    uint32_t port_data;
     if (val) {
-        atomic_fetch_or(&i2s_out_port_data, bit);
+        port_data = atomic_fetch_or(&i2s_out_port_data, bit);
     } else {
-        atomic_fetch_and(&i2s_out_port_data, ~bit);
+        port_data = atomic_fetch_and(&i2s_out_port_data, ~bit);
+    }
+    // i2s_out_port_data is the shadow register, skip the output update if the pin state is unchanged.
+    if (!!(port_data & bit) == !!val) {
+        return;
     }
 #    ifdef USE_I2S_OUT_STREAM_IMPL
     // It needs a lock for access, but I've given up because I need speed.
@@ -662,10 +707,25 @@ int IRAM_ATTR i2s_out_set_pulse_callback(i2s_out_pulse_func_t func) {
     return 0;
 }
 
+int IRAM_ATTR i2s_out_set_stream_callback(i2s_out_stream_func_t func) {
+#    ifdef USE_I2S_OUT_STREAM_IMPL
+    i2s_out_stream_func = func;
+#    endif
+    return 0;
+}
+
+int IRAM_ATTR i2s_out_set_pulse_samples(uint32_t num) {
+#    ifdef USE_I2S_OUT_STREAM_IMPL
+    i2s_out_pulse_samples = num < 1 ? 1 : (num > SAMPLE_SAFE_COUNT ? SAMPLE_SAFE_COUNT : num);
+#    endif
+    return 0;
+}
+
 int IRAM_ATTR i2s_out_reset() {
     I2S_OUT_PULSER_ENTER_CRITICAL();
     i2s_out_stop();
 #    ifdef USE_I2S_OUT_STREAM_IMPL
+    i2s_out_stream.count = i2s_out_stream.pos = 0;  // Discard pending step patterns
     if (i2s_out_pulser_status == STEPPING) {
         uint32_t port_data = atomic_load(&i2s_out_port_data);
         i2s_clear_o_dma_buffers(port_data);
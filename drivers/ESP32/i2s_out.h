@@ -65,8 +65,17 @@
 #    define I2S_OUT_DELAY_DMABUF_MS (I2S_OUT_DMABUF_LEN / sizeof(uint32_t) * I2S_OUT_USEC_PER_PULSE / 1000)
 #    define I2S_OUT_DELAY_MS (I2S_OUT_DELAY_DMABUF_MS * (I2S_OUT_DMABUF_COUNT + 1))
 
+#    define I2S_OUT_STREAM_BATCH 32 /* maximum number of step patterns fetched per stream callback */
+
 typedef void (*i2s_out_pulse_func_t)(void);
 
+/*
+    Step stream callback, fills pattern with up to max masks of the expanded port bits to pulse, one per step.
+    period is set to the step period in stepper timer ticks.
+    return: number of patterns, 0 if none are available.
+ */
+typedef uint32_t (*i2s_out_stream_func_t)(uint32_t *pattern, uint32_t max, uint64_t *period);
+
 typedef struct {
     /*
         I2S bitstream (32-bits): Transfers from MSB(bit31) to LSB(bit0) in sequence
@@ -165,6 +174,18 @@ int i2s_out_set_pulse_period(uint64_t period);
  */
 int i2s_out_set_pulse_callback(i2s_out_pulse_func_t func);
 
+/*
+   Register a callback function to fetch step patterns for a segment.
+   When set the step pulses are generated directly in the DMA buffer, the pulse
+   callback is then only called if the stream callback has no patterns to provide.
+ */
+int i2s_out_set_stream_callback(i2s_out_stream_func_t func);
+
+/*
+   Set the number of samples a step pulse from the stream callback is output for.
+ */
+int i2s_out_set_pulse_samples(uint32_t num);
+
 /*
    Get current pulser mode
  */
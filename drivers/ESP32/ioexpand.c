@@ -29,8 +29,33 @@
 
 #include "ioexpand.h"
 
+/*
+  Output pin changes are written to a shadow register and flushed in a single I2C transaction by the I2C task.
+  Changes made from thread context are accumulated until the end of the current realtime pass,
+  changes made from interrupt context are flushed immediately. At most one write is queued at a time, the I2C task
+  writes the shadow register content when it runs so changes made while a write is pending are coalesced.
+  Writes are skipped when the shadow register content matches what was last written to the expander.
+  Latency is bounded by one pass of protocol_execute_realtime() plus one I2C transaction (~0.3 ms @ 100 kHz).
+*/
+
+static volatile uint8_t shadow = 0, written = 0;
+static volatile bool queued = false;
+static on_execute_realtime_ptr on_execute_realtime = NULL;
+
+static void ioexpand_execute_realtime (uint_fast16_t state)
+{
+    ioexpand_flush();
+
+    on_execute_realtime(state);
+}
+
 void ioexpand_init (void)
 {
+    if(on_execute_realtime == NULL) {
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = ioexpand_execute_realtime;
+    }
+
     if(i2cBusy != NULL && xSemaphoreTake(i2cBusy, 5 / portTICK_PERIOD_MS) == pdTRUE) {
 
         // 0 = output, 1 = input
@@ -61,32 +86,72 @@ void ioexpand_init (void)
         i2c_master_stop(cmd);
         i2c_master_cmd_begin(I2C_PORT, cmd, 1000 / portTICK_PERIOD_MS);
 
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, IOEX_ADDRESS|I2C_MASTER_WRITE, true);
+        i2c_master_write_byte(cmd, RW_OUTPUT, true);
+        i2c_master_write_byte(cmd, shadow, true);
+        i2c_master_stop(cmd);
+        if(i2c_master_cmd_begin(I2C_PORT, cmd, 1000 / portTICK_PERIOD_MS) == ESP_OK)
+            written = shadow;
+
         i2c_cmd_link_delete(cmd);
 
         xSemaphoreGive(i2cBusy);
     }
 }
 
+// Updates the shadow register, the expander is written on the next flush.
 IRAM_ATTR void ioexpand_out (ioexpand_t pins)
 {
-    static i2c_task_t i2c_task = {
+    shadow = pins.mask;
+
+    if(xPortInIsrContext())
+        ioexpand_flush();
+}
+
+// Queues a write of the shadow register to the expander if it has changed and no write is pending.
+IRAM_ATTR void ioexpand_flush (void)
+{
+    static const i2c_task_t i2c_task = {
         .action = 2,
         .params = NULL
     };
 
-    if(xPortInIsrContext()) {
-        i2c_task.params = (void *)((uint32_t)pins.mask);
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        xQueueSendFromISR(i2cQueue, (void *)&i2c_task, &xHigherPriorityTaskWoken);
-    } else if(i2cBusy != NULL && xSemaphoreTake(i2cBusy, 5 / portTICK_PERIOD_MS) == pdTRUE) {
+    if(shadow != written && !queued && i2cQueue != NULL) {
+
+        queued = true;
+
+        if(xPortInIsrContext()) {
+            BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+            if(xQueueSendFromISR(i2cQueue, (void *)&i2c_task, &xHigherPriorityTaskWoken) != pdTRUE)
+                queued = false;
+            else if(xHigherPriorityTaskWoken)
+                portYIELD_FROM_ISR();
+        } else if(xQueueSend(i2cQueue, (void *)&i2c_task, 0) != pdTRUE)
+            queued = false;
+    }
+}
+
+// Writes the shadow register to the expander, called from the I2C task.
+// A failed write is retried on the next flush.
+void ioexpand_write (void)
+{
+    uint8_t mask;
+
+    queued = false;
+
+    if(i2cBusy != NULL && xSemaphoreTake(i2cBusy, 5 / portTICK_PERIOD_MS) == pdTRUE) {
+
+        mask = shadow;
 
         i2c_cmd_handle_t cmd = i2c_cmd_link_create();
         i2c_master_start(cmd);
         i2c_master_write_byte(cmd, IOEX_ADDRESS|I2C_MASTER_WRITE, true);
         i2c_master_write_byte(cmd, RW_OUTPUT, true);
-        i2c_master_write_byte(cmd, pins.mask, true);
+        i2c_master_write_byte(cmd, mask, true);
         i2c_master_stop(cmd);
-        i2c_master_cmd_begin(I2C_PORT, cmd, 1000 / portTICK_PERIOD_MS);
+        if(i2c_master_cmd_begin(I2C_PORT, cmd, 1000 / portTICK_PERIOD_MS) == ESP_OK)
+            written = mask;
         i2c_cmd_link_delete(cmd);
 
         xSemaphoreGive(i2cBusy);
@@ -36,6 +36,8 @@
 
 void ioexpand_init (void);
 void ioexpand_out (ioexpand_t pins);
+void ioexpand_flush (void);
+void ioexpand_write (void);
 ioexpand_t ioexpand_in (void);
 
 #endif
@@ -36,6 +36,7 @@
 #include <stdbool.h>
 
 #include "grbl/grbllib.h"
+#include "driver.h"
 
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -58,5 +59,5 @@ void app_main(void)
             ret = nvs_flash_init();
     }
 
-    xTaskCreatePinnedToCore(vGrblTask, "Grbl", 4096, NULL, 0, NULL, 1);
+    xTaskCreatePinnedToCore(vGrblTask, "Grbl", 4096, NULL, 0, NULL, GRBL_CORE);
 }
@@ -38,6 +38,7 @@
 //#define SDCARD_ENABLE      1 // Run gcode programs from SD card, requires sdcard plugin.
 //#define BLUETOOTH_ENABLE   1 // Enable Bloetooht streaming.
 //#define MPG_MODE_ENABLE    1 // Enable MPG mode (secondary serial port)
+//#define SEGMENT_PREP_TASK  1 // Run step segment prep from a FreeRTOS task woken by the stepper interrupt.
 #define EEPROM_ENABLE      1 // I2C EEPROM support. Set to 1 for 24LC16(2K), 2 for larger sizes. Requires eeprom plugin.
 //#define EEPROM_IS_FRAM     1 // Uncomment when EEPROM is enabled and chip is FRAM, this to remove write delay.
 
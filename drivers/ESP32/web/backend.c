@@ -82,6 +82,54 @@ static file_server_data_t file_server_data, spiff_fs_data;
 static file_server_data_t sd_fs_data;
 #endif
 
+// Creates an entity tag from the content, a 32-bit FNV-1a hash. Intended for data embedded in flash,
+// computed once and kept by the caller.
+char *http_etag_from_data (http_etag_t etag, const unsigned char *data, size_t size)
+{
+    uint32_t hash = 2166136261UL;
+
+    while(size--)
+        hash = (hash ^ *data++) * 16777619UL;
+
+    sprintf(etag, "\"%08x\"", (unsigned int)hash);
+
+    return etag;
+}
+
+// Adds the ETag and Cache-Control headers to the response. If the request If-None-Match header matches
+// the entity tag a 304 Not Modified response is sent and true is returned, the caller must not send any content.
+// NOTE: the header values are referenced until the response is sent.
+bool http_not_modified (httpd_req_t *req, const char *etag, const char *cache_control)
+{
+    bool match = false;
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+
+    if(len > 0 && len < sizeof(http_etag_t) * 4) {
+        char if_none_match[sizeof(http_etag_t) * 4];
+        if(httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, len + 1) == ESP_OK)
+            match = strstr(if_none_match, etag) != NULL || !strcmp(if_none_match, "*");
+    }
+
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", cache_control);
+
+    if(match) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+    }
+
+    return match;
+}
+
+// Returns true if the client accepts gzip encoded content.
+static bool accepts_gzip (httpd_req_t *req)
+{
+    char encoding[64];
+    size_t len = httpd_req_get_hdr_value_len(req, "Accept-Encoding");
+
+    return len > 0 && len < sizeof(encoding) && httpd_req_get_hdr_value_str(req, "Accept-Encoding", encoding, len + 1) == ESP_OK && strstr(encoding, "gzip");
+}
+
 /* Handler to redirect incoming GET request for /index.html to /
  * This can be overridden by uploading file with same name */
 static esp_err_t redirect_html_get_handler(httpd_req_t *req, char *location)
@@ -98,9 +146,17 @@ static esp_err_t redirect_html_get_handler(httpd_req_t *req, char *location)
 
 static esp_err_t favicon_get_handler(httpd_req_t *req)
 {
+    static http_etag_t etag = "";
     extern const unsigned char favicon_ico_start[] asm("_binary_favicon_ico_start");
     extern const unsigned char favicon_ico_end[]   asm("_binary_favicon_ico_end");
     const size_t favicon_ico_size = (favicon_ico_end - favicon_ico_start);
+
+    if(*etag == '\0')
+        http_etag_from_data(etag, favicon_ico_start, favicon_ico_size);
+
+    if(http_not_modified(req, etag, HTTP_CACHE_CONTROL_ASSET))
+        return ESP_OK;
+
     httpd_resp_set_type(req, "image/x-icon");
     return httpd_resp_send(req, (const char *)favicon_ico_start, favicon_ico_size);
 }
@@ -244,8 +300,15 @@ esp_err_t spiffs_get_handler (httpd_req_t *req)
 
     FILE *file;
     struct stat st;
+    http_etag_t etag;
+    fs_filepath_t gzpath;
+    bool gzipped = false;
 
-    if (stat(filepath, &st) != 0) {
+    // Serve a pre-compressed version of the file if present and accepted by the client.
+    if(strlen(filepath) + 3 < sizeof(fs_filepath_t) && !IS_FILE_EXT(filepath, ".gz") && accepts_gzip(req))
+        gzipped = stat(strcat(strcpy(gzpath, filepath), ".gz"), &st) == 0;
+
+    if (!gzipped && stat(filepath, &st) != 0) {
         /* If file not present on SPIFFS check if URI
          * corresponds to one of the hardcoded paths */
         if (strcmp(filename, "/index.html") == 0) {
@@ -257,13 +320,24 @@ esp_err_t spiffs_get_handler (httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    if ((file = fopen(filepath, "r")) == NULL) {
+    // Files may be replaced by uploads, the entity tag is derived from the size and modification time.
+    sprintf(etag, "\"%lx-%lx\"", (unsigned long)st.st_size, (unsigned long)st.st_mtime);
+
+    if(http_not_modified(req, etag, "no-cache"))
+        return ESP_OK;
+
+    if ((file = fopen(gzipped ? gzpath : filepath, "r")) == NULL) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
         return ESP_FAIL;
     }
 
     set_content_type_from_file(req, filename);
 
+    if(gzipped) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    }
+
     size_t chunksize;
     char *chunk = ((file_server_data_t *)req->user_ctx)->scratch;
 
@@ -879,6 +953,7 @@ bool httpdaemon_start (network_settings_t *network)
     config.server_port = network->http_port;
     config.uri_match_fn = httpd_uri_match_wildcard;
     config.stack_size = 10240;
+    config.core_id = COMMS_CORE;
 
     httpdaemon_stop();
 
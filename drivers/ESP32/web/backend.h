@@ -46,8 +46,17 @@ typedef struct {
 
 bool httpdaemon_start(network_settings_t *network);
 void httpdaemon_stop();
+// Cache-Control header value for assets that are not revalidated on each request.
+#ifndef HTTP_CACHE_CONTROL_ASSET
+#define HTTP_CACHE_CONTROL_ASSET "max-age=86400"
+#endif
+
+typedef char http_etag_t[24];
+
 esp_err_t set_content_type_from_file(httpd_req_t *req, const char *filename);
 char *http_get_key_value (char *qstring, char *key, char *s, size_t val_size);
+char *http_etag_from_data (http_etag_t etag, const unsigned char *data, size_t size);
+bool http_not_modified (httpd_req_t *req, const char *etag, const char *cache_control);
 
 #endif
 
@@ -35,6 +35,7 @@
 #include "upload.h"
 
 #include "networking/multipartparser.h"
+#include "grbl/state_machine.h"
 
 #if SDCARD_ENABLE
 #include "sdcard/sdcard.h"
@@ -42,6 +43,83 @@
 
 static struct multipartparser parser;
 static struct multipartparser_callbacks *sd_callbacks = NULL;
+static upload_stats_t stats = {0};
+static uint32_t started = 0;
+
+// Spools the upload while a job is running: a write is held off until the job has refilled its read-ahead
+// buffer from the card, and writes are paced to UPLOAD_RATE_JOB bytes per second.
+static bool fatfs_write (file_upload_t *upload, const char *data, size_t size)
+{
+    UINT count;
+    bool ok, job = !!(state_get() & (STATE_CYCLE|STATE_HOLD|STATE_JOG|STATE_TOOL_CHANGE));
+    uint32_t ms = hal.get_elapsed_ticks();
+
+#if SDCARD_ENABLE
+    if(job) {
+        uint32_t timeout = ms + UPLOAD_PREFETCH_WAIT;
+        while(sdcard_prefetch_pending() && (int32_t)(hal.get_elapsed_ticks() - timeout) < 0)
+            vTaskDelay(1);
+        ms = hal.get_elapsed_ticks();
+    }
+#endif
+
+    stats.writes++;
+
+    ok = f_write(upload->file.fatfs_handle, data, size, &count) == FR_OK && count == size;
+
+#if UPLOAD_RATE_JOB
+    if(job) {
+        uint32_t elapsed = hal.get_elapsed_ticks() - ms, period = (uint32_t)(((uint64_t)size * 1000) / UPLOAD_RATE_JOB);
+        if(period > elapsed)
+            vTaskDelay(pdMS_TO_TICKS(period - elapsed));
+    }
+#endif
+
+    return ok;
+}
+
+// Writes data in whole blocks, data is only copied to the staging buffer when needed to complete
+// a block. When the file pointer is sector aligned FatFs writes whole sectors straight from the
+// caller buffer (the HTTP receive buffer) to the card.
+static bool block_write (file_upload_t *upload, const char *data, size_t size)
+{
+    bool ok = true;
+    size_t n;
+
+    if(upload->block_fill) {
+        n = min(size, UPLOAD_BLOCK_SIZE - upload->block_fill);
+        memcpy(upload->block + upload->block_fill, data, n);
+        upload->block_fill += n;
+        data += n;
+        size -= n;
+        if(upload->block_fill == UPLOAD_BLOCK_SIZE) {
+            ok = fatfs_write(upload, upload->block, UPLOAD_BLOCK_SIZE);
+            upload->block_fill = 0;
+        }
+    }
+
+    if(ok && (n = size - (size % UPLOAD_BLOCK_SIZE))) {
+        ok = fatfs_write(upload, data, n);
+        data += n;
+        size -= n;
+    }
+
+    if(ok && size) {
+        memcpy(upload->block, data, size);
+        upload->block_fill = size;
+    }
+
+    return ok;
+}
+
+static bool block_flush (file_upload_t *upload)
+{
+    bool ok = upload->block_fill == 0 || fatfs_write(upload, upload->block, upload->block_fill);
+
+    upload->block_fill = 0;
+
+    return ok;
+}
 
 static void do_cleanup (file_upload_t *upload)
 {
@@ -115,6 +193,7 @@ static void on_header_done(struct multipartparser *parser)
                 upload->state = Upload_Write;
 
             upload->uploaded = 0;
+            upload->block_fill = 0;
         }
     }
 
@@ -154,13 +233,14 @@ static int on_data(struct multipartparser *parser, const char* data, size_t size
         case Upload_Write:
             {
                 size_t count;
-                if(upload->to_fatfs) {
-                    f_write(upload->file.fatfs_handle, data, size, &count);
-                } else
+                if(upload->to_fatfs)
+                    count = block_write(upload, data, size) ? size : 0;
+                else
                     count = fwrite(data, sizeof(char), size, upload->file.handle);
                 if(count != size)
                     upload->state = Upload_Failed;
                 upload->uploaded += count;
+                stats.bytes += count;
             }
             break;
 
@@ -187,8 +267,15 @@ static int on_part_end(struct multipartparser *parser)
 
         case Upload_Write:
             if(upload->to_fatfs) {
+                if(!block_flush(upload)) {
+                    do_cleanup(upload);
+                    break;
+                }
                 f_close(upload->file.fatfs_handle);
                 upload->file.fatfs_handle = NULL;
+#if SDCARD_ENABLE
+                sdcard_dir_cache_add(upload->filename, upload->uploaded);
+#endif
             } else {
                 fclose(upload->file.handle);
                 upload->file.handle = NULL;
@@ -212,6 +299,9 @@ static int on_body_end(struct multipartparser *parser)
 {
     ((file_upload_t *)parser->data)->state = Upload_Complete;
 
+    stats.ms = hal.get_elapsed_ticks() - started;
+    stats.active = false;
+
     return 0;
 }
 
@@ -238,6 +328,9 @@ bool upload_start (httpd_req_t *req, const char* boundary, bool to_fatfs)
             req->free_ctx = cleanup;
             memset(parser.data, 0, sizeof(file_upload_t));
             ((file_upload_t *)parser.data)->to_fatfs = to_fatfs;
+            memset(&stats, 0, sizeof(upload_stats_t));
+            stats.active = true;
+            started = hal.get_elapsed_ticks();
         }
     }
 
@@ -249,5 +342,14 @@ size_t upload_chunk (httpd_req_t *req, const char* data, size_t size)
     return multipartparser_execute(&parser, sd_callbacks, data, size);
 }
 
+// Returns statistics for the current or last upload, duration is updated while the upload is in progress.
+void upload_get_stats (upload_stats_t *upload_stats)
+{
+    if(stats.active)
+        stats.ms = hal.get_elapsed_ticks() - started;
+
+    memcpy(upload_stats, &stats, sizeof(upload_stats_t));
+}
+
 #endif
 
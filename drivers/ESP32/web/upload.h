@@ -29,6 +29,21 @@
 #include <esp_http_server.h>
 #include <esp_vfs_fat.h>
 
+// Size of the staging buffer used to coalesce upload data to whole sectors before writing to FatFs, must be a multiple of 512.
+#ifndef UPLOAD_BLOCK_SIZE
+#define UPLOAD_BLOCK_SIZE 4096
+#endif
+
+// Maximum rate in bytes per second of writes to the SD card while a job is running, 0 for no limit.
+#ifndef UPLOAD_RATE_JOB
+#define UPLOAD_RATE_JOB 65536
+#endif
+
+// Maximum time in milliseconds a write to the SD card is held off while the running job refills its read-ahead buffer.
+#ifndef UPLOAD_PREFETCH_WAIT
+#define UPLOAD_PREFETCH_WAIT 100
+#endif
+
 typedef enum
 {
     Upload_Parsing = 0,
@@ -57,10 +72,20 @@ typedef struct {
     FIL fatfs_fd;
     size_t size;
     size_t uploaded;
+    size_t block_fill;
+    char block[UPLOAD_BLOCK_SIZE];
 } file_upload_t;
 
+typedef struct {
+    uint32_t bytes;     // Number of bytes written to file
+    uint32_t writes;    // Number of file write calls
+    uint32_t ms;        // Upload duration in milliseconds
+    bool active;
+} upload_stats_t;
+
 bool upload_start (httpd_req_t *req, const char* boundary, bool to_fatfs);
 size_t upload_chunk (httpd_req_t *req, const char* data, size_t size);
+void upload_get_stats (upload_stats_t *stats);
 
 #endif
 
@@ -37,7 +37,6 @@
 #include <cJSON.h>
 
 #include <esp_log.h>
-#include <esp_spiffs.h>
 
 #include "grbl/report.h"
 #include "wifi.h"
@@ -676,9 +675,9 @@ status_code_t webui_command_handler (uint32_t command, char *args)
             {
                 char *cmd = get_arg(args, NULL, false);
                 status = Status_InvalidStatement;
-                if(!strcmp(cmd, "FORMAT") && esp_spiffs_mounted(NULL)) {
+                if(!strcmp(cmd, "FORMAT") && flashfs_mounted()) {
                     webui_print_chunk("Formating"); // sic
-                    if(esp_spiffs_format(NULL) == ESP_OK)
+                    if(flashfs_format())
                         status = Status_OK;
                 }
                 webui_print(status == Status_OK ? "...Done\n" : "error\n");
@@ -688,7 +687,7 @@ status_code_t webui_command_handler (uint32_t command, char *args)
         case WebUICmd_GetFlashFSCapacity:
             {
                 size_t total = 0, used = 0;
-                if(esp_spiffs_info(NULL, &total, &used) == ESP_OK) {
+                if(flashfs_info(&total, &used)) {
                     strcpy(response, "SPIFFS  Total:");
                     strcat(response, btoa(total));
                     strcat(response, " Used:");
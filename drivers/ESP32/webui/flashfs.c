@@ -34,6 +34,17 @@
 #include "flashfs.h"
 #include <esp_log.h>
 
+#if FLASHFS_LITTLEFS
+#include "esp_littlefs.h"
+#else
+#include "esp_spiffs.h"
+#endif
+
+// Size of the block buffer used for reading jobs, data is read from the filesystem one block at a time.
+#ifndef FLASHFS_BUFFER_SIZE
+#define FLASHFS_BUFFER_SIZE 512
+#endif
+
 typedef struct
 {
     FILE *handle;
@@ -42,8 +53,13 @@ typedef struct
     size_t pos;
     uint32_t line;
     uint8_t eol;
+    size_t buf_pos;
+    size_t buf_len;
+    char buffer[FLASHFS_BUFFER_SIZE];
 } file_t;
 
+static const char *TAG = "flashfs";
+
 static file_t file = {
     .handle = NULL,
     .size = 0,
@@ -78,8 +94,9 @@ static bool file_open (char *filename)
         file_close();
 
     if(stat(filename, &st) == 0 && (file.handle = fopen(filename, "r"))) {
+        setvbuf(file.handle, NULL, _IONBF, 0); // Data is buffered by file_read()
         file.size = st.st_size;
-        file.pos = 0;
+        file.pos = file.buf_pos = file.buf_len = 0;
         file.line = 0;
         file.eol = false;
         char *leafname = strrchr(filename, '/');
@@ -90,19 +107,28 @@ static bool file_open (char *filename)
     return file.handle != NULL;
 }
 
+// Returns the next character of the file from the block buffer, refilled when empty, or -1 on EOF or error.
+// The file position is tracked locally.
 static int16_t file_read (void)
 {
-    int c;
+    int16_t c = -1;
+
+    if(file.buf_pos == file.buf_len) {
+        file.buf_len = fread(file.buffer, 1, sizeof(file.buffer), file.handle);
+        file.buf_pos = 0;
+    }
 
-    if((c = fgetc(file.handle)) != EOF)
-        file.pos = ftell(file.handle);
+    if(file.buf_pos < file.buf_len) {
+        c = (int16_t)(uint8_t)file.buffer[file.buf_pos++];
+        file.pos++;
+    }
 
     if(c == '\r' || c == '\n')
         file.eol++;
     else
         file.eol = 0;
 
-    return (int16_t)c;
+    return c;
 }
 
 static void flashfs_end_job (void)
@@ -200,6 +226,7 @@ static message_code_t trap_feedback_message (message_code_t message_code)
         if(frewind) {
             fseek(file.handle, 0, SEEK_SET);
             file.pos = file.line = 0;
+            file.buf_pos = file.buf_len = 0;
             file.eol = false;
             report_feedback_message(Message_CycleStartToRerun);
             hal.stream.read = await_cycle_start;
@@ -234,10 +261,12 @@ static bool flashfs_suspend (bool suspend)
     if(suspend) {
         hal.stream.reset_read_buffer();
         hal.stream.read = active_stream.read;               // Restore normal stream input for tool change (jog etc)
+        hal.stream.read_block = active_stream.read_block;
         hal.stream.enqueue_realtime_command = active_stream.enqueue_realtime_command;
         hal.report.status_message = report_status_message;  // as well as normal status messages reporting
     } else {
         hal.stream.read = flashfs_read;                      // Resume reading from SD card
+        hal.stream.read_block = NULL;
         hal.stream.enqueue_realtime_command = drop_input_stream;
         hal.report.status_message = trap_status_report;     // and redirect status messages back to us
     }
@@ -259,6 +288,7 @@ status_code_t flashfs_stream_file (char *filename)
             memcpy(&active_stream, &hal.stream, sizeof(io_stream_t));   // Save current stream pointers
             hal.stream.type = StreamType_FlashFs;                       // then redirect to read from SD card instead
             hal.stream.read = flashfs_read;                             // ...
+            hal.stream.read_block = NULL;                               // ...
             hal.stream.enqueue_realtime_command = drop_input_stream;    // Drop input from current stream except realtime commands
 #if M6_ENABLE
             hal.stream.suspend_read = flashfs_suspend;                  // ...
@@ -291,6 +321,70 @@ void flashfs_reset (void)
     driver_reset();
 }
 
+// Mounts the flash filesystem at /spiffs, the path is kept for both SPIFFS and LittleFS.
+bool flashfs_mount (void)
+{
+#if FLASHFS_LITTLEFS
+    esp_vfs_littlefs_conf_t conf = {
+      .base_path = "/spiffs",
+      .partition_label = "storage",
+      .format_if_mount_failed = true
+    };
+
+    esp_err_t ret = esp_vfs_littlefs_register(&conf);
+#else
+    esp_vfs_spiffs_conf_t conf = {
+      .base_path = "/spiffs",
+      .partition_label = NULL,
+      .max_files = 50,
+      .format_if_mount_failed = true
+    };
+
+    // Use settings defined above to initialize and mount SPIFFS filesystem.
+    // Note: esp_vfs_spiffs_register is an all-in-one convenience function.
+    esp_err_t ret = esp_vfs_spiffs_register(&conf);
+#endif
+
+    if (ret != ESP_OK) {
+        if (ret == ESP_FAIL) {
+            ESP_LOGE(TAG, "Failed to mount or format filesystem");
+        } else if (ret == ESP_ERR_NOT_FOUND) {
+            ESP_LOGE(TAG, "Failed to find " FLASHFS_NAME " partition");
+        } else {
+            ESP_LOGE(TAG, "Failed to initialize " FLASHFS_NAME " (%s)", esp_err_to_name(ret));
+        }
+    }
+
+    return ret == ESP_OK;
+}
+
+bool flashfs_mounted (void)
+{
+#if FLASHFS_LITTLEFS
+    return esp_littlefs_mounted("storage");
+#else
+    return esp_spiffs_mounted(NULL);
+#endif
+}
+
+bool flashfs_format (void)
+{
+#if FLASHFS_LITTLEFS
+    return esp_littlefs_format("storage") == ESP_OK;
+#else
+    return esp_spiffs_format(NULL) == ESP_OK;
+#endif
+}
+
+bool flashfs_info (size_t *total, size_t *used)
+{
+#if FLASHFS_LITTLEFS
+    return esp_littlefs_info("storage", total, used) == ESP_OK;
+#else
+    return esp_spiffs_info(NULL, total, used) == ESP_OK;
+#endif
+}
+
 void flashfs_init (void)
 {
  //   hal.driver_reset = flashfs_reset;
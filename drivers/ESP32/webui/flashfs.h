@@ -25,6 +25,16 @@
 #include "driver.h"
 #include "grbl/grbl.h"
 
+#if FLASHFS_LITTLEFS
+#define FLASHFS_NAME "LittleFS"
+#else
+#define FLASHFS_NAME "SPIFFS"
+#endif
+
+bool flashfs_mount (void);
+bool flashfs_mounted (void);
+bool flashfs_format (void);
+bool flashfs_info (size_t *total, size_t *used);
 void flashfs_init (void);
 void flashfs_reset (void);
 status_code_t flashfs_stream_file (char *filename);
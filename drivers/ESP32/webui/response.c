@@ -32,12 +32,10 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
-#include "esp_spiffs.h"
 
 #include "webui.h"
 #include "grbl/grbl.h"
 
-static const char *TAG = "webui";
 
 static bool chunked = false;
 static httpd_req_t *http_request = NULL;
@@ -71,26 +69,7 @@ void webui_init (void)
 {
     grbl.on_user_command = webui_parse_command;
 
-    esp_vfs_spiffs_conf_t conf = {
-      .base_path = "/spiffs",
-      .partition_label = NULL,
-      .max_files = 50,
-      .format_if_mount_failed = true
-    };
-
-    // Use settings defined above to initialize and mount SPIFFS filesystem.
-    // Note: esp_vfs_spiffs_register is an all-in-one convenience function.
-    esp_err_t ret = esp_vfs_spiffs_register(&conf);
-
-    if (ret != ESP_OK) {
-        if (ret == ESP_FAIL) {
-            ESP_LOGE(TAG, "Failed to mount or format filesystem");
-        } else if (ret == ESP_ERR_NOT_FOUND) {
-            ESP_LOGE(TAG, "Failed to find SPIFFS partition");
-        } else {
-            ESP_LOGE(TAG, "Failed to initialize SPIFFS (%s)", esp_err_to_name(ret));
-        }
-    }
+    flashfs_mount();
 }
 
 void webui_set_http_request (httpd_req_t *req)
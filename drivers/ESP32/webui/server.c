@@ -33,7 +33,6 @@
 
 #include <cJSON.h>
 
-#include "esp_spiffs.h"
 
 #include "wifi.h"
 #include "webui.h"
@@ -43,11 +42,18 @@
 #include "networking/strutils.h"
 #include "web/upload.h"
 
+#include "grbl/state_machine.h"
+
 #if SDCARD_ENABLE
 #include "sdcard/sdcard.h"
 #include "esp_vfs_fat.h"
 #endif
 
+// Server task priority while uploading to the SD card during a job.
+#ifndef UPLOAD_PRIORITY_JOB
+#define UPLOAD_PRIORITY_JOB (tskIDLE_PRIORITY + 1)
+#endif
+
 #if AUTH_ENABLE
 static webui_auth_t *sessions = NULL;
 static webui_auth_level_t get_auth_level (httpd_req_t *req);
@@ -347,9 +353,10 @@ esp_err_t webui_sdcard_handler (httpd_req_t *req)
 
                 case 0: // delete
                     if(f_stat(fullname, &file) == FR_OK) {
-                        if(!(file.fattrib & AM_DIR) && f_unlink(fullname) == FR_OK)
+                        if(!(file.fattrib & AM_DIR) && f_unlink(fullname) == FR_OK) {
+                            sdcard_dir_cache_remove(fullname);
                             sprintf(status, "%s deleted", filename);
-                        else
+                        } else
                             sprintf(status, "Cannot delete %s!", filename);
                     } else
                         sprintf(status, "%s does not exist!", filename);
@@ -369,9 +376,10 @@ esp_err_t webui_sdcard_handler (httpd_req_t *req)
                     if(strlen(fullname) == 1)
                         strcpy(status, "Cannot delete root directory!");
                     else if(f_stat(fullname, &file) == FR_OK) {
-                        if(sd_rmdir(fullname))
+                        if(sd_rmdir(fullname)) {
+                            sdcard_dir_cache_remove(fullname);
                             sprintf(status, "%s deleted", filename);
-                        else
+                        } else
                             sprintf(status, "Error deleting %s!", filename);
                     } else
                         sprintf(status, "%s does not exist!", filename);
@@ -417,6 +425,12 @@ esp_err_t webui_sdcard_upload_handler (httpd_req_t *req)
         }
     }
 
+    // Run the server at reduced priority during a job so that the upload does not compete with motion.
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+
+    if(state_get() & (STATE_CYCLE|STATE_HOLD|STATE_JOG|STATE_TOOL_CHANGE))
+        vTaskPrioritySet(NULL, min(priority, UPLOAD_PRIORITY_JOB));
+
     fs_path_t path;
     char *scratch = ((file_server_data_t *)req->user_ctx)->scratch;
     file_upload_t *upload = (file_upload_t *)req->sess_ctx;
@@ -448,7 +462,16 @@ esp_err_t webui_sdcard_upload_handler (httpd_req_t *req)
         req->sess_ctx = NULL;
     }
 
-    hal.stream.write(ok ? "[MSG:Upload ok]\r\n" : "[MSG:Upload failed]\r\n");
+    vTaskPrioritySet(NULL, priority);
+
+    if(ok) {
+        upload_stats_t stats;
+        char msg[80];
+        upload_get_stats(&stats);
+        sprintf(msg, "[MSG:Upload ok, %u bytes in %u ms, %u KB/s]\r\n", stats.bytes, stats.ms, stats.ms ? stats.bytes / stats.ms : 0);
+        hal.stream.write(msg);
+    } else
+        hal.stream.write("[MSG:Upload failed]\r\n");
 
     if(rqhdr)
         free(rqhdr);
@@ -538,7 +561,7 @@ static bool spiffs_ls (httpd_req_t *req, char *path, char *status)
 
         size_t total = 0, used = 0;
 
-        if(esp_spiffs_info(NULL, &total, &used) == ESP_OK) {
+        if(flashfs_info(&total, &used)) {
 
             uint32_t pct_used = (used * 100) / total;
             cJSON_AddStringToObject(root, "total", btoa(total));
@@ -1060,10 +1083,20 @@ esp_err_t webui_login_handler (httpd_req_t *req)
     return ok && status == 200 ? ESP_OK : ESP_FAIL;
 }
 
+// The embedded UI is sent directly from the memory mapped flash. The URL is not versioned so the browser
+// is told to revalidate, this is answered by 304 Not Modified as long as the firmware is not updated.
 esp_err_t webui_index_html_get_handler (httpd_req_t *req)
 {
+    static http_etag_t etag = "";
     extern const unsigned char index_html_gz_start[] asm("_binary_index_html_gz_start");
     extern const unsigned char index_html_gz_end[]   asm("_binary_index_html_gz_end");
+
+    if(*etag == '\0')
+        http_etag_from_data(etag, index_html_gz_start, index_html_gz_end - index_html_gz_start);
+
+    if(http_not_modified(req, etag, "no-cache"))
+        return ESP_OK;
+
     set_content_type_from_file(req, "index.html");
     httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
     return httpd_resp_send(req, (const char *)index_html_gz_start, index_html_gz_end - index_html_gz_start);
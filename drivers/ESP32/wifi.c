@@ -41,6 +41,7 @@
 
 #include "networking/networking.h"
 #include "networking/utils.h"
+#include "networking/NetStats.h"
 //#include "lwip/timeouts.h"
 
 #include "wifi.h"
@@ -67,6 +68,10 @@ static ap_list_t ap_list = {0};
 static wifi_settings_t wifi;
 static driver_setting_ptrs_t driver_settings;
 static on_report_options_ptr on_report_options;
+static volatile uint32_t poll_interval = STREAM_POLL_INTERVAL;
+#if WIFI_LATENCY_MODE
+static on_state_change_ptr on_state_change;
+#endif
 
 ap_list_t *wifi_get_aplist (void)
 {
@@ -129,6 +134,27 @@ bool wifi_dns_running (void)
     return services.dns == On;
 }
 
+#if WIFI_LATENCY_MODE
+
+// Modem sleep delays frames to and from the station until the next DTIM beacon, turn it off while a job is running
+// so that realtime commands are not held up. The shorter poll interval takes effect from the next poll.
+static void onStateChanged (uint_fast16_t state)
+{
+    static bool job_mode = false;
+
+    bool job = !!(state & (STATE_CYCLE|STATE_HOLD|STATE_JOG|STATE_HOMING|STATE_TOOL_CHANGE));
+
+    if(job != job_mode && esp_wifi_set_ps(job ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM) != ESP_ERR_WIFI_NOT_INIT) {
+        job_mode = job;
+        poll_interval = job ? STREAM_POLL_INTERVAL_JOB : STREAM_POLL_INTERVAL;
+    }
+
+    if(on_state_change)
+        on_state_change(state);
+}
+
+#endif
+
 static void lwIPHostTimerHandler (void *arg)
 {
 #if TELNET_ENABLE
@@ -140,7 +166,7 @@ static void lwIPHostTimerHandler (void *arg)
         WsStreamPoll();
 #endif
     if(services.mask)
-        sys_timeout(STREAM_POLL_INTERVAL, lwIPHostTimerHandler, NULL);
+        sys_timeout(poll_interval, lwIPHostTimerHandler, NULL);
 }
 
 static void start_services (void)
@@ -150,7 +176,7 @@ static void start_services (void)
         TCPStreamInit();
         TCPStreamListen(network.telnet_port == 0 ? 23 : network.telnet_port);
         services.telnet = On;
-        sys_timeout(STREAM_POLL_INTERVAL, lwIPHostTimerHandler, NULL);
+        sys_timeout(poll_interval, lwIPHostTimerHandler, NULL);
     }
 #endif
 #if WEBSOCKET_ENABLE
@@ -158,7 +184,7 @@ static void start_services (void)
         WsStreamInit();
         WsStreamListen(network.websocket_port == 0 ? 80 : network.websocket_port);
         services.websocket = On;
-        sys_timeout(STREAM_POLL_INTERVAL, lwIPHostTimerHandler, NULL);
+        sys_timeout(poll_interval, lwIPHostTimerHandler, NULL);
     }
 #endif
 #if HTTP_ENABLE
@@ -928,6 +954,15 @@ bool wifi_init (void)
 
         on_report_options = grbl.on_report_options;
         grbl.on_report_options = reportIP;
+
+#if WIFI_LATENCY_MODE
+        on_state_change = grbl.on_state_change;
+        grbl.on_state_change = onStateChanged;
+#endif
+
+#if TELNET_ENABLE || WEBSOCKET_ENABLE
+        NetStatsInit();
+#endif
     }
 
     return driver_settings.nvs_address != 0;
@@ -28,6 +28,7 @@
 #include "esp_wifi.h"
 
 #define STREAM_POLL_INTERVAL 20 // Poll interval in milliseconds
+#define STREAM_POLL_INTERVAL_JOB 5 // Poll interval in milliseconds while a job is running, see WIFI_LATENCY_MODE
 
 typedef struct {
     uint16_t ap_num;
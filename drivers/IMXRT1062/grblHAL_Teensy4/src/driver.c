@@ -354,6 +354,7 @@ static void enetStreamWriteS (const char *data)
     const io_stream_t ethernet_stream = {
         .type = StreamType_Telnet,
         .read = TCPStreamGetC,
+        .read_block = TCPStreamReadBlock,
         .write = TCPStreamWriteS,
         .write_all = enetStreamWriteS,
         .get_rx_buffer_available = TCPStreamRxFree,
@@ -392,6 +393,7 @@ static void enetStreamWriteS (const char *data)
     const io_stream_t serial_stream = {
         .type = StreamType_Serial,
         .read = usb_serialGetC,
+        .read_block = usb_serialReadBlock,
         .write = usb_serialWriteS,
     #if ETHERNET_ENABLE
         .write_all = enetStreamWriteS,
@@ -652,7 +654,7 @@ static void stepperGoIdle (bool clear_signals)
 //       in order to avoid excessive delays on completion of motions
 // NOTE: If a 16 bit timer is used it may be neccesary to adjust the timer clock frequency (prescaler)
 //       to cover the needed range. Refer to actual drivers for code examples.
-static void stepperCyclesPerTick (uint32_t cycles_per_tick)
+ISR_CODE static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
     PIT_TCTRL0 &= ~PIT_TCTRL_TEN;
     PIT_LDVAL0 = cycles_per_tick < (1UL << 20) ? cycles_per_tick : 0x000FFFFFUL;
@@ -662,7 +664,7 @@ static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 
 // Start a stepper pulse, no delay version.
 // stepper_t struct is defined in grbl/stepper.h
-static void stepperPulseStart (stepper_t *stepper)
+ISR_CODE static void stepperPulseStart (stepper_t *stepper)
 {
 #ifdef SPINDLE_SYNC_ENABLE
     if(stepper->new_block && stepper->exec_segment->spindle_sync) {
@@ -687,7 +689,7 @@ static void stepperPulseStart (stepper_t *stepper)
 //       In the delayed step pulse interrupt handler the pulses are output and
 //       normal (no delay) operation is resumed.
 // stepper_t struct is defined in grbl/stepper.h
-static void stepperPulseStartDelayed (stepper_t *stepper)
+ISR_CODE static void stepperPulseStartDelayed (stepper_t *stepper)
 {
 #ifdef SPINDLE_SYNC_ENABLE
     if(stepper->new_block && stepper->exec_segment->spindle_sync) {
@@ -726,29 +728,15 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
 // Spindle sync version: sets stepper direction and pulse pins and starts a step pulse.
 // Switches back to "normal" version if spindle synchronized motion is finished.
 // TODO: add delayed pulse handling...
-static void stepperPulseStartSynchronized (stepper_t *stepper)
+ISR_CODE static void stepperPulseStartSynchronized (stepper_t *stepper)
 {
-    static bool sync = false;
-    static float block_start;
-
     if(stepper->new_block) {
         if(!stepper->exec_segment->spindle_sync) {
             hal.stepper.pulse_start = spindle_tracker.stepper_pulse_start_normal;
             hal.stepper.pulse_start(stepper);
             return;
         }
-        sync = true;
         set_dir_outputs(stepper->dir_outbits);
-        spindle_tracker.programmed_rate = stepper->exec_block->programmed_rate;
-        spindle_tracker.steps_per_mm = stepper->exec_block->steps_per_mm;
-        spindle_tracker.segment_id = 0;
-        spindle_tracker.prev_pos = 0.0f;
-        block_start = spindleGetData(SpindleData_AngularPosition).angular_position * spindle_tracker.programmed_rate;
-        pidf_reset(&spindle_tracker.pid);
-#ifdef PID_LOG
-        sys.pid_log.idx = 0;
-        sys.pid_log.setpoint = 100.0f;
-#endif
     }
 
     if(stepper->step_outbits.value) {
@@ -756,58 +744,8 @@ static void stepperPulseStartSynchronized (stepper_t *stepper)
         TMR4_CTRL0 |= TMR_CTRL_CM(0b001);
     }
 
-    if(spindle_tracker.segment_id != stepper->exec_segment->id) {
-
-        spindle_tracker.segment_id = stepper->exec_segment->id;
-
-        if(!stepper->new_block) {  // adjust this segments total time for any positional error since last segment
-
-            float actual_pos;
-
-            if(stepper->exec_segment->cruising) {
-
-                float dt = (float)hal.f_step_timer / (float)(stepper->exec_segment->cycles_per_tick * stepper->exec_segment->n_step);
-                actual_pos = spindleGetData(SpindleData_AngularPosition).angular_position * spindle_tracker.programmed_rate;
-
-                if(sync) {
-                    spindle_tracker.pid.sample_rate_prev = dt;
-//                    block_start += (actual_pos - spindle_tracker.block_start) - spindle_tracker.prev_pos;
-//                    block_start += spindle_tracker.prev_pos;
-                    sync = false;
-                }
-
-                actual_pos -= block_start;
-                int32_t step_delta = (int32_t)(pidf(&spindle_tracker.pid, spindle_tracker.prev_pos, actual_pos, dt) * spindle_tracker.steps_per_mm);
-
-
-                int32_t ticks = (((int32_t)stepper->step_count + step_delta) * (int32_t)stepper->exec_segment->cycles_per_tick) / (int32_t)stepper->step_count;
-
-                stepper->exec_segment->cycles_per_tick = (uint32_t)max(ticks, spindle_tracker.min_cycles_per_tick);
-
-                stepperCyclesPerTick(stepper->exec_segment->cycles_per_tick);
-           } else
-               actual_pos = spindle_tracker.prev_pos;
-
-#ifdef PID_LOG
-            if(sys.pid_log.idx < PID_LOG) {
-
-                sys.pid_log.target[sys.pid_log.idx] = spindle_tracker.prev_pos;
-                sys.pid_log.actual[sys.pid_log.idx] = actual_pos; // - spindle_tracker.prev_pos;
-
-            //    spindle_tracker.log[sys.pid_log.idx] = STEPPER_TIMER->BGLOAD << stepper->amass_level;
-            //    spindle_tracker.pos[sys.pid_log.idx] = stepper->exec_segment->cycles_per_tick  stepper->amass_level;
-            //    spindle_tracker.pos[sys.pid_log.idx] = stepper->exec_segment->cycles_per_tick * stepper->step_count;
-            //    STEPPER_TIMER->BGLOAD = STEPPER_TIMER->LOAD;
-
-             //   spindle_tracker.pos[sys.pid_log.idx] = spindle_tracker.prev_pos;
-
-                sys.pid_log.idx++;
-            }
-#endif
-        }
-
-        spindle_tracker.prev_pos = stepper->exec_segment->target_position;
-    }
+    if(spindle_sync_update(&spindle_tracker, stepper))
+        stepperCyclesPerTick(stepper->exec_segment->cycles_per_tick);
 }
 
 #endif
@@ -1666,6 +1604,11 @@ static void qei_reset (uint_fast8_t id)
     qei.vel_timeout = qei.encoder.axis != 0xFF ? QEI_VELOCITY_TIMEOUT : 0;
 }
 
+static int32_t qei_get_count (uint_fast8_t id)
+{
+    return qei.count;
+}
+
 // dummy handler, called on events if plugin init fails
 static void encoder_event (encoder_t *encoder, int32_t position)
 {
@@ -1675,6 +1618,13 @@ static void encoder_event (encoder_t *encoder, int32_t position)
 
 #endif
 
+#if ETHERNET_ENABLE && defined(ENABLE_DEFERRED_INIT)
+static void enet_start_deferred (uint_fast16_t state)
+{
+    grbl_enet_start();
+}
+#endif
+
 // Initializes MCU peripherals for Grbl use
 static bool driver_setup (settings_t *settings)
 {
@@ -1919,6 +1869,9 @@ static bool driver_setup (settings_t *settings)
 #endif
 
 #if ETHERNET_ENABLE
+  #ifdef ENABLE_DEFERRED_INIT
+    if(!protocol_enqueue_rt_command(enet_start_deferred))
+  #endif
     grbl_enet_start();
 #endif
 
@@ -1954,10 +1907,14 @@ bool nvsWrite (uint8_t *source)
 
 #endif
 
-#if ETHERNET_ENABLE || ADD_MSEVENT
+#if ADD_MSEVENT
+
+static on_execute_realtime_ptr on_execute_realtime;
 
 static void execute_realtime (uint_fast16_t state)
 {
+    on_execute_realtime(state);
+
 #if ADD_MSEVENT
     if(ms_event) {
 
@@ -1984,10 +1941,6 @@ static void execute_realtime (uint_fast16_t state)
   #endif
     }
 #endif // ADD_MSEVENT
-
-#if ETHERNET_ENABLE
-    grbl_enet_poll();
-#endif
 }
 
 #endif
@@ -2007,6 +1960,18 @@ void uart_debug_write (char *s)
 }
 #endif
 
+// DWT cycle counter, enabled by Teensy startup code
+static uint32_t getCycleCount (void)
+{
+    return ARM_DWT_CYCCNT;
+}
+
+// Sleeps until the next interrupt, at the latest the 1 ms systick, when the main loop has nothing to do
+static void idleWait (void)
+{
+    asm volatile("wfi");
+}
+
 // Cold restart (T4.x has no reset button)
 static void reboot (void)
 {
@@ -2130,13 +2095,17 @@ bool driver_init (void)
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
     hal.get_elapsed_ticks = millis;
+    hal.get_cycle_count = getCycleCount;
+    hal.idle_wait = idleWait;
 
-#if ETHERNET_ENABLE || ADD_MSEVENT
+#if ADD_MSEVENT
+    on_execute_realtime = grbl.on_execute_realtime;
     grbl.on_execute_realtime = execute_realtime;
 #endif
 
 #if QEI_ENABLE
     hal.encoder.reset = qei_reset;
+    hal.encoder.get_count = qei_get_count;
     hal.encoder.on_event = encoder_event;
 #endif
 
@@ -2227,7 +2196,7 @@ bool driver_init (void)
 /* interrupt handlers */
 
 // Main stepper driver.
-static void stepper_driver_isr (void)
+ISR_CODE static void stepper_driver_isr (void)
 {
     if(PIT_TFLG0 & PIT_TFLG_TIF) {
         PIT_TFLG0 |= PIT_TFLG_TIF;
@@ -2246,14 +2215,14 @@ static void stepper_driver_isr (void)
 // This interrupt is enabled when Grbl sets the motor port bits to execute
 // a step. This ISR resets the motor port after a short period (settings.pulse_microseconds)
 // completing one step cycle.
-static void stepper_pulse_isr (void)
+ISR_CODE static void stepper_pulse_isr (void)
 {
     TMR4_CSCTRL0 &= ~TMR_CSCTRL_TCF1;
 
     set_step_outputs((axes_signals_t){0});
 }
 
-static void stepper_pulse_isr_delayed (void)
+ISR_CODE static void stepper_pulse_isr_delayed (void)
 {
     TMR4_CSCTRL0 &= ~TMR_CSCTRL_TCF1;
 
@@ -62,6 +62,9 @@
 #ifndef ODOMETER_ENABLE
 #define ODOMETER_ENABLE     0
 #endif
+#ifndef SPINDLE_SELECT_ENABLE
+#define SPINDLE_SELECT_ENABLE 0
+#endif
 
 #ifndef ETHERNET_ENABLE
 #define ETHERNET_ENABLE     0
@@ -72,6 +75,9 @@
 #ifndef WEBSOCKET_ENABLE
 #define WEBSOCKET_ENABLE    0
 #endif
+#ifndef UDP_REALTIME_ENABLE
+#define UDP_REALTIME_ENABLE 0
+#endif
 
 #ifndef SDCARD_ENABLE
 #define SDCARD_ENABLE       0
@@ -130,6 +136,9 @@
 #ifndef NETWORK_HTTP_PORT
 #define NETWORK_HTTP_PORT       80
 #endif
+#ifndef ETHERNET_POLL_PERIOD
+#define ETHERNET_POLL_PERIOD    1 // ms, interval between polls of the Ethernet interface and the network streams
+#endif
 #if NETWORK_IPMODE < 0 || NETWORK_IPMODE > 2
 #error "Invalid IP mode selected!"
 #endif
@@ -34,10 +34,13 @@
 #include "lwip/dhcp.h"
 
 #include "grbl/report.h"
+#include "grbl/protocol.h"
 #include "grbl/nvs_buffer.h"
 
 #include "networking/TCPStream.h"
 #include "networking/WsStream.h"
+#include "networking/UDPRealtime.h"
+#include "networking/NetStats.h"
 
 static volatile bool linkUp = false;
 static char IPAddress[IP4ADDR_STRLEN_MAX];
@@ -74,6 +77,9 @@ static void netif_status_callback (struct netif *netif)
         TCPStreamInit();
         TCPStreamListen(network.telnet_port == 0 ? 23 : network.telnet_port);
         services.telnet = On;
+  #if UDP_REALTIME_ENABLE
+        UDPRealtimeListen(network.telnet_port == 0 ? 23 : network.telnet_port); // Same port number as Telnet
+  #endif
     }
 #endif
 
@@ -86,34 +92,43 @@ static void netif_status_callback (struct netif *netif)
 #endif
 }
 
-void grbl_enet_poll (void)
+// Run by the realtime task scheduler so that received frames are drained and the streams are polled
+// at a steady rate regardless of how busy the foreground is.
+static void grbl_enet_poll (uint_fast16_t state)
 {
-    static uint32_t last_ms0, last_ms1;
+    static uint32_t last_ms;
     uint32_t ms;
 
     enet_proc_input();
 
-    ms = millis();
-
-    if(ms - last_ms0 > 1) {
-        last_ms0 = ms;
 #if TELNET_ENABLE
-        if(services.telnet)
-          TCPStreamPoll();
+    if(services.telnet)
+      TCPStreamPoll();
+  #if UDP_REALTIME_ENABLE
+    if(services.telnet)
+      UDPRealtimePoll();
+  #endif
 #endif
-    #if WEBSOCKET_ENABLE
-        if(services.websocket)
-          WsStreamPoll();
+#if WEBSOCKET_ENABLE
+    if(services.websocket)
+      WsStreamPoll();
 #endif
-    }
 
-    if (ms - last_ms1 > 25)
+    ms = millis();
+
+    if (ms - last_ms > 25)
     {
-        last_ms1 = ms;
+        last_ms = ms;
         enet_poll();
     }
 }
 
+static rt_task_t enet_task = {
+    .name = "Ethernet",
+    .fn = grbl_enet_poll,
+    .period = ETHERNET_POLL_PERIOD
+};
+
 bool grbl_enet_start (void)
 {
     if(driver_settings.nvs_address != 0) {
@@ -136,6 +151,8 @@ bool grbl_enet_start (void)
     #endif
         if(network.ip_mode == IpMode_DHCP)
             dhcp_start(netif_default);
+
+        protocol_add_rt_task(&enet_task);
     }
 
     return driver_settings.nvs_address != 0;
@@ -382,6 +399,10 @@ bool grbl_enet_init (network_settings_t *settings)
 
         on_report_options = grbl.on_report_options;
         grbl.on_report_options = reportIP;
+
+#if TELNET_ENABLE || WEBSOCKET_ENABLE
+        NetStatsInit();
+#endif
     }
 
     return driver_settings.nvs_address != 0;
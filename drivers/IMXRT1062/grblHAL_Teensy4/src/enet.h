@@ -26,6 +26,5 @@
 
 bool grbl_enet_init (void);
 bool grbl_enet_start (void);
-void grbl_enet_poll (void);
 
 #endif
@@ -177,6 +177,7 @@ typedef struct {
     volatile uint8_t acount;
     uint8_t *data;
     uint8_t regaddr[2];
+    volatile uint32_t completed;    // Time of completion of last transmit, in ms
 #if KEYPAD_ENABLE
     keycode_callback_ptr keycode_callback;
 #endif
@@ -301,12 +302,24 @@ uint8_t *I2C_ReadRegister (uint32_t i2cAddr, uint8_t *buf, uint8_t abytes, uint1
 
 #if EEPROM_ENABLE
 
+// Writes are interrupt driven and not waited for, txbuf holds the data until sent.
+// The write cycle wait is deferred to the next transfer.
 nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *transfer, bool read)
 {
     static uint8_t txbuf[NVS_SIZE + 2];
+#if !EEPROM_IS_FRAM
+    static bool write_pending = false;
+#endif
 
     while(i2cIsBusy);
 
+#if !EEPROM_IS_FRAM
+    if(write_pending) {
+        write_pending = false;
+        while(millis() - i2c.completed < 8); // 7 ms write cycle + 1 ms for timer resolution
+    }
+#endif
+
     if(read) {
         if(transfer->word_addr_bytes == 1)
             i2c.regaddr[0] = transfer->word_addr;
@@ -323,9 +336,9 @@ nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *transfer, bool read)
             txbuf[0] = transfer->word_addr >> 8;
             txbuf[1] = transfer->word_addr & 0xFF;
         }
-        I2C_Send(transfer->address, txbuf, transfer->count + transfer->word_addr_bytes, true);
+        I2C_Send(transfer->address, txbuf, transfer->count + transfer->word_addr_bytes, false);
 #if !EEPROM_IS_FRAM
-        hal.delay_ms(7, NULL);
+        write_pending = true;
 #endif
     }
 
@@ -454,6 +467,7 @@ hal.stream.write(ASCII_EOL);
         case I2CState_AwaitCompletion:
             port->MIER &= ~LPI2C_MIER_TDIE;
             port->MTDR = LPI2C_MTDR_CMD_STOP;
+            i2c.completed = millis();
             i2c.count = 0;
             i2c.state = I2CState_Idle;
             break;
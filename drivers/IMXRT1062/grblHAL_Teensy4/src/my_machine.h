@@ -48,6 +48,7 @@ N_AXIS has a default value of 3, edit grbl\config.h to increase.
 #define USB_SERIAL_CDC       2 // 1 for Arduino class library and 2 for PJRC C library. Comment out to use UART communication.
 //#define USB_SERIAL_WAIT    1 // Wait for USB connection before starting grblHAL.
 //#define SPINDLE_HUANYANG   1 // Set to 1 or 2 for Huanyang VFD spindle. Requires spindle plugin.
+//#define SPINDLE_SELECT_ENABLE 1 // Keep the PWM spindle or laser when a VFD spindle is enabled, select with M104 P<n>. Requires spindle plugin.
 //#define QEI_ENABLE         1 // Enable quadrature encoder interfaces. Max value is 1. Requires encoder plugin.
 //#define ETHERNET_ENABLE    1 // Ethernet streaming. Requires networking plugin.
 //#define SDCARD_ENABLE      1 // Run gcode programs from SD card, requires sdcard plugin.
@@ -64,6 +65,8 @@ N_AXIS has a default value of 3, edit grbl\config.h to increase.
 #if ETHERNET_ENABLE > 0
 #define TELNET_ENABLE           1 // Telnet daemon - requires Ethernet streaming enabled.
 #define WEBSOCKET_ENABLE        1 // Websocket daemon - requires Ethernet streaming enabled.
+//#define UDP_REALTIME_ENABLE     1 // UDP realtime command and telemetry channel on the Telnet port number - requires Telnet enabled.
+//#define UDP_REALTIME_KEY        "secret" // Datagrams must start with this key to be accepted.
 #define NETWORK_HOSTNAME        "GRBL"
 #define NETWORK_IPMODE          1 // 0 = static, 1 = DHCP, 2 = AutoIP
 #define NETWORK_IP              "192.168.5.1"
@@ -183,6 +183,14 @@ int16_t usb_serialGetC (void)
     return (int16_t)data;
 }
 
+//
+// usb_serialReadBlock - returns number of characters copied, stops after first end of line character
+//
+uint16_t usb_serialReadBlock (char *buf, uint16_t size)
+{
+    return stream_rx_buffer_read_block(&usb_rxbuffer, buf, size);
+}
+
 // "dummy" version of serialGetC
 static int16_t serialGetNull (void)
 {
@@ -191,8 +199,10 @@ static int16_t serialGetNull (void)
 
 bool usb_serialSuspendInput (bool suspend)
 {
-    if(suspend)
+    if(suspend) {
         hal.stream.read = serialGetNull;
+        hal.stream.read_block = NULL;
+    }
     else if(usb_rxbuffer.backup)
         memcpy(&usb_rxbuffer, &usb_rxbackup, sizeof(stream_rx_buffer_t));
 
@@ -225,6 +235,7 @@ void usb_execute_realtime (uint_fast16_t state)
                 usb_rxbuffer.backup = true;
                 usb_rxbuffer.tail = usb_rxbuffer.head;
                 hal.stream.read = usb_serialGetC; // restore normal input
+                hal.stream.read_block = usb_serialReadBlock;
             } else if(!hal.stream.enqueue_realtime_command(c)) {
                 uint32_t bptr = (usb_rxbuffer.head + 1) & (RX_BUFFER_SIZE - 1); // Get next head pointer
                 if(bptr == usb_rxbuffer.tail)                                   // If buffer full
@@ -33,6 +33,7 @@ extern void usb_execute_realtime (uint_fast16_t state);
 
 void usb_serialInit(void);
 int16_t usb_serialGetC(void);
+uint16_t usb_serialReadBlock(char *buf, uint16_t size);
 bool usb_serialPutC(const char c);
 void usb_serialWriteS(const char *s);
 void usb_serialWriteLn(const char *s);
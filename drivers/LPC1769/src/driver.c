@@ -1133,6 +1133,7 @@ bool driver_init (void) {
 #endif
     hal.driver_cap.software_debounce = On;
     hal.driver_cap.step_pulse_delay = On;
+    hal.driver_cap.step_pulse_delay_dir_only = On;
     hal.driver_cap.amass_level = 3;
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
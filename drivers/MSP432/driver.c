@@ -308,27 +308,13 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
 // TODO: add delayed pulse handling...
 static void stepperPulseStartSynchronized (stepper_t *stepper)
 {
-    static bool sync = false;
-    static float block_start;
-
     if(stepper->new_block) {
         if(!stepper->exec_segment->spindle_sync) {
             hal.stepper.pulse_start = spindle_tracker.stepper_pulse_start_normal;
             hal.stepper.pulse_start(stepper);
             return;
         }
-        sync = true;
         set_dir_outputs(stepper->dir_outbits);
-        spindle_tracker.programmed_rate = stepper->exec_block->programmed_rate;
-        spindle_tracker.steps_per_mm = stepper->exec_block->steps_per_mm;
-        spindle_tracker.segment_id = 0;
-        spindle_tracker.prev_pos = 0.0f;
-        block_start = spindleGetData(SpindleData_AngularPosition).angular_position * spindle_tracker.programmed_rate;
-        pidf_reset(&spindle_tracker.pid);
-#ifdef PID_LOG
-        sys.pid_log.idx = 0;
-        sys.pid_log.setpoint = 100.0f;
-#endif
     }
 
     if(stepper->step_outbits.value) {
@@ -336,58 +322,8 @@ static void stepperPulseStartSynchronized (stepper_t *stepper)
         PULSE_TIMER->CTL |= TIMER_A_CTL_CLR|TIMER_A_CTL_MC1;
     }
 
-    if(spindle_tracker.segment_id != stepper->exec_segment->id) {
-
-        spindle_tracker.segment_id = stepper->exec_segment->id;
-
-        if(!stepper->new_block) {  // adjust this segments total time for any positional error since last segment
-
-            float actual_pos;
-
-            if(stepper->exec_segment->cruising) {
-
-                float dt = (float)hal.f_step_timer / (float)(stepper->exec_segment->cycles_per_tick * stepper->exec_segment->n_step);
-                actual_pos = spindleGetData(SpindleData_AngularPosition).angular_position * spindle_tracker.programmed_rate;
-
-                if(sync) {
-                    spindle_tracker.pid.sample_rate_prev = dt;
-//                    block_start += (actual_pos - spindle_tracker.block_start) - spindle_tracker.prev_pos;
-//                    block_start += spindle_tracker.prev_pos;
-                    sync = false;
-                }
-
-                actual_pos -= block_start;
-                int32_t step_delta = (int32_t)(pidf(&spindle_tracker.pid, spindle_tracker.prev_pos, actual_pos, dt) * spindle_tracker.steps_per_mm);
-
-
-                int32_t ticks = (((int32_t)stepper->step_count + step_delta) * (int32_t)stepper->exec_segment->cycles_per_tick) / (int32_t)stepper->step_count;
-
-                stepper->exec_segment->cycles_per_tick = (uint32_t)max(ticks, (int32_t)spindle_tracker.min_cycles_per_tick);
-
-                stepperCyclesPerTick(stepper->exec_segment->cycles_per_tick);
-           } else
-               actual_pos = spindle_tracker.prev_pos;
-
-#ifdef PID_LOG
-            if(sys.pid_log.idx < PID_LOG) {
-
-                sys.pid_log.target[sys.pid_log.idx] = spindle_tracker.prev_pos;
-                sys.pid_log.actual[sys.pid_log.idx] = actual_pos; // - spindle_tracker.prev_pos;
-
-                spindle_tracker.log[sys.pid_log.idx] = STEPPER_TIMER->BGLOAD << stepper->amass_level;
-            //    spindle_tracker.pos[sys.pid_log.idx] = stepper->exec_segment->cycles_per_tick  stepper->amass_level;
-                spindle_tracker.pos[sys.pid_log.idx] = stepper->exec_segment->cycles_per_tick * stepper->step_count;
-                STEPPER_TIMER->BGLOAD = STEPPER_TIMER->LOAD;
-
-             //   spindle_tracker.pos[sys.pid_log.idx] = spindle_tracker.prev_pos;
-
-                sys.pid_log.idx++;
-            }
-#endif
-        }
-
-        spindle_tracker.prev_pos = stepper->exec_segment->target_position;
-    }
+    if(spindle_sync_update(&spindle_tracker, stepper))
+        stepperCyclesPerTick(stepper->exec_segment->cycles_per_tick);
 }
 
 // Enable/disable limit pins interrupt
@@ -755,7 +691,6 @@ static spindle_data_t spindleGetData (spindle_data_request_t request)
     // If no (4) spindle pulses during last 250mS assume RPM is 0
     if((stopped = ((pulse_length == 0) || (rpm_timer_delta > spindle_encoder.maximum_tt)))) {
         spindle_data.rpm = 0.0f;
-        rpm_timer_delta = (RPM_COUNTER->R - (uint16_t)spindle_encoder.counter.last_count) * pulse_length;
     }
 
     switch(request) {
@@ -767,20 +702,15 @@ static spindle_data_t spindleGetData (spindle_data_request_t request)
         case SpindleData_RPM:
             if(!stopped)
 #ifdef SPINDLE_RPM_CONTROLLED
-                spindle_data.rpm = spindle_control.pid_enabled ? spindle_control.rpm : spindle_calc_rpm(pulse_length);
+                spindle_data.rpm = spindle_control.pid_enabled ? spindle_control.rpm : spindle_encoder_get_rpm(&spindle_encoder, 0 - RPM_TIMER->VALUE);
 #else
-                spindle_data.rpm = spindle_calc_rpm(pulse_length);
+                spindle_data.rpm = spindle_encoder_get_rpm(&spindle_encoder, 0 - RPM_TIMER->VALUE);
 #endif
             break;
 
-        case SpindleData_AngularPosition:;
-            int32_t d = (uint16_t)spindle_encoder.counter.last_count - (uint16_t)spindle_encoder.counter.last_index;
-            if(d < 0)
-                d++;
+        case SpindleData_AngularPosition: // Predicted position at the time of the request
             spindle_data.angular_position = (float)spindle_data.index_count +
-                    ((float)((uint16_t)spindle_encoder.counter.last_count - (uint16_t)spindle_encoder.counter.last_index) +
-                              (pulse_length == 0 ? 0.0f : (float)rpm_timer_delta / (float)pulse_length)) *
-                                spindle_encoder.pulse_distance;
+                                             spindle_encoder_predict(&spindle_encoder, 0 - RPM_TIMER->VALUE, NULL) * spindle_encoder.pulse_distance;
             break;
     }
 
@@ -816,6 +746,7 @@ static void spindleDataReset (void)
     spindle_encoder.timer.pulse_length = 0;
     spindle_encoder.counter.last_count = 0;
     spindle_encoder.counter.last_index = 0;
+    spindle_encoder_log_reset(&spindle_encoder);
 
     spindle_data.pulse_count = 0;
     spindle_data.index_count = 0;
@@ -987,6 +918,7 @@ void settings_changed (settings_t *settings)
         spindle_encoder.pulse_distance = 1.0f / spindle_encoder.ppr;
         spindle_encoder.maximum_tt = (uint32_t)(0.25f / timer_resolution) * spindle_encoder.counter.tics_per_irq; // 250 mS
         spindle_encoder.rpm_factor = 60.0f / ((timer_resolution * (float)spindle_encoder.ppr));
+        spindle_encoder.window_tt = (uint32_t)((float)SPINDLE_RPM_WINDOW / (1000.0f * timer_resolution));
         BITBAND_PERI(RPM_INDEX_PORT->IE, RPM_INDEX_PIN) = 1;
         spindleDataReset();
     }
@@ -1485,6 +1417,7 @@ bool driver_init (void)
     hal.driver_cap.mist_control = On;
     hal.driver_cap.software_debounce = On;
     hal.driver_cap.step_pulse_delay = On;
+    hal.driver_cap.step_pulse_delay_dir_only = On;
     hal.driver_cap.amass_level = 3;
 #if ESTOP_ENABLE
     hal.driver_cap.e_stop = On;
@@ -1522,6 +1455,8 @@ bool driver_init (void)
 
 #if SPINDLE_HUANYANG > 0
     huanyang_init(&modbus_stream);
+#elif SPINDLE_VFD > 0
+    vfd_init(&modbus_stream);
 #endif
 
 #if PLASMA_ENABLE
@@ -1603,6 +1538,8 @@ void RPMCOUNTER_IRQHandler (void)
     spindle_encoder.counter.last_count = cval;
     spindle_encoder.timer.pulse_length = spindle_encoder.timer.last_pulse - tval;
     spindle_encoder.timer.last_pulse = tval;
+
+    spindle_encoder_log_event(&spindle_encoder, spindle_data.pulse_count, 0 - tval); // NOTE: timer is counting down!
 }
 
 #if CNC_BOOSTERPACK_SHORTS
@@ -1617,6 +1554,7 @@ void CONTROL_IRQHandler (void)
     if(iflags & RPM_INDEX_BIT) {
         spindle_encoder.counter.last_index = RPM_COUNTER->R;
         spindle_encoder.timer.last_index = RPM_TIMER->VALUE;
+        spindle_encoder_log_index(&spindle_encoder, spindle_data.pulse_count + (uint16_t)(spindle_encoder.counter.last_index - spindle_encoder.counter.last_count));
         spindle_data.index_count++;
     }
 
@@ -1712,8 +1650,9 @@ void CONTROL_FH_CS_IRQHandler (void)
     CONTROL_PORT_FH->IFG = 0;
 
     if(iflags & RPM_INDEX_BIT) {
-        spindle_encoder.counter.last_index = RPM_TIMER->VALUE;
-        spindle_encoder.timer.last_index = RPM_COUNTER->R;
+        spindle_encoder.counter.last_index = RPM_COUNTER->R;
+        spindle_encoder.timer.last_index = RPM_TIMER->VALUE;
+        spindle_encoder_log_index(&spindle_encoder, spindle_data.pulse_count + (uint16_t)(spindle_encoder.counter.last_index - spindle_encoder.counter.last_count));
         spindle_data.index_count++;
     }
 
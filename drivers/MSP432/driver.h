@@ -53,6 +53,9 @@
 #ifndef SPINDLE_HUANYANG
 #define SPINDLE_HUANYANG        0
 #endif
+#ifndef SPINDLE_VFD
+#define SPINDLE_VFD             0
+#endif
 #ifndef KEYPAD_ENABLE
 #define KEYPAD_ENABLE           0
 #endif
@@ -119,6 +122,8 @@
 
 #if SPINDLE_HUANYANG
 #include "spindle/huanyang.h"
+#elif SPINDLE_VFD
+#include "spindle/vfd.h"
 #endif
 
 #if TRINAMIC_ENABLE
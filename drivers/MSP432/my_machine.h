@@ -26,6 +26,7 @@
 // Uncomment to enable, for some a value > 1 may be assigned, if so the default value is shown.
 
 //#define SPINDLE_HUANYANG   1 // Set to 1 or 2 for Huanyang VFD spindle. Requires spindle plugin.
+//#define SPINDLE_VFD        1 // Set to a VFD profile number for ModBus VFD spindle, see spindle/vfd.h. Requires spindle plugin.
 //#define KEYPAD_ENABLE      1 // I2C keypad for jogging etc., requires keypad plugin.
 #define TRINAMIC_ENABLE    1 // Trinamic TMC2130 stepper driver support. NOTE: work in progress.
 #define TRINAMIC_I2C       1 // Trinamic I2C - SPI bridge interface.
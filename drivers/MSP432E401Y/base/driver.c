@@ -105,6 +105,7 @@ static void enetStreamWriteS (const char *data)
     const io_stream_t ethernet_stream = {
         .type = StreamType_Telnet,
         .read = TCPStreamGetC,
+        .read_block = TCPStreamReadBlock,
         .write = TCPStreamWriteS,
         .write_all = enetStreamWriteS,
         .get_rx_buffer_available = TCPStreamRxFree,
@@ -1111,6 +1112,7 @@ static void modeSelect (bool mpg_mode)
     if(mpg_mode) {
         normal_stream = hal.stream.type;
         hal.stream.read = serial2GetC;
+        hal.stream.read_block = NULL;
         hal.stream.get_rx_buffer_available = serial2RxFree;
         hal.stream.cancel_read_buffer = serial2RxCancel;
         hal.stream.reset_read_buffer = serial2RxFlush;
@@ -1731,6 +1733,7 @@ bool driver_init (void)
     hal.driver_cap.mist_control = On;
     hal.driver_cap.software_debounce = On;
     hal.driver_cap.step_pulse_delay = On;
+    hal.driver_cap.step_pulse_delay_dir_only = On;
     hal.driver_cap.amass_level = 3;
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
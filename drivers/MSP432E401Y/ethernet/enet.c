@@ -57,6 +57,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "networking/networking.h"
 #include "networking/TCPStream.h"
 #include "networking/WsStream.h"
+#include "networking/NetStats.h"
 
 #define SYSTICK_INT_PRIORITY    0x80
 #define ETHERNET_INT_PRIORITY   0xC0
@@ -478,6 +479,10 @@ bool enet_init (void)
 
         on_report_options = grbl.on_report_options;
         grbl.on_report_options = reportIP;
+
+#if TELNET_ENABLE || WEBSOCKET_ENABLE
+        NetStatsInit();
+#endif
     }
 
     return driver_settings.nvs_address != 0;
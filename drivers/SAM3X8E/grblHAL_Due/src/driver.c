@@ -1602,6 +1602,8 @@ bool driver_init (void)
 
 #if SPINDLE_HUANYANG
     huanyang_init(&modbus_stream);
+#elif SPINDLE_VFD
+    vfd_init(&modbus_stream);
 #endif
 
     my_plugin_init();
@@ -63,6 +63,9 @@ void IRQUnRegister(int32_t IRQnum);
 #ifndef SPINDLE_HUANYANG
 #define SPINDLE_HUANYANG    0
 #endif
+#ifndef SPINDLE_VFD
+#define SPINDLE_VFD         0
+#endif
 #ifndef SDCARD_ENABLE
 #define SDCARD_ENABLE       0
 #endif
@@ -124,6 +127,8 @@ void IRQUnRegister(int32_t IRQnum);
 
 #if SPINDLE_HUANYANG
 #include "spindle/huanyang.h"
+#elif SPINDLE_VFD
+#include "spindle/vfd.h"
 #endif
 
 #if EEPROM_ENABLE || KEYPAD_ENABLE || (TRINAMIC_ENABLE && TRINAMIC_I2C)
@@ -930,8 +930,12 @@ bool nvsInit (void)
 // End EEPROM emulation
 
 #if USB_SERIAL_CDC
+static on_execute_realtime_ptr on_execute_realtime;
+
 static void execute_realtime (uint_fast16_t state)
 {
+    on_execute_realtime(state);
+
 #if USB_SERIAL_CDC
     usb_execute_realtime(state);
 #endif
@@ -1044,6 +1048,7 @@ bool driver_init (void) {
     hal.get_elapsed_ticks = millis;
 
 #if USB_SERIAL_CDC
+    on_execute_realtime = grbl.on_execute_realtime;
     grbl.on_execute_realtime = execute_realtime;
 #endif
 
@@ -24,6 +24,8 @@
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
+#include <malloc.h>
+#include <unistd.h>
 
 #include "main.h"
 
@@ -533,6 +535,47 @@ static uint32_t getElapsedTicks (void)
     return uwTick;
 }
 
+// Sleeps until the next interrupt, at the latest the 1 ms systick, when the main loop has nothing to do
+static void idleWait (void)
+{
+    __WFI();
+}
+
+// The stack, shared by the main loop and the interrupts, grows down from _estack towards the heap.
+// The free memory between them is painted at startup, the lowest address that has been overwritten is the high-water mark.
+#define STACK_PAINT 0xA5A5A5A5
+#define STACK_PAINT_MARGIN 64 // Bytes below the current stack pointer left unpainted
+
+extern uint32_t _estack;
+
+static uint32_t *heapTop (void)
+{
+    return (uint32_t *)(((uint32_t)sbrk(0) + 3) & ~0x03);
+}
+
+static void stackPaint (void)
+{
+    uint32_t *p = heapTop(), *sp = (uint32_t *)(__get_MSP() - STACK_PAINT_MARGIN);
+
+    while(p < sp)
+        *p++ = STACK_PAINT;
+}
+
+static bool getMemoryInfo (memory_info_t *info)
+{
+    struct mallinfo mi = mallinfo();
+    uint32_t *heap = heapTop(), *p = heap, *sp = (uint32_t *)__get_MSP();
+
+    while(p < sp && *p == STACK_PAINT)
+        p++;
+
+    info->heap_free = mi.fordblks;
+    info->stack_used = (uint32_t)&_estack - (uint32_t)p;
+    info->unused = (uint32_t)p - (uint32_t)heap;
+
+    return true;
+}
+
 // Configures peripherals when settings are initialized or changed
 void settings_changed (settings_t *settings)
 {
@@ -939,6 +982,8 @@ bool driver_init (void)
 
     __HAL_AFIO_REMAP_SWJ_NOJTAG();
 
+    stackPaint();
+
     hal.info = "STM32F103C8";
     hal.driver_version = "201024";
 #ifdef BOARD_NAME
@@ -977,6 +1022,8 @@ bool driver_init (void)
     hal.control.get_state = systemGetState;
 
     hal.get_elapsed_ticks = getElapsedTicks;
+    hal.idle_wait = idleWait;
+    hal.get_memory_info = getMemoryInfo;
     hal.set_bits_atomic = bitsSetAtomic;
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
@@ -1020,6 +1067,7 @@ bool driver_init (void)
     hal.driver_cap.mist_control = On;
     hal.driver_cap.software_debounce = On;
     hal.driver_cap.step_pulse_delay = On;
+    hal.driver_cap.step_pulse_delay_dir_only = On;
     hal.driver_cap.amass_level = 3;
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
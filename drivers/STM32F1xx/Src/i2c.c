@@ -93,18 +93,31 @@ void I2C2_ER_IRQHandler(void)
 
 #if EEPROM_ENABLE
 
+#if !EEPROM_IS_FRAM
+static uint8_t write_pending = 0; // Address of EEPROM with write cycle in progress, 0 if none
+#endif
+
 nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *i2c, bool read)
 {
+    uint32_t timeout = 10 + i2c->count / 8; // ms, about 90 us per byte at 100 kHz
+
     while (HAL_I2C_GetState(&i2c_port) != HAL_I2C_STATE_READY);
 
-//    while (HAL_I2C_IsDeviceReady(&i2c_port, (uint16_t)(0xA0), 3, 100) != HAL_OK);
+#if !EEPROM_IS_FRAM
+    // Wait for write cycle of the previous write to complete by polling for acknowledge,
+    // the EEPROM does not respond until done. 100 polls is about 10 ms at 100 kHz.
+    if(write_pending) {
+        HAL_I2C_IsDeviceReady(&i2c_port, write_pending << 1, 100, 10);
+        write_pending = 0;
+    }
+#endif
 
     if(read)
-        HAL_I2C_Mem_Read(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 1 ? I2C_MEMADD_SIZE_8BIT : I2C_MEMADD_SIZE_16BIT, i2c->data, i2c->count, 100);
+        HAL_I2C_Mem_Read(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 1 ? I2C_MEMADD_SIZE_8BIT : I2C_MEMADD_SIZE_16BIT, i2c->data, i2c->count, timeout);
     else {
-        HAL_I2C_Mem_Write(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 1 ? I2C_MEMADD_SIZE_8BIT : I2C_MEMADD_SIZE_16BIT, i2c->data, i2c->count, 100);
+        HAL_I2C_Mem_Write(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 1 ? I2C_MEMADD_SIZE_8BIT : I2C_MEMADD_SIZE_16BIT, i2c->data, i2c->count, timeout);
 #if !EEPROM_IS_FRAM
-        hal.delay_ms(7, NULL);
+        write_pending = i2c->address;
 #endif
     }
     i2c->data += i2c->count;
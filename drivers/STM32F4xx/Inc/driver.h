@@ -55,9 +55,15 @@
 #ifndef USB_SERIAL_CDC
 #define USB_SERIAL_CDC      0 // for UART comms
 #endif
+#ifndef USB_REALTIME_CHANNEL
+#define USB_REALTIME_CHANNEL 0
+#endif
 #ifndef SDCARD_ENABLE
 #define SDCARD_ENABLE       0
 #endif
+#ifndef SDCARD_SDIO
+#define SDCARD_SDIO         0
+#endif
 #ifndef KEYPAD_ENABLE
 #define KEYPAD_ENABLE       0
 #endif
@@ -199,7 +205,7 @@
 #error Keypad plugin not supported!
 #endif
 
-#if SDCARD_ENABLE && !defined(SD_CS_PORT)
+#if SDCARD_ENABLE && !SDCARD_SDIO && !defined(SD_CS_PORT)
 #error SD card plugin not supported!
 #endif
 
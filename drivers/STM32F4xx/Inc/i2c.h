@@ -25,6 +25,27 @@
 #include "driver.h"
 #include "grbl/plugins.h"
 
+typedef struct i2c_transfer i2c_transfer_t;
+
+typedef void (*i2c_complete_ptr)(i2c_transfer_t *transfer, bool ok);
+
+struct i2c_transfer {
+    uint8_t address;                // 7-bit device address
+    bool read;
+    bool high_priority;             // Queued ahead of normal priority transfers, e.g. for keypad reads
+    uint8_t reg_bytes;              // Number of register (word address) bytes to send before the data, 0 - 2
+    uint16_t reg;
+    uint8_t *data;
+    uint16_t count;
+    i2c_complete_ptr on_complete;   // Called from the interrupt handler when done, may be NULL
+    volatile bool pending;          // Set while queued or in progress
+    bool ok;                        // Result of last transfer
+    i2c_transfer_t *next;
+};
+
+bool i2c_transfer_queue (i2c_transfer_t *transfer);
+bool i2c_transfer_sync (i2c_transfer_t *transfer);
+
 #if TRINAMIC_ENABLE && TRINAMIC_I2C
 
 #include "trinamic\trinamic2130.h"
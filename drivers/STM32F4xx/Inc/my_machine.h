@@ -33,7 +33,10 @@
 #if !(defined(NUCLEO_F411) || defined(NUCLEO_F446)) // The Nucleo-F411RE board has an off-chip UART to USB interface.
 #define USB_SERIAL_CDC       1 // Serial communication via native USB.
 #endif
+//#define USB_REALTIME_CHANNEL 1 // Adds a vendor specific USB interface for realtime commands and status reports, requires USB_SERIAL_CDC.
+//#define SERIAL_RX_DMA        1 // Serial input by DMA with idle line detection instead of an interrupt per character.
 //#define SDCARD_ENABLE        1 // Run gcode programs from SD card, requires sdcard plugin.
+//#define SDCARD_SDIO          1 // SD card connected to the SDIO peripheral in 4-bit mode instead of SPI, see diskio_sdio.c.
 //#define KEYPAD_ENABLE        1 // I2C keypad for jogging etc., requires keypad plugin.
 //#define ODOMETER_ENABLE      1 // Odometer plugin.
 //#define PPI_ENABLE           1 // Laser PPI plugin. To be completed.
@@ -27,5 +27,7 @@ void spi_set_max_speed (void);
 void spi_disable (void);
 uint8_t spi_get_byte (void);
 void spi_put_byte (uint8_t byte);
+void spi_read (uint8_t *data, uint16_t length);
+void spi_write (const uint8_t *data, uint16_t length);
 
 #endif
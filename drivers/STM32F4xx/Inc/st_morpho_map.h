@@ -23,6 +23,7 @@
 #define SPINDLE_SYNC_ENABLE
 
 void board_init (void);
+void board_aux_interrupt_handler (uint32_t ifg);
 
 // Define step pulse output pins.
 #define STEP_PORT       GPIOC
@@ -148,6 +149,7 @@ void board_init (void);
 #define AUXINPUT1_PORT  GPIOB
 #define AUXINPUT1_PIN   14
 #define AUXINPUT1_BIT   (1<<AUXINPUT1_PIN)
+#define AUXINPUT_MASK   (AUXINPUT0_BIT|AUXINPUT1_BIT)
 
 #define AUXOUTPUT0_PORT GPIOB
 #define AUXOUTPUT0_PIN  15
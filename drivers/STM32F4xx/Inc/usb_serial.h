@@ -30,5 +30,9 @@ void usbWriteS(const char *s);
 uint16_t usbRxFree (void);
 void usbRxFlush(void);
 void usbRxCancel(void);
-void usbBufferInput (uint8_t *data, uint32_t length);
+bool usbBufferInput (uint8_t *data, uint32_t length);
 bool usbSuspendInput (bool suspend);
+#if USB_REALTIME_CHANNEL
+void usbRtBufferInput (uint8_t *data, uint32_t length);
+void usbRtWriteS (const char *s);
+#endif
@@ -107,6 +107,11 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
 
+void CDC_ReceiveResume_FS (void);
+#if USB_REALTIME_CHANNEL
+uint8_t CDC_TransmitRt_FS (uint8_t *Buf, uint16_t Len);
+#endif
+
 /* USER CODE END EXPORTED_FUNCTIONS */
 
 /**
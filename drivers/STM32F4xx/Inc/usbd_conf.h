@@ -37,6 +37,19 @@
 
 /* USER CODE BEGIN INCLUDE */
 
+#ifndef OVERRIDE_MY_MACHINE
+#include "my_machine.h"
+#endif
+
+// Adds a vendor specific interface for realtime commands and status reports, see usb_serial.c.
+#ifndef USB_REALTIME_CHANNEL
+#define USB_REALTIME_CHANNEL 0
+#endif
+
+#if USB_REALTIME_CHANNEL
+#define USBD_CDC_RT_CHANNEL 1U
+#endif
+
 /* USER CODE END INCLUDE */
 
 /** @addtogroup USBD_OTG_DRIVER
@@ -64,7 +77,11 @@
   */
 
 /*---------- -----------*/
+#if USB_REALTIME_CHANNEL
+#define USBD_MAX_NUM_INTERFACES     3U
+#else
 #define USBD_MAX_NUM_INTERFACES     1U
+#endif
 /*---------- -----------*/
 #define USBD_MAX_NUM_CONFIGURATION     1U
 /*---------- -----------*/
@@ -45,6 +45,15 @@ extern "C" {
 #define CDC_OUT_EP                                  0x01U  /* EP1 for data OUT */
 #define CDC_CMD_EP                                  0x82U  /* EP2 for CDC commands */
 
+/* Optional vendor specific interface, a second channel for realtime commands and status reports */
+#ifndef USBD_CDC_RT_CHANNEL
+#define USBD_CDC_RT_CHANNEL                         0U
+#endif /* USBD_CDC_RT_CHANNEL */
+
+#define CDC_RT_IN_EP                                0x83U  /* EP3 for realtime channel IN */
+#define CDC_RT_OUT_EP                               0x03U  /* EP3 for realtime channel OUT */
+#define CDC_RT_PACKET_SIZE                          64U
+
 #ifndef CDC_HS_BINTERVAL
 #define CDC_HS_BINTERVAL                            0x10U
 #endif /* CDC_HS_BINTERVAL */
@@ -58,7 +67,11 @@ extern "C" {
 #define CDC_DATA_FS_MAX_PACKET_SIZE                 64U  /* Endpoint IN & OUT Packet size */
 #define CDC_CMD_PACKET_SIZE                         8U  /* Control Endpoint Packet size */
 
+#if USBD_CDC_RT_CHANNEL
+#define USB_CDC_CONFIG_DESC_SIZ                     (67U + 8U + 23U) /* + IAD and vendor interface */
+#else
 #define USB_CDC_CONFIG_DESC_SIZ                     67U
+#endif /* USBD_CDC_RT_CHANNEL */
 #define CDC_DATA_HS_IN_PACKET_SIZE                  CDC_DATA_HS_MAX_PACKET_SIZE
 #define CDC_DATA_HS_OUT_PACKET_SIZE                 CDC_DATA_HS_MAX_PACKET_SIZE
 
@@ -105,6 +118,9 @@ typedef struct _USBD_CDC_Itf
   int8_t (* Control)(uint8_t cmd, uint8_t *pbuf, uint16_t length);
   int8_t (* Receive)(uint8_t *Buf, uint32_t *Len);
   int8_t (* TransmitCplt)(uint8_t *Buf, uint32_t *Len, uint8_t epnum);
+#if USBD_CDC_RT_CHANNEL
+  int8_t (* ReceiveRt)(uint8_t *Buf, uint32_t *Len);
+#endif /* USBD_CDC_RT_CHANNEL */
 } USBD_CDC_ItfTypeDef;
 
 
@@ -120,6 +136,10 @@ typedef struct
 
   __IO uint32_t TxState;
   __IO uint32_t RxState;
+#if USBD_CDC_RT_CHANNEL
+  uint32_t RtRxBuffer[CDC_RT_PACKET_SIZE / 4U];         /* Force 32bits alignment */
+  __IO uint32_t RtTxState;
+#endif /* USBD_CDC_RT_CHANNEL */
 } USBD_CDC_HandleTypeDef;
 
 
@@ -154,6 +174,10 @@ uint8_t USBD_CDC_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
 uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff);
 uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef *pdev);
 uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef *pdev);
+#if USBD_CDC_RT_CHANNEL
+uint8_t USBD_CDC_TransmitRtPacket(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
+                                  uint32_t length);
+#endif /* USBD_CDC_RT_CHANNEL */
 /**
   * @}
   */
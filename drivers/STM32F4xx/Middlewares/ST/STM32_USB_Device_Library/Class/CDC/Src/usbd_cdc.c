@@ -90,6 +90,50 @@ EndBSPDependencies */
   * @{
   */
 
+#if USBD_CDC_RT_CHANNEL
+
+/* Interface Association Descriptor grouping the CDC interfaces, required when the device has other interfaces */
+#define USBD_CDC_RT_IAD                                                                             \
+  0x08,                                       /* bLength: IAD size */                              \
+  0x0B,                                       /* bDescriptorType: Interface Association */         \
+  0x00,                                       /* bFirstInterface */                                \
+  0x02,                                       /* bInterfaceCount */                                \
+  0x02,                                       /* bFunctionClass: Communication Interface Class */  \
+  0x02,                                       /* bFunctionSubClass: Abstract Control Model */      \
+  0x01,                                       /* bFunctionProtocol: Common AT commands */          \
+  0x00,                                       /* iFunction */
+
+/* Vendor specific interface with a pair of bulk endpoints for realtime commands and status reports */
+#define USBD_CDC_RT_INTERFACE(size)                                                                 \
+  0x09,                                       /* bLength: Interface Descriptor size */             \
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: Interface */                     \
+  0x02,                                       /* bInterfaceNumber: Number of Interface */          \
+  0x00,                                       /* bAlternateSetting: Alternate setting */           \
+  0x02,                                       /* bNumEndpoints: Two endpoints used */              \
+  0xFF,                                       /* bInterfaceClass: Vendor specific */               \
+  0x00,                                       /* bInterfaceSubClass: */                            \
+  0x00,                                       /* bInterfaceProtocol: */                            \
+  0x00,                                       /* iInterface: */                                    \
+  0x07,                                       /* bLength: Endpoint Descriptor size */              \
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */                      \
+  CDC_RT_OUT_EP,                              /* bEndpointAddress */                               \
+  0x02,                                       /* bmAttributes: Bulk */                             \
+  LOBYTE(size),                               /* wMaxPacketSize: */                                \
+  HIBYTE(size),                                                                                    \
+  0x00,                                       /* bInterval: ignore for Bulk transfer */            \
+  0x07,                                       /* bLength: Endpoint Descriptor size */              \
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */                      \
+  CDC_RT_IN_EP,                               /* bEndpointAddress */                               \
+  0x02,                                       /* bmAttributes: Bulk */                             \
+  LOBYTE(size),                               /* wMaxPacketSize: */                                \
+  HIBYTE(size),                                                                                    \
+  0x00                                        /* bInterval: ignore for Bulk transfer */
+
+#define USBD_CDC_NUM_INTERFACES                     0x03U
+#else
+#define USBD_CDC_NUM_INTERFACES                     0x02U
+#endif /* USBD_CDC_RT_CHANNEL */
+
 /**
   * @}
   */
@@ -163,12 +207,16 @@ __ALIGN_BEGIN static uint8_t USBD_CDC_CfgHSDesc[USB_CDC_CONFIG_DESC_SIZ] __ALIGN
   USB_DESC_TYPE_CONFIGURATION,                /* bDescriptorType: Configuration */
   USB_CDC_CONFIG_DESC_SIZ,                    /* wTotalLength:no of returned bytes */
   0x00,
-  0x02,                                       /* bNumInterfaces: 2 interface */
+  USBD_CDC_NUM_INTERFACES,                    /* bNumInterfaces: 2 interfaces, 3 with realtime channel */
   0x01,                                       /* bConfigurationValue: Configuration value */
   0x00,                                       /* iConfiguration: Index of string descriptor describing the configuration */
   0xC0,                                       /* bmAttributes: self powered */
   0x32,                                       /* MaxPower 0 mA */
 
+#if USBD_CDC_RT_CHANNEL
+  USBD_CDC_RT_IAD
+#endif /* USBD_CDC_RT_CHANNEL */
+
   /*---------------------------------------------------------------------------*/
 
   /* Interface Descriptor */
@@ -248,6 +296,10 @@ __ALIGN_BEGIN static uint8_t USBD_CDC_CfgHSDesc[USB_CDC_CONFIG_DESC_SIZ] __ALIGN
   LOBYTE(CDC_DATA_HS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
   HIBYTE(CDC_DATA_HS_MAX_PACKET_SIZE),
   0x00                                        /* bInterval: ignore for Bulk transfer */
+#if USBD_CDC_RT_CHANNEL
+  ,
+  USBD_CDC_RT_INTERFACE(CDC_DATA_HS_MAX_PACKET_SIZE)
+#endif /* USBD_CDC_RT_CHANNEL */
 };
 
 
@@ -259,12 +311,16 @@ __ALIGN_BEGIN static uint8_t USBD_CDC_CfgFSDesc[USB_CDC_CONFIG_DESC_SIZ] __ALIGN
   USB_DESC_TYPE_CONFIGURATION,                /* bDescriptorType: Configuration */
   USB_CDC_CONFIG_DESC_SIZ,                    /* wTotalLength:no of returned bytes */
   0x00,
-  0x02,                                       /* bNumInterfaces: 2 interface */
+  USBD_CDC_NUM_INTERFACES,                    /* bNumInterfaces: 2 interfaces, 3 with realtime channel */
   0x01,                                       /* bConfigurationValue: Configuration value */
   0x00,                                       /* iConfiguration: Index of string descriptor describing the configuration */
   0xC0,                                       /* bmAttributes: self powered */
   0x32,                                       /* MaxPower 0 mA */
 
+#if USBD_CDC_RT_CHANNEL
+  USBD_CDC_RT_IAD
+#endif /* USBD_CDC_RT_CHANNEL */
+
   /*---------------------------------------------------------------------------*/
 
   /* Interface Descriptor */
@@ -344,6 +400,10 @@ __ALIGN_BEGIN static uint8_t USBD_CDC_CfgFSDesc[USB_CDC_CONFIG_DESC_SIZ] __ALIGN
   LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
   HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),
   0x00                                        /* bInterval: ignore for Bulk transfer */
+#if USBD_CDC_RT_CHANNEL
+  ,
+  USBD_CDC_RT_INTERFACE(CDC_RT_PACKET_SIZE)
+#endif /* USBD_CDC_RT_CHANNEL */
 };
 
 __ALIGN_BEGIN static uint8_t USBD_CDC_OtherSpeedCfgDesc[USB_CDC_CONFIG_DESC_SIZ] __ALIGN_END =
@@ -352,12 +412,16 @@ __ALIGN_BEGIN static uint8_t USBD_CDC_OtherSpeedCfgDesc[USB_CDC_CONFIG_DESC_SIZ]
   USB_DESC_TYPE_OTHER_SPEED_CONFIGURATION,
   USB_CDC_CONFIG_DESC_SIZ,
   0x00,
-  0x02,                                       /* bNumInterfaces: 2 interfaces */
+  USBD_CDC_NUM_INTERFACES,                    /* bNumInterfaces: 2 interfaces, 3 with realtime channel */
   0x01,                                       /* bConfigurationValue: */
   0x04,                                       /* iConfiguration: */
   0xC0,                                       /* bmAttributes: */
   0x32,                                       /* MaxPower 100 mA */
 
+#if USBD_CDC_RT_CHANNEL
+  USBD_CDC_RT_IAD
+#endif /* USBD_CDC_RT_CHANNEL */
+
   /*Interface Descriptor */
   0x09,                                       /* bLength: Interface Descriptor size */
   USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: Interface */
@@ -436,6 +500,10 @@ __ALIGN_BEGIN static uint8_t USBD_CDC_OtherSpeedCfgDesc[USB_CDC_CONFIG_DESC_SIZ]
   0x40,                                       /* wMaxPacketSize: */
   0x00,
   0x00                                        /* bInterval */
+#if USBD_CDC_RT_CHANNEL
+  ,
+  USBD_CDC_RT_INTERFACE(CDC_RT_PACKET_SIZE)
+#endif /* USBD_CDC_RT_CHANNEL */
 };
 
 /**
@@ -509,6 +577,17 @@ static uint8_t USBD_CDC_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   (void)USBD_LL_OpenEP(pdev, CDC_CMD_EP, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE);
   pdev->ep_in[CDC_CMD_EP & 0xFU].is_used = 1U;
 
+#if USBD_CDC_RT_CHANNEL
+  /* Open realtime channel EPs */
+  (void)USBD_LL_OpenEP(pdev, CDC_RT_IN_EP, USBD_EP_TYPE_BULK,
+                       pdev->dev_speed == USBD_SPEED_HIGH ? CDC_DATA_HS_MAX_PACKET_SIZE : CDC_RT_PACKET_SIZE);
+  pdev->ep_in[CDC_RT_IN_EP & 0xFU].is_used = 1U;
+
+  (void)USBD_LL_OpenEP(pdev, CDC_RT_OUT_EP, USBD_EP_TYPE_BULK,
+                       pdev->dev_speed == USBD_SPEED_HIGH ? CDC_DATA_HS_MAX_PACKET_SIZE : CDC_RT_PACKET_SIZE);
+  pdev->ep_out[CDC_RT_OUT_EP & 0xFU].is_used = 1U;
+#endif /* USBD_CDC_RT_CHANNEL */
+
   /* Init  physical Interface components */
   ((USBD_CDC_ItfTypeDef *)pdev->pUserData)->Init();
 
@@ -529,6 +608,13 @@ static uint8_t USBD_CDC_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
                                  CDC_DATA_FS_OUT_PACKET_SIZE);
   }
 
+#if USBD_CDC_RT_CHANNEL
+  /* Realtime commands are never held back, the channel is always armed */
+  hcdc->RtTxState = 0U;
+  (void)USBD_LL_PrepareReceive(pdev, CDC_RT_OUT_EP, (uint8_t *)hcdc->RtRxBuffer,
+                               CDC_RT_PACKET_SIZE);
+#endif /* USBD_CDC_RT_CHANNEL */
+
   return (uint8_t)USBD_OK;
 }
 
@@ -557,6 +643,15 @@ static uint8_t USBD_CDC_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   pdev->ep_in[CDC_CMD_EP & 0xFU].is_used = 0U;
   pdev->ep_in[CDC_CMD_EP & 0xFU].bInterval = 0U;
 
+#if USBD_CDC_RT_CHANNEL
+  /* Close realtime channel EPs */
+  (void)USBD_LL_CloseEP(pdev, CDC_RT_IN_EP);
+  pdev->ep_in[CDC_RT_IN_EP & 0xFU].is_used = 0U;
+
+  (void)USBD_LL_CloseEP(pdev, CDC_RT_OUT_EP);
+  pdev->ep_out[CDC_RT_OUT_EP & 0xFU].is_used = 0U;
+#endif /* USBD_CDC_RT_CHANNEL */
+
   /* DeInit  physical Interface components */
   if (pdev->pClassData != NULL)
   {
@@ -684,6 +779,14 @@ static uint8_t USBD_CDC_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
 
   hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
 
+#if USBD_CDC_RT_CHANNEL
+  if (epnum == (CDC_RT_IN_EP & 0xFU))
+  {
+    hcdc->RtTxState = 0U;
+    return (uint8_t)USBD_OK;
+  }
+#endif /* USBD_CDC_RT_CHANNEL */
+
   if ((pdev->ep_in[epnum].total_length > 0U) &&
       ((pdev->ep_in[epnum].total_length % hpcd->IN_ep[epnum].maxpacket) == 0U))
   {
@@ -718,6 +821,19 @@ static uint8_t USBD_CDC_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
     return (uint8_t)USBD_FAIL;
   }
 
+#if USBD_CDC_RT_CHANNEL
+  if (epnum == CDC_RT_OUT_EP)
+  {
+    uint32_t length = USBD_LL_GetRxDataSize(pdev, epnum);
+
+    ((USBD_CDC_ItfTypeDef *)pdev->pUserData)->ReceiveRt((uint8_t *)hcdc->RtRxBuffer, &length);
+
+    (void)USBD_LL_PrepareReceive(pdev, CDC_RT_OUT_EP, (uint8_t *)hcdc->RtRxBuffer,
+                                 CDC_RT_PACKET_SIZE);
+    return (uint8_t)USBD_OK;
+  }
+#endif /* USBD_CDC_RT_CHANNEL */
+
   /* Get the received data length */
   hcdc->RxLength = USBD_LL_GetRxDataSize(pdev, epnum);
 
@@ -922,6 +1038,38 @@ uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef *pdev)
 
   return (uint8_t)USBD_OK;
 }
+
+#if USBD_CDC_RT_CHANNEL
+/**
+  * @brief  USBD_CDC_TransmitRtPacket
+  *         Transmit packet on the realtime channel IN endpoint
+  * @param  pdev: device instance
+  * @param  pbuff: Tx Buffer, must be kept until the transfer is complete
+  * @param  length: Tx length, reports should fit in a single transfer
+  * @retval status
+  */
+uint8_t USBD_CDC_TransmitRtPacket(USBD_HandleTypeDef *pdev, uint8_t *pbuff,
+                                  uint32_t length)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef *)pdev->pClassData;
+
+  if (pdev->pClassData == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  if (hcdc->RtTxState != 0U)
+  {
+    return (uint8_t)USBD_BUSY;
+  }
+
+  hcdc->RtTxState = 1U;
+
+  (void)USBD_LL_Transmit(pdev, CDC_RT_IN_EP, pbuff, length);
+
+  return (uint8_t)USBD_OK;
+}
+#endif /* USBD_CDC_RT_CHANNEL */
 /**
   * @}
   */
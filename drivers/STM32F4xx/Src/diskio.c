@@ -13,7 +13,7 @@
 
 #include "driver.h"
 
-#if SDCARD_ENABLE
+#if SDCARD_ENABLE && !SDCARD_SDIO
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -88,11 +88,12 @@ BYTE PowerFlag = 0;     /* indicates if "power" is on */
 
 #define rcvr_spi() (BYTE)spi_get_byte()
 
-static
-void rcvr_spi_m (BYTE *dst)
-{
-    *dst = rcvr_spi();
-}
+/*-----------------------------------------------------------------------*/
+/* Transmit/receive a block of data by DMA  (Platform dependent)         */
+/*-----------------------------------------------------------------------*/
+
+#define xmit_spi_multi(buff, btx) spi_write(buff, btx)
+#define rcvr_spi_multi(buff, btr) spi_read(buff, btr)
 
 /*-----------------------------------------------------------------------*/
 /* Wait for card ready                                                   */
@@ -184,10 +185,7 @@ BOOL rcvr_datablock (
     } while ((token == 0xFF) && Timer1);
     if(token != 0xFE) return FALSE;    /* If not valid data token, retutn with error */
 
-    do {                            /* Receive the data block into buffer */
-        rcvr_spi_m(buff++);
-        rcvr_spi_m(buff++);
-    } while (btr -= 2);
+    rcvr_spi_multi(buff, btr);        /* Receive the data block into buffer */
     rcvr_spi();                        /* Discard CRC */
     rcvr_spi();
 
@@ -207,18 +205,14 @@ BOOL xmit_datablock (
     BYTE token            /* Data/Stop token */
 )
 {
-    BYTE resp, wc;
+    BYTE resp;
 
 
     if (wait_ready() != 0xFF) return FALSE;
 
     xmit_spi(token);                    /* Xmit data token */
     if (token != 0xFD) {    /* Is data token */
-        wc = 0;
-        do {                            /* Xmit the 512 byte data block to MMC */
-            xmit_spi(*buff++);
-            xmit_spi(*buff++);
-        } while (--wc);
+        xmit_spi_multi(buff, 512);        /* Xmit the 512 byte data block to MMC */
         xmit_spi(0xFF);                    /* CRC (Dummy) */
         xmit_spi(0xFF);
         resp = rcvr_spi();                /* Reveive data response */
@@ -0,0 +1,209 @@
+/*
+  diskio_sdio.c - FatFs disk interface for SD cards connected to the SDIO peripheral, 4-bit mode
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Pins: D0-D3 on PC8-PC11, CK on PC12 and CMD on PD2.
+  The SDIO kernel clock is the 48 MHz PLL48CLK shared with USB, the card is clocked at 24 MHz after initialization.
+
+  NOTE: the HAL SD driver is not part of this project by default, add stm32f4xx_hal_sd.c and stm32f4xx_ll_sdmmc.c
+        from STM32CubeF4 and enable HAL_SD_MODULE_ENABLED in stm32f4xx_hal_conf.h.
+*/
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_SDIO
+
+#include "main.h"
+#include "ff.h"
+#include "diskio.h"
+
+#ifndef HAL_SD_MODULE_ENABLED
+#error "SDCARD_SDIO requires HAL_SD_MODULE_ENABLED in stm32f4xx_hal_conf.h and the HAL SD driver!"
+#endif
+
+#define SDIO_TIMEOUT 1000 // ms
+
+static SD_HandleTypeDef hsd = {
+    .Instance = SDIO,
+    .Init.ClockEdge = SDIO_CLOCK_EDGE_RISING,
+    .Init.ClockBypass = SDIO_CLOCK_BYPASS_DISABLE,
+    .Init.ClockPowerSave = SDIO_CLOCK_POWER_SAVE_DISABLE,
+    .Init.BusWide = SDIO_BUS_WIDE_1B, // Initialization is done in 1-bit mode
+    .Init.HardwareFlowControl = SDIO_HARDWARE_FLOW_CONTROL_ENABLE,
+    .Init.ClockDiv = 0
+};
+
+static volatile DSTATUS Stat = STA_NOINIT;
+
+// Waits for the card to leave the programming state after a write.
+static bool wait_ready (void)
+{
+    uint32_t ms = HAL_GetTick();
+
+    while(HAL_SD_GetCardState(&hsd) != HAL_SD_CARD_TRANSFER) {
+        if(HAL_GetTick() - ms > SDIO_TIMEOUT)
+            return false;
+    }
+
+    return true;
+}
+
+static void sdio_init (void)
+{
+    static bool init = false;
+
+    if(!init) {
+
+        __HAL_RCC_SDIO_CLK_ENABLE();
+        __HAL_RCC_GPIOC_CLK_ENABLE();
+        __HAL_RCC_GPIOD_CLK_ENABLE();
+
+        GPIO_InitTypeDef GPIO_InitStruct = {0};
+        GPIO_InitStruct.Pin = GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11|GPIO_PIN_12;
+        GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+        GPIO_InitStruct.Pull = GPIO_PULLUP;
+        GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+        GPIO_InitStruct.Alternate = GPIO_AF12_SDIO;
+        HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+
+        GPIO_InitStruct.Pin = GPIO_PIN_2;
+        HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
+
+        init = true;
+    }
+}
+
+DSTATUS disk_initialize (BYTE drv)
+{
+    if(drv)
+        return STA_NOINIT;
+
+    sdio_init();
+
+    hsd.Init.BusWide = SDIO_BUS_WIDE_1B;
+
+    if(HAL_SD_Init(&hsd) == HAL_OK && HAL_SD_ConfigWideBusOperation(&hsd, SDIO_BUS_WIDE_4B) == HAL_OK)
+        Stat &= ~STA_NOINIT;
+    else
+        Stat |= STA_NOINIT;
+
+    return Stat;
+}
+
+DSTATUS disk_status (BYTE drv)
+{
+    return drv ? STA_NOINIT : Stat;
+}
+
+DRESULT disk_read (BYTE drv, BYTE *buff, DWORD sector, BYTE count)
+{
+    if(drv || !count)
+        return RES_PARERR;
+
+    if(Stat & STA_NOINIT)
+        return RES_NOTRDY;
+
+    if(HAL_SD_ReadBlocks(&hsd, buff, sector, count, SDIO_TIMEOUT) != HAL_OK)
+        return RES_ERROR;
+
+    return wait_ready() ? RES_OK : RES_ERROR;
+}
+
+#if FF_FS_READONLY == 0
+
+DRESULT disk_write (BYTE drv, const BYTE *buff, DWORD sector, BYTE count)
+{
+    if(drv || !count)
+        return RES_PARERR;
+
+    if(Stat & STA_NOINIT)
+        return RES_NOTRDY;
+
+    if(HAL_SD_WriteBlocks(&hsd, (uint8_t *)buff, sector, count, SDIO_TIMEOUT) != HAL_OK)
+        return RES_ERROR;
+
+    return wait_ready() ? RES_OK : RES_ERROR;
+}
+
+#endif
+
+DRESULT disk_ioctl (BYTE drv, BYTE ctrl, void *buff)
+{
+    DRESULT res = RES_ERROR;
+    HAL_SD_CardInfoTypeDef info;
+
+    if(drv)
+        return RES_PARERR;
+
+    if(Stat & STA_NOINIT)
+        return RES_NOTRDY;
+
+    switch(ctrl) {
+
+        case CTRL_SYNC:
+            if(wait_ready())
+                res = RES_OK;
+            break;
+
+        case GET_SECTOR_COUNT:
+            if(HAL_SD_GetCardInfo(&hsd, &info) == HAL_OK) {
+                *(DWORD *)buff = info.LogBlockNbr;
+                res = RES_OK;
+            }
+            break;
+
+        case GET_SECTOR_SIZE:
+            *(WORD *)buff = 512;
+            res = RES_OK;
+            break;
+
+        case GET_BLOCK_SIZE:
+            if(HAL_SD_GetCardInfo(&hsd, &info) == HAL_OK) {
+                *(DWORD *)buff = info.LogBlockSize / 512;
+                res = RES_OK;
+            }
+            break;
+
+        default:
+            res = RES_PARERR;
+            break;
+    }
+
+    return res;
+}
+
+// Called every 10 ms by the driver, timeouts are handled by the HAL SD driver.
+void disk_timerproc (void)
+{
+}
+
+DWORD get_fattime (void)
+{
+    return    ((2007UL-1980) << 25)    // Year = 2007
+            | (6UL << 21)            // Month = June
+            | (5UL << 16)            // Day = 5
+            | (11U << 11)            // Hour = 11
+            | (38U << 5)            // Min = 38
+            | (0U >> 1)                // Sec = 0
+            ;
+}
+
+#endif
@@ -62,6 +62,10 @@
 #include "flash.h"
 #endif
 
+#if LIMITS_FILTER_SAMPLES
+#include "grbl/limits.h"
+#endif
+
 extern __IO uint32_t uwTick;
 static uint32_t pulse_length, pulse_delay;
 static bool pwmEnabled = false, IOInitDone = false;
@@ -210,7 +214,11 @@ static uint32_t dir_outmap[sizeof(c_dir_outmap) / sizeof(uint32_t)];
 #define SPINDLE_INDEX_BIT 0
 #endif
 
-#define DRIVER_IRQMASK (LIMIT_MASK|CONTROL_MASK|KEYPAD_STROBE_BIT|SPINDLE_INDEX_BIT)
+#ifndef AUXINPUT_MASK
+#define AUXINPUT_MASK 0
+#endif
+
+#define DRIVER_IRQMASK (LIMIT_MASK|CONTROL_MASK|KEYPAD_STROBE_BIT|SPINDLE_INDEX_BIT|AUXINPUT_MASK)
 
 static void spindle_set_speed (uint_fast16_t pwm_value);
 
@@ -267,7 +275,7 @@ static void stepperGoIdle (bool clear_signals)
 
 
 // Sets up stepper driver interrupt timeout, "Normal" version
-static void stepperCyclesPerTick (uint32_t cycles_per_tick)
+ISR_CODE static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
     STEPPER_TIMER->ARR = cycles_per_tick < (1UL << 20) ? cycles_per_tick : 0x000FFFFFUL;
     STEPPER_TIMER->EGR = TIM_EGR_UG;
@@ -321,7 +329,7 @@ inline static __attribute__((always_inline)) void stepperSetDirOutputs (axes_sig
 }
 
 // Sets stepper direction and pulse pins and starts a step pulse.
-static void stepperPulseStart (stepper_t *stepper)
+ISR_CODE static void stepperPulseStart (stepper_t *stepper)
 {
 #ifdef SPINDLE_SYNC_ENABLE
     if(stepper->new_block && stepper->exec_segment->spindle_sync) {
@@ -344,7 +352,7 @@ static void stepperPulseStart (stepper_t *stepper)
 
 // Start a stepper pulse, delay version.
 // Note: delay is only added when there is a direction change and a pulse to be output.
-static void stepperPulseStartDelayed (stepper_t *stepper)
+ISR_CODE static void stepperPulseStartDelayed (stepper_t *stepper)
 {
 #ifdef SPINDLE_SYNC_ENABLE
     if(stepper->new_block && stepper->exec_segment->spindle_sync) {
@@ -381,29 +389,15 @@ static void stepperPulseStartDelayed (stepper_t *stepper)
 // Spindle sync version: sets stepper direction and pulse pins and starts a step pulse.
 // Switches back to "normal" version if spindle synchronized motion is finished.
 // TODO: add delayed pulse handling...
-static void stepperPulseStartSynchronized (stepper_t *stepper)
+ISR_CODE static void stepperPulseStartSynchronized (stepper_t *stepper)
 {
-    static bool sync = false;
-    static float block_start;
-
     if(stepper->new_block) {
         if(!stepper->exec_segment->spindle_sync) {
             hal.stepper.pulse_start = spindle_tracker.stepper_pulse_start_normal;
             hal.stepper.pulse_start(stepper);
             return;
         }
-        sync = true;
         stepperSetDirOutputs(stepper->dir_outbits);
-        spindle_tracker.programmed_rate = stepper->exec_block->programmed_rate;
-        spindle_tracker.steps_per_mm = stepper->exec_block->steps_per_mm;
-        spindle_tracker.segment_id = 0;
-        spindle_tracker.prev_pos = 0.0f;
-        block_start = spindleGetData(SpindleData_AngularPosition).angular_position * spindle_tracker.programmed_rate;
-        pidf_reset(&spindle_tracker.pid);
-#ifdef PID_LOG
-        sys.pid_log.idx = 0;
-        sys.pid_log.setpoint = 100.0f;
-#endif
     }
 
     if(stepper->step_outbits.value) {
@@ -412,58 +406,8 @@ static void stepperPulseStartSynchronized (stepper_t *stepper)
         PULSE_TIMER->CR1 |= TIM_CR1_CEN;
     }
 
-    if(spindle_tracker.segment_id != stepper->exec_segment->id) {
-
-        spindle_tracker.segment_id = stepper->exec_segment->id;
-
-        if(!stepper->new_block) {  // adjust this segments total time for any positional error since last segment
-
-            float actual_pos;
-
-            if(stepper->exec_segment->cruising) {
-
-                float dt = (float)hal.f_step_timer / (float)(stepper->exec_segment->cycles_per_tick * stepper->exec_segment->n_step);
-                actual_pos = spindleGetData(SpindleData_AngularPosition).angular_position * spindle_tracker.programmed_rate;
-
-                if(sync) {
-                    spindle_tracker.pid.sample_rate_prev = dt;
-//                    spindle_tracker.block_start += (actual_pos - spindle_tracker.block_start) - spindle_tracker.prev_pos;
-//                    spindle_tracker.block_start += spindle_tracker.prev_pos;
-                    sync = false;
-                }
-
-                actual_pos -= block_start;
-                int32_t step_delta = (int32_t)(pidf(&spindle_tracker.pid, spindle_tracker.prev_pos, actual_pos, dt) * spindle_tracker.steps_per_mm);
-
-
-                int32_t ticks = (((int32_t)stepper->step_count + step_delta) * (int32_t)stepper->exec_segment->cycles_per_tick) / (int32_t)stepper->step_count;
-
-                stepper->exec_segment->cycles_per_tick = (uint32_t)max(ticks, spindle_tracker.min_cycles_per_tick);
-
-                stepperCyclesPerTick(stepper->exec_segment->cycles_per_tick);
-           } else
-               actual_pos = spindle_tracker.prev_pos;
-
-#ifdef PID_LOG
-            if(sys.pid_log.idx < PID_LOG) {
-
-                sys.pid_log.target[sys.pid_log.idx] = spindle_tracker.prev_pos;
-                sys.pid_log.actual[sys.pid_log.idx] = actual_pos; // - spindle_tracker.prev_pos;
-
-            //    spindle_tracker.log[sys.pid_log.idx] = STEPPER_TIMER->BGLOAD << stepper->amass_level;
-            //    spindle_tracker.pos[sys.pid_log.idx] = stepper->exec_segment->cycles_per_tick  stepper->amass_level;
-            //    spindle_tracker.pos[sys.pid_log.idx] = stepper->exec_segment->cycles_per_tick * stepper->step_count;
-            //    STEPPER_TIMER->BGLOAD = STEPPER_TIMER->LOAD;
-
-             //   spindle_tracker.pos[sys.pid_log.idx] = spindle_tracker.prev_pos;
-
-                sys.pid_log.idx++;
-            }
-#endif
-        }
-
-        spindle_tracker.prev_pos = stepper->exec_segment->target_position;
-    }
+    if(spindle_sync_update(&spindle_tracker, stepper))
+        stepperCyclesPerTick(stepper->exec_segment->cycles_per_tick);
 }
 
 #endif
@@ -825,6 +769,17 @@ static uint32_t getElapsedTicks (void)
     return uwTick;
 }
 
+// Sleeps until the next interrupt, at the latest the 1 ms systick, when the main loop has nothing to do
+static void idleWait (void)
+{
+    __WFI();
+}
+
+static uint32_t getCycleCount (void)
+{
+    return DWT->CYCCNT;
+}
+
 // Configures peripherals when settings are initialized or changed
 void settings_changed (settings_t *settings)
 {
@@ -1278,11 +1233,13 @@ static bool driver_setup (settings_t *settings)
 
 #if SDCARD_ENABLE
 
+  #if !SDCARD_SDIO
     GPIO_Init.Mode = GPIO_MODE_OUTPUT_PP;
     GPIO_Init.Pin = SD_CS_BIT;
     HAL_GPIO_Init(SD_CS_PORT, &GPIO_Init);
 
     BITBAND_PERI(SD_CS_PORT->ODR, SD_CS_PIN) = 1;
+  #endif
 
     sdcard_init();
 
@@ -1358,6 +1315,11 @@ bool driver_init (void)
 
     // GPIO_PinRemapConfig(GPIO_Remap_SWJ_Disable, ENABLE); // ??? Disable JTAG and SWD!?? Bug?
 
+    // Enable DWT cycle counter, used for stepper interrupt load measurement
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
 #if USB_SERIAL_CDC
     usbInit();
 #else
@@ -1417,6 +1379,8 @@ bool driver_init (void)
     hal.control.get_state = systemGetState;
 
     hal.get_elapsed_ticks = getElapsedTicks;
+    hal.idle_wait = idleWait;
+    hal.get_cycle_count = getCycleCount;
     hal.set_bits_atomic = bitsSetAtomic;
     hal.clear_bits_atomic = bitsClearAtomic;
     hal.set_value_atomic = valueSetAtomic;
@@ -1429,6 +1393,9 @@ bool driver_init (void)
     hal.stream.reset_read_buffer = usbRxFlush;
     hal.stream.cancel_read_buffer = usbRxCancel;
     hal.stream.suspend_read = usbSuspendInput;
+#if USB_REALTIME_CHANNEL
+    hal.stream.write_realtime = usbRtWriteS;
+#endif
 #else
     hal.stream.read = serialGetC;
     hal.stream.write = serialWriteS;
@@ -1466,8 +1433,11 @@ bool driver_init (void)
 #ifdef COOLANT_MIST_PIN
     hal.driver_cap.mist_control = On;
 #endif
-    hal.driver_cap.software_debounce = On;
+#if !LIMITS_FILTER_SAMPLES
+    hal.driver_cap.software_debounce = On; // Replaced by the core limits filter when enabled
+#endif
     hal.driver_cap.step_pulse_delay = On;
+    hal.driver_cap.step_pulse_delay_dir_only = On;
     hal.driver_cap.amass_level = 3;
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
@@ -1501,7 +1471,7 @@ bool driver_init (void)
 /* interrupt handlers */
 
 // Main stepper driver
-void STEPPER_TIMER_IRQHandler (void)
+ISR_CODE void STEPPER_TIMER_IRQHandler (void)
 {
     if ((STEPPER_TIMER->SR & TIM_SR_UIF) != 0)                  // check interrupt source
     {
@@ -1529,7 +1499,7 @@ void STEPPER_TIMER_IRQHandler (void)
 // This interrupt is enabled when Grbl sets the motor port bits to execute
 // a step. This ISR resets the motor port after a short period (settings.pulse_microseconds)
 // completing one step cycle.
-void PULSE_TIMER_IRQHandler (void)
+ISR_CODE void PULSE_TIMER_IRQHandler (void)
 {
     PULSE_TIMER->SR &= ~TIM_SR_UIF;                 // Clear UIF flag
 
@@ -1751,6 +1721,11 @@ void EXTI15_10_IRQHandler(void)
         if(ifg & KEYPAD_STROBE_BIT)
             keypad_keyclick_handler(BITBAND_PERI(KEYPAD_PORT->IDR, KEYPAD_STROBE_PIN));
 #endif
+
+#if AUXINPUT_MASK & 0xFE00
+        if(ifg & AUXINPUT_MASK)
+            board_aux_interrupt_handler(ifg & AUXINPUT_MASK);
+#endif
     }
 }
 
@@ -1768,6 +1743,10 @@ void HAL_IncTick(void)
 #endif
     uwTick += uwTickFreq;
 
+#if LIMITS_FILTER_SAMPLES
+    limits_filter_sample();
+#endif
+
     if(delay.ms && !(--delay.ms)) {
         if(delay.callback) {
             delay.callback();
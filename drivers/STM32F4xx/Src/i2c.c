@@ -35,6 +35,16 @@
 
 #define I2CPORT I2Cport(I2C_PORT)
 
+#define I2Cirq(p, t) I2CirqI(p, t)
+#define I2CirqI(p, t) I2C ## p ## _ ## t ## _IRQn
+#define I2Chandler(p, t) I2ChandlerI(p, t)
+#define I2ChandlerI(p, t) I2C ## p ## _ ## t ## _IRQHandler
+
+#define I2C_EV_IRQn I2Cirq(I2C_PORT, EV)
+#define I2C_ER_IRQn I2Cirq(I2C_PORT, ER)
+#define I2C_EV_IRQHandler I2Chandler(I2C_PORT, EV)
+#define I2C_ER_IRQHandler I2Chandler(I2C_PORT, ER)
+
 static I2C_HandleTypeDef i2c_port = {
     .Instance = I2CPORT,
     .Init.ClockSpeed = 100000,
@@ -76,26 +86,199 @@ void i2c_init (void)
 
     HAL_I2C_Init(&i2c_port);
 #endif
+
+    // Below the stepper interrupts so that transfers never delay step generation.
+    HAL_NVIC_SetPriority(I2C_EV_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C_EV_IRQn);
+    HAL_NVIC_SetPriority(I2C_ER_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(I2C_ER_IRQn);
+}
+
+// Transaction queue, transfers are interrupt driven and executed in order, high priority transfers ahead of others.
+
+static i2c_transfer_t *queue_head = NULL, *current = NULL;
+static volatile bool sync_lock = false; // Set while the bus is used directly, see i2c_lock()
+
+static void transfer_done (bool ok)
+{
+    i2c_transfer_t *transfer = current;
+
+    current = NULL;
+    transfer->ok = ok;
+    transfer->pending = false;
+
+    if(transfer->on_complete)
+        transfer->on_complete(transfer, ok);
+}
+
+// Starts the next queued transfer if the bus is idle, called with interrupts disabled or from the I2C interrupt handlers.
+static void start_next (void)
+{
+    HAL_StatusTypeDef ret;
+
+    while(current == NULL && !sync_lock && queue_head) {
+
+        current = queue_head;
+        queue_head = current->next;
+
+        uint16_t address = current->address << 1, reg_size = current->reg_bytes == 2 ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT;
+
+        if(current->reg_bytes)
+            ret = current->read
+                   ? HAL_I2C_Mem_Read_IT(&i2c_port, address, current->reg, reg_size, current->data, current->count)
+                   : HAL_I2C_Mem_Write_IT(&i2c_port, address, current->reg, reg_size, current->data, current->count);
+        else
+            ret = current->read
+                   ? HAL_I2C_Master_Receive_IT(&i2c_port, address, current->data, current->count)
+                   : HAL_I2C_Master_Transmit_IT(&i2c_port, address, current->data, current->count);
+
+        if(ret != HAL_OK)
+            transfer_done(false);
+    }
+}
+
+// Queues a transfer, returns false if the transfer is already queued or in progress.
+// on_complete is called from the interrupt handler when done. May be called from interrupt handlers.
+bool i2c_transfer_queue (i2c_transfer_t *transfer)
+{
+    if(transfer->pending)
+        return false;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    i2c_transfer_t **link = &queue_head;
+
+    while(*link && (!transfer->high_priority || (*link)->high_priority))
+        link = &(*link)->next;
+
+    transfer->pending = true;
+    transfer->next = *link;
+    *link = transfer;
+
+    start_next();
+
+    __set_PRIMASK(primask);
+
+    return true;
+}
+
+// Queues a transfer and waits for it to complete, returns true if successful. Not to be called from interrupt handlers.
+bool i2c_transfer_sync (i2c_transfer_t *transfer)
+{
+    transfer->on_complete = NULL;
+
+    if(!i2c_transfer_queue(transfer))
+        return false;
+
+    while(transfer->pending);
+
+    return transfer->ok;
+}
+
+#if EEPROM_ENABLE && !EEPROM_IS_FRAM
+
+// Waits for the current transfer to complete and holds back queued transfers while locked,
+// for blocking HAL calls that have no interrupt driven equivalent.
+static void i2c_lock (bool lock)
+{
+    uint32_t primask;
+
+    if(lock) while(!sync_lock) {
+        primask = __get_PRIMASK();
+        __disable_irq();
+        if(current == NULL)
+            sync_lock = true;
+        __set_PRIMASK(primask);
+    } else {
+        primask = __get_PRIMASK();
+        __disable_irq();
+        sync_lock = false;
+        start_next();
+        __set_PRIMASK(primask);
+    }
+}
+
+#endif
+
+void HAL_I2C_MasterTxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    transfer_done(true);
+    start_next();
+}
+
+void HAL_I2C_MasterRxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    transfer_done(true);
+    start_next();
+}
+
+void HAL_I2C_MemTxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    transfer_done(true);
+    start_next();
+}
+
+void HAL_I2C_MemRxCpltCallback (I2C_HandleTypeDef *hi2c)
+{
+    transfer_done(true);
+    start_next();
+}
+
+void HAL_I2C_ErrorCallback (I2C_HandleTypeDef *hi2c)
+{
+    if(current)
+        transfer_done(false);
+    start_next();
+}
+
+void I2C_EV_IRQHandler (void)
+{
+    HAL_I2C_EV_IRQHandler(&i2c_port);
+}
+
+void I2C_ER_IRQHandler (void)
+{
+    HAL_I2C_ER_IRQHandler(&i2c_port);
 }
 
 #endif
 
 #if EEPROM_ENABLE
 
+#if !EEPROM_IS_FRAM
+static uint8_t write_pending = 0; // Address of EEPROM with write cycle in progress, 0 if none
+#endif
+
 nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *i2c, bool read)
 {
-    while (HAL_I2C_GetState(&i2c_port) != HAL_I2C_STATE_READY);
+    static i2c_transfer_t transfer = {0};
+
+#if !EEPROM_IS_FRAM
+    // Wait for write cycle of the previous write to complete by polling for acknowledge,
+    // the EEPROM does not respond until done. 100 polls is about 10 ms at 100 kHz.
+    if(write_pending) {
+        i2c_lock(true);
+        HAL_I2C_IsDeviceReady(&i2c_port, write_pending << 1, 100, 10);
+        i2c_lock(false);
+        write_pending = 0;
+    }
+#endif
+
+    transfer.address = i2c->address;
+    transfer.read = read;
+    transfer.reg_bytes = i2c->word_addr_bytes;
+    transfer.reg = i2c->word_addr;
+    transfer.data = i2c->data;
+    transfer.count = i2c->count;
 
-//    while (HAL_I2C_IsDeviceReady(&i2c_port, (uint16_t)(0xA0), 3, 100) != HAL_OK);
+    i2c_transfer_sync(&transfer);
 
-    if(read)
-        HAL_I2C_Mem_Read(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 2 ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT, i2c->data, i2c->count, 100);
-    else {
-        HAL_I2C_Mem_Write(&i2c_port, i2c->address << 1, i2c->word_addr, i2c->word_addr_bytes == 2 ? I2C_MEMADD_SIZE_16BIT : I2C_MEMADD_SIZE_8BIT, i2c->data, i2c->count, 100);
 #if !EEPROM_IS_FRAM
-        hal.delay_ms(5, NULL);
+    if(!read)
+        write_pending = i2c->address;
 #endif
-    }
+
     i2c->data += i2c->count;
 
     return NVS_TransferResult_OK;
@@ -107,23 +290,27 @@ nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *i2c, bool read)
 
 static uint8_t keycode = 0;
 static keycode_callback_ptr keypad_callback = NULL;
+static i2c_transfer_t keypad_transfer = {
+    .read = true,
+    .high_priority = true,
+    .data = &keycode,
+    .count = 1
+};
 
-void I2C_GetKeycode (uint32_t i2cAddr, keycode_callback_ptr callback)
+static void keypad_read_complete (i2c_transfer_t *transfer, bool ok)
 {
-    keycode = 0;
-    keypad_callback = callback;
-
-    HAL_StatusTypeDef ret = HAL_I2C_Master_Receive_IT(&i2c_port, KEYPAD_I2CADDR << 1, &keycode, 1);
-
-    if(!ret)
-        ret = HAL_I2C_Master_Receive_IT(&i2c_port, KEYPAD_I2CADDR << 1, &keycode, 1);
+    if(ok && keypad_callback && keycode != 0)
+        keypad_callback(keycode);
 }
 
-void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+void I2C_GetKeycode (uint32_t i2cAddr, keycode_callback_ptr callback)
 {
-    if(keypad_callback && keycode != 0) {
-        keypad_callback(keycode);
-        keypad_callback = NULL;
+    if(!keypad_transfer.pending) {
+        keycode = 0;
+        keypad_callback = callback;
+        keypad_transfer.address = (uint8_t)i2cAddr;
+        keypad_transfer.on_complete = keypad_read_complete;
+        i2c_transfer_queue(&keypad_transfer);
     }
 }
 
@@ -131,8 +318,6 @@ void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
 
 #if TRINAMIC_ENABLE && TRINAMIC_I2C
 
-static const uint8_t tmc_addr = I2C_ADR_I2CBRIDGE << 1;
-
 static TMC2130_status_t TMC_I2C_ReadRegister (TMC2130_t *driver, TMC2130_datagram_t *reg)
 {
     uint8_t tmc_reg, buffer[5] = {0};
@@ -142,7 +327,16 @@ static TMC2130_status_t TMC_I2C_ReadRegister (TMC2130_t *driver, TMC2130_datagra
         return status; // unsupported register
     }
 
-    HAL_I2C_Mem_Read(&i2c_port, tmc_addr, tmc_reg, I2C_MEMADD_SIZE_8BIT, buffer, 5, 100);
+    i2c_transfer_t transfer = {
+        .address = I2C_ADR_I2CBRIDGE,
+        .read = true,
+        .reg_bytes = 1,
+        .reg = tmc_reg,
+        .data = buffer,
+        .count = 5
+    };
+
+    i2c_transfer_sync(&transfer);
 
     status.value = buffer[0];
     reg->payload.value = buffer[4];
@@ -169,7 +363,15 @@ static TMC2130_status_t TMC_I2C_WriteRegister (TMC2130_t *driver, TMC2130_datagr
         buffer[2] = (reg->payload.value >> 8) & 0xFF;
         buffer[3] = reg->payload.value & 0xFF;
 
-        HAL_I2C_Mem_Write(&i2c_port, tmc_addr, tmc_reg, I2C_MEMADD_SIZE_8BIT, buffer, 4, 100);
+        i2c_transfer_t transfer = {
+            .address = I2C_ADR_I2CBRIDGE,
+            .reg_bytes = 1,
+            .reg = tmc_reg,
+            .data = buffer,
+            .count = 4
+        };
+
+        i2c_transfer_sync(&transfer);
     }
 
     return status;
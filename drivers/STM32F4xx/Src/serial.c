@@ -26,11 +26,23 @@
 #include "driver.h"
 #include "serial.h"
 #include "grbl.h"
+#include "grbl/protocol.h"
 
 #include "main.h"
 
 static stream_rx_buffer_t rxbuf = {0};
-static stream_tx_buffer_t txbuf = {0}, rxbackup;
+static stream_tx_buffer_t txbuf = {0};
+
+#ifdef SERIAL_RX_DMA
+
+#ifndef SERIAL_RX_DMA_SIZE
+#define SERIAL_RX_DMA_SIZE 64 // Size of the circular DMA receive buffer, data is processed when half full, full or the line goes idle.
+#endif
+
+static uint8_t rx_dma_buf[SERIAL_RX_DMA_SIZE];
+static uint_fast16_t rx_dma_tail = 0;
+
+#endif
 
 void serialInit (void)
 {
@@ -46,6 +58,15 @@ void serialInit (void)
 
   #define USART USART2
   #define USART_IRQHandler USART2_IRQHandler
+  #define USART_IRQn USART2_IRQn
+  #define USART_CLK HAL_RCC_GetPCLK1Freq()
+  #define RX_DMA DMA1_Stream5
+  #define RX_DMA_CHANNEL 4
+  #define RX_DMA_IRQn DMA1_Stream5_IRQn
+  #define RX_DMA_IRQHandler DMA1_Stream5_IRQHandler
+  #define RX_DMA_IFCR DMA1->HIFCR
+  #define RX_DMA_IFCR_FLAGS (DMA_HIFCR_CHTIF5|DMA_HIFCR_CTCIF5|DMA_HIFCR_CTEIF5|DMA_HIFCR_CDMEIF5|DMA_HIFCR_CFEIF5)
+  #define RX_DMA_CLK_ENABLE __HAL_RCC_DMA1_CLK_ENABLE
 
     __HAL_RCC_USART2_CLK_ENABLE();
 
@@ -53,17 +74,19 @@ void serialInit (void)
     GPIO_InitStructure.Alternate = GPIO_AF7_USART2;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStructure);
 
-    USART->CR1 = USART_CR1_RE|USART_CR1_TE;
-    USART->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK1Freq(), 115200);
-    USART->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
-
-    HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(USART2_IRQn);
-
 #else
 
   #define USART USART1
   #define USART_IRQHandler USART1_IRQHandler
+  #define USART_IRQn USART1_IRQn
+  #define USART_CLK HAL_RCC_GetPCLK2Freq()
+  #define RX_DMA DMA2_Stream2
+  #define RX_DMA_CHANNEL 4
+  #define RX_DMA_IRQn DMA2_Stream2_IRQn
+  #define RX_DMA_IRQHandler DMA2_Stream2_IRQHandler
+  #define RX_DMA_IFCR DMA2->LIFCR
+  #define RX_DMA_IFCR_FLAGS (DMA_LIFCR_CHTIF2|DMA_LIFCR_CTCIF2|DMA_LIFCR_CTEIF2|DMA_LIFCR_CDMEIF2|DMA_LIFCR_CFEIF2)
+  #define RX_DMA_CLK_ENABLE __HAL_RCC_DMA2_CLK_ENABLE
 
     __HAL_RCC_USART1_CLK_ENABLE();
 
@@ -71,14 +94,39 @@ void serialInit (void)
     GPIO_InitStructure.Alternate = GPIO_AF7_USART1;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStructure);
 
+#endif
+
     USART->CR1 = USART_CR1_RE|USART_CR1_TE;
-    USART->BRR = UART_BRR_SAMPLING16(HAL_RCC_GetPCLK2Freq(), 115200);
-    USART->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+    USART->BRR = UART_BRR_SAMPLING16(USART_CLK, 115200);
+
+#ifdef SERIAL_RX_DMA
+
+    // Received characters are transferred to a circular buffer by DMA, processed on half and full transfer
+    // complete interrupts and when the line goes idle.
+
+    RX_DMA_CLK_ENABLE();
+
+    RX_DMA->CR = 0;
+    while(RX_DMA->CR & DMA_SxCR_EN);
+    RX_DMA_IFCR = RX_DMA_IFCR_FLAGS;
+
+    RX_DMA->PAR = (uint32_t)&USART->DR;
+    RX_DMA->M0AR = (uint32_t)rx_dma_buf;
+    RX_DMA->NDTR = SERIAL_RX_DMA_SIZE;
+    RX_DMA->CR = (RX_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos)|DMA_SxCR_MINC|DMA_SxCR_CIRC|DMA_SxCR_HTIE|DMA_SxCR_TCIE|DMA_SxCR_EN;
 
-    HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
-    HAL_NVIC_EnableIRQ(USART1_IRQn);
+    USART->CR3 |= USART_CR3_DMAR;
+    USART->CR1 |= (USART_CR1_UE|USART_CR1_IDLEIE);
 
+    HAL_NVIC_SetPriority(RX_DMA_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(RX_DMA_IRQn);
+
+#else
+    USART->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
 #endif
+
+    HAL_NVIC_SetPriority(USART_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(USART_IRQn);
 }
 
 //
@@ -191,28 +239,100 @@ bool serialSuspendInput (bool suspend)
 {
     if(suspend)
         hal.stream.read = serialGetNull;
-    else if(rxbuf.backup)
-        memcpy(&rxbuf, &rxbackup, sizeof(stream_rx_buffer_t));
+    else
+        stream_rx_resume(&rxbuf);
 
     return rxbuf.tail != rxbuf.head;
 }
 
+#ifdef SERIAL_RX_DMA
+
+// Adds received characters to the input buffer, runs of characters that are not realtime commands are copied without further checks.
+static void rx_insert (const uint8_t *data, uint_fast16_t length)
+{
+    uint_fast16_t run, next_head;
+
+    while(length) {
+
+        if((run = protocol_plain_run(data, length))) {
+            length -= run;
+            do {
+                next_head = (rxbuf.head + 1) & (RX_BUFFER_SIZE - 1);
+                if(stream_rx_buffer_full(&rxbuf, next_head))
+                    rxbuf.overflow = 1;
+                else {
+                    rxbuf.data[rxbuf.head] = (char)*data;
+                    rxbuf.head = next_head;
+                }
+                data++;
+            } while(--run);
+            continue;
+        }
+
+        length--;
+        next_head = (rxbuf.head + 1) & (RX_BUFFER_SIZE - 1);
+
+        if(stream_rx_buffer_full(&rxbuf, next_head))
+            rxbuf.overflow = 1;
+        else if(*data == CMD_TOOL_ACK && !rxbuf.backup) {
+            stream_rx_suspend(&rxbuf);
+            hal.stream.read = serialGetC; // restore normal input
+        } else if(!hal.stream.enqueue_realtime_command((char)*data)) {
+            rxbuf.data[rxbuf.head] = (char)*data;
+            rxbuf.head = next_head;
+        }
+        data++;
+    }
+}
+
+// Processes the characters transferred by DMA since last call, called from the DMA and USART interrupt handlers.
+static void rx_dma_process (void)
+{
+    uint_fast16_t head = SERIAL_RX_DMA_SIZE - RX_DMA->NDTR;
+
+    if(head == SERIAL_RX_DMA_SIZE)
+        head = 0;
+
+    if(head < rx_dma_tail) {
+        rx_insert(&rx_dma_buf[rx_dma_tail], SERIAL_RX_DMA_SIZE - rx_dma_tail);
+        rx_dma_tail = 0;
+    }
+
+    if(head > rx_dma_tail) {
+        rx_insert(&rx_dma_buf[rx_dma_tail], head - rx_dma_tail);
+        rx_dma_tail = head;
+    }
+}
+
+void RX_DMA_IRQHandler (void)
+{
+    RX_DMA_IFCR = RX_DMA_IFCR_FLAGS;
+
+    rx_dma_process();
+}
+
+#endif
+
 void USART_IRQHandler (void)
 {
+#ifdef SERIAL_RX_DMA
+    if(USART->SR & USART_SR_IDLE) {
+        (void)USART->DR; // Clear idle flag
+        rx_dma_process();
+    }
+#else
     if(USART->SR & USART_SR_RXNE) {
 
         uint16_t next_head = (rxbuf.head + 1) & (RX_BUFFER_SIZE - 1);   // Get and increment buffer pointer
 
-        if(rxbuf.tail == next_head) {                                   // If buffer full
+        if(stream_rx_buffer_full(&rxbuf, next_head)) {                  // If buffer full
             rxbuf.overflow = 1;                                         // flag overflow
             next_head =  USART->DR;                                     // and do dummy read to clear interrupt
         } else {
             char data = USART->DR;
             if(data == CMD_TOOL_ACK && !rxbuf.backup) {
 
-                memcpy(&rxbackup, &rxbuf, sizeof(stream_rx_buffer_t));
-                rxbuf.backup = true;
-                rxbuf.tail = rxbuf.head;
+                stream_rx_suspend(&rxbuf);
                 hal.stream.read = serialGetC; // restore normal input
 
             } else if(!hal.stream.enqueue_realtime_command(data)) {     // Check and strip realtime commands,
@@ -221,6 +341,7 @@ void USART_IRQHandler (void)
             }
         }
     }
+#endif
 
     if((USART->SR & USART_SR_TXE) && (USART->CR1 & USART_CR1_TXEIE)) {
 
@@ -60,6 +60,8 @@ void spi_init (void)
 
         HAL_SPI_Init(&hspi1);
         __HAL_SPI_ENABLE(&hspi1);
+
+        __HAL_RCC_DMA2_CLK_ENABLE();
     }
 
     init = true;
@@ -96,3 +98,49 @@ void spi_put_byte (uint8_t byte)
     __HAL_SPI_CLEAR_OVRFLAG(&hspi1);
 }
 
+// Block transfers by DMA, SPI1 RX on DMA2 stream 0 and TX on DMA2 stream 3, channel 3.
+// NOTE: data buffers must not be located in CCM RAM as it is not accessible by DMA.
+
+#define SPI_DMA_RX DMA2_Stream0
+#define SPI_DMA_TX DMA2_Stream3
+#define SPI_DMA_CHANNEL (3 << DMA_SxCR_CHSEL_Pos)
+#define SPI_DMA_FLAGS (DMA_LIFCR_CTCIF0|DMA_LIFCR_CHTIF0|DMA_LIFCR_CTEIF0|DMA_LIFCR_CDMEIF0|DMA_LIFCR_CFEIF0|\
+                       DMA_LIFCR_CTCIF3|DMA_LIFCR_CHTIF3|DMA_LIFCR_CTEIF3|DMA_LIFCR_CDMEIF3|DMA_LIFCR_CFEIF3)
+
+// Transfers length bytes, received data is discarded if rx is NULL and 0xFF is sent if tx is NULL.
+static void spi_dma_transfer (uint8_t *rx, const uint8_t *tx, uint16_t length)
+{
+    static uint8_t rx_dummy, tx_dummy = 0xFF;
+
+    while(hspi1.Instance->SR & SPI_SR_BSY);
+    __HAL_SPI_CLEAR_OVRFLAG(&hspi1);
+
+    DMA2->LIFCR = SPI_DMA_FLAGS;
+
+    SPI_DMA_RX->PAR = SPI_DMA_TX->PAR = (uint32_t)&hspi1.Instance->DR;
+    SPI_DMA_RX->M0AR = (uint32_t)(rx ? rx : &rx_dummy);
+    SPI_DMA_TX->M0AR = (uint32_t)(tx ? tx : &tx_dummy);
+    SPI_DMA_RX->NDTR = SPI_DMA_TX->NDTR = length;
+
+    hspi1.Instance->CR2 |= SPI_CR2_RXDMAEN;
+    SPI_DMA_RX->CR = SPI_DMA_CHANNEL|(rx ? DMA_SxCR_MINC : 0)|DMA_SxCR_EN;
+    SPI_DMA_TX->CR = SPI_DMA_CHANNEL|(tx ? DMA_SxCR_MINC : 0)|DMA_SxCR_DIR_0|DMA_SxCR_EN;
+    hspi1.Instance->CR2 |= SPI_CR2_TXDMAEN;
+
+    while(!(DMA2->LISR & DMA_LISR_TCIF0)); // Wait for the last byte to be received
+
+    hspi1.Instance->CR2 &= ~(SPI_CR2_RXDMAEN|SPI_CR2_TXDMAEN);
+    SPI_DMA_RX->CR = SPI_DMA_TX->CR = 0;
+}
+
+// Reads a block of data, 0xFF is sent while reading.
+void spi_read (uint8_t *data, uint16_t length)
+{
+    spi_dma_transfer(data, NULL, length);
+}
+
+// Writes a block of data, received data is discarded.
+void spi_write (const uint8_t *data, uint16_t length)
+{
+    spi_dma_transfer(NULL, data, length);
+}
@@ -19,6 +19,8 @@
   along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <math.h>
+
 #include "driver.h"
 
 #if defined(BOARD_MORPHO_CNC)
@@ -38,50 +40,115 @@ static void digital_out (uint8_t port, bool on)
             break;
     }
 }
-/*
-inline static __attribute__((always_inline)) int32_t get_input(gpio_t *gpio, wait_mode_t wait_mode, float timeout)
+
+// Changes are applied with a single BSRR write when both outputs are on the same GPIO port.
+static void digital_out_mask (uint32_t mask, uint32_t value)
 {
-    uint_fast16_t delay = wait_mode == WaitMode_Immediate || timeout == 0.0f ? 0 : (uint_fast16_t)ceilf((1000.0f / 50.0f) * timeout) + 1;
+    uint32_t bsrr = 0;
 
-    bool wait_for = wait_mode != WaitMode_Low;
+    value ^= settings.ioport.invert_out.mask;
 
-    do {
-        if(!!(gpio->reg->DR & gpio->bit) == wait_for)
-            return !!(gpio->reg->DR & gpio->bit);
+    if(mask & 0x01)
+        bsrr |= (value & 0x01) ? AUXOUTPUT0_BIT : (AUXOUTPUT0_BIT << 16);
 
-        if(delay) {
-            protocol_execute_realtime();
-            hal.delay_ms(50, NULL);
-        } else
-            break;
-    } while(--delay && !sys.abort);
+    if(mask & 0x02)
+        bsrr |= (value & 0x02) ? AUXOUTPUT1_BIT : (AUXOUTPUT1_BIT << 16);
+
+    if(AUXOUTPUT0_PORT == AUXOUTPUT1_PORT)
+        AUXOUTPUT0_PORT->BSRR = bsrr;
+    else {
+        AUXOUTPUT0_PORT->BSRR = bsrr & (AUXOUTPUT0_BIT|(AUXOUTPUT0_BIT << 16));
+        AUXOUTPUT1_PORT->BSRR = bsrr & (AUXOUTPUT1_BIT|(AUXOUTPUT1_BIT << 16));
+    }
+}
+
+static ioport_interrupt_callback_ptr aux_irq_callback[2] = {0};
 
-    return -1;
+static inline bool get_input (uint_fast8_t port)
+{
+    return port == 0
+            ? !!(AUXINPUT0_PORT->IDR & AUXINPUT0_BIT) ^ settings.ioport.invert_in.bit0
+            : !!(AUXINPUT1_PORT->IDR & AUXINPUT1_BIT) ^ settings.ioport.invert_in.bit1;
 }
-*/
+
+// Polled wait, M66 waits by register_interrupt_handler() below when possible.
 static int32_t wait_on_input (bool digital, uint8_t port, wait_mode_t wait_mode, float timeout)
 {
     int32_t value = -1;
-/*
-    if(digital) {
-        switch(port) {
-            case 0:
-                value = get_input(&st0, wait_mode, timeout);
+
+    if(digital && port < 2) {
+
+        uint_fast16_t delay = wait_mode == WaitMode_Immediate || timeout == 0.0f ? 0 : (uint_fast16_t)ceilf((1000.0f / 50.0f) * timeout) + 1;
+        bool wait_for = wait_mode == WaitMode_Rise || wait_mode == WaitMode_High;
+
+        do {
+            if(wait_mode == WaitMode_Immediate || get_input(port) == wait_for) {
+                value = get_input(port);
                 break;
+            }
 
-            case 1:
-                value = get_input(&st1, wait_mode, timeout);
+            if(delay) {
+                protocol_execute_realtime();
+                hal.delay_ms(50, NULL);
+            } else
                 break;
-        }
+        } while(--delay && !sys.abort);
     }
-*/
+
     return value;
 }
 
+static bool register_interrupt_handler (uint8_t port, pin_irq_mode_t irq_mode, ioport_interrupt_callback_ptr interrupt_callback)
+{
+    if(port > 1)
+        return false;
+
+    bool invert = port == 0 ? settings.ioport.invert_in.bit0 : settings.ioport.invert_in.bit1;
+    GPIO_InitTypeDef GPIO_Init = {0};
+
+    GPIO_Init.Pin = port == 0 ? AUXINPUT0_BIT : AUXINPUT1_BIT;
+    GPIO_Init.Pull = (port == 0 ? settings.ioport.pullup_disable_in.bit0 : settings.ioport.pullup_disable_in.bit1) ? GPIO_NOPULL : GPIO_PULLUP;
+
+    switch(irq_mode) {
+
+        case IRQ_Mode_Rising:
+            GPIO_Init.Mode = invert ? GPIO_MODE_IT_FALLING : GPIO_MODE_IT_RISING;
+            break;
+
+        case IRQ_Mode_Falling:
+            GPIO_Init.Mode = invert ? GPIO_MODE_IT_RISING : GPIO_MODE_IT_FALLING;
+            break;
+
+        default:
+            GPIO_Init.Mode = GPIO_MODE_INPUT;
+            interrupt_callback = NULL;
+            break;
+    }
+
+    aux_irq_callback[port] = interrupt_callback;
+
+    __HAL_GPIO_EXTI_CLEAR_IT(GPIO_Init.Pin);
+    HAL_GPIO_Init(port == 0 ? AUXINPUT0_PORT : AUXINPUT1_PORT, &GPIO_Init);
+
+    return true;
+}
+
+// Called from EXTI15_10_IRQHandler() in driver.c
+void board_aux_interrupt_handler (uint32_t ifg)
+{
+    if((ifg & AUXINPUT0_BIT) && aux_irq_callback[0])
+        aux_irq_callback[0](0, get_input(0));
+
+    if((ifg & AUXINPUT1_BIT) && aux_irq_callback[1])
+        aux_irq_callback[1](1, get_input(1));
+}
+
 void board_init (void)
 {
     hal.port.wait_on_input = wait_on_input;
+    hal.port.register_interrupt_handler = register_interrupt_handler;
     hal.port.digital_out = digital_out;
+    hal.port.digital_out_mask = digital_out_mask;
     hal.port.num_digital_in = 2;
     hal.port.num_digital_out = 2;
 
@@ -95,6 +162,9 @@ void board_init (void)
 
     GPIO_Init.Pin = AUXOUTPUT1_BIT;
     HAL_GPIO_Init(AUXOUTPUT1_PORT, &GPIO_Init);
+
+    register_interrupt_handler(0, IRQ_Mode_None, NULL);
+    register_interrupt_handler(1, IRQ_Mode_None, NULL);
 }
 
 #endif
@@ -24,6 +24,7 @@
 #include "driver.h"
 #include "serial.h"
 #include "../grbl/grbl.h"
+#include "../grbl/protocol.h"
 
 #include "main.h"
 #include "usbd_cdc_if.h"
@@ -31,9 +32,28 @@
 
 static char txdata2[BLOCK_TX_BUFFER_SIZE]; // Secondary TX buffer (for double buffering)
 static bool use_tx2data = false;
-static stream_rx_buffer_t rxbuf = {0}, rxbackup;
+static stream_rx_buffer_t rxbuf = {0};
+// Set when the OUT endpoint is not rearmed, the host is NAKed until there is room for a packet.
+// NOTE: realtime commands are then delayed until input is read, senders keeping track of the
+//       buffer fill level (character counting) never fill the buffer.
+static volatile bool rx_held = false;
 static stream_block_tx_buffer_t txbuf = {0};
 
+#if USB_REALTIME_CHANNEL
+
+// Time in milliseconds a realtime channel write may wait for the host before the channel is considered closed.
+#ifndef USB_RT_TX_TIMEOUT
+#define USB_RT_TX_TIMEOUT 50
+#endif
+
+// Realtime channel transmit buffers, a buffer is kept until its transfer is complete.
+static char rt_txdata[2][BLOCK_TX_BUFFER_SIZE];
+static uint_fast8_t rt_txidx = 0;
+// Set when the host has started using the realtime channel, status reports are then output there.
+static volatile bool rt_active = false;
+
+#endif
+
 void usbInit (void)
 {
     MX_USB_DEVICE_Init();
@@ -51,12 +71,30 @@ uint16_t usbRxFree (void)
     return RX_BUFFER_SIZE - BUFCOUNT(head, tail, RX_BUFFER_SIZE);
 }
 
+// Returns true if a full packet can be added to the input buffer without overwriting unread or suspended input.
+static inline bool rx_packet_room (void)
+{
+    uint_fast16_t tail = rxbuf.backup ? rxbuf.suspend_tail : rxbuf.tail, head = rxbuf.head;
+
+    return RX_BUFFER_SIZE - 1 - BUFCOUNT(head, tail, RX_BUFFER_SIZE) >= CDC_DATA_FS_MAX_PACKET_SIZE;
+}
+
+// Rearms the OUT endpoint if reception was held back and there is room for a packet.
+static inline void rx_release (void)
+{
+    if(rx_held && rx_packet_room()) {
+        rx_held = false;
+        CDC_ReceiveResume_FS();
+    }
+}
+
 //
 // Flushes the input buffer
 //
 void usbRxFlush (void)
 {
     rxbuf.head = rxbuf.tail = 0;
+    rx_release();
 }
 
 //
@@ -67,6 +105,7 @@ void usbRxCancel (void)
     rxbuf.data[rxbuf.head] = ASCII_CAN;
     rxbuf.tail = rxbuf.head;
     rxbuf.head = (rxbuf.tail + 1) & (RX_BUFFER_SIZE - 1);
+    rx_release();
 }
 
 //
@@ -134,6 +173,8 @@ int16_t usbGetC (void)
     char data = rxbuf.data[bptr++];             // Get next character, increment tmp pointer
     rxbuf.tail = bptr & (RX_BUFFER_SIZE - 1);   // and update pointer
 
+    rx_release();
+
     return (int16_t)data;
 }
 
@@ -147,26 +188,46 @@ bool usbSuspendInput (bool suspend)
 {
     if(suspend)
         hal.stream.read = usbGetNull;
-    else if(rxbuf.backup)
-        memcpy(&rxbuf, &rxbackup, sizeof(stream_rx_buffer_t));
+    else {
+        stream_rx_resume(&rxbuf);
+        rx_release();
+    }
 
     return rxbuf.tail != rxbuf.head;
 }
 
-void usbBufferInput (uint8_t *data, uint32_t length)
+// Adds a received packet to the input buffer, returns false if the buffer has no room for another packet.
+// The caller then has to hold back reception, it is resumed when enough input has been read.
+bool usbBufferInput (uint8_t *data, uint32_t length)
 {
-    while(length--) {
+    uint_fast16_t run, next_head;
+
+    while(length) {
+
+        if((run = protocol_plain_run(data, length))) {                     // Characters that are not realtime commands
+            length -= run;                                                  // are copied without further checks
+            do {
+                next_head = (rxbuf.head + 1) & (RX_BUFFER_SIZE - 1);
+                if(stream_rx_buffer_full(&rxbuf, next_head))
+                    rxbuf.overflow = 1;
+                else {
+                    rxbuf.data[rxbuf.head] = *data;
+                    rxbuf.head = next_head;
+                }
+                data++;
+            } while(--run);
+            continue;
+        }
 
-        uint_fast16_t next_head = (rxbuf.head + 1)  & (RX_BUFFER_SIZE - 1); // Get and increment buffer pointer
+        length--;
+        next_head = (rxbuf.head + 1)  & (RX_BUFFER_SIZE - 1);               // Get and increment buffer pointer
 
-        if(rxbuf.tail == next_head) {                                       // If buffer full
+        if(stream_rx_buffer_full(&rxbuf, next_head)) {                      // If buffer full
             rxbuf.overflow = 1;                                             // flag overflow
         } else {
             if(*data == CMD_TOOL_ACK && !rxbuf.backup) {
 
-                memcpy(&rxbackup, &rxbuf, sizeof(stream_rx_buffer_t));
-                rxbuf.backup = true;
-                rxbuf.tail = rxbuf.head;
+                stream_rx_suspend(&rxbuf);
                 hal.stream.read = usbGetC; // restore normal input
 
             } else if(!hal.stream.enqueue_realtime_command(*data)) {        // Check and strip realtime commands,
@@ -176,4 +237,68 @@ void usbBufferInput (uint8_t *data, uint32_t length)
         }
         data++;                                                             // next
     }
+
+    rx_held = !rx_packet_room();
+
+    return !rx_held;
+}
+
+#if USB_REALTIME_CHANNEL
+
+// The realtime channel is a vendor specific interface with its own pair of bulk endpoints.
+// Input is always accepted since only realtime commands are processed, other characters are dropped.
+// Real-time status reports are output on the channel once the host has sent a command to it, so
+// polling is never queued behind streamed G-code responses and streaming is not interleaved with reports.
+void usbRtBufferInput (uint8_t *data, uint32_t length)
+{
+    rt_active = true;
+
+    while(length--)
+        hal.stream.enqueue_realtime_command(*data++);
+}
+
+// Transmits a chunk on the realtime channel, returns false if the host does not read the channel.
+static bool usb_rt_transmit (uint8_t *data, uint16_t length)
+{
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    while(CDC_TransmitRt_FS(data, length) == USBD_BUSY) {
+        if(!hal.stream_blocking_callback() || hal.get_elapsed_ticks() - ms > USB_RT_TX_TIMEOUT)
+            return false;
+    }
+
+    return true;
 }
+
+//
+// Writes a null terminated string to the realtime channel, falls back to the main channel if not in use.
+//
+void usbRtWriteS (const char *s)
+{
+    if(!rt_active) {
+        usbWriteS(s);
+        return;
+    }
+
+    size_t length = strlen(s), chunk;
+
+    while(length) {
+
+        chunk = length > BLOCK_TX_BUFFER_SIZE ? BLOCK_TX_BUFFER_SIZE : length;
+
+        // The other buffer may still be in transfer, it is released when this one can be submitted.
+        memcpy(rt_txdata[rt_txidx], s, chunk);
+
+        if(!usb_rt_transmit((uint8_t *)rt_txdata[rt_txidx], chunk) ||
+            (chunk % CDC_RT_PACKET_SIZE == 0 && !usb_rt_transmit(NULL, 0))) {
+            rt_active = false; // Host has gone away, revert to the main channel until it is used again
+            return;
+        }
+
+        rt_txidx ^= 1;
+        length -= chunk;
+        s += chunk;
+    }
+}
+
+#endif
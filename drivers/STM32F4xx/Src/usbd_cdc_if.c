@@ -133,6 +133,9 @@ static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len);
 static int8_t CDC_TransmitCplt_FS(uint8_t *pbuf, uint32_t *Len, uint8_t epnum);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
+#if USB_REALTIME_CHANNEL
+static int8_t CDC_ReceiveRt_FS(uint8_t* pbuf, uint32_t *Len);
+#endif
 
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
@@ -147,6 +150,9 @@ USBD_CDC_ItfTypeDef USBD_Interface_fops_FS =
   CDC_Control_FS,
   CDC_Receive_FS,
   CDC_TransmitCplt_FS
+#if USB_REALTIME_CHANNEL
+  , CDC_ReceiveRt_FS
+#endif
 };
 
 /* Private functions ---------------------------------------------------------*/
@@ -265,9 +271,9 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
-  usbBufferInput(Buf, *Len);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  if(usbBufferInput(Buf, *Len)) // Leave the OUT endpoint NAKing if the input buffer has no room for another packet,
+    USBD_CDC_ReceivePacket(&hUsbDeviceFS); // it is rearmed by CDC_ReceiveResume_FS() when data has been read.
   return (USBD_OK);
   /* USER CODE END 6 */
 }
@@ -322,6 +328,45 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
+/**
+  * @brief  CDC_ReceiveResume_FS
+  *         Rearms the OUT endpoint after reception was held back by CDC_Receive_FS.
+  * @retval None
+  */
+void CDC_ReceiveResume_FS (void)
+{
+  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+}
+
+#if USB_REALTIME_CHANNEL
+
+/**
+  * @brief  CDC_ReceiveRt_FS
+  *         Data received on the realtime channel OUT endpoint, the endpoint is rearmed on return.
+  * @param  Buf: Buffer of data received
+  * @param  Len: Number of data received (in bytes)
+  * @retval USBD_OK
+  */
+static int8_t CDC_ReceiveRt_FS (uint8_t* Buf, uint32_t *Len)
+{
+  usbRtBufferInput(Buf, *Len);
+  return (USBD_OK);
+}
+
+/**
+  * @brief  CDC_TransmitRt_FS
+  *         Data to send on the realtime channel IN endpoint.
+  * @param  Buf: Buffer of data to be sent, must be kept until the transfer is complete
+  * @param  Len: Number of data to be sent (in bytes)
+  * @retval USBD_OK if all operations are OK else USBD_FAIL or USBD_BUSY
+  */
+uint8_t CDC_TransmitRt_FS (uint8_t *Buf, uint16_t Len)
+{
+  return USBD_CDC_TransmitRtPacket(&hUsbDeviceFS, Buf, Len);
+}
+
+#endif
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
@@ -166,9 +166,15 @@ __ALIGN_BEGIN uint8_t USBD_FS_DeviceDesc[USB_LEN_DEV_DESC] __ALIGN_END =
   0x00,                       /*bcdUSB */
 #endif /* (USBD_LPM_ENABLED == 1) */
   0x02,
+#if USB_REALTIME_CHANNEL
+  0xEF,                       /*bDeviceClass: Miscellaneous, composite device with IAD*/
+  0x02,                       /*bDeviceSubClass: Common Class*/
+  0x01,                       /*bDeviceProtocol: Interface Association Descriptor*/
+#else
   0x02,                       /*bDeviceClass*/
   0x02,                       /*bDeviceSubClass*/
   0x00,                       /*bDeviceProtocol*/
+#endif
   USB_MAX_EP0_SIZE,           /*bMaxPacketSize*/
   LOBYTE(USBD_VID),           /*idVendor*/
   HIBYTE(USBD_VID),           /*idVendor*/
@@ -0,0 +1,474 @@
+/*
+  bench.c - planner and stepper benchmark
+
+  Part of Grbl Simulator
+
+  2020 - Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Feeds G-code corpora through the parser, planner, segment prep and the simulated stepper interrupt in a single
+  thread, simulated time jumps straight from one timer event to the next. Runs are deterministic for a given
+  settings file. Input is fed as fast as the parser accepts it, there is no serial port pacing.
+
+  After each corpus the following is reported:
+    lines/s, blocks/s and segments/s - throughput in CPU time, includes the simulated hardware
+    cycle time                       - simulated job execution time
+    underruns                        - times the segment buffer ran dry with motion pending, i.e. planner starvation
+    min planner blocks               - lowest number of blocks in the planner when a new block was loaded for prep
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "simulator.h"
+#include "eeprom.h"
+#include "serial.h"
+#include "isr_cost.h"
+
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/grbllib.h"
+
+#define BENCH_MAX_CORPORA 16
+#define BENCH_IDLE_TICKS (F_CPU / 1000)
+
+typedef bool (*corpus_line_ptr)(uint32_t n, char *line);
+
+typedef struct {
+    const char *name;
+    const char *const *prologue;    // Lines to output before the generated lines, NULL terminated
+    const char *const *epilogue;    // Lines to output after the generated lines, NULL terminated
+    corpus_line_ptr line;           // Generates line n, returns false when done
+} corpus_t;
+
+typedef struct {
+    uint32_t lines;
+    uint32_t blocks;
+    uint32_t segments;
+    uint32_t errors;
+    uint64_t start_tick;
+    clock_t start_clock;
+} bench_stats_t;
+
+arg_vars_t args;
+const char *progname;
+
+static const char *const preamble[] = { "$X", "G21G90G94G17", NULL };
+static const char *const none[] = { NULL };
+
+// Dense 3D surfacing: zig-zag over a 100 x 100 mm wavy surface, 0.25 mm point spacing and 1 mm stepover.
+static const char *const surfacing_prologue[] = { "G0Z5", "G0X0Y0", "G1Z0F2000", NULL };
+
+static bool surfacing_line (uint32_t n, char *line)
+{
+    uint32_t row = n / 401, col = n % 401;
+
+    if(row > 100)
+        return false;
+
+    float x = (row & 1) ? 100.0f - col * 0.25f : col * 0.25f, y = (float)row;
+
+    sprintf(line, "G1X%.3fY%.3fZ%.3f", x, y, 2.0f * sinf(x / 10.0f) * cosf(y / 10.0f));
+
+    return true;
+}
+
+// Laser raster: 100 rows of 200 pixels at 0.1 mm, constant velocity with power changing every pixel.
+static const char *const raster_prologue[] = { "$32=1", "G0X0Y0", "M4S0", "G1F3000", NULL };
+static const char *const raster_epilogue[] = { "M5", "$32=0", NULL };
+
+static bool raster_line (uint32_t n, char *line)
+{
+    uint32_t row = n / 201, col = n % 201;
+
+    if(row >= 100)
+        return false;
+
+    if(col == 200)
+        sprintf(line, "G0Y%.1fS0", (row + 1) * 0.1f);
+    else
+        sprintf(line, "G1X%.1fS%u", (row & 1) ? 20.0f - col * 0.1f : col * 0.1f, (uint32_t)((row * 7 + col * 13) % 1000));
+
+    return true;
+}
+
+// Arcs: full circles from 1 to 50 mm radius, alternating direction.
+static const char *const arcs_prologue[] = { "G0X1Y0", "G1F1500", NULL };
+
+static bool arcs_line (uint32_t n, char *line)
+{
+    float r = (float)(n / 2 + 1);
+
+    if(n >= 100)
+        return false;
+
+    if(n & 1)
+        sprintf(line, "G1X%.3fY0", r + 1.0f);
+    else
+        sprintf(line, "%sX%.3fY0I%.3fJ0", (n & 2) ? "G2" : "G3", r, -r);
+
+    return true;
+}
+
+// Canned cycles: drilling a 20 x 20 grid with G81, then a 10 x 10 grid with peck drilling G83.
+static const char *const cycles_prologue[] = { "G0Z5", "G98", NULL };
+static const char *const cycles_epilogue[] = { "G80", NULL };
+
+static bool cycles_line (uint32_t n, char *line)
+{
+    if(n < 400) {
+        if(n == 0)
+            sprintf(line, "G81X0Y0Z-2R1F300");
+        else
+            sprintf(line, "X%uY%u", (n % 20) * 5, (n / 20) * 5);
+    } else if((n -= 400) < 100) {
+        if(n == 0)
+            sprintf(line, "G83X0Y0Z-10R1Q2F300");
+        else
+            sprintf(line, "X%uY%u", (n % 10) * 10, (n / 10) * 10);
+    } else
+        return false;
+
+    return true;
+}
+
+static const corpus_t corpora[] = {
+    { .name = "surfacing", .prologue = surfacing_prologue, .epilogue = none, .line = surfacing_line },
+    { .name = "raster", .prologue = raster_prologue, .epilogue = raster_epilogue, .line = raster_line },
+    { .name = "arcs", .prologue = arcs_prologue, .epilogue = none, .line = arcs_line },
+    { .name = "cycles", .prologue = cycles_prologue, .epilogue = cycles_epilogue, .line = cycles_line }
+};
+
+static struct {
+    const char *name[BENCH_MAX_CORPORA];
+    uint_fast8_t count;
+    uint_fast8_t current;
+    const corpus_t *corpus;         // Built in corpus, NULL if file
+    FILE *file;
+    enum { Input_Preamble, Input_Prologue, Input_Lines, Input_Epilogue, Input_Done } phase;
+    uint32_t n;
+    char line[LINE_BUFFER_SIZE];
+    char *c;
+} input;
+
+static bench_stats_t stats;
+static bool verbose = false, started = false;
+static uint64_t next_byte_tick;
+static plan_block_t *planner_head = NULL;
+static stepper_cycles_per_tick_ptr cycles_per_tick = NULL;
+
+// Planner accessor, see planner_inject_accessors.c
+plan_block_t *get_block_buffer_head();
+
+int usage (const char *badarg)
+{
+    uint_fast8_t idx;
+
+    if (badarg)
+        printf("Unrecognized option %s\n", badarg);
+
+    printf("Usage: \n"
+      "%s [options] <corpus> [<corpus>...]\n"
+      "  Options:\n"
+      "    -e <EEPROM file>   : file containing grblHAL settings.  default = BENCH.DAT\n"
+      "    -m <MCU>           : charge stepper interrupt execution time for the MCU and report overruns.\n"
+      "    -v                 : output grbl responses.\n"
+      "    -h                 : this help.\n"
+      "\n  A corpus is a G-code file or one of the built in corpora:",
+      progname);
+
+    for(idx = 0; idx < sizeof(corpora) / sizeof(corpus_t); idx++)
+        printf(" %s", corpora[idx].name);
+
+    printf("\n  MCU is one of:");
+    isr_cost_list(stdout);
+
+    printf("\n\n");
+
+    return -1;
+}
+
+static void stats_reset (void)
+{
+    st_stats_t st_stats;
+
+    memset(&stats, 0, sizeof(bench_stats_t));
+    stats.start_tick = sim.masterclock;
+    stats.start_clock = clock();
+
+    st_get_stats(&st_stats, true);
+    isr_cost_reset();
+}
+
+static void stats_report (void)
+{
+    st_stats_t st_stats;
+    double cpu = (double)(clock() - stats.start_clock) / CLOCKS_PER_SEC;
+
+    st_get_stats(&st_stats, false);
+
+    if(cpu <= 0.0)
+        cpu = 1e-9;
+
+    printf("%-12s lines: %u (%.0f/s), blocks: %u (%.0f/s), segments: %u (%.0f/s), cycle time: %.3f s, underruns: %u, min planner blocks: %u, errors: %u\n",
+            input.name[input.current],
+            stats.lines, stats.lines / cpu,
+            stats.blocks, stats.blocks / cpu,
+            stats.segments, stats.segments / cpu,
+            (double)(sim.masterclock - stats.start_tick) / (double)F_CPU,
+            st_stats.underruns, (uint32_t)st_stats.planner_buffer_min, stats.errors);
+
+    isr_cost_report(stdout);
+
+    fflush(stdout);
+}
+
+// Opens the next corpus, returns false if none left.
+static bool corpus_open (void)
+{
+    uint_fast8_t idx;
+
+    if(input.file) {
+        fclose(input.file);
+        input.file = NULL;
+    }
+
+    if(input.current >= input.count)
+        return false;
+
+    input.corpus = NULL;
+    for(idx = 0; idx < sizeof(corpora) / sizeof(corpus_t); idx++) {
+        if(!strcmp(input.name[input.current], corpora[idx].name))
+            input.corpus = &corpora[idx];
+    }
+
+    if(input.corpus == NULL && (input.file = fopen(input.name[input.current], "r")) == NULL) {
+        printf("Error opening : %s\n", input.name[input.current]);
+        exit(-1);
+    }
+
+    input.phase = Input_Preamble;
+    input.n = 0;
+    input.c = NULL;
+
+    stats_reset();
+
+    return true;
+}
+
+// Fetches the next line of the current corpus, returns false at end of corpus.
+static bool corpus_line (void)
+{
+    const char *s = NULL;
+
+    while(s == NULL && input.phase != Input_Done) {
+
+        switch(input.phase) {
+
+            case Input_Preamble:
+                if((s = preamble[input.n]) == NULL)
+                    input.phase = input.corpus ? Input_Prologue : Input_Lines;
+                break;
+
+            case Input_Prologue:
+                if((s = input.corpus->prologue[input.n]) == NULL)
+                    input.phase = Input_Lines;
+                break;
+
+            case Input_Lines:
+                if(input.corpus ? input.corpus->line(input.n, input.line) : fgets(input.line, sizeof(input.line), input.file) != NULL)
+                    s = input.line;
+                else
+                    input.phase = input.corpus ? Input_Epilogue : Input_Done;
+                break;
+
+            case Input_Epilogue:
+                if((s = input.corpus->epilogue[input.n]) == NULL)
+                    input.phase = Input_Done;
+                break;
+
+            default:
+                break;
+        }
+
+        if(s)
+            input.n++;
+        else
+            input.n = 0;
+    }
+
+    if(s && s != input.line)
+        strcpy(input.line, s);
+
+    input.c = s ? input.line : NULL;
+
+    return s != NULL;
+}
+
+static void countSegment (uint32_t cycles)
+{
+    stats.segments++;
+
+    cycles_per_tick(cycles);
+}
+
+// Runs the simulated hardware up to the next event, called by the foreground process on each main loop pass and while waiting.
+// Starts the next corpus, or exits, when the current corpus has been executed.
+static void bench_realtime (void)
+{
+    plan_block_t *head = get_block_buffer_head();
+
+    if(!started)
+        started = corpus_open();
+
+    if(cycles_per_tick == NULL && hal.stepper.cycles_per_tick) {
+        cycles_per_tick = hal.stepper.cycles_per_tick;
+        hal.stepper.cycles_per_tick = countSegment;
+    }
+
+    // Count the blocks added to the planner since the last pass, merged blocks are not counted.
+    if(planner_head)
+        while(planner_head != head) {
+            stats.blocks++;
+            planner_head = planner_head->next;
+        }
+    planner_head = head;
+
+    // Limit the time skipped when no timer is running, the parser is not paced.
+    next_byte_tick = sim.masterclock + BENCH_IDLE_TICKS;
+    sim_next_event(&next_byte_tick);
+
+    if(input.phase == Input_Done && input.c == NULL && plan_get_current_block() == NULL && (sys.state == STATE_IDLE || sys.state == STATE_ALARM)) {
+        stats_report();
+        input.current++;
+        if(!corpus_open()) {
+            shutdown_simulator();
+            eeprom_close();
+            exit(stats.errors ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+    }
+}
+
+// Stream implementation, replaces the serial port simulation in serial.c
+
+void serialInit (void)
+{
+}
+
+int16_t serialGetC (void)
+{
+    int16_t c;
+
+    if(!started || (input.c == NULL && !corpus_line()))
+        return SERIAL_NO_DATA;
+
+    if((c = *input.c++) == '\0' || c == '\n') {
+        input.c = NULL;
+        stats.lines++;
+        c = '\n';
+    }
+
+    return c;
+}
+
+void serialWriteS (const char *data)
+{
+    if(!strncmp(data, "error", 5))
+        stats.errors++;
+
+    if(verbose)
+        fputs(data, stdout);
+}
+
+bool serialSuspendInput (bool suspend)
+{
+    return false;
+}
+
+uint16_t serialRxFree (void)
+{
+    return RX_BUFFER_SIZE;
+}
+
+void serialRxFlush (void)
+{
+}
+
+void serialRxCancel (void)
+{
+}
+
+int main (int argc, char *argv[])
+{
+    progname = argv[0];
+
+    args.step_out_file = stderr;
+    args.block_out_file = stdout;
+    args.serial_out_file = stdout;
+    strcpy(args.eeprom_file, "BENCH.DAT");
+
+    while (argc > 1) {
+        argv++; argc--;
+        if (argv[0][0] == '-') {
+
+            switch(argv[0][1]) {
+
+                case 'e': //EEPROM file
+                    if(argc < 2)
+                        return usage(*argv);
+                    argv++; argc--;
+                    strcpy(args.eeprom_file, *argv);
+                    break;
+
+                case 'm': //MCU stepper interrupt cost profile
+                    if(argc < 2 || !isr_cost_select(argv[1]))
+                        return usage(*argv);
+                    argv++; argc--;
+                    break;
+
+                case 'v': //Verbose
+                    verbose = true;
+                    break;
+
+                case 'h':
+                    return usage(NULL);
+
+                default:
+                    return usage(*argv);
+            }
+        } else if(input.count < BENCH_MAX_CORPORA)
+            input.name[input.count++] = *argv;
+    }
+
+    if(input.count == 0)
+        return usage(NULL);
+
+    platform_init();
+
+    init_simulator(0.0f);
+
+    sim.event_driven = true;
+    sim.baud_ticks = INT32_MAX; // No serial port simulation
+    sim.on_realtime = bench_realtime;
+
+    grbl_enter();
+
+    return 0;
+}
@@ -26,10 +26,14 @@
 #include "eeprom.h"
 #include "grbl_eeprom_extensions.h"
 #include "platform.h"
+#include "simulator.h"
+#include "isr_cost.h"
+#include "trace.h"
 
 #include "grbl/hal.h"
 
 static bool probe_invert;
+static isr_path_t isr_path;
 static delay_t delay = { .ms = 1, .callback = NULL }; // NOTE: initial ms set to 1 for "resetting" systick timer on startup
 
 void SysTick_Handler (void);
@@ -50,7 +54,8 @@ static void driver_delay_ms (uint32_t ms, void (*callback)(void))
     if((delay.ms = ms) > 0) {
         systick_timer.enable = 1;
         if(!(delay.callback = callback))
-            while(delay.ms);
+            while(delay.ms)
+                sim.on_realtime();
     } else if(callback)
         callback();
 }
@@ -102,6 +107,9 @@ static void stepperGoIdle (bool clear_signals)
 // Sets up stepper driver interrupt timeout, limiting the slowest speed
 static void stepperCyclesPerTick (uint32_t cycles_per_tick)
 {
+    isr_path = IsrPath_Segment;
+    trace_segment(cycles_per_tick);
+
     timer[STEPPER_TIMER].load = cycles_per_tick;
     timer[STEPPER_TIMER].value = 0;
     timer[STEPPER_TIMER].enable = 1;
@@ -114,10 +122,15 @@ static void stepperPulseStart (stepper_t *stepper)
     if(stepper->new_block) {
         stepper->new_block = false;
         set_dir_outputs(stepper->dir_outbits);
+        trace_block(stepper->exec_block->steps, stepper->exec_block->step_event_count, stepper->exec_block->millimeters, stepper->exec_block->programmed_rate);
+        trace_dir(stepper->dir_outbits.mask);
     }
 
     if(stepper->step_outbits.value) {
+        if(isr_path == IsrPath_AMASS)
+            isr_path = IsrPath_Step;
         set_step_outputs(stepper->step_outbits);
+        trace_step(stepper->step_outbits.mask);
     }
 }
 
@@ -316,6 +329,12 @@ static uint_fast16_t valueSetAtomic (volatile uint_fast16_t *ptr, uint_fast16_t
     return prev;
 }
 
+// Microseconds of simulated time
+static uint32_t getMicros (void)
+{
+    return (uint32_t)(sim.masterclock / (F_CPU / 1000000));
+}
+
 void settings_changed (settings_t *settings)
 {
 
@@ -359,14 +378,19 @@ bool driver_setup (settings_t *settings)
     hal.spindle.set_state((spindle_state_t){0}, 0.0f);
     hal.coolant.set_state((coolant_state_t){0});
 
-    return settings->version == 18;
+    return settings->version == SETTINGS_VERSION;
 }
 
+static on_execute_realtime_ptr on_execute_realtime;
+
 // used to inject a sleep in grbl main loop, 
 // ensures hardware simulator gets some cycles in "parallel"
 void sim_process_realtime (uint_fast16_t state)
 {
-    platform_sleep(0);
+    on_execute_realtime(state);
+
+    sim.fg_passes++;
+    sim.on_realtime();
 }
 
 bool driver_init ()
@@ -386,8 +410,10 @@ bool driver_init ()
     hal.rx_buffer_size = RX_BUFFER_SIZE;
     hal.f_step_timer = F_CPU;
     hal.delay_ms = driver_delay_ms;
+    hal.get_micros = getMicros;
     hal.settings_changed = settings_changed;
 
+    on_execute_realtime = grbl.on_execute_realtime;
     grbl.on_execute_realtime = sim_process_realtime;
 
     hal.stepper.wake_up = stepperWakeUp;
@@ -468,7 +494,11 @@ bool driver_init ()
 // Main stepper driver
 void Stepper_IRQHandler (void)
 {
+    isr_path = IsrPath_AMASS;
+
     hal.stepper.interrupt_callback();
+
+    timer[STEPPER_TIMER].irq_ticks = isr_cost_charge(isr_path, timer[STEPPER_TIMER].enable ? timer[STEPPER_TIMER].load : 0);
 }
 
 void Control_IRQHandler (void)
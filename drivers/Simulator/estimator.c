@@ -0,0 +1,248 @@
+/*
+  estimator.c - job time estimator for the validator
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The job is parsed and planned by the real parser and planner, the estimator takes the place of the stepper
+  segment generator and executes the planned blocks by integrating their velocity profiles analytically, no steps
+  are generated.
+
+  A block is executed when the planner buffer is full, as when the job is streamed faster than it is executed, and
+  all blocks are executed when a cycle start is requested while the buffer is not full, ie. when the parser waits
+  for motion to complete (buffer sync) or when input ends. The exit speed of a block is the entry speed of the next
+  block when it is executed, the entry speed is the exit speed of the previous block.
+  Cycle start requests are consumed by the estimator so that the state machine and the stepper module stays idle.
+
+  Overrides are at 100%. Dwells and other delays are added as requested by hal.delay_ms, spindle spin up times
+  are not included. Tool changes are counted but take no time, M6 is accepted without a tool changer configured.
+
+  NOTE: the profile is trapezoidal also when ENABLE_JERK_ACCELERATION is enabled.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "estimator.h"
+
+#include "grbl/hal.h"
+
+typedef struct {
+    uint32_t tool;
+    double time;
+} tool_time_t;
+
+static struct {
+    double feed;            // Feed motion time in seconds
+    double rapid;           // Rapid motion time in seconds
+    double dwell;           // Dwell and other delay time in seconds
+    double feed_mm;
+    double rapid_mm;
+    uint32_t blocks;
+    uint32_t tool_changes;
+    bool tools_overflow;    // Set when the last entry holds the time of more than one tool
+    uint_fast8_t n_tools;
+    tool_time_t tools[ESTIMATOR_MAX_TOOLS];
+} est;
+
+static bool cycle_start = false;
+static float exit_speed_sqr = 0.0f; // Exit speed of the last executed block in (mm/min)^2
+static void (*delay_ms)(uint32_t ms, void (*callback)(void));
+static void (*set_bits_atomic)(volatile uint_fast16_t *value, uint_fast16_t bits);
+
+// Returns the time in seconds to travel distance mm from entry to exit speed, limited by the nominal speed.
+// Speeds are in mm/min, acceleration in mm/min^2.
+static double profile_time (double mm, double entry_sqr, double exit_sqr, double nominal, double acceleration)
+{
+    double entry = sqrt(entry_sqr), exit = sqrt(exit_sqr), nominal_sqr = nominal * nominal, peak, t;
+    double accelerate_mm = (nominal_sqr - entry_sqr) / (2.0 * acceleration), decelerate_mm = (nominal_sqr - exit_sqr) / (2.0 * acceleration);
+
+    if(entry > nominal || exit > nominal) // Out of bounds, eg. planned for a higher rate: assume constant acceleration.
+        t = 2.0 * mm / (entry + exit);
+    else if(accelerate_mm + decelerate_mm <= mm) // Trapezoid: accelerate, cruise and decelerate.
+        t = (nominal - entry) / acceleration + (mm - accelerate_mm - decelerate_mm) / nominal + (nominal - exit) / acceleration;
+    else if((peak = (2.0 * acceleration * mm + entry_sqr + exit_sqr) * 0.5) >= entry_sqr && peak >= exit_sqr) { // Triangle.
+        peak = sqrt(peak);
+        t = (peak - entry) / acceleration + (peak - exit) / acceleration;
+    } else // Entry and exit speeds cannot be joined within the block length: assume constant acceleration.
+        t = 2.0 * mm / (entry + exit);
+
+    return t * 60.0;
+}
+
+static void add_tool_time (double time)
+{
+    uint32_t tool = gc_state.tool->tool;
+    uint_fast8_t idx = est.n_tools;
+
+    while(idx && est.tools[idx - 1].tool != tool)
+        idx--;
+
+    if(idx == 0) {
+        if(est.n_tools < ESTIMATOR_MAX_TOOLS)
+            est.tools[est.n_tools++].tool = tool;
+        else
+            est.tools_overflow = true;
+        idx = est.n_tools;
+    }
+
+    est.tools[idx - 1].time += time;
+}
+
+// Executes the block at the tail of the planner buffer, returns false if none.
+static bool execute_block (void)
+{
+    double time;
+    plan_block_t *block;
+
+    if((block = plan_get_current_block()) == NULL)
+        return false;
+
+    float entry_sqr = exit_speed_sqr;
+
+    exit_speed_sqr = plan_get_exec_block_exit_speed_sqr();
+
+#ifdef ENABLE_PLANNED_DWELL
+    if(block->condition.dwell) {
+        time = (double)block->dwell * 60.0;
+        est.dwell += time;
+        est.blocks++;
+        add_tool_time(time);
+        plan_discard_current_block();
+
+        return true;
+    }
+#endif
+
+    time = profile_time(block->millimeters, entry_sqr, exit_speed_sqr, plan_compute_profile_nominal_speed(block), block->acceleration);
+
+    if(block->condition.rapid_motion) {
+        est.rapid += time;
+        est.rapid_mm += block->millimeters;
+    } else {
+        est.feed += time;
+        est.feed_mm += block->millimeters;
+    }
+
+    est.blocks++;
+    add_tool_time(time);
+
+    plan_discard_current_block();
+
+    return true;
+}
+
+// Replaces the validator handler that discards planned motion.
+static void estimator_execute_realtime (uint_fast16_t state)
+{
+    (void)state;
+
+    if(plan_check_full_buffer())
+        execute_block();
+    else if(cycle_start)
+        estimator_flush();
+
+    cycle_start = false;
+}
+
+// Consumes cycle start requests, keeps the state machine and the stepper module idle.
+static void estimator_set_bits_atomic (volatile uint_fast16_t *value, uint_fast16_t bits)
+{
+    if(value == &sys_rt_exec_state && (bits & EXEC_CYCLE_START)) {
+        cycle_start = true;
+        bits &= ~EXEC_CYCLE_START;
+    }
+
+    if(bits)
+        set_bits_atomic(value, bits);
+}
+
+// Tool changes are executed as by an instant automatic tool changer.
+static status_code_t estimator_tool_change (parser_state_t *gc_state)
+{
+    est.tool_changes++;
+
+    return Status_OK;
+}
+
+static void estimator_delay_ms (uint32_t ms, void (*callback)(void))
+{
+    est.dwell += (double)ms / 1000.0;
+    add_tool_time((double)ms / 1000.0);
+
+    delay_ms(ms, callback);
+}
+
+void estimator_init (void)
+{
+    memset(&est, 0, sizeof(est));
+    exit_speed_sqr = 0.0f;
+    cycle_start = false;
+
+    sys.override.feed_rate = DEFAULT_FEED_OVERRIDE;
+    sys.override.rapid_rate = DEFAULT_RAPID_OVERRIDE;
+    sys.override.spindle_rpm = DEFAULT_SPINDLE_RPM_OVERRIDE;
+
+    grbl.on_execute_realtime = estimator_execute_realtime;
+
+    set_bits_atomic = hal.set_bits_atomic;
+    hal.set_bits_atomic = estimator_set_bits_atomic;
+
+    delay_ms = hal.delay_ms;
+    hal.delay_ms = estimator_delay_ms;
+
+    if(hal.tool.change == NULL)
+        hal.tool.change = estimator_tool_change;
+}
+
+void estimator_flush (void)
+{
+    while(execute_block());
+}
+
+double estimator_get_time (void)
+{
+    return est.feed + est.rapid + est.dwell;
+}
+
+static void print_time (FILE *f, const char *label, double time)
+{
+    uint32_t s = (uint32_t)time;
+
+    fprintf(f, "%-12s%12.3f s  %u:%02u:%02u\n", label, time, s / 3600, (s / 60) % 60, s % 60);
+}
+
+void estimator_report (FILE *f)
+{
+    uint_fast8_t idx;
+    char label[20];
+
+    print_time(f, "Total:", estimator_get_time());
+    print_time(f, "  feed:", est.feed);
+    print_time(f, "  rapid:", est.rapid);
+    print_time(f, "  dwell:", est.dwell);
+
+    for(idx = 0; idx < est.n_tools; idx++) {
+        sprintf(label, est.tools_overflow && idx == est.n_tools - 1 ? "Tool %u+:" : "Tool %u:", est.tools[idx].tool);
+        print_time(f, label, est.tools[idx].time);
+    }
+
+    fprintf(f, "Blocks: %u, feed: %.3f mm, rapid: %.3f mm, tool changes: %u\n", est.blocks, est.feed_mm, est.rapid_mm, est.tool_changes);
+}
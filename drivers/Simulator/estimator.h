@@ -0,0 +1,48 @@
+/*
+  estimator.h - job time estimator for the validator
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _ESTIMATOR_H_
+
+#define _ESTIMATOR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef ESTIMATOR_MAX_TOOLS
+#define ESTIMATOR_MAX_TOOLS 32 // Number of tools times are tracked for, time for any further tools is added to the last entry
+#endif
+
+// Installs the estimator handlers, to be called after driver_init() and before the job is parsed.
+// NOTE: replaces grbl.on_execute_realtime.
+void estimator_init (void);
+
+// Executes the blocks left in the planner buffer, to be called when the job has been parsed.
+void estimator_flush (void);
+
+// Returns the estimated job time in seconds.
+double estimator_get_time (void);
+
+// Outputs the estimated job time with feed, rapid and dwell times and times per tool.
+void estimator_report (FILE *f);
+
+#endif
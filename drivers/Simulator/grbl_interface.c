@@ -151,6 +151,7 @@ static void print_steps (bool force)
 
     plan_block_t* current_block = plan_get_current_block();
     int ocr = 0;
+    int32_t position[N_AXIS];
 
     //Allow exit when idle. Prevents aborting before all streamed commands have run
     if (sim.exit == exit_REQ && sys.state < STATE_HOMING )
@@ -159,6 +160,8 @@ static void print_steps (bool force)
     if (next_print_time == 0.0)
         return;  //no printing
 
+    st_get_position(position);
+
     #ifdef VARIABLE_SPINDLE
     if(SPINDLE_TCCRA_REGISTER >= 127) ocr = SPINDLE_OCR_REGISTER;
     #endif
@@ -166,7 +169,7 @@ static void print_steps (bool force)
     if (current_block != printed_block) {
         //new block. 
         if (block_number) //print values from the end of prev block
-            fprintf(args.step_out_file, "%12.5f %d, %d, %d, %d\n", sim.sim_time, sys_position[X_AXIS], sys_position[Y_AXIS], sys_position[Z_AXIS],ocr);
+            fprintf(args.step_out_file, "%12.5f %d, %d, %d, %d\n", sim.sim_time, position[X_AXIS], position[Y_AXIS], position[Z_AXIS], ocr);
 
         printed_block = current_block;
         if (current_block == NULL)
@@ -176,7 +179,7 @@ static void print_steps (bool force)
     }
     //print at correct interval while executing block
     else if ((current_block && sim.sim_time>=next_print_time) || force ) {
-        fprintf(args.step_out_file, "%12.5f %d, %d, %d, %d\n", sim.sim_time, sys_position[X_AXIS], sys_position[Y_AXIS], sys_position[Z_AXIS], ocr);
+        fprintf(args.step_out_file, "%12.5f %d, %d, %d, %d\n", sim.sim_time, position[X_AXIS], position[Y_AXIS], position[Z_AXIS], ocr);
         fflush(args.step_out_file);
         //make sure the simulation time doesn't get ahead of next_print_time
         while (next_print_time <= sim.sim_time)
@@ -0,0 +1,456 @@
+/*
+  gtrace.c - reader for binary step timeline traces written by the simulator
+
+  Part of Grbl Simulator
+
+  2020 - Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+typedef struct {
+    FILE *file;
+    const char *name;
+    uint_fast8_t n_axis;
+    uint32_t f_cpu;
+    uint64_t tick;
+    uint8_t dir;
+    int32_t position[TRACE_MAX_AXIS];
+} reader_t;
+
+typedef struct {
+    uint8_t tag;
+    uint64_t tick;
+    uint32_t value;                     // Direction mask or cycles per tick
+    uint32_t step_event_count;
+    uint32_t steps[TRACE_MAX_AXIS];
+    float millimeters;
+    float programmed_rate;
+} record_t;
+
+static const char *axis_name = "XYZABCU";
+static const char *progname;
+
+static int usage (const char *badarg)
+{
+    if (badarg)
+        printf("Unrecognized option %s\n", badarg);
+
+    printf("Usage: \n"
+      "%s [options] <trace file> [<trace file>]\n"
+      "  Options:\n"
+      "    -t                 : dump records as text.\n"
+      "    -p <interval>      : output position, velocity, acceleration and jerk per axis as CSV, sampled every interval seconds.\n"
+      "    -d                 : compare step and direction timeline of two traces, exit code is 1 if they differ.\n"
+      "    -h                 : this help.\n"
+      "\n  Without options a summary is output.\n\n",
+      progname);
+
+    return -1;
+}
+
+static bool get_varint (reader_t *r, uint64_t *value)
+{
+    int c;
+    uint_fast8_t shift = 0;
+
+    *value = 0;
+
+    do {
+        if((c = fgetc(r->file)) == EOF || shift > 63)
+            return false;
+        *value |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while(c & 0x80);
+
+    return true;
+}
+
+static bool get_u32 (reader_t *r, uint32_t *value)
+{
+    uint8_t b[4];
+
+    if(fread(b, 1, 4, r->file) != 4)
+        return false;
+
+    *value = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+
+    return true;
+}
+
+static bool get_float (reader_t *r, float *value)
+{
+    uint32_t u;
+
+    if(!get_u32(r, &u))
+        return false;
+
+    memcpy(value, &u, sizeof(float));
+
+    return true;
+}
+
+static bool trace_reader_open (reader_t *r, const char *name)
+{
+    uint8_t header[TRACE_HEADER_SIZE];
+
+    memset(r, 0, sizeof(reader_t));
+    r->name = name;
+
+    if((r->file = fopen(name, "rb")) == NULL) {
+        printf("Error opening : %s\n", name);
+        return false;
+    }
+
+    if(fread(header, 1, TRACE_HEADER_SIZE, r->file) != TRACE_HEADER_SIZE || memcmp(header, TRACE_MAGIC, 4) ||
+        header[4] != TRACE_VERSION || header[5] > TRACE_MAX_AXIS) {
+        printf("%s: not a version %d trace file\n", name, TRACE_VERSION);
+        fclose(r->file);
+        return false;
+    }
+
+    r->n_axis = header[5];
+    r->f_cpu = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t)header[11] << 24);
+
+    return r->f_cpu != 0;
+}
+
+// Reads the next record, returns false at end of file.
+// Truncated traces, e.g. from an aborted simulation, end without a TRACE_END record.
+static bool trace_read (reader_t *r, record_t *rec)
+{
+    int c;
+    uint64_t v;
+    uint_fast8_t idx;
+
+    if((c = fgetc(r->file)) == EOF || !get_varint(r, &v))
+        return false;
+
+    rec->tag = (uint8_t)c;
+    rec->tick = (r->tick += v);
+    rec->value = 0;
+
+    if(rec->tag >= TRACE_DIR) switch(rec->tag) {
+
+        case TRACE_DIR:
+            if((c = fgetc(r->file)) == EOF)
+                return false;
+            rec->value = (uint8_t)c;
+            break;
+
+        case TRACE_SEGMENT:
+            if(!get_varint(r, &v))
+                return false;
+            rec->value = (uint32_t)v;
+            break;
+
+        case TRACE_BLOCK:
+            if(!get_varint(r, &v))
+                return false;
+            rec->step_event_count = (uint32_t)v;
+            for(idx = 0; idx < r->n_axis; idx++) {
+                if(!get_varint(r, &v))
+                    return false;
+                rec->steps[idx] = (uint32_t)v;
+            }
+            if(!get_float(r, &rec->millimeters) || !get_float(r, &rec->programmed_rate))
+                return false;
+            break;
+
+        case TRACE_END:
+            return false;
+
+        default:
+            printf("%s: unknown record 0x%02X at %.6f s\n", r->name, rec->tag, (double)r->tick / r->f_cpu);
+            return false;
+    }
+
+    return true;
+}
+
+// Updates the reader direction and position from a record.
+static void trace_apply (reader_t *r, record_t *rec)
+{
+    uint_fast8_t idx;
+
+    if(rec->tag < TRACE_DIR) {
+        for(idx = 0; idx < r->n_axis; idx++) {
+            if(rec->tag & (1 << idx))
+                r->position[idx] += (r->dir & (1 << idx)) ? -1 : 1;
+        }
+    } else if(rec->tag == TRACE_DIR)
+        r->dir = (uint8_t)rec->value;
+}
+
+static void print_position (reader_t *r)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < r->n_axis; idx++)
+        printf(" %c%d", axis_name[idx], r->position[idx]);
+}
+
+static int dump (reader_t *r)
+{
+    record_t rec;
+    uint_fast8_t idx;
+
+    while(trace_read(r, &rec)) {
+
+        trace_apply(r, &rec);
+        printf("%12.6f ", (double)rec.tick / r->f_cpu);
+
+        if(rec.tag < TRACE_DIR) {
+            printf("step ");
+            for(idx = 0; idx < r->n_axis; idx++) {
+                if(rec.tag & (1 << idx))
+                    putchar(axis_name[idx]);
+            }
+            print_position(r);
+        } else switch(rec.tag) {
+
+            case TRACE_DIR:
+                printf("dir  %02X", rec.value);
+                break;
+
+            case TRACE_SEGMENT:
+                printf("segment %u ticks, %.1f Hz", rec.value, (double)r->f_cpu / rec.value);
+                break;
+
+            case TRACE_BLOCK:
+                printf("block %u step events,", rec.step_event_count);
+                for(idx = 0; idx < r->n_axis; idx++)
+                    printf(" %c%u", axis_name[idx], rec.steps[idx]);
+                printf(", %.3f mm, F%.1f", rec.millimeters, rec.programmed_rate);
+                break;
+        }
+        putchar('\n');
+    }
+
+    return 0;
+}
+
+static int summary (reader_t *r, long size)
+{
+    record_t rec;
+    uint_fast8_t idx;
+    uint32_t blocks = 0, segments = 0, events = 0;
+    uint32_t steps[TRACE_MAX_AXIS] = {0};
+    uint64_t last_step[TRACE_MAX_AXIS] = {0}, min_interval[TRACE_MAX_AXIS] = {0};
+
+    while(trace_read(r, &rec)) {
+        trace_apply(r, &rec);
+        if(rec.tag < TRACE_DIR) {
+            events++;
+            for(idx = 0; idx < r->n_axis; idx++) {
+                if(rec.tag & (1 << idx)) {
+                    if(steps[idx]++ && (min_interval[idx] == 0 || rec.tick - last_step[idx] < min_interval[idx]))
+                        min_interval[idx] = rec.tick - last_step[idx];
+                    last_step[idx] = rec.tick;
+                }
+            }
+        } else if(rec.tag == TRACE_BLOCK)
+            blocks++;
+        else if(rec.tag == TRACE_SEGMENT)
+            segments++;
+    }
+
+    printf("%s: %.6f s, %u blocks, %u segments, %u step events, %.2f bytes per step event\n", r->name,
+            (double)r->tick / r->f_cpu, blocks, segments, events, events ? (double)size / events : 0.0);
+
+    for(idx = 0; idx < r->n_axis; idx++)
+        printf("  %c: %u steps, end position %d, max rate %.1f Hz\n", axis_name[idx], steps[idx], r->position[idx],
+                min_interval[idx] ? (double)r->f_cpu / min_interval[idx] : 0.0);
+
+    return 0;
+}
+
+typedef struct {
+    uint32_t n;
+    double interval;
+    double p[TRACE_MAX_AXIS], v[TRACE_MAX_AXIS], a[TRACE_MAX_AXIS];
+} samples_t;
+
+// Outputs a sample, derivatives are output as 0 until there is enough history.
+static void sample_output (reader_t *r, samples_t *s)
+{
+    uint_fast8_t idx;
+
+    printf("%.6f", s->n * s->interval);
+
+    for(idx = 0; idx < r->n_axis; idx++) {
+
+        double v = s->n > 0 ? (r->position[idx] - s->p[idx]) / s->interval : 0.0,
+               a = s->n > 1 ? (v - s->v[idx]) / s->interval : 0.0,
+               j = s->n > 2 ? (a - s->a[idx]) / s->interval : 0.0;
+
+        printf(",%d,%.1f,%.1f,%.1f", r->position[idx], v, a, j);
+
+        s->p[idx] = r->position[idx];
+        s->v[idx] = v;
+        s->a[idx] = a;
+    }
+
+    putchar('\n');
+
+    s->n++;
+}
+
+// Outputs position in steps, velocity (steps/s), acceleration (steps/s^2) and jerk (steps/s^3) by finite differences.
+static int profile (reader_t *r, double interval)
+{
+    record_t rec;
+    uint_fast8_t idx;
+    samples_t s = { .interval = interval };
+
+    if(interval * r->f_cpu < 1.0)
+        return usage("-p");
+
+    printf("time");
+    for(idx = 0; idx < r->n_axis; idx++)
+        printf(",%c,v%c,a%c,j%c", axis_name[idx], axis_name[idx], axis_name[idx], axis_name[idx]);
+    putchar('\n');
+
+    while(trace_read(r, &rec)) {
+        while((double)rec.tick > s.n * interval * r->f_cpu)
+            sample_output(r, &s);
+        trace_apply(r, &rec);
+    }
+
+    sample_output(r, &s);
+
+    return 0;
+}
+
+// Compares the step and direction records of two traces, block and segment records are ignored.
+static int diff (reader_t *a, reader_t *b)
+{
+    record_t ra, rb;
+    bool more_a, more_b;
+    uint32_t events = 0;
+
+    if(a->n_axis != b->n_axis || a->f_cpu != b->f_cpu) {
+        printf("traces differ: %u axes at %u Hz vs %u axes at %u Hz\n", a->n_axis, a->f_cpu, b->n_axis, b->f_cpu);
+        return 1;
+    }
+
+    do {
+        while((more_a = trace_read(a, &ra)) && ra.tag > TRACE_DIR);
+        while((more_b = trace_read(b, &rb)) && rb.tag > TRACE_DIR);
+
+        if(more_a != more_b || (more_a && (ra.tag != rb.tag || ra.tick != rb.tick || ra.value != rb.value))) {
+            printf("traces differ at event %u:\n", events);
+            if(more_a) {
+                printf("  %s: %.6f s (tick %llu), record 0x%02X, position", a->name, (double)ra.tick / a->f_cpu, (unsigned long long)ra.tick, ra.tag);
+                print_position(a);
+                putchar('\n');
+            } else
+                printf("  %s: ended\n", a->name);
+            if(more_b) {
+                printf("  %s: %.6f s (tick %llu), record 0x%02X, position", b->name, (double)rb.tick / b->f_cpu, (unsigned long long)rb.tick, rb.tag);
+                print_position(b);
+                putchar('\n');
+            } else
+                printf("  %s: ended\n", b->name);
+            return 1;
+        }
+
+        if(more_a) {
+            trace_apply(a, &ra);
+            trace_apply(b, &rb);
+            events++;
+        }
+    } while(more_a);
+
+    printf("traces are identical, %u step and direction events\n", events);
+
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int ret = -1;
+    long size = 0;
+    bool text = false, compare = false;
+    double interval = 0.0;
+    const char *names[2] = {0};
+    uint_fast8_t count = 0;
+    reader_t r[2];
+
+    progname = argv[0];
+
+    while (argc > 1) {
+        argv++; argc--;
+        if (argv[0][0] == '-') {
+
+            switch(argv[0][1]) {
+
+                case 't': //Text dump
+                    text = true;
+                    break;
+
+                case 'p': //Profile
+                    if(argc < 2)
+                        return usage(*argv);
+                    argv++; argc--;
+                    interval = atof(*argv);
+                    break;
+
+                case 'd': //Diff
+                    compare = true;
+                    break;
+
+                case 'h':
+                    return usage(NULL);
+
+                default:
+                    return usage(*argv);
+            }
+        } else if(count < 2)
+            names[count++] = *argv;
+        else
+            return usage(*argv);
+    }
+
+    if(count != (compare ? 2 : 1))
+        return usage(NULL);
+
+    if(!trace_reader_open(&r[0], names[0]) || (compare && !trace_reader_open(&r[1], names[1])))
+        return ret;
+
+    if(compare)
+        ret = diff(&r[0], &r[1]);
+    else if(text)
+        ret = dump(&r[0]);
+    else if(interval != 0.0)
+        ret = profile(&r[0], interval);
+    else {
+        fseek(r[0].file, 0, SEEK_END);
+        size = ftell(r[0].file);
+        fseek(r[0].file, TRACE_HEADER_SIZE, SEEK_SET);
+        ret = summary(&r[0], size);
+    }
+
+    fclose(r[0].file);
+    if(compare)
+        fclose(r[1].file);
+
+    return ret;
+}
@@ -0,0 +1,141 @@
+/*
+  isr_cost.c - stepper interrupt execution cost model for simulator MCU
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  Each stepper interrupt is charged the cost of the path taken, converted from target CPU cycles to master clock ticks.
+  If the cost is longer than the timer period the interrupt has overrun, the next interrupt is then delayed until the
+  current one has completed, stretching the step period as on the real hardware.
+
+  NOTE: the cycle counts are estimates for optimized builds with the standard step pulse output, calibrate them
+        against the ISR cycle counts reported by st_get_stats() on the real hardware where the driver provides
+        hal.get_cycle_count. Foreground code is not charged.
+*/
+
+#include <string.h>
+#include <strings.h>
+
+#include "isr_cost.h"
+#include "simulator.h"
+
+static const isr_cost_profile_t profiles[] = {
+    //  name        f_cpu       AMASS  step   segment
+    { "STM32F1",    72000000,  { 180,   360,  1100 } },
+    { "STM32F4",   168000000,  { 130,   250,   600 } },
+    { "SAMD21",     48000000,  { 260,   520,  2900 } }, // no FPU, segment load has soft float math
+    { "IMXRT1062", 600000000,  { 110,   200,   420 } },
+    { "ESP32",     240000000,  { 320,   560,  1400 } }  // interrupt entry through the RTOS dispatcher, handler in IRAM
+};
+
+static struct {
+    uint32_t count[IsrPath_N];
+    uint32_t overruns;
+    uint64_t first_overrun;         // Master clock tick of first overrun
+    uint32_t overrun_period;        // Timer period at first overrun
+    uint32_t period_min;            // Shortest timer period seen
+    uint64_t busy;                  // Sum of charged costs
+    uint64_t active;                // Sum of timer periods
+    float load_max;                 // Highest cost to period ratio
+} stats;
+
+static const isr_cost_profile_t *profile = NULL;
+
+bool isr_cost_select (const char *name)
+{
+    uint_fast8_t idx = sizeof(profiles) / sizeof(isr_cost_profile_t);
+
+    profile = NULL;
+
+    if(name) do {
+        if(!strcasecmp(name, profiles[--idx].name))
+            profile = &profiles[idx];
+    } while(idx && profile == NULL);
+
+    isr_cost_reset();
+
+    return profile != NULL;
+}
+
+void isr_cost_list (FILE *f)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < sizeof(profiles) / sizeof(isr_cost_profile_t); idx++)
+        fprintf(f, " %s", profiles[idx].name);
+}
+
+uint32_t isr_cost_charge (isr_path_t path, uint32_t period)
+{
+    uint32_t ticks;
+
+    if(profile == NULL)
+        return 0;
+
+    // Round up to the next master clock tick.
+    ticks = (uint32_t)(((uint64_t)profile->cycles[path] * F_CPU + profile->f_cpu - 1) / profile->f_cpu);
+
+    stats.count[path]++;
+    stats.busy += ticks;
+
+    if(period) {
+
+        float load = (float)ticks / (float)period;
+
+        stats.active += period;
+
+        if(load > stats.load_max)
+            stats.load_max = load;
+
+        if(stats.period_min == 0 || period < stats.period_min)
+            stats.period_min = period;
+
+        if(ticks >= period && stats.overruns++ == 0) {
+            stats.first_overrun = sim.masterclock;
+            stats.overrun_period = period;
+        }
+    }
+
+    return ticks;
+}
+
+void isr_cost_reset (void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void isr_cost_report (FILE *f)
+{
+    if(profile == NULL)
+        return;
+
+    fprintf(f, "%s ISR: AMASS %u, step %u, segment %u, max rate: %.1f kHz, load avg: %.1f%%, max: %.1f%%",
+            profile->name, stats.count[IsrPath_AMASS], stats.count[IsrPath_Step], stats.count[IsrPath_Segment],
+            stats.period_min ? (double)F_CPU / (double)stats.period_min / 1000.0 : 0.0,
+            stats.active ? (double)stats.busy * 100.0 / (double)stats.active : 0.0,
+            (double)stats.load_max * 100.0);
+
+    if(stats.overruns)
+        fprintf(f, ", overruns: %u, first at %.3f s (%.1f kHz)\n", stats.overruns,
+                (double)stats.first_overrun / (double)F_CPU,
+                (double)F_CPU / (double)stats.overrun_period / 1000.0);
+    else
+        fprintf(f, ", no overruns\n");
+}
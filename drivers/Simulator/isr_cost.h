@@ -0,0 +1,61 @@
+/*
+  isr_cost.h - stepper interrupt execution cost model for simulator MCU
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _ISR_COST_H_
+
+#define _ISR_COST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Paths through the stepper interrupt handler.
+typedef enum {
+    IsrPath_AMASS = 0,  // No step output, AMASS intermediate tick
+    IsrPath_Step,       // Step output from the current segment
+    IsrPath_Segment,    // New segment loaded
+    IsrPath_N
+} isr_path_t;
+
+// Execution cost of each path in target CPU cycles, includes interrupt entry and exit.
+typedef struct {
+    const char *name;
+    uint32_t f_cpu;
+    uint32_t cycles[IsrPath_N];
+} isr_cost_profile_t;
+
+// Selects the cost profile for the named target, NULL or unknown name disables the cost model.
+bool isr_cost_select (const char *name);
+
+// Lists the names of the available profiles.
+void isr_cost_list (FILE *f);
+
+// Charges the cost of an interrupt and checks it against the time until the next interrupt (in master clock ticks, 0 if none).
+// Returns the cost in master clock ticks, 0 if the cost model is disabled.
+uint32_t isr_cost_charge (isr_path_t path, uint32_t period);
+
+void isr_cost_reset (void);
+
+// Outputs the interrupt counts, load and overruns since last reset, nothing if the cost model is disabled.
+void isr_cost_report (FILE *f);
+
+#endif
@@ -35,7 +35,10 @@
 #include "simulator.h"
 #include "eeprom.h"
 #include "grbl_interface.h"
+#include "isr_cost.h"
+#include "trace.h"
 
+#include "grbl/hal.h"
 #include "grbl/grbllib.h"
 
 arg_vars_t args;
@@ -54,18 +57,24 @@ int usage(const char* badarg)
       "  Options:\n"
       "    -r <report time>   : minimum time step for printing stepper values. Default=0=no print.\n"
       "    -t <time factor>   : multiplier to realtime clock. Default=1. (needs work)\n"
+      "    -d                 : discrete event mode, run as fast as possible without realtime clock pacing.\n"
       "    -g <response file> : file to report responses from grbl.  default = stdout\n"
       "    -b <block file>    : file to report each block executed.  default = stdout\n"
       "    -s <step file>     : file to report each step executed.  default = stderr\n"
+      "    -T <trace file>    : file to write binary step timeline trace to, see gtrace.exe.\n"
       "    -e <EEPROM file>   : file containing grblHAL settings.  default = EEPROM.DAT\n"
       "    -p <port>          : port to open raw telnet communication.\n"
+      "    -m <MCU>           : charge stepper interrupt execution time for the MCU and report overruns.\n"
       "    -c<comment_char>   : character to print before each line from grbl.  default = '#'\n"
       "    -n                 : no comments before grbl response lines.\n"
       "    -h                 : this help.\n"
       "\n  <time_step> and <block_file> can be specifed with option flags or positional parameters\n"
-      "\n  ^-F to shutdown cleanly\n\n",
+      "\n  ^-F to shutdown cleanly\n\n  MCU is one of:",
       progname);
 
+    isr_cost_list(stdout);
+    printf("\n\n");
+
     return -1;
 }
 
@@ -174,6 +183,10 @@ int main(int argc, char *argv[])
                     tick_rate = atof(*argv);
                     break;
 
+                case 'd': //Discrete event mode
+                    sim.event_driven = true;
+                    break;
+
                 case 'b': //Block file
                     argv++; argc--;
                     args.block_out_file = fopen(*argv,"w");
@@ -199,6 +212,14 @@ int main(int argc, char *argv[])
                     }
                     break;
 
+                case 'T': //Binary step trace
+                    argv++; argc--;
+                    if (!trace_open(*argv, N_AXIS)) {
+                        printf("Error opening : %s\n",*argv);
+                        return(usage(0));
+                    }
+                    break;
+
                 case 'g': //Grbl output
                     argv++; argc--;
                     args.serial_out_file = fopen(*argv,"w");
@@ -219,6 +240,12 @@ int main(int argc, char *argv[])
                     args.port = atoi(*argv);
                     break;
 
+                case 'm':  // MCU stepper interrupt cost profile
+                    argv++; argc--;
+                    if(!isr_cost_select(*argv))
+                        return usage(*argv);
+                    break;
+
                 case 'h':
                     return usage(NULL);
 
@@ -324,6 +351,7 @@ int main(int argc, char *argv[])
 
     // Do not leave EEPROM file in an inconsistent state on ^C.
     atexit(eeprom_close);
+    atexit(trace_close);
     signal(SIGTERM, exithandler);
 
     // All the stream io and interrupt happen in this thread.
@@ -332,6 +360,10 @@ int main(int argc, char *argv[])
     // Graceful exit
     shutdown_simulator();
 
+    isr_cost_report(args.block_out_file);
+
+    trace_close();
+
     platform_kill_thread(th); //need force kill since original main has no return.
 
     // close the files we opened
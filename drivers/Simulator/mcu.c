@@ -112,7 +112,8 @@ void mcu_master_clock (void)
                             isr[Timer2_IRQ]();
                             break;                    }
                 } 
-                timer[i].value = timer[i].load;
+                timer[i].value = timer[i].irq_ticks > timer[i].load ? timer[i].irq_ticks : timer[i].load;
+                timer[i].irq_ticks = 0;
             }
         }
     }
@@ -133,6 +134,64 @@ void mcu_master_clock (void)
     }
 }
 
+// Returns the number of master clock ticks until the next timer interrupt or reload, capped at limit.
+// Returns 1 if a GPIO interrupt is pending or the next event cannot be determined (timer reloading or prescaled).
+uint32_t mcu_next_event (uint32_t limit)
+{
+    uint_fast8_t i;
+    uint32_t ticks = limit;
+
+    if(!booted)
+        return 1;
+
+    for(i = 0; i < MCU_N_GPIO; i++) {
+        if(gpio[i].irq_state.value & gpio[i].irq_mask.value)
+            return 1;
+    }
+
+    for(i = 0; i < MCU_N_TIMERS; i++) {
+        if(timer[i].enable) {
+            if(timer[i].prescaler || timer[i].value == 0)
+                return 1;
+            if(timer[i].value < ticks)
+                ticks = timer[i].value;
+        }
+    }
+
+    if(systick_timer.enable) {
+        if(systick_timer.value == 0)
+            return 1;
+        if(systick_timer.value < ticks)
+            ticks = systick_timer.value;
+    }
+
+    return ticks;
+}
+
+// Advances the timers by the given number of master clock ticks without triggering interrupts,
+// ticks should be less than returned by mcu_next_event().
+// NOTE: a timer may be reprogrammed by the foreground process in between, it then expires on the next tick.
+void mcu_advance (uint32_t ticks)
+{
+    uint_fast8_t i;
+
+    for(i = 0; i < MCU_N_TIMERS; i++) {
+        if(timer[i].enable && timer[i].value) {
+            if(timer[i].value > ticks)
+                timer[i].value -= ticks;
+            else
+                timer[i].value = 1;
+        }
+    }
+
+    if(systick_timer.enable && systick_timer.value) {
+        if(systick_timer.value > ticks)
+            systick_timer.value -= ticks;
+        else
+            systick_timer.value = 1;
+    }
+}
+
 void mcu_gpio_set (gpio_port_t *port, uint8_t pins, uint8_t mask)
 {
     port->state.value = (port->state.value & ~mask) | (pins & mask);
@@ -58,6 +58,7 @@ typedef struct
     uint32_t prescale;
     uint32_t prescaler;
     uint32_t compare;
+    uint32_t irq_ticks;     // Execution time of the interrupt handler, delays the next interrupt if longer than load. Set by the handler.
 } mcu_timer_t;
 
 typedef struct
@@ -110,6 +111,8 @@ void mcu_reset (void);
 void mcu_enable_interrupts (void);
 void mcu_disable_interrupts (void);
 void mcu_master_clock (void);
+uint32_t mcu_next_event (uint32_t limit);
+void mcu_advance (uint32_t ticks);
 void mcu_register_irq_handler (interrupt_handler handler, irq_num_t irq_num);
 void mcu_gpio_set (gpio_port_t *port, uint8_t pins, uint8_t mask);
 uint8_t mcu_gpio_get (gpio_port_t *port, uint8_t mask);
@@ -20,6 +20,7 @@ void platform_kill_thread(plat_thread_t* thread);
 
 uint32_t  platform_ns();  //monotonically increasing nanoseconds since program start.
 void platform_sleep(long microsec); //sleep for suggested time in microsec.
+void platform_yield(); //give up the remainder of the time slice to other threads.
 
 uint8_t platform_poll_stdin(); //non-blocking stdin read - returns 0 if no char present, 0xFF for EOF
 
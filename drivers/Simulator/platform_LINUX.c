@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sched.h>
 #include <termios.h>
 #include <time.h>
 #include <sys/time.h>
@@ -68,6 +69,12 @@ void platform_sleep(long  microsec)
     nanosleep(&ts, NULL);
 }
 
+//yield to other threads without sleeping
+void platform_yield()
+{
+    sched_yield();
+}
+
 #define SIM_ECHO_TERMINAL 0 //use this to make grbl_sim act like a serial terminal with local echo on.
 
 //set terminal to allow kbhit detection
@@ -67,6 +67,12 @@ void platform_sleep(long  microsec)
     Sleep(microsec / MICRO_PER_MILLI);
 }
 
+//yield to other threads without sleeping
+void platform_yield()
+{
+    SwitchToThread();
+}
+
   
 //create a thread
 plat_thread_t* platform_start_thread(plat_threadfunc_t threadfunc)
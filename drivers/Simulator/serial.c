@@ -30,7 +30,7 @@
 #include "grbl/hal.h"
 
 static stream_tx_buffer_t txbuffer = {0};
-static stream_rx_buffer_t rxbuffer = {0}, rxbackup;
+static stream_rx_buffer_t rxbuffer = {0};
 
 static void uart_interrupt_handler (void);
 
@@ -123,8 +123,8 @@ bool serialSuspendInput (bool suspend)
 {
     if(suspend)
         hal.stream.read = serialGetNull;
-    else if(rxbuffer.backup)
-        memcpy(&rxbuffer, &rxbackup, sizeof(stream_rx_buffer_t));
+    else
+        stream_rx_resume(&rxbuffer);
 
     return rxbuffer.tail != rxbuffer.head;
 }
@@ -163,7 +163,7 @@ static void uart_interrupt_handler (void)
 
         bptr = (rxbuffer.head + 1) & (RX_BUFFER_SIZE - 1);  // Get next head pointer
 
-        if(bptr == rxbuffer.tail) {                         // If buffer full
+        if(stream_rx_buffer_full(&rxbuffer, bptr)) {        // If buffer full
             rxbuffer.overflow = 1;                          // flag overflow and
             uart.rx_irq = 0;                                // clear interrupt flag
         } else {
@@ -172,9 +172,7 @@ static void uart_interrupt_handler (void)
             if(data == 0x06)
                 sim.exit = exit_REQ;
             else if(data == CMD_TOOL_ACK && !rxbuffer.backup) {
-                memcpy(&rxbackup, &rxbuffer, sizeof(stream_rx_buffer_t));
-                rxbuffer.backup = true;
-                rxbuffer.tail = rxbuffer.head;
+                stream_rx_suspend(&rxbuffer);
                 hal.stream.read = serialGetC; // restore normal input
 
             } else if(!hal.stream.enqueue_realtime_command((char)data)) {
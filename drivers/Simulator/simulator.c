@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -39,10 +40,20 @@ void sim_nop (void)
 {
 }
 
+// Default foreground hook, lets the hardware simulator thread run.
+static void sim_yield (void)
+{
+    if(sim.event_driven)
+        platform_yield();
+    else
+        platform_sleep(0);
+}
+
 sim_vars_t sim = {
     .on_init = sim_nop,
     .on_tick = sim_nop,
     .on_byte = sim_nop,
+    .on_realtime = sim_yield,
     .on_shutdown = sim_nop
 };
 
@@ -80,6 +91,62 @@ void simulate_hardware (bool do_serial)
   //  can ignore pinout int vect - hw start/hold not supported
 }
 
+// Maximum number of times the hardware simulator yields waiting for the foreground process in discrete event mode.
+#ifndef SIM_EVENT_YIELDS
+#define SIM_EVENT_YIELDS 100
+#endif
+
+static inline void sim_tick (uint64_t *next_byte_tick)
+{
+    // only read serial port as fast as the baud rate allows
+    bool read_serial = (sim.masterclock >= *next_byte_tick);
+
+    // do low level hardware
+    simulate_hardware(read_serial);
+
+    // do app-specific per-tick processing
+    sim.on_tick();
+
+    if (read_serial) {
+        *next_byte_tick += sim.baud_ticks;
+        // do app-specific per-byte processing
+        sim.on_byte();
+    }
+}
+
+// Advances simulated time straight to the tick of the next timer interrupt or serial byte and runs it.
+void sim_next_event (uint64_t *next_byte_tick)
+{
+    uint64_t ticks = *next_byte_tick > sim.masterclock ? *next_byte_tick - sim.masterclock : 1;
+
+    if((ticks = mcu_next_event(ticks > UINT32_MAX ? UINT32_MAX : (uint32_t)ticks)) > 1) {
+        mcu_advance((uint32_t)ticks - 1);
+        sim.masterclock += ticks - 1;
+    }
+
+    sim_tick(next_byte_tick);
+}
+
+// Runs the hardware simulator in discrete event mode until sim.exit is set.
+// Simulated time jumps straight to the tick of the next timer interrupt or serial byte, between events
+// the foreground process is allowed one pass of its main loop. It may be blocked waiting for a timer or
+// the serial port so it is only waited for a limited number of yields.
+static void sim_event_loop (void)
+{
+    uint64_t next_byte_tick = F_CPU;   //wait 1 sec before reading IO.
+    uint32_t passes = sim.fg_passes, yields;
+
+    while (sim.exit != exit_OK) { //don't quit until idle
+
+        yields = SIM_EVENT_YIELDS;
+        while(passes == sim.fg_passes && --yields)
+            platform_yield();
+        passes = sim.fg_passes;
+
+        sim_next_event(&next_byte_tick);
+    }
+}
+
 // Runs the hardware simulator at the desired rate until sim.exit is set
 void sim_loop (void)
 {
@@ -87,6 +154,11 @@ void sim_loop (void)
     uint32_t ns_prev = platform_ns();
     uint64_t next_byte_tick = F_CPU;   //wait 1 sec before reading IO.
 
+    if(sim.event_driven) {
+        sim_event_loop();
+        return;
+    }
+
     while (sim.exit != exit_OK  ) { //don't quit until idle
 
         if (sim.speedup) {
@@ -99,22 +171,8 @@ void sim_loop (void)
         else
             simulated_ticks++;  //as fast as possible
 
-        while (sim.masterclock < simulated_ticks) {
-            // only read serial port as fast as the baud rate allows
-            bool read_serial = (sim.masterclock >= next_byte_tick);
-
-            // do low level hardware
-            simulate_hardware(read_serial);
-
-            // do app-specific per-tick processing
-            sim.on_tick();
-
-            if (read_serial) {
-                next_byte_tick += sim.baud_ticks;
-                // do app-specific per-byte processing
-                sim.on_byte();
-            }
-        }
+        while (sim.masterclock < simulated_ticks)
+            sim_tick(&next_byte_tick);
 
         platform_sleep(25); // yield
     }
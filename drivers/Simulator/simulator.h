@@ -25,6 +25,7 @@
 #define simulator_h
 
 #include <stdio.h>
+#include <stdbool.h>
 
 #include "platform.h"
 
@@ -37,6 +38,8 @@ typedef struct sim_vars {
     uint8_t started;  // don't start timers until first char recieved.
     enum {exit_NO, exit_REQ, exit_OK} exit;
     float speedup;
+    bool event_driven;              // Discrete event mode, simulated time jumps to the next event without wall clock pacing.
+    volatile uint32_t fg_passes;    // Number of passes of the foreground process main loop, used for pacing in discrete event mode.
     int32_t baud_ticks;
     int socket_fd;
     uint8_t (*getchar)(void);
@@ -44,6 +47,7 @@ typedef struct sim_vars {
     sim_hook_fp on_init;
     sim_hook_fp on_tick;
     sim_hook_fp on_byte;
+    sim_hook_fp on_realtime;        // Called by the foreground process on each main loop pass and while waiting in delays, default yields.
     sim_hook_fp on_shutdown;
 } sim_vars_t;
 
@@ -74,6 +78,9 @@ void shutdown_simulator (void);
 // Simulates the hardware until sim.exit is set.
 void sim_loop (void);
 
+// Advances simulated time to the next event and runs it, for single threaded use from sim.on_realtime.
+void sim_next_event (uint64_t *next_byte_tick);
+
 // Call the stepper interrupt until one block is finished
 // (defined in serial.c)
 void simulate_serial (void);
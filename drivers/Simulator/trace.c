@@ -0,0 +1,149 @@
+/*
+  trace.c - binary step timeline trace for simulator MCU
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+#include "simulator.h"
+
+#define TRACE_BUFFER_SIZE 65536
+#define TRACE_RECORD_MAX 64 // Longest record: tag, 10 byte delta, 5 byte varints for event count and 7 axes, 2 floats
+
+static FILE *file = NULL;
+static uint_fast8_t axes;
+static uint64_t last_tick;
+static uint8_t last_dir;
+static uint8_t buffer[TRACE_BUFFER_SIZE];
+static uint32_t length;
+
+static void flush (void)
+{
+    if(length) {
+        fwrite(buffer, 1, length, file);
+        length = 0;
+    }
+}
+
+static inline void put_varint (uint64_t value)
+{
+    while(value > 0x7F) {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+}
+
+static inline void put_u32 (uint32_t value)
+{
+    buffer[length++] = (uint8_t)value;
+    buffer[length++] = (uint8_t)(value >> 8);
+    buffer[length++] = (uint8_t)(value >> 16);
+    buffer[length++] = (uint8_t)(value >> 24);
+}
+
+static inline void put_float (float value)
+{
+    uint32_t u;
+
+    memcpy(&u, &value, sizeof(u));
+    put_u32(u);
+}
+
+// Starts a record, flushes the buffer first if the record may not fit.
+static void put_tag (uint8_t tag)
+{
+    if(length > TRACE_BUFFER_SIZE - TRACE_RECORD_MAX)
+        flush();
+
+    buffer[length++] = tag;
+    put_varint(sim.masterclock - last_tick);
+    last_tick = sim.masterclock;
+}
+
+bool trace_open (const char *filename, uint_fast8_t n_axis)
+{
+    if(file || n_axis > TRACE_MAX_AXIS || (file = fopen(filename, "wb")) == NULL)
+        return false;
+
+    axes = n_axis;
+    last_tick = sim.masterclock;
+    last_dir = 0;
+    length = 0;
+
+    memcpy(buffer, TRACE_MAGIC, 4);
+    length = 4;
+    buffer[length++] = TRACE_VERSION;
+    buffer[length++] = (uint8_t)n_axis;
+    buffer[length++] = 0;
+    buffer[length++] = 0;
+    put_u32(F_CPU);
+
+    return true;
+}
+
+void trace_close (void)
+{
+    if(file) {
+        put_tag(TRACE_END);
+        flush();
+        fclose(file);
+        file = NULL;
+    }
+}
+
+void trace_step (uint8_t mask)
+{
+    if(file && (mask &= 0x7F))
+        put_tag(mask);
+}
+
+void trace_dir (uint8_t mask)
+{
+    if(file && mask != last_dir) {
+        put_tag(TRACE_DIR);
+        buffer[length++] = last_dir = mask;
+    }
+}
+
+void trace_segment (uint32_t cycles_per_tick)
+{
+    if(file) {
+        put_tag(TRACE_SEGMENT);
+        put_varint(cycles_per_tick);
+    }
+}
+
+void trace_block (const uint32_t *steps, uint32_t step_event_count, float millimeters, float programmed_rate)
+{
+    if(file) {
+
+        uint_fast8_t idx;
+
+        put_tag(TRACE_BLOCK);
+        put_varint(step_event_count);
+        for(idx = 0; idx < axes; idx++)
+            put_varint(steps[idx]);
+        put_float(millimeters);
+        put_float(programmed_rate);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+  trace.h - binary step timeline trace for simulator MCU
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  File format, all multibyte fields little endian:
+
+  Header (12 bytes): "GTRC", version (uint8), number of axes (uint8), reserved (uint16), master clock frequency (uint32).
+
+  Records: tag (uint8), ticks since previous record (varint), payload:
+    0x01 - 0x7F  step - tag is the mask of axes stepped, no payload
+    TRACE_DIR    direction mask (uint8), only written on change
+    TRACE_SEGMENT  timer ticks per step interrupt (varint)
+    TRACE_BLOCK  step event count (varint), steps for each axis (varint), millimeters (float), programmed rate (float)
+                 step counts are as loaded by the stepper interrupt, i.e. scaled up by AMASS
+    TRACE_END    no payload, written on clean close
+
+  Varints are unsigned LEB128, 7 bits per byte starting with the least significant, bit 7 set if more bytes follow.
+*/
+
+#ifndef _TRACE_H_
+
+#define _TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_MAGIC "GTRC"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 12
+#define TRACE_MAX_AXIS 7
+
+#define TRACE_DIR     0x80
+#define TRACE_SEGMENT 0x81
+#define TRACE_BLOCK   0x82
+#define TRACE_END     0x83
+
+// Opens the trace file, returns false on failure.
+bool trace_open (const char *filename, uint_fast8_t n_axis);
+void trace_close (void);
+
+// Record writers, time stamped with the current master clock. No-op if no trace file is open.
+void trace_step (uint8_t mask);
+void trace_dir (uint8_t mask);
+void trace_segment (uint32_t cycles_per_tick);
+void trace_block (const uint32_t *steps, uint32_t step_event_count, float millimeters, float programmed_rate);
+
+#endif
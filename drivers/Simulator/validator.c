@@ -28,23 +28,41 @@
 #include <errno.h>
 
 #include "platform.h"
+
+#if defined(PLAT_LINUX) || defined(PLAT_OSX)
+#define VALIDATOR_BATCH
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#endif
+
 #include "grbl/hal.h"
 #include "grbl/report.h"
 #include "grbl/protocol.h"
-#include "grbl/protocol.h"
+#include "grbl/override.h"
 #include "grbl/nvs_buffer.h"
 
+#include "estimator.h"
+
 typedef struct arg_vars {
     // Output file handles
     FILE *input_file;
     FILE *output_file;
     uint8_t echo;
     uint8_t silent;   
+    uint8_t estimate;   // Estimate job time
+    const char *settings_name;
+    const char *map;    // Memory mapped input file, batch mode
+    size_t map_size;
+    size_t map_pos;
 } arg_vars_t;
 
 arg_vars_t args;
 const char* progname;
 uint8_t exit_code = 0;
+uint32_t line_number = 0, error_line = 0;
 
 int usage (const char* badarg)
 {
@@ -57,9 +75,22 @@ int usage (const char* badarg)
      "    -o <output file> : use output file instead of stdout\n"
      "    -e        : echo input to output\n"
      "    -s        : silent, no output only return code \n"
+     "    -t        : estimate job time, outputs the estimate instead of grbl's responses\n"
+     "    -c <settings file> : apply the settings ($<n>=<value> lines, other lines are ignored) in the file before the input\n"
+#ifdef VALIDATOR_BATCH
+     "    -j <jobs> : batch mode, validate the input files with up to jobs files in parallel\n"
+#endif
      "\n  Parses gcode from stdin or input line, prints grbl's expected response"
-     "\n  Returns 0 on successs, or line number of error",
-     progname);
+     "\n  Returns 0 on successs, or line number of error"
+#ifdef VALIDATOR_BATCH
+     "\n\n  %s -j <jobs> [-o <output file>] input_file...\n"
+     "\n  Validates each file in a separate process and outputs one line per file in input order:"
+     "\n    <file name>\\t<line number>\\t<status code>[\\t<estimated time (s)>]"
+     "\n  line number and status code are 0 if the file is valid, status code is -1 if the file cannot be read."
+     "\n  Returns 0 if all files are valid, else 1.",
+     progname
+#endif
+     ,progname);
 
     return -1;
 }
@@ -69,18 +100,40 @@ status_code_t validator_report_status_message (status_code_t status_code)
     report_status_message(status_code);
 
     if (status_code && !exit_code) {
-        printf("EXITING %d\n",status_code);
+        if (!args.silent)
+            printf("EXITING %d\n",status_code);
         exit_code = status_code;
+        error_line = line_number;
         sys.abort = 1;
     }
 
     return status_code;
 }
 
+// Discard planned motion, keeps motion commands from waiting for a full planner buffer to be executed.
+static void validator_execute_realtime (uint_fast16_t state)
+{
+    (void)state;
+
+    plan_reset();
+}
+
 // Read fom input
 int16_t serial_read()
 {
-    int16_t data = fgetc(args.input_file);
+    int16_t data;
+
+    if (args.map) {
+        // Terminate a last line without line ending
+        if (args.map_pos < args.map_size)
+            data = (uint8_t)args.map[args.map_pos++];
+        else
+            data = args.map_pos++ == args.map_size && args.map_size && args.map[args.map_size - 1] != '\n' ? '\n' : -1;
+    } else
+        data = fgetc(args.input_file);
+
+    if (data == '\n')
+        line_number++;
 
     if (data == PLATFORM_EXTRA_CR)
         return(0);
@@ -88,9 +141,10 @@ int16_t serial_read()
     if (args.echo)
         fputc(data, args.output_file); 
 
-    plan_reset();
+    if (!args.estimate)
+        plan_reset();
 
-    if (sys.abort || feof(args.input_file) || data == 0x06 || data == -1) { 
+    if (sys.abort || (!args.map && feof(args.input_file)) || data == 0x06 || data == -1) { 
         sys.abort = 1;
         return SERIAL_NO_DATA;
     }
@@ -108,9 +162,220 @@ void serial_write (const char *data)
     }
 }
 
+// Executes the settings lines ($<n>=<value>) in the settings file, other lines are ignored.
+// Returns the status code of the first failed line or 0 if none.
+static int apply_settings (const char *name)
+{
+    char line[LINE_BUFFER_SIZE], *eol;
+    status_code_t status = Status_OK;
+    FILE *file;
+
+    if ((file = fopen(name, "r")) == NULL) {
+        perror("fopen");
+        return -1;
+    }
+
+    while (status == Status_OK && fgets(line, (LINE_BUFFER_SIZE / 2) - 1, file)) {
+        if ((eol = strpbrk(line, "\r\n")))
+            *eol = '\0';
+        if (*line == '$')
+            status = system_execute_line(line);
+    }
+
+    fclose(file);
+
+    return status;
+}
+
+// Validates the input, returns the status code of the first error or 0 if none.
+static int validate (void)
+{
+    // Clear all and set some core function pointers
+    memset(&grbl, 0, sizeof(grbl_t));
+    grbl.on_execute_realtime = validator_execute_realtime;
+    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
+
+    // Clear all and set some HAL function pointers
+    memset(&hal, 0, sizeof(grbl_hal_t));
+    hal.version = HAL_VERSION; // Update when signatures and/or contract is changed - driver_init() should fail
+    hal.driver_reset = dummy_handler;
+    hal.irq_enable = dummy_handler;
+    hal.irq_disable = dummy_handler;
+    hal.nvs.size = GRBL_NVS_SIZE;
+
+    protocol_init();
+    init_override_buffers();
+
+    nvs_buffer_alloc(); // Allocate memory block for NVS buffer, settings and coordinate data are kept in RAM
+
+    if(!driver_init())
+       return -1;
+
+    // TODO: read settings from EEPROM.dat if exists?
+
+    hal.stream.read = serial_read;
+    hal.stream.write = serial_write;
+    hal.stream.write_all = serial_write;
+
+    // NOTE: settings_init() reports the settings read failure, report functions and stream must be set before it is called.
+    report_init_fns();
+
+    nvs_buffer_init();
+    settings_init();
+
+    int status;
+
+    if (args.settings_name && (status = apply_settings(args.settings_name)) != 0)
+        return status;
+
+    gc_init(true); // Set g-code parser to default state, the defaults may be set by the settings file
+
+    grbl.report.status_message = validator_report_status_message;
+    grbl.report.feedback_message = report_feedback_message;
+
+    if (args.estimate) {
+        estimator_init();
+        if (!plan_reset()) // Allocate planner buffer, size is set by $398.
+            return -1;
+    }
+
+    protocol_main_loop(true);
+
+    if (args.estimate && !args.map) {
+        if (exit_code)
+            fprintf(args.output_file, "Error %d on line %u, no estimate\n", exit_code, error_line);
+        else {
+            estimator_flush();
+            estimator_report(args.output_file);
+        }
+    } else if (args.estimate && !exit_code)
+        estimator_flush();
+
+    return exit_code;
+}
+
+#ifdef VALIDATOR_BATCH
+
+typedef struct {
+    const char *name;
+    pid_t pid;
+    int fd;             // Read end of result pipe
+    bool done;
+    int32_t result[2];  // Line number and status code
+    double time;        // Estimated job time, -t option
+} batch_job_t;
+
+// Worker process: validates one memory mapped file and writes line number and status code to the pipe.
+static void batch_worker (const char *name, int fd)
+{
+    int32_t result[2] = {0, -1};
+    double time = 0.0;
+    struct stat st;
+    int in;
+
+    if ((in = open(name, O_RDONLY)) >= 0 && fstat(in, &st) == 0) {
+
+        args.map_size = st.st_size;
+        args.map = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0) : "";
+
+        if (args.map != MAP_FAILED) {
+            result[1] = validate();
+            result[0] = result[1] ? error_line : 0;
+            if (args.estimate && result[1] == 0)
+                time = estimator_get_time();
+        }
+    }
+
+    if (write(fd, result, sizeof(result)) != sizeof(result) || write(fd, &time, sizeof(time)) != sizeof(time))
+        _exit(2);
+
+    _exit(0);
+}
+
+// Collects the result of a finished worker, returns false if none are running.
+static bool batch_collect (batch_job_t *jobs, uint32_t count)
+{
+    uint32_t idx;
+    pid_t pid = wait(NULL);
+
+    if (pid < 0)
+        return false;
+
+    for (idx = 0; idx < count; idx++) {
+        if (jobs[idx].pid == pid) {
+            if (read(jobs[idx].fd, jobs[idx].result, sizeof(jobs[idx].result)) != sizeof(jobs[idx].result) ||
+                 read(jobs[idx].fd, &jobs[idx].time, sizeof(jobs[idx].time)) != sizeof(jobs[idx].time)) {
+                jobs[idx].result[0] = 0;
+                jobs[idx].result[1] = -1;
+            }
+            close(jobs[idx].fd);
+            jobs[idx].done = true;
+            break;
+        }
+    }
+
+    return true;
+}
+
+static int batch (char **names, uint32_t count, uint32_t workers)
+{
+    int fd[2];
+    uint32_t idx, started = 0, running = 0, printed = 0;
+    bool failed = false;
+    batch_job_t *jobs;
+
+    if ((jobs = calloc(count, sizeof(batch_job_t))) == NULL)
+        return -1;
+
+    fflush(args.output_file);
+
+    while (printed < count) {
+
+        if (started < count && running < workers) {
+            jobs[started].name = names[started];
+            if (pipe(fd) < 0 || (jobs[started].pid = fork()) < 0) {
+                perror("fork");
+                return -1;
+            }
+            if (jobs[started].pid == 0) {
+                close(fd[0]);
+                batch_worker(jobs[started].name, fd[1]);
+            }
+            close(fd[1]);
+            jobs[started++].fd = fd[0];
+            running++;
+            continue;
+        }
+
+        if (batch_collect(jobs, started))
+            running--;
+
+        // Output results in input order
+        while (printed < started && jobs[printed].done) {
+            idx = printed++;
+            failed |= jobs[idx].result[1] != 0;
+            if (args.estimate)
+                fprintf(args.output_file, "%s\t%d\t%d\t%.3f\n", jobs[idx].name, jobs[idx].result[0], jobs[idx].result[1], jobs[idx].time);
+            else
+                fprintf(args.output_file, "%s\t%d\t%d\n", jobs[idx].name, jobs[idx].result[0], jobs[idx].result[1]);
+        }
+    }
+
+    fflush(args.output_file);
+    free(jobs);
+
+    return failed ? 1 : 0;
+}
+
+#endif
+
 int main(int argc, char *argv[])
 {
     int positional_args=0;
+#ifdef VALIDATOR_BATCH
+    uint32_t workers = 0;
+    char **files = argv + 1;
+#endif
 
     //defaults
     args.input_file = stdin;
@@ -133,6 +398,17 @@ int main(int argc, char *argv[])
                     args.silent = 1;
                     break;
 
+                case 't': //estimate job time
+                    args.estimate = 1;
+                    break;
+
+                case 'c': //settings file
+                    argv++; argc--;
+                    if (argc < 1)
+                        return usage(0);
+                    args.settings_name = *argv;
+                    break;
+
                 case 'o': //output file
                     argv++; argc--;
                     args.output_file = fopen(*argv,"w");
@@ -143,12 +419,26 @@ int main(int argc, char *argv[])
                     }
                     break;
 
+#ifdef VALIDATOR_BATCH
+                case 'j': //batch mode
+                    argv++; argc--;
+                    if (argc < 1 || (workers = atoi(*argv)) == 0)
+                        return usage(0);
+                    break;
+#endif
+
                 case 'h':
                     return usage(NULL);
                 default:
                     return usage(*argv);
             }
         } else { //handle positional arguments
+#ifdef VALIDATOR_BATCH
+            if (workers) {
+                files[positional_args++] = *argv; // Compact file names to the start of the argument list
+                continue;
+            }
+#endif
             positional_args++;
             switch(positional_args) {
 
@@ -167,38 +457,20 @@ int main(int argc, char *argv[])
         }
     }
 
-    // Clear all and set some core function pointers
-    memset(&grbl, 0, sizeof(grbl_t));
-    grbl.on_execute_realtime = protocol_execute_noop;
-    grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
-
-    // Clear all and set some HAL function pointers
-    memset(&hal, 0, sizeof(grbl_hal_t));
-    hal.version = HAL_VERSION; // Update when signatures and/or contract is changed - driver_init() should fail
-    hal.driver_reset = dummy_handler;
-    hal.irq_enable = dummy_handler;
-    hal.irq_disable = dummy_handler;
-    hal.nvs.size = GRBL_NVS_SIZE;
-
-    if(!driver_init())
-       return -1;
-
-    // TODO: read settings from EEPROM.dat if exists?
-
-    nvs_buffer_init();
-    settings_init();
-
-    report_init_fns();
-    grbl.report.status_message = validator_report_status_message;
-    grbl.report.feedback_message = report_feedback_message;
-
-    hal.stream.read = serial_read;
-    hal.stream.write = serial_write;
-    hal.stream.write_all = serial_write;
+#ifdef VALIDATOR_BATCH
+    if (workers) {
+        args.silent = 1;
+        args.echo = 0;
+        return positional_args ? batch(files, positional_args, workers) : usage(0);
+    }
+#endif
 
-    protocol_main_loop(true);
+    if (args.estimate) {
+        args.silent = 1;    // Output the estimate only
+        args.echo = 0;
+    }
 
-    return exit_code;
+    return validate();
 }
 
 
@@ -31,6 +31,7 @@ typedef struct {
 static const float r1 = 10.0f, r2 = 20.0f;
 static tool_data_t *current_tool = 0, *next_tool = 0;
 static coord_data_t offset;
+static bool prepared = false;
 
 void atc_tool_select (uint8_t tool)
 {
@@ -57,31 +58,64 @@ static void atc_move (coord_data_t position, plan_line_data_t *plan_data)
     mc_line(position.values, plan_data);
 }
 
-void atc_tool_change (parser_state_t *gc_state)
+// Queues the rapid to above the slot of the current tool behind the motion still executing, called on M6
+// before the planner buffer is synchronized. The spindle is stopped by atc_tool_change() before the tool is put back.
+status_code_t atc_tool_prepare (parser_state_t *gc_state)
 {
-    if(next_tool != current_tool) {
+    if((prepared = next_tool != current_tool)) {
 
         float angle;
         plan_line_data_t plan_data;
         coord_data_t target;
 
-        memset(&target, 0, sizeof(target)); // Zero plan_data struct
+        memset(&target, 0, sizeof(target)); // Zero target struct
         memset(&plan_data, 0, sizeof(plan_line_data_t)); // Zero plan_data struct
         settings_read_coord_data(8, &offset.values); // G59.3 - fail if not set?
 
-        hal.spindle_set_state((spindle_state_t){0}, 0.0f);
-        hal.coolant_set_state((coolant_state_t){0});
-        mc_dwell(1.0);
-
         plan_data.condition.rapid_motion = On;
+        plan_data.spindle.rpm = gc_state->spindle.rpm;
+        plan_data.condition.spindle = gc_state->modal.spindle;
+        plan_data.condition.coolant = gc_state->modal.coolant;
 
-        // put current tool back
         angle = 0.25f * M_PI * (float)(current_tool->tool - 1);
         target.z = 15.0f;
         atc_move(target, &plan_data);
         target.x = r1 * sinf(angle);
         target.y = r1 * cosf(angle);
         atc_move(target, &plan_data);
+    }
+
+    return Status_OK;
+}
+
+status_code_t atc_tool_change (parser_state_t *gc_state)
+{
+    if(next_tool != current_tool) {
+
+        float angle;
+        plan_line_data_t plan_data;
+        coord_data_t target;
+
+        memset(&target, 0, sizeof(target)); // Zero target struct
+        memset(&plan_data, 0, sizeof(plan_line_data_t)); // Zero plan_data struct
+        if(!prepared)
+            settings_read_coord_data(8, &offset.values); // G59.3 - fail if not set?
+
+        hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+        hal.coolant.set_state((coolant_state_t){0});
+        mc_dwell(1.0);
+
+        plan_data.condition.rapid_motion = On;
+
+        // put current tool back, the rapid to above its slot is already executed if prepared
+        angle = 0.25f * M_PI * (float)(current_tool->tool - 1);
+        target.z = 15.0f;
+        if(!prepared)
+            atc_move(target, &plan_data);
+        target.x = r1 * sinf(angle);
+        target.y = r1 * cosf(angle);
+        if(!prepared)
+            atc_move(target, &plan_data);
         target.z = 10.0f;
         atc_move(target, &plan_data);
         target.x = r2 * sinf(angle);
@@ -116,6 +150,9 @@ void atc_tool_change (parser_state_t *gc_state)
         coolant_sync(gc_state->modal.coolant);
 
         mc_dwell(1.0);
-
     }
+
+    prepared = false;
+
+    return Status_OK;
 }
@@ -28,6 +28,7 @@
 
 void atc_tool_select (uint8_t tool);
 void atc_tool_selected (tool_data_t *tool);
-void atc_tool_change (parser_state_t *gc_block);
+status_code_t atc_tool_prepare (parser_state_t *gc_state);
+status_code_t atc_tool_change (parser_state_t *gc_state);
 
 #endif
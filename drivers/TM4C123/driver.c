@@ -78,6 +78,10 @@ static void ppi_timeout_isr (void);
 
 #endif
 
+#if RASTER_ENABLE
+#include "laser/raster.h"
+#endif
+
 #ifdef SPINDLE_SYNC_ENABLE
 
 typedef struct {                     // Set when last encoder pulse count did not match at last index
@@ -853,6 +857,10 @@ static bool driver_setup (settings_t *settings)
 
 #endif
 
+#if RASTER_ENABLE
+    raster_init();
+#endif
+
    /****************************
     *  Software debounce init  *
     ****************************/
@@ -1097,8 +1105,10 @@ bool driver_init (void)
     hal.set_value_atomic = valueSetAtomic;
 
 #ifdef _ATC_H_
-    hal.tool_select = atc_tool_selected;
-    hal.tool_change = atc_tool_change;
+    hal.driver_cap.atc = On;
+    hal.tool.select = atc_tool_selected;
+    hal.tool.prepare = atc_tool_prepare;
+    hal.tool.change = atc_tool_change;
 #endif
 
 #if PPI_ENABLE
@@ -1123,6 +1133,7 @@ bool driver_init (void)
     hal.driver_cap.mist_control = On;
     hal.driver_cap.software_debounce = On;
     hal.driver_cap.step_pulse_delay = On;
+    hal.driver_cap.step_pulse_delay_dir_only = On;
     hal.driver_cap.amass_level = 3;
     hal.driver_cap.control_pull_up = On;
     hal.driver_cap.limits_pull_up = On;
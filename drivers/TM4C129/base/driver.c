@@ -102,6 +102,7 @@ static void enetStreamWriteS (const char *data)
     const io_stream_t ethernet_stream = {
         .type = StreamType_Telnet,
         .read = TCPStreamGetC,
+        .read_block = TCPStreamReadBlock,
         .write = TCPStreamWriteS,
         .write_all = enetStreamWriteS,
         .get_rx_buffer_available = TCPStreamRxFree,
@@ -1135,6 +1136,7 @@ static void modeSelect (bool mpg_mode)
     if(mpg_mode) {
         normal_stream = hal.stream.type;
         hal.stream.read = serial2GetC;
+        hal.stream.read_block = NULL;
         hal.stream.get_rx_buffer_available = serial2RxFree;
         hal.stream.cancel_read_buffer = serial2RxCancel;
         hal.stream.reset_read_buffer = serial2RxFlush;
@@ -51,6 +51,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "base/driver.h"
 #include "networking/TCPStream.h"
 #include "networking/WsStream.h"
+#include "networking/NetStats.h"
 
 #define SYSTICK_INT_PRIORITY    0x80
 #define ETHERNET_INT_PRIORITY   0xC0
@@ -215,6 +216,10 @@ void vApplicationStackOverflowHook(xTaskHandle *pxTask, signed char *pcTaskName)
 
 bool enet_init (network_settings_t *network)
 {
+#if TELNET_ENABLE || WEBSOCKET_ENABLE
+    NetStatsInit();
+#endif
+
     return lwIPTaskInit(network);
 }
 
@@ -443,4 +443,35 @@ extern void UARTprintf(const char *pcString, ...);
 //#define SNMP_MIB_DEBUG                  LWIP_DBG_OFF
 //#define DNS_DEBUG                       LWIP_DBG_OFF
 
+//*****************************************************************************
+//
+// ---------- Streaming profile ----------
+//
+// Uncomment to tune the stack for sustained G-code streaming over Telnet or
+// WebSocket: the stream poll rate is raised, more EMAC descriptors and pool
+// buffers are allocated so that a burst of segments from the sender is not
+// refused while the foreground is busy, and lwIP statistics are enabled for
+// the $NETSTATS command. Costs about 12 KB of additional RAM.
+//
+//*****************************************************************************
+//#define NETWORK_STREAMING_PROFILE
+
+#ifdef NETWORK_STREAMING_PROFILE
+#undef HOST_TMR_INTERVAL
+#define HOST_TMR_INTERVAL               5           // Paces TCPStreamPoll() and WsStreamPoll()
+#undef NUM_RX_DESCRIPTORS
+#define NUM_RX_DESCRIPTORS              16
+#undef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE                  64
+#undef TCP_WND
+#define TCP_WND                         (4 * TCP_MSS) // Covers the stream RX buffer with segments in flight
+#define TCP_SND_QUEUELEN                32
+#define MEMP_NUM_TCP_SEG                32
+#undef LWIP_STATS
+#define LWIP_STATS                      1
+#define LINK_STATS                      1
+#define TCP_STATS                       1
+#define MEMP_STATS                      1
+#endif
+
 #endif /* __LWIPOPTS_H__ */
@@ -0,0 +1,190 @@
+/*
+  alarm_snapshot.c - post-mortem snapshot of the motion state taken when an alarm is raised
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal.h"
+#include "planner.h"
+#include "stepper.h"
+#include "nvs_buffer.h"
+#include "alarm_snapshot.h"
+
+#ifdef ENABLE_ALARM_SNAPSHOT
+
+// The snapshot is kept in RAM across soft resets, a copy is kept in NVS when storage is available.
+static THREAD_LOCAL alarm_snapshot_t snapshot = {0};
+static THREAD_LOCAL uint32_t nvs_address = 0;
+static THREAD_LOCAL bool loaded = false;
+
+// Loads the snapshot from NVS on first use, the NVS buffer is not available when alarm_snapshot_init() is called.
+static void snapshot_load (void)
+{
+    if(!loaded) {
+        loaded = true;
+        if(nvs_address && hal.nvs.type != NVS_None &&
+            (hal.nvs.memcpy_from_nvs((uint8_t *)&snapshot, nvs_address, sizeof(alarm_snapshot_t), true) != NVS_TransferResult_OK ||
+              snapshot.version != ALARM_SNAPSHOT_VERSION || snapshot.n_blocks > ALARM_SNAPSHOT_BLOCKS))
+            memset(&snapshot, 0, sizeof(alarm_snapshot_t));
+    }
+}
+
+static void snapshot_save (void)
+{
+    if(nvs_address && hal.nvs.type != NVS_None)
+        hal.nvs.memcpy_to_nvs(nvs_address, (uint8_t *)&snapshot, sizeof(alarm_snapshot_t), true);
+}
+
+void alarm_snapshot_init (void)
+{
+    nvs_address = nvs_alloc(sizeof(alarm_snapshot_t));
+}
+
+void alarm_snapshot_capture (alarm_code_t alarm)
+{
+    uint_fast8_t idx;
+    plan_block_t *block;
+    st_stats_t stats;
+
+    snapshot_load();
+
+    st_get_stats(&stats, false);
+
+    snapshot.version = ALARM_SNAPSHOT_VERSION;
+    snapshot.count++;
+    snapshot.ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    snapshot.state = (uint16_t)sys.state;
+    snapshot.alarm = (uint8_t)alarm;
+    snapshot.blocks = (uint8_t)min(plan_get_block_buffer_size() - 1 - plan_get_block_buffer_available(), 255);
+    snapshot.segments = (uint8_t)st_get_segment_buffer_level();
+    snapshot.segment_buffer_min = (uint8_t)stats.segment_buffer_min;
+    snapshot.planner_buffer_min = (uint8_t)min(stats.planner_buffer_min, 255);
+    snapshot.underruns = stats.underruns;
+    snapshot.isr_cycles_max = stats.isr_cycles_max;
+    snapshot.isr_cycles_avg = stats.isr_cycles_avg;
+    snapshot.feed_rate = st_get_realtime_rate();
+    snapshot.gc_line_number = gc_state.line_number;
+    snapshot.line_number = (block = plan_get_current_block()) ? block->line_number : 0;
+    st_get_position(snapshot.position);
+
+    for(idx = 0; idx < ALARM_SNAPSHOT_BLOCKS && (block = plan_get_block(idx)); idx++) {
+        snapshot.block[idx].millimeters = block->millimeters;
+        snapshot.block[idx].entry_speed_sqr = block->entry_speed_sqr;
+        snapshot.block[idx].line_number = block->line_number;
+    }
+
+    snapshot.n_blocks = (uint8_t)idx;
+
+    for(; idx < ALARM_SNAPSHOT_BLOCKS; idx++)
+        memset(&snapshot.block[idx], 0, sizeof(alarm_snapshot_block_t));
+
+    snapshot_save();
+}
+
+void alarm_snapshot_clear (void)
+{
+    loaded = true;
+    memset(&snapshot, 0, sizeof(alarm_snapshot_t));
+    snapshot_save();
+}
+
+static void write_line_number (int32_t line_number)
+{
+    if(line_number < 0)
+        hal.stream.write("-");
+    hal.stream.write(uitoa((uint32_t)abs(line_number)));
+}
+
+// Prints the snapshot:
+// [SNAP:<count>,<alarm>,<state>,<ms>] - followed by the lines below if count > 0
+// [SNAPPOS:<machine position>]
+// [SNAPLN:<executing line number>,<last parsed line number>,<feed rate>]
+// [SNAPST:<planner blocks>,<segments>,<min planner blocks>,<min segments>,<underruns>,<max isr cycles>,<avg isr cycles>]
+// [SNAPBLK:<line number>,<entry speed>,<mm remaining>] - for each saved planner block, executing block first
+// Speeds are in mm/min, the position in mm.
+void alarm_snapshot_report (void)
+{
+    uint_fast8_t idx;
+    float position[N_AXIS];
+
+    snapshot_load();
+
+    hal.stream.write("[SNAP:");
+    hal.stream.write(uitoa(snapshot.count));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.alarm));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.state));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.ms));
+    hal.stream.write("]" ASCII_EOL);
+
+    if(snapshot.count == 0)
+        return;
+
+    system_convert_array_steps_to_mpos(position, snapshot.position);
+
+    hal.stream.write("[SNAPPOS:");
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(idx)
+            hal.stream.write(",");
+        hal.stream.write(ftoa(position[idx], N_DECIMAL_COORDVALUE_MM));
+    }
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[SNAPLN:");
+    write_line_number(snapshot.line_number);
+    hal.stream.write(",");
+    write_line_number(snapshot.gc_line_number);
+    hal.stream.write(",");
+    hal.stream.write(ftoa(snapshot.feed_rate, N_DECIMAL_RATEVALUE_MM));
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[SNAPST:");
+    hal.stream.write(uitoa(snapshot.blocks));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.segments));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.planner_buffer_min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.segment_buffer_min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.underruns));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.isr_cycles_max));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(snapshot.isr_cycles_avg));
+    hal.stream.write("]" ASCII_EOL);
+
+    for(idx = 0; idx < snapshot.n_blocks; idx++) {
+        hal.stream.write("[SNAPBLK:");
+        write_line_number(snapshot.block[idx].line_number);
+        hal.stream.write(",");
+        hal.stream.write(ftoa(sqrtf(snapshot.block[idx].entry_speed_sqr), N_DECIMAL_RATEVALUE_MM));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(snapshot.block[idx].millimeters, N_DECIMAL_COORDVALUE_MM));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+#endif
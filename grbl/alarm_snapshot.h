@@ -0,0 +1,81 @@
+/*
+  alarm_snapshot.h - post-mortem snapshot of the motion state taken when an alarm is raised
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _ALARM_SNAPSHOT_H_
+#define _ALARM_SNAPSHOT_H_
+
+#include "system.h"
+
+#ifdef ENABLE_ALARM_SNAPSHOT
+
+// Number of planner blocks, starting with the executing block, saved in the snapshot. Each block takes 12 bytes.
+#ifndef ALARM_SNAPSHOT_BLOCKS
+#define ALARM_SNAPSHOT_BLOCKS 4
+#endif
+
+#define ALARM_SNAPSHOT_VERSION 1
+
+typedef struct {
+    float millimeters;          // Remaining distance
+    float entry_speed_sqr;      // (mm/min)^2
+    int32_t line_number;
+} alarm_snapshot_block_t;
+
+typedef struct {
+    uint8_t version;                // ALARM_SNAPSHOT_VERSION, the snapshot is discarded on mismatch
+    uint8_t alarm;                  // alarm_code_t
+    uint16_t state;                 // State when the alarm was raised
+    uint32_t count;                 // Number of alarms captured since the snapshot was cleared
+    uint32_t ms;                    // Timestamp from hal.get_elapsed_ticks(), 0 if not available
+    uint8_t blocks;                 // Planner buffer fill level
+    uint8_t segments;               // Segment buffer fill level
+    uint8_t segment_buffer_min;     // Lowest segment buffer fill level seen, from the stepper instrumentation data
+    uint8_t planner_buffer_min;     // Lowest planner buffer fill level seen, from the stepper instrumentation data
+    uint8_t n_blocks;               // Number of valid entries in block[]
+    uint8_t reserved[3];
+    int32_t position[N_AXIS];       // sys_position, including the steps executed by the current segment
+    int32_t line_number;            // Line number of the executing block
+    int32_t gc_line_number;         // Line number of the last block parsed
+    float feed_rate;                // Real time feed rate, mm/min
+    uint32_t underruns;             // Stepper instrumentation data
+    uint32_t isr_cycles_max;
+    uint32_t isr_cycles_avg;
+    alarm_snapshot_block_t block[ALARM_SNAPSHOT_BLOCKS];
+} alarm_snapshot_t;
+
+// Allocates non-volatile storage for the snapshot, to be called after driver_init() and before the NVS buffer is loaded.
+// If none is available the snapshot is kept in RAM only and survives soft resets but not power cycles.
+void alarm_snapshot_init (void);
+
+// Captures the snapshot, called from the alarm handler before the alarm state is entered.
+// NOTE: The snapshot is written to the NVS RAM buffer, it is committed to non-volatile storage when the buffer is synced.
+void alarm_snapshot_capture (alarm_code_t alarm);
+
+// Clears the snapshot, $ASR command.
+void alarm_snapshot_clear (void);
+
+// Prints the snapshot, $AS command.
+void alarm_snapshot_report (void);
+
+#endif
+
+#endif
@@ -47,6 +47,9 @@
 
 //#define KINEMATICS_API // Remove comment to add HAL entry points for custom kinematics
 
+// Kinematics enabled below are added to the kinematics registry, the one used is selected by $397.
+// Cartesian kinematics is always available and then bypasses the kinematics entry points.
+
 // Enable Maslow router kinematics.
 // Experimental - testing required and homing needs to be worked out.
 //#define MASLOW_ROUTER // Default disabled. Uncomment to enable.
@@ -64,12 +67,24 @@
 // have the same steps per mm internally.
 //#define COREXY // Default disabled. Uncomment to enable.
 
+// Enable five axis tool center point (RTCP) kinematics for table-table (trunnion) machines, requires N_AXIS 5 or 6.
+// The program is in tool tip coordinates in the workpiece frame and the rotary axis angles, moves with rotary motion
+// are segmented within the arc tolerance ($12). The tilting table rotates about X, the rotary table mounted on it
+// about Z. Default axes are A (tilt) and C (B with N_AXIS 5), change in rtcp.c. The pivot point is set by $385 - $387.
+//#define RTCP_TRUNNION // Default disabled. Uncomment to enable.
+
 // Add a short delay for each block processed in Check Mode to
 // avoid overwhelming the sender with fast reply messages.
 // This is likely to happen when streaming is done via a protocol where
 // the speed is not limited to 115200 baud. An example is native USB streaming.
 //#define CHECK_MODE_DELAY 0 // ms
 
+// Enables fast check mode, $CF. As for $C the program is parsed and validated without motion, but arcs are not
+// segmented, only their envelope is checked against the soft limits. "ok" responses are sent in batches of up to
+// CHECK_MODE_OK_BATCH lines, when no more input is available or before any other response. CHECK_MODE_DELAY is not
+// applied. Intended for validating large programs at full stream speed.
+//#define ENABLE_FAST_CHECK_MODE // Default disabled. Uncomment to enable.
+
 // This option enables the safety door switch. A safety door, when triggered,
 // immediately forces a feed hold and then safely de-energizes the machine. Resuming is blocked until
 // the safety door is re-engaged. When it is, Grbl will re-energize the machine and then resume on the
@@ -101,6 +116,19 @@
 // #define DEBUG // Uncomment to enable. Default disabled.
 // #define DEBUGOUT // Uncomment to add HAL entry point for debug output.
 
+// Places the core state (parser, planner, stepper, protocol, settings etc.) in thread local storage so that several
+// independent instances can be run in one process by host side tools such as validators and time estimators.
+// Requires a C11 compiler. Each instance, including its simulated interrupt handlers, must run in a single thread.
+// Kinematics registrations are process wide. Not for use in MCU builds.
+//#define ENABLE_THREAD_LOCAL_CONTEXT // Default disabled. Uncomment to enable.
+
+// Places code decorated with ISR_CODE, the stepper interrupt and other interrupt handlers, in RAM on STM32F4xx processors
+// to avoid flash wait states when the ART accelerator cache misses. This gives a more deterministic interrupt latency
+// at high step rates at the cost of RAM. The linker script must place the .RamFunc section in RAM.
+// Not needed for the ESP32 and IMXRT1062 (Teensy 4) where ISR_CODE is placed in IRAM and ITCM respectively.
+// Can be added as predefined symbol for the project instead of uncommenting here.
+//#define ISR_CODE_IN_RAM // Default disabled. Uncomment to enable.
+
 // If spindle RPM is set by high-level commands to a spindle controller (eg. via Modbus) or the driver supports closed loop
 // spindle RPM control either uncomment the #define SPINDLE_RPM_CONTROLLED below or add SPINDLE_RPM_CONTROLLED as predefined symbol
 // on the compiler command line. This will send spindle speed as a RPM value instead of a PWM value to the driver.
@@ -146,6 +174,59 @@
 // to help minimize transmission waiting within the serial write protocol.
 //#define REPORT_ECHO_LINE_RECEIVED // Default disabled. Uncomment to enable.
 
+// Adds stepper instrumentation data to the real-time status report as |St:<segments>,<blocks>,<underruns>,<isr cycles>
+// where segments and blocks are the lowest segment and planner buffer levels seen during motion and isr cycles is the
+// maximum stepper interrupt execution time. The full data set is reported by the $SS command, $SSR resets it.
+// NOTE: Only use this for debugging purposes, the status report gets longer.
+//#define REPORT_STEPPER_STATS // Default disabled. Uncomment to enable.
+
+// Records the planner blocks and step segments prepped for execution in a RAM ring buffer of MOTION_TRACE_SIZE
+// (default 128) entries, 24 bytes each. Blocks are recorded with entry and max entry speed, remaining distance and line
+// number, segments with cycles per tick, step count, AMASS level and segment buffer fill. $TRACE reports the entries,
+// oldest first, $TRACER clears the trace. Recording stops when an alarm is raised so that the motion leading up to
+// it can be reported, $TRACER restarts it. Use together with REPORT_STEPPER_STATS to diagnose stalls.
+//#define ENABLE_MOTION_TRACE // Default disabled. Uncomment to enable.
+
+// Synchronizes motion of controllers sharing a machine, e.g. when one board does not have enough axes. The master plans
+// all the axes and mirrors each step segment over a link provided by the driver to the slaves, which execute the segments
+// for their axes instead of their own. The master outputs a sync pulse at the start of each segment, slaves run
+// slightly fast and wait for the pulse before starting the next segment so that the controllers do not drift apart.
+// A slave executes master axes from MOTION_SYNC_AXIS_OFFSET (default 0) onwards, its $389 segment buffer size must be at
+// least that of the master. The driver selects the role by calling motion_sync_init(), see motion_sync.h.
+// NOTE: Slaves report Idle state while executing mirrored motion and do not support spindle synchronized motion,
+//       a lost message or a reset of the master resets the slaves.
+//#define ENABLE_MOTION_SYNC // Default disabled. Uncomment to enable.
+
+// Saves a snapshot of the motion state when an alarm is raised: alarm code, state, machine position, the executing and
+// last parsed line numbers, planner and segment buffer levels, stepper instrumentation data and the first
+// ALARM_SNAPSHOT_BLOCKS (default 4) planner blocks. The snapshot is kept in RAM across soft resets and in NVS when
+// storage is available so that it survives a power cycle. $AS reports it, $ASR clears it.
+// NOTE: Hard faults are not captured, the snapshot is taken by the alarm handler in the foreground process.
+//#define ENABLE_ALARM_SNAPSHOT // Default disabled. Uncomment to enable.
+
+// Enables the CMD_STATUS_REPORT_BINARY (0x89) realtime command that requests a binary status frame instead of
+// the '<...>' text report. The frame carries raw step positions and native values, no text formatting or parsing is
+// required. Frame format: 0x7E, version, fields, CRC-16/CCITT (0xFFFF initial value, low byte first), 0x7E.
+// Each field is encoded as type, length, data. 0x00, 0x7D and 0x7E bytes between the flags are escaped as 0x7D
+// followed by the byte XOR 0x20. Values are in native byte order, see report.h for the field types.
+// Plugins may add fields via the grbl.on_realtime_report_binary event.
+//#define ENABLE_BINARY_STATUS_REPORT // Default disabled. Uncomment to enable.
+
+// Adds a microsecond timestamp to the real-time status report as |TS:<us>, taken when the position is sampled, and to
+// feedback messages as [MSG:<text>|TS:<us>]. The binary status frame gets a timestamp field. The CMD_TIMESTAMP (0x8A)
+// realtime command reports [TS:<us>] with the time the command was received for aligning host and controller clocks.
+// The timestamp is from hal.get_micros if provided by the driver, else it has millisecond resolution.
+// NOTE: The counter is 32 bits and wraps around every 71.6 minutes.
+//#define REPORT_TIMESTAMP // Default disabled. Uncomment to enable.
+
+// Enables the performance counters plugins may add to their hooks with the PLUGIN_PERF_* macros in plugins.h.
+// The code in a hook may be timed by PLUGIN_PERF_START() and PLUGIN_PERF_END(), placed around the plugin's own
+// processing so that the time spent by the next handler in the chain is not included, or events counted by
+// PLUGIN_PERF_COUNT(). $PERF reports each counter as [PERF:<name>,<count>,<average cycles>,<max cycles>], $PERFR resets them.
+// Cycles are measured with hal.get_cycle_count and reported as 0 if the driver does not provide it.
+// The macros expand to nothing when disabled.
+//#define ENABLE_PLUGIN_PERF // Default disabled. Uncomment to enable.
+
 // Sets which axis the tool length offset is applied. Assumes the spindle is always parallel with
 // the selected axis with the tool oriented toward the negative direction. In other words, a positive
 // tool length offset value is subtracted from the current location.
@@ -181,11 +262,46 @@
 // much greater than this. The default setting should capture most, if not all, full arc error situations.
 //#define ARC_ANGULAR_TRAVEL_EPSILON 5E-7f // Float (radians)
 
-// Default constants for G5 Cubic splines
+// Enables planning of arcs as single planner blocks instead of approximating them by line motions in
+// the planner buffer. The step segment generator then splits the arc into chords within the arc
+// tolerance ($12) as the step segments are generated, so look-ahead is not used up by long or tight
+// tolerance arcs. Speed along the arc is limited by the curvature and the axis acceleration settings.
+// NOTE: Not available with kinematics or backlash compensation. Arcs moving axes other than the plane
+//       and helical axes are still approximated by line motions.
+//#define ENABLE_NATIVE_ARCS
+
+// Generates the moves of G73, G81 and G83 canned drill cycles as planner buffer slots become available instead
+// of blocking the parser until all of them are queued, the block is acknowledged as soon as the first moves are
+// planned. Any following block, system command or buffer sync completes the cycle first. Cycles with dwell
+// or spindle stop are still executed by the parser.
+//#define ENABLE_CANNED_CYCLE_GENERATOR
+
+// Queues all passes of G76 threading cycles without waiting for the planner buffer to empty between passes.
+// Spindle synchronized motion following unsynchronized motion is planned to start from rest, the step segment
+// generator holds it until the steppers are idle and the cycle is then restarted at the next spindle index pulse.
+// Retract and reposition moves of the next pass are then already planned when a pass ends.
+//#define ENABLE_THREADING_PIPELINE
+
+// Selects table lookup with linear interpolation for the sine and cosine calculations used by arc generation.
+// Considerably faster than sinf() and cosf() on processors without a floating point unit, max error is 5E-6.
+// Default is enabled for processors without a FPU (MSP430 and ARM Cortex-M0/M3), set to 0 or 1 to override.
+//#define ARC_TRIG_TABLE 1
+
+// Runs the planner passes over the block buffer in integer arithmetic, speeds squared are kept as unsigned integers in
+// (mm/min)^2 in addition to the float values used by the step segment generator. The planned block times are computed
+// from integer square roots. Considerably faster on processors without a floating point unit, planned speeds are
+// rounded to 1 (mm/min)^2. Use the simulator benchmark to compare cycle times with the float planner.
+//#define PLANNER_FIXED_POINT 1
+
+// Number parsing accumulates up to 17 significant digits and scales them in double precision before rounding
+// to float, avoiding rounding errors for large coordinates with many decimals. Otherwise 8 digits are used.
+// Default is enabled for processors with a double precision FPU (ARM Cortex-M7, IMXRT1062), set to 0 or 1 to override.
+//#define READ_FLOAT_DOUBLE 1
+
+// Default constants for G5 Cubic splines. Splines are flattened into chords within the arc tolerance ($12),
+// BEZIER_MIN_STEP is the minimum parameter step and limits the number of chords to 1 / BEZIER_MIN_STEP.
 //
 //#define BEZIER_MIN_STEP 0.002f
-//#define BEZIER_MAX_STEP 0.1f
-//#define BEZIER_SIGMA 0.1f
 
 // Time delay increments performed during a dwell. The default value is set at 50ms, which provides
 // a maximum time delay of roughly 55 minutes, more than enough for most any application. Increasing
@@ -199,6 +315,8 @@
 // available RAM, like when re-compiling for MCU with ample amounts of RAM. Or decrease if the MCU begins to
 // crash due to the lack of available RAM or if the CPU is having trouble keeping up with planning
 // new incoming motions as they are executed.
+// NOTE: This is the default, and fallback, value for the size. The number of blocks allocated at boot is
+//       set by the $398 setting, see DEFAULT_PLANNER_BUFFER_BLOCKS below.
 // #define BLOCK_BUFFER_SIZE 16 // Uncomment to override default in planner.h.
 
 // Governs the size of the intermediary step segment buffer between the step execution algorithm
@@ -207,8 +325,25 @@
 // block velocity profile is traced exactly. The size of this buffer governs how much step
 // execution lead time there is for other Grbl processes have to compute and do their thing
 // before having to come back and refill this buffer, currently at ~50msec of step moves.
+// NOTE: This is the default, and fallback, value for the size. The number of segments allocated at boot is
+//       set by the $389 setting, see DEFAULT_SEGMENT_BUFFER_SIZE below.
 // #define SEGMENT_BUFFER_SIZE 6 // Uncomment to override default in stepper.h.
 
+// Size in bytes of the queue for preprocessed input lines. When enabled, lines are read from the input
+// stream and queued while motion control waits for room in the planner buffer, so that a burst of short
+// lines can be fed to the parser as soon as planner blocks are released instead of waiting for the
+// stream. Must be large enough for at least two lines with messages (2 * (2 * LINE_BUFFER_SIZE + 1) bytes).
+// NOTE: Responses ("ok") are sent when queued lines are executed, not when they are read.
+//#define LINE_QUEUE_SIZE 2048 // Default disabled. Uncomment to enable.
+
+// Enables framed streaming with windowed acknowledgements, intended for senders connected via a network stream.
+// Lines prefixed by @<sequence number>: are not acknowledged by "ok", instead the sequence number of the last
+// line executed is reported cumulatively as [ACK:<sequence>,<free receive buffer bytes>,<free planner blocks>]
+// when no more input is available or every FRAMED_ACK_INTERVAL lines. Errors are reported immediately
+// as [NAK:<sequence>,<error code>]. Lines without a prefix are acknowledged as usual.
+// The sender may keep pushing lines as long as they fit in the free receive buffer space last reported.
+//#define ENABLE_FRAMED_STREAMING // Default disabled. Uncomment to enable.
+
 // Configures the position after a probing cycle during Grbl's check mode. Disabled sets
 // the position to the probe target, when enabled sets the position to the start position.
 // #define SET_CHECK_MODE_PROBE_TO_START // Default disabled. Uncomment to enable.
@@ -223,6 +358,15 @@
 // NOTE: This option has no effect if SOFTWARE_DEBOUNCE is enabled.
 // #define HARD_LIMIT_FORCE_STATE_CHECK // Default disabled. Uncomment to enable.
 
+// Enables a digital filter for the hard limit inputs. A pin change interrupt starts sampling of the inputs from
+// the driver's periodic (1 ms) timer, the hard limit alarm is raised when the inputs has been read as active for
+// LIMITS_FILTER_SAMPLES consecutive samples. Shorter pulses, e.g. from spindle EMI, are rejected as glitches.
+// The trip count, glitch count and last and maximum latency from pin change to alarm in ms are reported by $I as
+// [LIMITS FILTER:<samples>,<trips>,<glitches>,<last latency>,<max latency>].
+// NOTE: Requires driver support, drivers that support it disable their own software debounce when enabled.
+//       This option overrides HARD_LIMIT_FORCE_STATE_CHECK.
+//#define LIMITS_FILTER_SAMPLES 3 // Default disabled. Uncomment to enable, valid values are 1 - 255.
+
 // Adjusts homing cycle search and locate scalars. These are the multipliers used by Grbl's
 // homing cycle to ensure the limit switches are engaged and cleared through each phase of
 // the cycle. The search phase uses the axes max-travel setting times the SEARCH_SCALAR to
@@ -278,8 +422,121 @@
 // The buffer will be written to non-volatile storage when in idle state.
 //#define BUFFER_NVSDATA_DISABLE
 
+// Enables a log structured journal for flash based non-volatile storage, requires the driver to provide
+// the hal.nvs.journal entry points. Changes to the RAM buffer are appended to the journal as records instead
+// of rewriting the whole flash image. When the active sector is full a snapshot of the RAM buffer is written
+// to the next sector which then becomes the active sector, sectors are used in turn for wear leveling.
+// The RAM buffer is restored from the newest complete sector on startup.
+// NOTE: Sectors must be at least twice the size of a snapshot, see nvs_buffer.c.
+//#define ENABLE_NVS_JOURNAL
+
+// Defers writing buffered non-volatile storage changes to physical storage until NVS_SYNC_DELAY milliseconds
+// have passed since the last change, changes made back to back such as by G10 sequences are then written
+// in one batch. Writes are only done when the machine is idle, this includes dwells. While a program is running
+// pending changes are only written when the machine is idle after NVS_SYNC_DEADLINE milliseconds have passed
+// since the first change, this avoids blocking on slow EEPROM or flash writes between moves.
+// NOTE: requires the driver to provide hal.get_elapsed_ticks, changes are written immediately when idle if not.
+//#define ENABLE_NVS_DEFERRED_SYNC
+//#define NVS_SYNC_DELAY 1000 // ms
+//#define NVS_SYNC_DEADLINE 10000 // ms
+
+// Records timestamps of the startup phases, reported by the $SS command as a [BOOT:...] line with milliseconds
+// elapsed since driver_init() returned for: settings loaded from non-volatile storage, settings validated,
+// driver setup completed, welcome message sent and deferred initialization completed. If the driver provides
+// hal.get_cycle_count the same phases are reported in CPU cycles in a [BOOTCYCLES:...] line.
+//#define ENABLE_BOOT_TIMING
+
+// Defers non-critical initialization, such as Trinamic driver register setup and network startup, until
+// after the welcome message is sent. Deferred initialization is run before the first command is executed.
+//#define ENABLE_DEFERRED_INIT
+
+// Enables backlash compensation, backlash per axis is set by $160 - $165. Axes reversing direction get takeup steps
+// added at the start of the motion, output on the step ticks where the axis is not stepping.
 //#define ENABLE_BACKLASH_COMPENSATION
 
+// Enables controller side surface mapping. $M=x0,y0,x1,y1,nx,ny,clearance,depth,feed probes a grid of nx * ny points
+// in work coordinates in serpentine order, rapids between points are made at the clearance height and probing is to
+// the depth height. The heights are stored in RAM relative to the first point and reported once when done, $M reports
+// the map and $MC clears it. While a map is present the Z target of line motions is corrected by interpolating between
+// the grid points, motions are only split where the surface deviates more than HEIGHT_MAP_TOLERANCE (default 0.002 mm)
+// from a straight segment. Segments are passed on to mc_line() and thus to kinematics segmentation, e.g. for CoreXY.
+// Jog motions are not corrected.
+// NOTE: the map is stored in machine coordinates and is lost on power cycle, reported machine positions include the
+//       correction. Up to HEIGHT_MAP_POINTS_MAX (default 256) points can be stored.
+//#define ENABLE_HEIGHT_MAP
+
+// Enables jerk limited (S-curve) acceleration and deceleration ramps in the step segment generator.
+// Adds per axis jerk settings, $170 - $175 (mm/sec^3). The ramps are shaped to complete in the same
+// time and distance as the planned constant acceleration ramps, so the planner is not affected.
+// NOTE: Peak acceleration during a ramp is higher than the planned acceleration, up to twice the value
+//       for ramps too short to be completed within the jerk limit. Set jerk to 0 for an axis to disable.
+//#define ENABLE_JERK_ACCELERATION
+
+// Enables input shaping in the step segment generator, reduces ringing of the machine at its resonance frequencies
+// at a given acceleration. The path position generated from the planner blocks is convolved with a ZV, ZVD or EI
+// impulse train for the frequency set by $391 and the damping ratio set by $393, the shaper is selected by $390.
+// If $392 is set a shaper for the second frequency is cascaded, e.g. for axes with different resonances.
+// Motion is retimed only, the path is not changed. Each stop is delayed by the shaper duration, half a period
+// of vibration for ZV and a full period for ZVD and EI. Shaping is bypassed for homing, parking, laser mode and
+// spindle synchronized motion, shaped motion is completed before these are started. Native arcs are disabled.
+// NOTE: the shaper duration is limited to (INPUT_SHAPER_SAMPLES - 8) / 2 segment times, 140 ms by default.
+//       The shaper settings, duration (ms) and number of stalls are reported by $SS. A stall occurs when motion
+//       spans more than INPUT_SHAPER_BLOCKS (default 16) planner blocks within the shaper duration.
+//#define ENABLE_INPUT_SHAPING
+
+// Enables planned dwells, a G4 dwell is queued as a timed block without motion that the step segment generator
+// executes in sequence with the motions instead of waiting for the planner buffer to drain and then delaying.
+// The parser continues with the blocks following the dwell, motions before and after it are planned to stop at
+// the dwell. A feed hold pauses the dwell. G4 P0 still waits for motion to complete, as used by senders to
+// synchronize with motion.
+// NOTE: the ok response for a dwell is sent when it is queued, not when it is completed.
+//#define ENABLE_PLANNED_DWELL
+
+// Enables per axis homing rates, seek rates are set by $180 - $185 and feed (locate) rates by $190 - $195 (mm/min).
+// Each axis in a homing cycle then moves at its own rate during the approach and locate phases, axes still stop
+// independently when their limit switch triggers. Set a rate to 0 to use the common rate set by $24 or $25.
+// Pull-off motions are performed at the lowest seek rate of the axes in the cycle.
+//#define ENABLE_HOMING_AXIS_RATES
+
+// Enables velocity jogging by mc_jog_velocity(), typically called by MPG or joystick plugin code. The step segment
+// generator ramps directly towards the target velocity per axis without using the planner, on direction changes
+// motion is decelerated to standstill first. Motion is stopped at soft limits if enabled. Cartesian kinematics only.
+// Jog cancel and safety door stop the motion as for planned jog motions.
+//#define ENABLE_JOG_VELOCITY
+
+// Enables low latency jog cancel. On jog cancel or safety door open during jogging the segments prepped ahead
+// in the step segment buffer are discarded and the deceleration ramp is computed from the speed at the end of the
+// next segment to execute, the stop latency is then independent of the step segment buffer size.
+//#define ENABLE_FAST_JOG_CANCEL
+
+// Enables laser power tracking of velocity in rate adjusted (M4) laser mode. PWM is ramped linearly by the stepper ISR
+// over the steps of each segment from the power at the end of the previous segment, instead of being changed in steps
+// at segment boundaries. Reduces burn gradients at the ends of fast raster lines. Requires direct PWM output.
+//#define ENABLE_LASER_PWM_TRACKING
+
+// Enables laser raster runs, a run of pixel powers output by the stepper ISR evenly spaced over the length
+// of a single linear motion. Runs are queued by gc_laser_raster_add(), see the laser raster plugin.
+// Setting $388 enables controller generated overscan: raster motions are extended by a laser off lead-in and lead-out
+// computed from the axis accelerations, so that pixels are only output at constant speed.
+// NOTE: Pixel power is relative to the programmed spindle speed, M4 speed scaling does not apply to raster motions.
+//#define ENABLE_LASER_RASTER
+
+// Enables O-word subroutines and repeat loops: O<n>SUB ... O<n>ENDSUB, O<n>CALL, O<n>RETURN and O<n>REPEAT[<count>] ...
+// O<n>ENDREPEAT. Bodies are stored preprocessed in a RAM cache of SUBROUTINE_CACHE_SIZE (default 2048) bytes and executed
+// from there without being streamed again, this also applies to jobs run from SD card. Subroutines are kept until replaced
+// or soft reset, a repeat loop received outside a subroutine is executed when its ENDREPEAT block is received.
+// NOTE: parameters and expressions are not supported, WHILE and IF blocks and call arguments are rejected.
+//#define ENABLE_SUBROUTINES
+
+// Enables NGC parameters and expressions: numbered parameters #1 - #100, named parameters #<name>, read-only system
+// parameters such as #5221 (G54 X offset) and bracketed expressions with LinuxCNC operators and functions. Parameters
+// are assigned by #<n>=<value> words, the assignments are performed after all values in the block have been read.
+// Word values may be a number, a parameter or an expression, eg. X[#1+10]. Expressions are compiled to a stack bytecode
+// kept in a cache of NGC_EXPR_CACHE_SIZE (default 16) entries. With ENABLE_SUBROUTINES, adds O<n>WHILE[<expression>] ...
+// O<n>ENDWHILE loops and expressions for repeat counts, call arguments are assigned to #1, #2...
+// NOTE: parameters are kept in RAM only.
+//#define ENABLE_NGC_EXPRESSIONS
+
 // End compile time only default configuration
 
 // When the HAL driver supports spindle sync then this option sets the number of pulses per revolution
@@ -436,12 +693,23 @@
 
 #if COMPATIBILITY_LEVEL == 0
 // Number of tools in ATC tool table, comment out to disable
+// The tool table is kept in RAM, changes are written back to non-volatile storage by the NVS buffer sync.
+// NOTE: up to 8 tools are stored in the 1KB core area, larger tables (max 255 tools) are stored above it and
+//       NVS_SIZE is increased accordingly. Changing between these sizes will relocate the stored tool data.
 // #define N_TOOLS 8
 #endif
 
 // Max number of entries in log for PID data reporting, to be used for tuning
+// NOTE: only logs spindle synchronized motion, ENABLE_PID_TELEMETRY below streams data from any PID loop instead.
 //#define PID_LOG 1000 // Default disabled. Uncomment to enable.
 
+// Streams setpoint, error and output samples from a PID loop registered by pidf_telemetry_register() for live tuning.
+// $PIDT lists the registered loops (channels), $PIDT=<channel>[,<decimation>] starts streaming of every <decimation>'th
+// sample as [PIDT:<channel>,<dropped>|<setpoint>,<error>,<output>|...] lines and $PIDT=0 stops it. Samples are buffered
+// in RAM, PID_TELEMETRY_BUFFER (default 64) entries of 12 bytes, and output every PID_TELEMETRY_PERIOD milliseconds.
+// Spindle synchronized motion and the plasma THC plugin register their loops. Requires pid.c to be compiled in.
+//#define ENABLE_PID_TELEMETRY // Default disabled. Uncomment to enable.
+
 //#define DEFAULT_NO_REPORT_BUFFER_STATE
 //#define DEFAULT_NO_REPORT_LINE_NUMBERS
 //#define DEFAULT_NO_REPORT_CURRENT_FEED_SPEED
@@ -512,6 +780,36 @@
 
 //#define DEFAULT_G73_RETRACT 0.1f // mm
 
+// Number of planner blocks to allocate from the heap at boot, may be changed at run-time by $398.
+// Takes effect after a hard reset. If not enough memory is available the number is reduced,
+// the actual number of blocks available (less one) is reported by the $I command.
+//#define DEFAULT_PLANNER_BUFFER_BLOCKS 100 // Integer (PLANNER_BUFFER_BLOCKS_MIN - PLANNER_BUFFER_BLOCKS_MAX)
+
+// Number of step segments to allocate at boot, may be changed at run-time by $389. Takes effect after a hard reset.
+// Sizes larger than SEGMENT_BUFFER_SIZE are allocated from the heap, if not enough memory is available
+// SEGMENT_BUFFER_SIZE is used. A larger buffer adds lead time for the foreground process at the cost of a slower
+// response to feed holds and overrides. $SM reports the sizes of the buffers in use.
+// NOTE: POOL_MESSAGES may have to be increased when using many segments and messages.
+//#define DEFAULT_SEGMENT_BUFFER_SIZE 20 // Integer (SEGMENT_BUFFER_SIZE_MIN - SEGMENT_BUFFER_SIZE_MAX)
+
+// Interval in milliseconds between real-time status reports sent without a '?' request, may be changed at
+// run-time by $396. 0 disables, the minimum is AUTO_REPORT_INTERVAL_MIN. Reports are also sent on state changes,
+// rate limited to one per AUTO_REPORT_INTERVAL_MIN milliseconds. Requires the driver to provide hal.get_elapsed_ticks.
+// If $10 bit 12 is set reports due at the interval are skipped while state, position and tracked report data are unchanged.
+//#define DEFAULT_AUTO_REPORT_INTERVAL 100 // Integer (0 or AUTO_REPORT_INTERVAL_MIN - 65535)
+
+// Kinematics to use when compiled with KINEMATICS_API, may be changed at run-time by $397. Takes effect after
+// a hard reset. Only kinematics compiled in (COREXY, WALL_PLOTTER, MASLOW_ROUTER, RTCP_TRUNNION above) can be selected.
+// Default is the kinematics enabled above, Cartesian if none.
+//#define DEFAULT_KINEMATICS Kinematics_Cartesian // Kinematics_Cartesian, Kinematics_CoreXY, Kinematics_WallPlotter, Kinematics_Maslow or Kinematics_RTCP
+
+// Input shaper when compiled with ENABLE_INPUT_SHAPING, may be changed at run-time by $390 - $393.
+// The damping ratio of a lightly damped machine frame is typically in the range 0.05 - 0.15.
+//#define DEFAULT_INPUT_SHAPER_TYPE InputShaper_None // InputShaper_None, InputShaper_ZV, InputShaper_ZVD or InputShaper_EI
+//#define DEFAULT_INPUT_SHAPER_FREQUENCY 40.0f // Hz
+//#define DEFAULT_INPUT_SHAPER_FREQUENCY2 0.0f // Hz, 0 for none
+//#define DEFAULT_INPUT_SHAPER_DAMPING 0.1f // Damping ratio (0 - 0.5)
+
 #ifdef DEFAULT_HOMING_ENABLE
 
 // Number of homing cycles performed after when the machine initially jogs to limit switches.
@@ -571,6 +869,12 @@
 //#define DUAL_AXIS_HOMING_FAIL_DISTANCE_MAX  25.0f  // Float (mm)
 //#define DUAL_AXIS_HOMING_FAIL_DISTANCE_MIN  2.5f // Float (mm)
 
+// By default the motors of an auto squared axis are located by separate locate cycles for each motor after
+// the other axes in the homing cycle has been homed. Enable this to square the axis on every approach of the
+// homing cycle instead, each motor is then stopped by its own limit switch while the other axes are seeking and
+// locating. The fail distance above is the maximum skew allowed between the motors on each approach.
+//#define HOMING_AUTO_SQUARE_CONCURRENT // Default disabled. Uncomment to enable.
+
 // Enables and configures parking motion methods upon a safety door state. Primarily for OEMs
 // that desire this feature for their integrated machines. At the moment, Grbl assumes that
 // the parking motion only involves one axis, although the parking implementation was written
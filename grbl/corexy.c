@@ -24,6 +24,8 @@
 
 #ifdef COREXY
 
+#include <math.h>
+
 #include "settings.h"
 #include "planner.h"
 #include "kinematics.h"
@@ -45,35 +47,36 @@ inline static int32_t corexy_convert_to_b_motor_steps (int32_t *steps)
 }
 
 // Returns machine position of axis 'idx'. Must be sent a 'step' array.
+// The axis steps are recovered from the motor steps in integer, they are then scaled by the precomputed
+// reciprocals of steps/mm. Called for every status report.
 static void corexy_convert_array_steps_to_mpos (float *position, int32_t *steps)
 {
-    position[X_AXIS] = corexy_convert_to_a_motor_steps(steps) / settings.axis[X_AXIS].steps_per_mm;
-    position[Y_AXIS] = corexy_convert_to_b_motor_steps(steps) / settings.axis[Y_AXIS].steps_per_mm;
-    position[Z_AXIS] = steps[Z_AXIS] / settings.axis[Z_AXIS].steps_per_mm;
+    uint_fast8_t idx = N_AXIS;
+
+    position[X_AXIS] = (float)corexy_convert_to_a_motor_steps(steps) * mm_per_step[X_AXIS];
+    position[Y_AXIS] = (float)corexy_convert_to_b_motor_steps(steps) * mm_per_step[Y_AXIS];
+
+    do {
+        idx--;
+        position[idx] = (float)steps[idx] * mm_per_step[idx];
+    } while(idx > Z_AXIS);
 }
 
 // Transform absolute position from cartesian coordinate system (mm) to corexy coordinate system (step)
+// The axis targets are rounded to steps first, the motor steps are then their integer sum and difference.
 static void corexy_target_to_steps (int32_t *target_steps, float *target)
 {
     uint_fast8_t idx = N_AXIS;
     int32_t a_steps, b_steps;
 
     do {
-        switch(--idx) {
-            case X_AXIS:
-                a_steps = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
-                break;
-
-            case Y_AXIS:
-                b_steps = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
-                break;
-
-            default:
-                target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
-                break;
-        }
+        idx--;
+        target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
     } while(idx);
 
+    a_steps = target_steps[X_AXIS];
+    b_steps = target_steps[Y_AXIS];
+
     target_steps[A_MOTOR] = a_steps + b_steps;
     target_steps[B_MOTOR] = a_steps - b_steps;
 }
@@ -153,7 +156,7 @@ static void corexy_limits_set_machine_positions (axes_signals_t cycle)
 
 
 // Initialize API pointers for CoreXY kinematics
-void corexy_init (void)
+static void corexy_kinematics_init (void)
 {
     kinematics.limits_set_target_pos = corexy_limits_set_target_pos;
     kinematics.limits_get_axis_mask = corexy_limits_get_axis_mask;
@@ -162,5 +165,17 @@ void corexy_init (void)
     kinematics.convert_array_steps_to_mpos = corexy_convert_array_steps_to_mpos;
 }
 
+static kinematics_entry_t corexy = {
+    .type = Kinematics_CoreXY,
+    .name = "CoreXY",
+    .init = corexy_kinematics_init
+};
+
+// Add CoreXY kinematics to the kinematics registry
+void corexy_init (void)
+{
+    kinematics_register(&corexy);
+}
+
 #endif
 
@@ -23,7 +23,7 @@
 #ifndef _COREXY_H_
 #define _COREXY_H_
 
-// Initialize HAL pointers for CoreXY kinematics
+// Add CoreXY kinematics to the kinematics registry
 void corexy_init (void);
 
 #endif
@@ -36,6 +36,8 @@
 
 // Note: DEFAULT_ACCELERATION is only referenced in this file
 #define DEFAULT_ACCELERATION (10.0f * 60.0f * 60.0f) // 10*60*60 mm/min^2 = 10 mm/sec^2
+// Note: DEFAULT_JERK is only referenced in this file
+#define DEFAULT_JERK (100.0f * 60.0f * 60.0f * 60.0f) // 100*60*60*60 mm/min^3 = 100 mm/sec^3
 
 #ifdef DEFAULT_REPORT_MACHINE_POSITION
 #undef DEFAULT_REPORT_MACHINE_POSITION
@@ -141,6 +143,15 @@
 #ifndef DEFAULT_Z_ACCELERATION
 #define DEFAULT_Z_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_X_JERK
+#define DEFAULT_X_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_Y_JERK
+#define DEFAULT_Y_JERK DEFAULT_JERK
+#endif
+#ifndef DEFAULT_Z_JERK
+#define DEFAULT_Z_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_X_MAX_TRAVEL
 #define DEFAULT_X_MAX_TRAVEL 200.0f
 #endif
@@ -257,6 +268,9 @@
 #ifndef DEFAULT_A_ACCELERATION
 #define DEFAULT_A_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_A_JERK
+#define DEFAULT_A_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_A_MAX_TRAVEL
 #define DEFAULT_A_MAX_TRAVEL 200.0f
 #endif
@@ -270,6 +284,9 @@
 #ifndef DEFAULT_B_ACCELERATION
 #define DEFAULT_B_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_B_JERK
+#define DEFAULT_B_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_B_MAX_TRAVEL
 #define DEFAULT_B_MAX_TRAVEL 200.0f
 #endif
@@ -283,6 +300,9 @@
 #ifndef DEFAULT_C_ACCELERATION
 #define DEFAULT_C_ACCELERATION DEFAULT_ACCELERATION
 #endif
+#ifndef DEFAULT_C_JERK
+#define DEFAULT_C_JERK DEFAULT_JERK
+#endif
 #ifndef DEFAULT_C_MAX_TRAVEL
 #define DEFAULT_C_MAX_TRAVEL 200.0f
 #endif
@@ -291,6 +311,66 @@
 #define DEFAULT_G73_RETRACT 0.1f
 #endif
 
+#ifndef DEFAULT_PLANNER_BUFFER_BLOCKS
+#define DEFAULT_PLANNER_BUFFER_BLOCKS BLOCK_BUFFER_SIZE
+#endif
+
+#ifndef DEFAULT_SEGMENT_BUFFER_SIZE
+#define DEFAULT_SEGMENT_BUFFER_SIZE SEGMENT_BUFFER_SIZE
+#endif
+
+#ifndef DEFAULT_LASER_RASTER_OVERSCAN
+#define DEFAULT_LASER_RASTER_OVERSCAN 0.0f
+#endif
+
+#ifndef DEFAULT_AUTO_REPORT_INTERVAL
+#define DEFAULT_AUTO_REPORT_INTERVAL 0
+#endif
+
+#ifndef DEFAULT_INPUT_SHAPER_TYPE
+#define DEFAULT_INPUT_SHAPER_TYPE InputShaper_None
+#endif
+#ifndef DEFAULT_INPUT_SHAPER_FREQUENCY
+#define DEFAULT_INPUT_SHAPER_FREQUENCY 40.0f
+#endif
+#ifndef DEFAULT_INPUT_SHAPER_FREQUENCY2
+#define DEFAULT_INPUT_SHAPER_FREQUENCY2 0.0f
+#endif
+#ifndef DEFAULT_INPUT_SHAPER_DAMPING
+#define DEFAULT_INPUT_SHAPER_DAMPING 0.1f
+#endif
+
+#ifndef DEFAULT_PROBE_RETRACT
+#define DEFAULT_PROBE_RETRACT 2.0f // mm
+#endif
+#ifndef DEFAULT_PROBE_LOCATE_FEED_RATE
+#define DEFAULT_PROBE_LOCATE_FEED_RATE 0.0f // mm/min, 0 to disable
+#endif
+
+#ifndef DEFAULT_RTCP_PIVOT_X
+#define DEFAULT_RTCP_PIVOT_X 0.0f
+#endif
+#ifndef DEFAULT_RTCP_PIVOT_Y
+#define DEFAULT_RTCP_PIVOT_Y 0.0f
+#endif
+#ifndef DEFAULT_RTCP_PIVOT_Z
+#define DEFAULT_RTCP_PIVOT_Z 0.0f
+#endif
+
+#ifndef DEFAULT_KINEMATICS
+#if defined(RTCP_TRUNNION)
+#define DEFAULT_KINEMATICS Kinematics_RTCP
+#elif defined(MASLOW_ROUTER)
+#define DEFAULT_KINEMATICS Kinematics_Maslow
+#elif defined(WALL_PLOTTER)
+#define DEFAULT_KINEMATICS Kinematics_WallPlotter
+#elif defined(COREXY)
+#define DEFAULT_KINEMATICS Kinematics_CoreXY
+#else
+#define DEFAULT_KINEMATICS Kinematics_Cartesian
+#endif
+#endif
+
 #ifdef DEFAULT_LASER_MODE
 #undef DEFAULT_LASER_MODE
 #define DEFAULT_LASER_MODE 1
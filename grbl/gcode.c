@@ -23,11 +23,16 @@
 
 #include <math.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdlib.h>
 
 #include "hal.h"
 #include "motion_control.h"
 #include "protocol.h"
+#include "kinematics.h"
+#include "pool.h"
+#include "subroutine.h"
+#include "ngc_expr.h"
 
 // NOTE: Max line number is defined by the g-code standard to be 99999. It seems to be an
 // arbitrary value, and some GUIs may require more. So we increased it based on a max safe
@@ -55,18 +60,50 @@ typedef enum {
 } axis_command_t;
 
 // Declare gc extern struct
-parser_state_t gc_state, *saved_state = NULL;
+THREAD_LOCAL parser_state_t gc_state, *saved_state = NULL;
 #ifdef N_TOOLS
-tool_data_t tool_table[N_TOOLS + 1];
+THREAD_LOCAL tool_data_t tool_table[N_TOOLS + 1];
 #else
-tool_data_t tool_table;
+THREAD_LOCAL tool_data_t tool_table;
 #endif
 
 #define FAIL(status) return(status);
 
-static gc_thread_data thread;
-static output_command_t *output_commands = NULL; // Linked list
-static scale_factor_t scale_factor = {
+static THREAD_LOCAL gc_thread_data thread;
+static THREAD_LOCAL output_command_t *output_commands = NULL; // Linked list
+#ifdef ENABLE_LASER_RASTER
+static THREAD_LOCAL laser_raster_t *laser_raster = NULL; // Raster run pending for the next linear motion
+
+// Controller generated overscan of raster motions, see overscan_line().
+typedef struct {
+    bool pending;                   // Set when the machine is left at the end of a lead-out
+    float target[N_AXIS];           // Programmed end of the raster motion
+} overscan_t;
+
+static THREAD_LOCAL overscan_t overscan = {0};
+#endif
+
+// Data of the last G0/G1 motion, reused for following blocks with axis words only, see gc_execute_block().
+typedef struct {
+    bool valid;                     // Set when the parser state allows the fast path
+    machine_mode_t mode;            // Machine mode the planner data was set up for
+    plan_line_data_t plan_data;     // Planner data of the motion, without message, output commands and line number
+} fast_path_t;
+
+// Combined work coordinate transform for axis words, target = value * scale + offset in absolute distance mode
+// and target = value * scale + position in incremental distance mode.
+typedef struct {
+    bool valid;                     // Cleared when any of the offsets, scaling, units or diameter mode may change
+    float scale[N_AXIS];            // Unit conversion, diameter mode and G51 scale factors
+    float offset[N_AXIS];           // Coordinate system, G92 and tool length offsets and G51 scaling origin
+} wco_transform_t;
+
+// Modal groups of commands that may change the work coordinate transform.
+#define TRANSFORM_GROUPS (bit(ModalGroup_G0)|bit(ModalGroup_G6)|bit(ModalGroup_G8)|bit(ModalGroup_G11)|bit(ModalGroup_G12)|bit(ModalGroup_G15)|bit(ModalGroup_M4))
+
+static THREAD_LOCAL fast_path_t fast_path = {0};
+static THREAD_LOCAL wco_transform_t transform = {0};
+static THREAD_LOCAL scale_factor_t scale_factor = {
     .ijk[X_AXIS] = 1.0f,
     .ijk[Y_AXIS] = 1.0f,
     .ijk[Z_AXIS] = 1.0f
@@ -92,6 +129,8 @@ static void set_scaling (float factor)
     uint_fast8_t idx = N_AXIS;
     axes_signals_t state = gc_get_g51_state();
 
+    transform.valid = false;
+
     do {
         scale_factor.ijk[--idx] = factor;
 #ifdef MACH3_SCALING
@@ -135,10 +174,139 @@ inline static float gc_get_block_offset (parser_block_t *gc_block, uint_fast8_t
     return gc_block->modal.coord_system.xyz[idx] + gc_state.g92_coord_offset[idx] + gc_state.tool_length_offset[idx];
 }
 
+// Saves the planner data and offsets of a G0/G1 motion for the axis words only fast path.
+static void fast_path_save (plan_line_data_t *plan_data, bool program_flow)
+{
+    fast_path.valid = !program_flow && gc_state.modal.feed_mode == FeedMode_UnitsPerMin &&
+                       gc_state.modal.spindle_rpm_mode == SpindleSpeedMode_RPM;
+
+    if(fast_path.valid) {
+        fast_path.mode = settings.mode;
+        memcpy(&fast_path.plan_data, plan_data, sizeof(plan_line_data_t));
+        fast_path.plan_data.message = 0;
+        fast_path.plan_data.output_commands = NULL;
+        // The path control mode is updated after the planner data is set up, pick up a change made by the block.
+        fast_path.plan_data.path_tolerance = gc_state.modal.control == ControlMode_Blending ? gc_state.modal.path_tolerance : 0.0f;
+#ifdef ENABLE_LASER_RASTER
+        fast_path.plan_data.raster = NULL;
+#endif
+    }
+}
+
+#ifdef ENABLE_LASER_RASTER
+
+// Moves to an overscan position with the laser off. Spindle off and rate adjusted makes the
+// step segment generator output zero power regardless of the laser mode (M3 or M4).
+static void overscan_move (float *target)
+{
+    plan_line_data_t plan_data;
+
+    memset(&plan_data, 0, sizeof(plan_line_data_t));
+    plan_data.condition.rapid_motion = On;
+    plan_data.condition.is_rpm_rate_adjusted = On;
+    plan_data.line_number = gc_state.line_number;
+
+    mc_line(target, &plan_data);
+}
+
+// Moves back from the end of a lead-out to the programmed end of the raster motion.
+// Called before any block is executed except a raster motion, which moves directly to its own lead-in.
+static void overscan_return (void)
+{
+    overscan.pending = false;
+
+    overscan_move(overscan.target);
+}
+
+// Executes a raster motion with controller generated overscan ($388). The raster run is padded with zero power
+// pixels at both ends, long enough for the motion to accelerate to the feed rate before the first pixel and to
+// decelerate after the last, so that power is only applied at constant speed. The lead-in distance is computed from
+// the axis accelerations along the motion. The machine is first moved back to the start of the lead-in and is left at
+// the end of the lead-out, the parser position is the programmed target.
+static void overscan_line (float *target, plan_line_data_t *pl_data)
+{
+    uint_fast8_t idx = N_AXIS;
+    uint32_t pad = 0;
+    float delta[N_AXIS], length = 0.0f, acceleration = SOME_LARGE_VALUE;
+    laser_raster_t *raster = pl_data->raster;
+
+    do {
+        idx--;
+        delta[idx] = target[idx] - gc_state.position[idx];
+        length += delta[idx] * delta[idx];
+    } while(idx);
+
+    if((length = sqrtf(length)) > 0.0f && !pl_data->condition.inverse_time) {
+
+        idx = N_AXIS;
+        do {
+            if(delta[--idx] != 0.0f)
+                acceleration = min(acceleration, settings.axis[idx].acceleration * length / fabsf(delta[idx]));
+        } while(idx);
+
+        // Overscan distance in pixels, each pixel spans length / raster->length mm.
+        pad = (uint32_t)ceilf(settings.raster_overscan * pl_data->feed_rate * pl_data->feed_rate / (2.0f * acceleration) * (float)raster->length / length);
+    }
+
+    if(pad && (uint32_t)raster->length + 2 * pad <= UINT16_MAX && (raster = realloc(raster, sizeof(laser_raster_t) + raster->length + 2 * pad))) {
+
+        float start[N_AXIS], end[N_AXIS], f = (float)pad / (float)raster->length;
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            start[idx] = gc_state.position[idx] - delta[idx] * f;
+            end[idx] = target[idx] + delta[idx] * f;
+        } while(idx);
+
+        memmove(&raster->pixel[pad], raster->pixel, raster->length);
+        memset(raster->pixel, 0, pad);
+        memset(&raster->pixel[pad + raster->length], 0, pad);
+        raster->length += 2 * pad;
+        pl_data->raster = raster;
+
+        overscan_move(start);
+        mc_line(end, pl_data);
+
+        if(sys.state != STATE_CHECK_MODE) {
+            overscan.pending = true;
+            memcpy(overscan.target, target, sizeof(overscan.target));
+        }
+    } else {
+        if(overscan.pending)
+            overscan_return();
+        mc_line(target, pl_data);
+    }
+}
+
+#endif
+
+// Rebuilds the work coordinate transform from the parser state.
+static void transform_update (void)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        transform.scale[idx] = gc_state.modal.units_imperial ? MM_PER_INCH : 1.0f;
+        if(idx == X_AXIS && gc_state.modal.diameter_mode)
+            transform.scale[idx] /= 2.0f;
+        transform.offset[idx] = gc_get_offset(idx);
+        if(gc_state.modal.scaling_active) {
+            transform.scale[idx] *= scale_factor.ijk[idx];
+            transform.offset[idx] += scale_factor.xyz[idx] * (1.0f - scale_factor.ijk[idx]);
+        }
+    } while(idx);
+
+    transform.valid = true;
+}
+
 void gc_set_tool_offset (tool_offset_mode_t mode, uint_fast8_t idx, int32_t offset)
 {
     bool tlo_changed = false;
 
+    fast_path.valid = transform.valid = false;
+
     switch(mode) {
 
         case ToolLengthOffset_Cancel:
@@ -204,6 +372,8 @@ void gc_init (bool cold_start)
     cold_start = true;
 #endif
 
+    fast_path.valid = transform.valid = false;
+
     if(cold_start) {
         memset(&gc_state, 0, sizeof(parser_state_t));
       #ifdef N_TOOLS
@@ -223,10 +393,18 @@ void gc_init (bool cold_start)
     // Clear any pending output commands
     while(output_commands) {
         output_command_t *next = output_commands->next;
-        free(output_commands);
+        pool_free(output_commands);
         output_commands = next;
     }
 
+#ifdef ENABLE_LASER_RASTER
+    if(laser_raster) {
+        free(laser_raster);
+        laser_raster = NULL;
+    }
+    overscan.pending = false;
+#endif
+
     // Load default override status
     gc_state.modal.override_ctrl = sys.override.control;
     gc_state.spindle.css.max_rpm = settings.spindle.rpm_max; // default max speed for CSS mode
@@ -254,15 +432,89 @@ bool gc_laser_ppi_enable (uint_fast16_t ppi, uint_fast16_t pulse_length)
 {
     gc_state.is_laser_ppi_mode = ppi > 0 && pulse_length > 0;
 
+    st_set_laser_ppi(gc_state.is_laser_ppi_mode ? ppi : 0);
+
     return grbl.on_laser_ppi_enable && grbl.on_laser_ppi_enable(ppi, pulse_length);
 }
 
+#ifdef ENABLE_LASER_RASTER
+
+void gc_laser_raster_add (laser_raster_t *raster)
+{
+    if(laser_raster)
+        free(laser_raster);
+
+    laser_raster = raster;
+}
+
+#endif
+
 // Add output command to linked list
+// Applies coolant changes still waiting for a motion block to start, called before the parser waits for motion
+// to complete. The last change is applied after the wait, as it would have been without deferring.
+static bool coolant_flush (void)
+{
+    bool ok = true;
+    int32_t coolant = -1;
+    output_command_t *cmd = output_commands, *prev = NULL, *next;
+
+    while(cmd) {
+        next = cmd->next;
+        if(cmd->is_coolant) {
+            coolant = cmd->value;
+            if(prev)
+                prev->next = next;
+            else
+                output_commands = next;
+            pool_free(cmd);
+        } else
+            prev = cmd;
+        cmd = next;
+    }
+
+    if(coolant != -1)
+        ok = coolant_sync((coolant_state_t){ .value = (uint8_t)coolant });
+
+    return ok;
+}
+
+static volatile int32_t input_event;
+
+static void input_interrupt_handler (uint8_t port, bool state)
+{
+    input_event = state ? 1 : 0;
+}
+
+// M66 wait for a digital input edge or level by port interrupt, realtime commands are executed while waiting.
+// Falls back to the polled driver implementation if the port cannot be armed. Returns -1 on timeout.
+static int32_t wait_on_digital_input (uint8_t port, wait_mode_t wait_mode, float timeout)
+{
+    uint32_t ms = hal.get_elapsed_ticks(), delay = (uint32_t)ceilf(timeout * 1000.0f);
+
+    input_event = -1;
+
+    if(!hal.port.register_interrupt_handler(port, wait_mode == WaitMode_Rise || wait_mode == WaitMode_High ? IRQ_Mode_Rising : IRQ_Mode_Falling, input_interrupt_handler))
+        return hal.port.wait_on_input(true, port, wait_mode, timeout);
+
+    // Level modes are satisfied if the input is already at the level, checked after arming to not miss an edge.
+    if(wait_mode == WaitMode_High || wait_mode == WaitMode_Low) {
+        int32_t value = hal.port.wait_on_input(true, port, WaitMode_Immediate, 0.0f);
+        if(value == (wait_mode == WaitMode_High ? 1 : 0))
+            input_event = value;
+    }
+
+    while(input_event == -1 && (hal.get_elapsed_ticks() - ms) < delay && protocol_execute_realtime());
+
+    hal.port.register_interrupt_handler(port, IRQ_Mode_None, NULL);
+
+    return input_event;
+}
+
 static bool add_output_command (output_command_t *command)
 {
     output_command_t *add_cmd;
 
-    if((add_cmd = malloc(sizeof(output_command_t)))) {
+    if((add_cmd = pool_alloc_output_command())) {
 
         memcpy(add_cmd, command, sizeof(output_command_t));
 
@@ -303,6 +555,63 @@ static status_code_t init_sync_motion (plan_line_data_t *pl_data, float pitch)
     return Status_OK;
 }
 
+// Value word import table, indexed by letter - 'A'. Letters not in the table are unsupported.
+typedef enum {
+    ValueType_Unsupported = 0,
+    ValueType_Float,
+    ValueType_Axis,         // Float, also flagged in axis words
+    ValueType_IJK,          // Float, also flagged in ijk words
+    ValueType_Integer,      // uint32_t, value must be an integer
+    ValueType_Byte,         // uint8_t, value must be an integer
+    ValueType_LineNumber,   // int32_t, value is truncated
+    ValueType_Tool          // uint32_t, value must be an integer and a valid tool number
+} value_type_t;
+
+typedef struct {
+    value_type_t type;
+    parameter_word_t word;
+    uint8_t idx;            // Axis or IJK index
+    uint16_t offset;        // Offset of value in gc_values_t
+} value_word_t;
+
+#define VALUE_WORD(t, w, v) { .type = ValueType_##t, .word = Word_##w, .offset = offsetof(gc_values_t, v) }
+#define AXIS_WORD(w, i) { .type = ValueType_Axis, .word = Word_##w, .idx = i, .offset = offsetof(gc_values_t, xyz[i]) }
+#define IJK_WORD(w, i) { .type = ValueType_IJK, .word = Word_##w, .idx = i, .offset = offsetof(gc_values_t, ijk[i]) }
+
+static const value_word_t value_words_table['Z' - 'A' + 1] = {
+#ifdef A_AXIS
+    ['A' - 'A'] = AXIS_WORD(A, A_AXIS),
+#endif
+#ifdef B_AXIS
+    ['B' - 'A'] = AXIS_WORD(B, B_AXIS),
+#endif
+#ifdef C_AXIS
+    ['C' - 'A'] = AXIS_WORD(C, C_AXIS),
+#endif
+    ['D' - 'A'] = VALUE_WORD(Float, D, d),
+    ['E' - 'A'] = VALUE_WORD(Float, E, e),
+    ['F' - 'A'] = VALUE_WORD(Float, F, f),
+    ['H' - 'A'] = VALUE_WORD(Integer, H, h),
+    ['I' - 'A'] = IJK_WORD(I, I_VALUE),
+    ['J' - 'A'] = IJK_WORD(J, J_VALUE),
+    ['K' - 'A'] = IJK_WORD(K, K_VALUE),
+    ['L' - 'A'] = VALUE_WORD(Byte, L, l),
+    ['N' - 'A'] = VALUE_WORD(LineNumber, N, n),
+    ['P' - 'A'] = VALUE_WORD(Float, P, p), // NOTE: For certain commands, P value must be an integer, but none of these commands are supported.
+    ['Q' - 'A'] = VALUE_WORD(Float, Q, q), // may be used for user defined mcodes or G61,G76
+    ['R' - 'A'] = VALUE_WORD(Float, R, r),
+    ['S' - 'A'] = VALUE_WORD(Float, S, s),
+    ['T' - 'A'] = VALUE_WORD(Tool, T, t),
+    ['X' - 'A'] = AXIS_WORD(X, X_AXIS),
+    ['Y' - 'A'] = AXIS_WORD(Y, Y_AXIS),
+    ['Z' - 'A'] = AXIS_WORD(Z, Z_AXIS)
+};
+
+// Modal groups and value words of blocks that only write the axis, feed, spindle speed, tool and line number
+// values of the parser block. The next block then only has to clear these instead of the whole struct.
+#define PLAIN_BLOCK_GROUPS (bit(ModalGroup_G1)|bit(ModalGroup_G2)|bit(ModalGroup_G3)|bit(ModalGroup_G5)|bit(ModalGroup_G6))
+#define PLAIN_BLOCK_WORDS (AXIS_WORDS_MASK|bit(Word_F)|bit(Word_N)|bit(Word_S)|bit(Word_T))
+
 // Executes one block (line) of 0-terminated G-Code. The block is assumed to contain only uppercase
 // characters and signed floating point values (no whitespace). Comments and block delete
 // characters have been removed. In this function, all units and positions are converted and
@@ -310,7 +619,8 @@ static status_code_t init_sync_motion (plan_line_data_t *pl_data, float pitch)
 // coordinates, respectively.
 status_code_t gc_execute_block(char *block, char *message)
 {
-    static parser_block_t gc_block;
+    static THREAD_LOCAL parser_block_t gc_block;
+    static THREAD_LOCAL bool gc_block_plain = false; // Set when the previous block only wrote the values cleared for plain blocks.
 
     // Determine if the line is a program start/end marker.
     // Old comment from protocol.c:
@@ -323,6 +633,12 @@ status_code_t gc_execute_block(char *block, char *message)
         return Status_OK;
     }
 
+#ifdef ENABLE_SUBROUTINES
+    // O-word blocks and blocks of a subroutine or repeat loop body being recorded.
+    if (block[0] != '$' && subroutine_claims_block(block))
+        return subroutine_execute_block(block);
+#endif
+
   /* -------------------------------------------------------------------------------------
      STEP 1: Initialize parser block struct and copy current g-code state modes. The parser
      updates these modes and commands as the block line is parsed and will only be used and
@@ -330,7 +646,15 @@ status_code_t gc_execute_block(char *block, char *message)
      values struct, word tracking variables, and a non-modal commands tracker for the new
      block. This struct contains all of the necessary information to execute the block. */
 
-    memset(&gc_block, 0, sizeof(gc_block));                           // Initialize the parser block struct.
+    // Initialize the parser block struct, only the values written if the previous block was a plain motion.
+    if(gc_block_plain) {
+        memset(gc_block.values.xyz, 0, sizeof(gc_block.values.xyz));
+        gc_block.values.f = gc_block.values.s = 0.0f;
+        gc_block.values.n = 0;
+        gc_block.values.t = 0;
+        gc_block_plain = false; // Until the block has been parsed.
+    } else
+        memset(&gc_block, 0, sizeof(gc_block));
     memcpy(&gc_block.modal, &gc_state.modal, sizeof(gc_state.modal)); // Copy current modes
 
     bool set_tool = false;
@@ -369,15 +693,34 @@ status_code_t gc_execute_block(char *block, char *message)
     uint32_t int_value = 0;
     uint_fast16_t mantissa = 0;
     word_bit_t word_bit = { .parameter = (parameter_word_t)0 }; // Bit-value for assigning tracking variables
+#ifdef ENABLE_NGC_EXPRESSIONS
+    status_code_t status;
+
+    ngc_assignments_clear();
+#endif
 
     while ((letter = block[char_counter++]) != '\0') { // Loop until no more g-code words in block.
 
+#ifdef ENABLE_NGC_EXPRESSIONS
+        // Parameter assignment, performed when all words in the block have been read.
+        if(letter == '#') {
+            if((status = ngc_read_assignment(block, &char_counter)) != Status_OK)
+                FAIL(status);
+            continue;
+        }
+#endif
+
         // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
         if((letter < 'A') || (letter > 'Z'))
             FAIL(Status_ExpectedCommandLetter); // [Expected word letter]
 
+#ifdef ENABLE_NGC_EXPRESSIONS
+        if((status = ngc_read_value(block, &char_counter, &value)) != Status_OK)
+            FAIL(status); // [Expected word value]
+#else
         if (!read_float(block, &char_counter, &value))
             FAIL(Status_BadNumberFormat); // [Expected word value]
+#endif
 
         // Convert values to smaller uint8 significand and mantissa values for parsing this word.
         // NOTE: Mantissa is multiplied by 100 to catch non-integer command values. This is more
@@ -467,6 +810,12 @@ status_code_t gc_execute_block(char *block, char *message)
                         gc_block.modal.canned_cycle_active = false;
                         break;
 
+                    case 84:
+                        // Rigid tapping requires a spindle encoder, spindle direction control and spindle at speed checking.
+                        if(!(hal.spindle.get_data && hal.driver_cap.spindle_dir && settings.spindle.at_speed_tolerance > 0.0f))
+                            FAIL(Status_GcodeUnsupportedCommand); // [G84 not supported]
+                        // No break. Continues to next line.
+
                     case 73: case 81: case 82: case 83: case 85: case 86: case 89:
                         if (axis_command)
                             FAIL(Status_GcodeAxisCommandConflict); // [Axis word/command conflict]
@@ -557,11 +906,11 @@ status_code_t gc_execute_block(char *block, char *message)
                         }
                         break;
 
-                    case 61:
+                    case 61: case 64:
                         word_bit.group = ModalGroup_G13;
                         if (mantissa != 0) // [G61.1 not supported]
                             FAIL(Status_GcodeUnsupportedCommand);
-                        // gc_block.modal.control = CONTROL_MODE_EXACT_PATH; // G61
+                        gc_block.modal.control = int_value == 61 ? ControlMode_ExactPath : ControlMode_Blending;
                         break;
 
                     case 96: case 97:
@@ -741,151 +1090,128 @@ status_code_t gc_execute_block(char *block, char *message)
                 legal g-code words and stores their value. Error-checking is performed later since some
                 words (I,J,K,L,P,R) have multiple connotations and/or depend on the issued commands. */
 
-                switch(letter) {
-
-                  #ifdef A_AXIS
-                    case 'A':
-                        word_bit.parameter = Word_A;
-                        gc_block.values.xyz[A_AXIS] = value;
-                        bit_true(axis_words, bit(A_AXIS));
-                        break;
-                  #endif
-
-                  #ifdef B_AXIS
-                    case 'B':
-                        word_bit.parameter = Word_B;
-                        gc_block.values.xyz[B_AXIS] = value;
-                        bit_true(axis_words, bit(B_AXIS));
-                        break;
-                  #endif
-
-                  #ifdef C_AXIS
-                    case 'C':
-                        word_bit.parameter = Word_C;
-                        gc_block.values.xyz[C_AXIS] = value;
-                        bit_true(axis_words, bit(C_AXIS));
-                        break;
-                 #endif
-
-                    case 'D':
-                        word_bit.parameter = Word_D;
-                        gc_block.values.d = value;
-                        break;
-
-                    case 'E':
-                        word_bit.parameter = Word_E;
-                        gc_block.values.e = value;
-                        break;
-
-                    case 'F':
-                        word_bit.parameter = Word_F;
-                        gc_block.values.f = value;
-                        break;
-
-                    case 'H':
-                        if (mantissa > 0)
-                            FAIL(Status_GcodeCommandValueNotInteger);
-                        word_bit.parameter = Word_H;
-                        gc_block.values.h = int_value;
-                        break;
-
-                    case 'I':
-                        word_bit.parameter = Word_I;
-                        gc_block.values.ijk[I_VALUE] = value;
-                        bit_true(ijk_words, bit(I_VALUE));
-                        break;
+                {
+                    const value_word_t *value_word = &value_words_table[letter - 'A'];
+
+                    word_bit.parameter = value_word->word;
+
+                    switch(value_word->type) {
+
+                        case ValueType_Float:
+                            *(float *)((uint8_t *)&gc_block.values + value_word->offset) = value;
+                            break;
+
+                        case ValueType_Axis:
+                            gc_block.values.xyz[value_word->idx] = value;
+                            bit_true(axis_words, bit(value_word->idx));
+                            break;
+
+                        case ValueType_IJK:
+                            gc_block.values.ijk[value_word->idx] = value;
+                            bit_true(ijk_words, bit(value_word->idx));
+                            break;
+
+                        case ValueType_Integer:
+                            if (mantissa > 0)
+                                FAIL(Status_GcodeCommandValueNotInteger);
+                            *(uint32_t *)((uint8_t *)&gc_block.values + value_word->offset) = int_value;
+                            break;
+
+                        case ValueType_Tool:
+                            if (mantissa > 0)
+                                FAIL(Status_GcodeCommandValueNotInteger);
+                            if (int_value > MAX_TOOL_NUMBER)
+                                FAIL(Status_GcodeIllegalToolTableEntry);
+                            gc_block.values.t = int_value;
+                            break;
+
+                        case ValueType_Byte:
+                            if (mantissa > 0)
+                                FAIL(Status_GcodeCommandValueNotInteger);
+                            gc_block.values.l = (uint8_t)int_value;
+                            break;
+
+                        case ValueType_LineNumber:
+                            gc_block.values.n = (int32_t)truncf(value);
+                            break;
+
+                        default: FAIL(Status_GcodeUnsupportedCommand);
+                    }
+                }
 
-                    case 'J':
-                        word_bit.parameter = Word_J;
-                        gc_block.values.ijk[J_VALUE] = value;
-                        bit_true(ijk_words, bit(J_VALUE));
-                        break;
+                // NOTE: Variable 'word_bit' is always assigned, if the non-command letter is valid.
+                if (bit_istrue(value_words, bit(word_bit.parameter)))
+                    FAIL(Status_GcodeWordRepeated); // [Word repeated]
 
-                    case 'K':
-                        word_bit.parameter = Word_K;
-                        gc_block.values.ijk[K_VALUE] = value;
-                        bit_true(ijk_words, bit(K_VALUE));
-                        break;
+                // Check for invalid negative values for words F, H, N, P, T, and S.
+                // NOTE: Negative value check is done here simply for code-efficiency.
+                if ((bit(word_bit.parameter) & (bit(Word_D)|bit(Word_F)|bit(Word_H)|bit(Word_N)|bit(Word_T)|bit(Word_S))) && value < 0.0f)
+                    FAIL(Status_NegativeValue); // [Word value cannot be negative]
 
-                    case 'L':
-                        if (mantissa > 0)
-                            FAIL(Status_GcodeCommandValueNotInteger);
-                        word_bit.parameter = Word_L;
-                        gc_block.values.l = (uint8_t)int_value;
-                        break;
+                value_words |= bit(word_bit.parameter); // Flag to indicate parameter assigned.
 
-                    case 'N':
-                        word_bit.parameter = Word_N;
-                        gc_block.values.n = (int32_t)truncf(value);
-                        break;
+        } // end main letter switch
+    }
 
-                    case 'P': // NOTE: For certain commands, P value must be an integer, but none of these commands are supported.
-                        word_bit.parameter = Word_P;
-                        gc_block.values.p = value;
-                        break;
+    // Parsing complete!
 
-                    case 'Q': // may be used for user defined mcodes or G61,G76
-                        word_bit.parameter = Word_Q;
-                        gc_block.values.q = value;
-                        break;
+#ifdef ENABLE_NGC_EXPRESSIONS
+    ngc_assignments_commit();
+#endif
 
-                    case 'R':
-                        word_bit.parameter = Word_R;
-                        gc_block.values.r = value;
-                        break;
+    // Blocks with only motion, plane, distance, feed mode and units commands and axis, F, N, S and T words
+    // in G0 or G1 mode leave the rest of the parser block cleared.
+    gc_block_plain = !(command_words & ~PLAIN_BLOCK_GROUPS) && !(value_words & ~PLAIN_BLOCK_WORDS) &&
+                      (gc_block.modal.motion == MotionMode_Seek || gc_block.modal.motion == MotionMode_Linear);
 
-                    case 'S':
-                        word_bit.parameter = Word_S;
-                        gc_block.values.s = value;
-                        break;
+    // Invalidate the work coordinate transform before any command that may change it is checked or executed.
+    if(command_words & TRANSFORM_GROUPS)
+        transform.valid = false;
 
-                    case 'T':
-                        if (mantissa > 0)
-                            FAIL(Status_GcodeCommandValueNotInteger);
-                        if (int_value > MAX_TOOL_NUMBER)
-                            FAIL(Status_GcodeIllegalToolTableEntry);
-                        word_bit.parameter = Word_T;
-                        gc_block.values.t = int_value;
-                        break;
+#ifdef ENABLE_LASER_RASTER
+    // The machine is moved back from the end of a lead-out before anything else is executed, a following raster motion moves directly to its lead-in.
+    if(overscan.pending && !(laser_raster && axis_words && gc_block.modal.motion == MotionMode_Linear && settings.raster_overscan > 0.0f))
+        overscan_return();
+#endif
 
-                    case 'X':
-                        word_bit.parameter = Word_X;
-                        gc_block.values.xyz[X_AXIS] = value;
-                        bit_true(axis_words, bit(X_AXIS));
-                        break;
+    // Fast path for blocks with axis words and an optional line number only, with the parser state unchanged
+    // since the last G0/G1 motion. The error checks and conversions of steps 3 and 4 are then reduced to
+    // computing the target from the cached transform, the planner data of the last motion is reused.
+    if(fast_path.valid && axis_words && !command_words && !(value_words & ~(AXIS_WORDS_MASK|bit(Word_N))) &&
+        !gc_parser_flags.jog_motion && message == NULL && output_commands == NULL && fast_path.mode == settings.mode
+#ifdef ENABLE_LASER_RASTER
+         && laser_raster == NULL
+#endif
+          ) {
 
-                    case 'Y':
-                        word_bit.parameter = Word_Y;
-                        gc_block.values.xyz[Y_AXIS] = value;
-                        bit_true(axis_words, bit(Y_AXIS));
-                        break;
+        uint_fast8_t idx = N_AXIS;
+        plan_line_data_t plan_data;
 
-                    case 'Z':
-                        word_bit.parameter = Word_Z;
-                        gc_block.values.xyz[Z_AXIS] = value;
-                        bit_true(axis_words, bit(Z_AXIS));
-                        break;
+        if(!transform.valid)
+            transform_update();
 
-                    default: FAIL(Status_GcodeUnsupportedCommand);
+        float *base = gc_state.modal.distance_incremental ? gc_state.position : transform.offset;
 
-                } // end parameter letter switch
+        do {
+            idx--;
+            gc_block.values.xyz[idx] = bit_istrue(axis_words, bit(idx))
+                                        ? gc_block.values.xyz[idx] * transform.scale[idx] + base[idx]
+                                        : gc_state.position[idx];
+        } while(idx);
 
-                // NOTE: Variable 'word_bit' is always assigned, if the non-command letter is valid.
-                if (bit_istrue(value_words, bit(word_bit.parameter)))
-                    FAIL(Status_GcodeWordRepeated); // [Word repeated]
+        memcpy(&plan_data, &fast_path.plan_data, sizeof(plan_line_data_t));
+        gc_state.line_number = plan_data.line_number = gc_block.values.n;
+        sys.flags.delay_overrides = Off;
 
-                // Check for invalid negative values for words F, H, N, P, T, and S.
-                // NOTE: Negative value check is done here simply for code-efficiency.
-                if ((bit(word_bit.parameter) & (bit(Word_D)|bit(Word_F)|bit(Word_H)|bit(Word_N)|bit(Word_T)|bit(Word_S))) && value < 0.0f)
-                    FAIL(Status_NegativeValue); // [Word value cannot be negative]
+        mc_line(gc_block.values.xyz, &plan_data);
 
-                value_words |= bit(word_bit.parameter); // Flag to indicate parameter assigned.
+        // Do not update position on cancel (already done in protocol_exec_rt_system)
+        if(!sys.cancel)
+            memcpy(gc_state.position, gc_block.values.xyz, sizeof(gc_state.position));
 
-        } // end main letter switch
+        return Status_OK;
     }
 
-    // Parsing complete!
-
 
   /* -------------------------------------------------------------------------------------
      STEP 3: Error-check all commands and values passed in this block. This step ensures all of
@@ -1349,7 +1675,21 @@ status_code_t gc_execute_block(char *block, char *message)
             FAIL(Status_SettingReadFail);
     }
 
-    // [16. Set path control mode ]: N/A. Only G61. G61.1 and G64 NOT SUPPORTED.
+    // [16. Set path control mode ]: G64 P value is optional, if missing the junction deviation setting is used as tolerance.
+    //   G61.1 NOT SUPPORTED.
+    if (bit_istrue(command_words, bit(ModalGroup_G13))) {
+        if(gc_block.modal.control == ControlMode_Blending) {
+            if(bit_istrue(value_words, bit(Word_P))) {
+                if(gc_block.values.p < 0.0f)
+                    FAIL(Status_NegativeValue);
+                gc_block.modal.path_tolerance = gc_block.modal.units_imperial ? gc_block.values.p * MM_PER_INCH : gc_block.values.p;
+                bit_false(value_words, bit(Word_P));
+            } else
+                gc_block.modal.path_tolerance = settings.junction_deviation;
+        } else
+            gc_block.modal.path_tolerance = 0.0f;
+    }
+
     // [17. Set distance mode ]: N/A. Only G91.1. G90.1 NOT SUPPORTED.
     // [18. Set retract mode ]: N/A.
 
@@ -1739,6 +2079,20 @@ status_code_t gc_execute_block(char *block, char *message)
                             FAIL(Status_GcodeValueWordMissing);
                         // no break
 
+                    case MotionMode_CannedCycle84:
+                        if(!gc_block.modal.spindle.on)
+                            FAIL(Status_GcodeSpindleNotRunning);
+                        if(gc_block.modal.feed_mode != FeedMode_UnitsPerRev && gc_block.values.s <= 0.0f)
+                            FAIL(Status_GcodeValueOutOfRange); // [No spindle speed for the pitch]
+                        if(bit_istrue(value_words, bit(Word_P))) {
+                            if(gc_block.values.p < 0.0f)
+                                FAIL(Status_NegativeValue);
+                            gc_state.canned.dwell = gc_block.values.p;
+                            bit_false(value_words, bit(Word_P)); // Remove single-meaning value word.
+                        }
+                        gc_state.canned.rapid_retract = Off;
+                        // no break
+
                     case MotionMode_CannedCycle85:
                     case MotionMode_CannedCycle81:
                         gc_state.canned.delta = - gc_state.canned.xyz[plane.axis_linear] + gc_state.canned.retract_position;
@@ -2040,10 +2394,18 @@ status_code_t gc_execute_block(char *block, char *message)
      need to update the state and execute the block according to the order-of-execution.
     */
 
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    // Complete a pending canned cycle before executing anything else.
+    if(!mc_canned_drill_pump(true))
+        return Status_OK; // Aborted
+#endif
+
     // Initialize planner data struct for motion blocks.
     plan_line_data_t plan_data;
     memset(&plan_data, 0, sizeof(plan_line_data_t)); // Zero plan_data struct
 
+    fast_path.valid = false;
+
     // Intercept jog commands and complete error checking for valid jog commands and execute.
     // NOTE: G-code parser state is not updated, except the position to ensure sequential jog
     // targets are computed correctly. The final parser position after a jog is updated in
@@ -2100,8 +2462,9 @@ status_code_t gc_execute_block(char *block, char *message)
     plan_data.line_number = gc_state.line_number; // Record data for planner use.
 
     // [1. Comments feedback ]: Extracted in protocol.c if HAL entry point provided
-    if(message && sys.state != STATE_CHECK_MODE && (plan_data.message = malloc(strlen(message) + 1)))
-        strcpy(plan_data.message, message);
+    // NOTE: messages longer than POOL_MESSAGE_SIZE - 1 characters are truncated.
+    if(message && sys.state != STATE_CHECK_MODE && (plan_data.message = pool_intern_message(message)) == 0)
+        FAIL(Status_OutOfMemory);
 
     // [2. Set feed rate mode ]:
     gc_state.modal.feed_mode = gc_block.modal.feed_mode;
@@ -2111,6 +2474,7 @@ status_code_t gc_execute_block(char *block, char *message)
     // [3. Set feed rate ]:
     gc_state.feed_rate = gc_block.values.f; // Always copy this value. See feed rate error-checking.
     plan_data.feed_rate = gc_state.feed_rate; // Record data for planner use.
+    plan_data.path_tolerance = gc_state.modal.control == ControlMode_Blending ? gc_state.modal.path_tolerance : 0.0f;
 
     // [4. Set spindle speed ]:
     if(gc_state.modal.spindle_rpm_mode == SpindleSpeedMode_CSS) {
@@ -2133,7 +2497,7 @@ status_code_t gc_execute_block(char *block, char *message)
 
 
     if ((gc_state.spindle.rpm != gc_block.values.s) || gc_parser_flags.spindle_force_sync) {
-        if (gc_state.modal.spindle.on && !gc_parser_flags.laser_is_motion)
+        if (gc_state.modal.spindle.on && !gc_parser_flags.laser_is_motion && coolant_flush())
             spindle_sync(gc_state.modal.spindle, gc_parser_flags.laser_disable ? 0.0f : gc_block.values.s);
         gc_state.spindle.rpm = gc_block.values.s; // Update spindle speed state.
     }
@@ -2177,7 +2541,8 @@ status_code_t gc_execute_block(char *block, char *message)
 
             case 62:
             case 63:
-                add_output_command(&gc_block.output_command);
+                if(!add_output_command(&gc_block.output_command))
+                    FAIL(Status_OutOfMemory);
                 break;
 
             case 64:
@@ -2186,11 +2551,16 @@ status_code_t gc_execute_block(char *block, char *message)
                 break;
 
             case 66:
-                hal.port.wait_on_input(gc_block.output_command.is_digital, gc_block.output_command.port, (wait_mode_t)gc_block.values.l, gc_block.values.q);
+                if(gc_block.output_command.is_digital && (wait_mode_t)gc_block.values.l != WaitMode_Immediate &&
+                    hal.port.register_interrupt_handler && hal.get_elapsed_ticks)
+                    wait_on_digital_input(gc_block.output_command.port, (wait_mode_t)gc_block.values.l, gc_block.values.q);
+                else
+                    hal.port.wait_on_input(gc_block.output_command.is_digital, gc_block.output_command.port, (wait_mode_t)gc_block.values.l, gc_block.values.q);
                 break;
 
             case 67:
-                add_output_command(&gc_block.output_command);
+                if(!add_output_command(&gc_block.output_command))
+                    FAIL(Status_OutOfMemory);
                 break;
 
             case 68:
@@ -2202,12 +2572,17 @@ status_code_t gc_execute_block(char *block, char *message)
     // [6. Change tool ]: Delegated to (possible) driver implementation
     if (bit_istrue(command_words, bit(ModalGroup_M6)) && !set_tool && sys.state != STATE_CHECK_MODE) {
 
+        // Let the ATC queue motion to the tool change position behind the previous motion.
+        if(hal.tool.prepare && hal.tool.change && (int_value = (uint_fast16_t)hal.tool.prepare(&gc_state)) != Status_OK)
+            FAIL((status_code_t)int_value);
+
+        coolant_flush();
         protocol_buffer_synchronize();
 
         if(plan_data.message) {
-            report_message(plan_data.message, Message_Plain);
-            free(plan_data.message);
-            plan_data.message = NULL;
+            report_message(pool_get_message(plan_data.message), Message_Plain);
+            pool_release_message(plan_data.message);
+            plan_data.message = 0;
         }
 
 #ifdef N_TOOLS
@@ -2231,7 +2606,7 @@ status_code_t gc_execute_block(char *block, char *message)
         // Update spindle control and apply spindle speed when enabling it in this block.
         // NOTE: All spindle state changes are synced, even in laser mode. Also, plan_data,
         // rather than gc_state, is used to manage laser state for non-laser motions.
-        if(spindle_sync(gc_block.modal.spindle, plan_data.spindle.rpm))
+        if(coolant_flush() && spindle_sync(gc_block.modal.spindle, plan_data.spindle.rpm))
             gc_state.modal.spindle = gc_block.modal.spindle;
     }
 
@@ -2245,8 +2620,21 @@ status_code_t gc_execute_block(char *block, char *message)
     if (gc_parser_flags.set_coolant && gc_state.modal.coolant.value != gc_block.modal.coolant.value) {
     // NOTE: Coolant M-codes are modal. Only one command per line is allowed. But, multiple states
     // can exist at the same time, while coolant disable clears all states.
-        if(coolant_sync(gc_block.modal.coolant))
-            gc_state.modal.coolant = gc_block.modal.coolant;
+    // Changes are applied at the start of the next motion block when motion is queued, the planner
+    // buffer is not synchronized. Parser statements that wait for motion to complete apply them first.
+        if(sys.state == STATE_CHECK_MODE || (sys.state == STATE_IDLE && plan_get_current_block() == NULL)) {
+            if(coolant_flush() && coolant_sync(gc_block.modal.coolant))
+                gc_state.modal.coolant = gc_block.modal.coolant;
+        } else {
+            output_command_t coolant_cmd = {
+                .is_coolant = true,
+                .value = gc_block.modal.coolant.value
+            };
+            if(add_output_command(&coolant_cmd))
+                gc_state.modal.coolant = gc_block.modal.coolant;
+            else if(coolant_flush() && coolant_sync(gc_block.modal.coolant)) // Out of memory, fall back to sync.
+                gc_state.modal.coolant = gc_block.modal.coolant;
+        }
     }
 
     plan_data.condition.coolant = gc_state.modal.coolant; // Set condition flag for planner use.
@@ -2269,15 +2657,19 @@ status_code_t gc_execute_block(char *block, char *message)
     // [9a. User defined M commands ]:
     if(gc_block.user_mcode && sys.state != STATE_CHECK_MODE) {
 
-        if(gc_block.user_mcode_sync)
+        if(gc_block.user_mcode_sync && coolant_flush())
             protocol_buffer_synchronize(); // Ensure user defined mcode is executed when specified in program.
 
         hal.user_mcode.execute(sys.state, &gc_block);
     }
 
     // [10. Dwell ]:
-    if (gc_block.non_modal_command == NonModal_Dwell)
+    if (gc_block.non_modal_command == NonModal_Dwell && coolant_flush())
+#ifdef ENABLE_PLANNED_DWELL
+        mc_dwell_planned(gc_block.values.p, &plan_data);
+#else
         mc_dwell(gc_block.values.p);
+#endif
 
     // [11. Set active plane ]:
     gc_state.modal.plane_select = gc_block.modal.plane_select;
@@ -2347,8 +2739,9 @@ status_code_t gc_execute_block(char *block, char *message)
         system_flag_wco_change();
     }
 
-    // [16. Set path control mode ]: G61.1/G64 NOT SUPPORTED
-    // gc_state.modal.control = gc_block.modal.control; // NOTE: Always default.
+    // [16. Set path control mode ]: G61.1 NOT SUPPORTED
+    gc_state.modal.control = gc_block.modal.control;
+    gc_state.modal.path_tolerance = gc_block.modal.path_tolerance;
 
     // [17. Set distance mode ]:
     gc_state.modal.distance_incremental = gc_block.modal.distance_incremental;
@@ -2437,11 +2830,30 @@ status_code_t gc_execute_block(char *block, char *message)
                 //??    gc_state.distance_per_rev = plan_data.feed_rate;
                     // check initial feed rate - fail if zero?
                 }
+#ifdef ENABLE_LASER_RASTER
+                // Raster pixels are spread evenly over the block by the stepper ISR, motions split by kinematics are not supported.
+  #ifdef KINEMATICS_API
+                if(laser_raster && kinematics_is_cartesian()) {
+  #else
+                if(laser_raster) {
+  #endif
+                    plan_data.raster = laser_raster;
+                    laser_raster = NULL;
+                }
+#endif
+                if(!plan_data.condition.spindle.synchronized)
+                    fast_path_save(&plan_data, gc_block.modal.program_flow != ProgramFlow_Running);
+#ifdef ENABLE_LASER_RASTER
+                if(plan_data.raster && settings.raster_overscan > 0.0f)
+                    overscan_line(gc_block.values.xyz, &plan_data);
+                else
+#endif
                 mc_line(gc_block.values.xyz, &plan_data);
                 break;
 
             case MotionMode_Seek:
                 plan_data.condition.rapid_motion = On; // Set rapid motion condition flag.
+                fast_path_save(&plan_data, gc_block.modal.program_flow != ProgramFlow_Running);
                 mc_line(gc_block.values.xyz, &plan_data);
                 break;
 
@@ -2500,6 +2912,26 @@ status_code_t gc_execute_block(char *block, char *message)
                 mc_canned_drill(gc_state.modal.motion, gc_block.values.xyz, &plan_data, gc_state.position, plane, gc_block.values.l, &gc_state.canned);
                 break;
 
+            case MotionMode_CannedCycle84:
+                {
+                    gc_override_flags_t overrides = sys.override.control; // Save current override disable status.
+
+                    // Pitch is the feed rate in units per revolution mode (G95), else the feed rate divided by the spindle speed.
+                    plan_data.spindle.rpm = gc_block.values.s;
+                    status_code_t status = init_sync_motion(&plan_data, gc_state.modal.feed_mode == FeedMode_UnitsPerRev
+                                                                         ? plan_data.feed_rate
+                                                                         : plan_data.feed_rate / gc_block.values.s);
+                    if(status != Status_OK)
+                        FAIL(status);
+
+                    gc_state.canned.retract_mode = gc_state.modal.retract_mode;
+                    mc_canned_drill(gc_state.modal.motion, gc_block.values.xyz, &plan_data, gc_state.position, plane, gc_block.values.l, &gc_state.canned);
+
+                    protocol_buffer_synchronize();    // Wait until the cycle is finished,
+                    sys.override.control = overrides; // then restore previous override disable status.
+                }
+                break;
+
             case MotionMode_ProbeToward:
             case MotionMode_ProbeTowardNoError:
             case MotionMode_ProbeAway:
@@ -2507,7 +2939,9 @@ status_code_t gc_execute_block(char *block, char *message)
                 // NOTE: gc_block.values.xyz is returned from mc_probe_cycle with the updated position value. So
                 // upon a successful probing cycle, the machine position and the returned value should be the same.
                 plan_data.condition.no_feed_override = !settings.probe.allow_feed_override;
-                gc_update_pos = (pos_update_t)mc_probe_cycle(gc_block.values.xyz, &plan_data, gc_parser_flags);
+                gc_update_pos = (pos_update_t)(settings.probe_locate_feed_rate > 0.0f
+                                                ? mc_probe_locate_cycle(gc_block.values.xyz, &plan_data, gc_parser_flags)
+                                                : mc_probe_cycle(gc_block.values.xyz, &plan_data, gc_parser_flags));
                 break;
 
             default:
@@ -2520,11 +2954,19 @@ status_code_t gc_execute_block(char *block, char *message)
 
         //  Clean out any remaining output commands (may linger on error)
         while(plan_data.output_commands) {
-            output_command_t *next = plan_data.output_commands;
-            free(plan_data.output_commands);
+            output_command_t *next = plan_data.output_commands->next;
+            pool_free(plan_data.output_commands);
             plan_data.output_commands = next;
         }
 
+#ifdef ENABLE_LASER_RASTER
+        // Clean out raster run if not consumed by the planner (check mode, zero length motion or error)
+        if(plan_data.raster) {
+            free(plan_data.raster);
+            plan_data.raster = NULL;
+        }
+#endif
+
         // As far as the parser is concerned, the position is now == target. In reality the
         // motion control system might still be processing the action and the real tool position
         // in any intermediate location.
@@ -2536,8 +2978,8 @@ status_code_t gc_execute_block(char *block, char *message)
     }
 
     if(plan_data.message) {
-        report_message(plan_data.message, Message_Plain);
-        free(plan_data.message);
+        report_message(pool_get_message(plan_data.message), Message_Plain);
+        pool_release_message(plan_data.message);
     }
 
     // [21. Program flow ]:
@@ -2547,6 +2989,7 @@ status_code_t gc_execute_block(char *block, char *message)
 
     if (gc_state.modal.program_flow) {
 
+        coolant_flush();
         protocol_buffer_synchronize(); // Sync and finish all remaining buffered motions before moving on.
 
         if (gc_state.modal.program_flow == ProgramFlow_Paused || gc_block.modal.program_flow == ProgramFlow_OptionalStop || gc_block.modal.program_flow == ProgramFlow_CompletedM60) {
@@ -2613,10 +3056,17 @@ status_code_t gc_execute_block(char *block, char *message)
             // Clear any pending output commands
             while(output_commands) {
                 output_command_t *next = output_commands->next;
-                free(output_commands);
+                pool_free(output_commands);
                 output_commands = next;
             }
 
+#ifdef ENABLE_LASER_RASTER
+            if(laser_raster) {
+                free(laser_raster);
+                laser_raster = NULL;
+            }
+#endif
+
             grbl.report.feedback_message(Message_ProgramEnd);
         }
         gc_state.modal.program_flow = ProgramFlow_Running; // Reset program flow.
@@ -80,8 +80,17 @@ typedef enum {
     Status_HomingRequired = 46,
     Status_GCodeToolError = 47,
     Status_ValueWordConflict = 48,
+    Status_OutOfMemory = 49,
 
     Status_EStop = 50,
+    Status_FlowControlSyntaxError = 51,
+    Status_FlowControlStackOverflow = 52,
+    Status_FlowControlNotDefined = 53,
+    Status_ExpressionSyntaxError = 54,
+    Status_ExpressionDivideByZero = 55,
+    Status_ExpressionArgumentOutOfRange = 56,
+    Status_ExpressionUndefinedParameter = 57,
+    Status_ExpressionInvalidParameter = 58,
     Status_Unhandled = 59, // For internal use only
 
 // Some error codes as defined in bdring's ESP32 port
@@ -114,7 +123,7 @@ typedef enum {
     ModalGroup_G10,     // [G98,G99] Return mode in canned cycles
     ModalGroup_G11,     // [G50,G51] Scaling
     ModalGroup_G12,     // [G54,G55,G56,G57,G58,G59] Coordinate system selection
-    ModalGroup_G13,     // [G61] Control mode
+    ModalGroup_G13,     // [G61,G64] Control mode
     ModalGroup_G14,     // [G96,G97] Spindle Speed Mode
     ModalGroup_G15,     // [G7,G8] Lathe Diameter Mode
 
@@ -203,6 +212,7 @@ typedef enum {
     MotionMode_CannedCycle81 = 81,          // G81 (Do not alter value)
     MotionMode_CannedCycle82 = 82,          // G82 (Do not alter value)
     MotionMode_CannedCycle83 = 83,          // G83 (Do not alter value)
+    MotionMode_CannedCycle84 = 84,          // G84 (Do not alter value)
     MotionMode_CannedCycle85 = 85,          // G85 (Do not alter value)
     MotionMode_CannedCycle86 = 86,          // G86 (Do not alter value)
     MotionMode_CannedCycle89 = 89,          // G89 (Do not alter value)
@@ -250,7 +260,10 @@ typedef enum {
 //#define CUTTER_COMP_DISABLE 0 // G40 (Default: Must be zero)
 
 // Modal Group G13: Control mode
-//#define CONTROL_MODE_EXACT_PATH 0 // G61 (Default: Must be zero)
+typedef enum {
+    ControlMode_ExactPath = 0,  // G61 (Default: Must be zero)
+    ControlMode_Blending = 1    // G64
+} control_mode_t;
 
 // Modal Group G8: Tool length offset
 typedef enum {
@@ -281,12 +294,19 @@ typedef enum {
 
 typedef struct output_command {
     bool is_digital;
+    bool is_coolant;    // Coolant state change, value holds the coolant state
     bool is_executed;
     uint8_t port;
     int32_t value;
     struct output_command *next;
 } output_command_t;
 
+// Run of laser pixel powers to be output in sequence over the length of the next linear (G1) motion.
+typedef struct {
+    uint16_t length;    // Number of pixels
+    uint8_t pixel[];    // Pixel power, 0 - 255 of the programmed spindle speed (S-word)
+} laser_raster_t;
+
 typedef enum {
     WaitMode_Immediate = 0,
     WaitMode_Rise,
@@ -300,10 +320,14 @@ typedef enum {
 // NOTE: Not used by core, may be used by driver code
 typedef enum {
     UserMCode_Ignore = 0,
+    Spindle_Select = 104,
     LaserPPI_Enable = 112,
     LaserPPI_Rate = 113,
     LaserPPI_PulseLength = 114,
     Laser_Coolant = 115,
+    AuxAxis_Move = 170,
+    AuxAxis_Wait = 171,
+    AuxAxis_SetPosition = 172,
     Trinamic_DebugReport = 122,
     Trinamic_StepperCurrent = 906,
     Trinamic_ModeToggle = 569,
@@ -424,7 +448,8 @@ typedef struct {
     // uint8_t cutter_comp;              // {G40} NOTE: Don't track. Only default supported.
     tool_offset_mode_t tool_offset_mode; // {G43,G43.1,G49}
     coord_system_t coord_system;         // {G54,G55,G56,G57,G58,G59,G59.1,G59.2,G59.3}
-    // uint8_t control;                  // {G61} NOTE: Don't track. Only default supported.
+    control_mode_t control;              // {G61,G64}
+    float path_tolerance;                // {G64 P} Path blending tolerance in mm.
     program_flow_t program_flow;         // {M0,M1,M2,M30,M60}
     coolant_state_t coolant;             // {M7,M8,M9}
     spindle_state_t spindle;             // {M3,M4,M5}
@@ -536,11 +561,11 @@ typedef struct {
     float ijk[N_AXIS]; // Scaling factors
 } scale_factor_t;
 
-extern parser_state_t gc_state;
+extern THREAD_LOCAL parser_state_t gc_state;
 #ifdef N_TOOLS
-extern tool_data_t tool_table[N_TOOLS + 1];
+extern THREAD_LOCAL tool_data_t tool_table[N_TOOLS + 1];
 #else
-extern tool_data_t tool_table;
+extern THREAD_LOCAL tool_data_t tool_table;
 #endif
 
 typedef struct {
@@ -561,16 +586,28 @@ status_code_t gc_execute_block(char *block, char *message);
 
 // Sets g-code parser position in mm. Input in steps. Called by the system abort and hard
 // limit pull-off routines.
+#ifdef ENABLE_HEIGHT_MAP
+// NOTE: the height map correction is removed from the Z position, it is added back by mc_line().
+void height_map_sync_position (float *position, int32_t *steps);
+#define gc_sync_position() height_map_sync_position (gc_state.position, sys_position)
+#else
 #define gc_sync_position() system_convert_array_steps_to_mpos (gc_state.position, sys_position)
+#endif
 
 // Sets g-code parser and planner position in mm.
-#define sync_position() plan_sync_position(); system_convert_array_steps_to_mpos (gc_state.position, sys_position)
+#define sync_position() plan_sync_position(); gc_sync_position()
 
 // Set dynamic laser power mode to PPI (Pulses Per Inch)
 // Driver support for pulsing the laser on signal is required for this to work.
 // Returns true if driver uses hardware implementation.
 bool gc_laser_ppi_enable (uint_fast16_t ppi, uint_fast16_t pulse_length);
 
+#ifdef ENABLE_LASER_RASTER
+// Queues a malloc'ed raster run for the next linear motion, ownership is taken over by the core.
+// A run not yet consumed by a motion is replaced.
+void gc_laser_raster_add (laser_raster_t *raster);
+#endif
+
 // Gets axes scaling state.
 axes_signals_t gc_get_g51_state (void);
 float *gc_get_scaling (void);
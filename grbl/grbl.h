@@ -34,20 +34,46 @@
 #else
 #define GRBL_VERSION "1.1f"
 #endif
-#define GRBL_VERSION_BUILD "20201103"
+#define GRBL_VERSION_BUILD "20201110"
 
 // The following symbols are set here if not already set by the compiler or in config.h
 // Do NOT change here!
 
+// ISR_CODE is used to decorate code run in interrupt context, ISR_DATA data frequently accessed by it.
+// These are placed in fast memory where supported, drivers may define them as predefined symbols to override.
+// Do not remove or change unless you know what you are doing.
 #ifdef GRBL_ESP32
 #include "esp_attr.h"
 #define ISR_CODE IRAM_ATTR
-#else
-// Used to decorate code run in interrupt context.
-// Do not remove or change unless you know what you are doing.
+#define ISR_DATA DRAM_ATTR
+#elif defined(__IMXRT1062__)
+#ifndef ISR_CODE
+#define ISR_CODE __attribute__((section(".fastrun"))) // ITCM, same as FASTRUN
+#endif
+#elif defined(ISR_CODE_IN_RAM) && (defined(STM32F401xC) || defined(STM32F411xE) || defined(STM32F446xx))
+#ifndef ISR_CODE
+#define ISR_CODE __attribute__((section(".RamFunc")))
+#endif
+#endif
+
+#ifndef ISR_CODE
 #define ISR_CODE
 #endif
 
+// NOTE: ISR_DATA is not used with ENABLE_THREAD_LOCAL_CONTEXT as thread local storage cannot be placed in a named section.
+#ifndef ISR_DATA
+#define ISR_DATA
+#endif
+
+// Used to decorate mutable core state, see ENABLE_THREAD_LOCAL_CONTEXT in config.h.
+#ifndef THREAD_LOCAL
+#ifdef ENABLE_THREAD_LOCAL_CONTEXT
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL
+#endif
+#endif
+
 #ifndef N_AXIS
 #define N_AXIS 3 // Number of axes
 #endif
@@ -56,7 +82,7 @@
 #define COMPATIBILITY_LEVEL 0
 #endif
 
-#if (defined(COREXY) || defined(WALL_PLOTTER) || defined(MASLOW_ROUTER)) && !defined(KINEMATICS_API)
+#if (defined(COREXY) || defined(WALL_PLOTTER) || defined(MASLOW_ROUTER) || defined(RTCP_TRUNNION)) && !defined(KINEMATICS_API)
 #define KINEMATICS_API
 #endif
 
@@ -68,6 +94,10 @@
 #define SAFETY_DOOR_SPINDLE_DELAY 4.0f // Float (seconds)
 #endif
 
+#ifndef SPINDLE_AT_SPEED_POLL_INTERVAL
+#define SPINDLE_AT_SPEED_POLL_INTERVAL 10 // ms, interval between checks for spindle at speed on spin up
+#endif
+
 #ifndef SAFETY_DOOR_COOLANT_DELAY
 #define SAFETY_DOOR_COOLANT_DELAY 1.0f // Float (seconds)
 #endif
@@ -76,6 +106,10 @@
 #define SPINDLE_PWM_DIRECT
 #endif
 
+#if defined(ENABLE_LASER_PWM_TRACKING) && !defined(SPINDLE_PWM_DIRECT)
+#error "ENABLE_LASER_PWM_TRACKING requires direct PWM output, SPINDLE_RPM_CONTROLLED must not be defined."
+#endif
+
 #ifndef SLEEP_DURATION
 #define SLEEP_DURATION 5.0f // Number of minutes before sleep mode is entered.
 #endif
@@ -116,6 +150,8 @@
 //#define CMD_DEBUG_REPORT 0x86 // Only when DEBUG enabled, sends debug report in '{}' braces.
 #define CMD_STATUS_REPORT_ALL 0x87
 #define CMD_OPTIONAL_STOP_TOGGLE 0x88
+#define CMD_STATUS_REPORT_BINARY 0x89 // Only when ENABLE_BINARY_STATUS_REPORT is enabled in config.h
+#define CMD_TIMESTAMP 0x8A            // Only when REPORT_TIMESTAMP is enabled in config.h
 #define CMD_OVERRIDE_FEED_RESET 0x90         // Restores feed override value to 100%.
 #define CMD_OVERRIDE_FEED_COARSE_PLUS 0x91
 #define CMD_OVERRIDE_FEED_COARSE_MINUS 0x92
@@ -181,6 +217,9 @@
 
 // #define ENABLE_SPINDLE_LINEARIZATION        // Uncomment to enable spindle RPM linearization. Requires compatible driver if enabled.
 #define SPINDLE_NPWM_PIECES                 4 // Maximum number of pieces for spindle RPM linearization, do not change unless more are needed.
+#ifndef SPINDLE_PWM_LUT_SIZE
+#define SPINDLE_PWM_LUT_SIZE               64 // Number of RPM intervals in the PWM lookup table built for spindle RPM linearization.
+#endif
 #define DEFAULT_SPINDLE_RPM_OVERRIDE      100 // 100%. Don't change this value.
 #define MAX_SPINDLE_RPM_OVERRIDE          200 // Percent of programmed spindle speed (100-255). Usually 200%.
 #define MIN_SPINDLE_RPM_OVERRIDE           10 // Percent of programmed spindle speed (1-100). Usually 10%.
@@ -31,9 +31,13 @@
 #include "override.h"
 #include "protocol.h"
 #include "limits.h"
+#include "motion_control.h"
 #include "report.h"
 #include "state_machine.h"
 #include "nvs_buffer.h"
+#include "pool.h"
+#include "subroutine.h"
+#include "alarm_snapshot.h"
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
@@ -46,18 +50,22 @@
 #include "wall_plotter.h"
 #endif
 
+#ifdef RTCP_TRUNNION
+#include "rtcp.h"
+#endif
+
 // Declare system global variable structure
-system_t sys;
-int32_t sys_position[N_AXIS];               // Real-time machine (aka home) position vector in steps.
-int32_t sys_probe_position[N_AXIS];         // Last probe position in machine coordinates and steps.
-bool prior_mpg_mode;                        // Enter MPG mode on startup?
-bool cold_start = true;
-volatile probing_state_t sys_probing_state; // Probing state value. Used to coordinate the probing cycle with stepper ISR.
-volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
-volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtime executor bitflag variable for setting various alarms.
-
-grbl_t grbl;
-grbl_hal_t hal;
+THREAD_LOCAL system_t sys;
+THREAD_LOCAL int32_t sys_position[N_AXIS];               // Real-time machine (aka home) position vector in steps.
+THREAD_LOCAL int32_t sys_probe_position[N_AXIS];         // Last probe position in machine coordinates and steps.
+THREAD_LOCAL bool prior_mpg_mode;                        // Enter MPG mode on startup?
+THREAD_LOCAL bool cold_start = true;
+THREAD_LOCAL volatile probing_state_t sys_probing_state; // Probing state value. Used to coordinate the probing cycle with stepper ISR.
+THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
+THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtime executor bitflag variable for setting various alarms.
+
+THREAD_LOCAL grbl_t grbl;
+THREAD_LOCAL grbl_hal_t hal;
 
 // called from stream drivers while tx is blocking, return false to terminate
 
@@ -69,12 +77,12 @@ static bool stream_tx_blocking (void)
 
 #ifdef KINEMATICS_API
 
-kinematics_t kinematics;
+THREAD_LOCAL kinematics_t kinematics;
 
 // called from mc_line() to segment lines if not overridden, default implementation for pass-through
 static bool kinematics_segment_line (float *target, plan_line_data_t *pl_data, bool init)
 {
-    static uint_fast8_t iterations;
+    static THREAD_LOCAL uint_fast8_t iterations;
 
     if(init)
         iterations = 2;
@@ -84,6 +92,53 @@ static bool kinematics_segment_line (float *target, plan_line_data_t *pl_data, b
     return iterations != 0;
 }
 
+static kinematics_entry_t cartesian = {
+    .type = Kinematics_Cartesian,
+    .name = "Cartesian"
+};
+
+static kinematics_entry_t *kinematics_registry = &cartesian;
+
+void kinematics_register (kinematics_entry_t *entry)
+{
+    kinematics_entry_t *last = kinematics_registry;
+
+    while(last != entry && last->next)
+        last = last->next;
+
+    if(last != entry && entry->type != Kinematics_Cartesian) {
+        entry->next = NULL;
+        last->next = entry;
+    }
+}
+
+kinematics_entry_t *kinematics_get (kinematics_type_t type)
+{
+    kinematics_entry_t *entry = kinematics_registry;
+
+    while(entry && entry->type != type)
+        entry = entry->next;
+
+    return entry;
+}
+
+bool kinematics_select (kinematics_type_t type)
+{
+    kinematics_entry_t *entry = kinematics_get(type);
+
+    kinematics.convert_array_steps_to_mpos = NULL;
+    kinematics.plan_target_to_steps = NULL;
+    kinematics.limits_get_axis_mask = NULL;
+    kinematics.limits_set_target_pos = NULL;
+    kinematics.limits_set_machine_positions = NULL;
+    kinematics.segment_line = kinematics_segment_line; // default to no segmentation
+
+    if(entry && entry->init)
+        entry->init();
+
+    return entry != NULL;
+}
+
 #endif
 
 #ifdef DEBUGOUT
@@ -93,11 +148,19 @@ static void debug_out (bool on)
 }
 #endif
 
+#ifdef ENABLE_BOOT_TIMING
+// Enqueued after driver setup, runs after any initialization deferred by the driver or plugins.
+static void boot_deferred_completed (uint_fast16_t state)
+{
+    system_boot_timestamp(BootPhase_DeferredInit);
+}
+#endif
+
 // main entry point
 
 int grbl_enter (void)
 {
-#ifdef N_TOOLS
+#if defined(N_TOOLS) && !defined(NVS_TOOL_TABLE_EXTENDED)
     assert(NVS_ADDR_GLOBAL + sizeof(settings_t) + NVS_CRC_BYTES < NVS_ADDR_TOOL_TABLE);
 #else
     assert(NVS_ADDR_GLOBAL + sizeof(settings_t) + NVS_CRC_BYTES < NVS_ADDR_PARAMETERS);
@@ -109,7 +172,7 @@ int grbl_enter (void)
 
     // Clear all and set some core function pointers
     memset(&grbl, 0, sizeof(grbl_t));
-    grbl.on_execute_realtime = protocol_execute_noop;
+    grbl.on_execute_realtime = protocol_execute_rt_tasks;
     grbl.protocol_enqueue_gcode = protocol_enqueue_gcode;
     grbl.on_report_options = dummy_handler;
 
@@ -123,9 +186,15 @@ int grbl_enter (void)
     hal.stream.enqueue_realtime_command = protocol_enqueue_realtime_command;
     hal.limits.interrupt_callback = limit_interrupt_handler;
     hal.control.interrupt_callback = control_interrupt_handler;
+    hal.probe.interrupt_callback = probe_interrupt_handler;
     hal.stepper.interrupt_callback = stepper_driver_interrupt_handler;
+    hal.stepper.prep_callback = st_prep_buffer_irq;
+    hal.stepper.position_callback = st_sample_position;
     hal.stream_blocking_callback = stream_tx_blocking;
 
+    protocol_init();
+    init_override_buffers();
+
 #ifdef BUFFER_NVSDATA
     nvs_buffer_alloc(); // Allocate memory block for NVS buffer
 #endif
@@ -136,6 +205,16 @@ int grbl_enter (void)
     memset(&kinematics, 0, sizeof(kinematics_t));
 
     kinematics.segment_line = kinematics_segment_line; // default to no segmentation
+
+  #ifdef COREXY
+    corexy_init();
+  #endif
+  #ifdef WALL_PLOTTER
+    wall_plotter_init();
+  #endif
+  #ifdef RTCP_TRUNNION
+    rtcp_init();
+  #endif
 #endif
 
 #ifdef DEBUGOUT
@@ -143,6 +222,14 @@ int grbl_enter (void)
 #endif
     driver_ok = driver_init();
 
+#ifdef ENABLE_ALARM_SNAPSHOT
+    alarm_snapshot_init(); // Allocate NVS storage after the driver and its plugins
+#endif
+
+#ifdef ENABLE_BOOT_TIMING
+    system_boot_timestamp(BootPhase_DriverInit);
+#endif
+
 #if COMPATIBILITY_LEVEL > 0
     hal.stream.suspend_read = NULL;
 #endif
@@ -155,8 +242,14 @@ int grbl_enter (void)
 
   #ifdef BUFFER_NVSDATA
     nvs_buffer_init();
+  #endif
+  #ifdef ENABLE_BOOT_TIMING
+    system_boot_timestamp(BootPhase_NVSLoaded);
   #endif
     settings_init(); // Load Grbl settings from non-volatile storage
+  #ifdef ENABLE_BOOT_TIMING
+    system_boot_timestamp(BootPhase_SettingsLoaded);
+  #endif
 
     memset(sys_position, 0, sizeof(sys_position)); // Clear machine position.
 
@@ -181,6 +274,11 @@ int grbl_enter (void)
 
     driver_ok = driver_ok && hal.driver_setup(&settings);
 
+#ifdef ENABLE_BOOT_TIMING
+    system_boot_timestamp(BootPhase_DriverSetup);
+    protocol_enqueue_rt_command(boot_deferred_completed);
+#endif
+
 #ifdef ENABLE_SPINDLE_LINEARIZATION
     driver_ok = driver_ok && hal.driver_cap.spindle_pwm_linearization;
 #endif
@@ -194,15 +292,19 @@ int grbl_enter (void)
         while(true);
     }
 
+    // Allocate planner block buffer, size is set by $398.
+    if(!plan_reset()) {
+        hal.stream.write("GrblHAL: failed to allocate planner buffer" ASCII_EOL);
+        while(true);
+    }
+
     if(hal.get_position)
         hal.get_position(&sys_position); // TODO:  restore on abort when returns true?
 
-#ifdef COREXY
-    corexy_init();
-#endif
-
-#ifdef WALL_PLOTTER
-    wall_plotter_init();
+#ifdef KINEMATICS_API
+    if(!kinematics_select(settings.kinematics)) {
+        hal.stream.write("GrblHAL: selected kinematics not available, using Cartesian" ASCII_EOL);
+    }
 #endif
 
     // Grbl initialization loop upon power-up or a system abort. For the latter, all processes
@@ -232,12 +334,18 @@ int grbl_enter (void)
 
         flush_override_buffers();
 
+        settings_abort_transaction(); // Discard any uncommitted bulk settings changes.
+
         // Reset Grbl primary systems.
         hal.stream.reset_read_buffer(); // Clear input stream buffer
         gc_init(cold_start); // Set g-code parser to default state
         hal.limits.enable(settings.limits.flags.hard_enabled, false);
         plan_reset(); // Clear block buffer and planner variables
         st_reset(); // Clear stepper subsystem variables.
+        pool_reset(); // Release any message and output command entries still held.
+#ifdef ENABLE_SUBROUTINES
+        subroutine_reset(); // Discard subroutines and any body being recorded.
+#endif
         limits_set_homing_axes(); // Set axes to be homed from settings.
 #ifdef ENABLE_BACKLASH_COMPENSATION
         mc_backlash_init(); // Init backlash configuration.
@@ -254,6 +362,11 @@ int grbl_enter (void)
         // Print welcome message. Indicates an initialization has occured at power-up or with a reset.
         report_init_message();
 
+#ifdef ENABLE_BOOT_TIMING
+        if(cold_start)
+            system_boot_timestamp(BootPhase_Ready);
+#endif
+
         if(sys.state == STATE_ESTOP)
             set_state(STATE_ALARM);
 
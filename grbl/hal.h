@@ -68,7 +68,9 @@ typedef union {
                  probe_connected           :1,
                  atc                       :1,
                  no_gcode_message_handling :1,
-                 unassigned                :4;
+                 probe_latch               :1,
+                 step_pulse_delay_dir_only :1, // step_pulse_delay is only applied to the first step after a direction change
+                 unassigned                :2;
     };
 } driver_cap_t;
 
@@ -77,6 +79,7 @@ typedef void (*driver_reset_ptr)(void);
 // I/O stream
 
 typedef void (*stream_write_ptr)(const char *s);
+typedef uint16_t (*stream_read_block_ptr)(char *buf, uint16_t size);
 typedef bool (*enqueue_realtime_command_ptr)(char data);
 
 typedef struct {
@@ -86,20 +89,34 @@ typedef struct {
     stream_write_ptr write;     // write string to current I/O stream only.
     stream_write_ptr write_all; // write string to all active output streams.
     int16_t (*read)(void);
+    stream_read_block_ptr read_block; // optional, copies received characters up to and including the first end of line character.
     void (*reset_read_buffer)(void);
     void (*cancel_read_buffer)(void);
     bool (*suspend_read)(bool await);
     enqueue_realtime_command_ptr enqueue_realtime_command; // NOTE: set by grbl at startup.
+    stream_write_ptr write_realtime; // optional, write real-time status report to a dedicated channel, e.g. a second USB interface.
 } io_stream_t;
 
+typedef enum {
+    IRQ_Mode_None = 0,
+    IRQ_Mode_Rising,
+    IRQ_Mode_Falling
+} pin_irq_mode_t;
+
+typedef void (*ioport_interrupt_callback_ptr)(uint8_t port, bool state);
+
 typedef struct {
     uint8_t num_digital_in;
     uint8_t num_digital_out;
     uint8_t num_analog_in;
     uint8_t num_analog_out;
     void (*digital_out)(uint8_t port, bool on);
+    void (*digital_out_mask)(uint32_t mask, uint32_t value); // Optional, sets the ports in mask to the corresponding value bits in a single write.
     bool (*analog_out)(uint8_t port, float value);
     int32_t (*wait_on_input)(bool digital, uint8_t port, wait_mode_t wait_mode, float timeout);
+    // Optional, arms an edge interrupt on a digital input, the callback is called from the interrupt context.
+    // IRQ_Mode_None disarms it. Returns false if not supported for the port.
+    bool (*register_interrupt_handler)(uint8_t port, pin_irq_mode_t irq_mode, ioport_interrupt_callback_ptr interrupt_callback);
 } io_port_t;
 
 // Spindle
@@ -174,6 +191,8 @@ typedef void (*stepper_pulse_start_ptr)(stepper_t *stepper);
 typedef void (*stepper_output_step_ptr)(axes_signals_t step_outbits, axes_signals_t dir_outbits);
 typedef axes_signals_t (*stepper_get_auto_squared_ptr)(void);
 typedef void (*stepper_interrupt_callback_ptr)(void);
+typedef void (*stepper_prep_trigger_ptr)(void);
+typedef bool (*stepper_position_callback_ptr)(uint32_t cycles, float *position);
 
 typedef struct {
     stepper_wake_up_ptr wake_up;
@@ -183,11 +202,34 @@ typedef struct {
     stepper_cycles_per_tick_ptr cycles_per_tick;
     stepper_pulse_start_ptr pulse_start;
     stepper_interrupt_callback_ptr interrupt_callback; // set up by core before driver_init() is called.
+    stepper_interrupt_callback_ptr prep_callback; // set up by core before driver_init() is called.
+    stepper_position_callback_ptr position_callback; // set up by core before driver_init() is called. For drivers commanding servo drives by position instead of step pulses,
+                                                     // to be called at a fixed rate instead of interrupt_callback, see st_sample_position().
     // Optional entry points:
     stepper_get_auto_squared_ptr get_auto_squared;
     stepper_output_step_ptr output_step;
+    stepper_prep_trigger_ptr prep_trigger; // Pend a low priority interrupt (or wake a task) that calls prep_callback. Enables interrupt driven segment prep.
 } stepper_ptrs_t;
 
+// Auxiliary axis steppers (optional)
+
+typedef void (*aux_stepper_start_ptr)(uint32_t tick_rate);
+typedef void (*aux_stepper_stop_ptr)(void);
+typedef void (*aux_stepper_output_step_ptr)(uint8_t step_outbits, uint8_t dir_outbits);
+typedef void (*aux_stepper_interrupt_callback_ptr)(void);
+
+// NOTE: Auxiliary axes are stepped from a separate timer interrupt running at a fixed tick rate, independent of
+//       the main stepper interrupt which it must not preempt. output_step is called from the interrupt callback,
+//       bit 0 is the first auxiliary axis. The direction outputs must be set before the step pulses are started,
+//       the step pulse length is the same as for the main axes. Step pulses are at least one tick apart.
+typedef struct {
+    uint8_t n_axis;                                 // Number of auxiliary step/direction outputs available, 0 if none.
+    aux_stepper_start_ptr start;                    // Start the timer, interrupt_callback is to be called at tick_rate Hz.
+    aux_stepper_stop_ptr stop;                      // Stop the timer.
+    aux_stepper_output_step_ptr output_step;
+    aux_stepper_interrupt_callback_ptr interrupt_callback; // set up by the plugin claiming the auxiliary axes.
+} aux_stepper_ptrs_t;
+
 // Driver/plugin settings (optional)
 
 typedef status_code_t (*driver_setting_ptr)(setting_type_t setting, float value, char *svalue);
@@ -212,19 +254,32 @@ typedef struct {
 typedef probe_state_t (*probe_get_state_ptr)(void);
 typedef void (*probe_configure_ptr)(bool is_probe_away, bool probing);
 typedef void (*probe_connected_toggle_ptr)(void);
+typedef void (*probe_interrupt_callback_ptr)(void);
 
+// NOTE: Drivers setting hal.driver_cap.probe_latch must call interrupt_callback at the trigger edge when probing,
+//       e.g. from a pin change interrupt or a timer input capture interrupt. The stepper interrupt then does not
+//       poll the probe state. The interrupt must not preempt the stepper interrupt.
 typedef struct {
     probe_configure_ptr configure;
     probe_get_state_ptr get_state;
     probe_connected_toggle_ptr connected_toggle;
+    probe_interrupt_callback_ptr interrupt_callback; // set up by core before driver_init() is called.
 } probe_ptrs_t;
 
 typedef void (*tool_select_ptr)(tool_data_t *tool, bool next);
 typedef status_code_t (*tool_change_ptr)(parser_state_t *gc_state);
-
+typedef status_code_t (*tool_prepare_ptr)(parser_state_t *gc_state);
+
+// NOTE: select is called when a T word is parsed, the previous motion may still be executing. next is true if a M6 is
+//       to follow. An ATC may start preparations that do not involve motion, eg. carousel rotation, from this call.
+//       prepare is optional and called on M6 before the planner buffer is synchronized, the previous motion may still be
+//       executing. It may queue motion to the tool change position that is executed without stopping first,
+//       gc_state->tool is the current tool and gc_state->tool_pending the next. change is called when all motion has
+//       been executed and performs the actual tool swap.
 typedef struct {
     tool_select_ptr select;
     tool_change_ptr change;
+    tool_prepare_ptr prepare;
 } tool_ptrs_t;
 
 // User M-codes (optional)
@@ -243,12 +298,22 @@ typedef struct {
 
 typedef void (*encoder_on_event_ptr)(encoder_t *encoder, int32_t position);
 typedef void (*encoder_reset_ptr)(uint_fast8_t id);
+typedef int32_t (*encoder_get_count_ptr)(uint_fast8_t id);
 
 typedef struct {
     encoder_on_event_ptr on_event;
     encoder_reset_ptr reset;
+    encoder_get_count_ptr get_count; // Optional, returns the current count, required for motor encoders.
 } encoder_ptrs_t;
 
+// Memory usage (optional)
+
+typedef struct {
+    uint32_t heap_free;     // Free bytes in the heap arena
+    uint32_t stack_used;    // Stack high-water mark in bytes, from stack painting. 0 if not available.
+    uint32_t unused;        // Bytes between the top of the heap and the stack high-water mark, never used by either
+} memory_info_t;
+
 //
 
 // main HAL structure
@@ -284,8 +349,12 @@ typedef struct {
     bool (*driver_release)(void);
     bool (*get_position)(int32_t (*position)[N_AXIS]);
     uint32_t (*get_elapsed_ticks)(void);
+    uint32_t (*get_cycle_count)(void); // Free running CPU cycle counter, e.g. DWT CYCCNT on Cortex-M. Used for stepper interrupt load measurement.
+    uint32_t (*get_micros)(void); // Free running microsecond counter, optional. Used for report timestamps.
+    void (*idle_wait)(void); // Called by the main loop when there is no work pending. Should wait for an interrupt (e.g. WFI) or yield to other tasks, must return on any interrupt including the systick.
     void (*pallet_shuttle)(void);
     void (*reboot)(void);
+    bool (*get_memory_info)(memory_info_t *info); // Returns free heap and stack high-water mark, used by the $SM command.
 #ifdef DEBUGOUT
     void (*debug_out)(bool on);
 #endif
@@ -296,6 +365,7 @@ typedef struct {
     driver_setting_ptrs_t driver_settings;
     tool_ptrs_t tool;
     encoder_ptrs_t encoder;
+    aux_stepper_ptrs_t aux_stepper;
     nvs_io_t nvs;
     io_port_t port;
 
@@ -342,10 +412,14 @@ typedef struct {
 typedef void (*on_state_change_ptr)(uint_fast16_t state);
 typedef void (*on_probe_completed_ptr)(void);
 typedef void (*on_program_completed_ptr)(program_flow_t program_flow);
+typedef void (*on_block_completed_ptr)(plan_block_t *block);
 typedef void (*on_execute_realtime_ptr)(uint_fast16_t state);
+typedef void (*on_execute_realtime_data_ptr)(uint_fast16_t state, void *data);
 typedef void (*on_unknown_accessory_override_ptr)(uint8_t cmd);
 typedef void (*on_report_options_ptr)(void);
 typedef void (*on_realtime_report_ptr)(stream_write_ptr stream_write, report_tracking_flags_t report);
+typedef void (*report_binary_field_ptr)(uint8_t type, const void *data, uint8_t length);
+typedef void (*on_realtime_report_binary_ptr)(report_binary_field_ptr add_field, report_tracking_flags_t report);
 typedef void (*on_unknown_feedback_message_ptr)(stream_write_ptr stream_write);
 typedef bool (*on_laser_ppi_enable_ptr)(uint_fast16_t ppi, uint_fast16_t pulse_length);
 typedef status_code_t (*on_unknown_sys_command_ptr)(uint_fast16_t state, char *line, char *lcline); // return Status_Unhandled.
@@ -358,10 +432,12 @@ typedef struct {
     on_state_change_ptr on_state_change;
     on_probe_completed_ptr on_probe_completed;
     on_program_completed_ptr on_program_completed;
+    on_block_completed_ptr on_block_completed; // Called by segment prep when all steps of a planner block are queued for execution, may be called from an interrupt context.
     on_execute_realtime_ptr on_execute_realtime;
     on_unknown_accessory_override_ptr on_unknown_accessory_override;
     on_report_options_ptr on_report_options;
     on_realtime_report_ptr on_realtime_report;
+    on_realtime_report_binary_ptr on_realtime_report_binary; // Only called when ENABLE_BINARY_STATUS_REPORT is enabled
     on_unknown_feedback_message_ptr on_unknown_feedback_message;
     on_unknown_sys_command_ptr on_unknown_sys_command; // return Status_Unhandled if not handled.
     on_user_command_ptr on_user_command;
@@ -370,8 +446,8 @@ typedef struct {
     bool (*protocol_enqueue_gcode)(char *data);
 } grbl_t;
 
-extern grbl_t grbl;
-extern grbl_hal_t hal;
+extern THREAD_LOCAL grbl_t grbl;
+extern THREAD_LOCAL grbl_hal_t hal;
 extern bool driver_init (void);
 
 #endif
@@ -0,0 +1,372 @@
+/*
+  height_map.c - surface height map probing and Z compensation
+
+  Probes a grid on the controller and applies bilinear interpolated Z corrections to line motions
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "hal.h"
+#include "motion_control.h"
+#include "protocol.h"
+#include "height_map.h"
+
+#ifdef ENABLE_HEIGHT_MAP
+
+// Grid origin and spacing are in machine coordinates, heights are relative to the first probed point.
+typedef struct {
+    bool enabled;
+    bool busy;                  // Set while segments are being queued, blocks recursion from mc_line()
+    uint_fast16_t nx;
+    uint_fast16_t ny;
+    float x0;
+    float y0;
+    float dx;
+    float dy;
+    float z[HEIGHT_MAP_POINTS_MAX];
+} height_map_t;
+
+static THREAD_LOCAL height_map_t map = {0};
+
+// Returns the bilinear interpolated height at x,y, the edge heights are held outside the grid.
+static float get_height (float x, float y)
+{
+    float fx = (x - map.x0) / map.dx, fy = (y - map.y0) / map.dy;
+
+    fx = fx < 0.0f ? 0.0f : (fx > (float)(map.nx - 1) ? (float)(map.nx - 1) : fx);
+    fy = fy < 0.0f ? 0.0f : (fy > (float)(map.ny - 1) ? (float)(map.ny - 1) : fy);
+
+    uint_fast16_t ix = min((uint_fast16_t)fx, map.nx - 2), iy = min((uint_fast16_t)fy, map.ny - 2);
+    float *z = &map.z[iy * map.nx + ix];
+
+    fx -= (float)ix;
+    fy -= (float)iy;
+
+    return (z[0] + (z[1] - z[0]) * fx) * (1.0f - fy) + (z[map.nx] + (z[map.nx + 1] - z[map.nx]) * fx) * fy;
+}
+
+// Sets g-code parser position in mm from steps with the height correction removed, see gc_sync_position().
+void height_map_sync_position (float *position, int32_t *steps)
+{
+    system_convert_array_steps_to_mpos(position, steps);
+
+    if(map.enabled)
+        position[Z_AXIS] -= get_height(position[X_AXIS], position[Y_AXIS]);
+}
+
+bool height_map_compensate (plan_line_data_t *pl_data)
+{
+    return map.enabled && !map.busy && !(pl_data->condition.jog_motion || pl_data->condition.system_motion);
+}
+
+// Returns the height at parameter t (0 - 1) along the motion.
+inline static float height_along (float *start, float *delta, float t)
+{
+    return get_height(start[X_AXIS] + delta[X_AXIS] * t, start[Y_AXIS] + delta[Y_AXIS] * t);
+}
+
+// Returns the parameter (0 - 1) along the motion of the next grid line crossing after t, 1.0f if none.
+static float next_crossing (float *start, float *delta, float t)
+{
+    uint_fast8_t i;
+    float t_next = 1.0f;
+
+    for(i = 0; i < 2; i++) {
+
+        float step = delta[i] / (i == X_AXIS ? map.dx : map.dy), g, last = (float)((i == X_AXIS ? map.nx : map.ny) - 1);
+
+        if(step != 0.0f) {
+
+            float f0 = (start[i] - (i == X_AXIS ? map.x0 : map.y0)) / (i == X_AXIS ? map.dx : map.dy), f = f0 + step * t;
+
+            // Grid units, grid lines are at integer values from 0 to nx - 1 or ny - 1.
+            if(step > 0.0f) {
+                g = f < 0.0f ? 0.0f : floorf(f + 0.0001f) + 1.0f;
+                if(g <= last && (g = (g - f0) / step) > t && g < t_next)
+                    t_next = g;
+            } else {
+                g = f > last ? last : ceilf(f - 0.0001f) - 1.0f;
+                if(g >= 0.0f && (g = (g - f0) / step) > t && g < t_next)
+                    t_next = g;
+            }
+        }
+    }
+
+    return t_next;
+}
+
+// Queues the segment ending at parameter t along the motion with the interpolated height added to its Z target.
+static bool queue_segment (float *target, float *start, float *delta, float t_start, float t, plan_line_data_t *pl_data, float feed_rate)
+{
+    uint_fast8_t idx;
+    float segment_target[N_AXIS];
+
+    if(t >= 1.0f)
+        memcpy(segment_target, target, sizeof(segment_target));
+    else for(idx = 0; idx < N_AXIS; idx++)
+        segment_target[idx] = start[idx] + delta[idx] * t;
+
+    segment_target[Z_AXIS] += get_height(segment_target[X_AXIS], segment_target[Y_AXIS]);
+
+    // The inverse feed rate must be correct for the sum of all segments.
+    if(pl_data->condition.inverse_time)
+        pl_data->feed_rate = feed_rate / (t - t_start);
+
+    return mc_line(segment_target, pl_data);
+}
+
+// The height along the motion is piecewise quadratic between grid line crossings. Segments end at crossings, and
+// within cells where the surface twists, only where the chord from the start of the segment deviates more than
+// HEIGHT_MAP_TOLERANCE from the surface. Long motions over flat or linearly sloping areas thus stay unsplit.
+bool height_map_line (float *target, plan_line_data_t *pl_data)
+{
+    bool ok = true;
+    bool curved;
+    uint_fast8_t idx, tests = 0;
+    uint_fast16_t piece, pieces;
+    float position[N_AXIS], delta[N_AXIS], t_test[HEIGHT_MAP_TESTS_MAX];
+    float t_start = 0.0f, t_end = 0.0f, t_next, t_candidate, t_step, h_start, h_end, deviation, feed_rate = pl_data->feed_rate;
+
+    // The correction only depends on the XY position, its removal from the planner position is thus exact.
+    plan_get_planner_mpos(position);
+    position[Z_AXIS] -= get_height(position[X_AXIS], position[Y_AXIS]);
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        delta[idx] = target[idx] - position[idx];
+
+    h_start = h_end = get_height(position[X_AXIS], position[Y_AXIS]);
+
+    map.busy = true;
+
+    while(ok && t_end < 1.0f) {
+
+        t_next = next_crossing(position, delta, t_end);
+
+        // The deviation of a quadratic from its chord scales with the square of the chord length.
+        deviation = fabsf(height_along(position, delta, (t_end + t_next) * 0.5f) - (h_end + height_along(position, delta, t_next)) * 0.5f);
+        pieces = deviation > HEIGHT_MAP_TOLERANCE ? (uint_fast16_t)ceilf(sqrtf(deviation / HEIGHT_MAP_TOLERANCE)) : 1;
+        t_step = (t_next - t_end) / (float)pieces;
+        // Midpoints of linear pieces are on the chord between their end points and need not be checked.
+        curved = deviation > HEIGHT_MAP_TOLERANCE * 0.01f;
+
+        for(piece = 1; ok && piece <= pieces; piece++) {
+
+            bool fits = true;
+            uint_fast8_t n = tests;
+            float h_candidate;
+
+            t_candidate = piece == pieces ? t_next : t_end + t_step;
+            h_candidate = height_along(position, delta, t_candidate);
+
+            if(t_end > t_start)
+                t_test[n++] = t_end;
+            if(curved)
+                t_test[n++] = (t_end + t_candidate) * 0.5f;
+
+            // Check if the chord from the segment start can be extended to the candidate end.
+            for(idx = 0; fits && idx < n; idx++)
+                fits = fabsf(height_along(position, delta, t_test[idx]) - (h_start + (h_candidate - h_start) * (t_test[idx] - t_start) / (t_candidate - t_start))) <= HEIGHT_MAP_TOLERANCE;
+
+            if(!fits && t_end > t_start) {
+                ok = queue_segment(target, position, delta, t_start, t_end, pl_data, feed_rate);
+                t_start = t_end;
+                h_start = h_end;
+                if((tests = curved ? 1 : 0))
+                    t_test[0] = (t_end + t_candidate) * 0.5f;
+            } else
+                tests = n;
+
+            t_end = t_candidate;
+            h_end = h_candidate;
+
+            if(ok && tests >= HEIGHT_MAP_TESTS_MAX - 2 && t_end < 1.0f) {
+                ok = queue_segment(target, position, delta, t_start, t_end, pl_data, feed_rate);
+                t_start = t_end;
+                h_start = h_end;
+                tests = 0;
+            }
+        }
+    }
+
+    if(ok)
+        ok = queue_segment(target, position, delta, t_start, 1.0f, pl_data, feed_rate);
+
+    pl_data->feed_rate = feed_rate;
+    map.busy = false;
+
+    return ok;
+}
+
+// Reads the next comma separated value from the $M= command line.
+static bool get_parameter (char *line, uint_fast8_t *counter, float *value)
+{
+    if(*counter > 0 && line[(*counter)++] != ',')
+        return false;
+
+    return read_float(line, counter, value);
+}
+
+status_code_t height_map_probe (char *line)
+{
+    bool ok;
+    uint_fast8_t counter = 0, idx = 0;
+    uint_fast16_t ix, iy, nx, ny;
+    float values[9], z_clearance, z_depth, x0, y0;
+    float target[N_AXIS];
+    gc_parser_flags_t flags = {0};
+    plan_line_data_t plan_data = {0};
+
+    do {
+        if(!get_parameter(line, &counter, &values[idx]))
+            return Status_BadNumberFormat;
+    } while(++idx < sizeof(values) / sizeof(float));
+
+    if(line[counter] != '\0')
+        return Status_InvalidStatement;
+
+    nx = (uint_fast16_t)values[4];
+    ny = (uint_fast16_t)values[5];
+
+    if(values[4] != (float)nx || values[5] != (float)ny)
+        return Status_GcodeCommandValueNotInteger;
+
+    if(nx < 2 || ny < 2 || nx * ny > HEIGHT_MAP_POINTS_MAX || values[0] == values[2] || values[1] == values[3] ||
+        values[6] <= values[7])
+        return Status_GcodeValueOutOfRange;
+
+    if(values[8] <= 0.0f)
+        return Status_NonPositiveValue;
+
+    // Probe without compensation, the grid is stored in machine coordinates.
+    height_map_clear();
+
+    x0 = values[0] + gc_get_offset(X_AXIS);
+    y0 = values[1] + gc_get_offset(Y_AXIS);
+    z_clearance = values[6] + gc_get_offset(Z_AXIS);
+    z_depth = values[7] + gc_get_offset(Z_AXIS);
+    map.dx = (values[2] - values[0]) / (float)(nx - 1);
+    map.dy = (values[3] - values[1]) / (float)(ny - 1);
+
+    // Get current position and move to clearance height.
+    system_convert_array_steps_to_mpos(target, sys_position);
+    plan_data.condition.rapid_motion = On;
+    target[Z_AXIS] = z_clearance;
+    ok = mc_line(target, &plan_data);
+
+    // Report the map once when done, not the individual probe positions.
+    bool probe_coordinates = settings.status_report.probe_coordinates;
+    settings.status_report.probe_coordinates = Off;
+
+    // Traverse the grid in serpentine order, rows along the X axis.
+    for(iy = 0; ok && iy < ny; iy++) {
+        for(idx = 0; ok && idx < nx; idx++) {
+
+            ix = iy & 1 ? nx - 1 - idx : idx;
+
+            plan_data.condition.value = 0;
+            plan_data.condition.rapid_motion = On;
+            target[X_AXIS] = x0 + map.dx * (float)ix;
+            target[Y_AXIS] = y0 + map.dy * (float)iy;
+
+            if((ok = mc_line(target, &plan_data))) {
+
+                plan_data.condition.value = 0;
+                plan_data.feed_rate = values[8];
+                target[Z_AXIS] = z_depth;
+
+                if((ok = mc_probe_cycle(target, &plan_data, flags) == GCProbe_Found)) {
+
+                    float position[N_AXIS];
+
+                    system_convert_array_steps_to_mpos(position, sys_probe_position);
+                    map.z[iy * nx + ix] = position[Z_AXIS];
+
+                    plan_data.condition.rapid_motion = On;
+                    target[Z_AXIS] = z_clearance;
+                    ok = mc_line(target, &plan_data);
+                }
+            }
+        }
+    }
+
+    settings.status_report.probe_coordinates = probe_coordinates;
+
+    if((ok = ok && protocol_buffer_synchronize())) {
+
+        for(idx = 1; idx < nx * ny; idx++)
+            map.z[idx] -= map.z[0];
+        map.z[0] = 0.0f;
+
+        map.nx = nx;
+        map.ny = ny;
+        map.x0 = x0;
+        map.y0 = y0;
+        map.enabled = true;
+
+        sync_position();
+        height_map_report();
+    }
+
+    return ok ? Status_OK : Status_GCodeToolError;
+}
+
+void height_map_clear (void)
+{
+    map.enabled = false;
+    map.nx = map.ny = 0;
+
+    gc_sync_position();
+}
+
+void height_map_report (void)
+{
+    uint_fast16_t ix, iy;
+
+    hal.stream.write("[HEIGHTMAP:");
+    hal.stream.write(uitoa((uint32_t)map.nx));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)map.ny));
+
+    if(map.enabled) {
+        hal.stream.write(",");
+        hal.stream.write(ftoa(map.x0, N_DECIMAL_COORDVALUE_MM));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(map.y0, N_DECIMAL_COORDVALUE_MM));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(map.dx, N_DECIMAL_COORDVALUE_MM));
+        hal.stream.write(",");
+        hal.stream.write(ftoa(map.dy, N_DECIMAL_COORDVALUE_MM));
+    }
+
+    hal.stream.write("]" ASCII_EOL);
+
+    for(iy = 0; iy < map.ny; iy++) {
+        hal.stream.write("[HEIGHTMAPROW:");
+        hal.stream.write(uitoa((uint32_t)iy));
+        for(ix = 0; ix < map.nx; ix++) {
+            hal.stream.write(ix ? "," : ":");
+            hal.stream.write(ftoa(map.z[iy * map.nx + ix], N_DECIMAL_COORDVALUE_MM));
+        }
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+  height_map.h - surface height map probing and Z compensation
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HEIGHT_MAP_H_
+#define _HEIGHT_MAP_H_
+
+#include "planner.h"
+
+#ifdef ENABLE_HEIGHT_MAP
+
+// Maximum number of grid points in the height map, each point takes 4 bytes of RAM.
+#ifndef HEIGHT_MAP_POINTS_MAX
+#define HEIGHT_MAP_POINTS_MAX 256
+#endif
+
+// Maximum deviation in mm of a segment from the interpolated surface, longer motions are only split where exceeded.
+#ifndef HEIGHT_MAP_TOLERANCE
+#define HEIGHT_MAP_TOLERANCE 0.002f
+#endif
+
+// Maximum number of points along a segment checked against the surface, a segment is ended when reached.
+#ifndef HEIGHT_MAP_TESTS_MAX
+#define HEIGHT_MAP_TESTS_MAX 32
+#endif
+
+// Probes a grid and enables compensation if successful, called by the $M=x0,y0,x1,y1,nx,ny,clearance,depth,feed command.
+// Parameters are in work coordinates, probing starts at x0,y0 and the heights are stored relative to that point.
+status_code_t height_map_probe (char *line);
+
+// Disables compensation and clears the height map, called by the $MC command.
+void height_map_clear (void);
+
+// Outputs the height map, called by the $M command.
+void height_map_report (void);
+
+// Returns true if the motion is to be compensated, motions are then to be passed to height_map_line().
+bool height_map_compensate (plan_line_data_t *pl_data);
+
+// Splits a line motion into segments following the surface and adds the interpolated height to their Z targets.
+bool height_map_line (float *target, plan_line_data_t *pl_data);
+
+#endif
+
+#endif
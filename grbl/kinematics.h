@@ -22,6 +22,16 @@
 #ifndef _KINEMATICS_H_
 #define _KINEMATICS_H_
 
+// Line segmentation instrumentation data, updated by mc_line().
+typedef struct {
+    uint32_t moves;                 // Number of moves passed to segment_line()
+    uint32_t segments;              // Total number of segments output
+    uint_fast16_t segments_last;    // Number of segments output for the last move
+    uint_fast16_t segments_max;     // Max number of segments output for a single move
+} kinematics_stats_t;
+
+// Kinematics entry points. All are NULL when Cartesian kinematics is selected, the core then uses
+// inlined Cartesian code instead, segment_line is always set.
 typedef struct {
     void (*convert_array_steps_to_mpos)(float *position, int32_t *steps);
     void (*plan_target_to_steps) (int32_t *target_steps, float *target);
@@ -29,8 +39,28 @@ typedef struct {
     uint_fast8_t (*limits_get_axis_mask)(uint_fast8_t idx);
     void (*limits_set_target_pos)(uint_fast8_t idx);
     void (*limits_set_machine_positions)(axes_signals_t cycle);
+    kinematics_stats_t stats;
 } kinematics_t;
 
-extern kinematics_t kinematics;
+// Kinematics registry entry, init() sets the kinematics entry points when selected.
+typedef struct kinematics_entry {
+    kinematics_type_t type;
+    const char *name;
+    void (*init)(void);
+    struct kinematics_entry *next;
+} kinematics_entry_t;
+
+extern THREAD_LOCAL kinematics_t kinematics;
+
+#define kinematics_is_cartesian() (kinematics.plan_target_to_steps == NULL)
+
+// Adds kinematics to the registry, called by kinematics init functions on startup.
+void kinematics_register (kinematics_entry_t *entry);
+
+// Returns the registry entry for the kinematics type, NULL if not available.
+kinematics_entry_t *kinematics_get (kinematics_type_t type);
+
+// Selects the kinematics to use, called on startup with the type set by $397. Cartesian is selected if the type is not available.
+bool kinematics_select (kinematics_type_t type);
 
 #endif
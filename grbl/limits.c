@@ -57,6 +57,48 @@
 // special pinout for an e-stop, but it is generally recommended to just directly connect
 // your e-stop switch to the microcontroller reset pin, since it is the most correct way to do this.
 
+#if LIMITS_FILTER_SAMPLES
+
+static volatile struct {
+    bool armed;
+    uint_fast8_t samples;
+    uint32_t edge_ms;
+} filter = {0};
+
+static limits_filter_stats_t filter_stats = {0};
+
+// Called by the driver from a periodic timer interrupt, normally the 1 ms systick.
+// Hard limits are tripped when the limit inputs has been read as active for LIMITS_FILTER_SAMPLES consecutive
+// samples after a pin change interrupt, a pulse shorter than that is counted as a glitch and ignored.
+ISR_CODE void limits_filter_sample (void)
+{
+    if(filter.armed) {
+
+        if(hal.limits.get_state().value) {
+            if(++filter.samples >= LIMITS_FILTER_SAMPLES) {
+                filter.armed = false;
+                filter_stats.trips++;
+                filter_stats.latency_last = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() - filter.edge_ms : 0;
+                filter_stats.latency_max = max(filter_stats.latency_max, filter_stats.latency_last);
+                if (!(sys.state & (STATE_ALARM|STATE_ESTOP)) && !sys_rt_exec_alarm) {
+                    mc_reset(); // Initiate system kill.
+                    system_set_exec_alarm(Alarm_HardLimit); // Indicate hard limit critical event
+                }
+            }
+        } else {
+            filter.armed = false;
+            filter_stats.glitches++;
+        }
+    }
+}
+
+limits_filter_stats_t *limits_filter_get_stats (void)
+{
+    return &filter_stats;
+}
+
+#endif
+
 ISR_CODE void limit_interrupt_handler (axes_signals_t state) // DEFAULT: Limit pin change interrupt process.
 {
     // Ignore limit switches if already in an alarm state or in-process of executing an alarm.
@@ -67,7 +109,14 @@ ISR_CODE void limit_interrupt_handler (axes_signals_t state) // DEFAULT: Limit p
 
     if (!(sys.state & (STATE_ALARM|STATE_ESTOP)) && !sys_rt_exec_alarm) {
 
-      #ifdef HARD_LIMIT_FORCE_STATE_CHECK
+      #if LIMITS_FILTER_SAMPLES
+        // Start sampling the inputs, the alarm is raised by limits_filter_sample() when the trigger is confirmed.
+        if(!filter.armed) {
+            filter.samples = 0;
+            filter.edge_ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+            filter.armed = true;
+        }
+      #elif defined(HARD_LIMIT_FORCE_STATE_CHECK)
         // Check limit pin state.
         if (state.value) {
             mc_reset(); // Initiate system kill.
@@ -80,7 +129,6 @@ ISR_CODE void limit_interrupt_handler (axes_signals_t state) // DEFAULT: Limit p
     }
 }
 
-#ifndef KINEMATICS_API
 // Set machine positions for homed limit switches. Don't update non-homed axes.
 // NOTE: settings.max_travel[] is stored as a negative value.
 void limits_set_machine_positions (axes_signals_t cycle, bool add_pulloff)
@@ -104,6 +152,15 @@ void limits_set_machine_positions (axes_signals_t cycle, bool add_pulloff)
         }
     } while(idx);
 }
+
+#ifdef ENABLE_HOMING_AXIS_RATES
+// Returns homing seek or feed rate for axis, common rate if not set for the axis.
+static inline float homing_axis_rate (uint_fast8_t idx, bool seek)
+{
+    float rate = seek ? settings.axis[idx].homing_seek_rate : settings.axis[idx].homing_feed_rate;
+
+    return rate > 0.0f ? rate : (seek ? settings.homing.seek_rate : settings.homing.feed_rate);
+}
 #endif
 
 // Homes the specified cycle axes, sets the machine position, and performs a pull-off motion after
@@ -117,13 +174,17 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
     if (ABORTED) // Block if system reset has been issued.
         return false;
 
-    int32_t initial_trigger_position = 0, autosquare_fail_distance = 0;
+    int32_t initial_trigger_position = 0, autosquare_fail_distance = 0, position[N_AXIS];
     uint_fast8_t n_cycle = (2 * settings.homing.locate_cycles + 1);
     uint_fast8_t step_pin[N_AXIS], n_active_axis, dual_motor_axis = 0;
     float target[N_AXIS];
     float max_travel = 0.0f;
     float homing_rate = settings.homing.seek_rate;
     bool approach = true, autosquare_check = false, both_motors = mode == SquaringMode_Both && auto_square.mask;
+#ifdef ENABLE_HOMING_AXIS_RATES
+    bool seek = true;
+    float axis_rate[N_AXIS], min_rate;
+#endif
     axes_signals_t axislock, limit_state;
     plan_line_data_t plan_data;
 
@@ -145,7 +206,7 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
         idx--;
         // Initialize step pin masks
 #ifdef KINEMATICS_API
-        step_pin[idx] = kinematics.limits_get_axis_mask(idx);
+        step_pin[idx] = kinematics.limits_get_axis_mask ? kinematics.limits_get_axis_mask(idx) : bit(idx);
 #else
         step_pin[idx] = bit(idx);
 #endif
@@ -171,6 +232,16 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
         system_convert_array_steps_to_mpos(target, sys_position);
         axislock = (axes_signals_t){0};
         n_active_axis = 0;
+#ifdef HOMING_AUTO_SQUARE_CONCURRENT
+        // Square the ganged axis on each approach, the motors are located on their own switch.
+        if(approach && mode == SquaringMode_Both && auto_square.mask) {
+            both_motors = true;
+            autosquare_check = false;
+        }
+#endif
+#ifdef ENABLE_HOMING_AXIS_RATES
+        min_rate = 0.0f;
+#endif
 
         idx = N_AXIS;
         do {
@@ -179,10 +250,11 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
                 n_active_axis++;
 
 #ifdef KINEMATICS_API
-                kinematics.limits_set_target_pos(idx);
-#else
-                sys_position[idx] = 0;
+                if(kinematics.limits_set_target_pos)
+                    kinematics.limits_set_target_pos(idx);
+                else
 #endif
+                sys_position[idx] = 0;
                 // Set target direction based on cycle mask and homing cycle approach state.
                 // NOTE: This happens to compile smaller than any other implementation tried.
                 if (bit_istrue(settings.homing.dir_mask.value, bit(idx)))
@@ -192,10 +264,32 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
 
                 // Apply axislock to the step port pins active in this cycle.
                 axislock.mask |= step_pin[idx];
+#ifdef ENABLE_HOMING_AXIS_RATES
+                axis_rate[idx] = homing_axis_rate(idx, seek);
+                if(min_rate == 0.0f || axis_rate[idx] < min_rate)
+                    min_rate = axis_rate[idx];
+#endif
             }
         } while(idx);
 
+#ifdef ENABLE_HOMING_AXIS_RATES
+        if(approach) {
+            // Scale axis targets by rate so each axis moves at its own rate, the
+            // slowest axis covers the search distance and the others a longer distance.
+            homing_rate = 0.0f;
+            idx = N_AXIS;
+            do {
+                if (bit_istrue(cycle.mask, bit(--idx))) {
+                    target[idx] *= axis_rate[idx] / min_rate;
+                    homing_rate += axis_rate[idx] * axis_rate[idx];
+                }
+            } while(idx);
+            homing_rate = sqrtf(homing_rate);
+        } else // Pull-off distance is the same for all axes, move at the lowest rate.
+            homing_rate = min_rate * sqrtf(n_active_axis);
+#else
         homing_rate *= sqrtf(n_active_axis); // [sqrt(N_AXIS)] Adjust so individual axes all move at homing rate.
+#endif
         sys.homing_axis_lock.mask = axislock.mask;
 
         // Perform homing cycle. Planner buffer should be empty, as required to initiate the homing cycle.
@@ -226,8 +320,10 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
                             hal.stepper.disable_motors((axes_signals_t){0}, SquaringMode_Both);
                         }
                     }
-                    if((autosquare_check = (limit_state.mask & auto_square.mask) == 0))
-                        initial_trigger_position = sys_position[dual_motor_axis];
+                    if((autosquare_check = (limit_state.mask & auto_square.mask) == 0)) {
+                        st_get_position(position);
+                        initial_trigger_position = position[dual_motor_axis];
+                    }
                 }
 
                 idx = N_AXIS;
@@ -235,7 +331,7 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
                     idx--;
                     if ((axislock.mask & step_pin[idx]) && (limit_state.mask & bit(idx))) {
 #ifdef KINEMATICS_API
-                        axislock.mask &= ~kinematics.limits_get_axis_mask(idx);
+                        axislock.mask &= ~(kinematics.limits_get_axis_mask ? kinematics.limits_get_axis_mask(idx) : bit(idx));
 #else
                         axislock.mask &= ~bit(idx);
 #endif
@@ -244,11 +340,14 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
 
                 sys.homing_axis_lock.mask = axislock.mask;
 
-                if (autosquare_check && abs(initial_trigger_position - sys_position[dual_motor_axis]) > autosquare_fail_distance) {
-                    system_set_exec_alarm(Alarm_HomingFailAutoSquaringApproach);
-                    mc_reset();
-                    protocol_execute_realtime();
-                    return false;
+                if (autosquare_check) {
+                    st_get_position(position);
+                    if(abs(initial_trigger_position - position[dual_motor_axis]) > autosquare_fail_distance) {
+                        system_set_exec_alarm(Alarm_HomingFailAutoSquaringApproach);
+                        mc_reset();
+                        protocol_execute_realtime();
+                        return false;
+                    }
                 }
             }
 
@@ -295,12 +394,17 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
 
         // Reverse direction and reset homing rate for locate cycle(s).
         approach = !approach;
+#ifdef ENABLE_HOMING_AXIS_RATES
+        seek = !approach;
+#endif
 
         // After first cycle, homing enters locating phase. Shorten search to pull-off distance.
         if (approach) {
+#ifndef HOMING_AUTO_SQUARE_CONCURRENT
             // Only one initial pass for auto squared axis when both motors are active
             if(mode == SquaringMode_Both && auto_square.mask)
                 cycle.mask &= ~auto_square.mask;
+#endif
             max_travel = settings.homing.pulloff * HOMING_AXIS_LOCATE_SCALAR;
             homing_rate = settings.homing.feed_rate;
         } else {
@@ -320,10 +424,11 @@ static bool limits_homing_cycle (axes_signals_t cycle, axes_signals_t auto_squar
     // some initial clearance off the switches and should also help prevent them from falsely
     // triggering when hard limits are enabled or when more than one axes shares a limit pin.
 #ifdef KINEMATICS_API
-    kinematics.limits_set_machine_positions(cycle);
-#else
-    limits_set_machine_positions(cycle, true);
+    if(kinematics.limits_set_machine_positions)
+        kinematics.limits_set_machine_positions(cycle);
+    else
 #endif
+    limits_set_machine_positions(cycle, true);
 
 #ifdef ENABLE_BACKLASH_COMPENSATION
     mc_backlash_init();
@@ -359,6 +464,19 @@ bool limits_go_home (axes_signals_t cycle)
 
     homed = limits_homing_cycle(cycle, auto_square, SquaringMode_Both);
 
+#ifdef HOMING_AUTO_SQUARE_CONCURRENT
+    // The auto squared axis has been squared by the locate cycles, home the remaining auto squared axes.
+    if(homed && auto_square.mask) do {
+
+        hal.stepper.disable_motors((axes_signals_t){0}, SquaringMode_Both);
+
+        if((auto_squared.mask &= ~auto_square.mask)) {
+            while(!(auto_squared.mask & auto_square.mask))
+                auto_square.mask <<= 1;
+            homed = limits_homing_cycle(auto_square, auto_square, SquaringMode_Both);
+        }
+    } while(homed && auto_squared.mask);
+#else
     if(homed && auto_square.mask) {
 
         sys.homed.mask &= ~auto_square.mask;
@@ -377,16 +495,47 @@ bool limits_go_home (axes_signals_t cycle)
             homed = limits_homing_cycle(auto_square, auto_square, SquaringMode_Both);
         }
     } while(homed && auto_squared.mask);
+#endif
 
     return homed;
 }
 
+static THREAD_LOCAL travel_extents_t *travel_extents = NULL;
+
+void limits_travel_extents (travel_extents_t *extents)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if((travel_extents = extents)) {
+        extents->exceeded = false;
+        do {
+            idx--;
+            extents->min[idx] = SOME_LARGE_VALUE;
+            extents->max[idx] = -SOME_LARGE_VALUE;
+        } while(idx);
+    }
+}
+
+bool limits_soft_check_enabled (void)
+{
+    return settings.limits.flags.soft_enabled || (travel_extents && sys.state == STATE_CHECK_MODE);
+}
+
 // Performs a soft limit check. Called from mc_line() only. Assumes the machine has been homed,
 // the workspace volume is in all negative space, and the system is in normal operation.
 // NOTE: Also used by jogging to block travel outside soft-limit volume.
 void limits_soft_check  (float *target)
 {
-    if (!system_check_travel_limits(target)) {
+    if(travel_extents && sys.state == STATE_CHECK_MODE) {
+        uint_fast8_t idx = N_AXIS;
+        do {
+            idx--;
+            travel_extents->min[idx] = min(travel_extents->min[idx], target[idx]);
+            travel_extents->max[idx] = max(travel_extents->max[idx], target[idx]);
+        } while(idx);
+        if(settings.limits.flags.soft_enabled && !system_check_travel_limits(target))
+            travel_extents->exceeded = true;
+    } else if (!system_check_travel_limits(target)) {
         sys.flags.soft_limit = On;
         // Force feed hold if cycle is active. All buffered blocks are guaranteed to be within
         // workspace volume so just come to a controlled stop so position is not lost. When complete
@@ -416,4 +565,7 @@ void limits_set_homing_axes (void)
     } while(idx);
 
     sys.homed.mask &= sys.homing.mask;
+    travel_extents = NULL;
+
+    system_update_travel_envelope();
 }
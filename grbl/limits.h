@@ -29,13 +29,41 @@
 // Perform one portion of the homing cycle based on the input settings.
 bool limits_go_home(axes_signals_t cycle);
 
+// Machine position extents of motion collected in check mode, see limits_travel_extents().
+typedef struct {
+    bool exceeded;          // Set when a target outside the soft limits envelope has been checked
+    float min[N_AXIS];      // Minimum machine position of all targets checked
+    float max[N_AXIS];      // Maximum machine position of all targets checked
+} travel_extents_t;
+
 // Check for soft limit violations
 void limits_soft_check(float *target);
 
+// Returns true if motion targets are to be passed to limits_soft_check().
+bool limits_soft_check_enabled (void);
+
+// Starts collecting the extents of motion in check mode, soft limit violations are flagged in the extents
+// instead of raising an alarm. Collection is stopped when NULL is passed and on reset.
+void limits_travel_extents (travel_extents_t *extents);
+
 // Set axes to be homed from settings.
 void limits_set_homing_axes (void);
 void limits_set_machine_positions (axes_signals_t cycle, bool add_pulloff);
 
 void limit_interrupt_handler (axes_signals_t state);
 
+#if LIMITS_FILTER_SAMPLES
+
+typedef struct {
+    uint32_t trips;         // Number of confirmed hard limit triggers
+    uint32_t glitches;      // Number of pin changes rejected by the filter
+    uint32_t latency_last;  // Time from pin change to confirmed trigger in ms, last trigger
+    uint32_t latency_max;   // Time from pin change to confirmed trigger in ms, maximum
+} limits_filter_stats_t;
+
+void limits_filter_sample (void);
+limits_filter_stats_t *limits_filter_get_stats (void);
+
+#endif
+
 #endif
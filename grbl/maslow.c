@@ -31,6 +31,7 @@
 #ifdef MASLOW_ROUTER
 
 #include <math.h>
+#include <string.h>
 
 #include "driver.h"
 
@@ -54,12 +55,13 @@ typedef struct {
     float height_to_bit; //distance between sled attach point and bit
 } machine_t;
 
-static machine_t machine = {0};
+static THREAD_LOCAL machine_t machine = {0};
 
-uint_fast8_t selected_motor = A_MOTOR;
+THREAD_LOCAL uint_fast8_t selected_motor = A_MOTOR;
 
-maslow_hal_t maslow_hal = {0};
-static driver_setting_ptrs_t driver_settings;
+THREAD_LOCAL maslow_hal_t maslow_hal = {0};
+static THREAD_LOCAL driver_setting_ptrs_t driver_settings;
+static THREAD_LOCAL maslow_position_loop_t position_loop[Z_AXIS + 1] = {0};
 
 static const maslow_settings_t maslow_defaults = {
     .pid[A_MOTOR].Kp = MASLOW_A_KP,
@@ -96,6 +98,55 @@ static const maslow_settings_t maslow_defaults = {
     .YcorrScaling = MASLOW_BCORRSCALING
 };
 
+// Converts the PID settings of the motor to the fixed point gains of the position loop.
+static void maslow_position_loop_configure (uint_fast8_t idx)
+{
+    maslow_position_loop_t *loop = &position_loop[idx];
+    maslow_pid_coefficients_t *pid = &maslow_hal.settings.pid[idx];
+
+    loop->kp = (int32_t)lroundf(pid->Kp * FP_SCALING);
+    loop->ki = (int32_t)lroundf(pid->Ki * FP_SCALING);
+    loop->kd = (int32_t)lroundf(pid->Kd * FP_SCALING);
+    loop->integral_max = loop->ki > 0 ? (int32_t)(pid->Imax * FP_SCALING / (float)loop->ki) : 0;
+    loop->integral = max(min(loop->integral, loop->integral_max), -loop->integral_max);
+}
+
+// Fixed rate position loop, integer only. The intermediate products are 64 bit to allow for large errors.
+int32_t maslow_position_loop (uint_fast8_t idx, int32_t position)
+{
+    maslow_position_loop_t *loop = &position_loop[idx];
+    int32_t error = sys_position[idx] - position;
+    int64_t output;
+
+    loop->integral = max(min(loop->integral + error, loop->integral_max), -loop->integral_max);
+    loop->diff = error - loop->error;
+    loop->error = error;
+
+    output = ((int64_t)loop->kp * error + (int64_t)loop->ki * loop->integral + (int64_t)loop->kd * loop->diff) / (int32_t)FP_SCALING;
+
+    return loop->output = (int32_t)max(min(output, MASLOW_PID_OUTPUT_MAX), -MASLOW_PID_OUTPUT_MAX);
+}
+
+void maslow_position_loop_reset (uint_fast8_t idx)
+{
+    position_loop[idx].integral = position_loop[idx].error = position_loop[idx].diff = position_loop[idx].output = 0;
+}
+
+maslow_debug_t *maslow_position_loop_debug (uint_fast8_t idx)
+{
+    static maslow_debug_t debug;
+
+    maslow_position_loop_t *loop = &position_loop[idx];
+
+    debug.Error = (float)loop->error;
+    debug.Integral = (float)loop->integral;
+    debug.iterm = (float)loop->ki * (float)loop->integral / FP_SCALING;
+    debug.DiffTerm = (float)loop->kd * (float)loop->diff / FP_SCALING;
+    debug.speed = (float)loop->output;
+
+    return &debug;
+}
+
 static status_code_t maslow_settings_set (setting_type_t param, float value, char *svalue)
 {
     status_code_t status = Status_Unhandled;
@@ -203,8 +254,11 @@ static status_code_t maslow_settings_set (setting_type_t param, float value, cha
             break;
     }
 
-    if(status == Status_OK)
+    if(status == Status_OK) {
+        if(param >= (setting_type_t)Maslow_A_KP && param <= (setting_type_t)Maslow_Z_IMAX)
+            maslow_position_loop_configure((param - Maslow_A_KP) / (Maslow_B_KP - Maslow_A_KP));
         hal.nvs.memcpy_to_nvs(hal.nvs.driver_area.address, (uint8_t *)&maslow_hal.settings, sizeof(maslow_settings_t), true);
+    }
 
     return status;
 }
@@ -335,6 +389,10 @@ static void maslow_settings_load (void)
     if(hal.nvs.memcpy_from_nvs((uint8_t *)&maslow_hal.settings, driver_settings.nvs_address, sizeof(maslow_settings_t), true) != NVS_TransferResult_OK)
         maslow_settings_restore();
 
+    maslow_position_loop_configure(A_MOTOR);
+    maslow_position_loop_configure(B_MOTOR);
+    maslow_position_loop_configure(Z_AXIS);
+
     if(driver_settings.load)
         driver_settings.load();
 }
@@ -394,11 +452,13 @@ inline static void triangularInverse (int32_t *target_steps, float *target)
     // scale target (absolute position) by any correction factor
     double xxx = (double)target[A_MOTOR] * (double)maslow_hal.settings.XcorrScaling;
     double yyy = (double)target[B_MOTOR] * (double)maslow_hal.settings.YcorrScaling;
-    double yyp = pow((double)machine.yCordOfMotor - yyy, 2.0);
+    double yyp = (double)machine.yCordOfMotor - yyy, xxa = (double)machine.xCordOfMotor + xxx, xxb = (double)machine.xCordOfMotor - xxx;
+
+    yyp *= yyp;
 
     //Calculate motor axes length to the bit
-    target_steps[A_MOTOR] = (int32_t)lround(sqrt(pow((double)machine.xCordOfMotor + xxx, 2.0f) + yyp) * settings.axis[A_MOTOR].steps_per_mm);
-    target_steps[B_MOTOR] = (int32_t)lround(sqrt(pow((double)machine.xCordOfMotor - xxx, 2.0f) + yyp) * settings.axis[B_MOTOR].steps_per_mm);
+    target_steps[A_MOTOR] = (int32_t)lround(sqrt(xxa * xxa + yyp) * settings.axis[A_MOTOR].steps_per_mm);
+    target_steps[B_MOTOR] = (int32_t)lround(sqrt(xxb * xxb + yyp) * settings.axis[B_MOTOR].steps_per_mm);
 }
 
 // Transform absolute position from cartesian coordinate system (mm) to maslow coordinate system (step)
@@ -418,19 +478,44 @@ static uint_fast8_t maslow_limits_get_axis_mask (uint_fast8_t idx)
     return ((idx == A_MOTOR) || (idx == B_MOTOR)) ? (bit(X_AXIS) | bit(Y_AXIS)) : bit(idx);
 }
 
+// Returns the max length of a segment of the line from start along the unit vector u in the XY plane for which
+// the deviation from linear interpolation of the string length from the motor at m is within the arc tolerance.
+// The second derivative of the string length along the line is d^2 / |r|^3 where d is the distance from the
+// motor to the line and r the vector from the motor to the point on the line, max is where r is shortest.
+static float maslow_segment_length (const float *m, const float *start, const float *u, float length)
+{
+    float rx = start[X_AXIS] - m[X_AXIS], ry = start[Y_AXIS] - m[Y_AXIS],
+          d = rx * u[Y_AXIS] - ry * u[X_AXIS],
+          t = -(rx * u[X_AXIS] + ry * u[Y_AXIS]);
+
+    t = t < 0.0f ? 0.0f : (t > length ? length : t); // closest point on the line
+
+    rx += u[X_AXIS] * t;
+    ry += u[Y_AXIS] * t;
+
+    float r2 = rx * rx + ry * ry, k = d * d;
+
+    if(k == 0.0f) // line through motor, string length is linear
+        return length;
+
+    k /= r2 * sqrtf(r2);
+
+    return sqrtf(8.0f * settings.arc_tolerance / k);
+}
+
 // MASLOW is circular in motion, so long lines must be divided up
 static bool maslow_segment_line (float *target, plan_line_data_t *pl_data, bool init)
 {
-    static uint_fast16_t iterations;
-    static bool segmented;
-    static float delta[N_AXIS], segment_target[N_AXIS];
+    static THREAD_LOCAL uint_fast16_t iterations;
+    static THREAD_LOCAL bool segmented;
+    static THREAD_LOCAL float delta[N_AXIS], segment_target[N_AXIS];
 //    static plan_line_data_t plan;
 
     uint_fast8_t idx = N_AXIS;
 
     if(init) {
 
-        float max_delta = 0.0f;
+        float max_delta = 0.0f, motor[2][2] = { { -machine.xCordOfMotor, machine.yCordOfMotor }, { machine.xCordOfMotor, machine.yCordOfMotor } };
 
         do {
             idx--;
@@ -438,11 +523,26 @@ static bool maslow_segment_line (float *target, plan_line_data_t *pl_data, bool
             max_delta = max(max_delta, fabsf(delta[idx]));
         } while(idx);
 
-        if((segmented = !(pl_data->condition.rapid_motion || pl_data->condition.jog_motion) &&
-                          max_delta > MAX_SEG_LENGTH_MM && !(delta[X_AXIS] == 0.0f && delta[Y_AXIS] == 0.0f))) {
+        iterations = 1;
+
+        if(!(pl_data->condition.rapid_motion || pl_data->condition.jog_motion) && !(delta[X_AXIS] == 0.0f && delta[Y_AXIS] == 0.0f)) {
+
+            // Segment length is calculated in the frame scaled by the correction factors, see triangularInverse().
+            float start[2] = { gc_state.position[X_AXIS] * maslow_hal.settings.XcorrScaling, gc_state.position[Y_AXIS] * maslow_hal.settings.YcorrScaling },
+                  u[2] = { delta[X_AXIS] * maslow_hal.settings.XcorrScaling, delta[Y_AXIS] * maslow_hal.settings.YcorrScaling },
+                  length = sqrtf(u[X_AXIS] * u[X_AXIS] + u[Y_AXIS] * u[Y_AXIS]), seg_length;
+
+            u[X_AXIS] /= length;
+            u[Y_AXIS] /= length;
+            seg_length = min(maslow_segment_length(motor[A_MOTOR], start, u, length),
+                              maslow_segment_length(motor[B_MOTOR], start, u, length));
+
+            iterations = (uint_fast16_t)max(ceilf(length / max(seg_length, MIN_SEG_LENGTH_MM)), ceilf(max_delta / MAX_SEG_LENGTH_MM));
+        }
+
+        if((segmented = iterations > 1)) {
 
             idx = N_AXIS;
-            iterations = (uint_fast16_t)ceilf(max_delta / MAX_SEG_LENGTH_MM);
 
             memcpy(segment_target, gc_state.position, sizeof(segment_target));
 //            memcpy(&plan, pl_data, sizeof(plan_line_data_t));
@@ -451,9 +551,7 @@ static bool maslow_segment_line (float *target, plan_line_data_t *pl_data, bool
                 delta[--idx] /= (float)iterations;
                 target[idx] = gc_state.position[idx];
             } while(idx);
-
-        } else
-            iterations = 1;
+        }
 
         iterations++; // return at least one iteration
 
@@ -648,6 +746,8 @@ status_code_t maslow_tuning (uint_fast16_t state, char *line, char *lcline)
                         hal.stream.write("Kp == ");
                         hal.stream.write(ftoa(maslow_hal.settings.pid[selected_motor].Kp, 3));
                         hal.stream.write(ASCII_EOL);
+                        maslow_position_loop_configure(selected_motor);
+                        maslow_hal.pid_settings_changed(selected_motor);
                         break;
 
                     case 'D':
@@ -655,6 +755,8 @@ status_code_t maslow_tuning (uint_fast16_t state, char *line, char *lcline)
                         hal.stream.write("Kd == ");
                         hal.stream.write(ftoa(maslow_hal.settings.pid[selected_motor].Kd, 3));
                         hal.stream.write(ASCII_EOL);
+                        maslow_position_loop_configure(selected_motor);
+                        maslow_hal.pid_settings_changed(selected_motor);
                         break;
 
                     case 'I':
@@ -662,6 +764,7 @@ status_code_t maslow_tuning (uint_fast16_t state, char *line, char *lcline)
                         hal.stream.write("Ki == ");
                         hal.stream.write(ftoa(maslow_hal.settings.pid[selected_motor].Ki, 3));
                         hal.stream.write(ASCII_EOL);
+                        maslow_position_loop_configure(selected_motor);
                         maslow_hal.pid_settings_changed(selected_motor);
                         break;
 
@@ -670,6 +773,7 @@ status_code_t maslow_tuning (uint_fast16_t state, char *line, char *lcline)
                         hal.stream.write("Imax == ");
                         hal.stream.write(ftoa(maslow_hal.settings.pid[selected_motor].Imax, 3));
                         hal.stream.write(ASCII_EOL);
+                        maslow_position_loop_configure(selected_motor);
                         maslow_hal.pid_settings_changed(selected_motor);
                         break;
 
@@ -762,10 +866,30 @@ status_code_t maslow_tuning (uint_fast16_t state, char *line, char *lcline)
 }
 
 // Initialize API pointers & machine parameters for Maslow router kinematics
-bool maslow_init (void)
+// Initialize API pointers for Maslow kinematics
+static void maslow_kinematics_init (void)
 {
     float xy[2] = {0.0f, 0.0f};
 
+    recomputeGeometry();
+    triangularInverse(sys_position, xy);
+
+    kinematics.limits_set_target_pos = maslow_limits_set_target_pos;
+    kinematics.limits_get_axis_mask = maslow_limits_get_axis_mask;
+    kinematics.limits_set_machine_positions = maslow_limits_set_machine_positions;
+    kinematics.plan_target_to_steps = maslow_target_to_steps;
+    kinematics.convert_array_steps_to_mpos = maslow_convert_array_steps_to_mpos;
+    kinematics.segment_line = maslow_segment_line;
+}
+
+static kinematics_entry_t maslow = {
+    .type = Kinematics_Maslow,
+    .name = "Maslow",
+    .init = maslow_kinematics_init
+};
+
+bool maslow_init (void)
+{
     if((hal.driver_settings.nvs_address = nvs_alloc(sizeof(maslow_settings_t)))) {
         memcpy(&driver_settings, &hal.driver_settings, sizeof(driver_setting_ptrs_t));
         hal.driver_settings.set = maslow_settings_set;
@@ -774,16 +898,10 @@ bool maslow_init (void)
         hal.driver_settings.restore = maslow_settings_restore;
 
         recomputeGeometry();
-        triangularInverse(sys_position, xy);
 
         selected_motor = A_MOTOR;
 
-        kinematics.limits_set_target_pos = maslow_limits_set_target_pos;
-        kinematics.limits_get_axis_mask = maslow_limits_get_axis_mask;
-        kinematics.limits_set_machine_positions = maslow_limits_set_machine_positions;
-        kinematics.plan_target_to_steps = maslow_target_to_steps;
-        kinematics.convert_array_steps_to_mpos = maslow_convert_array_steps_to_mpos;
-        kinematics.segment_line = maslow_segment_line;
+        kinematics_register(&maslow);
 
         grbl.on_unknown_sys_command = maslow_tuning;
     }
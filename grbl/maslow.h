@@ -36,7 +36,10 @@
 
 #define FP_SCALING 1024.0f
 #define SPROCKET_RADIUS_MM (10.1f)
-#define MAX_SEG_LENGTH_MM 2.0f /* long lines must be segmented due to circular motion */
+#ifndef MAX_SEG_LENGTH_MM
+#define MAX_SEG_LENGTH_MM 10.0f /* long lines must be segmented due to circular motion, segments are shorter where chain length changes nonlinearly */
+#endif
+#define MIN_SEG_LENGTH_MM 0.1f
 
   // PID position loop factors              X: Kp = 25000 Ki = 15000 Kd = 22000 Imax = 5000
   // 14.000 fixed point arithmatic S13.10
@@ -156,7 +159,39 @@ typedef struct {
     maslow_debug_t *(*get_debug_data)(uint_fast8_t idx);
 } maslow_hal_t;
 
-extern maslow_hal_t maslow_hal;
+extern THREAD_LOCAL maslow_hal_t maslow_hal;
+
+// Rate of the position loops in Hz, the PID gains are per loop update.
+#ifndef MASLOW_PID_RATE
+#define MASLOW_PID_RATE 1000
+#endif
+
+// Drive output range of the position loops, -MASLOW_PID_OUTPUT_MAX to MASLOW_PID_OUTPUT_MAX.
+#ifndef MASLOW_PID_OUTPUT_MAX
+#define MASLOW_PID_OUTPUT_MAX 1023
+#endif
+
+// Position loop of a PID controlled motor (A, B and Z), fixed point with gains scaled by FP_SCALING.
+typedef struct {
+    int32_t kp;
+    int32_t ki;
+    int32_t kd;
+    int32_t integral_max;   // Integral limit for the integral term to be within Imax
+    int32_t integral;
+    int32_t error;
+    int32_t diff;
+    int32_t output;
+} maslow_position_loop_t;
+
+// Updates the position loop of the motor from the encoder position (steps), returns the drive output.
+// The setpoint is the step generator output, sys_position. To be called at MASLOW_PID_RATE from a timer interrupt.
+int32_t maslow_position_loop (uint_fast8_t idx, int32_t position);
+
+// Clears the integral and derivative state of the position loop, e.g. when the motor is enabled.
+void maslow_position_loop_reset (uint_fast8_t idx);
+
+// Returns the position loop state in the format used by the tuning command, may be used for get_debug_data.
+maslow_debug_t *maslow_position_loop_debug (uint_fast8_t idx);
 
 // Initialize HAL pointers for Maslow Router kinematics
 bool maslow_init (void);
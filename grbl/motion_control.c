@@ -35,6 +35,9 @@
 #include "state_machine.h"
 #include "motion_control.h"
 #include "tool_change.h"
+#ifdef ENABLE_HEIGHT_MAP
+#include "height_map.h"
+#endif
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
@@ -49,17 +52,11 @@
 #ifndef BEZIER_MIN_STEP
 #define BEZIER_MIN_STEP 0.002f
 #endif
-#ifndef BEZIER_MAX_STEP
-#define BEZIER_MAX_STEP 0.1f
-#endif
-#ifndef BEZIER_SIGMA
-#define BEZIER_SIGMA 0.1f
-#endif
 
 #ifdef ENABLE_BACKLASH_COMPENSATION
 
-static float target_prev[N_AXIS];
-static axes_signals_t dir_negative, backlash_enabled;
+static THREAD_LOCAL float target_prev[N_AXIS];
+static THREAD_LOCAL axes_signals_t dir_negative, backlash_enabled;
 
 void mc_backlash_init (void)
 {
@@ -86,6 +83,36 @@ void mc_sync_backlash_position (void)
 
 #endif
 
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+
+typedef enum {
+    CannedPhase_Repeat = 0,
+    CannedPhase_Plunge,
+    CannedPhase_Retract,
+    CannedPhase_NextHole,
+    CannedPhase_Final,
+    CannedPhase_Done
+} canned_phase_t;
+
+// Canned drill cycle moves pending, generated as planner buffer slots become available.
+typedef struct {
+    volatile bool active;
+    bool busy;                  // Set while moves are being queued, blocks recursion from mc_line()
+    bool incremental;           // Distance mode at the start of the cycle
+    canned_phase_t phase;
+    motion_mode_t motion;
+    plane_t plane;
+    uint32_t repeats;           // Repeats not yet started
+    float current_z;            // Depth of the current peck
+    float position[N_AXIS];     // Target of the last generated move
+    plan_line_data_t pl_data;
+    gc_canned_t canned;         // Cycle parameters at the start of the cycle
+} canned_generator_t;
+
+static THREAD_LOCAL canned_generator_t canned_gen = {0};
+
+#endif
+
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
 // unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
 // (1 minute)/feed_rate time.
@@ -95,11 +122,22 @@ void mc_sync_backlash_position (void)
 // in the planner and to let backlash compensation or canned cycle integration simple and direct.
 bool mc_line (float *target, plan_line_data_t *pl_data)
 {
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    // Queue all pending canned cycle moves ahead of this motion.
+    if(canned_gen.active && !canned_gen.busy && !mc_canned_drill_pump(true))
+        return false;
+#endif
+
+#ifdef ENABLE_HEIGHT_MAP
+    // Split the motion into segments following the probed surface, they are passed back here one by one.
+    if(height_map_compensate(pl_data))
+        return height_map_line(target, pl_data);
+#endif
 
     // If enabled, check for soft limit violations. Placed here all line motions are picked up
     // from everywhere in Grbl.
     // NOTE: Block jog motions. Jogging is a special case and soft limits are handled independently.
-    if (!pl_data->condition.jog_motion && settings.limits.flags.soft_enabled)
+    if (!pl_data->condition.jog_motion && limits_soft_check_enabled())
         limits_soft_check(target);
 
     // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
@@ -121,9 +159,11 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
 
 #ifdef ENABLE_BACKLASH_COMPENSATION
 
+        // Flag axes reversing direction, the step generator adds the backlash takeup steps at the start of the motion.
+        pl_data->backlash.mask = 0;
+
         if(backlash_enabled.mask) {
 
-            bool backlash_comp = false;
             uint_fast8_t idx = N_AXIS, axismask = bit(N_AXIS - 1);
 
             do {
@@ -132,70 +172,66 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
                     if(target[idx] > target_prev[idx]) {
                         if (dir_negative.value & axismask) {
                             dir_negative.value &= ~axismask;
-                            target_prev[idx] += settings.axis[idx].backlash;
-                            backlash_comp = true;
+                            pl_data->backlash.mask |= axismask;
                         }
                     } else if(target[idx] < target_prev[idx] && !(dir_negative.value & axismask)) {
                         dir_negative.value |= axismask;
-                        target_prev[idx] -= settings.axis[idx].backlash;
-                        backlash_comp = true;
+                        pl_data->backlash.mask |= axismask;
                     }
                 }
                 axismask >>= 1;
             } while(idx);
 
-            if(backlash_comp) {
-
-                plan_line_data_t pl_backlash;
-
-                memset(&pl_backlash, 0, sizeof(plan_line_data_t));
-
-                pl_backlash.condition.rapid_motion = On;
-                pl_backlash.condition.backlash_motion = On;
-                pl_backlash.line_number = pl_data->line_number;
-                pl_backlash.spindle.rpm = pl_data->spindle.rpm;
-
-                // If the buffer is full: good! That means we are well ahead of the robot.
-                // Remain in this loop until there is room in the buffer.
-                while(plan_check_full_buffer()) {
-                    protocol_auto_cycle_start();     // Auto-cycle start when buffer is full.
-                    if(!protocol_execute_realtime()) // Check for any run-time commands
-                        return false;                // Bail, if system abort.
-                }
-
-                plan_buffer_line(target_prev, &pl_backlash);
-            }
-
             memcpy(target_prev, target, sizeof(float) * N_AXIS);
         }
 
 #endif // Backlash comp
 
 #ifdef KINEMATICS_API
+     uint_fast16_t segments = 0;
+
      kinematics.segment_line(target, pl_data, true);
 
      while(kinematics.segment_line(target, pl_data, false)) {
+
+        segments++;
 #endif
         // If the buffer is full: good! That means we are well ahead of the robot.
         // Remain in this loop until there is room in the buffer.
          do {
             if(!protocol_execute_realtime())    // Check for any run-time commands
                 return false;                   // Bail, if system abort.
-            if(plan_check_full_buffer())
+            if(plan_check_full_buffer()) {
                 protocol_auto_cycle_start();    // Auto-cycle start when buffer is full.
-            else
+                protocol_stream_prefetch();     // Read ahead input stream while waiting.
+            } else
                 break;
         } while(true);
 
         // Plan and queue motion into planner buffer
-        // bool plan_status; // Not used in normal operation.
-        if(!plan_buffer_line(target, pl_data) && settings.mode == Mode_Laser && pl_data->condition.spindle.on && !pl_data->condition.spindle.ccw) {
+        bool plan_status = plan_buffer_line(target, pl_data);
+
+#ifdef ENABLE_BACKLASH_COMPENSATION
+        // Backlash is taken up by the first planned motion only. If not planned (zero length) reverting the
+        // direction flags makes the next motion in the same direction take it up instead.
+        if(!plan_status)
+            dir_negative.value ^= pl_data->backlash.mask;
+        pl_data->backlash.mask = 0;
+#endif
+
+        if(!plan_status && settings.mode == Mode_Laser && pl_data->condition.spindle.on && !pl_data->condition.spindle.ccw) {
             // Correctly set spindle state, if there is a coincident position passed.
             // Forces a buffer sync while in M3 laser mode only.
             hal.spindle.set_state(pl_data->condition.spindle, pl_data->spindle.rpm);
         }
 #ifdef KINEMATICS_API
       }
+
+      kinematics.stats.moves++;
+      kinematics.stats.segments += segments;
+      kinematics.stats.segments_last = segments;
+      if(segments > kinematics.stats.segments_max)
+          kinematics.stats.segments_max = segments;
 #endif
     }
 
@@ -203,6 +239,115 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
 }
 
 
+#ifdef ENABLE_NATIVE_ARCS
+
+// Plans an arc as a single block, the step segment generator executes it as chords within settings.arc_tolerance.
+// Returns false if not possible, the arc must then be approximated by line motions.
+static bool mc_arc_native (float *target, plan_line_data_t *pl_data, float *position, float *offset, float radius, plane_t plane, float angular_travel)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    // Only circular and helical motions, no other axes may move.
+    do {
+        idx--;
+        if(idx != plane.axis_0 && idx != plane.axis_1 && idx != plane.axis_linear && target[idx] != position[idx])
+            return false;
+    } while(idx);
+
+    // If enabled, check for soft limit violations. The end points of the arc and the points where
+    // it crosses the plane axes through the center are checked.
+    if (limits_soft_check_enabled()) {
+
+        float point[N_AXIS], axis_angle;
+        float start = atan2f(-offset[plane.axis_1], -offset[plane.axis_0]), angle;
+        uint_fast8_t quadrant = 4;
+
+        memcpy(point, target, sizeof(point));
+
+        do {
+            // Angle from the start position to the axis crossing in the direction of travel, 0 - 2*pi.
+            axis_angle = (float)(--quadrant) * 0.5f * M_PI;
+            angle = axis_angle - start;
+            if(angular_travel < 0.0f)
+                angle = -angle;
+            angle = fmodf(angle, 2.0f * M_PI);
+            if(angle < 0.0f)
+                angle += 2.0f * M_PI;
+            if(angle < fabsf(angular_travel)) {
+                point[plane.axis_0] = position[plane.axis_0] + offset[plane.axis_0] + radius * cosf(axis_angle);
+                point[plane.axis_1] = position[plane.axis_1] + offset[plane.axis_1] + radius * sinf(axis_angle);
+                limits_soft_check(point);
+            }
+        } while(quadrant);
+
+        limits_soft_check(target);
+    }
+
+    // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
+    if (sys.state != STATE_CHECK_MODE && protocol_execute_realtime()) {
+
+        plan_arc_t arc = {
+            .plane = plane,
+            .offset[0] = offset[plane.axis_0],
+            .offset[1] = offset[plane.axis_1],
+            .angular_travel = angular_travel,
+            .linear_travel = target[plane.axis_linear] - position[plane.axis_linear]
+        };
+
+        // If the buffer is full: good! That means we are well ahead of the robot.
+        // Remain in this loop until there is room in the buffer.
+        do {
+            if(!protocol_execute_realtime())    // Check for any run-time commands
+                return true;                    // Bail, if system abort.
+            if(plan_check_full_buffer()) {
+                protocol_auto_cycle_start();    // Auto-cycle start when buffer is full.
+                protocol_stream_prefetch();     // Read ahead input stream while waiting.
+            } else
+                break;
+        } while(true);
+
+        plan_buffer_arc(target, pl_data, &arc);
+    }
+
+    return true;
+}
+
+#endif
+
+#ifdef ENABLE_FAST_CHECK_MODE
+
+// Fast check mode: checks the arc envelope against the soft limits instead of segmenting the arc.
+// The envelope is given by the end points and the quadrant points passed, the end point is handed to
+// mc_line() for the parser position to be updated as usual.
+static void mc_arc_check (float *target, plan_line_data_t *pl_data, float *position, float *offset, float radius,
+                           plane_t plane, float angular_travel)
+{
+    if(!pl_data->condition.jog_motion && limits_soft_check_enabled()) {
+
+        float point[N_AXIS], start = atan2f(-offset[plane.axis_1], -offset[plane.axis_0]), travel;
+        uint_fast8_t quadrant = 4;
+
+        memcpy(point, target, sizeof(point));
+
+        do {
+            quadrant--;
+            travel = (float)quadrant * (M_PI / 2.0f) - start;
+            if(angular_travel < 0.0f)
+                travel = -travel;
+            travel = fmodf(travel + 4.0f * M_PI, 2.0f * M_PI);
+            if(travel <= fabsf(angular_travel)) {
+                point[plane.axis_0] = position[plane.axis_0] + offset[plane.axis_0] + (quadrant == 0 ? radius : (quadrant == 2 ? -radius : 0.0f));
+                point[plane.axis_1] = position[plane.axis_1] + offset[plane.axis_1] + (quadrant == 1 ? radius : (quadrant == 3 ? -radius : 0.0f));
+                limits_soft_check(point);
+            }
+        } while(quadrant);
+    }
+
+    mc_line(target, pl_data);
+}
+
+#endif
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_X defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, isclockwise boolean. Used
@@ -231,12 +376,28 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
             angular_travel += 2.0f * M_PI;
     }
 
+#ifdef ENABLE_FAST_CHECK_MODE
+    if(sys.check_mode_fast) {
+        mc_arc_check(target, pl_data, position, offset, radius, plane, angular_travel);
+        return;
+    }
+#endif
+
+#ifdef ENABLE_NATIVE_ARCS
+    if(mc_arc_native(target, pl_data, position, offset, radius, plane, angular_travel))
+        return;
+#endif
+
     // NOTE: Segment end points are on the arc, which can lead to the arc diameter being smaller by up to
     // (2x) settings.arc_tolerance. For 99% of users, this is just fine. If a different arc segment fit
     // is desired, i.e. least-squares, midpoint on arc, just change the mm_per_arc_segment calculation.
     // For the intended uses of Grbl, this value shouldn't exceed 2000 for the strictest of cases.
     uint16_t segments = (uint16_t)floorf(fabsf(0.5f * angular_travel * radius) / sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance)));
 
+    // Limit the rate by the centripetal acceleration, v^2 / r must not exceed the acceleration of the plane axes.
+    // The same limit is used for the junctions between the chords so the rate does not depend on the number of segments.
+    pl_data->rate_limit = sqrtf(min(settings.axis[plane.axis_0].acceleration, settings.axis[plane.axis_1].acceleration) * radius);
+
     if (segments) {
 
         // Multiply inverse feed_rate to compensate for the fact that this movement is approximated
@@ -297,8 +458,7 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
             } else {
                 // Arc correction to radius vector. Computed only every N_ARC_CORRECTION increments. ~375 usec
                 // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
-                cos_Ti = cosf(i * theta_per_segment);
-                sin_Ti = sinf(i * theta_per_segment);
+                sin_cos(i * theta_per_segment, &sin_Ti, &cos_Ti);
                 r_axis0 = -offset[plane.axis_0] * cos_Ti + offset[plane.axis_1] * sin_Ti;
                 r_axis1 = -offset[plane.axis_0] * sin_Ti - offset[plane.axis_1] * cos_Ti;
                 count = 0;
@@ -312,180 +472,216 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
             // Bail mid-circle on system abort. Runtime command check already performed by mc_line.
             if(!mc_line(position, pl_data))
                 return;
+
+            pl_data->arc_junction = true;
         }
     }
     // Ensure last segment arrives at target location.
     mc_line(target, pl_data);
+
+    pl_data->rate_limit = 0.0f;
+    pl_data->arc_junction = false;
 }
 
-// Bezier splines, from a pull request for Marlin
-// By Giovanni Mascellani - https://github.com/giomasce/Marlin
+// Cubic Bezier splines
+
+typedef struct {
+    float a[2], b[2], c[2], d[2]; // Power basis coefficients, p(t) = ((a * t + b) * t + c) * t + d
+} bezier_t;
 
-// Compute the linear interpolation between two real numbers.
-static inline float interp(const float a, const float b, const float t)
+// Returns the curve point at t, Horner evaluation of the power basis polynomial.
+static inline float bezier_point (const bezier_t *bz, uint_fast8_t i, const float t)
 {
-    return (1.0f - t) * a + t * b;
+    return ((bz->a[i] * t + bz->b[i]) * t + bz->c[i]) * t + bz->d[i];
 }
 
-/**
- * Compute a Bzier curve using the De Casteljau's algorithm (see
- * https://en.wikipedia.org/wiki/De_Casteljau's_algorithm), which is
- * easy to code and has good numerical stability (very important,
- * since Arudino works with limited precision real numbers).
- */
-static inline float eval_bezier(const float a, const float b, const float c, const float d, const float t)
+// Returns the magnitude of the second derivative at t.
+static inline float bezier_d2 (const bezier_t *bz, const float t)
 {
-    const float iab = interp(a, b, t),
-                ibc = interp(b, c, t),
-                icd = interp(c, d, t),
-                iabc = interp(iab, ibc, t),
-                ibcd = interp(ibc, icd, t);
+    float x = 6.0f * bz->a[0] * t + 2.0f * bz->b[0],
+          y = 6.0f * bz->a[1] * t + 2.0f * bz->b[1];
 
-    return interp(iabc, ibcd, t);
+    return sqrtf(x * x + y * y);
 }
 
-/**
- * We approximate Euclidean distance with the sum of the coordinates
- * offset (so-called "norm 1"), which is quicker to compute.
- */
-static inline float dist1(const float x1, const float y1, const float x2, const float y2)
+// Returns the max rate (mm/min) at t as limited by the centripetal acceleration, 0.0f if the curve is straight at t.
+static float bezier_rate_limit (const bezier_t *bz, const float t, const float acceleration)
 {
-    return fabsf(x1 - x2) + fabsf(y1 - y2);
+    float dx = (3.0f * bz->a[0] * t + 2.0f * bz->b[0]) * t + bz->c[0],
+          dy = (3.0f * bz->a[1] * t + 2.0f * bz->b[1]) * t + bz->c[1],
+          ddx = 6.0f * bz->a[0] * t + 2.0f * bz->b[0],
+          ddy = 6.0f * bz->a[1] * t + 2.0f * bz->b[1],
+          cross = fabsf(dx * ddy - dy * ddx),
+          speed = sqrtf(dx * dx + dy * dy);
+
+    // Radius of curvature is |p'|^3 / |p' x p''|.
+    return cross > 0.0f ? sqrtf(acceleration * speed * speed * speed / cross) : 0.0f;
 }
 
-/**
- * The algorithm for computing the step is loosely based on the one in Kig
- * (See https://sources.debian.net/src/kig/4:15.08.3-1/misc/kigpainter.cpp/#L759)
- * However, we do not use the stack.
- *
- * The algorithm goes as it follows: the parameters t runs from 0.0 to
- * 1.0 describing the curve, which is evaluated by eval_bezier(). At
- * each iteration we have to choose a step, i.e., the increment of the
- * t variable. By default the step of the previous iteration is taken,
- * and then it is enlarged or reduced depending on how straight the
- * curve locally is. The step is always clamped between MIN_STEP/2 and
- * 2*MAX_STEP. MAX_STEP is taken at the first iteration.
- *
- * For some t, the step value is considered acceptable if the curve in
- * the interval [t, t+step] is sufficiently straight, i.e.,
- * sufficiently close to linear interpolation. In practice the
- * following test is performed: the distance between eval_bezier(...,
- * t+step/2) is evaluated and compared with 0.5*(eval_bezier(...,
- * t)+eval_bezier(..., t+step)). If it is smaller than SIGMA, then the
- * step value is considered acceptable, otherwise it is not. The code
- * seeks to find the larger step value which is considered acceptable.
+/*
+ * The curve is flattened into chords with a deviation from the curve bound by the arc tolerance ($12).
  *
- * At every iteration the recorded step value is considered and then
- * iteratively halved until it becomes acceptable. If it was already
- * acceptable in the beginning (i.e., no halving were done), then
- * maybe it was necessary to enlarge it; then it is iteratively
- * doubled while it remains acceptable. The last acceptable value
- * found is taken, provided that it is between MIN_STEP and MAX_STEP
- * and does not bring t over 1.0.
+ * The deviation of a chord spanning the parameter interval [t, t + h] from the curve is at most
+ * h^2 / 8 * max|p''| over the interval. p'' is linear in t for a cubic so the max magnitude is found
+ * at one of the interval ends, the step h is thus calculated from the second derivative at the start
+ * and then reduced if the magnitude at the end is larger. In gentle parts of the curve the steps get
+ * long, and a straight spline is output as a single line. The remaining number of steps is rounded up
+ * and the step evenly distributed so no short chord is generated at the end of the curve.
  *
- * Caveat: this algorithm is not perfect, since it can happen that a
- * step is considered acceptable even when the curve is not linear at
- * all in the interval [t, t+step] (but its mid point coincides "by
- * chance" with the midpoint according to the parametrization). This
- * kind of glitches can be eliminated with proper first derivative
- * estimates; however, given the improbability of such configurations,
- * the mitigation offered by MIN_STEP and the small computational
- * power available on Arduino, I think it is not wise to implement it.
+ * The rate is limited by the centripetal acceleration at the tightest end of each chord, and the same rate
+ * is used for the junctions between the chords in the same way as for arcs, see mc_arc().
  */
-
 void mc_cubic_b_spline (float *target, plan_line_data_t *pl_data, float *position, float *offset1, float *offset2)
 {
-    // Absolute first and second control points are recovered.
-
-    float first[2] = { position[X_AXIS] + offset1[X_AXIS], position[Y_AXIS] + offset1[Y_AXIS] };
-    float second[2] = { target[X_AXIS] + offset2[X_AXIS], target[Y_AXIS] + offset2[Y_AXIS] };
-    float bez_target[N_AXIS];
+    bezier_t bz;
+    uint_fast8_t idx = 2;
+    float bez_target[N_AXIS], t = 0.0f, h, d2_start, d2_end, r_remaining, rate_end, rate_start,
+          acceleration = min(settings.axis[X_AXIS].acceleration, settings.axis[Y_AXIS].acceleration),
+          tolerance8 = 8.0f * settings.arc_tolerance;
+
+    // Convert the control points to the power basis, the first and second control points are relative
+    // to the start and end points respectively.
+    do {
+        idx--;
+        float p1 = position[idx] + offset1[idx], p2 = target[idx] + offset2[idx];
+        bz.d[idx] = position[idx];
+        bz.c[idx] = 3.0f * (p1 - position[idx]);
+        bz.b[idx] = 3.0f * (position[idx] - 2.0f * p1 + p2);
+        bz.a[idx] = target[idx] - position[idx] + 3.0f * (p1 - p2);
+    } while(idx);
 
     memcpy(bez_target, position, sizeof(float) * N_AXIS);
 
-    float t = 0.0f, step = BEZIER_MAX_STEP;
+    d2_start = bezier_d2(&bz, 0.0f);
+    rate_start = bezier_rate_limit(&bz, 0.0f, acceleration);
 
-    while (t < 1.0f) {
+    while(t < 1.0f) {
 
-        // First try to reduce the step in order to make it sufficiently
-        // close to a linear interpolation.
-        bool did_reduce = false;
-        float new_t = t + step;
+        r_remaining = 1.0f - t;
 
-        if(new_t > 1.0f)
-            new_t = 1.0f;
+        h = d2_start > 0.0f ? sqrtf(tolerance8 / d2_start) : r_remaining;
+        if(h < r_remaining) {
+            if((d2_end = bezier_d2(&bz, t + h)) > d2_start)
+                h = sqrtf(tolerance8 / d2_end);
+            if(h < BEZIER_MIN_STEP)
+                h = BEZIER_MIN_STEP;
+            h = r_remaining / ceilf(r_remaining / h);
+        } else
+            h = r_remaining;
 
-        float new_pos0 = eval_bezier(position[X_AXIS], first[X_AXIS], second[X_AXIS], target[X_AXIS], new_t),
-              new_pos1 = eval_bezier(position[Y_AXIS], first[Y_AXIS], second[Y_AXIS], target[Y_AXIS], new_t);
+        if((t += h) > 1.0f - BEZIER_MIN_STEP * 0.5f)
+            t = 1.0f;
 
-        while(new_t - t >= (BEZIER_MIN_STEP)) {
+        bez_target[X_AXIS] = t == 1.0f ? target[X_AXIS] : bezier_point(&bz, X_AXIS, t);
+        bez_target[Y_AXIS] = t == 1.0f ? target[Y_AXIS] : bezier_point(&bz, Y_AXIS, t);
 
-//            if (new_t - t < (BEZIER_MIN_STEP))
-//                break;
+        d2_end = bezier_d2(&bz, t);
+        rate_end = bezier_rate_limit(&bz, t, acceleration);
 
-            const float candidate_t = 0.5f * (t + new_t),
-                      candidate_pos0 = eval_bezier(position[X_AXIS], first[X_AXIS], second[X_AXIS], target[X_AXIS], candidate_t),
-                      candidate_pos1 = eval_bezier(position[Y_AXIS], first[Y_AXIS], second[Y_AXIS], target[Y_AXIS], candidate_t),
-                      interp_pos0 = 0.5f * (bez_target[X_AXIS] + new_pos0),
-                      interp_pos1 = 0.5f * (bez_target[Y_AXIS] + new_pos1);
+        // Rate is limited by the tightest end, a straight end (0.0f) does not limit the rate.
+        pl_data->rate_limit = rate_start == 0.0f ? rate_end : (rate_end == 0.0f ? rate_start : min(rate_start, rate_end));
 
-            if (dist1(candidate_pos0, candidate_pos1, interp_pos0, interp_pos1) <= (BEZIER_SIGMA))
-                break;
+        // Bail mid-spline on system abort. Runtime command check already performed by mc_line.
+        if(!mc_line(bez_target, pl_data))
+            break;
 
-            new_t = candidate_t;
-            new_pos0 = candidate_pos0;
-            new_pos1 = candidate_pos1;
-            did_reduce = true;
-        }
+        // Junctions between chords are on the curve, see mc_arc().
+        pl_data->arc_junction = rate_end > 0.0f;
+        d2_start = d2_end;
+        rate_start = rate_end;
+    }
 
-        // If we did not reduce the step, maybe we should enlarge it.
-        if (!did_reduce) while (new_t - t <= BEZIER_MAX_STEP) {
+    pl_data->rate_limit = 0.0f;
+    pl_data->arc_junction = false;
+}
 
-//            if (new_t - t > BEZIER_MAX_STEP)
-//                break;
+// end Bezier splines
 
-            const float candidate_t = t + 2.0f * (new_t - t);
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
 
-            if (candidate_t >= 1.0f)
-                break;
+// Computes the next move of a canned drill cycle from the loop in mc_canned_drill(), returns false when completed.
+static bool canned_drill_next (canned_generator_t *gen)
+{
+    float *z = &gen->position[gen->plane.axis_linear], bottom = gen->canned.xyz[gen->plane.axis_linear];
 
-            const float candidate_pos0 = eval_bezier(position[X_AXIS], first[X_AXIS], second[X_AXIS], target[X_AXIS], candidate_t),
-                      candidate_pos1 = eval_bezier(position[Y_AXIS], first[Y_AXIS], second[Y_AXIS], target[Y_AXIS], candidate_t),
-                      interp_pos0 = 0.5f * (bez_target[X_AXIS] + candidate_pos0),
-                      interp_pos1 = 0.5f * (bez_target[Y_AXIS] + candidate_pos1);
+    while(true) switch(gen->phase) {
 
-            if (dist1(new_pos0, new_pos1, interp_pos0, interp_pos1) > (BEZIER_SIGMA))
-                break;
+        case CannedPhase_Repeat:
+            if(gen->repeats == 0)
+                gen->phase = CannedPhase_Final;
+            else {
+                gen->repeats--;
+                gen->current_z = gen->canned.retract_position;
+                gen->phase = CannedPhase_Plunge;
+            }
+            break;
+
+        case CannedPhase_Plunge:
+            if(gen->current_z <= bottom)
+                gen->phase = CannedPhase_NextHole;
+            else {
+                gen->current_z -= gen->canned.delta;
+                if(gen->current_z < bottom)
+                    gen->current_z = bottom;
+                *z = gen->current_z;
+                gen->pl_data.condition.rapid_motion = Off;
+                gen->phase = CannedPhase_Retract;
+                return true;
+            }
+            break;
+
+        case CannedPhase_Retract:
+            *z = gen->motion == MotionMode_DrillChipBreak && *z != bottom ? *z + settings.g73_retract : gen->canned.retract_position;
+            gen->pl_data.condition.rapid_motion = gen->canned.rapid_retract;
+            gen->phase = CannedPhase_Plunge;
+            return true;
+
+        case CannedPhase_NextHole:
+            gen->phase = CannedPhase_Repeat;
+            if(gen->repeats && gen->incremental) {
+                gen->position[gen->plane.axis_0] += gen->canned.xyz[gen->plane.axis_0];
+                gen->position[gen->plane.axis_1] += gen->canned.xyz[gen->plane.axis_1];
+                *z = gen->canned.prev_position;
+                return true;
+            }
+            break;
+
+        case CannedPhase_Final:
+            gen->phase = CannedPhase_Done;
+            if(gen->canned.retract_mode == CCRetractMode_Previous && gen->motion != MotionMode_DrillChipBreak && *z < gen->canned.prev_position) {
+                gen->pl_data.condition.rapid_motion = On;
+                *z = gen->canned.prev_position;
+                return true;
+            }
+            break;
 
-            new_t = candidate_t;
-            new_pos0 = candidate_pos0;
-            new_pos1 = candidate_pos1;
-        }
+        default:
+            return false;
+    }
+}
 
-        // Check some postcondition; they are disabled in the actual
-        // Marlin build, but if you test the same code on a computer you
-        // may want to check they are respect.
-        /*
-          assert(new_t <= 1.0);
-          if (new_t < 1.0) {
-            assert(new_t - t >= (MIN_STEP) / 2.0);
-            assert(new_t - t <= (MAX_STEP) * 2.0);
-          }
-        */
+// Queues moves of a pending canned drill cycle while there is room in the planner buffer,
+// or all of them if wait is true. Returns false on abort.
+bool mc_canned_drill_pump (bool wait)
+{
+    bool ok = true;
 
-        step = new_t - t;
-        t = new_t;
+    if(canned_gen.active && !canned_gen.busy) {
 
-        bez_target[X_AXIS] = new_pos0;
-        bez_target[Y_AXIS] = new_pos1;
+        canned_gen.busy = true;
 
-        // Bail mid-spline on system abort. Runtime command check already performed by mc_line.
-        if(!mc_line(bez_target, pl_data))
-            return;
+        while(canned_gen.active && (wait || !plan_check_full_buffer())) {
+            if(sys.abort || !canned_drill_next(&canned_gen) || !(ok = mc_line(canned_gen.position, &canned_gen.pl_data)))
+                canned_gen.active = false;
+        }
+
+        canned_gen.busy = false;
     }
+
+    return ok && !sys.abort;
 }
 
-// end Bezier splines
+#endif
 
 void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_data, float *position, plane_t plane, uint32_t repeats, gc_canned_t *canned)
 {
@@ -514,6 +710,34 @@ void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_
     if(canned->retract_mode == CCRetractMode_RPos)
         canned->prev_position = canned->retract_position;
 
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    // Cycles without dwell or spindle stop are generated as planner buffer slots become available,
+    // the final position is found by a dry run of the generator.
+    if(canned->dwell <= 0.0f && !canned->spindle_off && motion != MotionMode_CannedCycle84) {
+
+        canned_generator_t dry_run;
+
+        canned_gen.phase = CannedPhase_Repeat;
+        canned_gen.motion = motion;
+        canned_gen.plane = plane;
+        canned_gen.repeats = repeats;
+        canned_gen.incremental = gc_state.modal.distance_incremental;
+        memcpy(canned_gen.position, position, sizeof(float) * N_AXIS);
+        memcpy(&canned_gen.pl_data, pl_data, sizeof(plan_line_data_t));
+        memcpy(&canned_gen.canned, canned, sizeof(gc_canned_t));
+
+        memcpy(&dry_run, &canned_gen, sizeof(canned_generator_t));
+        while(canned_drill_next(&dry_run));
+        memcpy(target, dry_run.position, sizeof(float) * N_AXIS);
+        memcpy(position, target, sizeof(float) * N_AXIS);
+
+        canned_gen.active = true;
+        mc_canned_drill_pump(false);
+
+        return;
+    }
+#endif
+
     while(repeats--) {
 
         float current_z = canned->retract_position;
@@ -526,15 +750,38 @@ void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_
 
             pl_data->condition.rapid_motion = Off;
 
+            if(motion == MotionMode_CannedCycle84) {
+#ifndef ENABLE_THREADING_PIPELINE
+                if(!protocol_buffer_synchronize()) // Wait until the spindle synchronized motion can be started.
+                    return;
+#endif
+                pl_data->condition.spindle.synchronized = On;   // Enable spindle sync for tapping
+                pl_data->overrides.feed_hold_disable = On;      // and disable feed hold.
+            }
+
             position[plane.axis_linear] = current_z;
             if(!mc_line(position, pl_data)) // drill
                 return;
 
             if(canned->dwell > 0.0f)
+#ifdef ENABLE_PLANNED_DWELL
+                mc_dwell_planned(canned->dwell, pl_data);
+#else
                 mc_dwell(canned->dwell);
+#endif
 
-            if(canned->spindle_off)
+            if(canned->spindle_off) {
+                protocol_buffer_synchronize(); // Stop the spindle at the bottom of the hole.
                 hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+            }
+
+            // Reverse the spindle at the bottom of the hole and wait for it to reach speed before the synchronized retract.
+            if(motion == MotionMode_CannedCycle84) {
+                spindle_state_t reverse = gc_state.modal.spindle;
+                reverse.ccw = !reverse.ccw;
+                if(!spindle_sync(reverse, pl_data->spindle.rpm))
+                    return;
+            }
 
             // rapid retract
             switch(motion) {
@@ -556,6 +803,14 @@ void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_
 
             if(canned->spindle_off)
                 spindle_sync(gc_state.modal.spindle, pl_data->spindle.rpm);
+
+            // Restore the spindle direction when retracted, positioning moves are not synchronized.
+            if(motion == MotionMode_CannedCycle84) {
+                if(!spindle_sync(gc_state.modal.spindle, pl_data->spindle.rpm))
+                    return;
+                pl_data->condition.spindle.synchronized = Off;
+                pl_data->overrides.feed_hold_disable = sys.override.control.feed_hold_disable;
+            }
         }
 
        // rapid move to next position if incremental mode
@@ -644,8 +899,10 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
         if(!mc_line(target, pl_data))
             return;
 
+#ifndef ENABLE_THREADING_PIPELINE
         if(!protocol_buffer_synchronize() && sys.state != STATE_IDLE) // Wait until any previous moves are finished.
             return;
+#endif
 
         pl_data->condition.rapid_motion = Off;          // Clear rapid motion condition flag,
         pl_data->condition.spindle.synchronized = On;   // enable spindle sync for cut
@@ -734,6 +991,58 @@ status_code_t mc_jog_execute (plan_line_data_t *pl_data, parser_block_t *gc_bloc
     return Status_OK;
 }
 
+#ifdef ENABLE_JOG_VELOCITY
+
+// Called by foreground process when velocity jog motion has ended.
+static void jog_velocity_completed (uint_fast16_t state)
+{
+    st_jog_velocity_end();
+    sync_position();
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    mc_sync_backlash_position();
+#endif
+}
+
+status_code_t mc_jog_velocity (float *velocity)
+{
+    bool start = sys.state == STATE_IDLE || sys.state == STATE_TOOL_CHANGE;
+
+    if(!(start || (sys.state == STATE_JOG && st_jog_velocity_active())))
+        return Status_IdleError;
+
+#ifdef KINEMATICS_API
+    if(!kinematics_is_cartesian())
+        return Status_GcodeUnsupportedCommand; // Steps are generated along straight lines in the Cartesian space.
+#endif
+
+    if(start) {
+
+        uint_fast8_t idx = N_AXIS;
+        bool moving = false;
+
+        do {
+            idx--;
+            moving |= velocity[idx] != 0.0f;
+        } while(idx);
+
+        if(!moving || plan_get_current_block() != NULL)
+            return Status_OK;
+    }
+
+    if(!st_jog_velocity(velocity, jog_velocity_completed))
+        return Status_IdleError; // Motion ended, completion not yet processed.
+
+    if(start) {
+        set_state(STATE_JOG);
+        st_prep_buffer();
+        st_wake_up();  // NOTE: Manual start. No state machine required.
+    }
+
+    return Status_OK;
+}
+
+#endif
+
 // Execute dwell in seconds.
 void mc_dwell (float seconds)
 {
@@ -743,6 +1052,32 @@ void mc_dwell (float seconds)
     }
 }
 
+#ifdef ENABLE_PLANNED_DWELL
+
+// Queue dwell in seconds as a planner block, executed in sequence with motions. A zero dwell waits for motion to complete.
+void mc_dwell_planned (float seconds, plan_line_data_t *pl_data)
+{
+    if (sys.state != STATE_CHECK_MODE) {
+
+        if (seconds <= 0.0f) {
+            protocol_buffer_synchronize();
+            return;
+        }
+
+        // Remain in this loop until there is room in the buffer, as for line motions.
+        while(plan_check_full_buffer()) {
+            if(!protocol_execute_realtime())    // Check for any run-time commands
+                return;                         // Bail, if system abort.
+            protocol_auto_cycle_start();        // Auto-cycle start when buffer is full.
+            protocol_stream_prefetch();         // Read ahead input stream while waiting.
+        }
+
+        plan_buffer_dwell(seconds, pl_data);
+    }
+}
+
+#endif
+
 
 // Perform homing cycle to locate and set machine zero. Only '$H' executes this command.
 // NOTE: There should be no motions in the buffer and Grbl must be in an idle state before
@@ -760,10 +1095,11 @@ status_code_t mc_homing_cycle (axes_signals_t cycle)
 
         sys.homed.mask |= cycle.mask;
 #ifdef KINEMATICS_API
-        kinematics.limits_set_machine_positions(cycle);
-#else
-        limits_set_machine_positions(cycle, false);
+        if(kinematics.limits_set_machine_positions)
+            kinematics.limits_set_machine_positions(cycle);
+        else
 #endif
+        limits_set_machine_positions(cycle, false);
     } else {
 
         // Check and abort homing cycle, if hard limits are already enabled. Helps prevent problems
@@ -826,10 +1162,11 @@ status_code_t mc_homing_cycle (axes_signals_t cycle)
             cycle.mask = AXES_BITMASK & ~sys.homing.mask;
             sys.homed.mask = AXES_BITMASK;
 #ifdef KINEMATICS_API
-            kinematics.limits_set_machine_positions(cycle);
-#else
-            limits_set_machine_positions(cycle, false);
+            if(kinematics.limits_set_machine_positions)
+                kinematics.limits_set_machine_positions(cycle);
+            else
 #endif
+            limits_set_machine_positions(cycle, false);
         }
 
         // Homing cycle complete! Setup system for normal operation.
@@ -847,9 +1184,21 @@ status_code_t mc_homing_cycle (axes_signals_t cycle)
 }
 
 
+// Called from the driver probe trigger interrupt when hal.driver_cap.probe_latch is set.
+// Records the system position at the trigger edge and stops the probing motion.
+ISR_CODE void probe_interrupt_handler (void)
+{
+    if (sys_probing_state == Probing_ActiveLatch) {
+        sys_probing_state = Probing_Off;
+        memcpy(sys_probe_position, sys_position, sizeof(sys_position));
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+    }
+}
+
 // Perform tool length probe cycle. Requires probe switch.
 // NOTE: Upon probe failure, the program will be stopped and placed into ALARM state.
-gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags)
+// If report is false the probe position is only reported on failure.
+static gc_probe_t probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags, bool report)
 {
     // TODO: Need to update this cycle so it obeys a non-auto cycle start.
     if (sys.state == STATE_CHECK_MODE)
@@ -877,8 +1226,8 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
     if(!mc_line(target, pl_data))
         return GCProbe_Abort;
 
-    // Activate the probing state monitor in the stepper module.
-    sys_probing_state = Probing_Active;
+    // Activate the probing state monitor in the stepper module or the driver.
+    sys_probing_state = hal.driver_cap.probe_latch ? Probing_ActiveLatch : Probing_Active;
 
     // Perform probing cycle. Wait here until probe is triggered or motion completes.
     system_set_exec_state_flag(EXEC_CYCLE_START);
@@ -890,7 +1239,7 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
     // Probing cycle complete!
 
     // Set state variables and error out, if the probe failed and cycle with error is enabled.
-    if (sys_probing_state == Probing_Active) {
+    if (sys_probing_state != Probing_Off) {
         if (parser_flags.probe_is_no_error)
             memcpy(sys_probe_position, sys_position, sizeof(sys_position));
         else
@@ -907,17 +1256,87 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
     plan_reset();           // Reset planner buffer. Zero planner positions. Ensure probing motion is cleared.
     plan_sync_position();   // Sync planner position to current machine position.
 
-    // All done! Output the probe position as message if configured.
-    if(settings.status_report.probe_coordinates)
-        report_probe_parameters();
+    if(report || !sys.flags.probe_succeeded) {
+
+        // All done! Output the probe position as message if configured.
+        if(settings.status_report.probe_coordinates)
+            report_probe_parameters();
 
-    if(grbl.on_probe_completed)
-        grbl.on_probe_completed();
+        if(grbl.on_probe_completed)
+            grbl.on_probe_completed();
+    }
 
     // Successful probe cycle or Failed to trigger probe within travel. With or without error.
     return sys.flags.probe_succeeded ? GCProbe_Found : GCProbe_FailEnd;
 }
 
+gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags)
+{
+    return probe_cycle(target, pl_data, parser_flags, true);
+}
+
+// Perform two-speed probe cycle: probe at the programmed feed rate, retract by $394 and re-probe at the $395 feed rate.
+// Only the result of the re-probe is reported, overtravel of the re-probe is limited to the retract distance.
+gc_probe_t mc_probe_locate_cycle (float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags)
+{
+    if (sys.state == STATE_CHECK_MODE)
+        return GCProbe_CheckMode;
+
+    if (!protocol_buffer_synchronize())
+        return GCProbe_Abort;
+
+    uint_fast8_t idx;
+    float position[N_AXIS], probe[N_AXIS], direction[N_AXIS], distance = 0.0f, travel = 0.0f, retract;
+    gc_probe_t result;
+    plan_line_data_t locate;
+
+    system_convert_array_steps_to_mpos(position, sys_position);
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        direction[idx] = target[idx] - position[idx];
+        distance += direction[idx] * direction[idx];
+    }
+
+    if((distance = sqrtf(distance)) == 0.0f || settings.probe_retract <= 0.0f)
+        return probe_cycle(target, pl_data, parser_flags, true);
+
+    if((result = probe_cycle(target, pl_data, parser_flags, false)) != GCProbe_Found)
+        return result;
+
+    // Retract along the probing direction, not beyond the start position.
+    system_convert_array_steps_to_mpos(probe, sys_probe_position);
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        direction[idx] /= distance;
+        travel += (probe[idx] - position[idx]) * direction[idx];
+    }
+
+    retract = min(settings.probe_retract, travel);
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        position[idx] = probe[idx] - direction[idx] * retract;
+
+    memcpy(&locate, pl_data, sizeof(plan_line_data_t));
+    locate.message = 0;
+    locate.output_commands = NULL;
+#ifdef ENABLE_LASER_RASTER
+    locate.raster = NULL;
+#endif
+    locate.condition.rapid_motion = On;
+
+    if(!mc_line(position, &locate))
+        return GCProbe_Abort;
+
+    locate.feed_rate = settings.probe_locate_feed_rate;
+    locate.condition.rapid_motion = Off;
+    locate.condition.inverse_time = Off;
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        position[idx] += direction[idx] * retract * 2.0f;
+
+    return probe_cycle(position, &locate, parser_flags, true);
+}
+
 
 // Plans and executes the single special motion case for parking. Independent of main planner buffer.
 // NOTE: Uses the always free planner ring buffer head to store motion parameters for execution.
@@ -954,6 +1373,10 @@ void mc_override_ctrl_update (gc_override_flags_t override_state)
 // realtime abort command and hard limits. So, keep to a minimum.
 ISR_CODE void mc_reset ()
 {
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    canned_gen.active = false;
+#endif
+
     // Only this function can set the system reset. Helps prevent multiple kill calls.
     if (bit_isfalse(sys_rt_exec_state, EXEC_RESET)) {
 
@@ -48,21 +48,43 @@ void mc_arc(float *target, plan_line_data_t *pl_data, float *position, float *of
 // Execute canned cycle (drill)
 void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_data, float *position, plane_t plane, uint32_t repeats, gc_canned_t *canned);
 
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+// Queues moves of a pending canned drill cycle, all of them if wait is true. Returns false on abort.
+bool mc_canned_drill_pump (bool wait);
+#endif
+
 // Execute canned cycle (threading)
 void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thread, bool feed_hold_disabled);
 
 // Sets up valid jog motion received from g-code parser, checks for soft-limits, and executes the jog.
 status_code_t mc_jog_execute(plan_line_data_t *pl_data, parser_block_t *gc_block);
 
+#ifdef ENABLE_JOG_VELOCITY
+// Sets target velocity per axis (mm/min) for velocity jogging, a zero velocity vector stops the motion.
+// Motion is generated directly by the step segment generator, no planner blocks are used.
+status_code_t mc_jog_velocity (float *velocity);
+#endif
+
 // Dwell for a specific number of seconds
 void mc_dwell(float seconds);
 
+#ifdef ENABLE_PLANNED_DWELL
+// Queue a dwell for a specific number of seconds, executed in sequence with motions by the step segment generator
+void mc_dwell_planned (float seconds, plan_line_data_t *pl_data);
+#endif
+
 // Perform homing cycle to locate machine zero. Requires limit switches.
 status_code_t mc_homing_cycle(axes_signals_t cycle);
 
 // Perform tool length probe cycle. Requires probe switch.
 gc_probe_t mc_probe_cycle(float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags);
 
+// Perform probe cycle with fast seek, retract and slow re-probe. Requires probe switch.
+gc_probe_t mc_probe_locate_cycle (float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags);
+
+// Latches the probe position, called by drivers capable of latching the position on the probe trigger edge.
+void probe_interrupt_handler (void);
+
 // Handles updating the override control state.
 void mc_override_ctrl_update(gc_override_flags_t override_state);
 
@@ -0,0 +1,193 @@
+/*
+  motion_sync.c - mirrors step segments from a master controller to slave controllers
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stddef.h>
+
+#include "hal.h"
+#include "motion_control.h"
+#include "motion_sync.h"
+
+#ifdef ENABLE_MOTION_SYNC
+
+#if N_AXIS > MOTION_SYNC_AXES || MOTION_SYNC_AXIS_OFFSET + N_AXIS > MOTION_SYNC_AXES
+#error "Motion sync supports max 6 axes!"
+#endif
+
+#define MSG_LENGTH(member) (offsetof(motion_sync_msg_t, member) + sizeof(((motion_sync_msg_t *)0)->member))
+
+static THREAD_LOCAL struct {
+    motion_sync_role_t role;
+    const motion_sync_link_t *link;
+    uint8_t seq;                    // Master: sequence number of the next message, slave: expected sequence number
+    bool resync;                    // Slave: accept any sequence number for the next message, set on reset
+    volatile uint32_t pulses;       // Slave: number of sync pulses received not yet consumed by a segment start
+    volatile bool waiting;          // Slave: a segment is waiting for its sync pulse
+    volatile bool discard;          // Slave: discard messages until the reset is completed
+    st_block_t *block;              // Master: block data last sent
+} sync = {0};
+
+void motion_sync_init (motion_sync_role_t role, const motion_sync_link_t *link)
+{
+    sync.role = link && link->send ? role : MotionSync_Off;
+    sync.link = link;
+    sync.resync = true;
+}
+
+motion_sync_role_t motion_sync_role (void)
+{
+    return sync.role;
+}
+
+static bool msg_send (motion_sync_msg_t *msg, uint_fast8_t length)
+{
+    msg->seq = sync.seq++;
+
+    return sync.link->send(msg, length);
+}
+
+void motion_sync_segment (segment_t *segment)
+{
+    if(sync.role != MotionSync_Master)
+        return;
+
+    bool ok = true;
+    motion_sync_msg_t msg;
+
+    if(segment->exec_block != sync.block) {
+
+        sync.block = segment->exec_block;
+
+        memset(&msg, 0, sizeof(motion_sync_msg_t));
+        msg.type = MotionSyncMsg_Block;
+        msg.direction_bits = sync.block->direction_bits.mask;
+        msg.block.step_event_count = sync.block->step_event_count;
+        memcpy(msg.block.steps, sync.block->steps, sizeof(sync.block->steps));
+
+        ok = msg_send(&msg, MSG_LENGTH(block));
+    }
+
+    if(ok) {
+        msg.type = MotionSyncMsg_Segment;
+        msg.amass_level = (uint8_t)segment->amass_level;
+        msg.segment.cycles_per_tick = segment->cycles_per_tick;
+        msg.segment.n_step = (uint32_t)segment->n_step;
+
+        ok = msg_send(&msg, MSG_LENGTH(segment));
+    }
+
+    // Slaves are out of sync if a message is lost, abort.
+    if(!ok)
+        mc_reset();
+}
+
+void motion_sync_reset (void)
+{
+    if(sync.role == MotionSync_Master) {
+        motion_sync_msg_t msg = {0};
+        msg.type = MotionSyncMsg_Reset;
+        msg_send(&msg, MSG_LENGTH(reserved));
+        sync.block = NULL;
+    } else {
+        sync.pulses = 0;
+        sync.waiting = sync.discard = false;
+        sync.resync = true;
+    }
+}
+
+// Aborts motion, messages received until the reset is completed belongs to the aborted motion and are discarded.
+static void slave_abort (void)
+{
+    sync.discard = true;
+    mc_reset();
+}
+
+void motion_sync_receive (const motion_sync_msg_t *msg)
+{
+    bool ok;
+
+    if(sync.role != MotionSync_Slave || sync.discard)
+        return;
+
+    if(!sync.resync && msg->seq != sync.seq) {
+        slave_abort(); // Lost message
+        return;
+    }
+
+    sync.resync = false;
+    sync.seq = msg->seq + 1;
+
+    switch((motion_sync_msg_type_t)msg->type) {
+
+        case MotionSyncMsg_Block:;
+            uint32_t steps[N_AXIS];
+            memcpy(steps, &msg->block.steps[MOTION_SYNC_AXIS_OFFSET], sizeof(steps));
+            ok = st_sync_add_block(steps, msg->block.step_event_count, (axes_signals_t){(msg->direction_bits >> MOTION_SYNC_AXIS_OFFSET) & AXES_BITMASK});
+            break;
+
+        case MotionSyncMsg_Segment:
+            ok = st_sync_add_segment((uint_fast16_t)msg->segment.n_step,
+                                      msg->segment.cycles_per_tick - (uint32_t)(((uint64_t)msg->segment.cycles_per_tick * MOTION_SYNC_SLAVE_LEAD) >> 16),
+                                       msg->amass_level);
+            break;
+
+        default: // MotionSyncMsg_Reset, abort any motion in progress.
+            ok = st_sync_idle();
+            break;
+    }
+
+    if(!ok)
+        slave_abort();
+}
+
+// A segment waiting for its pulse is started immediately, aligning it with the master.
+ISR_CODE void motion_sync_pulse (void)
+{
+    if(sync.role == MotionSync_Slave) {
+        sync.pulses++;
+        if(sync.waiting)
+            hal.stepper.interrupt_callback();
+    }
+}
+
+ISR_CODE bool motion_sync_segment_start (void)
+{
+    switch(sync.role) {
+
+        case MotionSync_Master:
+            if(sync.link->pulse)
+                sync.link->pulse();
+            break;
+
+        case MotionSync_Slave:
+            if((sync.waiting = sync.pulses == 0))
+                return false;
+            sync.pulses--;
+            break;
+
+        default:
+            break;
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+  motion_sync.h - mirrors step segments from a master controller to slave controllers
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MOTION_SYNC_H_
+#define _MOTION_SYNC_H_
+
+#include "stepper.h"
+
+#ifdef ENABLE_MOTION_SYNC
+
+// Number of axes carried by the link messages, the master must be configured with all the axes of the machine.
+#define MOTION_SYNC_AXES 6
+
+// First master axis executed by a slave, slave axis n executes master axis MOTION_SYNC_AXIS_OFFSET + n.
+#ifndef MOTION_SYNC_AXIS_OFFSET
+#define MOTION_SYNC_AXIS_OFFSET 0
+#endif
+
+// Segments are executed this many 1/65536 parts faster by slaves so that they always complete a segment
+// before the master and then wait for the sync pulse starting the next one. Default is about 0.1%.
+#ifndef MOTION_SYNC_SLAVE_LEAD
+#define MOTION_SYNC_SLAVE_LEAD 64
+#endif
+
+typedef enum {
+    MotionSync_Off = 0,
+    MotionSync_Master,
+    MotionSync_Slave
+} motion_sync_role_t;
+
+typedef enum {
+    MotionSyncMsg_Reset = 0,    // Master was reset, slaves abort motion
+    MotionSyncMsg_Block,        // Bresenham data of a new block, sent ahead of its first segment
+    MotionSyncMsg_Segment       // Step segment
+} motion_sync_msg_type_t;
+
+// Link message, all values are little endian. Messages are sent in the order they are to be executed,
+// seq is incremented for each message so that slaves can detect lost messages.
+typedef struct {
+    uint8_t type;               // motion_sync_msg_type_t
+    uint8_t seq;
+    union {
+        uint8_t direction_bits; // Block
+        uint8_t amass_level;    // Segment
+    };
+    uint8_t reserved;
+    union {
+        struct {
+            uint32_t step_event_count;
+            uint32_t steps[MOTION_SYNC_AXES];
+        } block;
+        struct {
+            uint32_t cycles_per_tick;
+            uint32_t n_step;
+        } segment;
+    };
+} motion_sync_msg_t;
+
+// Link provided by the driver. Messages are sent from segment prep, which may run in the low priority prep interrupt,
+// the sync pulse is output from the stepper interrupt at the start of each segment and should be a single
+// timer or GPIO write.
+typedef struct {
+    bool (*send)(const motion_sync_msg_t *msg, uint_fast8_t length); // Returns false if the message could not be queued.
+    void (*pulse)(void);                                              // Master only.
+} motion_sync_link_t;
+
+// Sets the role of the controller and the link to use, to be called by the driver from driver_init().
+// The master mirrors all step segments to the slaves, slaves execute the received segments instead of their own.
+void motion_sync_init (motion_sync_role_t role, const motion_sync_link_t *link);
+
+// Returns the role of the controller.
+motion_sync_role_t motion_sync_role (void);
+
+// To be called by slave drivers for each message received, may be called from an interrupt context with a priority below the stepper interrupt.
+void motion_sync_receive (const motion_sync_msg_t *msg);
+
+// To be called by slave drivers on the sync pulse edge, from an interrupt context with the same priority as the stepper interrupt.
+void motion_sync_pulse (void);
+
+// Sends the segment, and the block data ahead of it if it starts a new block, to the slaves. Called from segment prep.
+void motion_sync_segment (segment_t *segment);
+
+// Outputs the sync pulse on the master. On slaves returns false if the sync pulse for the next segment
+// has not yet been received, the segment must then not be started. Called by the stepper interrupt.
+bool motion_sync_segment_start (void);
+
+// Called by st_reset(), the master tells the slaves to abort motion.
+void motion_sync_reset (void);
+
+#endif
+
+#endif
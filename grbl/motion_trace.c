@@ -0,0 +1,156 @@
+/*
+  motion_trace.c - RAM ring buffer trace of prepped planner blocks and step segments
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal.h"
+#include "motion_trace.h"
+
+#ifdef ENABLE_MOTION_TRACE
+
+// Entries are only written by segment prep, which may run in the low priority prep interrupt.
+// Recording is suspended while the trace is reported.
+static THREAD_LOCAL struct {
+    volatile bool frozen;
+    volatile bool reporting;
+    uint_fast16_t head;     // Next entry to write
+    uint32_t count;         // Number of entries recorded since last reset
+    motion_trace_entry_t entry[MOTION_TRACE_SIZE];
+} trace = {0};
+
+static inline motion_trace_entry_t *trace_add (trace_entry_type_t type)
+{
+    motion_trace_entry_t *entry = &trace.entry[trace.head];
+
+    trace.head = trace.head == MOTION_TRACE_SIZE - 1 ? 0 : trace.head + 1;
+    trace.count++;
+
+    entry->type = (uint8_t)type;
+    entry->blocks = (uint8_t)min(plan_get_block_buffer_size() - 1 - plan_get_block_buffer_available(), 255);
+    entry->ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+
+    return entry;
+}
+
+void motion_trace_block (plan_block_t *block, bool reload)
+{
+    if(!(trace.frozen || trace.reporting)) {
+
+        motion_trace_entry_t *entry = trace_add(reload ? TraceEntry_Reload : TraceEntry_Block);
+
+        entry->segments = 0;
+        entry->amass_level = 0;
+        entry->block.entry_speed_sqr = block->entry_speed_sqr;
+        entry->block.max_entry_speed_sqr = block->max_entry_speed_sqr;
+        entry->block.millimeters = block->millimeters;
+        entry->block.line_number = block->line_number;
+    }
+}
+
+void motion_trace_segment (segment_t *segment, uint_fast8_t segments)
+{
+    if(!(trace.frozen || trace.reporting)) {
+
+        motion_trace_entry_t *entry = trace_add(TraceEntry_Segment);
+
+        entry->segments = (uint8_t)segments;
+        entry->amass_level = (uint8_t)segment->amass_level;
+        entry->segment.cycles_per_tick = segment->cycles_per_tick;
+        entry->segment.n_step = (uint32_t)segment->n_step;
+    }
+}
+
+void motion_trace_freeze (void)
+{
+    if(trace.count)
+        trace.frozen = true;
+}
+
+void motion_trace_reset (void)
+{
+    trace.reporting = true;
+    trace.head = 0;
+    trace.count = 0;
+    trace.frozen = trace.reporting = false;
+}
+
+// Prints trace header and entries:
+// [TRACE:<entries>,<trace size>,<frozen>]
+// [TB:<ms>,<line number>,<entry speed>,<max entry speed>,<mm remaining>,<planner blocks>] - TR if reloaded after replan
+// [TS:<ms>,<cycles per tick>,<steps>,<AMASS level>,<segments>,<planner blocks>]
+// Speeds are in mm/min.
+void motion_trace_report (void)
+{
+    uint_fast16_t idx, count;
+    motion_trace_entry_t *entry;
+
+    trace.reporting = true;
+
+    count = (uint_fast16_t)min(trace.count, MOTION_TRACE_SIZE);
+    idx = trace.count > MOTION_TRACE_SIZE ? trace.head : 0;
+
+    hal.stream.write("[TRACE:");
+    hal.stream.write(uitoa(trace.count));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(MOTION_TRACE_SIZE));
+    hal.stream.write(trace.frozen ? ",1]" ASCII_EOL : ",0]" ASCII_EOL);
+
+    while(count--) {
+
+        entry = &trace.entry[idx];
+        idx = idx == MOTION_TRACE_SIZE - 1 ? 0 : idx + 1;
+
+        if(entry->type == TraceEntry_Segment) {
+            hal.stream.write("[TS:");
+            hal.stream.write(uitoa(entry->ms));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(entry->segment.cycles_per_tick));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(entry->segment.n_step));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(entry->amass_level));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(entry->segments));
+        } else {
+            hal.stream.write(entry->type == TraceEntry_Reload ? "[TR:" : "[TB:");
+            hal.stream.write(uitoa(entry->ms));
+            hal.stream.write(",");
+            if(entry->block.line_number < 0)
+                hal.stream.write("-");
+            hal.stream.write(uitoa((uint32_t)abs(entry->block.line_number)));
+            hal.stream.write(",");
+            hal.stream.write(ftoa(sqrtf(entry->block.entry_speed_sqr), N_DECIMAL_RATEVALUE_MM));
+            hal.stream.write(",");
+            hal.stream.write(ftoa(sqrtf(entry->block.max_entry_speed_sqr), N_DECIMAL_RATEVALUE_MM));
+            hal.stream.write(",");
+            hal.stream.write(ftoa(entry->block.millimeters, N_DECIMAL_COORDVALUE_MM));
+        }
+        hal.stream.write(",");
+        hal.stream.write(uitoa(entry->blocks));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    trace.reporting = false;
+}
+
+#endif
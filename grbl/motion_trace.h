@@ -0,0 +1,77 @@
+/*
+  motion_trace.h - RAM ring buffer trace of prepped planner blocks and step segments
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MOTION_TRACE_H_
+#define _MOTION_TRACE_H_
+
+#include "stepper.h"
+
+#ifdef ENABLE_MOTION_TRACE
+
+// Number of entries in the trace buffer, each entry takes 24 bytes of RAM.
+#ifndef MOTION_TRACE_SIZE
+#define MOTION_TRACE_SIZE 128
+#endif
+
+typedef enum {
+    TraceEntry_Block = 0,   // Planner block loaded for segment prep
+    TraceEntry_Reload,      // Planner block reloaded after a replan while executing
+    TraceEntry_Segment      // Step segment added to the segment buffer
+} trace_entry_type_t;
+
+typedef struct {
+    uint8_t type;               // trace_entry_type_t
+    uint8_t blocks;             // Planner buffer fill level
+    uint8_t segments;           // Segment buffer fill level
+    uint8_t amass_level;        // Segment only
+    uint32_t ms;                // Timestamp from hal.get_elapsed_ticks(), 0 if not available
+    union {
+        struct {
+            float entry_speed_sqr;      // (mm/min)^2
+            float max_entry_speed_sqr;  // (mm/min)^2
+            float millimeters;          // Remaining distance
+            int32_t line_number;
+        } block;
+        struct {
+            uint32_t cycles_per_tick;
+            uint32_t n_step;
+        } segment;
+    };
+} motion_trace_entry_t;
+
+// Records a planner block loaded for segment prep. Called from st_prep_buffer().
+void motion_trace_block (plan_block_t *block, bool reload);
+
+// Records a step segment added to the segment buffer with the buffer fill level. Called from st_prep_buffer().
+void motion_trace_segment (segment_t *segment, uint_fast8_t segments);
+
+// Stops recording, keeps the entries leading up to an alarm. Ignored if no entries have been recorded.
+void motion_trace_freeze (void);
+
+// Clears the trace and restarts recording, $TRACER command.
+void motion_trace_reset (void);
+
+// Prints the trace entries, oldest first, $TRACE command.
+void motion_trace_report (void);
+
+#endif
+
+#endif
@@ -0,0 +1,721 @@
+/*
+  ngc_expr.c - NGC parameters and expressions, compiled to a stack bytecode kept in a cache
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Expressions are enclosed in brackets and follow the LinuxCNC syntax, angles are in degrees:
+
+  Binary operators by precedence: **, * / MOD, + -, EQ NE GT GE LT LE, AND OR XOR.
+  Unary operators: - and +.
+  Functions: ABS, ACOS, ASIN, ATAN[y]/[x], COS, EXP, FIX, FUP, LN, ROUND, SIN, SQRT and TAN.
+  Parameters: #<n> numbered, #<name> named, #[expression] and ##<n> indirect.
+
+  A bracketed expression is compiled to bytecode for a small evaluation stack when first met, the bytecode
+  is kept in a direct mapped cache keyed by a hash of the expression source. Expressions in subroutine and
+  loop bodies are thus only compiled on the first pass.
+
+  Read-only system parameters, in current units:
+
+  #5161-#5166  G28 position          #5181-#5186  G30 position
+  #5211-#5216  G92 offset            #5220        Current coordinate system, 1 - 9
+  #5221-#5226  G54 offset, +20 for each of G55 - G59.3
+  #5400        Current tool number   #5401-#5406  Tool length offset
+  #5420-#5425  Current position in work coordinates
+
+  NOTE: parameters are kept in RAM only and are not cleared by soft reset.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "hal.h"
+#include "ngc_expr.h"
+
+#ifdef ENABLE_NGC_EXPRESSIONS
+
+#define NGC_EQ_TOLERANCE 0.000001f
+
+typedef enum {
+    ExprOp_Number = 0,  // Followed by a float
+    ExprOp_Param,       // Followed by an uint16_t parameter number
+    ExprOp_Named,       // Followed by an uint8_t named parameter slot
+    ExprOp_Indirect,
+    ExprOp_Neg,
+    ExprOp_Pow,
+    ExprOp_Mul,
+    ExprOp_Div,
+    ExprOp_Mod,
+    ExprOp_Add,
+    ExprOp_Sub,
+    ExprOp_EQ,
+    ExprOp_NE,
+    ExprOp_GT,
+    ExprOp_GE,
+    ExprOp_LT,
+    ExprOp_LE,
+    ExprOp_And,
+    ExprOp_Or,
+    ExprOp_Xor,
+    ExprOp_Abs,
+    ExprOp_ACos,
+    ExprOp_ASin,
+    ExprOp_ATan,
+    ExprOp_Cos,
+    ExprOp_Exp,
+    ExprOp_Fix,
+    ExprOp_Fup,
+    ExprOp_Ln,
+    ExprOp_Round,
+    ExprOp_Sin,
+    ExprOp_Sqrt,
+    ExprOp_Tan
+} expr_op_t;
+
+typedef struct {
+    const char *name;
+    expr_op_t op;
+} expr_keyword_t;
+
+typedef struct {
+    uint8_t code[NGC_EXPR_CODE_SIZE];
+    uint_fast8_t length;
+    uint_fast8_t depth;
+    status_code_t status;
+    char *s;
+} expr_compiler_t;
+
+typedef struct {
+    uint32_t hash;
+    uint8_t source_length;  // 0 if entry is not in use
+    uint8_t code_length;
+    char source[NGC_EXPR_SOURCE_MAX];
+    uint8_t code[NGC_EXPR_CODE_SIZE];
+} expr_cache_entry_t;
+
+typedef struct {
+    bool defined;
+    float value;
+    char name[NGC_NAMED_PARAMETER_LENGTH + 1];
+} named_param_t;
+
+typedef struct {
+    bool named;
+    uint16_t id;            // Parameter number or named parameter slot
+    float value;
+} assignment_t;
+
+static const expr_keyword_t functions[] = {
+    { "ABS",   ExprOp_Abs },
+    { "ACOS",  ExprOp_ACos },
+    { "ASIN",  ExprOp_ASin },
+    { "ATAN",  ExprOp_ATan },
+    { "COS",   ExprOp_Cos },
+    { "EXP",   ExprOp_Exp },
+    { "FIX",   ExprOp_Fix },
+    { "FUP",   ExprOp_Fup },
+    { "LN",    ExprOp_Ln },
+    { "ROUND", ExprOp_Round },
+    { "SIN",   ExprOp_Sin },
+    { "SQRT",  ExprOp_Sqrt },
+    { "TAN",   ExprOp_Tan }
+};
+
+static const expr_keyword_t relational_ops[] = {
+    { "EQ", ExprOp_EQ },
+    { "NE", ExprOp_NE },
+    { "GT", ExprOp_GT },
+    { "GE", ExprOp_GE },
+    { "LT", ExprOp_LT },
+    { "LE", ExprOp_LE }
+};
+
+static const expr_keyword_t logical_ops[] = {
+    { "AND", ExprOp_And },
+    { "OR",  ExprOp_Or },
+    { "XOR", ExprOp_Xor }
+};
+
+static THREAD_LOCAL float params[NGC_PARAMETERS_MAX];
+static THREAD_LOCAL named_param_t named_params[NGC_NAMED_PARAMETERS_MAX];
+static THREAD_LOCAL uint_fast8_t n_named = 0;
+static THREAD_LOCAL expr_cache_entry_t cache[NGC_EXPR_CACHE_SIZE];
+static THREAD_LOCAL struct {
+    uint_fast8_t count;
+    assignment_t assignment[NGC_ASSIGNMENTS_MAX];
+} assignments = {0};
+
+static bool logical (expr_compiler_t *c);
+static bool primary (expr_compiler_t *c);
+
+// Parameters
+
+static inline float to_current_units (float value)
+{
+    return gc_state.modal.units_imperial ? value * INCH_PER_MM : value;
+}
+
+bool ngc_param_get (uint32_t id, float *value)
+{
+    bool ok = true;
+    coord_data_t data;
+
+    if(id >= 1 && id <= NGC_PARAMETERS_MAX)
+        *value = params[id - 1];
+    else if(id >= 5161 && id < 5161 + N_AXIS && settings_read_coord_data(CoordinateSystem_G28, &data.values))
+        *value = to_current_units(data.values[id - 5161]);
+    else if(id >= 5181 && id < 5181 + N_AXIS && settings_read_coord_data(CoordinateSystem_G30, &data.values))
+        *value = to_current_units(data.values[id - 5181]);
+    else if(id >= 5211 && id < 5211 + N_AXIS)
+        *value = to_current_units(gc_state.g92_coord_offset[id - 5211]);
+    else if(id == 5220)
+        *value = (float)(gc_state.modal.coord_system.id + 1);
+    else if(id >= 5221 && id < 5221 + N_WorkCoordinateSystems * 20 && (id - 5221) % 20 < N_AXIS) {
+        coord_system_id_t coord_id = (coord_system_id_t)((id - 5221) / 20);
+        if(coord_id == gc_state.modal.coord_system.id)
+            *value = to_current_units(gc_state.modal.coord_system.xyz[(id - 5221) % 20]);
+        else if((ok = settings_read_coord_data(coord_id, &data.values)))
+            *value = to_current_units(data.values[(id - 5221) % 20]);
+    } else if(id == 5400)
+        *value = (float)gc_state.tool->tool;
+    else if(id >= 5401 && id < 5401 + N_AXIS)
+        *value = to_current_units(gc_state.tool_length_offset[id - 5401]);
+    else if(id >= 5420 && id < 5420 + N_AXIS)
+        *value = to_current_units(gc_state.position[id - 5420] - gc_get_offset(id - 5420));
+    else
+        ok = false;
+
+    return ok;
+}
+
+bool ngc_param_set (uint32_t id, float value)
+{
+    bool ok;
+
+    if((ok = id >= 1 && id <= NGC_PARAMETERS_MAX))
+        params[id - 1] = value;
+
+    return ok;
+}
+
+// Returns the slot of a named parameter, a new undefined parameter is added if not found. Returns
+// NGC_NAMED_PARAMETERS_MAX if the name is invalid or there is no room for a new parameter.
+static uint_fast8_t named_param_slot (char **s)
+{
+    char *name = *s, *end = strchr(name, '>');
+    uint_fast8_t len = end ? end - name : 0, idx = n_named;
+
+    if(len == 0 || len > NGC_NAMED_PARAMETER_LENGTH)
+        return NGC_NAMED_PARAMETERS_MAX;
+
+    *s = end + 1;
+
+    while(idx) {
+        if(!strncmp(named_params[--idx].name, name, len) && named_params[idx].name[len] == '\0')
+            return idx;
+    }
+
+    if(n_named == NGC_NAMED_PARAMETERS_MAX)
+        return NGC_NAMED_PARAMETERS_MAX;
+
+    memcpy(named_params[n_named].name, name, len);
+    named_params[n_named].name[len] = '\0';
+    named_params[n_named].defined = false;
+
+    return n_named++;
+}
+
+// Compiler, recursive descent emitting bytecode in evaluation order.
+
+static bool emit (expr_compiler_t *c, expr_op_t op, const void *data, uint_fast8_t size, int_fast8_t depth)
+{
+    if(c->length + 1 + size > NGC_EXPR_CODE_SIZE || (c->depth += depth) > NGC_EXPR_STACK_SIZE) {
+        c->status = Status_OutOfMemory; // Expression too complex.
+        return false;
+    }
+
+    c->code[c->length++] = (uint8_t)op;
+    if(size) {
+        memcpy(&c->code[c->length], data, size);
+        c->length += size;
+    }
+
+    return true;
+}
+
+static bool syntax_error (expr_compiler_t *c)
+{
+    c->status = Status_ExpressionSyntaxError;
+
+    return false;
+}
+
+static bool match (expr_compiler_t *c, const char *keyword)
+{
+    size_t len = strlen(keyword);
+    bool ok;
+
+    if((ok = !strncmp(c->s, keyword, len)))
+        c->s += len;
+
+    return ok;
+}
+
+static bool bracketed (expr_compiler_t *c)
+{
+    if(*c->s++ != '[')
+        return syntax_error(c);
+
+    if(!logical(c))
+        return false;
+
+    return *c->s++ == ']' || syntax_error(c);
+}
+
+// Parameter reference, starting after the '#'.
+static bool param (expr_compiler_t *c)
+{
+    if(*c->s == '<') {
+        c->s++;
+        uint8_t slot = named_param_slot(&c->s);
+        if(slot == NGC_NAMED_PARAMETERS_MAX)
+            return syntax_error(c);
+        return emit(c, ExprOp_Named, &slot, sizeof(uint8_t), 1);
+    }
+
+    if(*c->s >= '0' && *c->s <= '9') {
+        uint32_t id = 0;
+        while(*c->s >= '0' && *c->s <= '9' && id <= UINT16_MAX)
+            id = id * 10 + (uint32_t)(*c->s++ - '0');
+        if(*c->s == '.')
+            return syntax_error(c);
+        if(id > UINT16_MAX) {
+            c->status = Status_ExpressionInvalidParameter;
+            return false;
+        }
+        uint16_t id16 = (uint16_t)id;
+        return emit(c, ExprOp_Param, &id16, sizeof(uint16_t), 1);
+    }
+
+    if(*c->s == '[' || *c->s == '#')
+        return primary(c) && emit(c, ExprOp_Indirect, NULL, 0, 0);
+
+    return syntax_error(c);
+}
+
+static bool primary (expr_compiler_t *c)
+{
+    uint_fast8_t idx;
+    char ch = *c->s;
+
+    if(ch == '[')
+        return bracketed(c);
+
+    if(ch == '-' || ch == '+') {
+        c->s++;
+        return primary(c) && (ch == '+' || emit(c, ExprOp_Neg, NULL, 0, 0));
+    }
+
+    if(ch == '#') {
+        c->s++;
+        return param(c);
+    }
+
+    if((ch >= '0' && ch <= '9') || ch == '.') {
+        float value;
+        uint_fast8_t cc = 0;
+        if(!read_float(c->s, &cc, &value))
+            return syntax_error(c);
+        c->s += cc;
+        return emit(c, ExprOp_Number, &value, sizeof(float), 1);
+    }
+
+    for(idx = 0; idx < sizeof(functions) / sizeof(expr_keyword_t); idx++) {
+        if(match(c, functions[idx].name)) {
+            if(!bracketed(c))
+                return false;
+            if(functions[idx].op == ExprOp_ATan) {
+                if(*c->s++ != '/' || !bracketed(c))
+                    return syntax_error(c);
+                return emit(c, ExprOp_ATan, NULL, 0, -1);
+            }
+            return emit(c, functions[idx].op, NULL, 0, 0);
+        }
+    }
+
+    return syntax_error(c);
+}
+
+static bool power (expr_compiler_t *c)
+{
+    if(!primary(c))
+        return false;
+
+    while(match(c, "**")) {
+        if(!(primary(c) && emit(c, ExprOp_Pow, NULL, 0, -1)))
+            return false;
+    }
+
+    return true;
+}
+
+static bool term (expr_compiler_t *c)
+{
+    expr_op_t op;
+
+    if(!power(c))
+        return false;
+
+    while(true) {
+        if(*c->s == '*' && c->s[1] != '*') {
+            c->s++;
+            op = ExprOp_Mul;
+        } else if(*c->s == '/') {
+            c->s++;
+            op = ExprOp_Div;
+        } else if(match(c, "MOD"))
+            op = ExprOp_Mod;
+        else
+            break;
+        if(!(power(c) && emit(c, op, NULL, 0, -1)))
+            return false;
+    }
+
+    return true;
+}
+
+static bool sum (expr_compiler_t *c)
+{
+    char ch;
+
+    if(!term(c))
+        return false;
+
+    while((ch = *c->s) == '+' || ch == '-') {
+        c->s++;
+        if(!(term(c) && emit(c, ch == '+' ? ExprOp_Add : ExprOp_Sub, NULL, 0, -1)))
+            return false;
+    }
+
+    return true;
+}
+
+// Parses a chain of binary operators from ops, operands are parsed by operand().
+static bool binary (expr_compiler_t *c, const expr_keyword_t *ops, uint_fast8_t n_ops, bool (*operand)(expr_compiler_t *c))
+{
+    uint_fast8_t idx;
+
+    if(!operand(c))
+        return false;
+
+    do {
+        for(idx = 0; idx < n_ops; idx++) {
+            if(match(c, ops[idx].name)) {
+                if(!(operand(c) && emit(c, ops[idx].op, NULL, 0, -1)))
+                    return false;
+                break;
+            }
+        }
+    } while(idx < n_ops);
+
+    return true;
+}
+
+static bool relational (expr_compiler_t *c)
+{
+    return binary(c, relational_ops, sizeof(relational_ops) / sizeof(expr_keyword_t), sum);
+}
+
+static bool logical (expr_compiler_t *c)
+{
+    return binary(c, logical_ops, sizeof(logical_ops) / sizeof(expr_keyword_t), relational);
+}
+
+// Evaluator
+
+static status_code_t evaluate (const uint8_t *code, uint_fast8_t length, float *result)
+{
+    float stack[NGC_EXPR_STACK_SIZE], a = 0.0f, b = 0.0f;
+    uint_fast8_t sp = 0, pc = 0;
+    uint16_t id;
+    status_code_t status = Status_OK;
+
+    while(pc < length && status == Status_OK) {
+
+        expr_op_t op = (expr_op_t)code[pc++];
+
+        if(op >= ExprOp_Pow && op <= ExprOp_Xor) {
+            b = stack[--sp];
+            a = stack[sp - 1];
+        } else if(op > ExprOp_Named)
+            a = stack[sp - 1];
+
+        switch(op) {
+
+            case ExprOp_Number:
+                memcpy(&stack[sp++], &code[pc], sizeof(float));
+                pc += sizeof(float);
+                break;
+
+            case ExprOp_Param:
+                memcpy(&id, &code[pc], sizeof(uint16_t));
+                pc += sizeof(uint16_t);
+                if(!ngc_param_get(id, &stack[sp++]))
+                    status = Status_ExpressionInvalidParameter;
+                break;
+
+            case ExprOp_Named:
+                if(named_params[code[pc]].defined)
+                    stack[sp++] = named_params[code[pc]].value;
+                else
+                    status = Status_ExpressionUndefinedParameter;
+                pc++;
+                break;
+
+            case ExprOp_Indirect:
+                if(a < 0.0f || a != truncf(a) || !ngc_param_get((uint32_t)a, &stack[sp - 1]))
+                    status = Status_ExpressionInvalidParameter;
+                break;
+
+            case ExprOp_Neg:   a = -a; break;
+            case ExprOp_Pow:   a = powf(a, b); break;
+            case ExprOp_Mul:   a = a * b; break;
+            case ExprOp_Add:   a = a + b; break;
+            case ExprOp_Sub:   a = a - b; break;
+            case ExprOp_EQ:    a = fabsf(a - b) < NGC_EQ_TOLERANCE ? 1.0f : 0.0f; break;
+            case ExprOp_NE:    a = fabsf(a - b) < NGC_EQ_TOLERANCE ? 0.0f : 1.0f; break;
+            case ExprOp_GT:    a = a > b ? 1.0f : 0.0f; break;
+            case ExprOp_GE:    a = a >= b ? 1.0f : 0.0f; break;
+            case ExprOp_LT:    a = a < b ? 1.0f : 0.0f; break;
+            case ExprOp_LE:    a = a <= b ? 1.0f : 0.0f; break;
+            case ExprOp_And:   a = (a != 0.0f && b != 0.0f) ? 1.0f : 0.0f; break;
+            case ExprOp_Or:    a = (a != 0.0f || b != 0.0f) ? 1.0f : 0.0f; break;
+            case ExprOp_Xor:   a = ((a != 0.0f) != (b != 0.0f)) ? 1.0f : 0.0f; break;
+            case ExprOp_Abs:   a = fabsf(a); break;
+            case ExprOp_Cos:   a = cosf(a * RADDEG); break;
+            case ExprOp_Sin:   a = sinf(a * RADDEG); break;
+            case ExprOp_Tan:   a = tanf(a * RADDEG); break;
+            case ExprOp_Exp:   a = expf(a); break;
+            case ExprOp_Fix:   a = floorf(a); break;
+            case ExprOp_Fup:   a = ceilf(a); break;
+            case ExprOp_Round: a = roundf(a); break;
+
+            case ExprOp_Div:
+            case ExprOp_Mod:
+                if(b == 0.0f)
+                    status = Status_ExpressionDivideByZero;
+                else
+                    a = op == ExprOp_Div ? a / b : a - b * floorf(a / b);
+                break;
+
+            case ExprOp_ACos:
+            case ExprOp_ASin:
+                if(a < -1.0f || a > 1.0f)
+                    status = Status_ExpressionArgumentOutOfRange;
+                else
+                    a = (op == ExprOp_ACos ? acosf(a) : asinf(a)) * DEGRAD;
+                break;
+
+            case ExprOp_ATan:
+                b = stack[--sp];
+                a = stack[sp - 1];
+                a = atan2f(a, b) * DEGRAD;
+                break;
+
+            case ExprOp_Ln:
+                if(a <= 0.0f)
+                    status = Status_ExpressionArgumentOutOfRange;
+                else
+                    a = logf(a);
+                break;
+
+            case ExprOp_Sqrt:
+                if(a < 0.0f)
+                    status = Status_ExpressionArgumentOutOfRange;
+                else
+                    a = sqrtf(a);
+                break;
+        }
+
+        if(op > ExprOp_Indirect && status == Status_OK)
+            stack[sp - 1] = a;
+    }
+
+    if(status == Status_OK)
+        *result = stack[0];
+
+    return status;
+}
+
+// FNV-1a
+static uint32_t hash_source (const char *s, uint_fast8_t length)
+{
+    uint32_t hash = 2166136261UL;
+
+    while(length--)
+        hash = (hash ^ (uint8_t)*s++) * 16777619UL;
+
+    return hash;
+}
+
+// Returns the length of the bracketed expression at s including the brackets, 0 if unbalanced.
+static uint_fast8_t bracketed_length (const char *s)
+{
+    uint_fast8_t length = 0, level = 0;
+
+    do {
+        if(s[length] == '[')
+            level++;
+        else if(s[length] == ']')
+            level--;
+        else if(s[length] == '\0' || length == 255)
+            return 0;
+        length++;
+    } while(level);
+
+    return length;
+}
+
+// Compiles and evaluates the operand at s, bracketed expressions are looked up in and added to the cache.
+static status_code_t read_operand (char **s, float *value)
+{
+    expr_compiler_t c = {0};
+    expr_cache_entry_t *entry = NULL;
+
+    if(**s == '[') {
+
+        uint_fast8_t length = bracketed_length(*s);
+
+        if(length == 0)
+            return Status_ExpressionSyntaxError;
+
+        if(length <= NGC_EXPR_SOURCE_MAX) {
+            uint32_t hash = hash_source(*s, length);
+            entry = &cache[hash % NGC_EXPR_CACHE_SIZE];
+            if(entry->source_length == length && entry->hash == hash && !memcmp(entry->source, *s, length)) {
+                *s += length;
+                return evaluate(entry->code, entry->code_length, value);
+            }
+            entry->source_length = 0;
+            entry->hash = hash;
+        }
+    }
+
+    c.s = *s;
+    c.status = Status_OK;
+
+    if(!primary(&c))
+        return c.status;
+
+    if(entry) {
+        memcpy(entry->source, *s, c.s - *s);
+        memcpy(entry->code, c.code, c.length);
+        entry->code_length = (uint8_t)c.length;
+        entry->source_length = (uint8_t)(c.s - *s);
+    }
+
+    *s = c.s;
+
+    return evaluate(c.code, c.length, value);
+}
+
+status_code_t ngc_read_value (char *line, uint_fast8_t *char_counter, float *value)
+{
+    char *s = &line[*char_counter];
+    status_code_t status;
+
+    if(!(*s == '[' || *s == '#' || ((*s == '-' || *s == '+') && (s[1] == '[' || s[1] == '#'))))
+        return read_float(line, char_counter, value) ? Status_OK : Status_BadNumberFormat;
+
+    bool negate = *s == '-';
+
+    if(*s == '-' || *s == '+')
+        s++;
+
+    if((status = read_operand(&s, value)) == Status_OK) {
+        if(negate)
+            *value = -*value;
+        *char_counter = (uint_fast8_t)(s - line);
+    }
+
+    return status;
+}
+
+status_code_t ngc_read_assignment (char *line, uint_fast8_t *char_counter)
+{
+    float value;
+    assignment_t assignment = {0};
+    char *s = &line[*char_counter];
+    status_code_t status = Status_OK;
+
+    if(*s == '<') {
+        s++;
+        if((assignment.id = named_param_slot(&s)) == NGC_NAMED_PARAMETERS_MAX)
+            return Status_ExpressionSyntaxError;
+        assignment.named = true;
+    } else if(*s == '[' || *s == '#' || (*s >= '0' && *s <= '9')) {
+        if(*s >= '0' && *s <= '9') {
+            uint_fast8_t cc = 0;
+            if(!read_float(s, &cc, &value))
+                return Status_BadNumberFormat;
+            s += cc;
+        } else if((status = read_operand(&s, &value)) != Status_OK)
+            return status;
+        if(value < 1.0f || value > (float)NGC_PARAMETERS_MAX || value != truncf(value))
+            return Status_ExpressionInvalidParameter;
+        assignment.id = (uint16_t)value;
+    } else
+        return Status_ExpressionSyntaxError;
+
+    if(*s++ != '=')
+        return Status_ExpressionSyntaxError;
+
+    *char_counter = (uint_fast8_t)(s - line);
+
+    if((status = ngc_read_value(line, char_counter, &assignment.value)) == Status_OK) {
+        if(assignments.count == NGC_ASSIGNMENTS_MAX)
+            status = Status_OutOfMemory;
+        else
+            assignments.assignment[assignments.count++] = assignment;
+    }
+
+    return status;
+}
+
+void ngc_assignments_commit (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < assignments.count; idx++) {
+        if(assignments.assignment[idx].named) {
+            named_params[assignments.assignment[idx].id].value = assignments.assignment[idx].value;
+            named_params[assignments.assignment[idx].id].defined = true;
+        } else
+            params[assignments.assignment[idx].id - 1] = assignments.assignment[idx].value;
+    }
+
+    assignments.count = 0;
+}
+
+void ngc_assignments_clear (void)
+{
+    assignments.count = 0;
+}
+
+#endif
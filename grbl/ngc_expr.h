@@ -0,0 +1,86 @@
+/*
+  ngc_expr.h - NGC parameters and expressions, compiled to a stack bytecode kept in a cache
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NGC_EXPR_H_
+#define _NGC_EXPR_H_
+
+#include "gcode.h"
+
+#ifdef ENABLE_NGC_EXPRESSIONS
+
+// Number of user numbered parameters, #1 - #NGC_PARAMETERS_MAX. Each parameter takes 4 bytes of RAM.
+#ifndef NGC_PARAMETERS_MAX
+#define NGC_PARAMETERS_MAX 100
+#endif
+
+// Number of named parameters, #<name>, and the maximum name length.
+#ifndef NGC_NAMED_PARAMETERS_MAX
+#define NGC_NAMED_PARAMETERS_MAX 16
+#endif
+#ifndef NGC_NAMED_PARAMETER_LENGTH
+#define NGC_NAMED_PARAMETER_LENGTH 15
+#endif
+
+// Number of compiled expressions kept in the cache and the maximum source length of a cached expression.
+// Longer expressions are compiled each time they are evaluated.
+#ifndef NGC_EXPR_CACHE_SIZE
+#define NGC_EXPR_CACHE_SIZE 16
+#endif
+#ifndef NGC_EXPR_SOURCE_MAX
+#define NGC_EXPR_SOURCE_MAX 40
+#endif
+
+// Maximum bytecode size and evaluation stack depth of an expression.
+#ifndef NGC_EXPR_CODE_SIZE
+#define NGC_EXPR_CODE_SIZE 64
+#endif
+#ifndef NGC_EXPR_STACK_SIZE
+#define NGC_EXPR_STACK_SIZE 12
+#endif
+
+// Maximum number of parameter assignments in a block.
+#ifndef NGC_ASSIGNMENTS_MAX
+#define NGC_ASSIGNMENTS_MAX 8
+#endif
+
+// Reads a word value starting at line[*char_counter]: a number, a parameter reference or a bracketed expression,
+// optionally preceded by a sign. char_counter is advanced past the value. Replaces read_float() for g-code words.
+status_code_t ngc_read_value (char *line, uint_fast8_t *char_counter, float *value);
+
+// Parses a parameter assignment, #<parameter>=<value>, starting after the '#' at line[*char_counter].
+// The assignment is performed by ngc_assignments_commit(), after all values in the block have been read.
+status_code_t ngc_read_assignment (char *line, uint_fast8_t *char_counter);
+
+// Performs the parameter assignments read from the block.
+void ngc_assignments_commit (void);
+
+// Discards the parameter assignments read from the block, called before parsing a new block.
+void ngc_assignments_clear (void);
+
+// Gets the value of a numbered parameter, user or read-only system parameter. Returns false if not available.
+bool ngc_param_get (uint32_t id, float *value);
+
+// Sets the value of a user numbered parameter, returns false if not available or read-only.
+bool ngc_param_set (uint32_t id, float value);
+
+#endif
+
+#endif
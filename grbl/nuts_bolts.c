@@ -34,9 +34,7 @@
 #define DWELL_TIME_STEP 50 // Integer (1-255) (milliseconds)
 #endif
 
-#define MAX_PRECISION 10
-
-static char buf[STRLEN_COORDVALUE + 1];
+static THREAD_LOCAL char buf[STRLEN_COORDVALUE + 2];
 
 static const float froundvalues[MAX_PRECISION + 1] =
 {
@@ -68,40 +66,56 @@ char const *const axis_letter[N_AXIS] = {
 #endif
 };
 
-// Converts an uint32 variable to string.
-char *uitoa (uint32_t n)
+static const uint32_t pow10u[9] = { 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+// Converts an uint32 variable to string in place, returns pointer to the terminating null.
+// NOTE: s must have room for at least STRLEN_UINT32 + 1 characters.
+char *uitoa_r (char *s, uint32_t n)
 {
-    char *bptr = buf + sizeof(buf);
+    uint_fast8_t digits = 1;
+
+    while(digits < STRLEN_UINT32 && n >= pow10u[digits - 1])
+        digits++;
+
+    char *end = s + digits;
 
-    *--bptr = '\0';
+    s = end;
+    *s = '\0';
 
-    if (n == 0)
-        *--bptr = '0';
-    else while (n) {
-        *--bptr = '0' + (n % 10);
+    do {
+        *--s = '0' + (n % 10);
         n /= 10;
-    }
+    } while (n);
 
-    return bptr;
+    return end;
 }
 
-// Convert float to string by immediately converting to integers.
-// Number of decimal places, which are tracked by a counter, must be set by the user.
-// The integers is then efficiently converted to a string.
-char *ftoa (float n, uint8_t decimal_places)
+// Converts an uint32 variable to string.
+char *uitoa (uint32_t n)
 {
-    bool isNegative;
-    char *bptr = buf + sizeof(buf);
+    uitoa_r(buf, n);
 
-    *--bptr = '\0';
+    return buf;
+}
 
-    if ((isNegative = n < 0.0f))
+// Convert float to string in place by immediately converting to integers, returns pointer to the terminating null.
+// Number of decimal places, which are tracked by a counter, must be set by the user.
+// The integers is then efficiently converted to a string.
+// NOTE: s must have room for at least STRLEN_UINT32 + decimal_places + 3 characters.
+char *ftoa_r (char *s, float n, uint8_t decimal_places)
+{
+    if (n < 0.0f) {
+        *s++ = '-';
         n = -n;
+    }
 
     n += froundvalues[decimal_places];
 
     uint32_t a = (uint32_t)n;
 
+    s = uitoa_r(s, a);
+    *s++ = '.'; // Always add decimal point (TODO: is this really needed?)
+
     if (decimal_places) {
 
         n -= (float)a;
@@ -116,30 +130,30 @@ char *ftoa (float n, uint8_t decimal_places)
             n *= 10.0f;
 
         uint32_t b = (uint32_t)n;
+        char *end = s + decimal_places;
 
+        s = end;
         while(decimal_places--) {
             if(b) {
-                *--bptr = (b % 10) + '0'; // Get digit
+                *--s = (b % 10) + '0'; // Get digit
                 b /= 10;
             } else
-                *--bptr = '0';
+                *--s = '0';
         }
+        s = end;
     }
 
-    *--bptr = '.'; // Always add decimal point (TODO: is this really needed?)
-
-    if(a == 0)
-        *--bptr = '0';
+    *s = '\0';
 
-    else while(a) {
-        *--bptr = (a % 10) + '0'; // Get digit
-        a /= 10;
-    }
+    return s;
+}
 
-    if(isNegative)
-        *--bptr = '-';
+// Convert float to string.
+char *ftoa (float n, uint8_t decimal_places)
+{
+    ftoa_r(buf, n, decimal_places);
 
-    return bptr;
+    return buf;
 }
 
 // Extracts a floating point value from a string. The following code is based loosely on
@@ -149,12 +163,33 @@ char *ftoa (float n, uint8_t decimal_places)
 // Scientific notation is officially not supported by g-code, and the 'E' character may
 // be a g-code word on some CNC systems. So, 'E' notation will not be recognized.
 // NOTE: Thanks to Radu-Eosif Mihailescu for identifying the issues with using strtod().
+#if READ_FLOAT_DOUBLE
+#define READ_FLOAT_DIGITS 17 // Maximum number of significant digits accumulated, exactly representable in a double
+typedef uint64_t read_float_int_t;
+typedef double read_float_t;
+// Powers of ten exactly representable in a double.
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#else
+#define READ_FLOAT_DIGITS MAX_INT_DIGITS
+typedef uint32_t read_float_int_t;
+typedef float read_float_t;
+// Powers of ten exactly representable in a float.
+static const float pow10_table[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+#endif
+
+#define POW10_MAX ((int_fast8_t)(sizeof(pow10_table) / sizeof(pow10_table[0])) - 1)
+
 bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
 {
     char *ptr = line + *char_counter;
     int_fast8_t exp = 0;
-    uint_fast8_t ndigit = 0, c;
-    uint32_t intval = 0;
+    uint_fast8_t ndigit = 0, nsig = 0, c;
+    read_float_int_t intval = 0;
     bool isnegative, isdecimal = false;
 
     // Grab first character and increment pointer. No spaces assumed in line.
@@ -165,16 +200,27 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
         c = *ptr++;
 
     // Extract number into fast integer. Track decimal in terms of exponent value.
+    // NOTE: Leading zeros are not counted as significant digits, the first dropped digit rounds the value.
     while(c) {
         c -= '0';
         if (c <= 9) {
             ndigit++;
-            if (ndigit <= MAX_INT_DIGITS) {
+            if (nsig < READ_FLOAT_DIGITS) {
                 if (isdecimal)
                     exp--;
-                intval = (((intval << 2) + intval) << 1) + c; // intval*10 + c
-            } else if (!isdecimal)
-                exp++;  // Drop overflow digits
+                if (intval || c) {
+                    nsig++;
+                    intval = intval * 10 + c;
+                }
+            } else {
+                if (nsig == READ_FLOAT_DIGITS) {
+                    nsig++;
+                    if (c >= 5)
+                        intval++;
+                }
+                if (!isdecimal)
+                    exp++;  // Drop overflow digits
+            }
         } else if (c == (uint_fast8_t)('.' - '0') && !isdecimal)
             isdecimal = true;
          else
@@ -188,24 +234,32 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
         return false;
 
     // Convert integer into floating point.
-    float fval = (float)intval;
-
-    // Apply decimal. Should perform no more than two floating point multiplications for the
-    // expected range of E0 to E-4.
-    if (fval != 0.0f) {
-        while (exp <= -2) {
-            fval *= 0.01f;
-            exp += 2;
-        }
+    read_float_t fval = (read_float_t)intval;
+
+    // Apply decimal by a single division or multiplication with an exact power of ten, as both operands
+    // are exact the result is correctly rounded when the integer value is exactly representable.
+    // NOTE: Negative exponents are limited to READ_FLOAT_DIGITS, never more than the table size.
+    if (intval) {
+#if !READ_FLOAT_DOUBLE
+        if (exp < 0 && intval > (1UL << 24)) {
+            // Integer value not exactly representable, convert integer and fractional parts separately.
+            uint32_t divisor = (uint32_t)pow10_table[-exp];
+            fval = (float)(intval / divisor) + (float)(intval % divisor) / pow10_table[-exp];
+        } else
+#endif
         if (exp < 0)
-            fval *= 0.1f;
-        else if (exp > 0) do {
-            fval *= 10.0f;
-        } while (--exp > 0);
+            fval /= pow10_table[-exp];
+        else if (exp > 0) {
+            while (exp > POW10_MAX) {
+                fval *= pow10_table[POW10_MAX];
+                exp -= POW10_MAX;
+            }
+            fval *= pow10_table[exp];
+        }
     }
 
     // Assign floating point value with correct sign.
-    *float_ptr = isnegative ? - fval : fval;
+    *float_ptr = (float)(isnegative ? - fval : fval);
     *char_counter = ptr - line - 1; // Set char_counter to next statement
 
     return true;
@@ -257,6 +311,102 @@ float convert_delta_vector_to_unit_vector (float *vector)
     return magnitude;
 }
 
+// Integer square root, rounded down. Computed bit by bit, two bits of the argument per iteration.
+uint32_t isqrt (uint32_t value)
+{
+    uint32_t root = 0, bit = 1UL << 30;
+
+    while(bit > value)
+        bit >>= 2;
+
+    while(bit) {
+        if(value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else
+            root >>= 1;
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+#if ARC_TRIG_TABLE
+
+#define SIN_TABLE_BITS 8
+#define SIN_TABLE_SIZE (1 << SIN_TABLE_BITS) // Intervals per quarter wave
+
+// Sine of first quadrant, sin_table[k] = sin(k * (M_PI / 2) / SIN_TABLE_SIZE)
+static const float sin_table[SIN_TABLE_SIZE + 1] = {
+    0.00000000f, 0.00613588f, 0.01227154f, 0.01840673f, 0.02454123f, 0.03067480f, 0.03680722f, 0.04293826f,
+    0.04906767f, 0.05519524f, 0.06132074f, 0.06744392f, 0.07356456f, 0.07968244f, 0.08579731f, 0.09190896f,
+    0.09801714f, 0.10412163f, 0.11022221f, 0.11631863f, 0.12241068f, 0.12849811f, 0.13458071f, 0.14065824f,
+    0.14673047f, 0.15279719f, 0.15885814f, 0.16491312f, 0.17096189f, 0.17700422f, 0.18303989f, 0.18906866f,
+    0.19509032f, 0.20110463f, 0.20711138f, 0.21311032f, 0.21910124f, 0.22508391f, 0.23105811f, 0.23702361f,
+    0.24298018f, 0.24892761f, 0.25486566f, 0.26079412f, 0.26671276f, 0.27262136f, 0.27851969f, 0.28440754f,
+    0.29028468f, 0.29615089f, 0.30200595f, 0.30784964f, 0.31368174f, 0.31950203f, 0.32531029f, 0.33110631f,
+    0.33688985f, 0.34266072f, 0.34841868f, 0.35416353f, 0.35989504f, 0.36561300f, 0.37131719f, 0.37700741f,
+    0.38268343f, 0.38834505f, 0.39399204f, 0.39962420f, 0.40524131f, 0.41084317f, 0.41642956f, 0.42200027f,
+    0.42755509f, 0.43309382f, 0.43861624f, 0.44412214f, 0.44961133f, 0.45508359f, 0.46053871f, 0.46597650f,
+    0.47139674f, 0.47679923f, 0.48218377f, 0.48755016f, 0.49289819f, 0.49822767f, 0.50353838f, 0.50883014f,
+    0.51410274f, 0.51935599f, 0.52458968f, 0.52980362f, 0.53499762f, 0.54017147f, 0.54532499f, 0.55045797f,
+    0.55557023f, 0.56066158f, 0.56573181f, 0.57078075f, 0.57580819f, 0.58081396f, 0.58579786f, 0.59075970f,
+    0.59569930f, 0.60061648f, 0.60551104f, 0.61038281f, 0.61523159f, 0.62005721f, 0.62485949f, 0.62963824f,
+    0.63439328f, 0.63912444f, 0.64383154f, 0.64851440f, 0.65317284f, 0.65780669f, 0.66241578f, 0.66699992f,
+    0.67155895f, 0.67609270f, 0.68060100f, 0.68508367f, 0.68954054f, 0.69397146f, 0.69837625f, 0.70275474f,
+    0.70710678f, 0.71143220f, 0.71573083f, 0.72000251f, 0.72424708f, 0.72846439f, 0.73265427f, 0.73681657f,
+    0.74095113f, 0.74505779f, 0.74913639f, 0.75318680f, 0.75720885f, 0.76120239f, 0.76516727f, 0.76910334f,
+    0.77301045f, 0.77688847f, 0.78073723f, 0.78455660f, 0.78834643f, 0.79210658f, 0.79583690f, 0.79953727f,
+    0.80320753f, 0.80684755f, 0.81045720f, 0.81403633f, 0.81758481f, 0.82110251f, 0.82458930f, 0.82804505f,
+    0.83146961f, 0.83486287f, 0.83822471f, 0.84155498f, 0.84485357f, 0.84812034f, 0.85135519f, 0.85455799f,
+    0.85772861f, 0.86086694f, 0.86397286f, 0.86704625f, 0.87008699f, 0.87309498f, 0.87607009f, 0.87901223f,
+    0.88192126f, 0.88479710f, 0.88763962f, 0.89044872f, 0.89322430f, 0.89596625f, 0.89867447f, 0.90134885f,
+    0.90398929f, 0.90659570f, 0.90916798f, 0.91170603f, 0.91420976f, 0.91667906f, 0.91911385f, 0.92151404f,
+    0.92387953f, 0.92621024f, 0.92850608f, 0.93076696f, 0.93299280f, 0.93518351f, 0.93733901f, 0.93945922f,
+    0.94154407f, 0.94359346f, 0.94560733f, 0.94758559f, 0.94952818f, 0.95143502f, 0.95330604f, 0.95514117f,
+    0.95694034f, 0.95870347f, 0.96043052f, 0.96212140f, 0.96377607f, 0.96539444f, 0.96697647f, 0.96852209f,
+    0.97003125f, 0.97150389f, 0.97293995f, 0.97433938f, 0.97570213f, 0.97702814f, 0.97831737f, 0.97956977f,
+    0.98078528f, 0.98196387f, 0.98310549f, 0.98421009f, 0.98527764f, 0.98630810f, 0.98730142f, 0.98825757f,
+    0.98917651f, 0.99005821f, 0.99090264f, 0.99170975f, 0.99247953f, 0.99321195f, 0.99390697f, 0.99456457f,
+    0.99518473f, 0.99576741f, 0.99631261f, 0.99682030f, 0.99729046f, 0.99772307f, 0.99811811f, 0.99847558f,
+    0.99879546f, 0.99907773f, 0.99932238f, 0.99952942f, 0.99969882f, 0.99983058f, 0.99992470f, 0.99998118f,
+    1.00000000f
+};
+
+// Linear interpolated sine of table index n (in quarter wave intervals) + fraction.
+static inline float sin_lookup (int32_t n, float fraction)
+{
+    uint_fast16_t k = n & (SIN_TABLE_SIZE - 1);
+    float value;
+
+    if(n & SIN_TABLE_SIZE) // Second and fourth quadrant are the mirror of the first
+        value = sin_table[SIN_TABLE_SIZE - k] + (sin_table[SIN_TABLE_SIZE - 1 - k] - sin_table[SIN_TABLE_SIZE - k]) * fraction;
+    else
+        value = sin_table[k] + (sin_table[k + 1] - sin_table[k]) * fraction;
+
+    return n & (SIN_TABLE_SIZE << 1) ? -value : value; // Third and fourth quadrant are negated
+}
+
+void sin_cos (float angle, float *sin_a, float *cos_a)
+{
+    float u = angle * (float)(SIN_TABLE_SIZE * 4 / (2.0 * M_PI)), idx = floorf(u);
+    int32_t n = (int32_t)idx;
+
+    u -= idx;
+    *sin_a = sin_lookup(n, u);
+    *cos_a = sin_lookup(n + SIN_TABLE_SIZE, u);
+}
+
+#else
+
+void sin_cos (float angle, float *sin_a, float *cos_a)
+{
+    *sin_a = sinf(angle);
+    *cos_a = cosf(angle);
+}
+
+#endif
+
 
 // calculate checksum byte for data
 uint8_t calc_checksum (uint8_t *data, uint32_t size) {
@@ -275,3 +425,80 @@ void dummy_handler (void)
 {
     // NOOP
 }
+
+void mpsc_init (mpsc_queue_t *queue, uint_fast16_t size, volatile uint_fast16_t *link, volatile uint_fast16_t *claimed)
+{
+    queue->size = size;
+    queue->link = link;
+    queue->claimed = claimed;
+
+    mpsc_reset(queue);
+}
+
+void mpsc_reset (mpsc_queue_t *queue)
+{
+    uint_fast16_t idx = queue->size + 2;
+
+    do {
+        idx--;
+        queue->link[idx] = MPSC_NIL;
+        queue->claimed[idx] = 0;
+    } while(idx);
+
+    queue->head = queue->tail = MPSC_STUB;
+}
+
+ISR_CODE int_fast16_t mpsc_reserve (mpsc_queue_t *queue)
+{
+    uint_fast16_t entry = 0;
+
+    // The claim flag is swapped in, the producer getting the previous value 0 back owns the entry.
+    do {
+        if(queue->claimed[entry] == 0 && hal.set_value_atomic(&queue->claimed[entry], 1) == 0)
+            return (int_fast16_t)entry;
+    } while(++entry < queue->size);
+
+    return -1;
+}
+
+ISR_CODE static void mpsc_link (mpsc_queue_t *queue, uint_fast16_t node)
+{
+    queue->link[node] = MPSC_NIL;
+    // Swap in the node as the new head, then link it from the previous head.
+    queue->link[hal.set_value_atomic(&queue->head, node)] = node;
+}
+
+ISR_CODE void mpsc_publish (mpsc_queue_t *queue, uint_fast16_t entry)
+{
+    mpsc_link(queue, entry + 2);
+}
+
+int_fast16_t mpsc_next (mpsc_queue_t *queue)
+{
+    uint_fast16_t tail = queue->tail, next = queue->link[tail];
+
+    if(tail == MPSC_STUB) {
+        if(next == MPSC_NIL)
+            return -1;
+        queue->tail = tail = next;
+        next = queue->link[next];
+    }
+
+    if(next == MPSC_NIL) {
+        // Last node in the list, the stub node is linked behind it so that it can be dequeued.
+        if(tail != queue->head)
+            return -1; // A producer is between swap and link.
+        mpsc_link(queue, MPSC_STUB);
+        if((next = queue->link[tail]) == MPSC_NIL)
+            return -1;
+    }
+
+    queue->tail = next;
+
+    return (int_fast16_t)(tail - 2);
+}
+
+void mpsc_release (mpsc_queue_t *queue, uint_fast16_t entry)
+{
+    queue->claimed[entry] = 0;
+}
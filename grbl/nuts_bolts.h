@@ -41,6 +41,7 @@
 
 #define TAN_30 0.57735f         // Used for threading calculations (60 degree inserts)
 #define RADDEG 0.0174532925f    // Radians per degree
+#define DEGRAD 57.2957795f      // Degrees per radian
 
 #define ABORTED (sys.abort || sys.cancel)
 
@@ -114,6 +115,8 @@ typedef struct {
 
 #define MAX_INT_DIGITS 8 // Maximum number of digits in int32 (and float)
 #define STRLEN_COORDVALUE (MAX_INT_DIGITS + N_DECIMAL_COORDVALUE_INCH + 1) // 8.4 format - excluding terminating null
+#define STRLEN_UINT32 10 // Maximum number of digits in uint32 - excluding terminating null
+#define MAX_PRECISION 10 // Maximum number of decimal places for float to string conversion
 
 // Useful macros
 #define clear_vector(a) memset(a, 0, sizeof(a))
@@ -137,12 +140,53 @@ typedef struct {
 #define bit_istrue(x, mask) ((x & (mask)) != 0)
 #define bit_isfalse(x, mask) ((x & (mask)) == 0)
 
+// Returns the index of the least significant set bit, x must be non zero.
+#ifdef __GNUC__
+#define bit_scan(x) ((uint_fast8_t)__builtin_ctzl(x))
+#else
+static inline uint_fast8_t bit_scan (uint32_t x)
+{
+    uint_fast8_t idx = 0;
+
+    while(!(x & 1)) {
+        x >>= 1;
+        idx++;
+    }
+
+    return idx;
+}
+#endif
+
+// Table lookup sine and cosine for processors without a floating point unit, see config.h.
+#ifndef ARC_TRIG_TABLE
+#if defined(__MSP430__) || (defined(__arm__) && !defined(__ARM_FP))
+#define ARC_TRIG_TABLE 1
+#else
+#define ARC_TRIG_TABLE 0
+#endif
+#endif
+
+// Double precision accumulation in read_float() for processors with a double precision FPU, see config.h.
+#ifndef READ_FLOAT_DOUBLE
+#if defined(__arm__) && defined(__ARM_FP) && (__ARM_FP & 0x08)
+#define READ_FLOAT_DOUBLE 1
+#else
+#define READ_FLOAT_DOUBLE 0
+#endif
+#endif
+
 // Converts an uint32 variable to string.
 char *uitoa (uint32_t n);
 
 // Converts a float variable to string with the specified number of decimal places.
 char *ftoa (float n, uint8_t decimal_places);
 
+// Converts an uint32 variable to string in the buffer pointed to by s, returns pointer to the terminating null.
+char *uitoa_r (char *s, uint32_t n);
+
+// Converts a float variable to string in the buffer pointed to by s, returns pointer to the terminating null.
+char *ftoa_r (char *s, float n, uint8_t decimal_places);
+
 // Returns true if float value is a whole number (integer)
 bool isintf (float value);
 
@@ -156,9 +200,56 @@ void delay_sec(float seconds, delaymode_t mode);
 
 float convert_delta_vector_to_unit_vector(float *vector);
 
+// Integer square root, rounded down.
+uint32_t isqrt (uint32_t value);
+
+// Calculates sine and cosine of angle (radians), by table lookup when ARC_TRIG_TABLE is enabled.
+void sin_cos (float angle, float *sin_a, float *cos_a);
+
 // calculate checksum byte for data
 uint8_t calc_checksum (uint8_t *data, uint32_t size);
 
+// Lock-free multi producer, single consumer queue of entry indices. Entries may be enqueued from any interrupt
+// priority and the foreground, only the atomic exchange provided by hal.set_value_atomic is required.
+// Entries are linked in enqueue order through per node links, node 1 is a stub node and node n + 2 holds entry n.
+// NOTE: arrays pointed to by link and claimed must have room for size + 2 elements.
+#define MPSC_NIL  0
+#define MPSC_STUB 1
+
+typedef struct {
+    volatile uint_fast16_t head;        // Last enqueued node, swapped in by producers
+    volatile uint_fast16_t tail;        // Next node to dequeue, only accessed by the consumer
+    uint_fast16_t size;                 // Number of entries
+    volatile uint_fast16_t *link;       // Per node link to the next node, MPSC_NIL if none
+    volatile uint_fast16_t *claimed;    // Per entry claim flag
+} mpsc_queue_t;
+
+// Static initializer, link and claimed are to be static arrays of size + 2 elements.
+#define MPSC_QUEUE_INIT(size_, link_, claimed_) { .head = MPSC_STUB, .tail = MPSC_STUB, .size = size_, .link = link_, .claimed = claimed_ }
+
+// Runtime initializer, for queues that cannot be statically initialized. Leaves the queue empty.
+void mpsc_init (mpsc_queue_t *queue, uint_fast16_t size, volatile uint_fast16_t *link, volatile uint_fast16_t *claimed);
+
+// Empties the queue, not to be called while producers may be active.
+void mpsc_reset (mpsc_queue_t *queue);
+
+// Claims a free entry for the caller to fill in, returns -1 if the queue is full.
+int_fast16_t mpsc_reserve (mpsc_queue_t *queue);
+
+// Enqueues an entry claimed by mpsc_reserve().
+void mpsc_publish (mpsc_queue_t *queue, uint_fast16_t entry);
+
+// Dequeues the next entry, returns -1 if none. To be released by mpsc_release() when its data is consumed.
+// NOTE: an entry being enqueued by a preempted producer, and any entries queued after it, are not available until
+//       the producer resumes.
+int_fast16_t mpsc_next (mpsc_queue_t *queue);
+
+// Returns an entry dequeued by mpsc_next() to the pool of free entries.
+void mpsc_release (mpsc_queue_t *queue, uint_fast16_t entry);
+
+// Returns true if entries are enqueued.
+#define mpsc_pending(queue) ((queue)->head != (queue)->tail)
+
 void dummy_handler (void);
 
 #endif
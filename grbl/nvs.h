@@ -23,12 +23,27 @@
 #ifndef _NVS_H_
 #define _NVS_H_
 
+#define NVS_CRC_BYTES 1
+
+#ifdef N_TOOLS
+#define NVS_SIZE_TOOL_TABLE (N_TOOLS * (sizeof(tool_data_t) + NVS_CRC_BYTES))
+// Tool tables with more than 8 entries are stored above the 1KB core area, ahead of the driver area.
+#if N_TOOLS > 8
+#define NVS_TOOL_TABLE_EXTENDED
+#endif
+#endif
+
+#ifdef NVS_TOOL_TABLE_EXTENDED
+#ifndef NVS_SIZE
+#define NVS_SIZE (2048 + NVS_SIZE_TOOL_TABLE)
+#endif
+#define GRBL_NVS_SIZE (1024 + NVS_SIZE_TOOL_TABLE)
+#else
 #ifndef NVS_SIZE
 #define NVS_SIZE 2048
 #endif
-
 #define GRBL_NVS_SIZE 1024
-#define NVS_CRC_BYTES 1
+#endif
 
 // Define persistent storage memory address location values for Grbl settings and parameters
 // NOTE: 1KB persistent storage is the minimum required. The upper half is reserved for parameters and
@@ -38,8 +53,10 @@
 #define NVS_ADDR_PARAMETERS     512U
 #define NVS_ADDR_BUILD_INFO     942U
 #define NVS_ADDR_STARTUP_BLOCK  (NVS_ADDR_BUILD_INFO - 1 - N_STARTUP_LINE * (sizeof(stored_line_t) + NVS_CRC_BYTES))
-#ifdef N_TOOLS
-#define NVS_ADDR_TOOL_TABLE     (NVS_ADDR_PARAMETERS - 1 - N_TOOLS * (sizeof(tool_data_t) + NVS_CRC_BYTES))
+#ifdef NVS_TOOL_TABLE_EXTENDED
+#define NVS_ADDR_TOOL_TABLE     1024U
+#elif defined(N_TOOLS)
+#define NVS_ADDR_TOOL_TABLE     (NVS_ADDR_PARAMETERS - 1 - NVS_SIZE_TOOL_TABLE)
 #endif
 
 typedef enum {
@@ -62,6 +79,18 @@ typedef enum {
     NVS_TransferResult_OK,
 } nvs_transfer_result_t;
 
+// Flash journal entry points, used by the RAM buffer when ENABLE_NVS_JOURNAL is enabled.
+// Sectors are numbered from 0, offsets are relative to the start of the sector.
+// NOTE: offsets and sizes passed to program() are multiples of program_unit.
+typedef struct {
+    uint32_t sector_size;       // Size of an erasable sector in bytes
+    uint8_t sectors;            // Number of sectors reserved for the journal, at least 2
+    uint8_t program_unit;       // Smallest programmable unit in bytes: 1, 2, 4 or 8
+    bool (*erase)(uint_fast8_t sector);
+    bool (*program)(uint_fast8_t sector, uint32_t offset, const uint8_t *data, uint32_t size);
+    bool (*read)(uint_fast8_t sector, uint32_t offset, uint8_t *data, uint32_t size);
+} nvs_journal_io_t;
+
 typedef struct {
     nvs_type type;
     uint16_t size;
@@ -72,6 +101,9 @@ typedef struct {
     nvs_transfer_result_t (*memcpy_from_nvs)(uint8_t *destination, uint32_t source, uint32_t size, bool with_checksum);
     bool (*memcpy_from_flash)(uint8_t *dest);
     bool (*memcpy_to_flash)(uint8_t *source);
+#ifdef ENABLE_NVS_JOURNAL
+    nvs_journal_io_t journal;
+#endif
 } nvs_io_t;
 
 #endif
@@ -27,17 +27,25 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
 
 #include "hal.h"
 #include "nvs_buffer.h"
 #include "protocol.h"
 
-static uint8_t *nvsbuffer = NULL;
-static nvs_io_t physical_nvs;
-static bool dirty;
+static THREAD_LOCAL uint8_t *nvsbuffer = NULL;
+static THREAD_LOCAL nvs_io_t physical_nvs;
+static THREAD_LOCAL bool dirty;
 
-settings_dirty_t settings_dirty;
+THREAD_LOCAL settings_dirty_t settings_dirty;
+
+#ifdef ENABLE_NVS_DEFERRED_SYNC
+static THREAD_LOCAL struct {
+    uint32_t first; // Time of first change since last sync
+    uint32_t last;  // Time of last change
+} dirty_ms;
+#endif
 
 typedef struct {
     uint16_t addr;
@@ -46,32 +54,15 @@ typedef struct {
 } emap_t;
 
 #define NVS_GROUP_GLOBAL 0
-#define NVS_GROUP_TOOLS 1
 #define NVS_GROUP_PARAMETERS 2
 #define NVS_GROUP_STARTUP 3
 #define NVS_GROUP_BUILD 4
 
 #define PARAMETER_ADDR(n) (NVS_ADDR_PARAMETERS + n * (sizeof(coord_data_t) + NVS_CRC_BYTES))
 #define STARTLINE_ADDR(n) (NVS_ADDR_STARTUP_BLOCK + n * (sizeof(stored_line_t) + NVS_CRC_BYTES))
-#ifdef N_TOOLS
-#define TOOL_ADDR(n) (NVS_ADDR_TOOL_TABLE + n * (sizeof(tool_data_t) + NVS_CRC_BYTES))
-#endif
 
 static const emap_t target[] = {
     {NVS_ADDR_GLOBAL, NVS_GROUP_GLOBAL, 0},
-#ifdef N_TOOLS
-    {TOOL_ADDR(0), NVS_GROUP_TOOLS, 0},
-    {TOOL_ADDR(1), NVS_GROUP_TOOLS, 1},
-    {TOOL_ADDR(2), NVS_GROUP_TOOLS, 2},
-    {TOOL_ADDR(3), NVS_GROUP_TOOLS, 3},
-    {TOOL_ADDR(4), NVS_GROUP_TOOLS, 4},
-    {TOOL_ADDR(5), NVS_GROUP_TOOLS, 5},
-    {TOOL_ADDR(6), NVS_GROUP_TOOLS, 6},
-    {TOOL_ADDR(7), NVS_GROUP_TOOLS, 7},
-#if N_TOOL > 8
-#error Increase number of tool entries!
-#endif
-#endif
     {PARAMETER_ADDR(0), NVS_GROUP_PARAMETERS, 0},
     {PARAMETER_ADDR(1), NVS_GROUP_PARAMETERS, 1},
     {PARAMETER_ADDR(2), NVS_GROUP_PARAMETERS, 2},
@@ -129,11 +120,27 @@ static nvs_transfer_result_t memcpy_to_ram (uint32_t destination, uint8_t *sourc
 
         uint8_t idx = 0;
 
+#ifdef ENABLE_NVS_DEFERRED_SYNC
+        if(hal.get_elapsed_ticks) {
+            dirty_ms.last = hal.get_elapsed_ticks();
+            if(!settings_dirty.is_dirty)
+                dirty_ms.first = dirty_ms.last;
+        }
+#endif
+
         settings_dirty.is_dirty = true;
 
-        if(hal.nvs.driver_area.address && destination == hal.nvs.driver_area.address)
+        if(hal.nvs.driver_area.address && destination >= hal.nvs.driver_area.address &&
+            destination < hal.nvs.driver_area.address + hal.nvs.driver_area.size)
             settings_dirty.driver_settings = true;
 
+#ifdef N_TOOLS
+        // Tool entries are located by offset rather than by lookup, the table may be large.
+        else if(destination >= NVS_ADDR_TOOL_TABLE && destination < NVS_ADDR_TOOL_TABLE + NVS_SIZE_TOOL_TABLE) {
+            uint_fast16_t tool = (destination - NVS_ADDR_TOOL_TABLE) / (sizeof(tool_data_t) + NVS_CRC_BYTES);
+            settings_dirty.tool_data[tool >> 5] |= bit((tool & 0x1F));
+        }
+#endif
         else {
 
             do {
@@ -146,11 +153,6 @@ static nvs_transfer_result_t memcpy_to_ram (uint32_t destination, uint8_t *sourc
                 case NVS_GROUP_GLOBAL:
                     settings_dirty.global_settings = true;
                     break;
-#ifdef N_TOOLS
-                case NVS_GROUP_TOOLS:
-                    settings_dirty.tool_data |= (1 << target[idx].offset);
-                    break;
-#endif
                 case NVS_GROUP_PARAMETERS:
                     settings_dirty.coord_data |= (1 << target[idx].offset);
                     break;
@@ -169,6 +171,250 @@ static nvs_transfer_result_t memcpy_to_ram (uint32_t destination, uint8_t *sourc
     return NVS_TransferResult_OK;
 }
 
+#ifdef ENABLE_NVS_JOURNAL
+
+// Journal layout, each sector starts with a header followed by records appended in order:
+//   header: magic, sequence number - incremented for each sector written
+//   record: RAM buffer address, data size, checksum, data - padded to the program unit with 0xFF
+// Changes are written as transactions, data records for a region followed by a commit record. The first
+// transaction in a sector is a snapshot of the whole RAM buffer. Erased flash terminates the record list.
+
+#define JOURNAL_MAGIC           0x4C4E524AUL    // "JRNL"
+#define JOURNAL_RECORD_DATA     28              // Max data bytes per record
+#define JOURNAL_ADDR_COMMIT     0xFFF0          // Address of commit records
+#define JOURNAL_ADDR_ERASED     0xFFFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+} journal_header_t;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t size;
+    uint8_t checksum;
+    uint8_t data[JOURNAL_RECORD_DATA];
+} journal_record_t;
+
+typedef struct {
+    uint32_t committed; // Offset past the last commit record, 0 if none
+    uint32_t end;       // Offset past the last valid record
+    bool clean;         // True if the record list is terminated by erased flash
+} journal_scan_t;
+
+static THREAD_LOCAL struct {
+    bool enabled;
+    uint_fast8_t sector;    // Active sector
+    uint32_t sequence;      // Sequence number of the active sector
+    uint32_t offset;        // Write offset in the active sector
+} journal = {0};
+
+static inline uint32_t journal_align (uint32_t length)
+{
+    return (length + physical_nvs.journal.program_unit - 1) & ~(uint32_t)(physical_nvs.journal.program_unit - 1);
+}
+
+static inline uint32_t journal_record_length (uint_fast8_t size)
+{
+    return journal_align(offsetof(journal_record_t, data) + size);
+}
+
+static inline uint32_t journal_image_size (void)
+{
+    return GRBL_NVS_SIZE + hal.nvs.driver_area.size;
+}
+
+// Returns the journal space needed for a transaction of size bytes, including the commit record.
+static uint32_t journal_transaction_length (uint32_t size)
+{
+    return (size / JOURNAL_RECORD_DATA) * journal_record_length(JOURNAL_RECORD_DATA) +
+            (size % JOURNAL_RECORD_DATA ? journal_record_length(size % JOURNAL_RECORD_DATA) : 0) +
+             journal_record_length(0);
+}
+
+static uint8_t journal_checksum (journal_record_t *record)
+{
+    uint8_t checksum = record->checksum, result;
+
+    record->checksum = 0;
+    result = calc_checksum((uint8_t *)record, offsetof(journal_record_t, data) + record->size);
+    record->checksum = checksum;
+
+    return result;
+}
+
+// Programs a record at the write offset of the active sector.
+static bool journal_put (uint16_t addr, const uint8_t *data, uint_fast8_t size)
+{
+    journal_record_t record;
+    uint32_t length = journal_record_length(size);
+
+    if(journal.offset + length > physical_nvs.journal.sector_size)
+        return false;
+
+    memset(&record, 0xFF, sizeof(journal_record_t));
+    record.addr = addr;
+    record.size = size;
+    if(size)
+        memcpy(record.data, data, size);
+    record.checksum = journal_checksum(&record);
+
+    if(!physical_nvs.journal.program(journal.sector, journal.offset, (uint8_t *)&record, length))
+        return false;
+
+    journal.offset += length;
+
+    return true;
+}
+
+// Programs a region of the RAM buffer as a transaction.
+static bool journal_put_region (uint32_t addr, uint32_t size)
+{
+    uint_fast8_t length;
+
+    while(size) {
+        length = size > JOURNAL_RECORD_DATA ? JOURNAL_RECORD_DATA : size;
+        if(!journal_put((uint16_t)addr, nvsbuffer + addr, length))
+            return false;
+        addr += length;
+        size -= length;
+    }
+
+    return journal_put(JOURNAL_ADDR_COMMIT, NULL, 0);
+}
+
+// Writes a snapshot of the RAM buffer to the next sector which then becomes the active sector.
+static bool journal_compact (void)
+{
+    uint_fast8_t sector = (journal.sector + 1) % physical_nvs.journal.sectors;
+    journal_header_t header = {
+        .magic = JOURNAL_MAGIC,
+        .sequence = journal.sequence + 1
+    };
+    uint8_t data[journal_align(sizeof(journal_header_t))];
+
+    memset(data, 0xFF, sizeof(data));
+    memcpy(data, &header, sizeof(journal_header_t));
+
+    if(!(physical_nvs.journal.erase(sector) && physical_nvs.journal.program(sector, 0, data, sizeof(data))))
+        return false;
+
+    journal.sector = sector;
+    journal.sequence = header.sequence;
+    journal.offset = sizeof(data);
+
+    return journal_put_region(0, journal_image_size());
+}
+
+// Scans the records of a sector, applies data records up to and including the offset limit to the RAM buffer.
+static journal_scan_t journal_scan (uint_fast8_t sector, uint32_t limit)
+{
+    journal_record_t record;
+    journal_scan_t scan = {
+        .end = journal_align(sizeof(journal_header_t))
+    };
+    uint32_t length;
+
+    while(scan.end + journal_record_length(0) <= physical_nvs.journal.sector_size) {
+
+        if(!physical_nvs.journal.read(sector, scan.end, (uint8_t *)&record, offsetof(journal_record_t, data)))
+            break;
+
+        if((scan.clean = record.addr == JOURNAL_ADDR_ERASED))
+            break;
+
+        length = journal_record_length(record.size);
+
+        if(record.size > JOURNAL_RECORD_DATA || scan.end + length > physical_nvs.journal.sector_size ||
+            (record.addr != JOURNAL_ADDR_COMMIT && record.addr + record.size > journal_image_size()))
+            break;
+
+        if(record.size && !physical_nvs.journal.read(sector, scan.end + offsetof(journal_record_t, data), record.data, record.size))
+            break;
+
+        if(journal_checksum(&record) != record.checksum)
+            break;
+
+        scan.end += length;
+
+        if(record.addr == JOURNAL_ADDR_COMMIT)
+            scan.committed = scan.end;
+        else if(scan.end <= limit)
+            memcpy(nvsbuffer + record.addr, record.data, record.size);
+    }
+
+    return scan;
+}
+
+// Restores the RAM buffer from the newest sector with a complete snapshot, returns false if none found.
+static bool journal_replay (void)
+{
+    bool found = false;
+    uint_fast8_t sector, tried = 0;
+    uint32_t best;
+    journal_header_t header;
+    journal_scan_t scan;
+
+    while(!found) {
+
+        // Find the newest sector not tried yet, sequence numbers are compared wrap around safe.
+        best = 0;
+        for(sector = 0; sector < physical_nvs.journal.sectors; sector++) {
+            if(!(tried & bit(sector)) && physical_nvs.journal.read(sector, 0, (uint8_t *)&header, sizeof(journal_header_t)) &&
+                 header.magic == JOURNAL_MAGIC && (!best || (int32_t)(header.sequence - journal.sequence) > 0)) {
+                best = sector + 1;
+                journal.sequence = header.sequence;
+            }
+        }
+
+        if(!best)
+            break;
+
+        sector = best - 1;
+        tried |= bit(sector);
+
+        if((scan = journal_scan(sector, 0)).committed) {
+            journal_scan(sector, scan.committed);
+            journal.sector = sector;
+            journal.offset = scan.end;
+            found = true;
+            // Write a new snapshot if the last transaction is incomplete or the record list is damaged.
+            if(!scan.clean || scan.end != scan.committed)
+                journal_compact();
+        }
+    }
+
+    return found;
+}
+
+// Checks that the driver provides the journal entry points and that the sectors are large enough.
+static bool journal_init (void)
+{
+    nvs_journal_io_t *io = &physical_nvs.journal;
+
+    journal.enabled = io->erase && io->program && io->read && io->sectors >= 2 && io->sectors <= 8 &&
+                       (io->program_unit == 1 || io->program_unit == 2 || io->program_unit == 4 || io->program_unit == 8) &&
+                        io->sector_size >= 2 * (journal_align(sizeof(journal_header_t)) + journal_transaction_length(journal_image_size()));
+
+    return journal.enabled;
+}
+
+// Appends a region of the RAM buffer to the journal, compacts the journal to the next sector when full.
+// NOTE: source must point to the region in the RAM buffer, the checksum is already included.
+static nvs_transfer_result_t journal_write (uint32_t destination, uint8_t *source, uint32_t size, bool with_checksum)
+{
+    bool ok;
+
+    if(journal.offset + journal_transaction_length(size) > physical_nvs.journal.sector_size)
+        ok = journal_compact(); // Snapshot includes the region
+    else if(!(ok = journal_put_region(destination, size)))
+        ok = journal_compact();
+
+    return ok ? NVS_TransferResult_OK : NVS_TransferResult_Failed;
+}
+
+#endif // ENABLE_NVS_JOURNAL
+
 static nvs_transfer_result_t memcpy_from_ram (uint8_t *destination, uint32_t source, uint32_t size, bool with_checksum)
 {
     if(hal.nvs.driver_area.address && source > hal.nvs.driver_area.address + hal.nvs.driver_area.size)
@@ -197,6 +443,12 @@ bool nvs_buffer_alloc (void)
     return nvsbuffer != NULL;
 }
 
+// Returns the size of the RAM buffer, 0 if not allocated.
+uint32_t nvs_buffer_size (void)
+{
+    return nvsbuffer ? NVS_SIZE : 0;
+}
+
 //
 // Switch over to RAM based copy.
 // Changes to RAM based copy will be written to physical storage when Grbl is in IDLE state.
@@ -206,7 +458,18 @@ bool nvs_buffer_init (void)
 
         memcpy(&physical_nvs, &hal.nvs, sizeof(nvs_io_t)); // save pointers to physical storage handler functions
 
+#ifdef ENABLE_NVS_JOURNAL
+        bool snapshot = false;
+#endif
+
         // Copy physical storage content to RAM when available
+#ifdef ENABLE_NVS_JOURNAL
+        if(physical_nvs.type == NVS_Flash && journal_init()) {
+            // Fall back to the flash image if the journal is empty, a snapshot is then written to the journal.
+            if(!journal_replay() && (snapshot = physical_nvs.memcpy_from_flash != NULL))
+                physical_nvs.memcpy_from_flash(nvsbuffer);
+        } else
+#endif
         if(physical_nvs.type == NVS_Flash)
             physical_nvs.memcpy_from_flash(nvsbuffer);
         else if(physical_nvs.type != NVS_None)
@@ -225,12 +488,21 @@ bool nvs_buffer_init (void)
         // and write out to physical storage when available.
         if(physical_nvs.type == NVS_None || ram_get_byte(0) != SETTINGS_VERSION) {
             settings_restore(settings_all);
+#ifdef ENABLE_NVS_JOURNAL
+            if(journal.enabled)
+                journal_compact();
+            else
+#endif
             if(physical_nvs.type == NVS_Flash)
                 physical_nvs.memcpy_to_flash(nvsbuffer);
-            else
+            else if(physical_nvs.type != NVS_None)
                 physical_nvs.memcpy_to_nvs(0, nvsbuffer, GRBL_NVS_SIZE + hal.nvs.driver_area.size, false);
             grbl.report.status_message(Status_SettingReadFail);
         }
+#ifdef ENABLE_NVS_JOURNAL
+        else if(snapshot)
+            journal_compact();
+#endif
     } else
         protocol_enqueue_rt_command(nvs_warning);
 
@@ -244,7 +516,7 @@ bool nvs_buffer_init (void)
 // NOTE: allocation has to be done before content is copied from physical storage.
 uint32_t nvs_alloc (size_t size)
 {
-    static uint8_t *mem_address;
+    static THREAD_LOCAL uint8_t *mem_address;
 
     uint32_t addr = 0;
 
@@ -259,7 +531,7 @@ uint32_t nvs_alloc (size_t size)
 
     size += NVS_CRC_BYTES; // add room for checksum.
     if(hal.nvs.driver_area.size + size < (NVS_SIZE - GRBL_NVS_SIZE)) {
-        mem_address = (uint8_t *)((uint32_t)(mem_address - 1) | 0x03) + 1; // Align to word boundary
+        mem_address = (uint8_t *)((uintptr_t)(mem_address - 1) | 0x03) + 1; // Align to word boundary
         addr = mem_address - nvsbuffer;
         mem_address += size;
         hal.nvs.driver_area.size = mem_address - hal.nvs.driver_area.mem_address;
@@ -275,13 +547,20 @@ void nvs_buffer_sync_physical (void)
     if(!settings_dirty.is_dirty)
         return;
 
-    if(physical_nvs.memcpy_to_nvs) {
+    nvs_transfer_result_t (*memcpy_to_nvs)(uint32_t destination, uint8_t *source, uint32_t size, bool with_checksum) = physical_nvs.memcpy_to_nvs;
+
+#ifdef ENABLE_NVS_JOURNAL
+    if(journal.enabled)
+        memcpy_to_nvs = journal_write;
+#endif
+
+    if(memcpy_to_nvs) {
 
         if(settings_dirty.build_info)
-            settings_dirty.build_info = physical_nvs.memcpy_to_nvs(NVS_ADDR_BUILD_INFO, (uint8_t *)(nvsbuffer + NVS_ADDR_BUILD_INFO), sizeof(stored_line_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
+            settings_dirty.build_info = memcpy_to_nvs(NVS_ADDR_BUILD_INFO, (uint8_t *)(nvsbuffer + NVS_ADDR_BUILD_INFO), sizeof(stored_line_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
 
         if(settings_dirty.global_settings)
-            settings_dirty.global_settings = physical_nvs.memcpy_to_nvs(NVS_ADDR_GLOBAL, (uint8_t *)(nvsbuffer + NVS_ADDR_GLOBAL), sizeof(settings_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
+            settings_dirty.global_settings = memcpy_to_nvs(NVS_ADDR_GLOBAL, (uint8_t *)(nvsbuffer + NVS_ADDR_GLOBAL), sizeof(settings_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
 
         uint_fast8_t idx = N_STARTUP_LINE, offset;
         if(settings_dirty.startup_lines) do {
@@ -289,7 +568,7 @@ void nvs_buffer_sync_physical (void)
             if(bit_istrue(settings_dirty.startup_lines, bit(idx))) {
                 bit_false(settings_dirty.startup_lines, bit(idx));
                 offset = NVS_ADDR_STARTUP_BLOCK + idx * (sizeof(stored_line_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(stored_line_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
+                if(memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(stored_line_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
                     bit_false(settings_dirty.startup_lines, bit(idx));
             }
         } while(idx);
@@ -298,35 +577,44 @@ void nvs_buffer_sync_physical (void)
         if(settings_dirty.coord_data) do {
             if(bit_istrue(settings_dirty.coord_data, bit(idx))) {
                 offset = NVS_ADDR_PARAMETERS + idx * (sizeof(coord_data_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(coord_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
+                if(memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(coord_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
                     bit_false(settings_dirty.coord_data, bit(idx));
             }
         } while(idx--);
 
         if(settings_dirty.driver_settings) {
             if(hal.nvs.driver_area.size > 0)
-                settings_dirty.driver_settings = physical_nvs.memcpy_to_nvs(hal.nvs.driver_area.address, (uint8_t *)(nvsbuffer + hal.nvs.driver_area.address), hal.nvs.driver_area.size, false) != NVS_TransferResult_OK;
+                settings_dirty.driver_settings = memcpy_to_nvs(hal.nvs.driver_area.address, (uint8_t *)(nvsbuffer + hal.nvs.driver_area.address), hal.nvs.driver_area.size, false) != NVS_TransferResult_OK;
             else
                 settings_dirty.driver_settings = false;
         }
 
 #ifdef N_TOOLS
-        idx = N_TOOLS;
-        if(settings_dirty.tool_data) do {
-            idx--;
-            if(bit_istrue(settings_dirty.tool_data, bit(idx))) {
-                offset = NVS_ADDR_TOOL_TABLE + idx * (sizeof(tool_data_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(tool_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
-                    bit_false(settings_dirty.tool_data, bit(idx));
+        bool tools_dirty = false;
+        uint_fast16_t tool, word = sizeof(settings_dirty.tool_data) / sizeof(uint32_t);
+
+        do {
+            word--;
+            // Only entries changed since the last sync are written, whole words of unchanged entries are skipped.
+            if(settings_dirty.tool_data[word]) {
+                tool = word << 5;
+                do {
+                    if(bit_istrue(settings_dirty.tool_data[word], bit((tool & 0x1F)))) {
+                        uint32_t addr = NVS_ADDR_TOOL_TABLE + tool * (sizeof(tool_data_t) + NVS_CRC_BYTES);
+                        if(memcpy_to_nvs(addr, (uint8_t *)(nvsbuffer + addr), sizeof(tool_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
+                            bit_false(settings_dirty.tool_data[word], bit((tool & 0x1F)));
+                    }
+                } while((++tool & 0x1F) && tool < N_TOOLS);
+                tools_dirty |= settings_dirty.tool_data[word] != 0;
             }
-        } while(idx);
+        } while(word);
 #endif
         settings_dirty.is_dirty = settings_dirty.coord_data ||
                                    settings_dirty.global_settings ||
                                     settings_dirty.driver_settings ||
                                      settings_dirty.startup_lines ||
 #ifdef N_TOOLS
-                                      settings_dirty.tool_data ||
+                                      tools_dirty ||
 #endif
                                        settings_dirty.build_info;
 
@@ -336,6 +624,32 @@ void nvs_buffer_sync_physical (void)
     }
 }
 
+#ifdef ENABLE_NVS_DEFERRED_SYNC
+
+// Write RAM changes to physical storage when due, to be called when the machine is idle.
+// Changes are written when no changes have been made for NVS_SYNC_DELAY ms, if a program is running
+// only when the first unwritten change is older than NVS_SYNC_DEADLINE ms.
+void nvs_buffer_sync_deferred (bool program_running)
+{
+    if(!settings_dirty.is_dirty)
+        return;
+
+    if(hal.get_elapsed_ticks) {
+
+        uint32_t ms = hal.get_elapsed_ticks();
+
+        if(program_running
+            ? (ms - dirty_ms.first) < NVS_SYNC_DEADLINE
+            : ((ms - dirty_ms.last) < NVS_SYNC_DELAY && (ms - dirty_ms.first) < NVS_SYNC_DEADLINE))
+            return;
+    } else if(program_running)
+        return;
+
+    nvs_buffer_sync_physical();
+}
+
+#endif
+
 nvs_io_t *nvs_buffer_get_physical (void)
 {
     return hal.nvs.type == NVS_Emulated ? &physical_nvs : &hal.nvs;
@@ -363,6 +677,14 @@ void nvs_memmap (void)
     strcat(buf, uitoa(N_CoordinateSystems * (sizeof(coord_data_t) + NVS_CRC_BYTES)));
     report_message(buf, Message_Plain);
 
+#ifdef N_TOOLS
+    strcpy(buf, "Tool table: ");
+    strcat(buf, uitoa(NVS_ADDR_TOOL_TABLE));
+    strcat(buf, " ");
+    strcat(buf, uitoa(NVS_SIZE_TOOL_TABLE));
+    report_message(buf, Message_Plain);
+
+#endif
     strcpy(buf, "Startup block: ");
     strcat(buf, uitoa(NVS_ADDR_STARTUP_BLOCK));
     strcat(buf, " ");
@@ -31,16 +31,29 @@ typedef struct {
     uint8_t startup_lines;
     uint16_t coord_data;
 #ifdef N_TOOLS
-    uint16_t tool_data;
+    uint32_t tool_data[(N_TOOLS + 31) / 32]; // Bitmap, bit n is tool n + 1
 #endif
 } settings_dirty_t;
 
-extern settings_dirty_t settings_dirty;
+extern THREAD_LOCAL settings_dirty_t settings_dirty;
+
+#ifdef ENABLE_NVS_DEFERRED_SYNC
+#ifndef NVS_SYNC_DELAY
+#define NVS_SYNC_DELAY 1000     // ms
+#endif
+#ifndef NVS_SYNC_DEADLINE
+#define NVS_SYNC_DEADLINE 10000 // ms
+#endif
+#endif
 
 bool nvs_buffer_init (void);
 bool nvs_buffer_alloc (void);
 uint32_t nvs_alloc (size_t size);
+uint32_t nvs_buffer_size (void);
 void nvs_buffer_sync_physical (void);
+#ifdef ENABLE_NVS_DEFERRED_SYNC
+void nvs_buffer_sync_deferred (bool program_running);
+#endif
 nvs_io_t *nvs_buffer_get_physical (void);
 void nvs_memmap (void);
 
@@ -22,64 +22,73 @@
 */
 
 #include "grbl.h"
+#include "nuts_bolts.h"
 #include "override.h"
 
+// Override commands may be enqueued from several interrupt handlers, the queues are lock-free multi producer queues.
 typedef struct {
-    volatile uint_fast8_t head;
-    volatile uint_fast8_t tail;
+    mpsc_queue_t queue;
+    volatile uint_fast16_t link[OVERRIDE_BUFSIZE + 2];
+    volatile uint_fast16_t claimed[OVERRIDE_BUFSIZE + 2];
     uint8_t buf[OVERRIDE_BUFSIZE];
 } override_queue_t;
 
-static override_queue_t feed = {0}, accessory = {0};
+// NOTE: initialized at runtime by init_override_buffers() since the queues may be thread local data.
+static THREAD_LOCAL override_queue_t feed, accessory;
 
-ISR_CODE void enqueue_feed_override (uint8_t cmd)
+ISR_CODE static void enqueue_override (override_queue_t *overrides, uint8_t cmd)
 {
-    uint_fast8_t bptr = (feed.head + 1) & (OVERRIDE_BUFSIZE - 1);    // Get next head pointer
+    int_fast16_t entry;
 
-    if(bptr != feed.tail) {         // If not buffer full
-        feed.buf[feed.head] = cmd;  // add data to buffer
-        feed.head = bptr;           // and update pointer
+    if((entry = mpsc_reserve(&overrides->queue)) >= 0) {    // If not buffer full
+        overrides->buf[entry] = cmd;                        // add data to buffer
+        mpsc_publish(&overrides->queue, entry);             // and link it in
     }
 }
 
 // Returns 0 if no commands enqueued
-uint8_t get_feed_override (void)
+static uint8_t get_override (override_queue_t *overrides)
 {
     uint8_t data = 0;
-    uint_fast8_t bptr = feed.tail;
+    int_fast16_t entry;
 
-    if(bptr != feed.head) {
-        data = feed.buf[bptr++];                    // Get next character, increment tmp pointer
-        feed.tail = bptr & (OVERRIDE_BUFSIZE - 1);  // and update pointer
+    if((entry = mpsc_next(&overrides->queue)) >= 0) {
+        data = overrides->buf[entry];
+        mpsc_release(&overrides->queue, entry);
     }
 
     return data;
 }
 
-ISR_CODE void enqueue_accessory_override (uint8_t cmd)
+ISR_CODE void enqueue_feed_override (uint8_t cmd)
 {
-    uint_fast8_t bptr = (accessory.head + 1) & (OVERRIDE_BUFSIZE - 1);    // Get next head pointer
+    enqueue_override(&feed, cmd);
+}
 
-    if(bptr != accessory.tail) {                // If not buffer full
-        accessory.buf[accessory.head] = cmd;    // add data to buffer
-        accessory.head = bptr;                  // and update pointer
-    }
+// Returns 0 if no commands enqueued
+uint8_t get_feed_override (void)
+{
+    return get_override(&feed);
+}
+
+ISR_CODE void enqueue_accessory_override (uint8_t cmd)
+{
+    enqueue_override(&accessory, cmd);
 }
 
 // Returns 0 if no commands enqueued
 uint8_t get_accessory_override (void)
 {
-    uint8_t data = 0;
-    uint_fast8_t bptr = accessory.tail;
-
-    if(bptr != accessory.head) {
-        data = accessory.buf[bptr++];                   // Get next character, increment tmp pointer
-        accessory.tail = bptr & (OVERRIDE_BUFSIZE - 1); // and update pointer
-    }
+    return get_override(&accessory);
+}
 
-    return data;
+void init_override_buffers (void)
+{
+    mpsc_init(&feed.queue, OVERRIDE_BUFSIZE, feed.link, feed.claimed);
+    mpsc_init(&accessory.queue, OVERRIDE_BUFSIZE, accessory.link, accessory.claimed);
 }
 
 void flush_override_buffers () {
-    feed.head = feed.tail = accessory.head = accessory.tail = 0;
+    mpsc_reset(&feed.queue);
+    mpsc_reset(&accessory.queue);
 }
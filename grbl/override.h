@@ -25,9 +25,10 @@
 #define _OVERRIDE_H_
 
 #ifndef OVERRIDE_BUFSIZE
-#define OVERRIDE_BUFSIZE 16 // must be a power of 2
+#define OVERRIDE_BUFSIZE 16
 #endif
 
+void init_override_buffers (void);
 void flush_override_buffers ();
 void enqueue_feed_override (uint8_t cmd);
 uint8_t get_feed_override (void);
@@ -3,7 +3,7 @@
 
   PID algorithm for closed loop control
 
-  NOTE: not referenced in the core grbl code
+  NOTE: not referenced in the core grbl code unless ENABLE_PID_TELEMETRY is enabled
 
   Part of GrblHAL
 
@@ -27,7 +27,287 @@
 
 #include "pid.h"
 
-// Fixed point version: TODO
+#ifdef ENABLE_PID_TELEMETRY
+
+#include "hal.h"
+#include "protocol.h"
+
+#if (PID_TELEMETRY_BUFFER & (PID_TELEMETRY_BUFFER - 1)) || PID_TELEMETRY_BUFFER < 4 || PID_TELEMETRY_BUFFER > 256
+#error PID_TELEMETRY_BUFFER must be a power of 2 and in the range 4 - 256!
+#endif
+
+#define PID_TELEMETRY_LINE_SAMPLES 8 // Max number of samples output per line
+
+typedef struct {
+    float setpoint;
+    float error;
+    float output;
+} pid_sample_t;
+
+typedef struct {
+    const void *pid; // pidf_t or pidq_t instance
+    const char *name;
+} pid_channel_t;
+
+// Samples are added by pidf(), possibly from an interrupt context, and output from the realtime loop.
+static THREAD_LOCAL struct {
+    const void *volatile pid;   // Instance being streamed, NULL if none
+    uint_fast8_t channel;
+    uint16_t decimation;
+    uint16_t count;
+    volatile uint32_t dropped;  // Number of samples lost due to buffer overflow since streaming was started
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    pid_sample_t sample[PID_TELEMETRY_BUFFER];
+} telemetry = {0};
+
+static THREAD_LOCAL uint_fast8_t n_channels = 0;
+static THREAD_LOCAL pid_channel_t channels[PID_TELEMETRY_CHANNELS];
+
+static void telemetry_output (uint_fast16_t state);
+
+static THREAD_LOCAL rt_task_t telemetry_task = {
+    .name = "PID telemetry",
+    .fn = telemetry_output,
+    .period = PID_TELEMETRY_PERIOD
+};
+
+static inline void telemetry_sample (float setpoint, float error, float output)
+{
+    if(++telemetry.count >= telemetry.decimation) {
+
+        uint_fast8_t head = (telemetry.head + 1) & (PID_TELEMETRY_BUFFER - 1);
+
+        telemetry.count = 0;
+
+        if(head == telemetry.tail)
+            telemetry.dropped++;
+        else {
+            telemetry.sample[telemetry.head].setpoint = setpoint;
+            telemetry.sample[telemetry.head].error = error;
+            telemetry.sample[telemetry.head].output = output;
+            telemetry.head = head;
+        }
+    }
+}
+
+// Outputs buffered samples as [PIDT:<channel>,<dropped>|<setpoint>,<error>,<output>|...]
+static void telemetry_output (uint_fast16_t state)
+{
+    uint_fast8_t samples;
+
+    while(telemetry.tail != telemetry.head) {
+
+        samples = PID_TELEMETRY_LINE_SAMPLES;
+
+        hal.stream.write("[PIDT:");
+        hal.stream.write(uitoa(telemetry.channel));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(telemetry.dropped));
+
+        do {
+            pid_sample_t *sample = &telemetry.sample[telemetry.tail];
+            hal.stream.write("|");
+            hal.stream.write(ftoa(sample->setpoint, N_DECIMAL_PIDVALUE));
+            hal.stream.write(",");
+            hal.stream.write(ftoa(sample->error, N_DECIMAL_PIDVALUE));
+            hal.stream.write(",");
+            hal.stream.write(ftoa(sample->output, N_DECIMAL_PIDVALUE));
+            telemetry.tail = (telemetry.tail + 1) & (PID_TELEMETRY_BUFFER - 1);
+        } while(--samples && telemetry.tail != telemetry.head);
+
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+static uint_fast8_t telemetry_register (const void *pid, const char *name)
+{
+    uint_fast8_t idx = n_channels;
+
+    while(idx && channels[idx - 1].pid != pid)
+        idx--;
+
+    if(idx == 0 && n_channels < PID_TELEMETRY_CHANNELS) {
+        channels[n_channels].pid = pid;
+        channels[n_channels].name = name;
+        idx = ++n_channels;
+    }
+
+    return idx;
+}
+
+uint_fast8_t pidf_telemetry_register (pidf_t *pid, const char *name)
+{
+    return telemetry_register(pid, name);
+}
+
+uint_fast8_t pidq_telemetry_register (pidq_t *pid, const char *name)
+{
+    return telemetry_register(pid, name);
+}
+
+bool pidf_telemetry_start (uint_fast8_t channel, uint16_t decimation)
+{
+    if(channel > n_channels)
+        return false;
+
+    telemetry.pid = NULL;
+    protocol_remove_rt_task(&telemetry_task);
+
+    if(channel) {
+        telemetry.channel = channel;
+        telemetry.decimation = decimation ? decimation : 1;
+        telemetry.count = 0;
+        telemetry.dropped = 0;
+        telemetry.head = telemetry.tail = 0;
+        protocol_add_rt_task(&telemetry_task);
+        telemetry.pid = channels[channel - 1].pid;
+    }
+
+    return true;
+}
+
+// $PIDT lists registered channels as [PIDTCH:<channel>,<name>,<decimation>], decimation is 0 if not streaming.
+// $PIDT=<channel>[,<decimation>] starts streaming, $PIDT=0 stops.
+status_code_t pidf_telemetry_command (char *args)
+{
+    float channel, decimation = 1.0f;
+    uint_fast8_t idx, counter = 1;
+
+    if(*args == '\0') {
+        for(idx = 0; idx < n_channels; idx++) {
+            hal.stream.write("[PIDTCH:");
+            hal.stream.write(uitoa(idx + 1));
+            hal.stream.write(",");
+            hal.stream.write(channels[idx].name);
+            hal.stream.write(",");
+            hal.stream.write(uitoa(telemetry.pid && telemetry.channel == idx + 1 ? telemetry.decimation : 0));
+            hal.stream.write("]" ASCII_EOL);
+        }
+        return Status_OK;
+    }
+
+    if(*args != '=')
+        return Status_InvalidStatement;
+
+    if(!read_float(args, &counter, &channel))
+        return Status_BadNumberFormat;
+
+    if(args[counter] == ',') {
+        counter++;
+        if(!read_float(args, &counter, &decimation))
+            return Status_BadNumberFormat;
+    }
+
+    if(args[counter] != '\0' || !isintf(channel) || !isintf(decimation) || channel < 0.0f || channel > (float)PID_TELEMETRY_CHANNELS || decimation < 1.0f || decimation > 65535.0f)
+        return Status_InvalidStatement;
+
+    return pidf_telemetry_start((uint_fast8_t)channel, (uint16_t)decimation) ? Status_OK : Status_InvalidStatement;
+}
+
+#endif
+
+// Fixed point version
+
+// Returns value saturated to the range of q16_t.
+static inline q16_t q16_sat (int64_t value)
+{
+    return value > INT32_MAX ? INT32_MAX : (value < INT32_MIN ? INT32_MIN : (q16_t)value);
+}
+
+// Returns a * b, saturated to the range of q16_t.
+static inline q16_t q16_mul (q16_t a, q16_t b)
+{
+    return q16_sat(((int64_t)a * (int64_t)b) >> 16);
+}
+
+static inline q16_t q16_clamp (q16_t value, q16_t limit)
+{
+    return value > limit ? limit : (value < -limit ? -limit : value);
+}
+
+void pidq_init (pidq_t *pid, pid_values_t *config)
+{
+    pidq_reset(pid);
+
+    pid->cfg.p_gain = Q16_FROM_FLOAT(config->p_gain);
+    pid->cfg.i_gain = Q16_FROM_FLOAT(config->i_gain);
+    pid->cfg.d_gain = Q16_FROM_FLOAT(config->d_gain);
+    pid->cfg.i_max_error = Q16_FROM_FLOAT(config->i_max_error);
+    pid->cfg.d_max_error = Q16_FROM_FLOAT(config->d_max_error);
+    pid->cfg.deadband = Q16_FROM_FLOAT(config->deadband);
+    pid->cfg.max_error = Q16_FROM_FLOAT(config->max_error);
+}
+
+void pidq_reset (pidq_t *pid)
+{
+    pid->error = 0;
+    pid->i_error = 0;
+    pid->d_error = 0;
+    pid->sample_rate_prev = 0;
+}
+
+q16_t pidq (pidq_t *pid, q16_t command, q16_t actual, uint32_t sample_rate)
+{
+    bool same_rate;
+    q16_t error, pidres;
+    int64_t sum, delta = (int64_t)command - actual;
+
+    if(delta > pid->cfg.deadband)
+        delta -= pid->cfg.deadband;
+    else if(delta < -pid->cfg.deadband)
+        delta += pid->cfg.deadband;
+    else
+        delta = 0;
+
+    error = q16_sat(delta);
+
+    // The first sample after a reset is taken to have the same rate as the previous,
+    // the divisions below are only needed when the sample rate changes.
+    if(pid->sample_rate_prev == 0 || sample_rate == 0)
+        pid->sample_rate_prev = sample_rate;
+
+    same_rate = pid->sample_rate_prev == sample_rate;
+
+    // calculate the proportional term
+    sum = q16_mul(pid->cfg.p_gain, error);
+
+    // calculate and add the integral term
+    pid->i_error = q16_sat((int64_t)pid->i_error + (same_rate ? (int64_t)error : ((int64_t)error * pid->sample_rate_prev) / sample_rate));
+
+    if(pid->cfg.i_max_error != 0)
+        pid->i_error = q16_clamp(pid->i_error, pid->cfg.i_max_error);
+
+    sum += q16_mul(pid->cfg.i_gain, pid->i_error);
+
+    // calculate and add the derivative term
+    if(pid->cfg.d_gain != 0) {
+        int64_t p_error = (int64_t)error - pid->d_error;
+        if(!same_rate)
+            p_error = (p_error * sample_rate) / pid->sample_rate_prev;
+        q16_t d_error = q16_sat(p_error);
+        if(pid->cfg.d_max_error != 0)
+            d_error = q16_clamp(d_error, pid->cfg.d_max_error);
+        sum += q16_mul(pid->cfg.d_gain, d_error);
+        pid->d_error = error;
+    }
+
+    pid->sample_rate_prev = sample_rate;
+
+    // limit error output
+    pidres = q16_sat(sum);
+    if(pid->cfg.max_error != 0)
+        pidres = q16_clamp(pidres, pid->cfg.max_error);
+
+    pid->error = pidres;
+
+#ifdef ENABLE_PID_TELEMETRY
+    if(pid == telemetry.pid)
+        telemetry_sample(Q16_TO_FLOAT(command), Q16_TO_FLOAT(error), Q16_TO_FLOAT(pidres));
+#endif
+
+    return pidres;
+}
 
 // Float version
 
@@ -96,5 +376,10 @@ float pidf (pidf_t *pid, float command, float actual, float sample_rate)
 
     pid->error = pidres;
 
+#ifdef ENABLE_PID_TELEMETRY
+    if(pid == telemetry.pid)
+        telemetry_sample(command, error, pidres);
+#endif
+
     return pidres;
 }
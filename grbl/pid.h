@@ -3,7 +3,7 @@
 
   PID algorithm for closed loop control
 
-  NOTE: not referenced in the core grbl code
+  NOTE: not referenced in the core grbl code unless ENABLE_PID_TELEMETRY is enabled
 
   Part of GrblHAL
 
@@ -40,8 +40,68 @@ typedef struct {
     float max_error;
 } pidf_t;
 
+// Q16.16 fixed point values, 16 integer and 16 fractional bits.
+typedef int32_t q16_t;
+
+#define Q16_ONE (1L << 16)
+#define Q16_FROM_FLOAT(v) ((q16_t)((v) * (float)Q16_ONE + ((v) < 0.0f ? -0.5f : 0.5f)))
+#define Q16_TO_FLOAT(v) ((float)(v) / (float)Q16_ONE)
+
+typedef struct {
+    q16_t p_gain;
+    q16_t i_gain;
+    q16_t d_gain;
+    q16_t i_max_error;
+    q16_t d_max_error;
+    q16_t deadband;
+    q16_t max_error;
+} pidq_values_t;
+
+// Fixed point version of pidf_t for loops running in interrupt context on MCUs without a FPU.
+typedef struct {
+    pidq_values_t cfg;
+    q16_t i_error;
+    q16_t d_error;
+    uint32_t sample_rate_prev;
+    q16_t error;
+} pidq_t;
+
 void pidf_reset (pidf_t *pid);
 void pidf_init(pidf_t *pid, pid_values_t *config);
 float pidf (pidf_t *pid, float command, float actual, float sample_rate);
 
+// Gains and limits are converted from the float configuration, tuning is the same as for pidf().
+// Command and actual values are in Q16.16 format, sample_rate may be in any unit as only the ratio
+// between consecutive samples is used, eg. the number of timer ticks since the previous call.
+// NOTE: unlike pidf() the configured deadband is applied to the error.
+void pidq_reset (pidq_t *pid);
+void pidq_init (pidq_t *pid, pid_values_t *config);
+q16_t pidq (pidq_t *pid, q16_t command, q16_t actual, uint32_t sample_rate);
+
+#ifdef ENABLE_PID_TELEMETRY
+
+#ifndef PID_TELEMETRY_CHANNELS
+#define PID_TELEMETRY_CHANNELS 4    // Number of PID instances that can be registered for streaming
+#endif
+#ifndef PID_TELEMETRY_BUFFER
+#define PID_TELEMETRY_BUFFER 64     // Number of samples buffered for output, must be a power of 2
+#endif
+#ifndef PID_TELEMETRY_PERIOD
+#define PID_TELEMETRY_PERIOD 20     // Minimum time between output of buffered samples in milliseconds
+#endif
+
+// Registers a PID instance for streaming, name is used in the $PIDT channel list and must be static.
+// May be called repeatedly for the same instance. Returns the channel number, 0 if the channel table is full.
+uint_fast8_t pidf_telemetry_register (pidf_t *pid, const char *name);
+uint_fast8_t pidq_telemetry_register (pidq_t *pid, const char *name);
+
+// Starts streaming of every decimation'th sample from the instance registered as channel, 0 stops streaming.
+// Returns false if no instance is registered as channel.
+bool pidf_telemetry_start (uint_fast8_t channel, uint16_t decimation);
+
+// Handles the $PIDT command: lists the registered channels, $PIDT=<channel>[,<decimation>] starts streaming.
+status_code_t pidf_telemetry_command (char *args);
+
+#endif
+
 #endif
@@ -29,6 +29,7 @@
 #include "hal.h"
 #include "nuts_bolts.h"
 #include "planner.h"
+#include "pool.h"
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
@@ -40,13 +41,30 @@
 #define MINIMUM_FEED_RATE 1.0f
 #endif
 
-static plan_block_t block_buffer[BLOCK_BUFFER_SIZE];    // A ring buffer for motion instructions
-static plan_block_t *block_buffer_tail;                 // Pointer to the block to process now
-static plan_block_t *block_buffer_head;                 // Pointer to the next block to be pushed
-static plan_block_t *next_buffer_head;                  // Pointer to the next buffer head
-static plan_block_t *block_buffer_planned;              // Pointer to the optimally planned block
-
-static planner_t pl;
+static THREAD_LOCAL plan_block_t *block_buffer = NULL;               // A ring buffer for motion instructions, allocated on first reset
+static THREAD_LOCAL uint_fast16_t block_buffer_size = 0;             // Number of blocks allocated for the ring buffer
+static THREAD_LOCAL plan_block_t *block_buffer_tail;                 // Pointer to the block to process now
+static THREAD_LOCAL plan_block_t *block_buffer_head;                 // Pointer to the next block to be pushed
+static THREAD_LOCAL plan_block_t *next_buffer_head;                  // Pointer to the next buffer head
+static THREAD_LOCAL plan_block_t *block_buffer_planned;              // Pointer to the optimally planned block
+static THREAD_LOCAL plan_block_data_t block_data[PLANNER_BLOCK_DATA_SIZE]; // Side table for rarely used block data
+static THREAD_LOCAL uint_fast8_t block_data_head, block_data_tail;   // Side table ring buffer indices
+
+static THREAD_LOCAL planner_t pl;
+
+static THREAD_LOCAL planner_t pl_merge;                              // Planner state before the last block, used for path blending
+static THREAD_LOCAL plan_block_t *merge_block = NULL;                // Last block that may be merged with a new one, NULL if none
+static THREAD_LOCAL volatile bool buffer_filled = false;             // Set when the buffer has been full since it was last empty
+static THREAD_LOCAL float buffer_time = 0.0f;                        // Sum of the planned block times in minutes
+static THREAD_LOCAL struct {
+    uint_fast8_t n_vertices;
+    float reserved;                                                  // Deviation bound of vertices dropped from the list
+    float vertex[PLANNER_MERGE_VERTICES][N_AXIS];                    // Dropped vertices relative to the block start in mm
+} merge_path;                                                        // Path of the merged block, used for path blending
+static THREAD_LOCAL struct {
+    bool pending;                                                    // Replan deferred after an override increase
+    uint32_t ms;                                                     // Time of the first deferred override change
+} override_replan = {0};
 
 
 /*                            PLANNER SPEED DEFINITION
@@ -113,25 +131,131 @@ static planner_t pl;
   to compute an optimal plan, so select carefully. ARM versions should have enough memory and speed for
   look-ahead blocks numbering up to a hundred or more.
 
+  The number of blocks is set by the $398 setting and the buffer is allocated from the heap at boot. To keep the
+  cost of adding a block bounded for large buffers the reverse pass is terminated as soon as it reaches a block
+  whose entry speed is left unchanged by the new exit speed. Since the entry speeds of all blocks before it are
+  computed from unchanged values they cannot change either, and the forward pass is then started from that block.
+  Full recalculation is performed when the plan is reinitialized, e.g. after feed holds and overrides.
+
+  The planned time of the blocks is summed for reporting the buffered motion time. The time of a block depends
+  on its entry and exit speeds only, so it is updated for the blocks from the forward pass start onward.
+
+  With PLANNER_FIXED_POINT enabled the passes are run on integer copies of the entry speeds squared, the maximum
+  entry speeds squared and the speed squared change over the block at full acceleration. The float entry speeds
+  used by the segment generator are updated when a pass changes them. The stepper module may alter the entry speed
+  and remaining distance of the executing block, the integer values of the block the forward pass starts from are
+  thus refreshed from the float values first.
+
 */
-static void planner_recalculate ()
+
+#if PLANNER_FIXED_POINT
+
+typedef uint32_t plan_sqr_t;
+
+// Converts a speed squared in (mm/min)^2 to an integer, saturated.
+static inline plan_sqr_t plan_sqr_fixed (float sqr)
+{
+    return sqr >= 4294967040.0f ? UINT32_MAX : (plan_sqr_t)(sqr + 0.5f);
+}
+
+static inline plan_sqr_t plan_sqr_add (plan_sqr_t a, plan_sqr_t b)
+{
+    return a > UINT32_MAX - b ? UINT32_MAX : a + b;
+}
+
+#define ENTRY_SQR(b) ((b)->entry_speed_sqr_q)
+#define MAX_ENTRY_SQR(b) ((b)->max_entry_speed_sqr_q)
+#define ACCEL_SQR(b) ((b)->accel_speed_sqr_q)
+#define SPEED(sqr) ((float)isqrt(sqr))
+
+static inline void plan_set_entry_sqr (plan_block_t *block, plan_sqr_t sqr)
+{
+    block->entry_speed_sqr_q = sqr;
+    block->entry_speed_sqr = (float)sqr;
+}
+
+#else
+
+typedef float plan_sqr_t;
+
+#define ENTRY_SQR(b) ((b)->entry_speed_sqr)
+#define MAX_ENTRY_SQR(b) ((b)->max_entry_speed_sqr)
+#define ACCEL_SQR(b) (2.0f * (b)->acceleration * (b)->millimeters)
+#define SPEED(sqr) sqrtf(sqr)
+#define plan_sqr_add(a, b) ((a) + (b))
+
+static inline void plan_set_entry_sqr (plan_block_t *block, plan_sqr_t sqr)
+{
+    block->entry_speed_sqr = sqr;
+}
+
+#endif
+
+// Returns the time in minutes to travel the block from the entry to the exit speed, limited by the nominal speed.
+static float plan_block_time (plan_block_t *block, float entry, float exit)
+{
+#ifdef ENABLE_PLANNED_DWELL
+    if (block->condition.dwell)
+        return block->dwell;
+#endif
+
+    float nominal = plan_compute_profile_nominal_speed(block), nominal_sqr = nominal * nominal;
+    float entry_sqr = entry * entry, exit_sqr = exit * exit, inv_accel = 1.0f / block->acceleration, peak;
+    float accelerate_mm = 0.5f * inv_accel * (nominal_sqr - entry_sqr), decelerate_mm = 0.5f * inv_accel * (nominal_sqr - exit_sqr);
+
+    if (entry > nominal || exit > nominal) // Planned for a higher override: assume constant acceleration.
+        return 2.0f * block->millimeters / (entry + exit);
+
+    if (accelerate_mm + decelerate_mm <= block->millimeters) // Trapezoid: accelerate, cruise and decelerate.
+        return (2.0f * nominal - entry - exit) * inv_accel + (block->millimeters - accelerate_mm - decelerate_mm) / nominal;
+
+    if ((peak = block->acceleration * block->millimeters + 0.5f * (entry_sqr + exit_sqr)) >= entry_sqr && peak >= exit_sqr) { // Triangle.
+        peak = sqrtf(peak);
+        return (2.0f * peak - entry - exit) * inv_accel;
+    }
+
+    return 2.0f * block->millimeters / (entry + exit); // Speeds cannot be joined within the block: assume constant acceleration.
+}
+
+// Updates the planned time of the blocks from block to the end of the buffer.
+static void plan_update_time (plan_block_t *block)
+{
+    float time;
+
+    while (block != block_buffer_head) {
+        time = plan_block_time(block, SPEED(ENTRY_SQR(block)), block->next == block_buffer_head ? 0.0f : SPEED(ENTRY_SQR(block->next)));
+        buffer_time += time - block->time;
+        block->time = time;
+        block = block->next;
+    }
+}
+
+static void planner_recalculate (bool full)
 {
     // Initialize block pointer to the last block in the planner buffer.
     plan_block_t *block = block_buffer_head->prev;
 
+#if PLANNER_FIXED_POINT
+    // The planned block may be the executing block, its entry speed and distance may have been altered by the stepper module.
+    block_buffer_planned->entry_speed_sqr_q = plan_sqr_fixed(block_buffer_planned->entry_speed_sqr);
+    block_buffer_planned->accel_speed_sqr_q = plan_sqr_fixed(2.0f * block_buffer_planned->acceleration * block_buffer_planned->millimeters);
+#endif
+
     // Bail. Can't do anything with one only one plan-able block.
-    if (block == block_buffer_planned)
+    if (block == block_buffer_planned) {
+        plan_update_time(block);
         return;
+    }
 
     // Reverse Pass: Coarsely maximize all possible deceleration curves back-planning from the last
     // block in buffer. Cease planning when the last optimal planned or tail pointer is reached.
     // NOTE: Forward pass will later refine and correct the reverse pass to create an optimal plan.
-    float entry_speed_sqr;
+    plan_sqr_t entry_speed_sqr;
     plan_block_t *next;
-    plan_block_t *current = block;
+    plan_block_t *current = block, *start = block_buffer_planned;
 
     // Calculate maximum entry speed for last block in buffer, where the exit speed is always zero.
-    current->entry_speed_sqr = min(current->max_entry_speed_sqr, 2.0f * current->acceleration * current->millimeters);
+    plan_set_entry_sqr(current, min(MAX_ENTRY_SQR(current), ACCEL_SQR(current)));
 
     block = block->prev;
     if (block == block_buffer_planned) { // Only two plannable blocks in buffer. Reverse pass complete.
@@ -144,21 +268,28 @@ static void planner_recalculate ()
         current = block;
         block = block->prev;
 
+        // Compute maximum entry speed decelerating over the current block from its exit speed.
+        if (ENTRY_SQR(current) != MAX_ENTRY_SQR(current)) {
+            entry_speed_sqr = plan_sqr_add(ENTRY_SQR(next), ACCEL_SQR(current));
+            if(entry_speed_sqr > MAX_ENTRY_SQR(current))
+                entry_speed_sqr = MAX_ENTRY_SQR(current);
+            // Optimal block cutoff: nothing before an unchanged entry speed can be improved by the new block.
+            if(!full && entry_speed_sqr == ENTRY_SQR(current)) {
+                start = current;
+                break;
+            }
+            plan_set_entry_sqr(current, entry_speed_sqr);
+        }
+
         // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
         if (block == block_buffer_tail)
             st_update_plan_block_parameters();
-
-        // Compute maximum entry speed decelerating over the current block from its exit speed.
-        if (current->entry_speed_sqr != current->max_entry_speed_sqr) {
-            entry_speed_sqr = next->entry_speed_sqr + 2.0f * current->acceleration * current->millimeters;
-            current->entry_speed_sqr = entry_speed_sqr < current->max_entry_speed_sqr ? entry_speed_sqr : current->max_entry_speed_sqr;
-        }
     }
 
-    // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
+    // Forward Pass: Forward plan the acceleration curve from the planned pointer (or reverse pass cutoff) onward.
     // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
-    next = block_buffer_planned; // Begin at buffer planned pointer
-    block = block_buffer_planned->next;
+    next = start; // Begin at buffer planned pointer
+    block = start->next;
 
     while (block != block_buffer_head) {
 
@@ -168,11 +299,11 @@ static void planner_recalculate ()
         // Any acceleration detected in the forward pass automatically moves the optimal planned
         // pointer forward, since everything before this is all optimal. In other words, nothing
         // can improve the plan from the buffer tail to the planned pointer by logic.
-        if (current->entry_speed_sqr < next->entry_speed_sqr) {
-            entry_speed_sqr = current->entry_speed_sqr + 2.0f * current->acceleration * current->millimeters;
+        if (ENTRY_SQR(current) < ENTRY_SQR(next)) {
+            entry_speed_sqr = plan_sqr_add(ENTRY_SQR(current), ACCEL_SQR(current));
         // If true, current block is full-acceleration and we can move the planned pointer forward.
-            if (entry_speed_sqr < next->entry_speed_sqr) {
-                next->entry_speed_sqr = entry_speed_sqr; // Always <= max_entry_speed_sqr. Backward pass sets this.
+            if (entry_speed_sqr < ENTRY_SQR(next)) {
+                plan_set_entry_sqr(next, entry_speed_sqr); // Always <= max_entry_speed_sqr. Backward pass sets this.
                 block_buffer_planned = block; // Set optimal plan pointer.
             }
         }
@@ -181,24 +312,57 @@ static void planner_recalculate ()
         // point in the buffer. When the plan is bracketed by either the beginning of the
         // buffer and a maximum entry speed or two maximum entry speeds, every block in between
         // cannot logically be further improved. Hence, we don't have to recompute them anymore.
-        if (next->entry_speed_sqr == next->max_entry_speed_sqr)
+        if (ENTRY_SQR(next) == MAX_ENTRY_SQR(next))
             block_buffer_planned = block;
 
         block = block->next;
     }
+
+    plan_update_time(start);
+}
+
+// Side table entries are allocated in block order and released in the same order when blocks are discarded.
+inline static bool plan_block_data_full (void)
+{
+    return (block_data_head == PLANNER_BLOCK_DATA_SIZE - 1 ? 0 : block_data_head + 1) == block_data_tail;
+}
+
+inline static plan_block_data_t *plan_block_data_alloc (plan_block_t *block)
+{
+    plan_block_data_t *data = &block_data[block_data_head];
+
+    block->data = block_data_head + 1;
+    block_data_head = block_data_head == PLANNER_BLOCK_DATA_SIZE - 1 ? 0 : block_data_head + 1;
+
+    return data;
 }
 
 inline static void plan_cleanup (plan_block_t *block)
 {
-    if(block->message) {
-        free(block->message);
-        block->message = NULL;
-    }
+    if(block->data) {
+
+        plan_block_data_t *data = &block_data[block->data - 1];
+
+        if(data->message) {
+            pool_release_message(data->message);
+            data->message = 0;
+        }
+
+        while(data->output_commands) {
+            output_command_t *next = data->output_commands->next;
+            pool_free(data->output_commands);
+            data->output_commands = next;
+        }
+
+#ifdef ENABLE_LASER_RASTER
+        if(data->raster) {
+            free(data->raster);
+            data->raster = NULL;
+        }
+#endif
 
-    while(block->output_commands) {
-        output_command_t *next = block->output_commands->next;
-        free(block->output_commands);
-        block->output_commands = next;
+        block->data = 0;
+        block_data_tail = block_data_tail == PLANNER_BLOCK_DATA_SIZE - 1 ? 0 : block_data_tail + 1;
     }
 }
 
@@ -216,24 +380,62 @@ inline static void plan_reset_buffer (bool soft_reset)
     block_buffer_tail = block_buffer_head = &block_buffer[0];   // Empty = tail == head
     next_buffer_head = block_buffer_head->next;                 // = next block
     block_buffer_planned = block_buffer_tail;                   // = block_buffer_tail
+    merge_block = NULL;
+    buffer_filled = false;
+    buffer_time = 0.0f;
+    block_data_head = block_data_tail = 0;
+    override_replan.pending = false;
 }
 
 
-void plan_reset ()
+// Allocates the block ring buffer with the number of blocks set by $398.
+// If the heap cannot hold the requested number the size is stepped down towards BLOCK_BUFFER_SIZE.
+static bool plan_alloc_buffer (void)
 {
-    static bool soft_reset = false;
+    uint_fast16_t blocks = settings.planner_buffer_blocks;
+
+    if(blocks < PLANNER_BUFFER_BLOCKS_MIN || blocks > PLANNER_BUFFER_BLOCKS_MAX)
+        blocks = BLOCK_BUFFER_SIZE;
+
+    while((block_buffer = malloc(blocks * sizeof(plan_block_t))) == NULL && blocks > BLOCK_BUFFER_SIZE) {
+        blocks -= blocks > BLOCK_BUFFER_SIZE + 100 ? 100 : 10;
+        if(blocks < BLOCK_BUFFER_SIZE)
+            blocks = BLOCK_BUFFER_SIZE;
+    }
+
+    if(block_buffer) {
+        block_buffer_size = blocks;
+        memset(block_buffer, 0, blocks * sizeof(plan_block_t));
+    }
+
+    return block_buffer != NULL;
+}
+
+// Resets the planner. The block buffer is allocated on the first call, a changed $398 setting
+// takes effect after a hard reset. Returns false if the block buffer could not be allocated.
+bool plan_reset (void)
+{
+    static THREAD_LOCAL bool soft_reset = false;
+
+    if(block_buffer == NULL && !plan_alloc_buffer())
+        return false;
+
+    st_prep_lock(true);
 
     memset(&pl, 0, sizeof(planner_t)); // Clear planner struct
 
     // Set up stepper block ringbuffer as circular doubly linked list
-    uint_fast8_t idx;
-    for(idx = 0 ; idx <= BLOCK_BUFFER_SIZE - 1 ; idx++) {
-        block_buffer[idx].prev = &block_buffer[idx == 0 ? BLOCK_BUFFER_SIZE - 1 : idx - 1];
-        block_buffer[idx].next = &block_buffer[idx == BLOCK_BUFFER_SIZE - 1 ? 0 : idx + 1];
+    uint_fast16_t idx;
+    for(idx = 0 ; idx <= block_buffer_size - 1 ; idx++) {
+        block_buffer[idx].prev = &block_buffer[idx == 0 ? block_buffer_size - 1 : idx - 1];
+        block_buffer[idx].next = &block_buffer[idx == block_buffer_size - 1 ? 0 : idx + 1];
     }
 
     plan_reset_buffer(soft_reset);
+    st_prep_lock(false);
     soft_reset = true;
+
+    return true;
 }
 
 
@@ -241,10 +443,15 @@ void plan_discard_current_block ()
 {
     if (block_buffer_tail != block_buffer_head) { // Discard non-empty buffer.
         plan_cleanup(block_buffer_tail);
+        buffer_time -= block_buffer_tail->time;
         // Push block_buffer_planned pointer, if encountered.
         if (block_buffer_tail == block_buffer_planned)
             block_buffer_planned = block_buffer_tail->next;
         block_buffer_tail = block_buffer_tail->next;
+        if (block_buffer_tail == block_buffer_head) {
+            buffer_filled = false;
+            buffer_time = 0.0f; // Discard accumulated round-off.
+        }
     }
 }
 
@@ -262,6 +469,23 @@ plan_block_t *plan_get_current_block ()
     return block_buffer_head == block_buffer_tail ? NULL : block_buffer_tail;
 }
 
+// Gets a queued block by its position in the buffer, 0 is the current block. Returns NULL if not queued.
+plan_block_t *plan_get_block (uint_fast16_t idx)
+{
+    if(idx >= block_buffer_size - 1 - plan_get_block_buffer_available())
+        return NULL;
+
+    idx += block_buffer_tail - block_buffer;
+
+    return &block_buffer[idx >= block_buffer_size ? idx - block_buffer_size : idx];
+}
+
+// Returns address of side table data for the block, if available. Called by segment generator.
+plan_block_data_t *plan_get_block_data (plan_block_t *block)
+{
+    return block->data ? &block_data[block->data - 1] : NULL;
+}
+
 
 inline float plan_get_exec_block_exit_speed_sqr ()
 {
@@ -270,10 +494,32 @@ inline float plan_get_exec_block_exit_speed_sqr ()
 }
 
 
+// Returns the planned time to execute the motions in the buffer in seconds. The time of the executing
+// block is computed from its remaining distance and the current speed.
+// NOTE: Motion in the step segment buffer is not included.
+float plan_get_buffer_time (void)
+{
+    float time = 0.0f, speed;
+    plan_block_t *block;
+
+    st_prep_lock(true);
+
+    if ((block = plan_get_current_block())) {
+        speed = st_get_realtime_rate();
+        time = buffer_time - block->time + plan_block_time(block, speed, sqrtf(plan_get_exec_block_exit_speed_sqr()));
+    }
+
+    st_prep_lock(false);
+
+    return time * 60.0f;
+}
+
+
 // Returns the availability status of the block ring buffer. True, if full.
+// NOTE: Also returns true if the side table for rarely used block data is full.
 bool plan_check_full_buffer ()
 {
-    return block_buffer_tail == next_buffer_head;
+    return block_buffer_tail == next_buffer_head || plan_block_data_full();
 }
 
 
@@ -305,6 +551,9 @@ inline static float plan_compute_profile_parameters (plan_block_t *block, float
     block->max_entry_speed_sqr = nominal_speed > prev_nominal_speed ? (prev_nominal_speed * prev_nominal_speed) : (nominal_speed * nominal_speed);
     if (block->max_entry_speed_sqr > block->max_junction_speed_sqr)
         block->max_entry_speed_sqr = block->max_junction_speed_sqr;
+#if PLANNER_FIXED_POINT
+    block->max_entry_speed_sqr_q = plan_sqr_fixed(block->max_entry_speed_sqr);
+#endif
     return nominal_speed;
 }
 
@@ -319,67 +568,120 @@ void plan_update_velocity_profile_parameters ()
         block = block->next;
     }
     pl.previous_nominal_speed = prev_nominal_speed; // Update prev nominal speed for next incoming block.
+    merge_block = NULL; // Planner state kept for path blending is outdated.
 }
 
-static inline float limit_acceleration_by_axis_maximum (float *unit_vec)
+// Returns the acceleration limit along vec, scaled by magnitude so that vec does not have to be normalized first.
+// The most limiting axis is found by cross multiplying the ratios, only one division is performed.
+static inline float limit_acceleration_by_axis_maximum (float *vec, float magnitude)
 {
     uint_fast8_t idx = N_AXIS;
-    float limit_value = SOME_LARGE_VALUE;
+    float component, limit_accel = 0.0f, limit_component = 0.0f;
 
     do {
-        if (unit_vec[--idx] != 0.0f)  // Avoid divide by zero.
-            limit_value = min(limit_value, fabsf(settings.axis[idx].acceleration / unit_vec[idx]));
+        if ((component = fabsf(vec[--idx])) != 0.0f && (limit_component == 0.0f ||
+              settings.axis[idx].acceleration * limit_component < limit_accel * component)) {
+            limit_accel = settings.axis[idx].acceleration;
+            limit_component = component;
+        }
     } while(idx);
 
-    return limit_value;
+    return limit_component == 0.0f ? SOME_LARGE_VALUE : magnitude * limit_accel / limit_component;
 }
 
-static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
+// Sets the block acceleration, jerk and rapid rate limited by the axis maximums, one division per moving axis.
+static inline void limit_block_by_axis_maximum (plan_block_t *block, float *unit_vec)
 {
     uint_fast8_t idx = N_AXIS;
-    float limit_value = SOME_LARGE_VALUE;
+    float inv_unit_vec;
+
+    block->acceleration = block->rapid_rate = SOME_LARGE_VALUE;
+#ifdef ENABLE_JERK_ACCELERATION
+    block->jerk = SOME_LARGE_VALUE;
+#endif
 
     do {
-        if (unit_vec[--idx] != 0.0f)  // Avoid divide by zero.
-            limit_value = min(limit_value, fabsf(settings.axis[idx].max_rate / unit_vec[idx]));
+        if (unit_vec[--idx] != 0.0f) {  // Avoid divide by zero.
+            inv_unit_vec = fabsf(1.0f / unit_vec[idx]);
+            block->acceleration = min(block->acceleration, settings.axis[idx].acceleration * inv_unit_vec);
+#ifdef ENABLE_JERK_ACCELERATION
+            block->jerk = min(block->jerk, settings.axis[idx].jerk * inv_unit_vec);
+#endif
+            block->rapid_rate = min(block->rapid_rate, settings.axis[idx].max_rate * inv_unit_vec);
+        }
     } while(idx);
+}
 
-    return limit_value;
+#ifdef ENABLE_NATIVE_ARCS
+
+// Computes the tangent unit vector of an arc at the fraction f (0.0 - 1.0) of the angular travel.
+static void plan_arc_tangent (plan_arc_t *arc, float f, float *unit_vec)
+{
+    float cos_a, sin_a;
+
+    sin_cos(arc->angular_travel * f, &sin_a, &cos_a);
+
+    memset(unit_vec, 0, sizeof(float) * N_AXIS);
+
+    // Rotate the radius vector from the center to the start position (= -offset) and take its derivative.
+    unit_vec[arc->plane.axis_0] = (arc->offset[0] * sin_a + arc->offset[1] * cos_a) * arc->angular_travel / arc->millimeters;
+    unit_vec[arc->plane.axis_1] = (-arc->offset[0] * cos_a + arc->offset[1] * sin_a) * arc->angular_travel / arc->millimeters;
+    unit_vec[arc->plane.axis_linear] = arc->linear_travel / arc->millimeters;
 }
 
+// Computes the arc length, axis limited acceleration and rates and the estimated step event count of an arc block.
+// The entry direction is returned in unit_vec.
+static void plan_arc_setup (plan_block_t *block, plan_arc_t *arc, float *unit_vec)
+{
+    float radius = sqrtf(arc->offset[0] * arc->offset[0] + arc->offset[1] * arc->offset[1]);
+    float arc_travel = fabsf(arc->angular_travel) * radius;
+    float steps;
 
+    arc->millimeters = sqrtf(arc_travel * arc_travel + arc->linear_travel * arc->linear_travel);
+    arc->chord_max = settings.arc_tolerance < radius
+                      ? 2.0f * sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance))
+                      : 2.0f * radius;
 
-/* Add a new linear movement to the buffer. target[N_AXIS] is the signed, absolute target position
-   in millimeters. Feed rate specifies the speed of the motion. If feed rate is inverted, the feed
-   rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
-   All position data passed to the planner must be in terms of machine position to keep the planner
-   independent of any coordinate system changes and offsets, which are handled by the g-code parser.
-   NOTE: Assumes buffer is available. Buffer checks are handled at a higher level by motion_control.
-   In other words, the buffer head is never equal to the buffer tail.  Also the feed rate input value
-   is used in three ways: as a normal feed rate if invert_feed_rate is false, as inverse time if
-   invert_feed_rate is true, or as seek/rapids rate if the feed_rate value is negative (and
-   invert_feed_rate always false).
-   The system motion condition tells the planner to plan a motion in the always unused block buffer
-   head. It avoids changing the planner state and preserves the buffer to ensure subsequent gcode
-   motions are still planned correctly, while the stepper module only points to the block buffer head
-   to execute the special system motion. */
-bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
+    memcpy(&block->arc, arc, sizeof(plan_arc_t));
+    block->condition.arc_motion = On;
+    block->millimeters = arc->millimeters;
+    block->step_event_count = 0;
+
+    if(arc->millimeters == 0.0f)
+        return;
+
+    // Use the largest velocity components along the plane axes over the arc for the axis limits.
+    memset(unit_vec, 0, sizeof(float) * N_AXIS);
+    unit_vec[arc->plane.axis_0] = unit_vec[arc->plane.axis_1] = arc_travel / arc->millimeters;
+    unit_vec[arc->plane.axis_linear] = fabsf(arc->linear_travel) / arc->millimeters;
+
+    limit_block_by_axis_maximum(block, unit_vec);
+
+    // Limit speed by curvature, the centripetal acceleration must not exceed the block acceleration.
+    block->rapid_rate = min(block->rapid_rate, sqrtf(block->acceleration * radius));
+
+    // Estimate step event count from the travel along each axis, used for the step segment generator resolution.
+    steps = ceilf(arc_travel * max(settings.axis[arc->plane.axis_0].steps_per_mm, settings.axis[arc->plane.axis_1].steps_per_mm));
+    block->step_event_count = max((uint32_t)steps, block->steps[arc->plane.axis_linear]);
+
+    plan_arc_tangent(&block->arc, 0.0f, unit_vec);
+}
+
+#endif
+
+// Computes the block data from the planner position and the target, returns false if zero-length.
+// If arc is not NULL the block is planned as a circular or helical motion.
+static bool plan_prepare_block (plan_block_t *block, float *target, plan_line_data_t *pl_data, int32_t *target_steps, float *unit_vec, plan_arc_t *arc)
 {
-    // Prepare and initialize new block. Copy relevant pl_data for block execution.
-    plan_block_t *block = block_buffer_head;
-    int32_t target_steps[N_AXIS], position_steps[N_AXIS], delta_steps;
+    int32_t position_steps[N_AXIS], delta_steps;
     uint_fast8_t idx;
-    float unit_vec[N_AXIS];
 
 //    plan_cleanup(block);
     memset(block, 0, sizeof(plan_block_t) - 2 * sizeof(plan_block_t *));    // Zero all block values (except linked list pointers).
-    memcpy(&block->spindle, &pl_data->spindle, sizeof(spindle_t));          // Copy spindle data (RPM etc)
+    block->spindle_rpm = pl_data->spindle.rpm;
     block->condition = pl_data->condition;
     block->overrides = pl_data->overrides;
     block->line_number = pl_data->line_number;
-    block->output_commands = pl_data->output_commands;
-    block->message = pl_data->message;
-    pl_data->message = NULL;
 
     // Copy position data based on type of motion being planned.
     memcpy(position_steps, block->condition.system_motion ? sys_position : pl.position, sizeof(position_steps));
@@ -387,7 +689,10 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
     // Compute and store initial move distance data.
 
 #ifdef KINEMATICS_API
-    kinematics.plan_target_to_steps(target_steps, target);
+    bool cartesian = kinematics_is_cartesian();
+
+    if(!cartesian)
+        kinematics.plan_target_to_steps(target_steps, target);
 #endif
 
     idx = N_AXIS;
@@ -397,51 +702,55 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
         // Also, compute individual axes distance for move and prep unit vector calculations.
         // NOTE: Computes true distance from converted step values.
 
-#ifndef KINEMATICS_API
-        target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
+#ifdef KINEMATICS_API
+        if(cartesian)
 #endif
+        target_steps[idx] = lroundf(target[idx] * settings.axis[idx].steps_per_mm);
         delta_steps = target_steps[idx] - position_steps[idx];
         block->steps[idx] = labs(delta_steps);
         block->step_event_count = max(block->step_event_count, block->steps[idx]);
-        unit_vec[idx] = (float)delta_steps / settings.axis[idx].steps_per_mm; // Store unit vector numerator
+        unit_vec[idx] = (float)delta_steps * mm_per_step[idx]; // Store unit vector numerator
 
         // Set direction bits. Bit enabled always means direction is negative.
         if (delta_steps < 0)
             block->direction_bits.mask |= bit(idx);
+#ifdef ENABLE_BACKLASH_COMPENSATION
+        // Backlash takeup direction for reversing axes moving less than a step.
+        else if(delta_steps == 0 && (pl_data->backlash.mask & bit(idx)) && target[idx] * settings.axis[idx].steps_per_mm < (float)position_steps[idx])
+            block->direction_bits.mask |= bit(idx);
+#endif
 
     } while(idx);
 
-    // Calculate RPMs to be used for Constant Surface Speed calculations
-    if(block->condition.is_rpm_pos_adjusted) {
-        float pos;
-        if((pos = (float)position_steps[block->spindle.css.axis] / settings.axis[block->spindle.css.axis].steps_per_mm - block->spindle.css.tool_offset) > 0.0f) {
-            block->spindle.rpm = block->spindle.css.surface_speed / (pos * (float)(2.0f * M_PI));
-            if(block->spindle.rpm > block->spindle.css.max_rpm)
-                block->spindle.rpm = block->spindle.css.max_rpm;
-        } else
-            block->spindle.rpm = block->spindle.css.max_rpm;
-        if((pos = target[block->spindle.css.axis] - block->spindle.css.tool_offset) > 0.0f) {
-            block->spindle.css.target_rpm = block->spindle.css.surface_speed / (pos * (float)(2.0f * M_PI));
-            if(block->spindle.css.target_rpm > block->spindle.css.max_rpm)
-                block->spindle.css.target_rpm = block->spindle.css.max_rpm;
-        } else
-            block->spindle.css.target_rpm = block->spindle.css.max_rpm;
-    }
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    block->backlash = pl_data->backlash;
+#endif
+
+#ifdef ENABLE_NATIVE_ARCS
+    if(arc)
+        plan_arc_setup(block, arc, unit_vec);
+#endif
 
     // Bail if this is a zero-length block. Highly unlikely to occur.
     if (block->step_event_count == 0)
         return false;
 
-    pl_data->message = NULL;         // Indicate message is already queued for display on execution
-    pl_data->output_commands = NULL; // Indicate commands are already queued for execution
-
+#ifdef ENABLE_NATIVE_ARCS
+    if(!arc) {
+#endif
     // Calculate the unit vector of the line move and the block maximum feed rate and acceleration scaled
     // down such that no individual axes maximum values are exceeded with respect to the line direction.
     // NOTE: This calculation assumes all axes are orthogonal (Cartesian) and works with ABC-axes,
     // if they are also orthogonal/independent. Operates on the absolute value of the unit vector.
     block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
-    block->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
-    block->rapid_rate = limit_max_rate_by_axis_maximum(unit_vec);
+    limit_block_by_axis_maximum(block, unit_vec);
+#ifdef ENABLE_NATIVE_ARCS
+    }
+#endif
+
+    // Apply the rate limit of the motion, used for curvature limiting the arc chords.
+    if(pl_data->rate_limit > 0.0f && block->rapid_rate > pl_data->rate_limit)
+        block->rapid_rate = pl_data->rate_limit;
 
     // Store programmed rate.
     if (block->condition.rapid_motion)
@@ -458,6 +767,9 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
         // Initialize block entry speed as zero. Assume it will be starting from rest. Planner will correct this later.
         // If system motion, the system motion block always is assumed to start from rest and end at a complete stop.
         block->entry_speed_sqr = 0.0f;
+#if PLANNER_FIXED_POINT
+        block->entry_speed_sqr_q = 0;
+#endif
         block->max_junction_speed_sqr = 0.0f; // Starting from rest. Enforce start from zero velocity.
 
     } else {
@@ -484,14 +796,17 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
         // memory in the event of a feedrate override changing the nominal speeds of blocks, which can
         // change the overall maximum entry speed conditions of all blocks.
 
-        float junction_unit_vec[N_AXIS];
-        float junction_cos_theta = 0.0f;
+        // The junction vector is not normalized, its length is accumulated in the same pass and
+        // passed on to limit_acceleration_by_axis_maximum() instead.
+        float junction_vec[N_AXIS];
+        float junction_cos_theta = 0.0f, junction_sqr = 0.0f;
 
         idx = N_AXIS;
         do {
             idx--;
             junction_cos_theta -= pl.previous_unit_vec[idx] * unit_vec[idx];
-            junction_unit_vec[idx] = unit_vec[idx] - pl.previous_unit_vec[idx];
+            junction_vec[idx] = unit_vec[idx] - pl.previous_unit_vec[idx];
+            junction_sqr += junction_vec[idx] * junction_vec[idx];
         } while(idx);
 
         // NOTE: Computed without any expensive trig, sin() or acos(), by trig half angle identity of cos(theta).
@@ -502,49 +817,421 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
             // Junction is a straight line or 180 degrees. Junction speed is infinite.
             block->max_junction_speed_sqr = SOME_LARGE_VALUE;
         } else {
-            convert_delta_vector_to_unit_vector(junction_unit_vec);
-            float junction_acceleration = limit_acceleration_by_axis_maximum(junction_unit_vec);
+            float junction_acceleration = limit_acceleration_by_axis_maximum(junction_vec, sqrtf(junction_sqr));
+            // In path blending mode (G64) the corner may deviate up to the path tolerance from the programmed path.
+            float junction_deviation = max(settings.junction_deviation, pl_data->path_tolerance);
             float sin_theta_d2 = sqrtf(0.5f * (1.0f - junction_cos_theta)); // Trig half angle identity. Always positive.
             block->max_junction_speed_sqr = max(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
-                                                  (junction_acceleration * settings.junction_deviation * sin_theta_d2) / (1.0f - sin_theta_d2));
+                                                  (junction_acceleration * junction_deviation * sin_theta_d2) / (1.0f - sin_theta_d2));
+        }
+
+        // Junctions between arc chords are on the arc, the curvature limited rate applies instead of the junction deviation.
+        if(pl_data->arc_junction)
+            block->max_junction_speed_sqr = max(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED, pl_data->rate_limit * pl_data->rate_limit);
+
+#ifdef ENABLE_THREADING_PIPELINE
+        // Spindle synchronized motion following unsynchronized motion starts from rest at a spindle index pulse.
+        if(block->condition.spindle.synchronized && !block->prev->condition.spindle.synchronized)
+            block->max_junction_speed_sqr = 0.0f;
+#endif
+    }
+
+#if PLANNER_FIXED_POINT
+    block->accel_speed_sqr_q = plan_sqr_fixed(2.0f * block->acceleration * block->millimeters);
+#endif
+
+#ifdef ENABLE_NATIVE_ARCS
+    // Return the exit direction of arcs for the next junction.
+    if(arc)
+        plan_arc_tangent(&block->arc, 1.0f, unit_vec);
+#endif
+
+    return true;
+}
+
+
+// Returns the distance of vertex from the line from the origin to end, or -1.0f if the vertex does not project onto the line.
+static float vertex_deviation (float *vertex, float *end, float end_sqr)
+{
+    uint_fast8_t idx = N_AXIS;
+    float vertex_sqr = 0.0f, dot = 0.0f, deviation;
+
+    do {
+        idx--;
+        vertex_sqr += vertex[idx] * vertex[idx];
+        dot += vertex[idx] * end[idx];
+    } while(idx);
+
+    if(dot <= 0.0f || dot >= end_sqr)
+        return -1.0f;
+
+    deviation = vertex_sqr - dot * dot / end_sqr;
+
+    return deviation > 0.0f ? sqrtf(deviation) : 0.0f;
+}
+
+// Adds a dropped vertex to the merged path. When the list is full every other vertex is removed, the largest
+// deviation of a removed vertex from the line between its neighbours is added to the reserved deviation.
+// NOTE: distance to a line is convex along a segment, the bound is kept for any line checked later.
+static void merge_path_add (float *vertex)
+{
+    if(merge_path.n_vertices == PLANNER_MERGE_VERTICES) {
+
+        uint_fast8_t idx, axis;
+        float start[N_AXIS] = {0}, end[N_AXIS], end_sqr, deviation, max_deviation = 0.0f, *prev = start;
+
+        for(idx = 0; idx < PLANNER_MERGE_VERTICES; idx += 2) {
+            end_sqr = 0.0f;
+            for(axis = 0; axis < N_AXIS; axis++) {
+                end[axis] = merge_path.vertex[idx + 1][axis] - prev[axis];
+                start[axis] = merge_path.vertex[idx][axis] - prev[axis];
+                end_sqr += end[axis] * end[axis];
+            }
+            if((deviation = end_sqr > 0.0f ? vertex_deviation(start, end, end_sqr) : -1.0f) < 0.0f) {
+                deviation = 0.0f; // Not between its neighbours, use the distance to the nearest one.
+                for(axis = 0; axis < N_AXIS; axis++)
+                    deviation += start[axis] * start[axis];
+                deviation = sqrtf(deviation);
+            }
+            max_deviation = max(max_deviation, deviation);
+            prev = merge_path.vertex[idx + 1];
+        }
+
+        for(idx = 0; idx < PLANNER_MERGE_VERTICES / 2; idx++)
+            memcpy(merge_path.vertex[idx], merge_path.vertex[idx * 2 + 1], sizeof(merge_path.vertex[0]));
+
+        merge_path.n_vertices = PLANNER_MERGE_VERTICES / 2;
+        merge_path.reserved += max_deviation;
+    }
+
+    memcpy(merge_path.vertex[merge_path.n_vertices++], vertex, sizeof(merge_path.vertex[0]));
+}
+
+// Returns the tolerance for merging collinear lines in exact path mode, a fraction of the smallest step length.
+static float plan_collinear_tolerance (void)
+{
+    uint_fast8_t idx = N_AXIS;
+    float step_length = mm_per_step[--idx];
+
+    while(idx) {
+        if(mm_per_step[--idx] < step_length)
+            step_length = mm_per_step[idx];
+    }
+
+    return step_length * PLANNER_COLLINEAR_TOLERANCE;
+}
+
+// Merges a new line motion with the last block in the buffer when all vertices dropped by merging deviate less
+// than the path tolerance from the merged line. Each vertex is checked against the new line, the curve through
+// the dropped vertices is thus replaced by the longest chord that stays within the tolerance.
+// Only plain motions that differ in nothing but the target are merged, and only if the last block is neither
+// executing nor has to start slower than already planned. Returns false if not merged, the plan is then unchanged.
+static bool plan_merge_line (float *target, plan_line_data_t *pl_data, float path_tolerance)
+{
+    static const planner_cond_t no_merge = {
+        .system_motion = On,
+        .jog_motion = On,
+        .inverse_time = On,
+        .is_rpm_pos_adjusted = On,
+        .spindle.synchronized = On
+    };
+
+    plan_block_t *block = block_buffer_head->prev;
+
+    if(merge_block != block || block_buffer_head == block_buffer_tail || block == block_buffer_tail || block->data ||
+        pl_data->message || pl_data->output_commands || (pl_data->condition.value & no_merge.value) ||
+#ifdef ENABLE_LASER_RASTER
+         pl_data->raster ||
+#endif
+         pl_data->condition.value != block->condition.value || pl_data->overrides.value != block->overrides.value ||
+          pl_data->spindle.rpm != block->spindle_rpm || (!block->condition.rapid_motion && pl_data->feed_rate != block->programmed_rate))
+        return false;
+
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    if(pl_data->backlash.mask)
+        return false;
+#endif
+
+    // Check deviation of the vertex and earlier dropped vertices from the line from the start of the last block
+    // to the new target. Vertices must project onto the merged line, this rejects reversals.
+    uint_fast8_t idx = N_AXIS;
+    float vertex[N_AXIS], line[N_AXIS], line_sqr = 0.0f, deviation, tolerance = path_tolerance - merge_path.reserved;
+
+    do {
+        idx--;
+        vertex[idx] = (float)(pl.position[idx] - pl_merge.position[idx]) * mm_per_step[idx];
+        line[idx] = target[idx] - (float)pl_merge.position[idx] * mm_per_step[idx];
+        line_sqr += line[idx] * line[idx];
+    } while(idx);
+
+    if((deviation = vertex_deviation(vertex, line, line_sqr)) < 0.0f || deviation > tolerance)
+        return false;
+
+    idx = merge_path.n_vertices;
+    while(idx) {
+        if((deviation = vertex_deviation(merge_path.vertex[--idx], line, line_sqr)) < 0.0f || deviation > tolerance)
+            return false;
+    }
+
+    // Replan the last block from its start position to the new target.
+    float unit_vec[N_AXIS], nominal_speed;
+    int32_t target_steps[N_AXIS];
+    plan_block_t block_prev;
+    planner_t pl_prev;
+
+    memcpy(&block_prev, block, sizeof(plan_block_t));
+    memcpy(&pl_prev, &pl, sizeof(planner_t));
+    memcpy(&pl, &pl_merge, sizeof(planner_t));
+    block_buffer_head = block;
+    next_buffer_head = block->next;
+
+    if(plan_prepare_block(block, target, pl_data, target_steps, unit_vec, NULL)) {
+
+        nominal_speed = plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block), pl.previous_nominal_speed);
+
+        // The entry speed of the block may already be in use by the segment generator, it must not be lowered.
+        if(min(block->max_entry_speed_sqr, 2.0f * block->acceleration * block->millimeters) >= block_prev.entry_speed_sqr) {
+
+            block->entry_speed_sqr = block_prev.entry_speed_sqr;
+#if PLANNER_FIXED_POINT
+            block->entry_speed_sqr_q = block_prev.entry_speed_sqr_q;
+#endif
+            block->time = block_prev.time; // Included in the buffer time, updated by the replan.
+            pl.previous_nominal_speed = nominal_speed;
+            memcpy(pl.previous_unit_vec, unit_vec, sizeof(pl.previous_unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
+            memcpy(pl.position, target_steps, sizeof(pl.position)); // pl.position[] = target_steps[]
+            merge_path_add(vertex);
+
+            if(block_buffer_planned == next_buffer_head)
+                block_buffer_planned = block;
+
+            block_buffer_head = next_buffer_head;
+            next_buffer_head = block_buffer_head->next;
+
+            planner_recalculate(false);
+
+            return true;
+        }
+    }
+
+    // Not possible, restore the plan.
+    memcpy(block, &block_prev, sizeof(plan_block_t));
+    memcpy(&pl, &pl_prev, sizeof(planner_t));
+    block_buffer_head = block->next;
+    next_buffer_head = block_buffer_head->next;
+
+    return false;
+}
+
+
+// Adds a block for a line motion, or for an arc motion if arc is not NULL.
+static bool plan_add_line (float *target, plan_line_data_t *pl_data, plan_arc_t *arc)
+{
+    // Prepare and initialize new block. Copy relevant pl_data for block execution.
+    plan_block_t *block = block_buffer_head;
+    int32_t target_steps[N_AXIS];
+    float unit_vec[N_AXIS];
+
+    // Path blending (G64): try to merge near collinear motions with the last block first.
+    // In exact path mode (G61) only motions collinear within a fraction of a step are merged.
+    // Motions are not merged until the buffer has been filled, the auto cycle start on a full buffer would be delayed.
+    // NOTE: Not possible with kinematics other than Cartesian as motor motion is not linear in cartesian space.
+    float path_tolerance = pl_data->path_tolerance > 0.0f ? pl_data->path_tolerance : plan_collinear_tolerance();
+#ifdef KINEMATICS_API
+    if(arc == NULL && path_tolerance > 0.0f && buffer_filled && kinematics_is_cartesian() &&
+        plan_merge_line(target, pl_data, path_tolerance))
+        return true;
+#else
+    if(arc == NULL && path_tolerance > 0.0f && buffer_filled && plan_merge_line(target, pl_data, path_tolerance))
+        return true;
+#endif
+
+    if(!plan_prepare_block(block, target, pl_data, target_steps, unit_vec, arc))
+        return false;
+
+    // Attach side table entry for messages, output commands, laser raster and Constant Surface Speed data if required.
+    // NOTE: Availability of an entry is checked by plan_check_full_buffer(). System motions never carry this data.
+#ifdef ENABLE_LASER_RASTER
+    if(!block->condition.system_motion && (pl_data->message || pl_data->output_commands || pl_data->raster || block->condition.is_rpm_pos_adjusted)) {
+#else
+    if(!block->condition.system_motion && (pl_data->message || pl_data->output_commands || block->condition.is_rpm_pos_adjusted)) {
+#endif
+
+        plan_block_data_t *data = plan_block_data_alloc(block);
+
+        data->message = pl_data->message;
+        data->output_commands = pl_data->output_commands;
+        pl_data->message = 0;            // Indicate message is already queued for display on execution
+        pl_data->output_commands = NULL; // Indicate commands are already queued for execution
+#ifdef ENABLE_LASER_RASTER
+        data->raster = pl_data->raster;
+        pl_data->raster = NULL;          // Indicate raster is already queued for output on execution
+#endif
+
+        // Keep the radial positions to be used for Constant Surface Speed calculations, the RPM at the start of the block
+        // is used when the spindle is started or restored.
+        if(block->condition.is_rpm_pos_adjusted) {
+            css_data_t *css = &pl_data->spindle.css;
+            data->css.surface_speed = css->surface_speed;
+            data->css.max_rpm = css->max_rpm;
+            data->css.start_pos = (float)pl.position[css->axis] * mm_per_step[css->axis] - css->tool_offset;
+            data->css.delta_pos = target[css->axis] - css->tool_offset - data->css.start_pos;
+            if(data->css.start_pos > 0.0f) {
+                block->spindle_rpm = css->surface_speed / (data->css.start_pos * (float)(2.0f * M_PI));
+                if(block->spindle_rpm > css->max_rpm)
+                    block->spindle_rpm = css->max_rpm;
+            } else
+                block->spindle_rpm = css->max_rpm;
         }
     }
 
     // Block system motion from updating this data to ensure next g-code motion is computed correctly.
     if (!block->condition.system_motion) {
 
+        // Keep the planner state at the start of the block for path blending.
+        memcpy(&pl_merge, &pl, sizeof(planner_t));
+#ifdef ENABLE_BACKLASH_COMPENSATION
+        merge_block = block->backlash.mask || block->condition.arc_motion ? NULL : block;
+#else
+        merge_block = block->condition.arc_motion ? NULL : block;
+#endif
+        merge_path.n_vertices = 0;
+        merge_path.reserved = 0.0f;
+
         pl.previous_nominal_speed = plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block), pl.previous_nominal_speed);
 
-        if(!block->condition.backlash_motion) {
-            // Update previous path unit_vector and planner position.
-            memcpy(pl.previous_unit_vec, unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
-            memcpy(pl.position, target_steps, sizeof(target_steps)); // pl.position[] = target_steps[]
-        }
+        // Update previous path unit_vector and planner position.
+        memcpy(pl.previous_unit_vec, unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
+        memcpy(pl.position, target_steps, sizeof(target_steps)); // pl.position[] = target_steps[]
         // New block is all set. Update buffer head and next buffer head indices.
         block_buffer_head = next_buffer_head;
         next_buffer_head = block_buffer_head->next;
+        if (next_buffer_head == block_buffer_tail)
+            buffer_filled = true;
 
         // Finish up by recalculating the plan with the new block.
-        planner_recalculate();
+        planner_recalculate(false);
     }
 
     return true;
 }
 
 
+/* Add a new linear movement to the buffer. target[N_AXIS] is the signed, absolute target position
+   in millimeters. Feed rate specifies the speed of the motion. If feed rate is inverted, the feed
+   rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
+   All position data passed to the planner must be in terms of machine position to keep the planner
+   independent of any coordinate system changes and offsets, which are handled by the g-code parser.
+   NOTE: Assumes buffer is available. Buffer checks are handled at a higher level by motion_control.
+   In other words, the buffer head is never equal to the buffer tail.  Also the feed rate input value
+   is used in three ways: as a normal feed rate if invert_feed_rate is false, as inverse time if
+   invert_feed_rate is true, or as seek/rapids rate if the feed_rate value is negative (and
+   invert_feed_rate always false).
+   The system motion condition tells the planner to plan a motion in the always unused block buffer
+   head. It avoids changing the planner state and preserves the buffer to ensure subsequent gcode
+   motions are still planned correctly, while the stepper module only points to the block buffer head
+   to execute the special system motion. */
+bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
+{
+    bool ok;
+
+    // Block interrupt driven segment prep from accessing the buffer while it is updated.
+    st_prep_lock(true);
+    ok = plan_add_line(target, pl_data, NULL);
+    st_prep_lock(false);
+
+    return ok;
+}
+
+#ifdef ENABLE_PLANNED_DWELL
+
+/* Add a dwell to the buffer as a block without motion, the step segment generator executes it by outputting
+   segments without steps for the dwell time. The dwell block has zero length and a zero max entry speed, so
+   the preceding motion is planned to stop at the dwell and the following motion to start from rest.
+   NOTE: Assumes buffer is available, same as plan_buffer_line(). */
+bool plan_buffer_dwell (float seconds, plan_line_data_t *pl_data)
+{
+    plan_block_t *block = block_buffer_head;
+
+    st_prep_lock(true);
+
+    memset(block, 0, sizeof(plan_block_t) - 2 * sizeof(plan_block_t *));    // Zero all block values (except linked list pointers).
+    block->spindle_rpm = pl_data->spindle.rpm;
+    block->condition.spindle = pl_data->condition.spindle;
+    block->condition.spindle.synchronized = Off;
+    block->condition.coolant = pl_data->condition.coolant;
+    block->condition.is_rpm_rate_adjusted = pl_data->condition.is_rpm_rate_adjusted;
+    block->condition.is_laser_ppi_mode = pl_data->condition.is_laser_ppi_mode;
+    block->condition.dwell = On;
+    block->overrides = pl_data->overrides;
+    block->line_number = pl_data->line_number;
+    block->dwell = seconds * (1.0f / 60.0f);
+
+    // Lines are not merged across the dwell and the next motion starts from rest.
+    merge_block = NULL;
+    pl.previous_nominal_speed = 0.0f;
+
+    block_buffer_head = next_buffer_head;
+    next_buffer_head = block_buffer_head->next;
+    if (next_buffer_head == block_buffer_tail)
+        buffer_filled = true;
+
+    planner_recalculate(false);
+
+    st_prep_lock(false);
+
+    return true;
+}
+
+#endif
+
+#ifdef ENABLE_NATIVE_ARCS
+
+/* Add a new circular or helical motion to the buffer as a single block. target[N_AXIS] is the signed,
+   absolute end position in millimeters, arc holds the geometry relative to the current planner position.
+   The arc length, curvature limited speed and chord length are computed here, the step segment generator
+   executes the arc as chords within settings.arc_tolerance. Takes one planner block regardless of size.
+   NOTE: Assumes buffer is available, same as plan_buffer_line(). */
+bool plan_buffer_arc (float *target, plan_line_data_t *pl_data, plan_arc_t *arc)
+{
+    bool ok;
+
+    st_prep_lock(true);
+    ok = plan_add_line(target, pl_data, arc);
+    st_prep_lock(false);
+
+    return ok;
+}
+
+#endif
+
+
 // Reset the planner position vectors. Called by the system abort/initialization routine.
 void plan_sync_position ()
 {
     memcpy(pl.position, sys_position, sizeof(pl.position));
+    merge_block = NULL;
+}
+
+// Returns the planner position, the target of the last planned motion, in machine coordinates.
+void plan_get_planner_mpos (float *target)
+{
+    system_convert_array_steps_to_mpos(target, pl.position);
 }
 
 
 // Returns the number of available blocks are in the planner buffer.
-uint8_t plan_get_block_buffer_available ()
+uint_fast16_t plan_get_block_buffer_available ()
+{
+    return (uint_fast16_t)(block_buffer_head >= block_buffer_tail
+                            ? ((block_buffer_size - 1) - (block_buffer_head - block_buffer_tail))
+                            : ((block_buffer_tail - block_buffer_head) - 1));
+}
+
+// Returns the number of blocks allocated for the planner buffer.
+uint_fast16_t plan_get_block_buffer_size ()
 {
-    return (uint8_t)(block_buffer_head >= block_buffer_tail
-                      ? ((BLOCK_BUFFER_SIZE - 1) - (block_buffer_head - block_buffer_tail))
-                      : ((block_buffer_tail - block_buffer_head) - 1));
+    return block_buffer_size;
 }
 
 
@@ -552,10 +1239,12 @@ uint8_t plan_get_block_buffer_available ()
 // Called after a steppers have come to a complete stop for a feed hold and the cycle is stopped.
 void plan_cycle_reinitialize ()
 {
+    st_prep_lock(true);
     // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
     st_update_plan_block_parameters();
     block_buffer_planned = block_buffer_tail;
-    planner_recalculate();
+    planner_recalculate(true);
+    st_prep_lock(false);
 }
 
 // Set feed overrides
@@ -567,10 +1256,38 @@ void plan_feed_override (uint_fast8_t feed_override, uint_fast8_t rapid_override
     feed_override = max(min(feed_override, MAX_FEED_RATE_OVERRIDE), MIN_FEED_RATE_OVERRIDE);
 
     if ((feed_override != sys.override.feed_rate) || (rapid_override != sys.override.rapid_rate)) {
+      bool increase = feed_override >= sys.override.feed_rate && rapid_override >= sys.override.rapid_rate;
       sys.override.feed_rate = (uint8_t)feed_override;
       sys.override.rapid_rate = (uint8_t)rapid_override;
       sys.report.overrides = On; // Set to report change immediately
-      plan_update_velocity_profile_parameters();
-      plan_cycle_reinitialize();
+      st_prep_lock(true);
+      if(increase && hal.get_elapsed_ticks) {
+          // The current plan is valid at higher overrides since the planned speeds are still reachable, only
+          // the executing block is updated now and the replan of the buffer is deferred.
+          // NOTE: the block nominal speeds are computed from the current overrides by the segment generator.
+          st_update_plan_block_parameters();
+          if(!override_replan.pending) {
+              override_replan.pending = true;
+              override_replan.ms = hal.get_elapsed_ticks();
+          }
+      } else {
+          override_replan.pending = false;
+          plan_update_velocity_profile_parameters();
+          plan_cycle_reinitialize();
+      }
+      st_prep_lock(false);
+    }
+}
+
+// Replans the buffer PLANNER_OVERRIDE_REPLAN_DELAY ms after a deferred override increase, called
+// from the main loop. Repeated override changes, e.g. from a THC, are thus replanned together.
+void plan_override_replan (void)
+{
+    if(override_replan.pending && hal.get_elapsed_ticks() - override_replan.ms >= PLANNER_OVERRIDE_REPLAN_DELAY) {
+        override_replan.pending = false;
+        st_prep_lock(true);
+        plan_update_velocity_profile_parameters();
+        plan_cycle_reinitialize();
+        st_prep_lock(false);
     }
 }
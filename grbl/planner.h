@@ -24,51 +24,128 @@
 #ifndef _PLANNER_H_
 #define _PLANNER_H_
 
-// The number of linear motions that can be in the plan at any give time
+// The number of linear motions that can be in the plan at any give time.
+// NOTE: The actual number is set by $398 at boot, this is the default and fallback value.
 #ifndef BLOCK_BUFFER_SIZE
   #define BLOCK_BUFFER_SIZE 36
 #endif
 
+// Limits for the number of planner blocks that can be set by $398.
+#ifndef PLANNER_BUFFER_BLOCKS_MIN
+  #define PLANNER_BUFFER_BLOCKS_MIN 16
+#endif
+#ifndef PLANNER_BUFFER_BLOCKS_MAX
+  #define PLANNER_BUFFER_BLOCKS_MAX 1000
+#endif
+
+// Number of entries in the side table for rarely used block data (messages, output commands and CSS data).
+// NOTE: When all entries are in use the planner is reported full until a block holding an entry has been executed.
+#ifndef PLANNER_BLOCK_DATA_SIZE
+  #define PLANNER_BLOCK_DATA_SIZE 16
+#endif
+
+// Delay in ms before the buffer is replanned after a feed or rapid override increase, override decreases are
+// replanned immediately. Set to 0 to replan on the next main loop pass.
+#ifndef PLANNER_OVERRIDE_REPLAN_DELAY
+  #define PLANNER_OVERRIDE_REPLAN_DELAY 25
+#endif
+
+// Runs the planner passes in integer arithmetic, see config.h.
+#ifndef PLANNER_FIXED_POINT
+  #define PLANNER_FIXED_POINT 0
+#endif
+
+// Number of dropped vertices kept for the G64 path tolerance check of merged lines, must be even. When full, every
+// other vertex is dropped and its deviation from the remaining path is reserved from the tolerance.
+#ifndef PLANNER_MERGE_VERTICES
+  #define PLANNER_MERGE_VERTICES 16
+#endif
+
+// In exact path mode (G61) lines are merged when the dropped vertices deviate less than this fraction of the smallest
+// step length from the merged line. This extends the look-ahead distance for long runs of short collinear lines so that
+// they can reach the speed of a single line. Set to 0.0f to disable.
+#ifndef PLANNER_COLLINEAR_TOLERANCE
+  #define PLANNER_COLLINEAR_TOLERANCE 0.5f
+#endif
+
+// Native arcs are not possible with kinematics, backlash compensation or input shaping, arcs are then approximated by line motions.
+#if defined(ENABLE_NATIVE_ARCS) && (defined(KINEMATICS_API) || defined(ENABLE_BACKLASH_COMPENSATION) || defined(ENABLE_INPUT_SHAPING))
+#undef ENABLE_NATIVE_ARCS
+#endif
+
 typedef union {
     uint32_t value;
     struct {
         uint16_t rapid_motion         :1,
                  system_motion        :1,
                  jog_motion           :1,
-                 backlash_motion      :1,
                  no_feed_override     :1,
                  inverse_time         :1,
                  is_rpm_rate_adjusted :1,
                  is_rpm_pos_adjusted  :1,
                  is_laser_ppi_mode    :1,
-                 unassigned           :7;
+                 arc_motion           :1,
+                 dwell                :1,
+                 unassigned           :6;
         spindle_state_t spindle;
         coolant_state_t coolant;
     };
 } planner_cond_t;
 
+// Constant Surface Speed mode data, the spindle RPM is computed by the step segment generator from the radial position.
+typedef struct {
+    float surface_speed;    // Surface speed in millimeters/min
+    float max_rpm;          // Maximum spindle RPM
+    float start_pos;        // Radial position at start of block in millimeters
+    float delta_pos;        // Radial distance travelled by the block in millimeters
+} plan_css_t;
+
+// Rarely used block data, kept in a side table referenced by index from the planner block.
+typedef struct {
+    uint8_t message;                    // Id of message to be displayed when block is executed, 0 if none. See pool.h.
+    output_command_t *output_commands;  // Output commands (linked list) to be performed when block is executed.
+    plan_css_t css;                     // Constant Surface Speed mode data.
+#ifdef ENABLE_LASER_RASTER
+    laser_raster_t *raster;             // Laser pixel powers to be output over the length of the block.
+#endif
+} plan_block_data_t;
+
+// Arc geometry of a circular or helical motion planned as a single block, relative to the start position of the block.
+typedef struct {
+    plane_t plane;          // Arc plane and helical axis
+    float offset[2];        // Arc center relative to the start position along the plane axes (mm)
+    float angular_travel;   // Angular travel (radians), positive is counter clockwise
+    float linear_travel;    // Travel along the helical axis (mm)
+    float millimeters;      // Arc length (mm), set by the planner. Does not change.
+    float chord_max;        // Maximum chord length within the arc tolerance (mm), set by the planner
+} plan_arc_t;
+
 // This struct stores a linear movement of a g-code block motion with its critical "nominal" values
 // are as specified in the source g-code.
+// NOTE: Only data used by the planner and the step segment generator is kept here, fields are ordered to avoid padding.
 typedef struct plan_block {
     // Fields used by the bresenham algorithm for tracing the line
     // NOTE: Used by stepper algorithm to execute the block correctly. Do not alter these values.
     uint32_t steps[N_AXIS];         // Step count along each axis
     uint32_t step_event_count;      // The maximum step axis count and number of steps required to complete this block.
-    axes_signals_t direction_bits;  // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
-
-    // Block condition data to ensure correct execution depending on states and overrides.
-    planner_cond_t condition;       // Block bitfield variable defining block run conditions. Copied from pl_line_data.
-    gc_override_flags_t overrides;  // Block bitfield variable for overrides
-    int32_t line_number;            // Block line number for real-time reporting. Copied from pl_line_data.
 
     // Fields used by the motion planner to manage acceleration. Some of these values may be updated
     // by the stepper module during execution of special motion cases for replanning purposes.
     float entry_speed_sqr;      // The current planned entry speed at block junction in (mm/min)^2
     float max_entry_speed_sqr;  // Maximum allowable entry speed based on the minimum of junction limit and
                                 // neighboring nominal speeds with overrides in (mm/min)^2
+#if PLANNER_FIXED_POINT
+    uint32_t entry_speed_sqr_q;     // Integer values in (mm/min)^2 used by the planner passes, see planner.c.
+    uint32_t max_entry_speed_sqr_q;
+    uint32_t accel_speed_sqr_q;     // Change of speed squared over the block at full acceleration, 2 * acceleration * millimeters.
+#endif
     float acceleration;         // Axis-limit adjusted line acceleration in (mm/min^2). Does not change.
+#ifdef ENABLE_JERK_ACCELERATION
+    float jerk;                 // Axis-limit adjusted line jerk in (mm/min^3). Does not change.
+#endif
     float millimeters;          // The remaining distance for this block to be executed in (mm).
                                 // NOTE: This value may be altered by stepper algorithm during execution.
+    float time;                 // Planned duration of the block in minutes, computed from the planned entry and exit speeds.
 
     // Stored rate limiting data used by planner when changes occur.
     float max_junction_speed_sqr; // Junction entry speed limit based on direction vectors in (mm/min)^2
@@ -76,10 +153,27 @@ typedef struct plan_block {
     float programmed_rate;        // Programmed rate of this block (mm/min).
 
     // Stored spindle speed data used by spindle overrides and resuming methods.
-    spindle_t spindle;    // Block spindle speed. Copied from pl_line_data.
+    float spindle_rpm;            // Block spindle speed. Copied from pl_line_data.
+#ifdef ENABLE_PLANNED_DWELL
+    float dwell;                  // Remaining dwell time of a dwell block in minutes, only valid if condition.dwell is set.
+                                  // NOTE: This value is altered by the stepper algorithm during execution.
+#endif
+
+    // Block condition data to ensure correct execution depending on states and overrides.
+    int32_t line_number;            // Block line number for real-time reporting. Copied from pl_line_data.
+    planner_cond_t condition;       // Block bitfield variable defining block run conditions. Copied from pl_line_data.
+    axes_signals_t direction_bits;  // The direction bit set for this block (refers to *_DIRECTION_BIT in config.h)
+    gc_override_flags_t overrides;  // Block bitfield variable for overrides
+    uint8_t data;                   // Index + 1 of side table entry for rarely used data, 0 if none. See plan_get_block_data().
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    axes_signals_t backlash;        // Axes reversing direction, the step generator adds backlash takeup steps at the start of the block.
+#endif
+#ifdef ENABLE_NATIVE_ARCS
+    plan_arc_t arc;                 // Arc geometry, only valid if condition.arc_motion is set.
+                                    // NOTE: For arcs steps and direction_bits are for the end position, the step event count
+                                    //       is estimated from the arc length. The step segment generator executes arcs as chords.
+#endif
 
-    char *message;                // Message to be displayed when block is executed.
-    output_command_t *output_commands;
     struct plan_block *prev, *next; // Linked list pointers, DO NOT MOVE - these MUST be the last elements in the struct!
 } plan_block_t;
 
@@ -91,9 +185,18 @@ typedef struct {
     planner_cond_t condition;       // Bitfield variable to indicate planner conditions. See defines above.
     gc_override_flags_t overrides;  // Block bitfield variable for overrides
     int32_t line_number;            // Desired line number to report when executing.
+    float path_tolerance;           // Path blending tolerance in mm (G64 P), zero when in exact path mode (G61).
+    float rate_limit;               // Maximum rate of the motion (mm/min), zero if not limited. Set by mc_arc() from the arc curvature.
+    bool arc_junction;              // Set by mc_arc() for arc chords following the first, junction speed is then limited by rate_limit.
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    axes_signals_t backlash;        // Axes reversing direction, set by mc_line().
+#endif
 //    void *parameters;               // TODO: pointer to extra parameters, for canned cycles and threading?
-    char *message;                  // Message to be displayed when block is executed.
+    uint8_t message;                // Id of message to be displayed when block is executed, 0 if none. See pool.h.
     output_command_t *output_commands;
+#ifdef ENABLE_LASER_RASTER
+    laser_raster_t *raster;         // Laser pixel powers to be output over the length of the motion.
+#endif
 } plan_line_data_t;
 
 
@@ -107,7 +210,7 @@ typedef struct {
 } planner_t;
 
 // Initialize and reset the motion plan subsystem
-void plan_reset(); // Reset all
+bool plan_reset (void); // Reset all
 //void plan_reset_buffer(); // Reset buffer only.
 
 // Add a new linear movement to the buffer. target[N_AXIS] is the signed, absolute target position
@@ -115,6 +218,17 @@ void plan_reset(); // Reset all
 // rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
 bool plan_buffer_line(float *target, plan_line_data_t *pl_data);
 
+#ifdef ENABLE_PLANNED_DWELL
+// Add a dwell to the buffer, executed in sequence with motions by the step segment generator.
+bool plan_buffer_dwell (float seconds, plan_line_data_t *pl_data);
+#endif
+
+#ifdef ENABLE_NATIVE_ARCS
+// Add a new circular or helical motion to the buffer as a single block, target is the absolute end position.
+// Returns false if zero-length. NOTE: Axes other than the plane and helical axes must not move.
+bool plan_buffer_arc (float *target, plan_line_data_t *pl_data, plan_arc_t *arc);
+#endif
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 void plan_discard_current_block();
@@ -125,6 +239,12 @@ plan_block_t *plan_get_system_motion_block();
 // Gets the current block. Returns NULL if buffer empty
 plan_block_t *plan_get_current_block();
 
+// Gets a queued block by its position in the buffer, 0 is the current block. Returns NULL if not queued.
+plan_block_t *plan_get_block (uint_fast16_t idx);
+
+// Gets the side table data (messages, output commands and CSS data) for a block. Returns NULL if none.
+plan_block_data_t *plan_get_block_data (plan_block_t *block);
+
 // Called by step segment buffer when computing executing block velocity profile.
 float plan_get_exec_block_exit_speed_sqr();
 
@@ -141,7 +261,13 @@ void plan_sync_position();
 void plan_cycle_reinitialize();
 
 // Returns the number of available blocks in the planner buffer.
-uint8_t plan_get_block_buffer_available();
+uint_fast16_t plan_get_block_buffer_available();
+
+// Returns the number of blocks allocated for the planner buffer.
+uint_fast16_t plan_get_block_buffer_size();
+
+// Returns the planned time to execute the motions in the buffer in seconds.
+float plan_get_buffer_time (void);
 
 // Returns the status of the block ring buffer. True, if buffer is full.
 bool plan_check_full_buffer();
@@ -149,4 +275,7 @@ bool plan_check_full_buffer();
 void plan_get_planner_mpos(float *target);
 void plan_feed_override (uint_fast8_t feed_override, uint_fast8_t rapid_override);
 
+// Executes a pending deferred replan after an override increase.
+void plan_override_replan (void);
+
 #endif
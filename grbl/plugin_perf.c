@@ -0,0 +1,119 @@
+/*
+  plugin_perf.c - performance counters for plugin hooks, reported by $PERF
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "hal.h"
+
+#ifdef ENABLE_PLUGIN_PERF
+
+static THREAD_LOCAL plugin_perf_t *perf_list = NULL;
+static THREAD_LOCAL on_unknown_sys_command_ptr on_unknown_sys_command = NULL;
+
+ISR_CODE void plugin_perf_add (plugin_perf_t *perf, uint32_t start)
+{
+    perf->count++;
+
+    if(hal.get_cycle_count) {
+        uint32_t cycles = hal.get_cycle_count() - start;
+        perf->cycles += cycles;
+        if(cycles > perf->cycles_max)
+            perf->cycles_max = cycles;
+    }
+}
+
+static void perf_reset (void)
+{
+    plugin_perf_t *perf = perf_list;
+
+    while(perf) {
+        hal.irq_disable();
+        perf->count = perf->cycles_max = 0;
+        perf->cycles = 0;
+        hal.irq_enable();
+        perf = perf->next;
+    }
+}
+
+// Prints [PERF:<name>,<count>,<average cycles>,<max cycles>] for each counter in the order registered.
+static void perf_report (void)
+{
+    uint32_t count, cycles_max;
+    uint64_t cycles;
+    plugin_perf_t *perf = perf_list;
+
+    while(perf) {
+        hal.irq_disable();
+        count = perf->count;
+        cycles = perf->cycles;
+        cycles_max = perf->cycles_max;
+        hal.irq_enable();
+
+        hal.stream.write("[PERF:");
+        hal.stream.write(perf->name);
+        hal.stream.write(",");
+        hal.stream.write(uitoa(count));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(count ? (uint32_t)(cycles / count) : 0));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(cycles_max));
+        hal.stream.write("]" ASCII_EOL);
+
+        perf = perf->next;
+    }
+}
+
+static status_code_t perf_command (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strcmp(&line[1], "PERF")) {
+        perf_report();
+        retval = Status_OK;
+    } else if(!strcmp(&line[1], "PERFR")) {
+        perf_reset();
+        retval = Status_OK;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+// The $PERF command is added when the first counter is registered.
+void plugin_perf_register (plugin_perf_t *perf)
+{
+    plugin_perf_t *last = perf_list;
+
+    if(perf_list == NULL) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = perf_command;
+    }
+
+    perf->next = NULL;
+
+    if(last) {
+        while(last->next)
+            last = last->next;
+        last->next = perf;
+    } else
+        perf_list = perf;
+}
+
+#endif
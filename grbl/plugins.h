@@ -120,7 +120,13 @@ typedef enum {
     Encoder_MPG_A,
     Encoder_MPG_B,
     Encoder_MPG_C,
-    Encoder_Spindle_Position
+    Encoder_Spindle_Position,
+    Encoder_Motor_X,    // Motor or axis feedback, CPR is counts per mm and CPD the following error limit in counts
+    Encoder_Motor_Y,
+    Encoder_Motor_Z,
+    Encoder_Motor_A,
+    Encoder_Motor_B,
+    Encoder_Motor_C
 } encoder_mode_t;
 
 typedef enum {
@@ -179,6 +185,46 @@ typedef struct {
     uint8_t *data;
 } nvs_transfer_t;
 
+// Performance counters, see ENABLE_PLUGIN_PERF in config.h
+
+typedef struct plugin_perf {
+    const char *name;
+    volatile uint32_t count;     // Number of calls or events
+    volatile uint32_t cycles_max;
+    volatile uint64_t cycles;    // Total cycles, only when hal.get_cycle_count is provided
+    struct plugin_perf *next;
+} plugin_perf_t;
+
+// Adds a counter to the list reported by $PERF, to be called once from the plugin init function.
+void plugin_perf_register (plugin_perf_t *perf);
+
+// Counts a call and adds the cycles since start, called by PLUGIN_PERF_END().
+void plugin_perf_add (plugin_perf_t *perf, uint32_t start);
+
+#ifdef ENABLE_PLUGIN_PERF
+#define PLUGIN_PERF_DEFINE(var, label) static plugin_perf_t var = { .name = label }
+#define PLUGIN_PERF_REGISTER(var) plugin_perf_register(&var)
+#define PLUGIN_PERF_START(var) uint32_t var##_start = hal.get_cycle_count ? hal.get_cycle_count() : 0
+#define PLUGIN_PERF_END(var) plugin_perf_add(&var, var##_start)
+#define PLUGIN_PERF_COUNT(var) var.count++
+// Spans time intervals crossing calls, e.g. from a request to its reply. A span is started by PLUGIN_PERF_MARK(), ended and added
+// by PLUGIN_PERF_SPAN_END() and abandoned by PLUGIN_PERF_SPAN_CANCEL(), ending a span not started does nothing.
+#define PLUGIN_PERF_DEFINE_SPAN(var, label) static plugin_perf_t var = { .name = label }; static uint32_t var##_mark; static bool var##_pending = false
+#define PLUGIN_PERF_MARK(var) do { var##_mark = hal.get_cycle_count ? hal.get_cycle_count() : 0; var##_pending = true; } while(0)
+#define PLUGIN_PERF_SPAN_END(var) do { if(var##_pending) { var##_pending = false; plugin_perf_add(&var, var##_mark); } } while(0)
+#define PLUGIN_PERF_SPAN_CANCEL(var) var##_pending = false
+#else
+#define PLUGIN_PERF_DEFINE(var, label)
+#define PLUGIN_PERF_REGISTER(var)
+#define PLUGIN_PERF_START(var)
+#define PLUGIN_PERF_END(var)
+#define PLUGIN_PERF_COUNT(var)
+#define PLUGIN_PERF_DEFINE_SPAN(var, label)
+#define PLUGIN_PERF_MARK(var)
+#define PLUGIN_PERF_SPAN_END(var)
+#define PLUGIN_PERF_SPAN_CANCEL(var)
+#endif
+
 extern void i2c_init (void);
 extern nvs_transfer_result_t i2c_nvs_transfer (nvs_transfer_t *i2c, bool read);
 extern void my_plugin_init (void)  __attribute__((weak));
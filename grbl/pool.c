@@ -0,0 +1,148 @@
+/*
+  pool.c - fixed size pools for messages and output commands queued with motion
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Entries are allocated by the parser and released by the planner, the stepper or the parser, the stepper
+  may release entries from the step interrupt. Allocation is only done by the foreground process and an
+  output command entry is released by clearing its in use flag, so no locking is required for these.
+
+  Messages are interned: blocks carry the 8-bit id of a reference counted entry and repeated messages, eg.
+  tool change prompts emitted for every setup, share the entry. Reference counts are updated with interrupts
+  disabled since they may be dropped from interrupt context.
+*/
+
+#include <string.h>
+
+#include "hal.h"
+#include "pool.h"
+
+typedef struct {
+    uint8_t *items;
+    volatile bool *used;
+    uint_fast16_t item_size;
+    uint_fast16_t n_items;
+    uint_fast16_t next; // Entry to check first on next allocation
+} pool_t;
+
+typedef struct {
+    volatile uint8_t refs;
+    char text[POOL_MESSAGE_SIZE];
+} message_t;
+
+static THREAD_LOCAL message_t messages[POOL_MESSAGES];
+static THREAD_LOCAL output_command_t output_commands[POOL_OUTPUT_COMMANDS];
+static THREAD_LOCAL volatile bool output_commands_used[POOL_OUTPUT_COMMANDS];
+
+static THREAD_LOCAL pool_t output_command_pool = {
+    .items = (uint8_t *)output_commands,
+    .used = output_commands_used,
+    .item_size = sizeof(output_command_t),
+    .n_items = POOL_OUTPUT_COMMANDS
+};
+
+static void *pool_get (pool_t *pool)
+{
+    uint_fast16_t idx = pool->n_items, entry = pool->next;
+
+    do {
+        if(!pool->used[entry]) {
+            pool->used[entry] = true;
+            pool->next = entry == pool->n_items - 1 ? 0 : entry + 1;
+            return pool->items + entry * pool->item_size;
+        }
+        entry = entry == pool->n_items - 1 ? 0 : entry + 1;
+    } while(--idx);
+
+    return NULL;
+}
+
+ISR_CODE static bool pool_put (pool_t *pool, void *item)
+{
+    bool ok;
+
+    if((ok = (uint8_t *)item >= pool->items && (uint8_t *)item < pool->items + pool->n_items * pool->item_size))
+        pool->used[((uint8_t *)item - pool->items) / pool->item_size] = false;
+
+    return ok;
+}
+
+uint8_t pool_intern_message (const char *message)
+{
+    uint_fast16_t idx = POOL_MESSAGES, id = 0, free = 0;
+
+    while(idx && !id) {
+        if(messages[--idx].refs == 0)
+            free = idx + 1;
+        else if(!strncmp(messages[idx].text, message, POOL_MESSAGE_SIZE - 1))
+            id = idx + 1;
+    }
+
+    if(id) {
+        // NOTE: the text is unchanged if the last reference was dropped after the entry was found.
+        hal.irq_disable();
+        messages[id - 1].refs++;
+        hal.irq_enable();
+    } else if((id = free)) {
+        strncpy(messages[id - 1].text, message, POOL_MESSAGE_SIZE - 1);
+        messages[id - 1].text[POOL_MESSAGE_SIZE - 1] = '\0';
+        messages[id - 1].refs = 1;
+    }
+
+    return (uint8_t)id;
+}
+
+const char *pool_get_message (uint8_t id)
+{
+    return id && id <= POOL_MESSAGES ? messages[id - 1].text : "";
+}
+
+ISR_CODE void pool_release_message (uint8_t id)
+{
+    if(id && id <= POOL_MESSAGES) {
+        hal.irq_disable();
+        if(messages[id - 1].refs)
+            messages[id - 1].refs--;
+        hal.irq_enable();
+    }
+}
+
+output_command_t *pool_alloc_output_command (void)
+{
+    return (output_command_t *)pool_get(&output_command_pool);
+}
+
+ISR_CODE void pool_free (void *item)
+{
+    if(item)
+        pool_put(&output_command_pool, item);
+}
+
+uint32_t pool_get_memory (void)
+{
+    return sizeof(messages) + sizeof(output_commands) + sizeof(output_commands_used);
+}
+
+void pool_reset (void)
+{
+    memset(messages, 0, sizeof(messages));
+    memset((void *)output_commands_used, 0, sizeof(output_commands_used));
+    output_command_pool.next = 0;
+}
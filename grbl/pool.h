@@ -0,0 +1,71 @@
+/*
+  pool.h - fixed size pools for messages and output commands queued with motion
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include "gcode.h"
+#include "planner.h"
+#include "stepper.h"
+
+// Size of a message entry, including the terminating null. Longer messages are truncated.
+#ifndef POOL_MESSAGE_SIZE
+#define POOL_MESSAGE_SIZE 64
+#endif
+
+// Number of message entries. Messages are held by the planner block data side table, the step segment
+// buffer blocks, the pending output of the stepper and the parser. Identical messages share an entry.
+#ifndef POOL_MESSAGES
+#define POOL_MESSAGES (PLANNER_BLOCK_DATA_SIZE + SEGMENT_BUFFER_SIZE + 1)
+#endif
+
+#if POOL_MESSAGES > 255
+#error "POOL_MESSAGES must be less than 256, messages are referenced by an 8-bit id!"
+#endif
+
+// Number of output command entries (M62, M63, M67 and deferred coolant changes).
+#ifndef POOL_OUTPUT_COMMANDS
+#define POOL_OUTPUT_COMMANDS (PLANNER_BLOCK_DATA_SIZE * 2)
+#endif
+
+// Returns the id of a reference counted entry holding the message, 0 if none is available.
+// An existing entry is shared if it holds the same message. Must be called from the foreground process.
+uint8_t pool_intern_message (const char *message);
+
+// Returns the message for an id returned by pool_intern_message().
+const char *pool_get_message (uint8_t id);
+
+// Drops a reference to a message entry, 0 is ignored. May be called from interrupt context.
+void pool_release_message (uint8_t id);
+
+// Allocates an output command entry, returns NULL if none is available. Must be called from the foreground process.
+output_command_t *pool_alloc_output_command (void);
+
+// Releases an output command entry, NULL is ignored. May be called from interrupt context.
+void pool_free (void *item);
+
+// Returns the memory in bytes used by the pools.
+uint32_t pool_get_memory (void);
+
+// Releases all entries, called on soft reset when all holders have been reset.
+void pool_reset (void);
+
+#endif
@@ -26,7 +26,8 @@
 
 typedef enum {
     Probing_Off = 0,
-    Probing_Active
+    Probing_Active,     // Probe state polled by the stepper interrupt
+    Probing_ActiveLatch // Position latched by the driver on trigger via hal.probe.interrupt_callback
 } probing_state_t;
 
 typedef union {
@@ -32,9 +32,10 @@
 #include "motion_control.h"
 #include "sleep.h"
 #include "protocol.h"
+#include "alarm_snapshot.h"
 
 #ifndef RT_QUEUE_SIZE
-#define RT_QUEUE_SIZE 8 // must be a power of 2
+#define RT_QUEUE_SIZE 8
 #endif
 
 // Define line flags. Includes comment type tracking and line overflow detection.
@@ -46,7 +47,8 @@ typedef union {
                 comment_semicolon   :1,
                 line_is_comment     :1,
                 block_delete        :1,
-                unassigned          :3;
+                has_message         :1,
+                unassigned          :2;
     };
 } line_flags_t;
 
@@ -58,22 +60,140 @@ typedef struct {
 } user_message_t;
 
 typedef struct {
-    volatile uint_fast8_t head;
-    volatile uint_fast8_t tail;
-    on_execute_realtime_ptr fn[RT_QUEUE_SIZE];
-} realtime_queue_t;
-
-static uint_fast16_t char_counter = 0;
-static char line[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
-static char xcommand[LINE_BUFFER_SIZE];
-static bool keep_rt_commands = false;
-static user_message_t user_message = {NULL, 0, 0, false};
+    on_execute_realtime_ptr fn;
+    on_execute_realtime_data_ptr fn_data;
+    void *data;
+} realtime_command_t;
+
+#if LINE_QUEUE_SIZE
+
+#if LINE_QUEUE_SIZE < 2 * (2 * LINE_BUFFER_SIZE + 1)
+#error "LINE_QUEUE_SIZE must be at least room for two lines with messages"
+#endif
+
+#define LINE_QUEUE_ENTRY_MAX (2 * LINE_BUFFER_SIZE + 1) // Flags, line and message
+#define LINE_QUEUE_WRAP 0xFF                            // Flags value for entry wrapping to start of buffer
+
+// Queue of preprocessed lines read while the planner buffer is full. Entries are stored contiguously
+// as a flags byte followed by the zero terminated line and the zero terminated message, if present.
+typedef struct {
+    uint_fast16_t head;
+    uint_fast16_t tail;
+    char data[LINE_QUEUE_SIZE];
+} line_queue_t;
+
+static THREAD_LOCAL line_queue_t line_queue = {0};
+static THREAD_LOCAL char pline[LINE_BUFFER_SIZE];    // Line being received, may be queued while another line is executed.
+static THREAD_LOCAL char qmessage[LINE_BUFFER_SIZE]; // Message of queued line being executed.
+#else
+#define pline line
+#endif
+
+// Block of input stream data, used when the stream provides hal.stream.read_block.
+typedef struct {
+    uint_fast16_t idx;
+    uint_fast16_t len;
+    char data[LINE_BUFFER_SIZE];
+} stream_block_t;
+
+// Input character classification, RtChar_Plain characters are passed on to the input buffer without side effects.
+typedef enum {
+    RtChar_Plain = 0,   // Printable ASCII characters except legacy realtime commands, CR and LF
+    RtChar_Realtime,    // Control characters, legacy realtime commands and characters in the range 0x7F - 0xBF
+    RtChar_Override,    // Feed, rapid, spindle and coolant override commands
+    RtChar_Extended     // Top bit set characters from 0xC0, dropped unless kept in settings or comments
+} rt_char_class_t;
+
+static THREAD_LOCAL stream_block_t rx_block = {0};
+static THREAD_LOCAL uint_fast16_t char_counter = 0;
+static THREAD_LOCAL char line[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
+static THREAD_LOCAL char xcommand[LINE_BUFFER_SIZE];
+static THREAD_LOCAL char eol = '\0';
+static THREAD_LOCAL line_flags_t line_flags = {0};
+static THREAD_LOCAL bool nocaps = false;
+static THREAD_LOCAL bool keep_rt_commands = false;
+static THREAD_LOCAL bool esc = false; // Last character received was ASCII_ESC, see CMD_REBOOT
+#ifdef REPORT_TIMESTAMP
+static THREAD_LOCAL volatile uint32_t timestamp_request; // Time the last CMD_TIMESTAMP was received
+#endif
+static ISR_DATA uint8_t rt_char_class[256]; // rt_char_class_t, built by protocol_init()
+static THREAD_LOCAL user_message_t user_message = {NULL, 0, 0, false};
 static const char *msg = "(MSG,";
-static realtime_queue_t realtime_queue = {0};
+static THREAD_LOCAL volatile uint_fast16_t rt_link[RT_QUEUE_SIZE + 2] = {0}, rt_claimed[RT_QUEUE_SIZE + 2] = {0};
+static THREAD_LOCAL realtime_command_t rt_commands[RT_QUEUE_SIZE];
+static THREAD_LOCAL mpsc_queue_t realtime_queue; // Initialized by protocol_init(), may be thread local data
+static THREAD_LOCAL volatile uint_fast16_t idle_lock = 0;
+static THREAD_LOCAL rt_task_t *rt_tasks = NULL, *rt_task_next = NULL;
+
+#ifdef ENABLE_FRAMED_STREAMING
+
+#ifndef FRAMED_ACK_INTERVAL
+#define FRAMED_ACK_INTERVAL 8 // Maximum number of lines executed before a cumulative acknowledge is sent.
+#endif
+
+// Tracks framed lines, see ENABLE_FRAMED_STREAMING in config.h.
+typedef struct {
+    uint_fast16_t prefix_len;   // Length of the @<sequence>: prefix of the line being received, 0 if none or incomplete
+    bool in_prefix;             // Receiving the prefix
+    uint32_t ack_seq;           // Sequence number of the last framed line executed
+    uint_fast16_t ack_pending;  // Number of framed lines executed since the last acknowledge
+} framed_stream_t;
+
+static THREAD_LOCAL framed_stream_t framed = {0};
+
+#define LINE_START (char_counter == framed.prefix_len)
+
+#else
+#define LINE_START (char_counter == 0)
+#endif
+
+#ifdef ENABLE_FAST_CHECK_MODE
+
+#ifndef CHECK_MODE_OK_BATCH
+#define CHECK_MODE_OK_BATCH 16 // Maximum number of "ok" responses batched in fast check mode.
+#endif
+
+#define CHECK_MODE_OK_LEN (sizeof("ok" ASCII_EOL) - 1)
+
+static THREAD_LOCAL uint_fast16_t check_ok_pending = 0;
+
+// Sends the "ok" responses batched in fast check mode, if any, with a single write.
+static void check_ok_flush (void)
+{
+    static char ok_batch[CHECK_MODE_OK_BATCH * CHECK_MODE_OK_LEN + 1] = "";
+
+    if(check_ok_pending) {
+        if(*ok_batch == '\0') {
+            uint_fast16_t idx = CHECK_MODE_OK_BATCH;
+            do {
+                memcpy(&ok_batch[--idx * CHECK_MODE_OK_LEN], "ok" ASCII_EOL, CHECK_MODE_OK_LEN);
+            } while(idx);
+        }
+        hal.stream.write(&ok_batch[(CHECK_MODE_OK_BATCH - check_ok_pending) * CHECK_MODE_OK_LEN]);
+        check_ok_pending = 0;
+    }
+}
+
+#endif
 
 static void protocol_exec_rt_suspend ();
 static void protocol_execute_rt_commands (void);
 
+// Handlers for the EXEC_REPORTS requests, indexed by bit number.
+static void (* const rt_request[])(void) = {
+    [0]  = report_realtime_status,          // EXEC_STATUS_REPORT
+    [10] = report_pid_log,                  // EXEC_PID_REPORT
+    [11] = report_gcode_modes,              // EXEC_GCODE_REPORT
+    [12] = report_tool_offsets,             // EXEC_TLO_REPORT
+    [13] = protocol_execute_rt_commands,    // EXEC_RT_COMMAND
+#ifdef ENABLE_BINARY_STATUS_REPORT
+    [14] = report_realtime_status_binary    // EXEC_BINARY_REPORT
+#else
+    [14] = NULL
+#endif
+};
+static bool protocol_is_idle (void);
+
 // add gcode to execute not originating from normal input stream
 bool protocol_enqueue_gcode (char *gcode)
 {
@@ -90,6 +210,380 @@ bool protocol_enqueue_gcode (char *gcode)
     return ok;
 }
 
+// Returns the next character from the input stream, reads a block at a time if supported by the stream.
+static inline int16_t stream_get_c (void)
+{
+    if(rx_block.idx < rx_block.len)
+        return (int16_t)rx_block.data[rx_block.idx++];
+
+    rx_block.idx = 0;
+
+    if(hal.stream.read_block && (rx_block.len = hal.stream.read_block(rx_block.data, sizeof(rx_block.data))))
+        return (int16_t)rx_block.data[rx_block.idx++];
+
+    rx_block.len = 0;
+
+    return hal.stream.read();
+}
+
+// Reset tracking data for next line.
+static void protocol_line_reset (void)
+{
+    keep_rt_commands = nocaps = user_message.show = false;
+    char_counter = line_flags.value = 0;
+#ifdef ENABLE_FRAMED_STREAMING
+    framed.prefix_len = 0;
+    framed.in_prefix = false;
+#endif
+}
+
+#ifdef ENABLE_FRAMED_STREAMING
+
+// Sends a cumulative acknowledge of the framed lines executed if any are pending.
+static void framed_ack (void)
+{
+    if(framed.ack_pending) {
+        framed.ack_pending = 0;
+        hal.stream.write("[ACK:");
+        hal.stream.write(uitoa(framed.ack_seq));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(hal.stream.get_rx_buffer_available ? hal.stream.get_rx_buffer_available() : 0));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(plan_get_block_buffer_available()));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+// Strips the @<sequence>: prefix of a framed line, returns the line to be executed.
+// Sets seq to the sequence number and returns NULL if the line is not framed.
+static char *framed_line (char *line, uint32_t *seq)
+{
+    char *s = line;
+
+    if(*s++ != '@' || *s < '0' || *s > '9')
+        return NULL;
+
+    *seq = 0;
+    while(*s >= '0' && *s <= '9')
+        *seq = *seq * 10 + (uint32_t)(*s++ - '0');
+
+    return *s == ':' ? s + 1 : NULL;
+}
+
+#endif
+
+#if LINE_QUEUE_SIZE
+
+static inline bool line_queue_is_empty (void)
+{
+    return line_queue.tail == line_queue.head;
+}
+
+// Returns true if there is contiguous room for a line of maximum length with a message.
+static inline bool line_queue_has_room (void)
+{
+    if(line_queue.head >= line_queue.tail)
+        return LINE_QUEUE_SIZE - line_queue.head > LINE_QUEUE_ENTRY_MAX || line_queue.tail > LINE_QUEUE_ENTRY_MAX;
+
+    return line_queue.tail - line_queue.head > LINE_QUEUE_ENTRY_MAX;
+}
+
+// Adds the received line and message, if any, to the queue. Assumes there is room.
+static void line_queue_put (void)
+{
+    uint_fast16_t len = char_counter + 1;
+    line_flags_t flags = line_flags;
+
+    flags.has_message = user_message.show;
+
+    if(line_queue.head >= line_queue.tail && LINE_QUEUE_SIZE - line_queue.head <= LINE_QUEUE_ENTRY_MAX) {
+        line_queue.data[line_queue.head] = LINE_QUEUE_WRAP;
+        line_queue.head = 0;
+    }
+
+    line_queue.data[line_queue.head++] = (char)flags.value;
+    memcpy(&line_queue.data[line_queue.head], pline, len);
+    line_queue.head += len;
+
+    if(flags.has_message) {
+        len = strlen(user_message.message) + 1;
+        memcpy(&line_queue.data[line_queue.head], user_message.message, len);
+        line_queue.head += len;
+    }
+}
+
+// Removes the first line from the queue, copies it to the line buffer and the message, if any, to the queued message buffer.
+static line_flags_t line_queue_get (void)
+{
+    line_flags_t flags;
+    uint_fast16_t len;
+
+    if((uint8_t)line_queue.data[line_queue.tail] == LINE_QUEUE_WRAP)
+        line_queue.tail = 0;
+
+    flags.value = (uint8_t)line_queue.data[line_queue.tail++];
+    len = strlen(&line_queue.data[line_queue.tail]) + 1;
+    memcpy(line, &line_queue.data[line_queue.tail], len);
+    line_queue.tail += len;
+
+    if(flags.has_message) {
+        len = strlen(&line_queue.data[line_queue.tail]) + 1;
+        memcpy(qmessage, &line_queue.data[line_queue.tail], len);
+        line_queue.tail += len;
+    }
+
+    return flags;
+}
+
+#else
+#define line_queue_is_empty() true
+#endif
+
+// Processes one character of incoming stream data. Performs an initial filtering by removing spaces
+// and comments and capitalizing all letters. Returns true when a complete line has been received.
+static bool protocol_input_char (int16_t c)
+{
+    if(c == ASCII_CAN) {
+
+        eol = xcommand[0] = '\0';
+        protocol_line_reset();
+        gc_state.last_error = Status_OK;
+#if LINE_QUEUE_SIZE
+        line_queue.head = line_queue.tail; // Discard queued lines
+#endif
+
+        if (sys.state == STATE_JOG) // Block all other states from invoking motion cancel.
+            system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+
+    } else if ((c == '\n') || (c == '\r')) { // End of line reached
+
+        // Check for possible secondary end of line character, do not process as empty line
+        // if part of crlf (or lfcr pair) as this produces a possibly unwanted double response
+        if(char_counter == 0 && eol && eol != c) {
+            eol = '\0';
+            return false;
+        } else
+            eol = (char)c;
+
+        pline[char_counter] = '\0'; // Set string termination character.
+
+        return true;
+
+#ifdef ENABLE_FRAMED_STREAMING
+    } else if ((char_counter == 0 && c == '@') || (framed.in_prefix && c > ' ')) {
+        // Sequence number prefix of framed line, ends with ':'. Processing of the line starts after it.
+        framed.in_prefix = c != ':';
+        if(!(line_flags.overflow = char_counter >= (LINE_BUFFER_SIZE - 1)))
+            pline[char_counter++] = c;
+        if(!framed.in_prefix)
+            framed.prefix_len = char_counter;
+#endif
+    } else if (c <= (nocaps ? ' ' - 1 : ' ') || line_flags.value) {
+        // Throw away all whitepace, control characters, comment characters and overflow characters.
+        if(c >= ' ' && line_flags.comment_parentheses) {
+            if(user_message.tracker == 5)
+                user_message.message[user_message.idx++] = c == ')' ? '\0' : c;
+            else if(user_message.tracker > 0 && CAPS(c) == msg[user_message.tracker])
+                user_message.tracker++;
+            else
+                user_message.tracker = 0;
+            if (c == ')') {
+                // End of '()' comment. Resume line.
+                line_flags.comment_parentheses = Off;
+                keep_rt_commands = false;
+                user_message.show = user_message.show || user_message.tracker == 5;
+            }
+        }
+    } else {
+        switch(c) {
+
+            case '/':
+                if(LINE_START)
+                    line_flags.block_delete = sys.flags.block_delete_enabled;
+                break;
+
+            case '$':
+            case '[':
+                // Do not uppercase system or user commands - will destroy passwords etc...
+                if(LINE_START)
+                    nocaps = keep_rt_commands = true;
+                break;
+
+            case '(':
+                if(LINE_START)
+                    line_flags.line_is_comment = On;
+                if(!keep_rt_commands) {
+                    // Enable comments flag and ignore all characters until ')' or EOL unless it is a message.
+                    // NOTE: This doesn't follow the NIST definition exactly, but is good enough for now.
+                    // In the future, we could simply remove the items within the comments, but retain the
+                    // comment control characters, so that the g-code parser can error-check it.
+                    if((line_flags.comment_parentheses = !line_flags.comment_semicolon)) {
+                        if(!hal.driver_cap.no_gcode_message_handling) {
+                            if(user_message.message == NULL)
+                                user_message.message = malloc(LINE_BUFFER_SIZE);
+                            if(user_message.message) {
+                                user_message.idx = 0;
+                                user_message.tracker = 1;
+                            }
+                        }
+                        keep_rt_commands = true;
+                    }
+                }
+                break;
+
+            case ';':
+                if(LINE_START)
+                    line_flags.line_is_comment = On;
+                // NOTE: ';' comment to EOL is a LinuxCNC definition. Not NIST.
+                if(!keep_rt_commands) {
+                    if((line_flags.comment_semicolon = !line_flags.comment_parentheses))
+                        keep_rt_commands = true;
+                }
+                break;
+        }
+        if (line_flags.value == 0 && !(line_flags.overflow = char_counter >= (LINE_BUFFER_SIZE - 1)))
+            pline[char_counter++] = nocaps ? c : CAPS(c);
+    }
+
+    return false;
+}
+
+// Directs and executes the line in the line buffer, and reports status of execution.
+static void protocol_execute_line (line_flags_t flags, char *message)
+{
+    char *block = line;
+
+  #ifdef REPORT_ECHO_LINE_RECEIVED
+    report_echo_line_received(line);
+  #endif
+
+#ifdef ENABLE_FRAMED_STREAMING
+    uint32_t seq = 0;
+    char *framed_block = flags.overflow ? NULL : framed_line(line, &seq);
+
+    if(framed_block)
+        block = framed_block;
+#endif
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    // System and user commands are executed after all moves of a pending canned cycle are queued.
+    if ((block[0] == '$' || block[0] == '[') && !mc_canned_drill_pump(true))
+        return;
+#endif
+
+#ifdef ENABLE_FAST_CHECK_MODE
+    // Responses to g-code blocks validated in fast check mode are sent before system and user command output.
+    if (block[0] == '$' || block[0] == '[')
+        check_ok_flush();
+#endif
+
+    if (flags.overflow) // Report line overflow error.
+        gc_state.last_error = Status_Overflow;
+    else if (block[0] == '\0' && !flags.has_message && !flags.line_is_comment) // Empty or comment line. For syncing purposes.
+        gc_state.last_error = Status_OK;
+    else if (block[0] == '$') {// Grbl '$' system command
+        if((gc_state.last_error = system_execute_line(block)) == Status_LimitsEngaged) {
+            set_state(STATE_ALARM); // Ensure alarm state is active.
+            report_alarm_message(Alarm_LimitsEngaged);
+            grbl.report.feedback_message(Message_CheckLimits);
+        }
+    } else if (block[0] == '[' && grbl.on_user_command)
+        gc_state.last_error = grbl.on_user_command(block);
+    else if (sys.state & (STATE_ALARM|STATE_ESTOP|STATE_JOG)) // Everything else is gcode. Block if in alarm, eStop or jog mode.
+        gc_state.last_error = Status_SystemGClock;
+#if COMPATIBILITY_LEVEL == 0
+    else if(gc_state.last_error == Status_OK || gc_state.last_error == Status_GcodeToolChangePending) { // Parse and execute g-code block.
+#else
+    else { // Parse and execute g-code block.
+
+#endif
+        gc_state.last_error = gc_execute_block(block, message);
+    }
+
+    // Add a short delay for each block processed in Check Mode to
+    // avoid overwhelming the sender with fast reply messages.
+    // This is likely to happen when streaming is done via a protocol where
+    // the speed is not limited to 115200 baud. An example is native USB streaming.
+#if CHECK_MODE_DELAY
+  #ifdef ENABLE_FAST_CHECK_MODE
+    if(sys.state == STATE_CHECK_MODE && !sys.check_mode_fast)
+  #else
+    if(sys.state == STATE_CHECK_MODE)
+  #endif
+        hal.delay_ms(CHECK_MODE_DELAY, NULL);
+#endif
+
+#ifdef ENABLE_FRAMED_STREAMING
+    if(framed_block) {
+        if(gc_state.last_error != Status_OK) {
+            framed_ack(); // Acknowledge lines executed ok before reporting the error
+            hal.stream.write("[NAK:");
+            hal.stream.write(uitoa(seq));
+            hal.stream.write(",");
+            hal.stream.write(uitoa((uint32_t)gc_state.last_error));
+            hal.stream.write("]" ASCII_EOL);
+            framed.ack_seq = seq;
+        } else {
+            framed.ack_seq = seq;
+            if(++framed.ack_pending >= FRAMED_ACK_INTERVAL)
+                framed_ack();
+        }
+        return;
+    }
+#endif
+
+#ifdef ENABLE_FAST_CHECK_MODE
+    if(sys.check_mode_fast && gc_state.last_error == Status_OK && block[0] != '$' && block[0] != '[') {
+        if(++check_ok_pending == CHECK_MODE_OK_BATCH)
+            check_ok_flush();
+        return;
+    }
+
+    check_ok_flush();
+#endif
+
+    grbl.report.status_message(gc_state.last_error);
+}
+
+// Reads and preprocesses stream data into the line queue while there is room for more lines.
+// Called by motion control while waiting for room in the planner buffer so that the parser
+// can be fed with the next lines as soon as a block has been executed.
+// NOTE: Queued lines are not executed, the response is sent when they are.
+void protocol_stream_prefetch (void)
+{
+#if LINE_QUEUE_SIZE
+    int16_t c;
+
+    while(line_queue_has_room() && (c = stream_get_c()) != SERIAL_NO_DATA) {
+        if(protocol_input_char(c)) {
+            line_queue_put();
+            protocol_line_reset();
+        }
+    }
+#endif
+}
+
+void protocol_init (void)
+{
+    uint_fast16_t c;
+
+    mpsc_init(&realtime_queue, RT_QUEUE_SIZE, rt_link, rt_claimed);
+
+    for(c = 0; c < 256; c++) {
+        if(c < ' ' || c == 0x7F)
+            rt_char_class[c] = RtChar_Realtime;
+        else if(c >= CMD_OVERRIDE_FEED_RESET && c <= CMD_OVERRIDE_COOLANT_MIST_TOGGLE)
+            rt_char_class[c] = RtChar_Override;
+        else if(c > 0x7F)
+            rt_char_class[c] = c <= 0xBF ? RtChar_Realtime : RtChar_Extended;
+        else
+            rt_char_class[c] = RtChar_Plain;
+    }
+
+    rt_char_class['\n'] = rt_char_class['\r'] = RtChar_Plain;
+    rt_char_class[CMD_STATUS_REPORT_LEGACY] = rt_char_class[CMD_CYCLE_START_LEGACY] = rt_char_class[CMD_FEED_HOLD_LEGACY] = RtChar_Realtime;
+}
+
 /*
   GRBL PRIMARY LOOP:
 */
@@ -141,10 +635,10 @@ bool protocol_main_loop(bool cold_start)
     if(cold_start) {
         hal.spindle.set_state((spindle_state_t){0}, 0.0f);
         hal.coolant.set_state((coolant_state_t){0});
-        if(realtime_queue.head != realtime_queue.tail)
+        if(mpsc_pending(&realtime_queue))
             system_set_exec_state_flag(EXEC_RT_COMMAND);  // execute any boot up commands
     } else
-        memset(&realtime_queue, 0, sizeof(realtime_queue_t));
+        mpsc_reset(&realtime_queue);
 
     // ---------------------------------------------------------------------------------
     // Primary loop! Upon a system abort, this exits back to main() to reset the system.
@@ -152,155 +646,73 @@ bool protocol_main_loop(bool cold_start)
     // ---------------------------------------------------------------------------------
 
     int16_t c;
-    char eol = '\0';
-    line_flags_t line_flags = {0};
-    bool nocaps = false;
 
     xcommand[0] = '\0';
     user_message.show = keep_rt_commands = false;
+    protocol_line_reset();
+    rx_block.idx = rx_block.len = 0;
+#ifdef ENABLE_FRAMED_STREAMING
+    framed.ack_pending = 0;
+#endif
+#ifdef ENABLE_FAST_CHECK_MODE
+    check_ok_pending = 0;
+#endif
+#if LINE_QUEUE_SIZE
+    line_queue.head = line_queue.tail = 0;
+#endif
 
     while(true) {
 
-        // Process one line of incoming stream data, as the data becomes available. Performs an
-        // initial filtering by removing spaces and comments and capitalizing all letters.
-        while((c = hal.stream.read()) != SERIAL_NO_DATA) {
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+        // Feed pending canned cycle moves to the planner as buffer slots become available.
+        mc_canned_drill_pump(false);
+#endif
+
+#if LINE_QUEUE_SIZE
+        // Execute lines queued while the planner buffer was full before reading more stream data.
+        if(!line_queue_is_empty()) {
 
-            if(c == ASCII_CAN) {
+            if(!protocol_execute_realtime()) // Runtime command check point.
+                return !sys.flags.exit;      // Bail to calling function upon system abort
 
-                eol = xcommand[0] = '\0';
-                keep_rt_commands = nocaps = user_message.show = false;
-                char_counter = line_flags.value = 0;
-                gc_state.last_error = Status_OK;
+            line_flags_t flags = line_queue_get();
 
-                if (sys.state == STATE_JOG) // Block all other states from invoking motion cancel.
-                    system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+            protocol_execute_line(flags, flags.has_message ? qmessage : NULL);
+        }
+#endif
 
-            } else if ((c == '\n') || (c == '\r')) { // End of line reached
+        // Process one line of incoming stream data, as the data becomes available.
+        while(line_queue_is_empty() && (c = stream_get_c()) != SERIAL_NO_DATA) {
 
-                // Check for possible secondary end of line character, do not process as empty line
-                // if part of crlf (or lfcr pair) as this produces a possibly unwanted double response
-                if(char_counter == 0 && eol && eol != c) {
-                    eol = '\0';
-                    continue;
-                } else
-                    eol = (char)c;
+            if(protocol_input_char(c)) { // End of line reached
 
                 if(!protocol_execute_realtime()) // Runtime command check point.
                     return !sys.flags.exit;      // Bail to calling function upon system abort
 
-                line[char_counter] = '\0'; // Set string termination character.
-
-              #ifdef REPORT_ECHO_LINE_RECEIVED
-                report_echo_line_received(line);
-              #endif
-
-                // Direct and execute one line of formatted input, and report status of execution.
-                if (line_flags.overflow) // Report line overflow error.
-                    gc_state.last_error = Status_Overflow;
-                else if ((line[0] == '\0' || char_counter == 0) && !user_message.show && !line_flags.line_is_comment) // Empty or comment line. For syncing purposes.
-                    gc_state.last_error = Status_OK;
-                else if (line[0] == '$') {// Grbl '$' system command
-                    if((gc_state.last_error = system_execute_line(line)) == Status_LimitsEngaged) {
-                        set_state(STATE_ALARM); // Ensure alarm state is active.
-                        report_alarm_message(Alarm_LimitsEngaged);
-                        grbl.report.feedback_message(Message_CheckLimits);
-                    }
-                } else if (line[0] == '[' && grbl.on_user_command)
-                    gc_state.last_error = grbl.on_user_command(line);
-                else if (sys.state & (STATE_ALARM|STATE_ESTOP|STATE_JOG)) // Everything else is gcode. Block if in alarm, eStop or jog mode.
-                    gc_state.last_error = Status_SystemGClock;
-#if COMPATIBILITY_LEVEL == 0
-                else if(gc_state.last_error == Status_OK || gc_state.last_error == Status_GcodeToolChangePending) { // Parse and execute g-code block.
-#else
-                else { // Parse and execute g-code block.
-
+                line_flags_t flags = line_flags;
+                flags.has_message = user_message.show;
+#if LINE_QUEUE_SIZE
+                memcpy(line, pline, char_counter + 1);
 #endif
-                    gc_state.last_error = gc_execute_block(line, user_message.show ? user_message.message : NULL);
-                }
-
-                // Add a short delay for each block processed in Check Mode to
-                // avoid overwhelming the sender with fast reply messages.
-                // This is likely to happen when streaming is done via a protocol where
-                // the speed is not limited to 115200 baud. An example is native USB streaming.
-#if CHECK_MODE_DELAY
-                if(sys.state == STATE_CHECK_MODE)
-                    hal.delay_ms(CHECK_MODE_DELAY, NULL);
-#endif
-
-                grbl.report.status_message(gc_state.last_error);
-
-                // Reset tracking data for next line.
-                keep_rt_commands = nocaps = user_message.show = false;
-                char_counter = line_flags.value = 0;
-
-            } else if (c <= (nocaps ? ' ' - 1 : ' ') || line_flags.value) {
-                // Throw away all whitepace, control characters, comment characters and overflow characters.
-                if(c >= ' ' && line_flags.comment_parentheses) {
-                    if(user_message.tracker == 5)
-                        user_message.message[user_message.idx++] = c == ')' ? '\0' : c;
-                    else if(user_message.tracker > 0 && CAPS(c) == msg[user_message.tracker])
-                        user_message.tracker++;
-                    else
-                        user_message.tracker = 0;
-                    if (c == ')') {
-                        // End of '()' comment. Resume line.
-                        line_flags.comment_parentheses = Off;
-                        keep_rt_commands = false;
-                        user_message.show = user_message.show || user_message.tracker == 5;
-                    }
-                }
-            } else {
-                switch(c) {
-
-                    case '/':
-                        if(char_counter == 0)
-                            line_flags.block_delete = sys.flags.block_delete_enabled;
-                        break;
+                // Reset tracking data for next line, lines may be read and queued while this one is executed.
+                protocol_line_reset();
 
-                    case '$':
-                    case '[':
-                        // Do not uppercase system or user commands - will destroy passwords etc...
-                        if(char_counter == 0)
-                            nocaps = keep_rt_commands = true;
-                        break;
-
-                    case '(':
-                        if(char_counter == 0)
-                            line_flags.line_is_comment = On;
-                        if(!keep_rt_commands) {
-                            // Enable comments flag and ignore all characters until ')' or EOL unless it is a message.
-                            // NOTE: This doesn't follow the NIST definition exactly, but is good enough for now.
-                            // In the future, we could simply remove the items within the comments, but retain the
-                            // comment control characters, so that the g-code parser can error-check it.
-                            if((line_flags.comment_parentheses = !line_flags.comment_semicolon)) {
-                                if(!hal.driver_cap.no_gcode_message_handling) {
-                                    if(user_message.message == NULL)
-                                        user_message.message = malloc(LINE_BUFFER_SIZE);
-                                    if(user_message.message) {
-                                        user_message.idx = 0;
-                                        user_message.tracker = 1;
-                                    }
-                                }
-                                keep_rt_commands = true;
-                            }
-                        }
-                        break;
-
-                    case ';':
-                        if(char_counter == 0)
-                            line_flags.line_is_comment = On;
-                        // NOTE: ';' comment to EOL is a LinuxCNC definition. Not NIST.
-                        if(!keep_rt_commands) {
-                            if((line_flags.comment_semicolon = !line_flags.comment_parentheses))
-                                keep_rt_commands = true;
-                        }
-                        break;
-                }
-                if (line_flags.value == 0 && !(line_flags.overflow = char_counter >= (LINE_BUFFER_SIZE - 1)))
-                    line[char_counter++] = nocaps ? c : CAPS(c);
+                protocol_execute_line(flags, flags.has_message ? user_message.message : NULL);
             }
         }
 
+#ifdef ENABLE_FRAMED_STREAMING
+        // No more input available, acknowledge framed lines executed.
+        if(line_queue_is_empty())
+            framed_ack();
+#endif
+
+#ifdef ENABLE_FAST_CHECK_MODE
+        // No more input available, send the batched responses.
+        if(line_queue_is_empty())
+            check_ok_flush();
+#endif
+
         // Handle extra command (internal stream)
         if(xcommand[0] != '\0') {
 
@@ -327,15 +739,46 @@ bool protocol_main_loop(bool cold_start)
         // Check for sleep conditions and execute auto-park, if timeout duration elapses.
         if(settings.flags.sleep_enable)
             sleep_check();
+
+        // Wait for an interrupt if there is nothing to do. Incoming characters, realtime commands and
+        // control signals are all interrupt driven, the systick bounds latency for anything polled.
+        if(hal.idle_wait && protocol_is_idle())
+            hal.idle_wait();
     }
 }
 
+// Returns true when the main loop has no pending work and no motion is in progress.
+static bool protocol_is_idle (void)
+{
+    return idle_lock == 0 &&
+            sys_rt_exec_state == 0 &&
+             !mpsc_pending(&realtime_queue) &&
+              !(sys.state & ~(STATE_ALARM|STATE_ESTOP|STATE_SLEEP)) &&
+               plan_get_current_block() == NULL &&
+                line_queue_is_empty() &&
+                 xcommand[0] == '\0';
+}
+
+void protocol_idle_lock (bool lock)
+{
+    if(lock)
+        idle_lock++;
+    else if(idle_lock)
+        idle_lock--;
+}
+
 
 // Block until all buffered steps are executed or in a cycle state. Works with feed hold
 // during a synchronize call, if it should happen. Also, waits for clean cycle end.
 bool protocol_buffer_synchronize ()
 {
     bool ok = true;
+
+#ifdef ENABLE_CANNED_CYCLE_GENERATOR
+    if(!mc_canned_drill_pump(true))
+        return false;
+#endif
+
     // If system is queued, ensure cycle resumes if the auto start flag is present.
     protocol_auto_cycle_start();
     while ((ok = protocol_execute_realtime()) && (plan_get_current_block() || sys.state == STATE_CYCLE));
@@ -377,8 +820,13 @@ bool protocol_execute_realtime ()
             protocol_exec_rt_suspend();
 
       #ifdef BUFFER_NVSDATA
+       #ifdef ENABLE_NVS_DEFERRED_SYNC
+        if((sys.state == STATE_IDLE || sys.state == STATE_ALARM || sys.state == STATE_ESTOP) && settings_dirty.is_dirty)
+            nvs_buffer_sync_deferred(gc_state.file_run);
+       #else
         if((sys.state == STATE_IDLE || sys.state == STATE_ALARM || sys.state == STATE_ESTOP) && settings_dirty.is_dirty && !gc_state.file_run)
             nvs_buffer_sync_physical();
+       #endif
       #endif
     }
 
@@ -392,11 +840,17 @@ bool protocol_exec_rt_system ()
 {
     uint_fast16_t rt_exec;
 
+    if(settings.auto_report_interval && hal.get_elapsed_ticks)
+        report_auto_status();
+
     if (sys_rt_exec_alarm && (rt_exec = system_clear_exec_alarm())) { // Enter only if any bit flag is true
 
         // System alarm. Everything has shutdown by something that has gone severely wrong. Report
         // the source of the error to the user. If critical, Grbl disables by entering an infinite
         // loop until system reset/abort.
+#ifdef ENABLE_ALARM_SNAPSHOT
+        alarm_snapshot_capture((alarm_code_t)rt_exec); // Save the motion state for diagnosis before it is lost on reset.
+#endif
         set_state((alarm_code_t)rt_exec == Alarm_EStop ? STATE_ESTOP : STATE_ALARM); // Set system alarm state
         report_alarm_message((alarm_code_t)rt_exec);
 
@@ -423,6 +877,12 @@ bool protocol_exec_rt_system ()
                     system_clear_exec_state_flag(EXEC_STATUS_REPORT);
                     report_realtime_status();
                 }
+#ifdef ENABLE_BINARY_STATUS_REPORT
+                if(bit_istrue(sys_rt_exec_state, EXEC_BINARY_REPORT)) {
+                    system_clear_exec_state_flag(EXEC_BINARY_REPORT);
+                    report_realtime_status_binary();
+                }
+#endif
 
                 grbl.on_execute_realtime(STATE_ESTOP);
             }
@@ -483,24 +943,17 @@ bool protocol_exec_rt_system ()
             set_state(STATE_IDLE);
         }
 
-        // Execute and print status to output stream
-        if (rt_exec & EXEC_STATUS_REPORT)
-            report_realtime_status();
+        // Execute reports and realtime commands, lowest bit number first.
+        uint_fast16_t requests = rt_exec & EXEC_REPORTS;
 
-        if(rt_exec & EXEC_GCODE_REPORT)
-            report_gcode_modes();
-
-        if(rt_exec & EXEC_TLO_REPORT)
-            report_tool_offsets();
-
-        // Execute and print PID log to output stream
-        if (rt_exec & EXEC_PID_REPORT)
-            report_pid_log();
-
-        if(rt_exec & EXEC_RT_COMMAND)
-            protocol_execute_rt_commands();
+        while(requests) {
+            uint_fast8_t idx = bit_scan(requests);
+            requests &= requests - 1;
+            if(rt_request[idx])
+                rt_request[idx]();
+        }
 
-        rt_exec &= ~(EXEC_STOP|EXEC_STATUS_REPORT|EXEC_GCODE_REPORT|EXEC_PID_REPORT|EXEC_TLO_REPORT|EXEC_RT_COMMAND); // clear requests already processed
+        rt_exec &= ~(EXEC_STOP|EXEC_REPORTS); // clear requests already processed
 
         if(sys.flags.feed_hold_pending) {
             if(rt_exec & EXEC_CYCLE_START)
@@ -640,6 +1093,9 @@ bool protocol_exec_rt_system ()
         }
     } // End execute overrides.
 
+    // Replan after override increases
+    plan_override_replan();
+
     // Reload step segment buffer
     if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP| STATE_JOG))
         st_prep_buffer();
@@ -680,10 +1136,17 @@ static void protocol_exec_rt_suspend ()
 // These characters are not passed into the main buffer,
 // but rather sets system state flag bits for later execution by protocol_exec_rt_system().
 // Called from input stream interrupt handler.
-ISR_CODE bool protocol_enqueue_realtime_command (char c)
+#ifdef REPORT_TIMESTAMP
+
+static void report_timestamp_request (uint_fast16_t state)
 {
-    static bool esc = false;
+    report_timestamp(timestamp_request);
+}
 
+#endif
+
+ISR_CODE bool protocol_enqueue_realtime_command (char c)
+{
     bool drop = false;
 
     // 1. Process characters in the ranges 0x - 1x and 8x-Ax
@@ -731,6 +1194,22 @@ ISR_CODE bool protocol_enqueue_realtime_command (char c)
             drop = true;
             break;
 
+#ifdef ENABLE_BINARY_STATUS_REPORT
+        case CMD_STATUS_REPORT_BINARY:
+            system_set_exec_state_flag(EXEC_BINARY_REPORT);
+            drop = true;
+            break;
+#endif
+
+#ifdef REPORT_TIMESTAMP
+        case CMD_TIMESTAMP:
+            // Captured on reception, the report is output by the foreground process.
+            timestamp_request = report_get_timestamp();
+            protocol_enqueue_rt_command(report_timestamp_request);
+            drop = true;
+            break;
+#endif
+
         case CMD_CYCLE_START:
             system_set_exec_state_flag(EXEC_CYCLE_START);
             // Cancel any pending tool change
@@ -854,33 +1333,179 @@ ISR_CODE bool protocol_enqueue_realtime_command (char c)
     return drop;
 }
 
-// Enqueue a function to be called once by the
-// foreground process, typically enqueued from an interrupt handler.
-ISR_CODE bool protocol_enqueue_rt_command (on_execute_realtime_ptr fn)
+// Returns the number of leading characters in data that protocol_enqueue_realtime_command() would pass on
+// to the input buffer without acting upon them, these may be copied to the input buffer as a block.
+// Returns 0 if the realtime command handler is replaced (by a plugin) or a CMD_REBOOT sequence is pending.
+// Called from input stream interrupt handlers.
+ISR_CODE uint_fast16_t protocol_plain_run (const uint8_t *data, uint_fast16_t length)
 {
-    bool ok;
-    uint_fast8_t bptr = (realtime_queue.head + 1) & (RT_QUEUE_SIZE - 1);    // Get next head pointer
+    const uint8_t *end = data, *last = data + length;
 
-    if((ok = bptr != realtime_queue.tail)) {          // If not buffer full
-        realtime_queue.fn[realtime_queue.head] = fn;  // add function pointer to buffer,
-        realtime_queue.head = bptr;                   // update pointer and
+    if(!esc && hal.stream.enqueue_realtime_command == protocol_enqueue_realtime_command) {
+        while(end < last && rt_char_class[*end] == RtChar_Plain)
+            end++;
+    }
+
+    return (uint_fast16_t)(end - data);
+}
+
+ISR_CODE static bool enqueue_rt_command (on_execute_realtime_ptr fn, on_execute_realtime_data_ptr fn_data, void *data)
+{
+    int_fast16_t entry;
+
+    if((entry = mpsc_reserve(&realtime_queue)) >= 0) {
+        rt_commands[entry].fn = fn;
+        rt_commands[entry].fn_data = fn_data;
+        rt_commands[entry].data = data;
+        mpsc_publish(&realtime_queue, (uint_fast16_t)entry);
         system_set_exec_state_flag(EXEC_RT_COMMAND);  // flag it for execute
     }
 
-    return ok;
+    return entry >= 0;
+}
+
+// Enqueue a function to be called once by the
+// foreground process, typically enqueued from an interrupt handler.
+// NOTE: may be called from any interrupt priority.
+ISR_CODE bool protocol_enqueue_rt_command (on_execute_realtime_ptr fn)
+{
+    return enqueue_rt_command(fn, NULL, NULL);
+}
+
+// Enqueue a function to be called once by the foreground process with the data pointer passed on,
+// a pointer sized value may be passed by casting.
+ISR_CODE bool protocol_enqueue_rt_command_data (on_execute_realtime_data_ptr fn, void *data)
+{
+    return enqueue_rt_command(NULL, fn, data);
 }
 
 // Execute enqueued functions.
 static void protocol_execute_rt_commands (void)
 {
-    while(realtime_queue.tail != realtime_queue.head) {
-        uint_fast8_t bptr = realtime_queue.tail;
-        on_execute_realtime_ptr call;
-        if((call = realtime_queue.fn[bptr])) {
-            realtime_queue.fn[bptr] = NULL;
-            call(sys.state);
-        }
-        realtime_queue.tail = (bptr + 1) & (RT_QUEUE_SIZE - 1);
+    int_fast16_t entry;
+
+    while((entry = mpsc_next(&realtime_queue)) >= 0) {
+
+        realtime_command_t cmd = rt_commands[entry];
+
+        mpsc_release(&realtime_queue, (uint_fast16_t)entry);
+
+        if(cmd.fn_data)
+            cmd.fn_data(sys.state, cmd.data);
+        else if(cmd.fn)
+            cmd.fn(sys.state);
+    }
+}
+
+// Adds a task to the realtime task scheduler, returns false if already added.
+bool protocol_add_rt_task (rt_task_t *task)
+{
+    rt_task_t *last = rt_tasks;
+
+    while(last) {
+        if(last == task)
+            return false;
+        if(last->next == NULL)
+            break;
+        last = last->next;
+    }
+
+    task->next = NULL;
+    task->last_ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    memset(&task->stats, 0, sizeof(rt_task_stats_t));
+
+    if(last)
+        last->next = task;
+    else
+        rt_tasks = task;
+
+    return true;
+}
+
+// Removes a task from the realtime task scheduler, may be called from the task handler.
+bool protocol_remove_rt_task (rt_task_t *task)
+{
+    rt_task_t *prev = NULL, *t = rt_tasks;
+
+    while(t && t != task) {
+        prev = t;
+        t = t->next;
+    }
+
+    if(t) {
+        if(prev)
+            prev->next = task->next;
+        else
+            rt_tasks = task->next;
+        if(rt_task_next == task)
+            rt_task_next = task->next;
+        task->next = NULL;
+    }
+
+    return t != NULL;
+}
+
+rt_task_t *protocol_get_rt_tasks (void)
+{
+    return rt_tasks;
+}
+
+void protocol_reset_rt_task_stats (void)
+{
+    rt_task_t *task = rt_tasks;
+
+    while(task) {
+        memset(&task->stats, 0, sizeof(rt_task_stats_t));
+        task = task->next;
+    }
+}
+
+static void run_rt_task (rt_task_t *task, uint_fast16_t state)
+{
+    uint32_t cycles = hal.get_cycle_count ? hal.get_cycle_count() : 0;
+
+    task->fn(state);
+    task->stats.calls++;
+
+    if(hal.get_cycle_count) {
+        cycles = hal.get_cycle_count() - cycles;
+        if(cycles > task->stats.cycles_max)
+            task->stats.cycles_max = cycles;
+        task->stats.cycles_avg = task->stats.calls == 1 ? cycles : task->stats.cycles_avg + (int32_t)(cycles - task->stats.cycles_avg) / 16;
+        if(task->budget && cycles > task->budget)
+            task->stats.overruns++;
+    }
+}
+
+// Realtime task scheduler, the default (last) handler in the grbl.on_execute_realtime chain.
+// Tasks with period 0 are called on every pass. Of the periodic tasks that are due only one,
+// picked round robin, is called per pass so that they do not add up and delay segment prep.
+// NOTE: periods are ignored if the driver does not provide hal.get_elapsed_ticks.
+void protocol_execute_rt_tasks (uint_fast16_t state)
+{
+    rt_task_t *task = rt_tasks, *next;
+
+    while(task) {
+        next = task->next;
+        if(task->period == 0 || hal.get_elapsed_ticks == NULL)
+            run_rt_task(task, state);
+        task = next;
+    }
+
+    if(rt_tasks && hal.get_elapsed_ticks) {
+
+        uint32_t ms = hal.get_elapsed_ticks();
+        rt_task_t *first = task = rt_task_next ? rt_task_next : rt_tasks;
+
+        do {
+            next = task->next ? task->next : rt_tasks;
+            if(task->period && ms - task->last_ms >= task->period) {
+                task->last_ms = ms;
+                rt_task_next = next;
+                run_rt_task(task, state);
+                break;
+            }
+        } while((task = next) != first);
     }
 }
 
@@ -33,6 +33,35 @@
   #define LINE_BUFFER_SIZE 257 // 256 characters plus terminator
 #endif
 
+// Size of the queue for lines read while the planner buffer is full, see config.h. 0 to disable.
+#ifndef LINE_QUEUE_SIZE
+  #define LINE_QUEUE_SIZE 0
+#endif
+
+// Realtime task statistics, cycle counts are only available if the driver provides hal.get_cycle_count.
+typedef struct {
+    uint32_t calls;         // Number of times the handler has been called
+    uint32_t overruns;      // Number of calls that exceeded the budget
+    uint32_t cycles_avg;    // Moving average of handler execution time in CPU cycles
+    uint32_t cycles_max;    // Maximum handler execution time in CPU cycles
+} rt_task_stats_t;
+
+// Realtime task, a handler called from the realtime execution system at a given period.
+// The structure is owned by the caller and must be static, it is linked into the task list on registration.
+// NOTE: All tasks with period 0 are called on every pass, at most one periodic task that is due is called per pass.
+typedef struct rt_task {
+    const char *name;               // Name used in the $SS report
+    on_execute_realtime_ptr fn;     // Handler, called with the current state
+    uint16_t period;                // Minimum time between calls in milliseconds, 0 to call on every pass
+    uint32_t budget;                // Expected maximum execution time in CPU cycles, calls exceeding it are counted as overruns. 0 for none.
+    uint32_t last_ms;               // Time of last call, set by the scheduler
+    rt_task_stats_t stats;          // Timing statistics, set by the scheduler
+    struct rt_task *next;           // Set by the scheduler
+} rt_task_t;
+
+// Initializes the realtime command queue, to be called before the driver is initialized.
+void protocol_init (void);
+
 // Starts Grbl main loop. It handles all incoming characters from the input stream and executes
 // them as they complete. It is also responsible for finishing the initialization procedures.
 bool protocol_main_loop(bool cold_start);
@@ -42,6 +71,14 @@ bool protocol_execute_realtime();
 bool protocol_exec_rt_system();
 void protocol_execute_noop (uint_fast16_t state);
 bool protocol_enqueue_rt_command (on_execute_realtime_ptr fn);
+bool protocol_enqueue_rt_command_data (on_execute_realtime_data_ptr fn, void *data);
+
+// Realtime task scheduler, runs at the end of the grbl.on_execute_realtime chain.
+bool protocol_add_rt_task (rt_task_t *task);
+bool protocol_remove_rt_task (rt_task_t *task);
+rt_task_t *protocol_get_rt_tasks (void);
+void protocol_reset_rt_task_stats (void);
+void protocol_execute_rt_tasks (uint_fast16_t state);
 
 // Executes the auto cycle feature, if enabled.
 void protocol_auto_cycle_start();
@@ -49,7 +86,14 @@ void protocol_auto_cycle_start();
 // Block until all buffered steps are executed
 bool protocol_buffer_synchronize();
 
+// Reads and queues input lines while waiting for room in the planner buffer.
+void protocol_stream_prefetch (void);
+
+// Keeps the main loop from waiting for interrupts via hal.idle_wait while locked, for code that has to be polled continuously. Calls may be nested.
+void protocol_idle_lock (bool lock);
+
 bool protocol_enqueue_realtime_command (char c);
+uint_fast16_t protocol_plain_run (const uint8_t *data, uint_fast16_t length);
 bool protocol_enqueue_gcode (char *data);
 void protocol_message (char *message);
 
@@ -28,12 +28,21 @@
   methods to accomodate their needs.
 */
 
+#include <math.h>
 #include <stdarg.h>
 #include <string.h>
 
 #include "hal.h"
 #include "report.h"
 #include "nvs_buffer.h"
+#include "protocol.h"
+#include "pool.h"
+#ifdef KINEMATICS_API
+#include "kinematics.h"
+#endif
+#if LIMITS_FILTER_SAMPLES
+#include "limits.h"
+#endif
 
 #ifdef ENABLE_SPINDLE_LINEARIZATION
 #include <stdio.h>
@@ -51,6 +60,12 @@
 #ifndef REPORT_WCO_REFRESH_IDLE_COUNT
 #define REPORT_WCO_REFRESH_IDLE_COUNT 10        // (2-255) Must be less than or equal to the busy count
 #endif
+#ifndef REPORT_STATUS_BUFFER_SIZE
+#define REPORT_STATUS_BUFFER_SIZE 256           // Real-time status report is assembled here before output
+#endif
+#ifndef SETTINGS_REPORT_CHUNK
+#define SETTINGS_REPORT_CHUNK 8                 // Number of settings output by $$ between runs of the realtime loop
+#endif
 
 // Compile-time sanity check of defines
 
@@ -68,12 +83,36 @@
 #endif
 
 static char buf[(STRLEN_COORDVALUE + 1) * N_AXIS];
-static char *(*get_axis_values)(float *axis_values);
-static char *(*get_axis_value)(float value);
-static char *(*get_rate_value)(float value);
-static uint8_t override_counter = 0; // Tracks when to add override data to status reports.
-static uint8_t wco_counter = 0;      // Tracks when to add work coordinate offset data to status reports.
-alarm_code_t current_alarm = Alarm_None;
+static THREAD_LOCAL char *(*get_axis_values)(float *axis_values);
+static THREAD_LOCAL char *(*get_axis_value)(float value);
+static THREAD_LOCAL char *(*get_rate_value)(float value);
+static THREAD_LOCAL uint8_t override_counter = 0; // Tracks when to add override data to status reports.
+static THREAD_LOCAL uint8_t wco_counter = 0;      // Tracks when to add work coordinate offset data to status reports.
+THREAD_LOCAL alarm_code_t current_alarm = Alarm_None;
+
+static THREAD_LOCAL struct {
+    uint_fast16_t length;
+    char data[REPORT_STATUS_BUFFER_SIZE];
+} status_buf = {0};
+
+// Fixed point (32.32) factors for converting step counts to reporting units scaled by 10^decimals,
+// used for formatting the real-time status report position without float conversions.
+static THREAD_LOCAL struct {
+    bool valid;
+    float steps_per_mm[N_AXIS];     // Steps per mm the factors were calculated from
+    int64_t factor[N_AXIS];         // Scaled reporting units per step
+    int32_t max_steps[N_AXIS];      // Max absolute step count that can be converted without overflow
+    float offset_scale;             // Scaled reporting units per mm
+    uint32_t divisor;               // 10^decimals
+    uint8_t decimals;
+} position_scale = {0};
+
+// Snapshot of data at the last real-time status report, used by auto reporting.
+static THREAD_LOCAL struct {
+    uint32_t ms;
+    uint_fast16_t state;
+    int32_t position[N_AXIS];
+} last_report = {0};
 
 static const report_t report_fns = {
     .status_message = report_status_message,
@@ -213,6 +252,7 @@ inline static char *axis_signals_tostring (char *buf, axes_signals_t signals)
 void report_init (void)
 {
     current_alarm = Alarm_None;
+    position_scale.valid = false;
     get_axis_value = settings.flags.report_inches ? get_axis_value_inches : get_axis_value_mm;
     get_axis_values = settings.flags.report_inches ? get_axis_values_inches : get_axis_values_mm;
     get_rate_value = settings.flags.report_inches ? get_rate_value_inch : get_rate_value_mm;
@@ -276,6 +316,10 @@ void report_message (const char *msg, message_type_t type)
     }
 
     hal.stream.write(msg);
+#ifdef REPORT_TIMESTAMP
+    hal.stream.write("|TS:");
+    hal.stream.write(uitoa(report_get_timestamp()));
+#endif
     hal.stream.write("]" ASCII_EOL);
 }
 
@@ -359,6 +403,9 @@ message_code_t report_feedback_message (message_code_t message_code)
             break;
     }
 
+#ifdef REPORT_TIMESTAMP
+    hal.stream.write_all(appendbuf(2, "|TS:", uitoa(report_get_timestamp())));
+#endif
     hal.stream.write_all("]" ASCII_EOL);
 
     return message_code;
@@ -385,245 +432,316 @@ void report_grbl_help (void)
 
 // Grbl settings print out.
 
-void report_uint_setting (setting_type_t n, uint32_t val)
+// Setting lines are formatted in place in a line buffer and written in one call,
+// room is reserved for the setting number, the longest float value and the line terminator.
+#define SETTING_LINE_LENGTH (STRLEN_UINT32 * 2 + MAX_PRECISION + 8)
+
+// Formats the "$<n>=" setting line prefix, returns pointer to the terminating null.
+static inline char *setting_prefix (char *line, setting_type_t n)
 {
-    hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
-    hal.stream.write(appendbuf(2, uitoa(val), ASCII_EOL));
+    *line++ = '$';
+    line = uitoa_r(line, (uint32_t)n);
+    *line++ = '=';
+
+    return line;
 }
 
+void report_uint_setting (setting_type_t n, uint32_t val)
+{
+    char line[SETTING_LINE_LENGTH];
+
+    strcpy(uitoa_r(setting_prefix(line, n), val), ASCII_EOL);
+    hal.stream.write(line);
+}
 
 void report_float_setting (setting_type_t n, float val, uint8_t n_decimal)
 {
-    hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
-    hal.stream.write(appendbuf(2, ftoa(val, n_decimal), ASCII_EOL));
+    char line[SETTING_LINE_LENGTH];
+
+    strcpy(ftoa_r(setting_prefix(line, n), val, n_decimal > MAX_PRECISION ? MAX_PRECISION : n_decimal), ASCII_EOL);
+    hal.stream.write(line);
 }
 
 void report_string_setting (setting_type_t n, char *val)
 {
-    hal.stream.write(appendbuf(3, "$", uitoa((uint32_t)n), "="));
-    hal.stream.write(appendbuf(2, val, ASCII_EOL));
+    char line[SETTING_LINE_LENGTH];
+
+    *setting_prefix(line, n) = '\0';
+    hal.stream.write(line);
+    hal.stream.write(val);
+    hal.stream.write(ASCII_EOL);
 }
 
-void report_grbl_settings (bool all)
+// Prints a setting handled by custom code in settings_store_global_setting().
+// Returns false if the setting is not handled there or is an extended setting and all is not set.
+static bool report_custom_setting (setting_type_t setting, bool all)
 {
-    uint_fast8_t idx;
+    bool ok = true;
 
-    // Print Grbl settings.
-    report_float_setting(Setting_PulseMicroseconds, settings.steppers.pulse_microseconds, 1);
-    report_uint_setting(Setting_StepperIdleLockTime, settings.steppers.idle_lock_time);
-    report_uint_setting(Setting_StepInvertMask, settings.steppers.step_invert.mask);
-    report_uint_setting(Setting_DirInvertMask, settings.steppers.dir_invert.mask);
-    report_uint_setting(Setting_InvertStepperEnable, settings.steppers.enable_invert.mask);
-    report_uint_setting(Setting_LimitPinsInvertMask, settings.limits.invert.mask);
-    if(hal.probe.configure)
-        report_uint_setting(Setting_InvertProbePin, settings.probe.invert_probe_pin);
-    if(all)
-        report_uint_setting(Setting_StatusReportMask, (uint32_t)settings.status_report.mask);
-    else
-        report_uint_setting(Setting_StatusReportMask, settings.status_report.mask & 0x3);
-    report_float_setting(Setting_JunctionDeviation, settings.junction_deviation, N_DECIMAL_SETTINGVALUE);
-    report_float_setting(Setting_ArcTolerance, settings.arc_tolerance, N_DECIMAL_SETTINGVALUE);
-    report_uint_setting(Setting_ReportInches, settings.flags.report_inches);
-
-    if(all) {
-        report_uint_setting(Setting_ControlInvertMask, settings.control_invert.mask);
-        report_uint_setting(Setting_CoolantInvertMask, settings.coolant_invert.mask);
-        report_uint_setting(Setting_SpindleInvertMask, settings.spindle.invert.mask);
-        report_uint_setting(Setting_ControlPullUpDisableMask, settings.control_disable_pullup.mask);
-        report_uint_setting(Setting_LimitPullUpDisableMask, settings.limits.disable_pullup.mask);
-        if(hal.probe.configure)
-            report_uint_setting(Setting_ProbePullUpDisable, settings.probe.disable_probe_pullup);
-    }
+    switch(setting) {
 
-    report_uint_setting(Setting_SoftLimitsEnable, settings.limits.flags.soft_enabled);
-    report_uint_setting(Setting_HardLimitsEnable, ((settings.limits.flags.hard_enabled & bit(0)) ? bit(0) | (settings.limits.flags.check_at_init ? bit(1) : 0) : 0));
-    report_uint_setting(Setting_HomingEnable, (settings.homing.flags.value & 0x0F) |
-                                               (settings.limits.flags.two_switches ? bit(4) : 0) |
-                                                (settings.homing.flags.manual ? bit(5) : 0));
-    report_uint_setting(Setting_HomingDirMask, settings.homing.dir_mask.value);
-    report_float_setting(Setting_HomingFeedRate, settings.homing.feed_rate, N_DECIMAL_SETTINGVALUE);
-    report_float_setting(Setting_HomingSeekRate, settings.homing.seek_rate, N_DECIMAL_SETTINGVALUE);
-    report_uint_setting(Setting_HomingDebounceDelay, settings.homing.debounce_delay);
-    report_float_setting(Setting_HomingPulloff, settings.homing.pulloff, N_DECIMAL_SETTINGVALUE);
-
-    if(all) {
-        report_float_setting(Setting_G73Retract, settings.g73_retract, N_DECIMAL_SETTINGVALUE);
-        if(hal.driver_cap.step_pulse_delay)
-            report_float_setting(Setting_PulseDelayMicroseconds, settings.steppers.pulse_delay_microseconds, 1);
-    }
+        case Setting_PulseMicroseconds:
+            report_float_setting(setting, settings.steppers.pulse_microseconds, 1);
+            break;
 
-    report_float_setting(Setting_RpmMax, settings.spindle.rpm_max, N_DECIMAL_RPMVALUE);
-    report_float_setting(Setting_RpmMin, settings.spindle.rpm_min, N_DECIMAL_RPMVALUE);
-    report_uint_setting(Setting_Mode, (uint32_t)settings.mode);
+        case Setting_InvertProbePin:
+            if(hal.probe.configure)
+                report_uint_setting(setting, settings.probe.invert_probe_pin);
+            break;
 
-    if(all) {
+        case Setting_StatusReportMask:
+            report_uint_setting(setting, all ? (uint32_t)settings.status_report.mask : settings.status_report.mask & 0x3);
+            break;
 
-        report_float_setting(Setting_PWMFreq, settings.spindle.pwm_freq, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PWMOffValue, settings.spindle.pwm_off_value, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PWMMinValue, settings.spindle.pwm_min_value, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PWMMaxValue, settings.spindle.pwm_max_value, N_DECIMAL_SETTINGVALUE);
-        report_uint_setting(Setting_StepperDeenergizeMask, settings.steppers.deenergize.mask);
-        if(hal.driver_cap.spindle_sync || hal.driver_cap.spindle_pid)
-            report_uint_setting(Setting_SpindlePPR, settings.spindle.ppr);
+        case Setting_ReportInches:
+            report_uint_setting(setting, settings.flags.report_inches);
+            break;
 
-        report_uint_setting(Setting_EnableLegacyRTCommands, settings.flags.legacy_rt_commands ? 1 : 0);
-        report_uint_setting(Setting_JogSoftLimited, settings.limits.flags.jog_soft_limited);
-        report_uint_setting(Setting_ParkingEnable, settings.parking.flags.value);
-        report_uint_setting(Setting_ParkingAxis, settings.parking.axis);
+        case Setting_SoftLimitsEnable:
+            report_uint_setting(setting, settings.limits.flags.soft_enabled);
+            break;
 
-        report_uint_setting(Setting_HomingLocateCycles, settings.homing.locate_cycles);
+        case Setting_HardLimitsEnable:
+            report_uint_setting(setting, ((settings.limits.flags.hard_enabled & bit(0)) ? bit(0) | (settings.limits.flags.check_at_init ? bit(1) : 0) : 0));
+            break;
 
-        for(idx = 0 ; idx < N_AXIS ; idx++)
-            report_uint_setting((setting_type_t)(Setting_HomingCycle_1 + idx), settings.homing.cycle[idx].mask);
+        case Setting_HomingEnable:
+            report_uint_setting(setting, (settings.homing.flags.value & 0x0F) |
+                                          (settings.limits.flags.two_switches ? bit(4) : 0) |
+                                           (settings.homing.flags.manual ? bit(5) : 0));
+            break;
 
-        if(hal.driver_settings.report) {
-            for(idx = Setting_JogStepSpeed; idx < Setting_ParkingPulloutIncrement; idx++)
-                hal.driver_settings.report((setting_type_t)idx);
-        }
+        case Setting_Mode:
+            report_uint_setting(setting, (uint32_t)settings.mode);
+            break;
 
-        report_float_setting(Setting_ParkingPulloutIncrement, settings.parking.pullout_increment, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_ParkingPulloutRate, settings.parking.pullout_rate, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_ParkingTarget, settings.parking.target, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_ParkingFastRate, settings.parking.rate, N_DECIMAL_SETTINGVALUE);
-        report_uint_setting(Setting_RestoreOverrides, settings.flags.restore_overrides);
-        report_uint_setting(Setting_IgnoreDoorWhenIdle, settings.flags.safety_door_ignore_when_idle);
-        report_uint_setting(Setting_SleepEnable, settings.flags.sleep_enable);
-        report_uint_setting(Setting_HoldActions, (settings.flags.disable_laser_during_hold ? bit(0) : 0) | (settings.flags.restore_after_feed_hold ? bit(1) : 0));
-        report_uint_setting(Setting_ForceInitAlarm, settings.flags.force_initialization_alarm);
-        report_uint_setting(Setting_ProbingFeedOverride, settings.probe.allow_feed_override);
-
-      #ifdef ENABLE_SPINDLE_LINEARIZATION
-        for(idx = 0 ; idx < SPINDLE_NPWM_PIECES ; idx++) {
-            if(isnan(settings.spindle.pwm_piece[idx].rpm))
-                report_float_setting((setting_type_t)(Setting_LinearSpindlePiece1 + idx), settings.spindle.pwm_piece[idx].rpm, N_DECIMAL_RPMVALUE);
-            else {
-                sprintf(buf, "$%d=%f,%f,%f" ASCII_EOL, (setting_type_t)(Setting_LinearSpindlePiece1 + idx), settings.spindle.pwm_piece[idx].rpm, settings.spindle.pwm_piece[idx].start, settings.spindle.pwm_piece[idx].end);
-                hal.stream.write(buf);
-            }
-        }
-      #endif
+        default:
+            if(all) switch(setting) {
 
-    }
+                case Setting_ControlInvertMask:
+                    report_uint_setting(setting, settings.control_invert.mask);
+                    break;
 
-    if(hal.driver_settings.report) {
-        for(idx = Setting_NetworkServices; idx < Setting_SpindlePGain; idx++)
-            hal.driver_settings.report((setting_type_t)idx);
-    }
+                case Setting_SpindleInvertMask:
+                    report_uint_setting(setting, settings.spindle.invert.mask);
+                    break;
 
-#ifdef SPINDLE_RPM_CONTROLLED
+                case Setting_ControlPullUpDisableMask:
+                    report_uint_setting(setting, settings.control_disable_pullup.mask);
+                    break;
 
-    if(hal.driver_cap.spindle_pid) {
-        report_float_setting(Setting_SpindlePGain, settings.spindle.pid.p_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleIGain, settings.spindle.pid.i_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleDGain, settings.spindle.pid.d_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleMaxError, settings.spindle.pid.max_error, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_SpindleIMaxError, settings.spindle.pid.i_max_error, N_DECIMAL_SETTINGVALUE);
-    }
+                case Setting_ProbePullUpDisable:
+                    if(hal.probe.configure)
+                        report_uint_setting(setting, settings.probe.disable_probe_pullup);
+                    break;
 
-#endif
+                case Setting_PulseDelayMicroseconds:
+                    if(hal.driver_cap.step_pulse_delay)
+                        report_float_setting(setting, settings.steppers.pulse_delay_microseconds, 1);
+                    break;
 
-    if(hal.driver_cap.spindle_sync) {
-        report_float_setting(Setting_PositionPGain, settings.position.pid.p_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PositionIGain, settings.position.pid.i_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PositionDGain, settings.position.pid.d_gain, N_DECIMAL_SETTINGVALUE);
-        report_float_setting(Setting_PositionIMaxError, settings.position.pid.i_max_error, N_DECIMAL_SETTINGVALUE);
-    }
+                case Setting_EnableLegacyRTCommands:
+                    report_uint_setting(setting, settings.flags.legacy_rt_commands ? 1 : 0);
+                    break;
 
-    // Print axis settings
-    uint_fast8_t set_idx, val = (uint_fast8_t)Setting_AxisSettingsBase;
-    uint_fast8_t max_set = hal.driver_settings.report ? AXIS_SETTINGS_INCREMENT : AXIS_N_SETTINGS;
-    for (set_idx = 0; set_idx < max_set; set_idx++) {
+                case Setting_JogSoftLimited:
+                    report_uint_setting(setting, settings.limits.flags.jog_soft_limited);
+                    break;
+
+                case Setting_ParkingEnable:
+                    report_uint_setting(setting, settings.parking.flags.value);
+                    break;
 
-        for (idx = 0; idx < N_AXIS; idx++) {
+                case Setting_HomingLocateCycles:
+                    report_uint_setting(setting, settings.homing.locate_cycles);
+                    break;
 
-            switch ((axis_setting_type_t)set_idx) {
+                case Setting_HomingCycle_1:
+                case Setting_HomingCycle_2:
+                case Setting_HomingCycle_3:
+                case Setting_HomingCycle_4:
+                case Setting_HomingCycle_5:
+                case Setting_HomingCycle_6:
+                    if(setting - Setting_HomingCycle_1 < N_AXIS)
+                        report_uint_setting(setting, settings.homing.cycle[setting - Setting_HomingCycle_1].mask);
+                    break;
 
-                case AxisSetting_StepsPerMM:
-                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].steps_per_mm, N_DECIMAL_SETTINGVALUE);
+                case Setting_RestoreOverrides:
+                    report_uint_setting(setting, settings.flags.restore_overrides);
                     break;
 
-                case AxisSetting_MaxRate:
-                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].max_rate, N_DECIMAL_SETTINGVALUE);
+                case Setting_IgnoreDoorWhenIdle:
+                    report_uint_setting(setting, settings.flags.safety_door_ignore_when_idle);
                     break;
 
-                case AxisSetting_Acceleration:
-                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].acceleration / (60.0f * 60.0f), N_DECIMAL_SETTINGVALUE);
+                case Setting_SleepEnable:
+                    report_uint_setting(setting, settings.flags.sleep_enable);
                     break;
 
-                case AxisSetting_MaxTravel:
-                    report_float_setting((setting_type_t)(val + idx), -settings.axis[idx].max_travel, N_DECIMAL_SETTINGVALUE);
+                case Setting_HoldActions:
+                    report_uint_setting(setting, (settings.flags.disable_laser_during_hold ? bit(0) : 0) | (settings.flags.restore_after_feed_hold ? bit(1) : 0));
                     break;
 
-#ifdef ENABLE_BACKLASH_COMPENSATION
-                case AxisSetting_Backlash:
-                    report_float_setting((setting_type_t)(val + idx), settings.axis[idx].backlash, N_DECIMAL_SETTINGVALUE);
+                case Setting_ForceInitAlarm:
+                    report_uint_setting(setting, settings.flags.force_initialization_alarm);
+                    break;
+
+                case Setting_ProbingFeedOverride:
+                    report_uint_setting(setting, settings.probe.allow_feed_override);
+                    break;
+
+#ifdef ENABLE_SPINDLE_LINEARIZATION
+                case Setting_LinearSpindlePiece1:
+                case Setting_LinearSpindlePiece2:
+                case Setting_LinearSpindlePiece3:
+                case Setting_LinearSpindlePiece4:
+                    {
+                        uint_fast8_t idx = setting - Setting_LinearSpindlePiece1;
+                        if(isnan(settings.spindle.pwm_piece[idx].rpm))
+                            report_float_setting(setting, settings.spindle.pwm_piece[idx].rpm, N_DECIMAL_RPMVALUE);
+                        else {
+                            sprintf(buf, "$%d=%f,%f,%f" ASCII_EOL, setting, settings.spindle.pwm_piece[idx].rpm, settings.spindle.pwm_piece[idx].start, settings.spindle.pwm_piece[idx].end);
+                            hal.stream.write(buf);
+                        }
+                    }
+                    break;
+#endif
+
+                case Setting_ToolChangeMode:
+                    if(!hal.driver_cap.atc && hal.stream.suspend_read)
+                        report_uint_setting(setting, settings.tool_change.mode);
+                    break;
+
+                case Setting_AutoReportInterval:
+                    if(hal.get_elapsed_ticks)
+                        report_uint_setting(setting, settings.auto_report_interval);
+                    break;
+
+#ifdef KINEMATICS_API
+                case Setting_Kinematics:
+                    report_uint_setting(setting, (uint32_t)settings.kinematics);
                     break;
 #endif
 
                 default:
-                    if(hal.driver_settings.axis_report)
-                        hal.driver_settings.axis_report((axis_setting_type_t)set_idx, idx);
+                    ok = false;
                     break;
-            }
-        }
-        val += AXIS_SETTINGS_INCREMENT;
+
+            } else
+                ok = false;
+            break;
     }
 
-    if(all) for(idx = Setting_AxisSettingsMax + 1; idx <= Setting_SettingsMax; idx++) {
+    return ok;
+}
 
-        switch((setting_type_t)idx) {
+// Prints an axis setting, returns false if the setting number is not in use.
+static bool report_axis_setting (setting_type_t setting)
+{
+    uint_fast16_t base_idx = (uint_fast16_t)setting - (uint_fast16_t)Setting_AxisSettingsBase;
+    uint_fast8_t idx = base_idx % AXIS_SETTINGS_INCREMENT, set_idx = base_idx / AXIS_SETTINGS_INCREMENT;
 
-            case Setting_SpindleAtSpeedTolerance:
-                if(hal.driver_cap.spindle_at_speed)
-                    report_float_setting(Setting_SpindleAtSpeedTolerance, settings.spindle.at_speed_tolerance, 1);
-                break;
+    if(idx >= N_AXIS || set_idx >= (hal.driver_settings.report ? AXIS_SETTINGS_INCREMENT : AXIS_N_SETTINGS))
+        return false;
 
-            case Setting_ToolChangeMode:
-                if(!hal.driver_cap.atc && hal.stream.suspend_read)
-                    report_uint_setting(Setting_ToolChangeMode, settings.tool_change.mode);
-                break;
+    switch ((axis_setting_type_t)set_idx) {
 
-            case Setting_ToolChangeProbingDistance:
-                if(!hal.driver_cap.atc && hal.stream.suspend_read)
-                    report_float_setting(Setting_ToolChangeProbingDistance, settings.tool_change.probing_distance, 1);
-                break;
+        case AxisSetting_StepsPerMM:
+            report_float_setting(setting, settings.axis[idx].steps_per_mm, N_DECIMAL_SETTINGVALUE);
+            break;
 
-            case Setting_ToolChangeFeedRate:
-                if(!hal.driver_cap.atc && hal.stream.suspend_read)
-                    report_float_setting(Setting_ToolChangeFeedRate, settings.tool_change.feed_rate, 1);
-                break;
+        case AxisSetting_MaxRate:
+            report_float_setting(setting, settings.axis[idx].max_rate, N_DECIMAL_SETTINGVALUE);
+            break;
 
-            case Setting_ToolChangeSeekRate:
-                if(!hal.driver_cap.atc && hal.stream.suspend_read)
-                    report_float_setting(Setting_ToolChangeSeekRate, settings.tool_change.seek_rate, 1);
-                break;
+        case AxisSetting_Acceleration:
+            report_float_setting(setting, settings.axis[idx].acceleration / (60.0f * 60.0f), N_DECIMAL_SETTINGVALUE);
+            break;
 
-            case Settings_IoPort_InvertIn:
-                if(hal.port.num_digital_in)
-                    report_uint_setting(Settings_IoPort_InvertIn, settings.ioport.invert_in.mask);
-                break;
+        case AxisSetting_MaxTravel:
+            report_float_setting(setting, -settings.axis[idx].max_travel, N_DECIMAL_SETTINGVALUE);
+            break;
 
-            case Settings_IoPort_Pullup_Disable:
-                if(hal.port.num_digital_in)
-                    report_uint_setting(Settings_IoPort_Pullup_Disable, settings.ioport.pullup_disable_in.mask);
-                break;
+#ifdef ENABLE_BACKLASH_COMPENSATION
+        case AxisSetting_Backlash:
+            report_float_setting(setting, settings.axis[idx].backlash, N_DECIMAL_SETTINGVALUE);
+            break;
+#endif
 
-            case Settings_IoPort_InvertOut:
-                if(hal.port.num_digital_out)
-                    report_uint_setting(Settings_IoPort_InvertOut, settings.ioport.invert_out.mask);
-                break;
+#ifdef ENABLE_JERK_ACCELERATION
+        case AxisSetting_Jerk:
+            report_float_setting(setting, settings.axis[idx].jerk / (60.0f * 60.0f * 60.0f), N_DECIMAL_SETTINGVALUE);
+            break;
+#endif
 
-            case Settings_IoPort_OD_Enable:
-                if(hal.port.num_digital_out)
-                    report_uint_setting(Settings_IoPort_OD_Enable, settings.ioport.od_enable_out.mask);
-                break;
+#ifdef ENABLE_HOMING_AXIS_RATES
+        case AxisSetting_HomingSeekRate:
+            report_float_setting(setting, settings.axis[idx].homing_seek_rate, N_DECIMAL_SETTINGVALUE);
+            break;
 
-            default:
-                if(hal.driver_settings.report)
-                    hal.driver_settings.report((setting_type_t)idx);
-                break;
+        case AxisSetting_HomingFeedRate:
+            report_float_setting(setting, settings.axis[idx].homing_feed_rate, N_DECIMAL_SETTINGVALUE);
+            break;
+#endif
+
+        default:
+            if(hal.driver_settings.axis_report)
+                hal.driver_settings.axis_report((axis_setting_type_t)set_idx, idx);
+            break;
+    }
+
+    return true;
+}
+
+// Prints a setting owned by the driver or a plugin, returns false if the driver is not asked.
+static bool report_driver_setting (setting_type_t setting, bool all)
+{
+    bool ok = hal.driver_settings.report &&
+               ((setting >= Setting_NetworkServices && setting < Setting_SpindlePGain) ||
+                 (all && ((setting >= Setting_JogStepSpeed && setting < Setting_ParkingPulloutIncrement) || setting > Setting_AxisSettingsMax)));
+
+    if(ok)
+        hal.driver_settings.report(setting);
+
+    return ok;
+}
+
+// Prints Grbl settings in setting number order, settings described by the settings table first.
+// If yield is set the realtime loop is run every SETTINGS_REPORT_CHUNK settings so that realtime commands and
+// reports are serviced while a long list is output. Returns false if aborted.
+bool report_settings (bool all, bool yield)
+{
+    bool ok;
+    uint_fast16_t idx, count = 0; // NOTE: loops over setting numbers > 255
+    const setting_detail_t *setting;
+
+    for(idx = 0; idx <= Setting_SettingsMax; idx++) {
+
+        if(idx >= Setting_AxisSettingsBase && idx <= Setting_AxisSettingsMax)
+            ok = report_axis_setting((setting_type_t)idx);
+        else if((setting = settings_get_details((setting_type_t)idx))) {
+            if((ok = (all || !setting->extended) && (setting->is_available == NULL || setting->is_available()))) {
+                if(setting->format == SettingFormat_Float)
+                    report_float_setting(setting->id, settings_get_value(setting), setting->decimals);
+                else
+                    report_uint_setting(setting->id, (uint32_t)settings_get_value(setting));
+            }
+        } else if(!(ok = report_custom_setting((setting_type_t)idx, all)))
+            ok = report_driver_setting((setting_type_t)idx, all);
+
+        if(ok && yield && ++count == SETTINGS_REPORT_CHUNK) {
+            count = 0;
+            if(!protocol_execute_realtime())
+                return false;
         }
     }
+
+    return true;
+}
+
+void report_grbl_settings (bool all)
+{
+    report_settings(all, false);
 }
 
 
@@ -732,7 +850,7 @@ void report_ngc_parameters (void)
         plane_t plane;
         gc_get_plane_data(&plane, gc_state.modal.plane_select);
         hal.stream.write("[TLR:");
-        hal.stream.write(get_axis_value(sys.tlo_reference[plane.axis_linear] / settings.axis[plane.axis_linear].steps_per_mm));
+        hal.stream.write(get_axis_value(sys.tlo_reference[plane.axis_linear] * mm_per_step[plane.axis_linear]));
         hal.stream.write("]" ASCII_EOL);
     }
 }
@@ -796,6 +914,8 @@ void report_gcode_modes (void)
             hal.stream.write(gc_state.modal.tool_offset_mode == ToolLengthOffset_EnableDynamic ? ".1" : ".2");
     }
 
+    hal.stream.write(gc_state.modal.control == ControlMode_Blending ? " G64" : " G61");
+
     hal.stream.write(gc_state.canned.retract_mode == CCRetractMode_RPos ? " G99" : " G98");
 
     if(gc_state.modal.scaling_active) {
@@ -891,6 +1011,154 @@ void report_execute_startup_message (char *line, status_code_t status_code)
 }
 
 // Prints build info line
+// Prints stepper instrumentation data, $SS command
+void report_stepper_stats (void)
+{
+    st_stats_t stats;
+
+    st_get_stats(&stats, false);
+
+    if(hal.get_cycle_count) {
+        hal.stream.write("[ISR:");
+        hal.stream.write(uitoa(stats.isr_cycles_min == UINT32_MAX ? 0 : stats.isr_cycles_min));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats.isr_cycles_avg));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats.isr_cycles_max));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    hal.stream.write("[SEGMENTS:");
+    hal.stream.write(uitoa((uint32_t)stats.segment_buffer_min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)(st_get_segment_buffer_size() - 1)));
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[BLOCKS:");
+    hal.stream.write(uitoa((uint32_t)stats.planner_buffer_min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)(plan_get_block_buffer_size() - 1)));
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[UNDERRUNS:");
+    hal.stream.write(uitoa(stats.underruns));
+    hal.stream.write("]" ASCII_EOL);
+
+#ifdef ENABLE_INPUT_SHAPING
+    hal.stream.write("[SHAPER:");
+    hal.stream.write(uitoa(settings.input_shaper.type));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(settings.input_shaper.frequency[0], 1));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(settings.input_shaper.frequency[1], 1));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(st_get_input_shaper_duration() * 1000.0f, 1));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats.shaper_stalls));
+    hal.stream.write("]" ASCII_EOL);
+#endif
+
+    rt_task_t *task = protocol_get_rt_tasks();
+
+    while(task) {
+        hal.stream.write("[RTTASK:");
+        hal.stream.write(task->name ? task->name : "?");
+        hal.stream.write(",");
+        hal.stream.write(uitoa((uint32_t)task->period));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(task->stats.calls));
+        if(hal.get_cycle_count) {
+            hal.stream.write(",");
+            hal.stream.write(uitoa(task->stats.cycles_avg));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(task->stats.cycles_max));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(task->stats.overruns));
+        }
+        hal.stream.write("]" ASCII_EOL);
+        task = task->next;
+    }
+
+#ifdef ENABLE_BOOT_TIMING
+    uint_fast8_t idx;
+    boot_timing_t timing;
+
+    system_get_boot_timing(&timing);
+
+    hal.stream.write("[BOOT:");
+    for(idx = BootPhase_NVSLoaded; idx < BootPhase_N; idx++) {
+        hal.stream.write(uitoa(timing.ms[idx]));
+        hal.stream.write(idx == BootPhase_N - 1 ? "]" ASCII_EOL : ",");
+    }
+
+    if(hal.get_cycle_count) {
+        hal.stream.write("[BOOTCYCLES:");
+        for(idx = BootPhase_NVSLoaded; idx < BootPhase_N; idx++) {
+            hal.stream.write(uitoa(timing.cycles[idx]));
+            hal.stream.write(idx == BootPhase_N - 1 ? "]" ASCII_EOL : ",");
+        }
+    }
+#endif
+
+#ifdef KINEMATICS_API
+    hal.stream.write("[KINEMATICS:");
+    hal.stream.write(uitoa((uint32_t)kinematics.stats.segments_last));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)kinematics.stats.segments_max));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(kinematics.stats.moves));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(kinematics.stats.segments));
+    hal.stream.write("]" ASCII_EOL);
+#endif
+}
+
+// Prints the sizes of the input stream, planner and step segment buffers, $SM command:
+// [BUFFERS:<rx buffer bytes>,<planner blocks>,<segments>,<planner bytes>,<segment bytes>]
+// Blocks and segments are the number usable, bytes the memory allocated.
+void report_buffer_sizes (void)
+{
+    hal.stream.write("[BUFFERS:");
+    hal.stream.write(uitoa(hal.rx_buffer_size));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)(plan_get_block_buffer_size() - 1)));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)(st_get_segment_buffer_size() - 1)));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)(plan_get_block_buffer_size() * sizeof(plan_block_t))));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)st_get_segment_buffer_memory()));
+    hal.stream.write("]" ASCII_EOL);
+
+    report_memory_usage();
+}
+
+// Prints memory usage, $SM command and $SM=<ms> periodic report:
+// [MEMORY:<NVS buffer bytes>,<NVS driver area bytes>,<message and output command pool bytes>]
+// [HEAP:<free heap bytes>,<stack high-water bytes>,<unused bytes>] - if provided by the driver
+void report_memory_usage (void)
+{
+    memory_info_t info;
+
+    hal.stream.write("[MEMORY:");
+    hal.stream.write(uitoa(nvs_buffer_size()));
+    hal.stream.write(",");
+    hal.stream.write(uitoa((uint32_t)hal.nvs.driver_area.size));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(pool_get_memory()));
+    hal.stream.write("]" ASCII_EOL);
+
+    if(hal.get_memory_info && hal.get_memory_info(&info)) {
+        hal.stream.write("[HEAP:");
+        hal.stream.write(uitoa(info.heap_free));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(info.stack_used));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(info.unused));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
 void report_build_info (char *line)
 {
 
@@ -972,7 +1240,7 @@ void report_build_info (char *line)
     hal.stream.write(buf);
 
     // NOTE: Compiled values, like override increments/max/min values, may be added at some point later.
-    hal.stream.write(uitoa((uint32_t)(BLOCK_BUFFER_SIZE - 1)));
+    hal.stream.write(uitoa((uint32_t)(plan_get_block_buffer_size() - 1)));
     hal.stream.write(",");
     hal.stream.write(uitoa(hal.rx_buffer_size));
     hal.stream.write(",");
@@ -1044,6 +1312,10 @@ void report_build_info (char *line)
     strcat(buf, "PID,");
 #endif
 
+#ifdef ENABLE_PID_TELEMETRY
+    strcat(buf, "PIDT,");
+#endif
+
     append = &buf[strlen(buf) - 1];
     if(*append == ',')
         *append = '\0';
@@ -1071,6 +1343,22 @@ void report_build_info (char *line)
         hal.stream.write("]"  ASCII_EOL);
     }
 
+#if LIMITS_FILTER_SAMPLES
+    limits_filter_stats_t *filter = limits_filter_get_stats();
+
+    hal.stream.write("[LIMITS FILTER:");
+    hal.stream.write(uitoa(LIMITS_FILTER_SAMPLES));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(filter->trips));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(filter->glitches));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(filter->latency_last));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(filter->latency_max));
+    hal.stream.write("]"  ASCII_EOL);
+#endif
+
     grbl.on_report_options();
 
 #endif
@@ -1087,6 +1375,182 @@ void report_echo_line_received (char *line)
 }
 
 
+// Real-time status report writer.
+// Values are formatted in place at the end of the report buffer and the report is output in one write
+// when committed. Each append reserves room for its worst case length first, if there is not enough room
+// the buffer is output early. The cost of an append is thus bounded by its length and the buffer size.
+
+// Outputs the assembled real-time status report in one write.
+// NOTE: the report is output on the realtime channel of the stream if it has one.
+static void status_flush (void)
+{
+    if(status_buf.length) {
+        (hal.stream.write_realtime ? hal.stream.write_realtime : hal.stream.write_all)(status_buf.data);
+        status_buf.length = 0;
+    }
+}
+
+// Returns pointer to the end of the report buffer with room for at least length characters and the terminating null,
+// outputs the buffer first if there is no room.
+static inline char *status_reserve (uint_fast16_t length)
+{
+    if(status_buf.length + length >= sizeof(status_buf.data))
+        status_flush();
+
+    return &status_buf.data[status_buf.length];
+}
+
+// Commits characters written in place to the report buffer, end points past the last character.
+static inline void status_commit (char *end)
+{
+    *end = '\0';
+    status_buf.length = end - status_buf.data;
+}
+
+// Appends a string to the real-time status report buffer, outputs the buffer first if there is no room.
+static void status_write (const char *s)
+{
+    size_t length = strlen(s);
+
+    if(status_buf.length + length >= sizeof(status_buf.data)) {
+        status_flush();
+        if(length >= sizeof(status_buf.data)) {
+            (hal.stream.write_realtime ? hal.stream.write_realtime : hal.stream.write_all)(s);
+            return;
+        }
+    }
+
+    memcpy(&status_buf.data[status_buf.length], s, length + 1);
+    status_buf.length += length;
+}
+
+// Appends a string followed by an unsigned integer value.
+static void status_write_uint (const char *s, uint32_t n)
+{
+    status_write(s);
+    status_commit(uitoa_r(status_reserve(STRLEN_UINT32), n));
+}
+
+// Appends a string followed by a rate value in reporting units.
+static void status_write_rate (const char *s, float value)
+{
+    status_write_uint(s, (uint32_t)(settings.flags.report_inches ? value * INCH_PER_MM : value));
+}
+
+// Calculates the step count to reporting units conversion factors from the current settings.
+static void position_scale_update (void)
+{
+    uint_fast8_t idx;
+
+    position_scale.decimals = settings.flags.report_inches ? N_DECIMAL_COORDVALUE_INCH : N_DECIMAL_COORDVALUE_MM;
+    position_scale.divisor = 1;
+    for(idx = 0; idx < position_scale.decimals; idx++)
+        position_scale.divisor *= 10;
+
+    // NOTE: calculated in double precision as the factors need ~40 significant bits.
+    double scale = (double)position_scale.divisor / (settings.flags.report_inches ? 25.4 : 1.0);
+
+    position_scale.offset_scale = (float)scale;
+    scale *= 4294967296.0;
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        position_scale.steps_per_mm[idx] = settings.axis[idx].steps_per_mm;
+        position_scale.factor[idx] = (int64_t)(scale / (double)settings.axis[idx].steps_per_mm + 0.5);
+        // Leave headroom for offsets and diameter mode, values outside the range are formatted from floats.
+        int64_t max_steps = position_scale.factor[idx] > 0 ? (INT64_C(1) << 60) / position_scale.factor[idx] : -1;
+        position_scale.max_steps[idx] = max_steps > INT32_MAX ? INT32_MAX : (int32_t)max_steps;
+    } while(idx);
+
+    position_scale.valid = true;
+}
+
+// Appends a string followed by comma separated axis positions in reporting units, less offsets if provided.
+// Positions are converted directly from the step counts by fixed point arithmetic.
+static void status_write_axis_steps (const char *s, int32_t *steps, float *offset)
+{
+    uint_fast8_t idx;
+
+    if(position_scale.valid) for(idx = 0; idx < N_AXIS; idx++) {
+        if(position_scale.steps_per_mm[idx] != settings.axis[idx].steps_per_mm) {
+            position_scale.valid = false;
+            break;
+        }
+    }
+
+    if(!position_scale.valid)
+        position_scale_update();
+
+    status_write(s);
+
+    char *append = status_reserve((STRLEN_COORDVALUE + 2) * N_AXIS);
+
+    for (idx = 0; idx < N_AXIS; idx++) {
+
+        float scaled_offset = offset ? offset[idx] * position_scale.offset_scale : 0.0f;
+
+        int64_t value = steps[idx];
+
+        if((value < 0 ? -value : value) <= position_scale.max_steps[idx] && fabsf(scaled_offset) < 536870912.0f) {
+
+            value = value * position_scale.factor[idx] - (int64_t)(scaled_offset * 4294967296.0f);
+
+            if(idx == X_AXIS && gc_state.modal.diameter_mode)
+                value *= 2;
+
+            if(value < 0) {
+                *append++ = '-';
+                value = -value;
+            }
+
+            uint32_t units = (uint32_t)(((uint64_t)value + 0x80000000UL) >> 32), integer = units / position_scale.divisor;
+            uint_fast8_t decimals = position_scale.decimals;
+
+            append = uitoa_r(append, integer);
+            *append++ = '.';
+            append += decimals;
+
+            char *digit = append;
+            units -= integer * position_scale.divisor;
+            while(decimals--) {
+                *--digit = '0' + (units % 10);
+                units /= 10;
+            }
+        } else {
+            float value = steps[idx] * mm_per_step[idx] - (offset ? offset[idx] : 0.0f);
+            if(idx == X_AXIS && gc_state.modal.diameter_mode)
+                value *= 2.0f;
+            append = ftoa_r(append, settings.flags.report_inches ? value * INCH_PER_MM : value, position_scale.decimals);
+        }
+
+        if (idx < (N_AXIS - 1))
+            *append++ = ',';
+    }
+
+    status_commit(append);
+}
+
+// Appends a string followed by comma separated axis position values in reporting units.
+static void status_write_axis_values (const char *s, float *axis_values)
+{
+    uint_fast8_t idx;
+    float scale = settings.flags.report_inches ? INCH_PER_MM : 1.0f;
+    uint8_t decimals = settings.flags.report_inches ? N_DECIMAL_COORDVALUE_INCH : N_DECIMAL_COORDVALUE_MM;
+
+    status_write(s);
+
+    char *append = status_reserve((STRLEN_COORDVALUE + 2) * N_AXIS);
+
+    for (idx = 0; idx < N_AXIS; idx++) {
+        append = ftoa_r(append, idx == X_AXIS && gc_state.modal.diameter_mode ? axis_values[idx] * scale * 2.0f : axis_values[idx] * scale, decimals);
+        if (idx < (N_AXIS - 1))
+            *append++ = ',';
+    }
+
+    status_commit(append);
+}
+
  // Prints real-time data. This function grabs a real-time snapshot of the stepper subprogram
  // and the actual location of the CNC machine. Users may change the following function to their
  // specific needs, but the desired real-time data report must be as short as possible. This is
@@ -1094,108 +1558,133 @@ void report_echo_line_received (char *line)
  // especially during g-code programs with fast, short line segments and high frequency reports (5-20Hz).
 void report_realtime_status (void)
 {
-    static bool probing = false;
+    static THREAD_LOCAL bool probing = false;
 
     int32_t current_position[N_AXIS]; // Copy current state of the system position variable
-    float print_position[N_AXIS];
     probe_state_t probe_state = {
         .connected = On,
         .triggered = Off
     };
 
-    memcpy(current_position, sys_position, sizeof(sys_position));
-    system_convert_array_steps_to_mpos(print_position, current_position);
+    st_get_position(current_position);
+#ifdef REPORT_TIMESTAMP
+    uint32_t timestamp = report_get_timestamp();
+#endif
 
     if(hal.probe.get_state)
         probe_state = hal.probe.get_state();
 
+    if(hal.get_elapsed_ticks) {
+        last_report.ms = hal.get_elapsed_ticks();
+        last_report.state = sys.state;
+        memcpy(last_report.position, current_position, sizeof(current_position));
+    }
+
     // Report current machine state and sub-states
-    hal.stream.write_all("<");
+    status_write("<");
 
     switch (gc_state.tool_change && sys.state == STATE_CYCLE ? STATE_TOOL_CHANGE : sys.state) {
 
         case STATE_IDLE:
-            hal.stream.write_all("Idle");
+            status_write("Idle");
             break;
 
         case STATE_CYCLE:
-            hal.stream.write_all("Run");
-            if(sys_probing_state == Probing_Active && settings.status_report.run_substate)
+            status_write("Run");
+            if(sys_probing_state != Probing_Off && settings.status_report.run_substate)
                 probing = true;
             else if (probing)
                 probing = probe_state.triggered;
             if(sys.flags.feed_hold_pending)
-                hal.stream.write_all(":1");
+                status_write(":1");
             else if(probing)
-                hal.stream.write_all(":2");
+                status_write(":2");
             break;
 
         case STATE_HOLD:
-            hal.stream.write_all(appendbuf(2, "Hold:", uitoa((uint32_t)(sys.holding_state - 1))));
+            status_write_uint("Hold:", (uint32_t)(sys.holding_state - 1));
             break;
 
         case STATE_JOG:
-            hal.stream.write_all("Jog");
+            status_write("Jog");
             break;
 
         case STATE_HOMING:
-            hal.stream.write_all("Home");
+            status_write("Home");
             break;
 
         case STATE_ESTOP:
         case STATE_ALARM:
             if(settings.status_report.alarm_substate)
-                hal.stream.write_all(appendbuf(2, "Alarm:", uitoa((uint32_t)current_alarm)));
+                status_write_uint("Alarm:", (uint32_t)current_alarm);
             else
-                hal.stream.write_all("Alarm");
+                status_write("Alarm");
             break;
 
         case STATE_CHECK_MODE:
-            hal.stream.write_all("Check");
+            status_write("Check");
             break;
 
         case STATE_SAFETY_DOOR:
-            hal.stream.write_all(appendbuf(2, "Door:", uitoa((uint32_t)sys.parking_state)));
+            status_write_uint("Door:", (uint32_t)sys.parking_state);
             break;
 
         case STATE_SLEEP:
-            hal.stream.write_all("Sleep");
+            status_write("Sleep");
             break;
 
         case STATE_TOOL_CHANGE:
-            hal.stream.write_all("Tool");
+            status_write("Tool");
             break;
     }
 
     uint_fast8_t idx;
     float wco[N_AXIS];
     if (!settings.status_report.machine_position || sys.report.wco) {
-        for (idx = 0; idx < N_AXIS; idx++) {
-            // Apply work coordinate offsets and tool length offset to current position.
-            wco[idx] = gc_get_offset(idx);
-            if (!settings.status_report.machine_position)
-                print_position[idx] -= wco[idx];
-        }
+        for (idx = 0; idx < N_AXIS; idx++)
+            wco[idx] = gc_get_offset(idx); // Work coordinate offsets and tool length offset to apply to current position.
     }
 
     // Report position
-    hal.stream.write_all(settings.status_report.machine_position ? "|MPos:" : "|WPos:");
-    hal.stream.write_all(get_axis_values(print_position));
+#ifdef KINEMATICS_API
+    if(kinematics.convert_array_steps_to_mpos) {
+        float print_position[N_AXIS];
+        system_convert_array_steps_to_mpos(print_position, current_position);
+        if (!settings.status_report.machine_position) {
+            for (idx = 0; idx < N_AXIS; idx++)
+                print_position[idx] -= wco[idx];
+        }
+        status_write_axis_values(settings.status_report.machine_position ? "|MPos:" : "|WPos:", print_position);
+    } else
+#endif
+    status_write_axis_steps(settings.status_report.machine_position ? "|MPos:" : "|WPos:", current_position, settings.status_report.machine_position ? NULL : wco);
+#ifdef REPORT_TIMESTAMP
+    status_write_uint("|TS:", timestamp);
+#endif
 
     // Returns planner and output stream buffer states.
 
     if (settings.status_report.buffer_state) {
-        hal.stream.write_all("|Bf:");
-        hal.stream.write_all(uitoa((uint32_t)plan_get_block_buffer_available()));
-        hal.stream.write_all(",");
-        hal.stream.write_all(uitoa(hal.stream.get_rx_buffer_available()));
+        status_write_uint("|Bf:", (uint32_t)plan_get_block_buffer_available());
+        status_write_uint(",", hal.stream.get_rx_buffer_available());
+        status_write_uint("|Bt:", (uint32_t)lroundf(plan_get_buffer_time() * 1000.0f));
     }
 
+#ifdef REPORT_STEPPER_STATS
+    st_stats_t stats;
+
+    st_get_stats(&stats, false);
+    status_write_uint("|St:", (uint32_t)stats.segment_buffer_min);
+    status_write_uint(",", (uint32_t)stats.planner_buffer_min);
+    status_write_uint(",", stats.underruns);
+    status_write_uint(",", stats.isr_cycles_max);
+#endif
+
     if(settings.status_report.line_numbers) {
         // Report current line number
         plan_block_t *cur_block = plan_get_current_block();
         if (cur_block != NULL && cur_block->line_number > 0)
-            hal.stream.write_all(appendbuf(2, "|Ln:", uitoa((uint32_t)cur_block->line_number)));
+            status_write_uint("|Ln:", (uint32_t)cur_block->line_number);
     }
 
     spindle_state_t sp_state = hal.spindle.get_state();
@@ -1203,12 +1692,12 @@ void report_realtime_status (void)
     // Report realtime feed speed
     if(settings.status_report.feed_speed) {
         if(hal.driver_cap.variable_spindle) {
-            hal.stream.write_all(appendbuf(2, "|FS:", get_rate_value(st_get_realtime_rate())));
-            hal.stream.write_all(appendbuf(2, ",", uitoa(sp_state.on ? (uint32_t)sys.spindle_rpm : 0)));
+            status_write_rate("|FS:", st_get_realtime_rate());
+            status_write_uint(",", sp_state.on ? (uint32_t)sys.spindle_rpm : 0);
             if(hal.spindle.get_data /* && sys.mpg_mode */)
-                hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)hal.spindle.get_data(SpindleData_RPM).rpm)));
+                status_write_uint(",", (uint32_t)hal.spindle.get_data(SpindleData_RPM).rpm);
         } else
-            hal.stream.write_all(appendbuf(2, "|F:", get_rate_value(st_get_realtime_rate())));
+            status_write_rate("|F:", st_get_realtime_rate());
     }
 
     if(settings.status_report.pin_state) {
@@ -1218,9 +1707,9 @@ void report_realtime_status (void)
 
         if (lim_pin_state.value | ctrl_pin_state.value | probe_state.triggered | !probe_state.connected | sys.flags.block_delete_enabled) {
 
-            char *append = &buf[4];
+            status_write("|Pn:");
 
-            strcpy(buf, "|Pn:");
+            char *append = status_reserve(N_AXIS + 9);
 
             if (probe_state.triggered)
                 *append++ = 'P';
@@ -1247,8 +1736,7 @@ void report_realtime_status (void)
                 if (hal.driver_cap.program_stop ? ctrl_pin_state.stop_disable : sys.flags.optional_stop_disable)
                     *append++ = 'T';
             }
-            *append = '\0';
-            hal.stream.write_all(buf);
+            status_commit(append);
         }
     }
 
@@ -1281,28 +1769,27 @@ void report_realtime_status (void)
     if(sys.report.value || gc_state.tool_change) {
 
         if(sys.report.wco) {
-            hal.stream.write_all("|WCO:");
-            hal.stream.write_all(get_axis_values(wco));
+            status_write_axis_values("|WCO:", wco);
         }
 
         if(sys.report.gwco) {
-            hal.stream.write_all("|WCS:G");
-            hal.stream.write_all(map_coord_system(gc_state.modal.coord_system.id));
+            status_write("|WCS:G");
+            status_write(map_coord_system(gc_state.modal.coord_system.id));
         }
 
         if(sys.report.overrides) {
-            hal.stream.write_all(appendbuf(2, "|Ov:", uitoa((uint32_t)sys.override.feed_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)sys.override.rapid_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)sys.override.spindle_rpm)));
+            status_write_uint("|Ov:", (uint32_t)sys.override.feed_rate);
+            status_write_uint(",", (uint32_t)sys.override.rapid_rate);
+            status_write_uint(",", (uint32_t)sys.override.spindle_rpm);
         }
 
         if(sys.report.spindle || sys.report.coolant || sys.report.tool || gc_state.tool_change) {
 
             coolant_state_t cl_state = hal.coolant.get_state();
 
-            char *append = &buf[3];
+            status_write("|A:");
 
-            strcpy(buf, "|A:");
+            char *append = status_reserve(4);
 
             if (sp_state.on)
                 *append++ = sp_state.ccw ? 'C' : 'S';
@@ -1316,47 +1803,46 @@ void report_realtime_status (void)
             if(gc_state.tool_change && !sys.report.tool)
                 *append++ = 'T';
 
-            *append = '\0';
-            hal.stream.write_all(buf);
+            status_commit(append);
         }
 
         if(sys.report.scaling) {
-            axis_signals_tostring(buf, gc_get_g51_state());
-            hal.stream.write_all("|Sc:");
-            hal.stream.write_all(buf);
+            status_write("|Sc:");
+            status_commit(axis_signals_tostring(status_reserve(N_AXIS), gc_get_g51_state()));
         }
 
         if(sys.report.mpg_mode && hal.driver_cap.mpg_mode)
-            hal.stream.write_all(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
+            status_write(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
 
         if(sys.report.homed && (sys.homing.mask || settings.homing.flags.single_axis_commands || settings.homing.flags.manual)) {
             axes_signals_t homing = {sys.homing.mask ? sys.homing.mask : AXES_BITMASK};
-            hal.stream.write_all(appendbuf(2, "|H:", (homing.mask & sys.homed.mask) == homing.mask ? "1" : "0"));
+            status_write((homing.mask & sys.homed.mask) == homing.mask ? "|H:1" : "|H:0");
             if(settings.homing.flags.single_axis_commands)
-                hal.stream.write_all(appendbuf(2, ",", uitoa(sys.homed.mask)));
+                status_write_uint(",", sys.homed.mask);
         }
 
         if(sys.report.xmode && settings.mode == Mode_Lathe)
-            hal.stream.write_all(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
+            status_write(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
 
         if(sys.report.tool)
-            hal.stream.write_all(appendbuf(2, "|T:", uitoa(gc_state.tool->tool)));
+            status_write_uint("|T:", gc_state.tool->tool);
 
         if(sys.report.tlo_reference)
-            hal.stream.write_all(appendbuf(2, "|TLR:", uitoa(sys.tlo_reference_set.mask != 0)));
+            status_write_uint("|TLR:", sys.tlo_reference_set.mask != 0);
     }
 
     if(grbl.on_realtime_report)
-        grbl.on_realtime_report(hal.stream.write_all, sys.report);
+        grbl.on_realtime_report(status_write, sys.report);
 
-    hal.stream.write_all(">" ASCII_EOL);
+    status_write(">" ASCII_EOL);
+    status_flush();
 
     if(settings.status_report.parser_state) {
 
-        static uint32_t tool;
-        static float feed_rate, spindle_rpm;
-        static gc_modal_t last_state;
-        static bool g92_active;
+        static THREAD_LOCAL uint32_t tool;
+        static THREAD_LOCAL float feed_rate, spindle_rpm;
+        static THREAD_LOCAL gc_modal_t last_state;
+        static THREAD_LOCAL bool g92_active;
 
         bool is_changed = feed_rate != gc_state.feed_rate || spindle_rpm != gc_state.spindle.rpm || tool != gc_state.tool->tool;
 
@@ -1382,6 +1868,200 @@ void report_realtime_status (void)
     sys.report.wco = settings.status_report.work_coord_offset && wco_counter == 0; // Set to report on next request
 }
 
+// Requests a real-time status report when the $396 interval has elapsed since the last report or,
+// rate limited, when the state has changed. Reports requested by the host restart the interval.
+// In delta mode ($10 bit 12) a report due at the interval is skipped while the state, position and
+// tracked report data are unchanged.
+static bool position_changed (void)
+{
+    int32_t position[N_AXIS];
+
+    st_get_position(position);
+
+    return memcmp(last_report.position, position, sizeof(position)) != 0;
+}
+
+void report_auto_status (void)
+{
+    uint32_t elapsed = hal.get_elapsed_ticks() - last_report.ms;
+
+    if(elapsed < AUTO_REPORT_INTERVAL_MIN || (sys_rt_exec_state & EXEC_STATUS_REPORT))
+        return;
+
+    if(sys.state != last_report.state ||
+        (elapsed >= settings.auto_report_interval &&
+          (!settings.status_report.auto_report_delta || sys.report.value || position_changed())))
+        system_set_exec_state_flag(EXEC_STATUS_REPORT);
+}
+
+#ifdef ENABLE_BINARY_STATUS_REPORT
+
+#define BINARY_FRAME_FLAG   0x7E
+#define BINARY_FRAME_ESCAPE 0x7D
+
+static THREAD_LOCAL uint16_t binary_crc;
+
+// CRC-16/CCITT (polynomial 0x1021) nibble lookup table.
+static const uint16_t crc16_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// Appends a byte to the binary status frame, null, flag and escape bytes are escaped.
+static void binary_write (uint8_t c)
+{
+    char *s = status_reserve(2);
+
+    if(c == 0 || c == BINARY_FRAME_FLAG || c == BINARY_FRAME_ESCAPE) {
+        *s++ = BINARY_FRAME_ESCAPE;
+        c ^= 0x20;
+    }
+    *s++ = (char)c;
+
+    status_commit(s);
+}
+
+// Appends a byte to the binary status frame and to the frame CRC.
+static void binary_put (uint8_t c)
+{
+    binary_crc = (binary_crc << 4) ^ crc16_nibble[(binary_crc >> 12) ^ (c >> 4)];
+    binary_crc = (binary_crc << 4) ^ crc16_nibble[(binary_crc >> 12) ^ (c & 0x0F)];
+
+    binary_write(c);
+}
+
+// Appends a field to the binary status frame, passed to plugins via grbl.on_realtime_report_binary.
+static void binary_field (uint8_t type, const void *data, uint8_t length)
+{
+    const uint8_t *byte = (const uint8_t *)data;
+
+    binary_put(type);
+    binary_put(length);
+
+    while(length--)
+        binary_put(*byte++);
+}
+
+// Prints real-time data as a binary frame. Values are copied in native format, no text conversions are performed.
+void report_realtime_status_binary (void)
+{
+    static const char frame_flag[] = { BINARY_FRAME_FLAG, '\0' };
+
+    uint8_t data[sizeof(float) * N_AXIS]; // NOTE: N_AXIS is at least 3, room for the largest core field.
+    int32_t position[N_AXIS];
+    uint_fast16_t state = gc_state.tool_change && sys.state == STATE_CYCLE ? STATE_TOOL_CHANGE : sys.state;
+    uint16_t value16;
+    uint32_t value32;
+    float value;
+    probe_state_t probe_state = {
+        .connected = On,
+        .triggered = Off
+    };
+
+    st_get_position(position);
+#ifdef REPORT_TIMESTAMP
+    uint32_t timestamp = report_get_timestamp();
+#endif
+
+    if(hal.probe.get_state)
+        probe_state = hal.probe.get_state();
+
+    binary_crc = 0xFFFF;
+
+    status_write(frame_flag);
+    binary_put(BINARY_STATUS_VERSION);
+
+    value16 = (uint16_t)state;
+    memcpy(data, &value16, sizeof(uint16_t));
+    switch(state) {
+
+        case STATE_CYCLE:
+            data[2] = sys.flags.feed_hold_pending ? 1 : 0;
+            break;
+
+        case STATE_HOLD:
+            data[2] = (uint8_t)(sys.holding_state - 1);
+            break;
+
+        case STATE_ESTOP:
+        case STATE_ALARM:
+            data[2] = (uint8_t)current_alarm;
+            break;
+
+        case STATE_SAFETY_DOOR:
+            data[2] = (uint8_t)sys.parking_state;
+            break;
+
+        default:
+            data[2] = 0;
+            break;
+    }
+    binary_field(BinaryField_State, data, 3);
+
+    binary_field(BinaryField_Position, position, sizeof(position));
+#ifdef REPORT_TIMESTAMP
+    binary_field(BinaryField_Timestamp, &timestamp, sizeof(uint32_t));
+#endif
+
+    uint_fast8_t idx;
+    for (idx = 0; idx < N_AXIS; idx++) {
+        value = gc_get_offset(idx);
+        memcpy(&data[idx * sizeof(float)], &value, sizeof(float));
+    }
+    binary_field(BinaryField_WCO, data, sizeof(float) * N_AXIS);
+
+    value16 = (uint16_t)plan_get_block_buffer_available();
+    memcpy(data, &value16, sizeof(uint16_t));
+    value16 = hal.stream.get_rx_buffer_available();
+    memcpy(&data[2], &value16, sizeof(uint16_t));
+    binary_field(BinaryField_Buffer, data, 4);
+
+    spindle_state_t sp_state = hal.spindle.get_state();
+
+    value = st_get_realtime_rate();
+    memcpy(data, &value, sizeof(float));
+    value = sp_state.on ? sys.spindle_rpm : 0.0f;
+    memcpy(&data[4], &value, sizeof(float));
+    if(hal.spindle.get_data) {
+        value = hal.spindle.get_data(SpindleData_RPM).rpm;
+        memcpy(&data[8], &value, sizeof(float));
+    }
+    binary_field(BinaryField_FeedSpindle, data, hal.spindle.get_data ? 12 : 8);
+
+    data[0] = sys.override.feed_rate;
+    data[1] = sys.override.rapid_rate;
+    data[2] = sys.override.spindle_rpm;
+    binary_field(BinaryField_Overrides, data, 3);
+
+    data[0] = hal.limits.get_state().value;
+    value16 = hal.control.get_state().value;
+    memcpy(&data[1], &value16, sizeof(uint16_t));
+    data[3] = (probe_state.triggered ? bit(0) : 0) | (probe_state.connected ? 0 : bit(1));
+    binary_field(BinaryField_Pins, data, 4);
+
+    plan_block_t *cur_block = plan_get_current_block();
+    if (cur_block != NULL && cur_block->line_number > 0)
+        binary_field(BinaryField_LineNumber, &cur_block->line_number, sizeof(int32_t));
+
+    data[0] = sp_state.value;
+    data[1] = hal.coolant.get_state().value;
+    value32 = gc_state.tool->tool;
+    memcpy(&data[2], &value32, sizeof(uint32_t));
+    binary_field(BinaryField_Accessories, data, 6);
+
+    if(grbl.on_realtime_report_binary)
+        grbl.on_realtime_report_binary(binary_field, sys.report);
+
+    value16 = binary_crc;
+    binary_write(value16 & 0xFF);
+    binary_write(value16 >> 8);
+
+    status_write(frame_flag);
+    status_flush();
+}
+
+#endif
+
 
 void report_pid_log (void)
 {
@@ -1409,3 +2089,17 @@ void report_pid_log (void)
     grbl.report.status_message(Status_GcodeUnsupportedCommand);
 #endif
 }
+
+#ifdef REPORT_TIMESTAMP
+
+uint32_t report_get_timestamp (void)
+{
+    return hal.get_micros ? hal.get_micros() : (hal.get_elapsed_ticks ? hal.get_elapsed_ticks() * 1000 : 0);
+}
+
+void report_timestamp (uint32_t us)
+{
+    hal.stream.write_all(appendbuf(3, "[TS:", uitoa(us), "]" ASCII_EOL));
+}
+
+#endif
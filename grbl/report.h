@@ -56,6 +56,7 @@ void report_grbl_help();
 
 // Prints Grbl setting(s)
 void report_grbl_settings (bool all);
+bool report_settings (bool all, bool yield);
 void report_uint_setting (setting_type_t n, uint32_t val);
 void report_float_setting (setting_type_t n, float val, uint8_t n_decimal);
 void report_string_setting (setting_type_t n, char *val);
@@ -66,6 +67,36 @@ void report_echo_line_received (char *line);
 // Prints realtime status report.
 void report_realtime_status (void);
 
+// Minimum auto report interval and minimum time between reports triggered by state changes, in milliseconds.
+#define AUTO_REPORT_INTERVAL_MIN 10
+
+// Requests a realtime status report when due, called from the realtime loop when auto reporting is enabled by $396.
+void report_auto_status (void);
+
+#ifdef ENABLE_BINARY_STATUS_REPORT
+
+#define BINARY_STATUS_VERSION 1
+
+// Binary status frame field types, data is listed in order.
+typedef enum {
+    BinaryField_State = 0x01,       // uint16_t state, uint8_t substate (hold, alarm or door code as in the text report, 1 if feed hold is pending in cycle)
+    BinaryField_Position = 0x02,    // int32_t[N_AXIS] machine position in steps
+    BinaryField_WCO = 0x03,         // float[N_AXIS] work coordinate offset in mm, including tool length offset
+    BinaryField_Buffer = 0x04,      // uint16_t planner blocks available, uint16_t input stream characters available
+    BinaryField_FeedSpindle = 0x05, // float feed rate in mm/min, float programmed spindle RPM, optional float actual spindle RPM
+    BinaryField_Overrides = 0x06,   // uint8_t feed, rapid and spindle override in percent
+    BinaryField_Pins = 0x07,        // uint8_t limit pins (axes_signals_t), uint16_t control pins (control_signals_t), uint8_t probe: bit 0 triggered, bit 1 not connected
+    BinaryField_LineNumber = 0x08,  // int32_t line number of executing block
+    BinaryField_Accessories = 0x09, // uint8_t spindle state (spindle_state_t), uint8_t coolant state (coolant_state_t), uint32_t tool number
+    BinaryField_Timestamp = 0x0A,   // uint32_t microseconds when the position was sampled, only when REPORT_TIMESTAMP is enabled
+    BinaryField_User = 0x80         // First field type available for plugins and drivers
+} binary_field_t;
+
+// Prints realtime status report as a binary frame.
+void report_realtime_status_binary (void);
+
+#endif
+
 // Prints recorded probe position.
 void report_probe_parameters (void);
 
@@ -85,7 +116,24 @@ void report_execute_startup_message (char *line, status_code_t status_code);
 // Prints build info and user info.
 void report_build_info (char *line);
 
+// Prints stepper instrumentation data
+void report_stepper_stats (void);
+
+// Prints the sizes of the stream, planner and step segment buffers followed by the memory usage
+void report_buffer_sizes (void);
+
+// Prints memory usage
+void report_memory_usage (void);
+
 // Prints current PID log.
 void report_pid_log (void);
 
+#ifdef REPORT_TIMESTAMP
+// Returns the microsecond timestamp for reports.
+uint32_t report_get_timestamp (void);
+
+// Prints the timestamp captured by the CMD_TIMESTAMP realtime command.
+void report_timestamp (uint32_t us);
+#endif
+
 #endif
@@ -0,0 +1,307 @@
+/*
+  rtcp.c - five axis tool center point kinematics for table-table (trunnion) machines
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef RTCP_TRUNNION
+
+#include <math.h>
+#include <string.h>
+
+#include "settings.h"
+#include "planner.h"
+#include "kinematics.h"
+
+// The program is in tool tip coordinates in the workpiece frame, the frame of the machine with both rotary axes at 0.
+// The rotary table (RTCP_ROTARY_AXIS) rotates about Z and is mounted on the tilting table (RTCP_TILT_AXIS) which rotates
+// about X, or about Y if RTCP_TILT_ABOUT_Y is set. The rotation axes intersect at the pivot point, $385 - $387 in
+// machine coordinates. Positive angles rotate the tables counterclockwise viewed from the positive end of their axis.
+
+#if N_AXIS < 5
+#error "RTCP kinematics requires N_AXIS to be 5 or 6!"
+#endif
+
+#ifndef RTCP_TILT_AXIS
+#define RTCP_TILT_AXIS A_AXIS
+#endif
+#ifndef RTCP_ROTARY_AXIS
+#if N_AXIS == 6
+#define RTCP_ROTARY_AXIS C_AXIS
+#else
+#define RTCP_ROTARY_AXIS B_AXIS
+#endif
+#endif
+#ifndef RTCP_TILT_ABOUT_Y
+#define RTCP_TILT_ABOUT_Y 0
+#endif
+
+#if RTCP_TILT_AXIS <= Z_AXIS || RTCP_ROTARY_AXIS <= Z_AXIS || RTCP_TILT_AXIS == RTCP_ROTARY_AXIS
+#error "RTCP tilt and rotary axes must be two different rotary axes!"
+#endif
+
+typedef struct {
+    float angle;    // Degrees
+    float sin;
+    float cos;
+} rtcp_trig_t;
+
+// Trig values of the angles last transformed, updated incrementally by line segmentation.
+static THREAD_LOCAL rtcp_trig_t tilt = { .cos = 1.0f }, rotary = { .cos = 1.0f };
+
+static inline void rtcp_trig_set (rtcp_trig_t *trig, float angle)
+{
+    if(angle != trig->angle) {
+        trig->angle = angle;
+        trig->sin = sinf(angle * RADDEG);
+        trig->cos = cosf(angle * RADDEG);
+    }
+}
+
+// Advances the angle by the step without calling the trig functions, sin(a + b) = sin a cos b + cos a sin b etc.
+static inline void rtcp_trig_advance (rtcp_trig_t *trig, const rtcp_trig_t *step, float angle)
+{
+    float sin = trig->sin;
+
+    trig->angle = angle;
+    trig->sin = sin * step->cos + trig->cos * step->sin;
+    trig->cos = trig->cos * step->cos - sin * step->sin;
+}
+
+// Rotates the XYZ position about the pivot point, the table rotation is applied first.
+// Inverse kinematics when sin_sign is 1, forward kinematics when -1 and the rotations are applied in reverse order.
+static void rtcp_rotate (float *position, const rtcp_trig_t *t, const rtcp_trig_t *r, float sin_sign)
+{
+    float x = position[X_AXIS] - settings.rtcp.pivot[X_AXIS],
+          y = position[Y_AXIS] - settings.rtcp.pivot[Y_AXIS],
+          z = position[Z_AXIS] - settings.rtcp.pivot[Z_AXIS],
+          tsin = t->sin * sin_sign, rsin = r->sin * sin_sign, tmp;
+
+    if(sin_sign > 0.0f) {
+        tmp = x * r->cos - y * rsin;
+        y = x * rsin + y * r->cos;
+        x = tmp;
+    }
+
+#if RTCP_TILT_ABOUT_Y
+    tmp = x * t->cos + z * tsin;
+    z = z * t->cos - x * tsin;
+    x = tmp;
+#else
+    tmp = y * t->cos - z * tsin;
+    z = y * tsin + z * t->cos;
+    y = tmp;
+#endif
+
+    if(sin_sign < 0.0f) {
+        tmp = x * r->cos - y * rsin;
+        y = x * rsin + y * r->cos;
+        x = tmp;
+    }
+
+    position[X_AXIS] = x + settings.rtcp.pivot[X_AXIS];
+    position[Y_AXIS] = y + settings.rtcp.pivot[Y_AXIS];
+    position[Z_AXIS] = z + settings.rtcp.pivot[Z_AXIS];
+}
+
+// Returns tool tip position in the workpiece frame converted from system position steps.
+static void rtcp_convert_array_steps_to_mpos (float *position, int32_t *steps)
+{
+    uint_fast8_t idx = N_AXIS;
+    rtcp_trig_t t, r;
+
+    do {
+        idx--;
+        position[idx] = steps[idx] * mm_per_step[idx];
+    } while(idx);
+
+    t.sin = sinf(position[RTCP_TILT_AXIS] * RADDEG);
+    t.cos = cosf(position[RTCP_TILT_AXIS] * RADDEG);
+    r.sin = sinf(position[RTCP_ROTARY_AXIS] * RADDEG);
+    r.cos = cosf(position[RTCP_ROTARY_AXIS] * RADDEG);
+
+    rtcp_rotate(position, &t, &r, -1.0f);
+}
+
+// Transform tool tip position in the workpiece frame (mm) to machine position (step)
+static void rtcp_plan_target_to_steps (int32_t *target_steps, float *target)
+{
+    uint_fast8_t idx = N_AXIS;
+    float position[3];
+
+    memcpy(position, target, sizeof(position));
+
+    rtcp_trig_set(&tilt, target[RTCP_TILT_AXIS]);
+    rtcp_trig_set(&rotary, target[RTCP_ROTARY_AXIS]);
+    rtcp_rotate(position, &tilt, &rotary, 1.0f);
+
+    do {
+        idx--;
+        target_steps[idx] = lroundf((idx <= Z_AXIS ? position[idx] : target[idx]) * settings.axis[idx].steps_per_mm);
+    } while(idx);
+}
+
+static inline float rtcp_pivot_distance (const float *position)
+{
+    float x = position[X_AXIS] - settings.rtcp.pivot[X_AXIS],
+          y = position[Y_AXIS] - settings.rtcp.pivot[Y_AXIS],
+          z = position[Z_AXIS] - settings.rtcp.pivot[Z_AXIS];
+
+    return sqrtf(x * x + y * y + z * z);
+}
+
+// Moves with rotary motion are divided into segments with rotation small enough for the chord error, at the largest
+// distance of the tool tip from the pivot point, to be within the arc tolerance. Moves without rotary motion are
+// not segmented as the transformation then is linear. The feed rate of each segment is scaled by the ratio of the
+// machine distance to the tool tip distance so that the programmed feed rate is the tool tip feed rate, for pure
+// rotations the programmed feed rate is for the rotary axes.
+static bool rtcp_segment_line (float *target, plan_line_data_t *pl_data, bool init)
+{
+    static THREAD_LOCAL uint_fast16_t iterations;
+    static THREAD_LOCAL bool segmented, scale_feed;
+    static THREAD_LOCAL float feed_rate, distance, delta[N_AXIS], segment_target[N_AXIS], final_target[N_AXIS], machine_prev[3];
+    static THREAD_LOCAL rtcp_trig_t tilt_step, rotary_step;
+
+    uint_fast8_t idx = N_AXIS;
+
+    if(init) {
+
+        float rotation;
+
+        plan_get_planner_mpos(segment_target);
+
+        do {
+            idx--;
+            delta[idx] = target[idx] - segment_target[idx];
+        } while(idx);
+
+        iterations = 1;
+        rotation = (fabsf(delta[RTCP_TILT_AXIS]) + fabsf(delta[RTCP_ROTARY_AXIS])) * RADDEG;
+
+        // Less than half a step of rotation is a move without rotary motion, the start angles are from step positions.
+        if((segmented = fabsf(delta[RTCP_TILT_AXIS]) >= 0.5f * mm_per_step[RTCP_TILT_AXIS] ||
+                         fabsf(delta[RTCP_ROTARY_AXIS]) >= 0.5f * mm_per_step[RTCP_ROTARY_AXIS])) {
+
+            float radius = max(rtcp_pivot_distance(segment_target), rtcp_pivot_distance(target));
+
+            if(radius > 0.0f)
+                iterations = (uint_fast16_t)min(ceilf(rotation / sqrtf(8.0f * settings.arc_tolerance / radius)), 65534.0f);
+
+            idx = N_AXIS;
+            do {
+                idx--;
+                delta[idx] /= (float)iterations;
+            } while(idx);
+
+            memcpy(final_target, target, sizeof(final_target));
+
+            feed_rate = pl_data->feed_rate;
+            if(pl_data->condition.inverse_time)
+                pl_data->feed_rate *= (float)iterations;
+
+            if((scale_feed = !(pl_data->condition.rapid_motion || pl_data->condition.inverse_time))) {
+                distance = sqrtf(delta[X_AXIS] * delta[X_AXIS] + delta[Y_AXIS] * delta[Y_AXIS] + delta[Z_AXIS] * delta[Z_AXIS]);
+                if(distance * (float)iterations < 0.5f * mm_per_step[X_AXIS]) // No tool tip motion
+                    distance = sqrtf(delta[RTCP_TILT_AXIS] * delta[RTCP_TILT_AXIS] + delta[RTCP_ROTARY_AXIS] * delta[RTCP_ROTARY_AXIS]);
+            }
+
+            rtcp_trig_set(&tilt, segment_target[RTCP_TILT_AXIS]);
+            rtcp_trig_set(&rotary, segment_target[RTCP_ROTARY_AXIS]);
+            tilt_step.sin = sinf(delta[RTCP_TILT_AXIS] * RADDEG);
+            tilt_step.cos = cosf(delta[RTCP_TILT_AXIS] * RADDEG);
+            rotary_step.sin = sinf(delta[RTCP_ROTARY_AXIS] * RADDEG);
+            rotary_step.cos = cosf(delta[RTCP_ROTARY_AXIS] * RADDEG);
+
+            memcpy(machine_prev, segment_target, sizeof(machine_prev));
+            rtcp_rotate(machine_prev, &tilt, &rotary, 1.0f);
+        }
+
+        iterations++; // return at least one iteration
+
+    } else {
+
+        iterations--;
+
+        if(segmented) {
+
+            if(iterations == 0) // Move completed, restore programmed feed rate for the next move, e.g. an arc segment
+                pl_data->feed_rate = feed_rate;
+
+            else {
+
+                if(iterations == 1) // Last segment ends exactly at the target
+                    memcpy(target, final_target, sizeof(final_target));
+                else {
+                    do {
+                        idx--;
+                        target[idx] = segment_target[idx] += delta[idx];
+                    } while(idx);
+                    rtcp_trig_advance(&tilt, &tilt_step, target[RTCP_TILT_AXIS]);
+                    rtcp_trig_advance(&rotary, &rotary_step, target[RTCP_ROTARY_AXIS]);
+                }
+
+                if(scale_feed) {
+
+                    float machine[3], length = 0.0f;
+
+                    memcpy(machine, target, sizeof(machine));
+                    rtcp_trig_set(&tilt, target[RTCP_TILT_AXIS]);
+                    rtcp_trig_set(&rotary, target[RTCP_ROTARY_AXIS]);
+                    rtcp_rotate(machine, &tilt, &rotary, 1.0f);
+
+                    idx = N_AXIS;
+                    do {
+                        idx--;
+                        length += idx <= Z_AXIS
+                                   ? (machine[idx] - machine_prev[idx]) * (machine[idx] - machine_prev[idx])
+                                   : delta[idx] * delta[idx];
+                    } while(idx);
+
+                    memcpy(machine_prev, machine, sizeof(machine_prev));
+                    pl_data->feed_rate = feed_rate * sqrtf(length) / distance;
+                }
+            }
+        }
+    }
+
+    return iterations != 0;
+}
+
+// Initialize API pointers for RTCP kinematics
+static void rtcp_kinematics_init (void)
+{
+    kinematics.plan_target_to_steps = rtcp_plan_target_to_steps;
+    kinematics.convert_array_steps_to_mpos = rtcp_convert_array_steps_to_mpos;
+    kinematics.segment_line = rtcp_segment_line;
+}
+
+static kinematics_entry_t rtcp = {
+    .type = Kinematics_RTCP,
+    .name = "RTCP trunnion",
+    .init = rtcp_kinematics_init
+};
+
+// Add RTCP trunnion kinematics to the kinematics registry
+void rtcp_init (void)
+{
+    kinematics_register(&rtcp);
+}
+
+#endif
@@ -23,6 +23,7 @@
 
 #include <math.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
@@ -32,6 +33,9 @@
 #include "limits.h"
 #include "nvs_buffer.h"
 #include "tool_change.h"
+#ifdef KINEMATICS_API
+#include "kinematics.h"
+#endif
 
 #ifdef ENABLE_SPINDLE_LINEARIZATION
 #include <stdio.h>
@@ -53,7 +57,15 @@
 #define SETTINGS_RESTORE_DRIVER_PARAMETERS 1
 #endif
 
-settings_t settings;
+THREAD_LOCAL settings_t settings;
+THREAD_LOCAL float mm_per_step[N_AXIS];
+
+// RAM copy of the coordinate data, loaded on first read and written through to non-volatile storage.
+// Reads of already loaded data, e.g. by $# and WCS changes, does not access non-volatile storage.
+static THREAD_LOCAL struct {
+    uint32_t loaded; // Bitmask of coordinate systems loaded
+    coord_data_t data[N_CoordinateSystems];
+} coord_cache = {0};
 
 const settings_restore_t settings_all = {
     .defaults          = SETTINGS_RESTORE_DEFAULTS,
@@ -70,6 +82,26 @@ const settings_t defaults = {
     .junction_deviation = DEFAULT_JUNCTION_DEVIATION,
     .arc_tolerance = DEFAULT_ARC_TOLERANCE,
     .g73_retract = DEFAULT_G73_RETRACT,
+    .planner_buffer_blocks = DEFAULT_PLANNER_BUFFER_BLOCKS,
+    .segment_buffer_size = DEFAULT_SEGMENT_BUFFER_SIZE,
+    .kinematics = DEFAULT_KINEMATICS,
+    .auto_report_interval = DEFAULT_AUTO_REPORT_INTERVAL,
+#ifdef ENABLE_INPUT_SHAPING
+    .input_shaper.type = DEFAULT_INPUT_SHAPER_TYPE,
+    .input_shaper.frequency[0] = DEFAULT_INPUT_SHAPER_FREQUENCY,
+    .input_shaper.frequency[1] = DEFAULT_INPUT_SHAPER_FREQUENCY2,
+    .input_shaper.damping = DEFAULT_INPUT_SHAPER_DAMPING,
+#endif
+    .probe_retract = DEFAULT_PROBE_RETRACT,
+    .probe_locate_feed_rate = DEFAULT_PROBE_LOCATE_FEED_RATE,
+#ifdef RTCP_TRUNNION
+    .rtcp.pivot[X_AXIS] = DEFAULT_RTCP_PIVOT_X,
+    .rtcp.pivot[Y_AXIS] = DEFAULT_RTCP_PIVOT_Y,
+    .rtcp.pivot[Z_AXIS] = DEFAULT_RTCP_PIVOT_Z,
+#endif
+#ifdef ENABLE_LASER_RASTER
+    .raster_overscan = DEFAULT_LASER_RASTER_OVERSCAN,
+#endif
 
     .flags.legacy_rt_commands = DEFAULT_LEGACY_RTCOMMANDS,
     .flags.report_inches = DEFAULT_REPORT_INCHES,
@@ -181,12 +213,20 @@ const settings_t defaults = {
     .axis[X_AXIS].max_travel = (-DEFAULT_X_MAX_TRAVEL),
     .axis[Y_AXIS].max_travel = (-DEFAULT_Y_MAX_TRAVEL),
     .axis[Z_AXIS].max_travel = (-DEFAULT_Z_MAX_TRAVEL),
+#ifdef ENABLE_JERK_ACCELERATION
+    .axis[X_AXIS].jerk = DEFAULT_X_JERK,
+    .axis[Y_AXIS].jerk = DEFAULT_Y_JERK,
+    .axis[Z_AXIS].jerk = DEFAULT_Z_JERK,
+#endif
 
   #ifdef A_AXIS
     .axis[A_AXIS].steps_per_mm = DEFAULT_A_STEPS_PER_MM,
     .axis[A_AXIS].max_rate = DEFAULT_A_MAX_RATE,
     .axis[A_AXIS].acceleration = DEFAULT_A_ACCELERATION,
     .axis[A_AXIS].max_travel = (-DEFAULT_A_MAX_TRAVEL),
+   #ifdef ENABLE_JERK_ACCELERATION
+    .axis[A_AXIS].jerk = DEFAULT_A_JERK,
+   #endif
     .homing.cycle[3].mask = HOMING_CYCLE_3,
   #endif
   #ifdef B_AXIS
@@ -194,6 +234,9 @@ const settings_t defaults = {
     .axis[B_AXIS].max_rate = DEFAULT_B_MAX_RATE,
     .axis[B_AXIS].acceleration = DEFAULT_B_ACCELERATION,
     .axis[B_AXIS].max_travel = (-DEFAULT_B_MAX_TRAVEL),
+   #ifdef ENABLE_JERK_ACCELERATION
+    .axis[B_AXIS].jerk = DEFAULT_B_JERK,
+   #endif
     .homing.cycle[4].mask = HOMING_CYCLE_4,
   #endif
   #ifdef C_AXIS
@@ -201,6 +244,9 @@ const settings_t defaults = {
     .axis[C_AXIS].acceleration = DEFAULT_C_ACCELERATION,
     .axis[C_AXIS].max_rate = DEFAULT_C_MAX_RATE,
     .axis[C_AXIS].max_travel = (-DEFAULT_C_MAX_TRAVEL),
+   #ifdef ENABLE_JERK_ACCELERATION
+    .axis[C_AXIS].jerk = DEFAULT_C_JERK,
+   #endif
     .homing.cycle[5].mask = HOMING_CYCLE_5,
   #endif
 
@@ -268,20 +314,33 @@ bool settings_read_startup_line (uint8_t idx, char *line)
 // Write selected coordinate data to persistent storage.
 void settings_write_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS])
 {
-    assert(id <= N_CoordinateSystems);
+    assert(id < N_CoordinateSystems);
+
+    if(hal.nvs.type == NVS_None)
+        return;
+
+    if(bit_istrue(coord_cache.loaded, bit(id)) && isequal_position_vector(&coord_cache.data[id], coord_data))
+        return; // Unchanged
 
 #ifdef FORCE_BUFFER_SYNC_DURING_NVS_WRITE
     protocol_buffer_synchronize();
 #endif
 
-    if(hal.nvs.type != NVS_None)
-        hal.nvs.memcpy_to_nvs(NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), (uint8_t *)coord_data, sizeof(coord_data_t), true);
+    memcpy(&coord_cache.data[id], coord_data, sizeof(coord_data_t));
+    bit_true(coord_cache.loaded, bit(id));
+
+    hal.nvs.memcpy_to_nvs(NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), (uint8_t *)coord_data, sizeof(coord_data_t), true);
 }
 
 // Read selected coordinate data from persistent storage.
 bool settings_read_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS])
 {
-    assert(id <= N_CoordinateSystems);
+    assert(id < N_CoordinateSystems);
+
+    if(bit_istrue(coord_cache.loaded, bit(id))) {
+        memcpy(coord_data, &coord_cache.data[id], sizeof(coord_data_t));
+        return true;
+    }
 
     if (!(hal.nvs.type != NVS_None && hal.nvs.memcpy_from_nvs((uint8_t *)coord_data, NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), sizeof(coord_data_t), true) == NVS_TransferResult_OK)) {
         // Reset with default zero vector
@@ -289,6 +348,10 @@ bool settings_read_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS]
         settings_write_coord_data(id, coord_data);
         return false;
     }
+
+    memcpy(&coord_cache.data[id], coord_data, sizeof(coord_data_t));
+    bit_true(coord_cache.loaded, bit(id));
+
     return true;
 }
 
@@ -326,6 +389,17 @@ bool settings_read_tool_data (uint32_t tool, tool_data_t *tool_data)
 
 // Read Grbl global settings from persistent storage.
 // Checks version-byte of non-volatile storage and global settings copy.
+// Recalculates the steps per mm reciprocals.
+static void update_mm_per_step (void)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        mm_per_step[idx] = 1.0f / settings.axis[idx].steps_per_mm;
+    } while(idx);
+}
+
 bool read_global_settings ()
 {
     bool ok = hal.nvs.type != NVS_None && SETTINGS_VERSION == hal.nvs.get_byte(0) && hal.nvs.memcpy_from_nvs((uint8_t *)&settings, NVS_ADDR_GLOBAL, sizeof(settings_t), true) == NVS_TransferResult_OK;
@@ -355,6 +429,7 @@ void settings_restore (settings_restore_t restore)
 
     if (restore.defaults) {
         memcpy(&settings, &defaults, sizeof(settings_t));
+        update_mm_per_step();
 
         settings.control_invert.block_delete &= hal.driver_cap.block_delete;
         settings.control_invert.e_stop &= hal.driver_cap.e_stop;
@@ -403,13 +478,195 @@ void settings_restore (settings_restore_t restore)
     nvs_buffer_sync_physical();
 }
 
+#ifdef SPINDLE_RPM_CONTROLLED
+static bool is_spindle_pid (void)
+{
+    return hal.driver_cap.spindle_pid;
+}
+#endif
+
+static bool is_spindle_sync (void)
+{
+    return hal.driver_cap.spindle_sync;
+}
+
+static bool is_spindle_encoder (void)
+{
+    return hal.driver_cap.spindle_sync || hal.driver_cap.spindle_pid;
+}
+
+static bool is_spindle_at_speed (void)
+{
+    return hal.driver_cap.spindle_at_speed;
+}
+
+static bool is_tool_change (void)
+{
+    return !hal.driver_cap.atc && hal.stream.suspend_read;
+}
+
+static bool is_ioport_in (void)
+{
+    return hal.port.num_digital_in > 0;
+}
+
+static bool is_ioport_out (void)
+{
+    return hal.port.num_digital_out > 0;
+}
+
+#define SETTING_FIELD(field) sizeof(((settings_t *)0)->field), offsetof(settings_t, field)
+
+// Settings stored without conversion, in ascending id order.
+// Used by $$ and $x=, settings with side effects or derived values are handled in settings_store_global_setting() and report.c.
+static const setting_detail_t setting_detail[] = {
+    { Setting_StepperIdleLockTime, SettingFormat_Integer, SETTING_FIELD(steppers.idle_lock_time), 0, false, 0.0f, 0.0f, NULL },
+    { Setting_StepInvertMask, SettingFormat_AxisMask, SETTING_FIELD(steppers.step_invert), 0, false, 0.0f, 0.0f, NULL },
+    { Setting_DirInvertMask, SettingFormat_AxisMask, SETTING_FIELD(steppers.dir_invert), 0, false, 0.0f, 0.0f, NULL },
+    { Setting_InvertStepperEnable, SettingFormat_AxisMask, SETTING_FIELD(steppers.enable_invert), 0, false, 0.0f, 0.0f, NULL },
+    { Setting_LimitPinsInvertMask, SettingFormat_AxisMask, SETTING_FIELD(limits.invert), 0, false, 0.0f, 0.0f, NULL },
+    { Setting_JunctionDeviation, SettingFormat_Float, SETTING_FIELD(junction_deviation), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, NULL },
+    { Setting_ArcTolerance, SettingFormat_Float, SETTING_FIELD(arc_tolerance), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, NULL },
+    { Setting_CoolantInvertMask, SettingFormat_Integer, SETTING_FIELD(coolant_invert), 0, true, 0.0f, 0.0f, NULL },
+    { Setting_LimitPullUpDisableMask, SettingFormat_Integer, SETTING_FIELD(limits.disable_pullup), 0, true, 0.0f, 0.0f, NULL },
+    { Setting_HomingDirMask, SettingFormat_AxisMask, SETTING_FIELD(homing.dir_mask), 0, false, 0.0f, 0.0f, NULL },
+    { Setting_HomingFeedRate, SettingFormat_Float, SETTING_FIELD(homing.feed_rate), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, NULL },
+    { Setting_HomingSeekRate, SettingFormat_Float, SETTING_FIELD(homing.seek_rate), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, NULL },
+    { Setting_HomingDebounceDelay, SettingFormat_Integer, SETTING_FIELD(homing.debounce_delay), 0, false, 0.0f, 0.0f, NULL },
+    { Setting_HomingPulloff, SettingFormat_Float, SETTING_FIELD(homing.pulloff), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, NULL },
+    { Setting_G73Retract, SettingFormat_Float, SETTING_FIELD(g73_retract), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_RpmMax, SettingFormat_Float, SETTING_FIELD(spindle.rpm_max), N_DECIMAL_RPMVALUE, false, 0.0f, 0.0f, NULL },
+    { Setting_RpmMin, SettingFormat_Float, SETTING_FIELD(spindle.rpm_min), N_DECIMAL_RPMVALUE, false, 0.0f, 0.0f, NULL },
+    { Setting_PWMFreq, SettingFormat_Float, SETTING_FIELD(spindle.pwm_freq), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_PWMOffValue, SettingFormat_Float, SETTING_FIELD(spindle.pwm_off_value), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_PWMMinValue, SettingFormat_Float, SETTING_FIELD(spindle.pwm_min_value), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_PWMMaxValue, SettingFormat_Float, SETTING_FIELD(spindle.pwm_max_value), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_StepperDeenergizeMask, SettingFormat_AxisMask, SETTING_FIELD(steppers.deenergize), 0, true, 0.0f, 0.0f, NULL },
+    { Setting_SpindlePPR, SettingFormat_Integer, SETTING_FIELD(spindle.ppr), 0, true, 0.0f, 0.0f, is_spindle_encoder },
+    { Setting_ParkingAxis, SettingFormat_Integer, SETTING_FIELD(parking.axis), 0, true, 0.0f, (float)(N_AXIS - 1), NULL },
+    { Setting_ParkingPulloutIncrement, SettingFormat_Float, SETTING_FIELD(parking.pullout_increment), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_ParkingPulloutRate, SettingFormat_Float, SETTING_FIELD(parking.pullout_rate), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_ParkingTarget, SettingFormat_Float, SETTING_FIELD(parking.target), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_ParkingFastRate, SettingFormat_Float, SETTING_FIELD(parking.rate), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+#ifdef SPINDLE_RPM_CONTROLLED
+    { Setting_SpindlePGain, SettingFormat_Float, SETTING_FIELD(spindle.pid.p_gain), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_pid },
+    { Setting_SpindleIGain, SettingFormat_Float, SETTING_FIELD(spindle.pid.i_gain), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_pid },
+    { Setting_SpindleDGain, SettingFormat_Float, SETTING_FIELD(spindle.pid.d_gain), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_pid },
+    { Setting_SpindleMaxError, SettingFormat_Float, SETTING_FIELD(spindle.pid.max_error), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_pid },
+    { Setting_SpindleIMaxError, SettingFormat_Float, SETTING_FIELD(spindle.pid.i_max_error), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_pid },
+#endif
+    { Setting_PositionPGain, SettingFormat_Float, SETTING_FIELD(position.pid.p_gain), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_sync },
+    { Setting_PositionIGain, SettingFormat_Float, SETTING_FIELD(position.pid.i_gain), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_sync },
+    { Setting_PositionDGain, SettingFormat_Float, SETTING_FIELD(position.pid.d_gain), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_sync },
+    { Setting_PositionIMaxError, SettingFormat_Float, SETTING_FIELD(position.pid.i_max_error), N_DECIMAL_SETTINGVALUE, false, 0.0f, 0.0f, is_spindle_sync },
+    { Setting_SpindleAtSpeedTolerance, SettingFormat_Float, SETTING_FIELD(spindle.at_speed_tolerance), 1, true, 0.0f, 0.0f, is_spindle_at_speed },
+    { Setting_ToolChangeProbingDistance, SettingFormat_Float, SETTING_FIELD(tool_change.probing_distance), 1, true, 0.0f, 0.0f, is_tool_change },
+    { Setting_ToolChangeFeedRate, SettingFormat_Float, SETTING_FIELD(tool_change.feed_rate), 1, true, 0.0f, 0.0f, is_tool_change },
+    { Setting_ToolChangeSeekRate, SettingFormat_Float, SETTING_FIELD(tool_change.seek_rate), 1, true, 0.0f, 0.0f, is_tool_change },
+    { Settings_IoPort_InvertIn, SettingFormat_Integer, SETTING_FIELD(ioport.invert_in), 0, true, 0.0f, 0.0f, is_ioport_in },
+    { Settings_IoPort_Pullup_Disable, SettingFormat_Integer, SETTING_FIELD(ioport.pullup_disable_in), 0, true, 0.0f, 0.0f, is_ioport_in },
+    { Settings_IoPort_InvertOut, SettingFormat_Integer, SETTING_FIELD(ioport.invert_out), 0, true, 0.0f, 0.0f, is_ioport_out },
+    { Settings_IoPort_OD_Enable, SettingFormat_Integer, SETTING_FIELD(ioport.od_enable_out), 0, true, 0.0f, 0.0f, is_ioport_out },
+#ifdef RTCP_TRUNNION
+    { Setting_RTCP_PivotX, SettingFormat_Float, SETTING_FIELD(rtcp.pivot[X_AXIS]), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_RTCP_PivotY, SettingFormat_Float, SETTING_FIELD(rtcp.pivot[Y_AXIS]), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+    { Setting_RTCP_PivotZ, SettingFormat_Float, SETTING_FIELD(rtcp.pivot[Z_AXIS]), N_DECIMAL_SETTINGVALUE, true, 0.0f, 0.0f, NULL },
+#endif
+#ifdef ENABLE_LASER_RASTER
+    { Setting_LaserRasterOverscan, SettingFormat_Float, SETTING_FIELD(raster_overscan), 2, true, 0.0f, 10.0f, NULL },
+#endif
+    { Setting_SegmentBufferSize, SettingFormat_Integer, SETTING_FIELD(segment_buffer_size), 0, true, (float)SEGMENT_BUFFER_SIZE_MIN, (float)SEGMENT_BUFFER_SIZE_MAX, NULL }, // NOTE: takes effect after a hard reset.
+#ifdef ENABLE_INPUT_SHAPING
+    { Setting_InputShaperType, SettingFormat_Integer, SETTING_FIELD(input_shaper.type), 0, true, 0.0f, (float)InputShaper_EI, NULL },
+    { Setting_InputShaperFrequency, SettingFormat_Float, SETTING_FIELD(input_shaper.frequency[0]), 1, true, 1.0f, 500.0f, NULL },
+    { Setting_InputShaperFrequency2, SettingFormat_Float, SETTING_FIELD(input_shaper.frequency[1]), 1, true, 0.0f, 500.0f, NULL },
+    { Setting_InputShaperDamping, SettingFormat_Float, SETTING_FIELD(input_shaper.damping), 3, true, 0.0f, 0.5f, NULL },
+#endif
+    { Setting_ProbeRetract, SettingFormat_Float, SETTING_FIELD(probe_retract), 1, true, 0.0f, 0.0f, NULL },
+    { Setting_ProbeLocateFeedRate, SettingFormat_Float, SETTING_FIELD(probe_locate_feed_rate), 1, true, 0.0f, 0.0f, NULL },
+    { Setting_PlannerBlocks, SettingFormat_Integer, SETTING_FIELD(planner_buffer_blocks), 0, true, (float)PLANNER_BUFFER_BLOCKS_MIN, (float)PLANNER_BUFFER_BLOCKS_MAX, NULL } // NOTE: takes effect after a hard reset.
+};
+
+const setting_detail_t *settings_get_details (setting_type_t setting)
+{
+    uint_fast16_t idx = 0;
+
+    while(idx < sizeof(setting_detail) / sizeof(setting_detail_t) && setting_detail[idx].id < setting)
+        idx++;
+
+    return idx < sizeof(setting_detail) / sizeof(setting_detail_t) && setting_detail[idx].id == setting ? &setting_detail[idx] : NULL;
+}
+
+float settings_get_value (const setting_detail_t *setting)
+{
+    uint8_t *field = (uint8_t *)&settings + setting->offset;
+
+    if(setting->format == SettingFormat_Float)
+        return *(float *)field;
+
+    return setting->size == 1 ? (float)*field : (setting->size == 2 ? (float)*(uint16_t *)field : (float)*(uint32_t *)field);
+}
+
+static status_code_t store_setting (const setting_detail_t *setting, float value)
+{
+    uint8_t *field = (uint8_t *)&settings + setting->offset;
+
+    if(setting->is_available && !setting->is_available())
+        return Status_SettingDisabled;
+
+    if(setting->min < setting->max && (value < setting->min || value > setting->max))
+        return Status_InvalidStatement;
+
+    if(setting->format == SettingFormat_Float)
+        *(float *)field = value;
+    else {
+        uint32_t int_value = (uint32_t)truncf(value);
+        if(setting->format == SettingFormat_AxisMask)
+            int_value &= AXES_BITMASK;
+        switch(setting->size) {
+            case 1:
+                *field = (uint8_t)int_value;
+                break;
+            case 2:
+                *(uint16_t *)field = (uint16_t)int_value;
+                break;
+            default:
+                *(uint32_t *)field = int_value;
+                break;
+        }
+    }
+
+    return Status_OK;
+}
+
+// Bulk settings transaction state, see settings_begin_transaction().
+static struct {
+    bool active;
+    bool changed;           // Global settings changed
+    bool driver_changed;    // Driver settings changed
+    bool imported;          // Settings image data received
+} transaction = {0};
+
+// Updates derived data and reconfigures the driver after global settings has been changed.
+static void apply_settings (void)
+{
+    update_mm_per_step();
+    system_update_travel_envelope();
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    mc_backlash_init();
+#endif
+    hal.settings_changed(&settings);
+}
+
 static status_code_t store_driver_setting (setting_type_t setting, float value, char *svalue)
 {
     status_code_t status = hal.driver_settings.set ? hal.driver_settings.set(setting, value, svalue) : Status_Unhandled;
 
     if(status == Status_OK) {
  //       hal.nvs.memcpy_to_nvs(hal.nvs.driver_area.address, hal.nvs.driver_area.mem_address, hal.nvs.driver_area.size, true);
-        if(hal.driver_settings.changed)
+        if(transaction.active)
+            transaction.driver_changed = true;
+        else if(hal.driver_settings.changed)
             hal.driver_settings.changed(&settings);
     }
 
@@ -436,7 +693,7 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
 
 #if COMPATIBILITY_LEVEL <= 1
 
-    if (value < 0.0f && setting != Setting_ParkingTarget)
+    if (value < 0.0f && setting != Setting_ParkingTarget && !(setting >= Setting_RTCP_PivotX && setting <= Setting_RTCP_PivotZ))
         return Status_NegativeValue;
 
 #endif
@@ -485,6 +742,25 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 break;
 #endif
 
+#ifdef ENABLE_JERK_ACCELERATION
+            case AxisSetting_Jerk:
+                found = true;
+                settings.axis[axis_idx].jerk = value * 60.0f * 60.0f * 60.0f; // Convert to mm/min^3 for grbl internal use.
+                break;
+#endif
+
+#ifdef ENABLE_HOMING_AXIS_RATES
+            case AxisSetting_HomingSeekRate:
+                found = true;
+                settings.axis[axis_idx].homing_seek_rate = value;
+                break;
+
+            case AxisSetting_HomingFeedRate:
+                found = true;
+                settings.axis[axis_idx].homing_feed_rate = value;
+                break;
+#endif
+
             default: // for stopping compiler warning
                 break;
         }
@@ -495,7 +771,13 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
     } else {
         // Store non-axis Grbl settings
         uint_fast16_t int_value = (uint_fast16_t)truncf(value);
-        switch(setting) {
+        const setting_detail_t *detail;
+
+        if((detail = settings_get_details(setting))) {
+            status_code_t status;
+            if((status = store_setting(detail, value)) != Status_OK)
+                return status;
+        } else switch(setting) {
 
             case Setting_PulseMicroseconds:
                 if (value < 2.0f)
@@ -509,26 +791,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.steppers.pulse_delay_microseconds = value;
                 break;
 
-            case Setting_StepperIdleLockTime:
-                settings.steppers.idle_lock_time = int_value;
-                break;
-
-            case Setting_StepInvertMask:
-                settings.steppers.step_invert.mask = int_value & AXES_BITMASK;
-                break;
-
-            case Setting_DirInvertMask:
-                settings.steppers.dir_invert.mask = int_value & AXES_BITMASK;
-                break;
-
-            case Setting_InvertStepperEnable: // Reset to ensure change. Immediate re-init may cause problems.
-                settings.steppers.enable_invert.mask = int_value & AXES_BITMASK;
-                break;
-
-            case Setting_LimitPinsInvertMask: // Reset to ensure change. Immediate re-init may cause problems.
-                settings.limits.invert.mask = int_value & AXES_BITMASK;
-                break;
-
             case Setting_InvertProbePin: // Reset to ensure change. Immediate re-init may cause problems.
                 if(!hal.probe.configure)
                     return Status_SettingDisabled;
@@ -545,14 +807,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
 #endif
                 break;
 
-            case Setting_JunctionDeviation:
-                settings.junction_deviation = value;
-                break;
-
-            case Setting_ArcTolerance:
-                settings.arc_tolerance = value;
-                break;
-
             case Setting_ReportInches:
                 settings.flags.report_inches = int_value != 0;
                 report_init();
@@ -567,10 +821,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.control_invert.probe_disconnected &= hal.driver_cap.probe_connected;
                break;
 
-            case Setting_CoolantInvertMask:
-                settings.coolant_invert.mask = int_value;
-                break;
-
             case Setting_SpindleInvertMask:
                 settings.spindle.invert.mask = int_value;
                 if(settings.spindle.invert.pwm && !hal.driver_cap.spindle_pwm_invert) {
@@ -579,10 +829,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 }
                 break;
 
-            case Setting_SpindleAtSpeedTolerance:
-                settings.spindle.at_speed_tolerance = value;
-                break;
-
             case Setting_ControlPullUpDisableMask:
                 settings.control_disable_pullup.mask = int_value;
                 settings.control_disable_pullup.block_delete &= hal.driver_cap.block_delete;
@@ -591,10 +837,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.control_invert.probe_disconnected &= hal.driver_cap.probe_connected;
                 break;
 
-            case Setting_LimitPullUpDisableMask:
-                settings.limits.disable_pullup.mask = int_value;
-                break;
-
             case Setting_ProbePullUpDisable:
                 if(!hal.probe.configure)
                     return Status_SettingDisabled;
@@ -662,26 +904,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 }
                 break;
 
-            case Setting_HomingDirMask:
-                settings.homing.dir_mask.value = int_value & AXES_BITMASK;
-                break;
-
-            case Setting_HomingFeedRate:
-                settings.homing.feed_rate = value;
-                break;
-
-            case Setting_HomingSeekRate:
-                settings.homing.seek_rate = value;
-                break;
-
-            case Setting_HomingDebounceDelay:
-                settings.homing.debounce_delay = int_value;
-                break;
-
-            case Setting_HomingPulloff:
-                settings.homing.pulloff = value;
-                break;
-
             case Setting_EnableLegacyRTCommands:
                 settings.flags.legacy_rt_commands = value != 0;
                 break;
@@ -700,22 +922,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 limits_set_homing_axes();
                 break;
 
-            case Setting_G73Retract:
-                settings.g73_retract = value;
-                break;
-
-            case Setting_PWMFreq:
-                settings.spindle.pwm_freq = value;
-                break;
-
-            case Setting_RpmMax:
-                settings.spindle.rpm_max = value;
-                break;
-
-            case Setting_RpmMin:
-                settings.spindle.rpm_min = value;
-                break;
-
             case Setting_Mode:
                 switch((machine_mode_t)int_value) {
 
@@ -746,46 +952,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 settings.parking.flags.value = bit_istrue(int_value, bit(0)) ? (int_value & 0x07) : 0;
                 break;
 
-            case Setting_ParkingAxis:
-                settings.parking.axis = int_value;
-                break;
-
-            case Setting_ParkingPulloutIncrement:
-                settings.parking.pullout_increment = value;
-                break;
-
-            case Setting_ParkingPulloutRate:
-                settings.parking.pullout_rate = value;
-                break;
-
-            case Setting_ParkingTarget:
-                settings.parking.target = value;
-                break;
-
-            case Setting_ParkingFastRate:
-                settings.parking.rate = value;
-                break;
-
-            case Setting_PWMOffValue:
-                settings.spindle.pwm_off_value = value;
-                break;
-
-            case Setting_PWMMinValue:
-                settings.spindle.pwm_min_value = value;
-                break;
-
-            case Setting_PWMMaxValue:
-                settings.spindle.pwm_max_value = value;
-                break;
-
-            case Setting_StepperDeenergizeMask:
-                settings.steppers.deenergize.mask = int_value & AXES_BITMASK;
-                break;
-
-            case Setting_SpindlePPR:
-                settings.spindle.ppr = int_value;
-                break;
-
 #ifdef ENABLE_SPINDLE_LINEARIZATION
 
             case Setting_LinearSpindlePiece1:
@@ -810,46 +976,6 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                 break;
 #endif
 
-#ifdef SPINDLE_RPM_CONTROLLED
-
-            case Setting_SpindlePGain:
-                settings.spindle.pid.p_gain = value;
-                break;
-
-            case Setting_SpindleIGain:
-                settings.spindle.pid.i_gain = value;
-                break;
-
-            case Setting_SpindleDGain:
-                settings.spindle.pid.d_gain = value;
-                break;
-
-            case Setting_SpindleMaxError:
-                settings.spindle.pid.max_error = value;
-                break;
-
-            case Setting_SpindleIMaxError:
-                settings.spindle.pid.i_max_error = value;
-                break;
-
-#endif
-
-            case Setting_PositionPGain:
-                settings.position.pid.p_gain = value;
-                break;
-
-            case Setting_PositionIGain:
-                settings.position.pid.i_gain = value;
-                break;
-
-            case Setting_PositionDGain:
-                settings.position.pid.d_gain = value;
-                break;
-
-            case Setting_PositionIMaxError:
-                settings.position.pid.i_max_error = value;
-                break;
-
             case Setting_ToolChangeMode:
                 if(!hal.driver_cap.atc && hal.stream.suspend_read && int_value <= ToolChange_Ignore) {
 #if COMPATIBILITY_LEVEL > 1
@@ -862,53 +988,206 @@ status_code_t settings_store_global_setting (setting_type_t setting, char *svalu
                     return Status_InvalidStatement;
                 break;
 
-            case Setting_ToolChangeProbingDistance:
-                if(!hal.driver_cap.atc)
-                    settings.tool_change.probing_distance = value;
-                else
+            case Setting_AutoReportInterval:
+                if(int_value && (int_value < AUTO_REPORT_INTERVAL_MIN || int_value > 65535))
                     return Status_InvalidStatement;
+                settings.auto_report_interval = (uint16_t)int_value;
                 break;
 
-            case Setting_ToolChangeFeedRate:
-                settings.tool_change.feed_rate = value;
+#ifdef KINEMATICS_API
+            case Setting_Kinematics:
+                if(!kinematics_get((kinematics_type_t)int_value))
+                    return Status_InvalidStatement;
+                settings.kinematics = (kinematics_type_t)int_value; // NOTE: takes effect after a hard reset.
                 break;
+#endif
 
-            case Setting_ToolChangeSeekRate:
-                settings.tool_change.seek_rate = value;
-                break;
+            default:
+                return store_driver_setting(setting, value, svalue);
+        }
+    }
 
-            case Settings_IoPort_InvertIn:
-                settings.ioport.invert_in.mask = (uint8_t)(int_value & 0xFF);
-                break;
+    if(transaction.active)
+        transaction.changed = true; // Written and applied on commit.
+    else {
+        write_global_settings();
+        apply_settings();
+    }
 
-            case Settings_IoPort_Pullup_Disable:
-                settings.ioport.pullup_disable_in.mask = (uint8_t)(int_value & 0xFF);
-                break;
+    return Status_OK;
+}
 
-            case Settings_IoPort_InvertOut:
-                settings.ioport.invert_out.mask = (uint8_t)(int_value & 0xFF);
-                break;
+// Size of the settings image: global settings followed by the driver settings area if present.
+static uint32_t image_size (void)
+{
+    return sizeof(settings_t) + (hal.nvs.driver_area.mem_address ? hal.nvs.driver_area.size : 0);
+}
 
-            case Settings_IoPort_OD_Enable:
-                settings.ioport.od_enable_out.mask = (uint8_t)(int_value & 0xFF);
-                break;
+static uint8_t *image_address (uint32_t offset)
+{
+    return offset < sizeof(settings_t) ? (uint8_t *)&settings + offset : hal.nvs.driver_area.mem_address + offset - sizeof(settings_t);
+}
 
-            default:
-                return store_driver_setting(setting, value, svalue);
+// Same algorithm as calc_checksum(), continued over the image.
+static uint8_t image_checksum (void)
+{
+    uint8_t checksum = 0;
+    uint32_t offset, size = image_size();
+
+    for(offset = 0; offset < size; offset++) {
+        checksum = (checksum << 1) | (checksum >> 7);
+        checksum += *image_address(offset);
+    }
+
+    return checksum;
+}
+
+static int_fast8_t hex_value (char c)
+{
+    return c >= '0' && c <= '9' ? c - '0' : (c >= 'A' && c <= 'F' ? c - 'A' + 10 : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1));
+}
+
+// Starts a bulk settings transaction, $SB command. Settings stored until the transaction is committed are
+// validated as usual but not written to non-volatile storage and the driver is not reconfigured.
+// NOTE: driver and plugin settings are written by their handlers.
+void settings_begin_transaction (void)
+{
+    memset(&transaction, 0, sizeof(transaction));
+    transaction.active = true;
+}
+
+// Ends the transaction and discards changes by reloading settings from non-volatile storage, $SA command.
+// Also called on soft reset.
+void settings_abort_transaction (void)
+{
+    if(transaction.active) {
+
+        transaction.active = false;
+
+        if(transaction.changed || transaction.imported) {
+            if(!read_global_settings())
+                memcpy(&settings, &defaults, sizeof(settings_t));
+            apply_settings();
+        }
+
+        if((transaction.driver_changed || transaction.imported) && hal.driver_settings.load) {
+            hal.driver_settings.load();
+            if(hal.driver_settings.changed)
+                hal.driver_settings.changed(&settings);
         }
     }
+}
 
-    write_global_settings();
-#ifdef ENABLE_BACKLASH_COMPENSATION
-    mc_backlash_init();
-#endif
-    hal.settings_changed(&settings);
+// Commits the transaction, $SC command: writes global settings once and reconfigures the driver once.
+// If settings image data has been imported svalue must be <size>:<checksum> as output by settings_export(),
+// the transaction is aborted if the image does not match.
+status_code_t settings_commit_transaction (char *svalue)
+{
+    if(!transaction.active)
+        return Status_InvalidStatement;
+
+    if(transaction.imported) {
+
+        uint_fast8_t counter = 0;
+        float size, checksum;
+
+        if(!(read_float(svalue, &counter, &size) && svalue[counter++] == ':' && read_float(svalue, &counter, &checksum) &&
+              (uint32_t)size == image_size() && (uint8_t)checksum == image_checksum() && settings.version == SETTINGS_VERSION)) {
+            settings_abort_transaction();
+            return Status_InvalidStatement;
+        }
+
+        if(hal.nvs.driver_area.mem_address && hal.nvs.driver_area.size && hal.nvs.type != NVS_None)
+            hal.nvs.memcpy_to_nvs(hal.nvs.driver_area.address, hal.nvs.driver_area.mem_address, hal.nvs.driver_area.size, true);
+    }
+
+    transaction.active = false;
+
+    if(transaction.changed || transaction.imported) {
+        write_global_settings();
+        nvs_buffer_sync_physical();
+        apply_settings();
+        report_init();
+        limits_set_homing_axes();
+        if(hal.probe.configure)
+            hal.probe.configure(false, false);
+    }
+
+    if(transaction.driver_changed || transaction.imported) {
+        if(transaction.imported && hal.driver_settings.load)
+            hal.driver_settings.load();
+        if(hal.driver_settings.changed)
+            hal.driver_settings.changed(&settings);
+    }
+
+    return Status_OK;
+}
+
+// Copies settings image data to the settings in RAM, $SI=<offset>:<data> command where data is up to
+// SETTINGS_IMAGE_CHUNK bytes in hex. Only allowed in a transaction.
+status_code_t settings_import (char *svalue)
+{
+    uint_fast8_t counter = 0;
+    uint32_t offset;
+    float value;
+    int_fast8_t hi, lo;
+
+    if(!transaction.active)
+        return Status_InvalidStatement;
+
+    if(!(read_float(svalue, &counter, &value) && isintf(value) && svalue[counter++] == ':'))
+        return Status_BadNumberFormat;
+
+    svalue += counter;
+    offset = (uint32_t)value;
+
+    while(*svalue) {
+        if(offset >= image_size() || (hi = hex_value(*svalue)) < 0 || (lo = hex_value(*(svalue + 1))) < 0)
+            return Status_InvalidStatement;
+        *image_address(offset++) = (uint8_t)((hi << 4) | lo);
+        svalue += 2;
+    }
+
+    transaction.imported = true;
 
     return Status_OK;
 }
 
+// Prints the global and driver settings as a transaction that can be sent back to import them, $SE command.
+void settings_export (void)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    char line[SETTINGS_IMAGE_CHUNK * 2 + 1];
+    uint32_t offset = 0, size = image_size();
+    uint_fast8_t idx;
+
+    hal.stream.write("$SB" ASCII_EOL);
+
+    while(offset < size) {
+        hal.stream.write("$SI=");
+        hal.stream.write(uitoa(offset));
+        hal.stream.write(":");
+        for(idx = 0; idx < SETTINGS_IMAGE_CHUNK * 2 && offset < size; offset++) {
+            line[idx++] = hex[*image_address(offset) >> 4];
+            line[idx++] = hex[*image_address(offset) & 0x0F];
+        }
+        line[idx] = '\0';
+        hal.stream.write(line);
+        hal.stream.write(ASCII_EOL);
+    }
+
+    hal.stream.write("$SC=");
+    hal.stream.write(uitoa(size));
+    hal.stream.write(":");
+    hal.stream.write(uitoa(image_checksum()));
+    hal.stream.write(ASCII_EOL);
+}
+
 // Initialize the config subsystem
 void settings_init() {
+    coord_cache.loaded = 0;
+
     if(!read_global_settings()) {
         settings_restore_t settings = settings_all;
         settings.defaults = 1; // Ensure global settings get restored
@@ -921,6 +1200,7 @@ void settings_init() {
         report_grbl_settings(false);
 #endif
     } else {
+        update_mm_per_step();
         memset(&tool_table, 0, sizeof(tool_data_t)); // First entry is for tools not in tool table
 #ifdef N_TOOLS
         uint_fast8_t idx;
@@ -29,12 +29,16 @@
 
 // Version of the persistent storage data. Will be used to migrate existing data from older versions of Grbl
 // when firmware is upgraded. Always stored in byte 0 of non-volatile storage
-#define SETTINGS_VERSION 18  // NOTE: Check settings_reset() when moving to next version.
+#define SETTINGS_VERSION 19  // NOTE: Check settings_reset() when moving to next version.
 
 
 // Define axis settings numbering scheme. Starts at Setting_AxisSettingsBase, every INCREMENT, over N_SETTINGS.
-#ifdef ENABLE_BACKLASH_COMPENSATION
-#define AXIS_N_SETTINGS          6
+#if defined(ENABLE_HOMING_AXIS_RATES)
+#define AXIS_N_SETTINGS          10
+#elif defined(ENABLE_JERK_ACCELERATION)
+#define AXIS_N_SETTINGS          8
+#elif defined(ENABLE_BACKLASH_COMPENSATION)
+#define AXIS_N_SETTINGS          7
 #else
 #define AXIS_N_SETTINGS          4
 #endif
@@ -45,6 +49,11 @@
 #define ENCODER_N_SETTINGS_MAX 5 // NOTE: This is the maximum number of encoders allowed.
 #define ENCODER_SETTINGS_INCREMENT 10
 
+// Number of settings image bytes per $SI line output by $SE.
+#ifndef SETTINGS_IMAGE_CHUNK
+#define SETTINGS_IMAGE_CHUNK 32
+#endif
+
 typedef enum {
     Setting_PulseMicroseconds = 0,
     Setting_StepperIdleLockTime = 1,
@@ -219,6 +228,37 @@ typedef enum {
     Settings_IoPort_InvertOut = 372,
     Settings_IoPort_OD_Enable = 373,
 
+    Setting_AuxAxis0_StepsPerMm = 374,
+    Setting_AuxAxis0_MaxRate = 375,
+    Setting_AuxAxis0_Acceleration = 376,
+    Setting_AuxAxis1_StepsPerMm = 377,
+    Setting_AuxAxis1_MaxRate = 378,
+    Setting_AuxAxis1_Acceleration = 379,
+
+    Setting_VFD_TargetLoad = 380,
+    Setting_VFD_RatedCurrent = 381,
+    Setting_VFD_MinFeedOverride = 382,
+    Setting_VFD_MaxFeedOverride = 383,
+    Setting_VFD_LoadFilter = 384,
+
+    Setting_RTCP_PivotX = 385,
+    Setting_RTCP_PivotY = 386,
+    Setting_RTCP_PivotZ = 387,
+
+    Setting_LaserRasterOverscan = 388,
+    Setting_SegmentBufferSize = 389,
+
+    Setting_InputShaperType = 390,
+    Setting_InputShaperFrequency = 391,
+    Setting_InputShaperFrequency2 = 392,
+    Setting_InputShaperDamping = 393,
+    Setting_ProbeRetract = 394,
+    Setting_ProbeLocateFeedRate = 395,
+
+    Setting_AutoReportInterval = 396,
+    Setting_Kinematics = 397,
+    Setting_PlannerBlocks = 398,
+
     Setting_EncoderSettingsBase = 400, // NOTE: Reserving settings values >= 400 for encoder settings. Up to 449.
     Setting_EncoderSettingsMax = 449,
 
@@ -245,7 +285,10 @@ typedef enum {
     AxisSetting_MaxTravel = 3,
     AxisSetting_StepperCurrent = 4,
     AxisSetting_MicroSteps = 5,
-    AxisSetting_Backlash = 6
+    AxisSetting_Backlash = 6,
+    AxisSetting_Jerk = 7,
+    AxisSetting_HomingSeekRate = 8,
+    AxisSetting_HomingFeedRate = 9
     /*
     AxisSetting_P_Gain = 7,
     AxisSetting_I_Gain = 8,
@@ -314,7 +357,8 @@ typedef union {
                  parser_state       :1,
                  alarm_substate     :1,
                  run_substate       :1,
-                 unassigned         :4;
+                 auto_report_delta  :1,
+                 unassigned         :3;
     };
 } reportmask_t;
 
@@ -416,6 +460,13 @@ typedef struct {
 #ifdef ENABLE_BACKLASH_COMPENSATION
     float backlash;
 #endif
+#ifdef ENABLE_JERK_ACCELERATION
+    float jerk;
+#endif
+#ifdef ENABLE_HOMING_AXIS_RATES
+    float homing_seek_rate; // 0 if common rate is to be used
+    float homing_feed_rate; // 0 if common rate is to be used
+#endif
 } axis_settings_t;
 
 typedef union {
@@ -479,6 +530,34 @@ typedef struct {
     toolchange_mode_t mode;
 } tool_change_settings_t;
 
+// Kinematics selected by $397, only available when compiled with KINEMATICS_API.
+typedef enum {
+    Kinematics_Cartesian = 0,
+    Kinematics_CoreXY,
+    Kinematics_WallPlotter,
+    Kinematics_Maslow,
+    Kinematics_RTCP
+} kinematics_type_t;
+
+// Pivot point of RTCP trunnion kinematics, only available when compiled with RTCP_TRUNNION.
+typedef struct {
+    float pivot[3];     // Intersection of the rotary axes in machine coordinates (mm)
+} rtcp_settings_t;
+
+// Input shaper selected by $390, only available when compiled with ENABLE_INPUT_SHAPING.
+typedef enum {
+    InputShaper_None = 0,
+    InputShaper_ZV,
+    InputShaper_ZVD,
+    InputShaper_EI
+} input_shaper_type_t;
+
+typedef struct {
+    uint8_t type;       // input_shaper_type_t
+    float frequency[2]; // Resonance frequencies (Hz), the shaper for the second frequency is cascaded if not 0
+    float damping;      // Damping ratio of the resonances
+} input_shaper_settings_t;
+
 // Global persistent settings (Stored from byte persistent storage_ADDR_GLOBAL onwards)
 typedef struct {
     // Settings struct version
@@ -502,9 +581,48 @@ typedef struct {
     parking_settings_t parking;
     position_pid_t position;    // Used for synchronized motion
     ioport_signals_t ioport;
+    uint16_t planner_buffer_blocks; // Number of planner blocks to allocate at boot
+    uint8_t segment_buffer_size;    // Number of step segments to allocate at boot
+    kinematics_type_t kinematics;   // Kinematics to select at boot
+    uint16_t auto_report_interval;  // Interval in milliseconds between status reports sent without a request, 0 to disable
+#ifdef ENABLE_INPUT_SHAPING
+    input_shaper_settings_t input_shaper;
+#endif
+    float probe_retract;            // Retract distance before the slow re-probe of two-speed probing (mm)
+    float probe_locate_feed_rate;   // Feed rate of the slow re-probe (mm/min), 0 to disable two-speed probing
+#ifdef RTCP_TRUNNION
+    rtcp_settings_t rtcp;
+#endif
+#ifdef ENABLE_LASER_RASTER
+    float raster_overscan;          // Raster lead-in and lead-out length as a multiple of the distance needed to accelerate to the feed rate, 0 to disable
+#endif
 } settings_t;
 
-extern settings_t settings;
+typedef enum {
+    SettingFormat_Integer = 0,  // Unsigned integer, field size is 1, 2 or 4 bytes
+    SettingFormat_AxisMask,     // Unsigned integer masked with AXES_BITMASK on store
+    SettingFormat_Float
+} setting_format_t;
+
+// Descriptor for settings that are stored in a settings_t field without conversion.
+// Settings not described are handled by custom code or by the driver.
+typedef struct {
+    setting_type_t id;
+    setting_format_t format;
+    uint8_t size;               // Size of the field in bytes
+    uint16_t offset;            // Offset of the field in settings_t
+    uint8_t decimals;           // Number of decimals reported, float settings only
+    bool extended;              // Only reported by $$ when all settings are requested
+    float min;                  // Minimum and maximum values allowed,
+    float max;                  // not checked if min >= max
+    bool (*is_available)(void); // Returns false if the setting is not supported by the driver, NULL if always available
+} setting_detail_t;
+
+extern THREAD_LOCAL settings_t settings;
+
+// Reciprocals of settings.axis[idx].steps_per_mm, updated when settings are loaded, restored or changed.
+// Used by the planner and the steps to position conversions to avoid divisions.
+extern THREAD_LOCAL float mm_per_step[N_AXIS];
 
 // Initialize the configuration subsystem (load settings from persistent storage)
 void settings_init();
@@ -515,6 +633,19 @@ void settings_restore(settings_restore_t restore_flags);
 // A helper method to set new settings from command line
 status_code_t settings_store_global_setting(setting_type_t setting, char *svalue);
 
+// Bulk settings transaction and settings image transfer, $SB, $SC, $SA, $SI and $SE commands
+void settings_begin_transaction (void);
+status_code_t settings_commit_transaction (char *svalue);
+void settings_abort_transaction (void);
+status_code_t settings_import (char *svalue);
+void settings_export (void);
+
+// Returns the descriptor for a setting, NULL if the setting is handled by custom code or by the driver
+const setting_detail_t *settings_get_details (setting_type_t setting);
+
+// Returns the current value of a described setting
+float settings_get_value (const setting_detail_t *setting);
+
 // Writes the protocol line variable as a startup line in persistent storage
 void settings_write_startup_line(uint8_t idx, char *line);
 
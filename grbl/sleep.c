@@ -22,7 +22,7 @@
 
 #include "hal.h"
 
-volatile bool slumber;
+THREAD_LOCAL volatile bool slumber;
 
 static void fall_asleep()
 {
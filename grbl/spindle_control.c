@@ -72,29 +72,65 @@ bool spindle_set_state (spindle_state_t state, float rpm)
     return !ABORTED;
 }
 
+// Returns true if spindle at speed can be checked, either by the driver or with the RPM measured by the spindle encoder.
+static inline bool spindle_at_speed_available (void)
+{
+    return settings.spindle.at_speed_tolerance > 0.0f && (hal.driver_cap.spindle_at_speed || hal.spindle.get_data);
+}
+
+// Returns true if the spindle is at speed as flagged by the driver, or if the RPM measured by the spindle encoder
+// is within the at speed tolerance (percent) of the programmed RPM.
+static bool spindle_is_at_speed (void)
+{
+    if(hal.driver_cap.spindle_at_speed)
+        return hal.spindle.get_state().at_speed;
+
+    return fabsf(fabsf(hal.spindle.get_data(SpindleData_RPM).rpm) - sys.spindle_rpm) <= sys.spindle_rpm * settings.spindle.at_speed_tolerance * 0.01f;
+}
+
+// Waits for the spindle to reach the programmed speed, returns as soon as it is reached.
+// Raises a spindle alarm if not reached within SAFETY_DOOR_SPINDLE_DELAY seconds.
+static bool spindle_wait_at_speed (delaymode_t mode)
+{
+    uint32_t polls = (uint32_t)(SAFETY_DOOR_SPINDLE_DELAY * 1000.0f) / SPINDLE_AT_SPEED_POLL_INTERVAL;
+
+    while(!spindle_is_at_speed()) {
+
+        if(mode == DelayMode_Dwell)
+            protocol_execute_realtime();
+        else {
+            // Execute rt_system() only to avoid nesting suspend loops.
+            protocol_exec_rt_system();
+            if(state_door_reopened()) // Bail, if safety door reopens.
+                return false;
+        }
+
+        if(ABORTED)
+            return false;
+
+        if(polls-- == 0) {
+            set_state(STATE_ALARM); // Ensure alarm state is active.
+            report_alarm_message(Alarm_Spindle);
+            return false;
+        }
+
+        hal.delay_ms(SPINDLE_AT_SPEED_POLL_INTERVAL, NULL);
+    }
+
+    return true;
+}
+
 // G-code parser entry-point for setting spindle state. Forces a planner buffer sync and bails
-// if an abort or check-mode is active.
+// if an abort or check-mode is active. If at speed can be checked returns when the spindle is at speed.
 bool spindle_sync (spindle_state_t state, float rpm)
 {
     bool ok = true;
-    bool at_speed = sys.state == STATE_CHECK_MODE || !state.on || !hal.driver_cap.spindle_at_speed || settings.spindle.at_speed_tolerance <= 0.0f;
+    bool at_speed = sys.state == STATE_CHECK_MODE || !state.on || !spindle_at_speed_available();
 
     if (sys.state != STATE_CHECK_MODE) {
         // Empty planner buffer to ensure spindle is set when programmed.
-        if((ok = protocol_buffer_synchronize()) && spindle_set_state(state, rpm) && !at_speed) {
-            float delay = 0.0f;
-            while(!(at_speed = hal.spindle.get_state().at_speed)) {
-                delay_sec(0.1f, DelayMode_Dwell);
-                delay += 0.1f;
-                if(ABORTED)
-                    break;
-                if(delay >= SAFETY_DOOR_SPINDLE_DELAY) {
-                    set_state(STATE_ALARM); // Ensure alarm state is active.
-                    report_alarm_message(Alarm_Spindle);
-                    break;
-                }
-            }
-        }
+        if((ok = protocol_buffer_synchronize()) && spindle_set_state(state, rpm) && !at_speed)
+            at_speed = spindle_wait_at_speed(DelayMode_Dwell);
     }
 
     return ok && at_speed;
@@ -110,22 +146,10 @@ bool spindle_restore (spindle_state_t state, float rpm)
     else { // TODO: add check for current spindle state matches restore state?
         spindle_set_state(state, rpm);
         if(state.on) {
-            if((ok = !hal.driver_cap.spindle_at_speed))
+            if(spindle_at_speed_available())
+                ok = spindle_wait_at_speed(DelayMode_SysSuspend);
+            else
                 delay_sec(SAFETY_DOOR_SPINDLE_DELAY, DelayMode_SysSuspend);
-            else if((ok == (settings.spindle.at_speed_tolerance <= 0.0f))) {
-                float delay = 0.0f;
-                while(!(ok = hal.spindle.get_state().at_speed)) {
-                    delay_sec(0.1f, DelayMode_SysSuspend);
-                    delay += 0.1f;
-                    if(ABORTED)
-                        break;
-                    if(delay >= SAFETY_DOOR_SPINDLE_DELAY) {
-                        set_state(STATE_ALARM); // Ensure alarm state is active.
-                        report_alarm_message(Alarm_Spindle);
-                        break;
-                    }
-                }
-            }
         }
     }
 
@@ -186,6 +210,28 @@ bool spindle_precompute_pwm_values (spindle_pwm_t *pwm_data, uint32_t clock_hz)
         if(!isnan(settings.spindle.pwm_piece[idx].rpm) && settings.spindle.pwm_piece[idx].start != 0.0f)
             memcpy(&pwm_data->piece[pwm_data->n_pieces++], &settings.spindle.pwm_piece[idx], sizeof(pwm_piece_t));
     }
+
+    // Build RPM to PWM lookup table from the piecewise linear fit model.
+    if(pwm_data->n_pieces && settings.spindle.rpm_max > settings.spindle.rpm_min) {
+
+        uint_fast16_t entry;
+        float rpm_step = (settings.spindle.rpm_max - settings.spindle.rpm_min) / (float)SPINDLE_PWM_LUT_SIZE;
+
+        pwm_data->lut_scale = 65536.0f / rpm_step;
+
+        for(entry = 0; entry <= SPINDLE_PWM_LUT_SIZE; entry++) {
+            float rpm = settings.spindle.rpm_min + rpm_step * (float)entry, pwm_value;
+            idx = pwm_data->n_pieces;
+            do {
+                idx--;
+            } while(idx && rpm <= pwm_data->piece[idx].rpm);
+            pwm_value = floorf(pwm_data->piece[idx].start * rpm - pwm_data->piece[idx].end);
+            pwm_data->lut[entry] = pwm_value < (float)pwm_data->min_value
+                                    ? pwm_data->min_value
+                                    : (pwm_value >= (float)pwm_data->period ? pwm_data->period - 1 : (uint_fast16_t)pwm_value);
+        }
+    } else
+        pwm_data->n_pieces = 0;
 #endif
 
     return settings.spindle.rpm_max > settings.spindle.rpm_min;
@@ -198,17 +244,18 @@ uint_fast16_t spindle_compute_pwm_value (spindle_pwm_t *pwm_data, float rpm, boo
 
     if(rpm > settings.spindle.rpm_min) {
       #ifdef ENABLE_SPINDLE_LINEARIZATION
-        // Compute intermediate PWM value with linear spindle speed model via piecewise linear fit model.
-        uint_fast8_t idx = pwm_data->n_pieces;
-
-        if(idx) {
-            do {
-                idx--;
-                if(idx == 0 || rpm > pwm_data->piece[idx].rpm) {
-                    pwm_value = floorf(pwm_data->piece[idx].start * rpm - pwm_data->piece[idx].end);
-                    break;
-                }
-            } while(idx);
+        // Look up intermediate PWM value in the table built from the piecewise linear fit model,
+        // interpolate linearly between entries. The table position is in Q16.16 format.
+        if(pwm_data->n_pieces) {
+
+            uint32_t pos = rpm >= settings.spindle.rpm_max
+                            ? (SPINDLE_PWM_LUT_SIZE << 16)
+                            : (uint32_t)((rpm - settings.spindle.rpm_min) * pwm_data->lut_scale);
+            uint_fast16_t idx = pos >> 16;
+
+            pwm_value = pwm_data->lut[idx];
+            if(idx < SPINDLE_PWM_LUT_SIZE)
+                pwm_value += (((int32_t)pwm_data->lut[idx + 1] - (int32_t)pwm_value) * (int32_t)((pos >> 4) & 0x0FFF)) >> 12;
         } else
       #endif
         // Compute intermediate PWM value with linear spindle speed model.
@@ -56,6 +56,10 @@ typedef struct {
     bool always_on;
     uint_fast16_t n_pieces;
     pwm_piece_t piece[SPINDLE_NPWM_PIECES];
+#ifdef ENABLE_SPINDLE_LINEARIZATION
+    float lut_scale;                             // Converts RPM above rpm_min to Q16.16 table position
+    uint_fast16_t lut[SPINDLE_PWM_LUT_SIZE + 1]; // PWM values at equidistant RPMs from rpm_min to rpm_max, built from the pieces
+#endif
 } spindle_pwm_t;
 
 // Used when HAL driver supports spindle synchronization
@@ -0,0 +1,223 @@
+/*
+  spindle_sync.c - An embedded CNC Controller with rs274/ngc (g-code) support
+
+  Spindle encoder position and speed estimation for spindle synchronized motion
+
+  NOTE: not referenced in the core grbl code
+
+  Part of grblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "hal.h"
+#include "spindle_sync.h"
+
+#if (SPINDLE_ENCODER_EVENTS & (SPINDLE_ENCODER_EVENTS - 1)) || SPINDLE_ENCODER_EVENTS < 4
+#error SPINDLE_ENCODER_EVENTS must be a power of 2 and at least 4!
+#endif
+
+void spindle_encoder_log_reset (spindle_encoder_t *encoder)
+{
+    memset(&encoder->log, 0, sizeof(spindle_encoder_log_t));
+    memset(&encoder->estimate, 0, sizeof(spindle_encoder_rpm_t));
+}
+
+// Logs encoder event, to be called from the encoder pulse interrupt handler.
+// count is the total number of encoder pulses, timestamp the free running timer value, both must be counting up.
+void spindle_encoder_log_event (spindle_encoder_t *encoder, uint32_t count, uint32_t timestamp)
+{
+    spindle_encoder_event_t *event = &encoder->log.event[encoder->log.head];
+
+    event->count = count;
+    event->timestamp = timestamp;
+
+    encoder->log.head = (encoder->log.head + 1) & (SPINDLE_ENCODER_EVENTS - 1);
+    if(encoder->log.events < SPINDLE_ENCODER_EVENTS)
+        encoder->log.events++;
+}
+
+// Logs encoder pulse count at index pulse, to be called from the encoder index interrupt handler.
+void spindle_encoder_log_index (spindle_encoder_t *encoder, uint32_t count)
+{
+    encoder->log.index_count = count;
+}
+
+// Returns number of encoder pulses since the last index pulse extrapolated to the given timestamp.
+// The pulse rate used for extrapolation is the mean rate over the logged events, extrapolation is limited
+// to the mean event interval so that a decelerating or stopped spindle is not run ahead of.
+// The pulse rate in pulses per timer tick is returned in rate if not NULL, 0 if the spindle is stopped.
+float spindle_encoder_predict (spindle_encoder_t *encoder, uint32_t now, float *rate)
+{
+    uint_fast8_t head, events;
+    uint32_t index_count, dt;
+    spindle_encoder_event_t newest, oldest;
+    float pulses, pulse_rate = 0.0f;
+
+    // Copy events, retry if a new event was logged while copying.
+    // NOTE: the oldest event is not used as it may be overwritten by the next event.
+    do {
+        head = encoder->log.head;
+        events = encoder->log.events == SPINDLE_ENCODER_EVENTS ? SPINDLE_ENCODER_EVENTS - 1 : encoder->log.events;
+        index_count = encoder->log.index_count;
+        newest = encoder->log.event[(head - 1) & (SPINDLE_ENCODER_EVENTS - 1)];
+        oldest = encoder->log.event[(head - events) & (SPINDLE_ENCODER_EVENTS - 1)];
+    } while(head != encoder->log.head);
+
+    if(events == 0) {
+        if(rate)
+            *rate = 0.0f;
+        return 0.0f;
+    }
+
+    pulses = (float)(int32_t)(newest.count - index_count);
+
+    if(events > 1 && (dt = now - newest.timestamp) <= encoder->maximum_tt && newest.timestamp != oldest.timestamp) {
+        float extrapolated, interval = (float)(newest.count - oldest.count) / (float)(events - 1);
+        pulse_rate = (float)(newest.count - oldest.count) / (float)(newest.timestamp - oldest.timestamp);
+        extrapolated = pulse_rate * (float)dt;
+        pulses += extrapolated > interval ? interval : extrapolated;
+    }
+
+    if(rate)
+        *rate = pulse_rate;
+
+    return pulses;
+}
+
+// Returns spindle RPM estimated from the logged encoder events, to be called from the foreground only.
+// A measurement is made when the newest event is at least encoder->window_tt timer tics after the event that started
+// the current window: at high speed many pulses are counted over the window, at low speed the window is the period
+// between two events. Since the window always starts and ends at an event there is no +/- one pulse count error.
+// Until the first window is complete the mean rate over the logged events is returned.
+// Measurements are smoothed by SPINDLE_RPM_SMOOTHING. If no event has arrived for longer than the current estimate
+// implies the estimate is limited accordingly so that a decelerating spindle is detected without waiting for the next event.
+// NOTE: timestamps must be from the same free running timer that is used for logging events.
+float spindle_encoder_get_rpm (spindle_encoder_t *encoder, uint32_t now)
+{
+    uint_fast8_t head, events;
+    uint32_t dt;
+    spindle_encoder_event_t newest, oldest;
+    spindle_encoder_rpm_t *estimate = &encoder->estimate;
+
+    // Copy events, retry if a new event was logged while copying.
+    do {
+        head = encoder->log.head;
+        events = encoder->log.events == SPINDLE_ENCODER_EVENTS ? SPINDLE_ENCODER_EVENTS - 1 : encoder->log.events;
+        newest = encoder->log.event[(head - 1) & (SPINDLE_ENCODER_EVENTS - 1)];
+        oldest = encoder->log.event[(head - events) & (SPINDLE_ENCODER_EVENTS - 1)];
+    } while(head != encoder->log.head);
+
+    if(events < 2 || now - newest.timestamp > encoder->maximum_tt) {
+        estimate->valid = false;
+        estimate->rpm = 0.0f;
+        return 0.0f;
+    }
+
+    if(!estimate->valid) {
+        estimate->valid = true;
+        estimate->start = oldest;
+    }
+
+    if((dt = newest.timestamp - estimate->start.timestamp) >= encoder->window_tt && dt && newest.count != estimate->start.count) {
+
+        float rpm = encoder->rpm_factor * (float)(newest.count - estimate->start.count) / (float)dt;
+
+        estimate->rpm = estimate->rpm == 0.0f ? rpm : estimate->rpm * SPINDLE_RPM_SMOOTHING + rpm * (1.0f - SPINDLE_RPM_SMOOTHING);
+        estimate->start = newest;
+    } else if(estimate->rpm == 0.0f && newest.timestamp != oldest.timestamp) // No measurement yet, use the logged events
+        return encoder->rpm_factor * (float)(newest.count - oldest.count) / (float)(newest.timestamp - oldest.timestamp);
+
+    // Limit to the rate implied by the time since the newest event if longer than the mean event interval.
+    if(estimate->rpm > 0.0f && newest.count != oldest.count && (dt = now - newest.timestamp) > 0) {
+        float limit = encoder->rpm_factor * (float)(newest.count - oldest.count) / ((float)(events - 1) * (float)dt);
+        if(limit < estimate->rpm)
+            return limit;
+    }
+
+    return estimate->rpm;
+}
+
+// Spindle synchronized motion, to be called by the driver spindle sync pulse start function for every step pulse.
+// Starts tracking on a new block and adjusts the step rate of each new cruising segment for the positional error
+// since the previous segment. Spindle position is read via hal.spindle.get_data().
+// Returns true if exec_segment->cycles_per_tick was changed, the driver must then update the step timer.
+bool spindle_sync_update (spindle_sync_t *tracker, stepper_t *stepper)
+{
+    bool changed = false;
+
+    if(stepper->new_block) {
+        tracker->sync = true;
+        tracker->programmed_rate = stepper->exec_block->programmed_rate;
+        tracker->steps_per_mm = stepper->exec_block->steps_per_mm;
+        tracker->segment_id = 0;
+        tracker->prev_pos = 0.0f;
+        tracker->block_start = hal.spindle.get_data(SpindleData_AngularPosition).angular_position * tracker->programmed_rate;
+        pidf_reset(&tracker->pid);
+#ifdef ENABLE_PID_TELEMETRY
+        pidf_telemetry_register(&tracker->pid, "Spindle sync");
+#endif
+#ifdef PID_LOG
+        sys.pid_log.idx = 0;
+        sys.pid_log.setpoint = 100.0f;
+#endif
+    }
+
+    if(tracker->segment_id != stepper->exec_segment->id) {
+
+        tracker->segment_id = stepper->exec_segment->id;
+
+        if(!stepper->new_block) {  // adjust this segments total time for any positional error since last segment
+
+            float actual_pos;
+
+            if(stepper->exec_segment->cruising) {
+
+                float dt = (float)hal.f_step_timer / (float)(stepper->exec_segment->cycles_per_tick * stepper->exec_segment->n_step);
+                actual_pos = hal.spindle.get_data(SpindleData_AngularPosition).angular_position * tracker->programmed_rate;
+
+                if(tracker->sync) {
+                    tracker->pid.sample_rate_prev = dt;
+                    tracker->sync = false;
+                }
+
+                // Distance from block start, the encoder position decreases when reversed if the encoder can sense direction.
+                actual_pos = fabsf(actual_pos - tracker->block_start);
+                int32_t step_delta = (int32_t)(pidf(&tracker->pid, tracker->prev_pos, actual_pos, dt) * tracker->steps_per_mm);
+                int32_t ticks = (((int32_t)stepper->step_count + step_delta) * (int32_t)stepper->exec_segment->cycles_per_tick) / (int32_t)stepper->step_count;
+
+                stepper->exec_segment->cycles_per_tick = (uint32_t)max(ticks, tracker->min_cycles_per_tick);
+                changed = true;
+            } else
+                actual_pos = tracker->prev_pos;
+
+#ifdef PID_LOG
+            if(sys.pid_log.idx < PID_LOG) {
+                sys.pid_log.target[sys.pid_log.idx] = tracker->prev_pos;
+                sys.pid_log.actual[sys.pid_log.idx] = actual_pos;
+                sys.pid_log.idx++;
+            }
+#endif
+        }
+
+        tracker->prev_pos = stepper->exec_segment->target_position;
+    }
+
+    return changed;
+}
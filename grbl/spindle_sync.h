@@ -28,6 +28,23 @@
 
 #include "pid.h"
 
+// Number of timestamped encoder events kept for spindle position and speed estimation, must be a power of 2.
+#ifndef SPINDLE_ENCODER_EVENTS
+#define SPINDLE_ENCODER_EVENTS 8
+#endif
+
+// Minimum measurement window in milliseconds for spindle RPM estimation.
+// Pulses are counted over at least this time, timed from encoder event to encoder event. At low speed each event
+// is further apart than the window and the RPM is measured from the period between events.
+#ifndef SPINDLE_RPM_WINDOW
+#define SPINDLE_RPM_WINDOW 20
+#endif
+
+// Weight of the previous RPM estimate when a new measurement is added, 0.0 for no smoothing.
+#ifndef SPINDLE_RPM_SMOOTHING
+#define SPINDLE_RPM_SMOOTHING 0.25f
+#endif
+
 // Free running timer log data.
 // The free running timer is used to timestamp pulse events from the encoder.
 typedef struct {
@@ -48,16 +65,42 @@ typedef struct {
     uint32_t tics_per_irq;          // Counts per interrupt generated (prescaler value)
 } spindle_encoder_counter_t;
 
+typedef struct {
+    uint32_t count;                 // Encoder pulse count at event
+    uint32_t timestamp;             // Free running timer value at event, counting up
+} spindle_encoder_event_t;
+
+// RPM estimator state, updated from the foreground only.
+typedef struct {
+    bool valid;                     // Set when start holds the event the current measurement window starts at
+    spindle_encoder_event_t start;  // Event at start of current measurement window
+    float rpm;                      // Filtered RPM
+} spindle_encoder_rpm_t;
+
+// Encoder event log, written by the encoder interrupt handlers.
+// The oldest and newest events are used for estimating spindle speed and position at a given time.
+typedef struct {
+    volatile uint_fast8_t head;     // Index of next event to be written
+    volatile uint_fast8_t events;   // Number of events logged since reset, max SPINDLE_ENCODER_EVENTS
+    volatile uint32_t index_count;  // Encoder pulse count at last index pulse
+    spindle_encoder_event_t event[SPINDLE_ENCODER_EVENTS];
+} spindle_encoder_log_t;
+
 typedef struct {
     uint32_t ppr;                       // Encoder pulses per revolution
     float rpm_factor;                   // Inverse of event timer tics per RPM
     float pulse_distance;               // Encoder pulse distance in fraction of one revolution
     uint32_t maximum_tt;                // Maximum timer tics since last spindle encoder pulse before RPM = 0 is returned
+    uint32_t window_tt;                 // Minimum timer tics for RPM measurement, see SPINDLE_RPM_WINDOW
     spindle_encoder_timer_t timer;      // Event timestamps
     spindle_encoder_counter_t counter;  // Encoder event counts
+    spindle_encoder_log_t log;          // Timestamped encoder events
+    spindle_encoder_rpm_t estimate;     // RPM estimate from logged events
 } spindle_encoder_t;
 
 typedef struct {
+    bool sync;                      // Set on new block, cleared when the first cruising segment is started
+    float block_start;              // Spindle position at block start in mm
     float prev_pos;                 // Target position of previous segment
     float steps_per_mm;             // Steps per mm for current block
     float programmed_rate;          // Programmed feed in mm/rev for current block
@@ -71,4 +114,11 @@ typedef struct {
 #endif
 } spindle_sync_t;
 
+void spindle_encoder_log_reset (spindle_encoder_t *encoder);
+void spindle_encoder_log_event (spindle_encoder_t *encoder, uint32_t count, uint32_t timestamp);
+void spindle_encoder_log_index (spindle_encoder_t *encoder, uint32_t count);
+float spindle_encoder_predict (spindle_encoder_t *encoder, uint32_t now, float *rate);
+float spindle_encoder_get_rpm (spindle_encoder_t *encoder, uint32_t now);
+bool spindle_sync_update (spindle_sync_t *tracker, stepper_t *stepper);
+
 #endif
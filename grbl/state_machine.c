@@ -30,6 +30,9 @@
 #include "motion_control.h"
 #include "state_machine.h"
 #include "override.h"
+#ifdef ENABLE_MOTION_TRACE
+#include "motion_trace.h"
+#endif
 
 static void state_idle (uint_fast16_t new_state);
 static void state_cycle (uint_fast16_t rt_exec);
@@ -43,11 +46,27 @@ static void state_restore (uint_fast16_t rt_exec);
 static void state_await_resumed (uint_fast16_t rt_exec);
 static void state_await_restore (uint_fast16_t rt_exec);
 
-static void (* volatile stateHandler)(uint_fast16_t rt_exec) = state_idle;
-
-static float restore_spindle_rpm;
-static planner_cond_t restore_condition;
-static uint_fast16_t pending_state = STATE_IDLE;
+static THREAD_LOCAL void (* volatile stateHandler)(uint_fast16_t rt_exec) = state_idle;
+
+// Realtime events accepted in each state, indexed by state bit number + 1 (STATE_IDLE is 0).
+// Covers all handlers that may be active in a state, other events are discarded before dispatch.
+static const uint_fast16_t state_events[] = {
+    EXEC_CYCLE_START|EXEC_FEED_HOLD|EXEC_TOOL_CHANGE|EXEC_SLEEP,                                // STATE_IDLE
+    0,                                                                                          // STATE_ALARM
+    0,                                                                                          // STATE_CHECK_MODE
+    0,                                                                                          // STATE_HOMING
+    EXEC_CYCLE_START|EXEC_CYCLE_COMPLETE|EXEC_FEED_HOLD|EXEC_MOTION_CANCEL|EXEC_TOOL_CHANGE,    // STATE_CYCLE
+    EXEC_CYCLE_START|EXEC_CYCLE_COMPLETE|EXEC_FEED_HOLD|EXEC_SLEEP,                             // STATE_HOLD
+    EXEC_STATE_EVENTS,                                                                          // STATE_JOG
+    EXEC_CYCLE_START|EXEC_CYCLE_COMPLETE|EXEC_FEED_HOLD|EXEC_SAFETY_DOOR|EXEC_SLEEP,            // STATE_SAFETY_DOOR
+    EXEC_CYCLE_START|EXEC_CYCLE_COMPLETE|EXEC_FEED_HOLD|EXEC_SLEEP,                             // STATE_SLEEP
+    0,                                                                                          // STATE_ESTOP
+    EXEC_STATE_EVENTS                                                                           // STATE_TOOL_CHANGE
+};
+
+static THREAD_LOCAL float restore_spindle_rpm;
+static THREAD_LOCAL planner_cond_t restore_condition;
+static THREAD_LOCAL uint_fast16_t pending_state = STATE_IDLE;
 
 typedef struct {
     float target[N_AXIS];
@@ -55,24 +74,40 @@ typedef struct {
     float retract_waypoint;
     bool retracting;
     bool restart_retract;
+    bool armed;         // Set at the door event when a parking retract is possible, the retract data is then prepared
+    bool replan;        // Re-planning from stop is deferred until the parking retract is complete
     plan_line_data_t plan_data;
 } parking_data_t;
 
 // Declare and initialize parking local variables
-static parking_data_t park;
+static THREAD_LOCAL parking_data_t park;
 
-static void state_restore_conditions (planner_cond_t *condition, float rpm)
+// Restores coolant and optionally spindle state. Coolant is restored first so that its
+// delay overlaps the spindle spin up delay, only the remaining coolant delay is waited for.
+static void restore_coolant_and_spindle (planner_cond_t *condition, float rpm, bool coolant, bool spindle)
 {
-    if(!settings.parking.flags.enabled || !park.restart_retract) {
+    float coolant_delay = SAFETY_DOOR_COOLANT_DELAY;
+    uint32_t ms = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
 
+    // NOTE: Laser mode will honor the coolant delay. An exhaust system is often controlled by this pin.
+    if(coolant)
+        coolant_set_state(condition->coolant);
+
+    if(spindle) {
         spindle_restore(condition->spindle, rpm);
+        if(hal.get_elapsed_ticks)
+            coolant_delay -= (float)(hal.get_elapsed_ticks() - ms) / 1000.0f;
+    }
 
-        // Block if safety door re-opened during prior restore actions.
-        if (gc_state.modal.coolant.value != hal.coolant.get_state().value) {
-            // NOTE: Laser mode will honor this delay. An exhaust system is often controlled by this pin.
-            coolant_set_state(condition->coolant);
-            delay_sec(SAFETY_DOOR_COOLANT_DELAY, DelayMode_SysSuspend);
-        }
+    if(coolant && coolant_delay > 0.0f)
+        delay_sec(coolant_delay, DelayMode_SysSuspend);
+}
+
+static void state_restore_conditions (planner_cond_t *condition, float rpm)
+{
+    if(!settings.parking.flags.enabled || !park.restart_retract) {
+
+        restore_coolant_and_spindle(condition, rpm, gc_state.modal.coolant.value != hal.coolant.get_state().value, true);
 
         sys.override.spindle_stop.value = 0; // Clear spindle stop override states
     }
@@ -96,13 +131,27 @@ bool initiate_hold (uint_fast16_t new_state)
         restore_spindle_rpm = gc_state.spindle.rpm;
     } else {
         restore_condition = block->condition;
-        restore_spindle_rpm = block->spindle.rpm;
+        restore_spindle_rpm = block->spindle_rpm;
+    }
+
+    // Prepare the pull-out retract so that it can be started as soon as the hold is complete.
+    // NOTE: Parking requires parking axis homed and laser mode disabled.
+    if(settings.parking.flags.enabled && new_state != STATE_HOLD && !park.restart_retract) {
+        park.armed = bit_istrue(sys.homed.mask, bit(settings.parking.axis)) && settings.mode != Mode_Laser && !sys.override.control.parking_disable;
+        park.plan_data.feed_rate = settings.parking.pullout_rate;
+        park.plan_data.condition.coolant = restore_condition.coolant; // Retain coolant state
+        park.plan_data.condition.spindle = restore_condition.spindle; // Retain spindle state
+        park.plan_data.spindle.rpm = restore_spindle_rpm;
     }
 
     if(settings.mode == Mode_Laser && settings.flags.disable_laser_during_hold)
         enqueue_accessory_override(CMD_OVERRIDE_SPINDLE_STOP);
 
     if(sys.state & (STATE_CYCLE|STATE_JOG)) {
+#ifdef ENABLE_FAST_JOG_CANCEL
+        if(sys.state == STATE_JOG)
+            st_truncate_buffer();
+#endif
         st_update_plan_block_parameters();  // Notify stepper module to recompute for hold deceleration.
         sys.step_control.execute_hold = On; // Initiate suspend state with active flag.
         stateHandler = state_await_hold;
@@ -128,7 +177,7 @@ void update_state (uint_fast16_t rt_exec)
 {
     if((rt_exec & EXEC_SAFETY_DOOR) && sys.state != STATE_SAFETY_DOOR)
         set_state(STATE_SAFETY_DOOR);
-    else
+    else if((rt_exec &= state_events[sys.state == STATE_IDLE ? 0 : bit_scan(sys.state) + 1]))
         stateHandler(rt_exec);
 }
 
@@ -153,7 +202,7 @@ void set_state (uint_fast16_t new_state)
                     plan_block_t *block;
                     if ((block = plan_get_current_block())) {
                         sys.state = new_state;
-                        sys.steppers_deenergize = false;    // Cancel stepper deenergize if pending.
+                        st_energize();                      // Cancel stepper deenergize if pending, drivers wake up while prepping.
                         st_prep_buffer();                   // Initialize step segment buffer before beginning cycle.
                         if(block->condition.spindle.synchronized) {
 
@@ -214,6 +263,10 @@ void set_state (uint_fast16_t new_state)
 
             case STATE_ALARM:
             case STATE_ESTOP:
+#ifdef ENABLE_MOTION_TRACE
+                motion_trace_freeze(); // Keep the motion leading up to the alarm for $TRACE.
+#endif
+                // no break
             case STATE_HOMING:
             case STATE_CHECK_MODE:
                 sys.state = new_state;
@@ -284,10 +337,23 @@ static void state_cycle (uint_fast16_t rt_exec)
     if ((rt_exec & EXEC_TOOL_CHANGE))
         hal.stream.suspend_read(true); // Block reading from input stream until tool change state is acknowledged
 
-    if (rt_exec & EXEC_CYCLE_COMPLETE)
+    if (rt_exec & EXEC_CYCLE_COMPLETE) {
         set_state(gc_state.tool_change ? STATE_TOOL_CHANGE : STATE_IDLE);
+#ifdef ENABLE_THREADING_PIPELINE
+        // Restart the cycle for a spindle synchronized motion held by the step segment generator,
+        // the cycle start waits for the spindle index pulse.
+        plan_block_t *block;
+        if(sys.state == STATE_IDLE && !(rt_exec & (EXEC_MOTION_CANCEL|EXEC_FEED_HOLD)) &&
+            (block = plan_get_current_block()) && block->condition.spindle.synchronized)
+            set_state(STATE_CYCLE);
+#endif
+    }
 
     if (rt_exec & EXEC_MOTION_CANCEL) {
+#ifdef ENABLE_FAST_JOG_CANCEL
+        if(sys.state == STATE_JOG)
+            st_truncate_buffer();
+#endif
         st_update_plan_block_parameters();  // Notify stepper module to recompute for hold deceleration.
         sys.suspend = true;
         sys.step_control.execute_hold = On; // Initiate suspend state with active flag.
@@ -339,7 +405,12 @@ static void state_await_hold (uint_fast16_t rt_exec)
 
         bool handler_changed = false;
 
-        plan_cycle_reinitialize();
+        // When a parking retract is prepared re-planning the planner buffer from stop is deferred until the
+        // retract is complete, the retract is then started without delay. The step segment prep is notified of the stop.
+        if((park.replan = park.armed && settings.parking.flags.enabled && (sys.state & (STATE_SAFETY_DOOR|STATE_SLEEP))))
+            st_update_plan_block_parameters();
+        else
+            plan_cycle_reinitialize();
         sys.step_control.flags = 0;
 
         if(sys.alarm_pending) {
@@ -373,10 +444,10 @@ static void state_await_hold (uint_fast16_t rt_exec)
                         park.retract_waypoint = min(park.retract_waypoint, settings.parking.target);
                     }
 
-                    // Execute slow pull-out parking retract motion. Parking requires parking axis homed, the
-                    // current location not exceeding the parking target location, and laser mode disabled.
+                    // Execute slow pull-out parking retract motion, prepared by initiate_hold(). Parking requires
+                    // the current location not exceeding the parking target location.
                     // NOTE: State is will remain DOOR, until the de-energizing and retract is complete.
-                    if (bit_istrue(sys.homed.mask, bit(settings.parking.axis)) && (park.target[settings.parking.axis] < settings.parking.target) && settings.mode != Mode_Laser && !sys.override.control.parking_disable) {
+                    if (park.armed && (park.target[settings.parking.axis] < settings.parking.target)) {
                         handler_changed = true;
                         stateHandler = state_await_waypoint_retract;
                         // Retract spindle by pullout distance. Ensure retraction motion moves away from
@@ -384,14 +455,15 @@ static void state_await_hold (uint_fast16_t rt_exec)
                         if (park.target[settings.parking.axis] < park.retract_waypoint) {
                             park.target[settings.parking.axis] = park.retract_waypoint;
                             park.plan_data.feed_rate = settings.parking.pullout_rate;
-                            park.plan_data.condition.coolant = restore_condition.coolant; // Retain coolant state
-                            park.plan_data.condition.spindle = restore_condition.spindle; // Retain spindle state
-                            park.plan_data.spindle.rpm = restore_spindle_rpm;
                             if(!(park.retracting = mc_parking_motion(park.target, &park.plan_data)))
                                 stateHandler(EXEC_CYCLE_COMPLETE);
                         } else
                             stateHandler(EXEC_CYCLE_COMPLETE);
                     } else {
+                        if(park.replan) {
+                            park.replan = false;
+                            plan_cycle_reinitialize();
+                        }
                         // Parking motion not possible. Just disable the spindle and coolant.
                         // NOTE: Laser mode does not start a parking motion to ensure the laser stops immediately.
                         hal.spindle.set_state((spindle_state_t){0}, 0.0f); // De-energize
@@ -423,6 +495,10 @@ static void state_await_resume (uint_fast16_t rt_exec)
             sys.step_control.execute_sys_motion = Off;
             st_parking_restore_buffer(); // Restore step segment buffer to normal run state.
         }
+        if(park.replan) {
+            park.replan = false;
+            plan_cycle_reinitialize();
+        }
         sys.parking_state = Parking_DoorAjar;
     }
 
@@ -497,22 +573,18 @@ static void state_await_resume (uint_fast16_t rt_exec)
 
 static void state_await_restore (uint_fast16_t rt_exec)
 {
-    static bool restart = false;
+    static THREAD_LOCAL bool restart = false;
 
     if(rt_exec == 0) {
 
         restart = true;
 
-        if (restore_condition.spindle.on != hal.spindle.get_state().on) {
+        bool spindle = restore_condition.spindle.on != hal.spindle.get_state().on;
+
+        if(spindle)
             grbl.report.feedback_message(Message_SpindleRestore);
-            spindle_restore(restore_condition.spindle, restore_spindle_rpm);
-        }
 
-        if (restore_condition.coolant.value != hal.coolant.get_state().value) {
-            // NOTE: Laser mode will honor this delay. An exhaust system is often controlled by this pin.
-            coolant_set_state(restore_condition.coolant);
-            delay_sec(SAFETY_DOOR_COOLANT_DELAY, DelayMode_SysSuspend);
-        }
+        restore_coolant_and_spindle(&restore_condition, restore_spindle_rpm, restore_condition.coolant.value != hal.coolant.get_state().value, spindle);
 
         sys.override.spindle_stop.value = 0; // Clear spindle stop override states
 
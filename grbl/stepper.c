@@ -27,6 +27,13 @@
 
 #include "hal.h"
 #include "protocol.h"
+#include "pool.h"
+#ifdef ENABLE_MOTION_TRACE
+#include "motion_trace.h"
+#endif
+#ifdef ENABLE_MOTION_SYNC
+#include "motion_sync.h"
+#endif
 
 //#include "debug.h"
 
@@ -38,6 +45,18 @@
 #define DT_SEGMENT (1.0f/(ACCELERATION_TICKS_PER_SECOND*60.0f)) // min/segment
 #define REQ_MM_INCREMENT_SCALAR 1.25f
 
+// Number of segments queued ahead of execution when velocity jogging, limits the latency of velocity changes
+// to this number of segment times (1 / ACCELERATION_TICKS_PER_SECOND).
+// Minimum change of the spindle speed in percent for a Constant Surface Speed update within a block.
+// Limits the number of updates sent to spindles controlled over a serial link, e.g. Modbus VFDs.
+#ifndef CSS_RPM_HYSTERESIS
+#define CSS_RPM_HYSTERESIS 1.0f
+#endif
+
+#ifndef JOG_VELOCITY_SEGMENTS
+#define JOG_VELOCITY_SEGMENTS 3
+#endif
+
 typedef enum {
     Ramp_Accel,
     Ramp_Cruise,
@@ -56,22 +75,69 @@ typedef union {
     };
 } prep_flags_t;
 
+#ifdef ENABLE_JERK_ACCELERATION
+
+// Jerk limited (S-curve) ramp. The ramp is shaped to complete in the same time and distance as the
+// planned constant acceleration ramp, thus the planner is not affected. Acceleration is ramped up
+// and down at the jerk limit with a constant acceleration phase in between if the ramp is long enough.
+typedef struct {
+    float v0;       // Speed at start of ramp (mm/min)
+    float v1;       // Speed at end of ramp (mm/min)
+    float mm;       // Ramp distance (mm)
+    float start_mm; // Ramp start measured from end of block (mm)
+    float t;        // Elapsed ramp time (min)
+    float t_end;    // Ramp duration (min)
+    float t_jerk;   // Duration of each of the jerk phases (min)
+    float jerk;     // Signed jerk (mm/min^3)
+    float accel;    // Signed acceleration of the constant acceleration phase (mm/min^2)
+} jerk_ramp_t;
+
+static THREAD_LOCAL jerk_ramp_t ramp;
+
+#endif
+
 // Holds the planner block Bresenham algorithm execution data for the segments in the segment
 // buffer. Normally, this buffer is partially in-use, but, for the worst case scenario, it will
-// never exceed the number of accessible stepper buffer segments (SEGMENT_BUFFER_SIZE-1).
+// never exceed the number of accessible stepper buffer segments (segment_buffer_size - 1).
+// With input shaping the blocks held by the shaper are added.
 // NOTE: This data is copied from the prepped planner blocks so that the planner blocks may be
 // discarded when entirely consumed and completed by the segment buffer. Also, AMASS alters this
 // data for its own use.
-static st_block_t st_block_buffer[SEGMENT_BUFFER_SIZE - 1];
+#ifdef ENABLE_INPUT_SHAPING
+#define ST_BLOCK_BUFFER_EXTRA INPUT_SHAPER_BLOCKS
+#else
+#define ST_BLOCK_BUFFER_EXTRA 0
+#endif
+static THREAD_LOCAL ISR_DATA st_block_t st_block_buffer_default[SEGMENT_BUFFER_SIZE - 1 + ST_BLOCK_BUFFER_EXTRA];
 
 // Primary stepper segment ring buffer. Contains small, short line segments for the stepper
 // algorithm to execute, which are "checked-out" incrementally from the first block in the
 // planner buffer. Once "checked-out", the steps in the segments buffer cannot be modified by
 // the planner, where the remaining planner block steps still can.
-static segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
+static THREAD_LOCAL ISR_DATA segment_t segment_buffer_default[SEGMENT_BUFFER_SIZE];
+
+// The number of segments is set by $389 at boot. The statically allocated buffers above are used unless
+// a larger size is set, the larger buffers are then allocated from the heap if memory permits.
+static THREAD_LOCAL st_block_t *st_block_buffer = st_block_buffer_default;
+static THREAD_LOCAL segment_t *segment_buffer = segment_buffer_default;
+static THREAD_LOCAL uint_fast8_t st_block_buffer_size = SEGMENT_BUFFER_SIZE - 1 + ST_BLOCK_BUFFER_EXTRA;
+static THREAD_LOCAL uint_fast8_t segment_buffer_size = SEGMENT_BUFFER_SIZE;
+
+#ifdef SEGMENT_PREP_WATERMARK
+#define PREP_WATERMARK SEGMENT_PREP_WATERMARK
+#else
+#define PREP_WATERMARK (segment_buffer_size / 2)
+#endif
 
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
-static stepper_t st;
+static THREAD_LOCAL ISR_DATA stepper_t st;
+
+// Bresenham state at the start of the executing segment, or at the last position commit.
+// Steps executed since are derived from the counters, sys_position is only updated when a segment is complete.
+static THREAD_LOCAL ISR_DATA struct {
+    uint32_t counter[N_AXIS];
+    uint_fast16_t step_count;
+} seg_start;
 
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
 typedef struct {
@@ -80,23 +146,41 @@ typedef struct {
     uint32_t level_3;
 } amass_t;
 
-static amass_t amass;
+static THREAD_LOCAL amass_t amass;
 #endif
 
 // Message to be output by foreground process
-static char *message = NULL; // TODO: do we need a queue for this?
+static THREAD_LOCAL volatile uint8_t message = 0; // TODO: do we need a queue for this?
 
 // Stepper timer ticks per minute
-static float cycles_per_min;
+static THREAD_LOCAL float cycles_per_min;
 
 // Step segment ring buffer indices
-static volatile segment_t *segment_buffer_tail;
-static segment_t *segment_buffer_head, *segment_next_head;
+static THREAD_LOCAL ISR_DATA volatile segment_t *segment_buffer_tail;
+static THREAD_LOCAL ISR_DATA segment_t *segment_buffer_head, *segment_next_head;
+
+// Interrupt driven segment prep state, used when the driver provides hal.stepper.prep_trigger.
+static THREAD_LOCAL volatile uint_fast8_t prep_lock = 0;     // Nesting count of foreground locks, prep is deferred when not zero
+static THREAD_LOCAL volatile bool prep_pending = false;      // Set when prep was deferred by a foreground lock
+
+// Instrumentation data, see st_get_stats()
+static THREAD_LOCAL volatile st_stats_t stats;
+static THREAD_LOCAL volatile bool motion_pending = false;    // Set by segment prep when there are more planner blocks to prep
+#ifdef ENABLE_MOTION_SYNC
+static THREAD_LOCAL volatile bool sync_idle = true;          // Slave only, steppers are woken up by the first segment received when set
+#endif
+#ifdef ENABLE_THREADING_PIPELINE
+static THREAD_LOCAL volatile bool stepper_idle = true;       // Cleared by st_wake_up(), set by st_go_idle()
+static THREAD_LOCAL bool prep_synchronized = false;          // Set when the last block loaded for prep was spindle synchronized
+#endif
+static THREAD_LOCAL float laser_ppi_distance = 0.0f;         // Distance between laser pulses in PPI mode (mm), 0 if not in PPI mode
+static THREAD_LOCAL uint32_t sample_cycles = 0;              // Step timer cycles into the current tick, carried between st_sample_position() calls
 
 // Pointers for the step segment being prepped from the planner buffer. Accessed only by the
-// main program. Pointers may be planning segments or planner blocks ahead of what being executed.
-static plan_block_t *pl_block;     // Pointer to the planner block being prepped
-static st_block_t *st_prep_block;  // Pointer to the stepper block data being prepped
+// main program or the segment prep interrupt. Pointers may be planning segments or planner blocks
+// ahead of what being executed.
+static THREAD_LOCAL plan_block_t *pl_block;     // Pointer to the planner block being prepped
+static THREAD_LOCAL st_block_t *st_prep_block;  // Pointer to the stepper block data being prepped
 
 // Segment preparation data struct. Contains all the necessary information to compute new segments
 // based on the current executing planner block.
@@ -125,10 +209,151 @@ typedef struct {
     float target_feed;      //
     float inv_feedrate;     // Used by PWM laser mode to speed up segment calculations.
     float current_spindle_rpm;
+#ifdef ENABLE_LASER_PWM_TRACKING
+    uint_fast16_t spindle_pwm;    // PWM value of the last prepped segment updating the spindle
+    bool spindle_pwm_valid;       // Set when spindle_pwm is the value output by the stepper ISR when the next segment is loaded
+#endif
+#ifdef ENABLE_NATIVE_ARCS
+    int32_t arc_position[N_AXIS]; // End position of the last arc chord relative to the block start (steps)
+    bool arc_chord;               // Set when the stepper block of the first arc chord is used
+#endif
+#ifdef ENABLE_INPUT_SHAPING
+    bool shaped;                  // Set when the segments of the block are input to the shaper
+#endif
 } st_prep_t;
 
-static st_prep_t prep;
+static THREAD_LOCAL st_prep_t prep;
+
+#ifdef ENABLE_INPUT_SHAPING
+
+#define SHAPER_IMPULSES_MAX 9 // Two cascaded shapers of three impulses
+#define SHAPER_DURATION_MAX (DT_SEGMENT * (float)(INPUT_SHAPER_SAMPLES - 8) / 2.0f) // min
+
+// Path position at the end of a segment generated from the planner blocks, the shaper input.
+typedef struct {
+    float t;                        // Time (min)
+    float s;                        // Path position (mm)
+} shaper_sample_t;
+
+// Planner block being output by the shaper, steps are output from the shaped path position.
+typedef struct {
+    st_block_t *st_block;           // Stepper block data of the planner block
+    float end;                      // Path position at the end of the block (mm)
+    float steps_per_mm;
+    float dt_remainder;             // Partial step time carried over to the next output segment (min)
+    uint32_t steps_remaining;       // Steps remaining to be output
+    bool update_rpm;                // Set when the spindle speed is to be updated by the next output segment
+#ifdef SPINDLE_PWM_DIRECT
+    uint_fast16_t spindle_pwm;
+#else
+    float spindle_rpm;
+#endif
+} shaper_block_t;
+
+// Input shaper state. The path position generated from the planner blocks is convolved with a train of impulses that
+// cancels vibration at the shaper frequencies, step segments are output from the shaped path position. Motion along
+// the path is thus retimed, the path is not changed. Path position is measured from the start of the oldest block.
+typedef struct {
+    bool active;                    // Set while shaped motion is being output
+    bool stalled;                   // Set while input is stalled by lack of room for blocks
+    uint_fast8_t n_impulses;
+    float amplitude[SHAPER_IMPULSES_MAX];
+    float delay[SHAPER_IMPULSES_MAX];   // (min)
+    float duration;                 // Delay of the last impulse (min), 0 if shaping is off
+    float t;                        // Time at the end of the output (min)
+    float s;                        // Shaped path position at the end of the output (mm)
+    uint_fast8_t sample_tail;
+    uint_fast8_t n_samples;
+    shaper_sample_t sample[INPUT_SHAPER_SAMPLES];
+    uint_fast8_t block_tail;
+    uint_fast8_t n_blocks;
+    shaper_block_t block[INPUT_SHAPER_BLOCKS];
+} input_shaper_t;
+
+static THREAD_LOCAL input_shaper_t shaper;
+
+#endif
+
 
+#ifdef ENABLE_JERK_ACCELERATION
+
+// Initializes a jerk limited ramp from speed v0 to v1 over the distance start_mm - end_mm (measured from end of block).
+static void jerk_ramp_init (float v0, float v1, float start_mm, float end_mm, float jerk)
+{
+    float dv = fabsf(v1 - v0);
+
+    ramp.v0 = v0;
+    ramp.v1 = v1;
+    ramp.start_mm = start_mm;
+    ramp.mm = start_mm - end_mm;
+    ramp.t = ramp.t_end = ramp.t_jerk = ramp.jerk = 0.0f;
+
+    if(ramp.mm <= 0.0f || dv == 0.0f)
+        return;
+
+    ramp.t_end = 2.0f * ramp.mm / (v0 + v1); // Same duration as the planned constant acceleration ramp.
+
+    if(jerk <= 0.0f) // Jerk limit disabled, constant acceleration.
+        ramp.accel = dv / ramp.t_end;
+    else if(jerk * ramp.t_end * ramp.t_end <= 4.0f * dv) {
+        // Ramp is too short to reach a constant acceleration phase at the jerk limit, use
+        // the lowest possible jerk instead.
+        ramp.t_jerk = 0.5f * ramp.t_end;
+        ramp.accel = 2.0f * dv / ramp.t_end;
+    } else {
+        // Solve dv = accel * (t_end - accel / jerk) for the acceleration.
+        float jt = jerk * ramp.t_end;
+        ramp.accel = 0.5f * (jt - sqrtf(jt * jt - 4.0f * jerk * dv));
+        ramp.t_jerk = ramp.accel / jerk;
+    }
+
+    if(ramp.t_jerk > 0.0f)
+        ramp.jerk = ramp.accel / ramp.t_jerk;
+
+    if(v1 < v0) {
+        ramp.accel = -ramp.accel;
+        ramp.jerk = -ramp.jerk;
+    }
+}
+
+// Advances the ramp by *dt and returns the distance remaining of the block and the speed reached.
+// Returns false at end of the ramp with *dt set to the remaining ramp time.
+static bool jerk_ramp_step (float *dt, float *mm_remaining, float *speed)
+{
+    float t, s;
+
+    if((t = ramp.t + *dt) >= ramp.t_end) {
+        *dt = ramp.t_end - ramp.t;
+        ramp.t = ramp.t_end;
+        return false;
+    }
+
+    if(t < ramp.t_jerk) { // Acceleration ramping up.
+        *speed = ramp.v0 + 0.5f * ramp.jerk * t * t;
+        s = t * (ramp.v0 + ramp.jerk * t * t * (1.0f / 6.0f));
+    } else if(t <= ramp.t_end - ramp.t_jerk) { // Constant acceleration.
+        float v_jerk = ramp.v0 + 0.5f * ramp.accel * ramp.t_jerk, tc = t - ramp.t_jerk;
+        *speed = v_jerk + ramp.accel * tc;
+        s = ramp.t_jerk * (ramp.v0 + ramp.accel * ramp.t_jerk * (1.0f / 6.0f)) + tc * (v_jerk + 0.5f * ramp.accel * tc);
+    } else { // Acceleration ramping down, mirrored from end of ramp.
+        float tr = ramp.t_end - t;
+        *speed = ramp.v1 - 0.5f * ramp.jerk * tr * tr;
+        s = ramp.mm - tr * (ramp.v1 - ramp.jerk * tr * tr * (1.0f / 6.0f));
+    }
+
+    if(s >= ramp.mm) { // Round-off, treat as end of ramp.
+        *dt = ramp.t_end - ramp.t;
+        ramp.t = ramp.t_end;
+        return false;
+    }
+
+    ramp.t = t;
+    *mm_remaining = ramp.start_mm - s;
+
+    return true;
+}
+
+#endif
 
 /*    BLOCK VELOCITY PROFILE DEFINITION
           __________________________
@@ -174,9 +399,9 @@ static st_prep_t prep;
 static void output_message (uint_fast16_t state)
 {
     if(message) {
-        report_message(message, Message_Plain);
-        free(message);
-        message = NULL;
+        report_message(pool_get_message(message), Message_Plain);
+        pool_release_message(message);
+        message = 0;
     }
 }
 
@@ -198,10 +423,67 @@ void st_wake_up ()
     // cancel any pending steppers deenergize
     st.exec_block = NULL;
     sys.steppers_deenergize = false;
+    sample_cycles = 0;
+#ifdef ENABLE_THREADING_PIPELINE
+    stepper_idle = false;
+#endif
 
     hal.stepper.wake_up();
 }
 
+// Enables the stepper drivers ahead of st_wake_up() so that the driver enable delay overlaps
+// segment buffer prep, cancels any pending deenergize.
+void st_energize (void)
+{
+    sys.steppers_deenergize = false;
+    hal.stepper.enable((axes_signals_t){AXES_BITMASK});
+}
+
+// Returns the number of steps executed for an axis by the current segment since the segment start or the last commit.
+// Each tick adds st.steps[idx] to the counter and each step subtracts st.step_event_count from it.
+ISR_CODE static inline int32_t segment_steps (uint_fast8_t idx, uint_fast16_t ticks)
+{
+    int32_t steps = (int32_t)(((uint64_t)seg_start.counter[idx] + (uint64_t)ticks * st.steps[idx] - st.counter[idx]) / st.step_event_count);
+
+    return (st.dir_outbits.mask & bit(idx)) ? -steps : steps;
+}
+
+// Adds the steps executed by the current segment to sys_position and restarts step accounting from the current state.
+ISR_CODE static void st_commit_position (void)
+{
+    uint_fast8_t idx = N_AXIS;
+    uint_fast16_t ticks = seg_start.step_count - st.step_count;
+
+    if(ticks) do {
+        idx--;
+        sys_position[idx] += segment_steps(idx, ticks);
+    } while(idx);
+
+    memcpy(seg_start.counter, st.counter, sizeof(seg_start.counter));
+    seg_start.step_count = st.step_count;
+}
+
+// Copies the real-time machine position in steps, sys_position plus the steps executed by the current segment.
+// Safe to call from the foreground process, reads are repeated if the stepper interrupt executes a tick meanwhile.
+ISR_CODE void st_get_position (int32_t *position)
+{
+    uint_fast8_t idx;
+    uint_fast16_t step_count;
+    segment_t *segment;
+
+    do {
+        segment = *(segment_t * volatile *)&st.exec_segment;
+        step_count = *(volatile uint_fast16_t *)&st.step_count;
+        memcpy(position, sys_position, sizeof(sys_position));
+        if(segment && seg_start.step_count != step_count) {
+            idx = N_AXIS;
+            do {
+                idx--;
+                position[idx] += segment_steps(idx, seg_start.step_count - step_count);
+            } while(idx);
+        }
+    } while(segment != *(segment_t * volatile *)&st.exec_segment || step_count != *(volatile uint_fast16_t *)&st.step_count);
+}
 
 // Stepper shutdown
 ISR_CODE void st_go_idle ()
@@ -210,6 +492,17 @@ ISR_CODE void st_go_idle ()
 
     hal.stepper.go_idle(false);
 
+    // Commit steps of a segment aborted before completion.
+    if(st.exec_segment)
+        st_commit_position();
+
+#ifdef ENABLE_MOTION_SYNC
+    sync_idle = true;
+#endif
+#ifdef ENABLE_THREADING_PIPELINE
+    stepper_idle = true;
+#endif
+
     // Set stepper driver idle state, disabled or enabled, depending on settings and circumstances.
     if (((settings.steppers.idle_lock_time != 255) || sys_rt_exec_alarm || sys.state == STATE_SLEEP) && sys.state != STATE_HOMING) {
         // Force stepper dwell to lock axes for a defined amount of time to ensure the axes come to a complete
@@ -266,340 +559,1657 @@ ISR_CODE void st_go_idle ()
    ISR is 5usec typical and 25usec maximum, well below requirement.
    NOTE: This ISR expects at least one step to be executed per segment.
 */
-ISR_CODE void stepper_driver_interrupt_handler (void)
-{
+// Bresenham line algorithm step for one axis, sets the axis step bit when a step is due.
+// NOTE: the machine position is committed from the counters when the segment is complete, see st_commit_position().
+#define bresenham_step(idx, bit) \
+    st.counter[idx] += st.steps[idx]; \
+    if (st.counter[idx] > st.step_event_count) { \
+        step_outbits.mask |= bit; \
+        st.counter[idx] -= st.step_event_count; \
+    }
+
 #ifdef ENABLE_BACKLASH_COMPENSATION
-    static bool backlash_motion;
+static THREAD_LOCAL axes_signals_t backlash_pending;     // Axes with backlash takeup steps remaining for the executing block
+static THREAD_LOCAL uint32_t backlash_steps[N_AXIS];     // Backlash takeup steps remaining
 #endif
 
-    // Start a step pulse when there is a block to execute.
-    if(st.exec_block) {
+#ifdef ENABLE_JOG_VELOCITY
 
-        hal.stepper.pulse_start(&st);
+// Velocity jog state. Segments are generated directly from the target velocity, the planner is not used.
+typedef struct {
+    bool active;                    // Set while velocity jogging, cleared by st_jog_velocity_end()
+    volatile bool ended;            // Set by the stepper ISR when motion is complete
+    bool stopped;                   // Set when decelerated to standstill with no new target, no more segments are generated
+    bool target_pending;            // Set when a new target velocity is to be adopted
+    float target[N_AXIS];           // Target velocity per axis (mm/min)
+    float unit_vec[N_AXIS];         // Direction of motion
+    float max_speed;                // Target speed along unit_vec (mm/min)
+    float speed;                    // Current speed along unit_vec (mm/min)
+    float acceleration;             // Acceleration along unit_vec (mm/min^2)
+    float distance;                 // Remaining distance along unit_vec before soft limits are reached (mm)
+    float position[N_AXIS];         // Position relative to jog start (steps, fractional)
+    int32_t steps[N_AXIS];          // Steps generated relative to jog start
+    int32_t start[N_AXIS];          // Machine position at jog start (steps)
+    on_execute_realtime_ptr on_completed;
+} jog_velocity_t;
+
+static THREAD_LOCAL jog_velocity_t jog;
 
-        st.new_block = st.dir_change = false;
+#endif
 
-        if (st.step_count == 0) // Segment is complete. Discard current segment.
-            st.exec_segment = NULL;
+#ifdef ENABLE_LASER_PWM_TRACKING
+
+// Laser power ramp state for the executing segment.
+typedef struct {
+    uint32_t value;             // Fixed point (16.16) PWM value
+    int32_t step;               // Fixed point increment per step tick, 0 if not ramping
+    uint_fast16_t pwm;          // PWM value last output
+    uint_fast16_t target;       // PWM value at end of segment
+} pwm_ramp_t;
+
+static THREAD_LOCAL pwm_ramp_t pwm_ramp;
+
+#endif
+
+#ifdef ENABLE_LASER_RASTER
+
+// Laser raster output state for the executing block. Position is tracked in step event count units
+// of the block, pixel boundaries are at multiples of step_event_count / length kept exact by a
+// Bresenham style remainder so that no division is needed per pixel.
+typedef struct {
+    const uint8_t *pixel;       // Next pixel to output
+    uint_fast16_t remaining;    // Number of pixels not yet output
+    uint_fast16_t length;       // Number of pixels in the block
+    uint32_t position;          // Block position
+    uint32_t increment;         // Block position increment per step tick for the AMASS level of the executing segment
+    uint32_t next;              // Block position of next pixel boundary
+    uint32_t pitch;             // Pixel pitch, integer part
+    uint32_t pitch_rem;         // Pixel pitch, remainder part
+    uint32_t error;             // Pixel pitch, accumulated remainder
+} st_raster_t;
+
+static THREAD_LOCAL st_raster_t raster;
+
+ISR_CODE static inline void raster_output (void)
+{
+    uint_fast8_t power = *raster.pixel++;
+
+  #ifdef SPINDLE_PWM_DIRECT
+    hal.spindle.update_pwm(power ? st.exec_block->raster_pwm_min + ((st.exec_block->raster_pwm_span * (power + 1)) >> 8) : st.exec_block->raster_pwm_off);
+  #else
+    hal.spindle.update_rpm(st.exec_block->raster_rpm * (float)power * (1.0f / 255.0f));
+  #endif
+
+    raster.remaining--;
+    raster.next += raster.pitch;
+    if((raster.error += raster.pitch_rem) >= raster.length) {
+        raster.error -= raster.length;
+        raster.next++;
     }
+}
 
-    // If there is no step segment, attempt to pop one from the stepper buffer
-    if (st.exec_segment == NULL) {
-        // Anything in the buffer? If so, load and initialize next step segment.
-        if (segment_buffer_head != segment_buffer_tail) {
+#endif
+
+// Pops the next segment from the stepper buffer and initializes the stepper variables for it.
+// Returns false if the buffer is empty, the steppers are then set idle and cycle complete flagged.
+ISR_CODE static inline bool st_load_segment (void)
+{
+    // Anything in the buffer? If so, load and initialize next step segment.
+    if (segment_buffer_head != segment_buffer_tail) {
+
+#ifdef ENABLE_MOTION_SYNC
+        // Slaves wait for the sync pulse from the master, ticks meanwhile must not output steps.
+        if(!motion_sync_segment_start()) {
+            st.step_outbits.value = 0;
+            return false;
+        }
+#endif
 
-            // Initialize new step segment and load number of steps to execute
-            st.exec_segment = (segment_t *)segment_buffer_tail;
+        // Initialize new step segment and load number of steps to execute
+        st.exec_segment = (segment_t *)segment_buffer_tail;
 
-            // Initialize step segment timing per step and load number of steps to execute.
-            hal.stepper.cycles_per_tick(st.exec_segment->cycles_per_tick);
-            st.step_count = st.exec_segment->n_step; // NOTE: Can sometimes be zero when moving slow.
+        // Initialize step segment timing per step and load number of steps to execute.
+        hal.stepper.cycles_per_tick(st.exec_segment->cycles_per_tick);
+        st.step_count = st.exec_segment->n_step ? st.exec_segment->n_step : 1; // NOTE: n_step can sometimes be zero when moving slow, one tick is still executed.
+        st.amass_level = st.exec_segment->amass_level;
+        memcpy(st.steps, st.exec_segment->steps, sizeof(st.steps)); // Axis increments precomputed by segment prep
 
-            // If the new segment starts a new planner block, initialize stepper variables and counters.
-            if (st.exec_block != st.exec_segment->exec_block) {
+        // If the new segment starts a new planner block, initialize stepper variables and counters.
+        if (st.exec_block != st.exec_segment->exec_block) {
 
-                if((st.dir_change = st.exec_block == NULL || st.dir_outbits.value != st.exec_segment->exec_block->direction_bits.value))
-                    st.dir_outbits = st.exec_segment->exec_block->direction_bits;
-                st.exec_block = st.exec_segment->exec_block;
-                st.step_event_count = st.exec_block->step_event_count;
-                st.new_block = true;
+            if((st.dir_change = st.exec_block == NULL || st.dir_outbits.value != st.exec_segment->exec_block->direction_bits.value))
+                st.dir_outbits = st.exec_segment->exec_block->direction_bits;
+            st.exec_block = st.exec_segment->exec_block;
+            st.step_event_count = st.exec_block->step_event_count;
+            st.new_block = true;
 #ifdef ENABLE_BACKLASH_COMPENSATION
-                backlash_motion = st.exec_block->backlash_motion;
+            backlash_pending.mask = 0;
+            memcpy(backlash_steps, st.exec_block->backlash_steps, sizeof(backlash_steps));
 #endif
 
-                if(st.exec_block->overrides.sync)
-                    sys.override.control = st.exec_block->overrides;
+            if(st.exec_block->overrides.sync)
+                sys.override.control = st.exec_block->overrides;
+
+            // Execute output commands to be syncronized with motion, digital outputs are collected and set together
+            if(st.exec_block->output_commands) {
 
-                // Execute output commands to be syncronized with motion
-                while(st.exec_block->output_commands) {
+                uint32_t out_mask = 0, out_value = 0;
+
+                do {
                     output_command_t *cmd = st.exec_block->output_commands;
                     cmd->is_executed = true;
-                    if(cmd->is_digital)
-                        hal.port.digital_out(cmd->port, cmd->value != 0.0f);
-                    else
+                    if(cmd->is_coolant)
+                        coolant_set_state((coolant_state_t){ .value = (uint8_t)cmd->value });
+                    else if(!cmd->is_digital)
                         hal.port.analog_out(cmd->port, cmd->value);
-                    st.exec_block->output_commands = cmd->next;
-                }
-
-                // Enqueue any message to be printed (by foreground process)
-                if(st.exec_block->message) {
-                    if(message == NULL) {
-                        message = st.exec_block->message;
-                        protocol_enqueue_rt_command(output_message);
+                    else if(cmd->port < 32) {
+                        out_mask |= bit(cmd->port);
+                        if(cmd->value != 0.0f)
+                            out_value |= bit(cmd->port);
+                        else
+                            out_value &= ~bit(cmd->port);
                     } else
-                        free(st.exec_block->message); //
-                    st.exec_block->message = NULL;
+                        hal.port.digital_out(cmd->port, cmd->value != 0.0f);
+                    st.exec_block->output_commands = cmd->next;
+                } while(st.exec_block->output_commands);
+
+                if(out_mask) {
+                    if(hal.port.digital_out_mask)
+                        hal.port.digital_out_mask(out_mask, out_value);
+                    else {
+                        uint_fast8_t port = 0;
+                        do {
+                            if(out_mask & 0x01)
+                                hal.port.digital_out(port, out_value & 0x01);
+                            port++;
+                            out_value >>= 1;
+                        } while(out_mask >>= 1);
+                    }
                 }
+            }
 
-                // Initialize Bresenham line and distance counters
-                st.counter_x = st.counter_y = st.counter_z
-                #ifdef A_AXIS
-                  = st.counter_a
-                #endif
-                #ifdef B_AXIS
-                  = st.counter_b
-                #endif
-                #ifdef C_AXIS
-                  = st.counter_c
-                #endif
-                  = st.step_event_count >> 1;
+            // Enqueue any message to be printed (by foreground process)
+            if(st.exec_block->message) {
+                if(message == 0) {
+                    message = st.exec_block->message;
+                    protocol_enqueue_rt_command(output_message);
+                } else
+                    pool_release_message(st.exec_block->message);
+                st.exec_block->message = 0;
+            }
 
-              #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-                memcpy(st.steps, st.exec_block->steps, sizeof(st.steps));
-              #endif
+#ifdef ENABLE_LASER_RASTER
+            if((raster.remaining = raster.length = st.exec_block->raster ? st.exec_block->raster->length : 0)) {
+                raster.pixel = st.exec_block->raster->pixel;
+                raster.pitch = st.step_event_count / raster.length;
+                raster.pitch_rem = st.step_event_count % raster.length;
+                raster.position = raster.next = raster.error = 0;
+                raster_output();
             }
+#endif
 
-          #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-            // With AMASS enabled, adjust Bresenham axis increment counters according to AMASS level.
-            st.amass_level = st.exec_segment->amass_level;
-            st.steps[X_AXIS] = st.exec_block->steps[X_AXIS] >> st.amass_level;
-            st.steps[Y_AXIS] = st.exec_block->steps[Y_AXIS] >> st.amass_level;
-            st.steps[Z_AXIS] = st.exec_block->steps[Z_AXIS] >> st.amass_level;
-           #ifdef A_AXIS
-            st.steps[A_AXIS] = st.exec_block->steps[A_AXIS] >> st.amass_level;
-           #endif
-           #ifdef B_AXIS
-            st.steps[B_AXIS] = st.exec_block->steps[B_AXIS] >> st.amass_level;
-           #endif
-           #ifdef C_AXIS
-            st.steps[C_AXIS] = st.exec_block->steps[C_AXIS] >> st.amass_level;
-           #endif
-         #endif
+            // Initialize Bresenham line and distance counters
+            uint_fast8_t idx = N_AXIS;
+            do {
+                st.counter[--idx] = st.step_event_count >> 1;
+#ifdef ENABLE_BACKLASH_COMPENSATION
+                if(backlash_steps[idx])
+                    backlash_pending.mask |= bit(idx);
+#endif
+            } while(idx);
+        }
 
-            if(st.exec_segment->update_rpm) {
-              #ifdef SPINDLE_PWM_DIRECT
-                hal.spindle.update_pwm(st.exec_segment->spindle_pwm);
-              #else
-                hal.spindle.update_rpm(st.exec_segment->spindle_rpm);
-              #endif
-            }
-        } else {
-            // Segment buffer empty. Shutdown.
-            st_go_idle();
-            // Ensure pwm is set properly upon completion of rate-controlled motion.
-            if (st.exec_block->dynamic_rpm && settings.mode == Mode_Laser)
-                hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+        memcpy(seg_start.counter, st.counter, sizeof(seg_start.counter));
+        seg_start.step_count = st.step_count;
 
-            system_set_exec_state_flag(EXEC_CYCLE_COMPLETE); // Flag main program for cycle complete
+#ifdef ENABLE_LASER_RASTER
+      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        raster.increment = 1 << (MAX_AMASS_LEVEL - st.amass_level);
+      #else
+        raster.increment = 2;
+      #endif
+#endif
 
-            return; // Nothing to do but exit.
+        if(st.exec_segment->update_rpm) {
+          #ifdef SPINDLE_PWM_DIRECT
+           #ifdef ENABLE_LASER_PWM_TRACKING
+            // Ramp starts from the power at the end of the previous segment, which is already output.
+            if((pwm_ramp.step = st.exec_segment->spindle_pwm_step))
+                pwm_ramp.value = (uint32_t)pwm_ramp.target << 16;
+            else
+                hal.spindle.update_pwm(pwm_ramp.pwm = st.exec_segment->spindle_pwm);
+            pwm_ramp.target = st.exec_segment->spindle_pwm;
+           #else
+            hal.spindle.update_pwm(st.exec_segment->spindle_pwm);
+           #endif
+          #else
+            hal.spindle.update_rpm(st.exec_segment->spindle_rpm);
+          #endif
+        }
+#ifdef ENABLE_LASER_PWM_TRACKING
+        else if(pwm_ramp.step) {
+            // Ramp complete, output end value as the ramp may fall short of it by rounding.
+            pwm_ramp.step = 0;
+            if(pwm_ramp.pwm != pwm_ramp.target)
+                hal.spindle.update_pwm(pwm_ramp.pwm = pwm_ramp.target);
+        }
+#endif
+    } else {
+        // Segment buffer empty. Shutdown.
+        // Count as underrun if motion is still pending.
+        if(motion_pending && !(sys.step_control.end_motion || sys.step_control.execute_sys_motion))
+            stats.underruns++;
+        st_go_idle();
+#ifdef ENABLE_JOG_VELOCITY
+        // Velocity jog ends when the segment buffer runs dry, notify foreground process for position sync.
+        if(jog.active && !jog.ended) {
+            jog.ended = true;
+            if(jog.on_completed)
+                protocol_enqueue_rt_command(jog.on_completed);
         }
+#endif
+        // Ensure pwm is set properly upon completion of rate-controlled motion.
+        if (st.exec_block->dynamic_rpm && settings.mode == Mode_Laser)
+            hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+
+        system_set_exec_state_flag(EXEC_CYCLE_COMPLETE); // Flag main program for cycle complete
+
+        return false; // Nothing to do but exit.
+    }
+
+    return true;
+}
+
+// Commits the steps of the completed segment to the machine position and advances the segment tail pointer.
+ISR_CODE static inline void st_segment_complete (void)
+{
+    st_commit_position();
+    segment_buffer_tail = segment_buffer_tail->next;
+    // Track the segment buffer fill level while there is more to prep, and trigger prep when it drops below the watermark.
+    if(motion_pending) {
+        uint_fast8_t level = (segment_buffer_head->id + segment_buffer_size - segment_buffer_tail->id) % segment_buffer_size;
+        if(level < stats.segment_buffer_min)
+            stats.segment_buffer_min = level;
+        if(level < PREP_WATERMARK && hal.stepper.prep_trigger)
+            hal.stepper.prep_trigger();
     }
+}
 
+// Executes one step tick of the current segment, the step bits to output are returned in st.step_outbits.
+ISR_CODE static inline void st_step (void)
+{
     // Check probing state.
     // Monitors probe pin state and records the system position when detected.
     // NOTE: This function must be extremely efficient as to not bog down the stepper ISR.
     if (sys_probing_state == Probing_Active && hal.probe.get_state().triggered) {
         sys_probing_state = Probing_Off;
-        memcpy(sys_probe_position, sys_position, sizeof(sys_position));
+        st_get_position(sys_probe_position);
         bit_true(sys_rt_exec_state, EXEC_MOTION_CANCEL);
     }
 
     register axes_signals_t step_outbits = (axes_signals_t){0};
 
-    // Execute step displacement profile by Bresenham line algorithm
+    // Execute step displacement profile by Bresenham line algorithm, expanded for each axis at compile time
+
+    bresenham_step(X_AXIS, X_AXIS_BIT);
+    bresenham_step(Y_AXIS, Y_AXIS_BIT);
+    bresenham_step(Z_AXIS, Z_AXIS_BIT);
+  #ifdef A_AXIS
+    bresenham_step(A_AXIS, A_AXIS_BIT);
+  #endif
+  #ifdef B_AXIS
+    bresenham_step(B_AXIS, B_AXIS_BIT);
+  #endif
+  #ifdef C_AXIS
+    bresenham_step(C_AXIS, C_AXIS_BIT);
+  #endif
+
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    // Take up backlash of reversing axes by extra steps output on the ticks where the axis does not step,
+    // starting with the block. Machine position is not updated for these as the axis does not move.
+    if(backlash_pending.mask) {
+        uint_fast8_t idx = N_AXIS;
+        do {
+            idx--;
+            if((backlash_pending.mask & bit(idx)) && !(step_outbits.mask & bit(idx))) {
+                step_outbits.mask |= bit(idx);
+                if(--backlash_steps[idx] == 0)
+                    backlash_pending.mask &= ~bit(idx);
+            }
+        } while(idx);
+    }
+#endif
+
+#ifdef ENABLE_LASER_RASTER
+    if(raster.remaining && (raster.position += raster.increment) >= raster.next)
+        raster_output();
+#endif
+
+#ifdef ENABLE_LASER_PWM_TRACKING
+    if(pwm_ramp.step) {
+        uint_fast16_t pwm = (pwm_ramp.value += (uint32_t)pwm_ramp.step) >> 16;
+        if(pwm != pwm_ramp.pwm)
+            hal.spindle.update_pwm(pwm_ramp.pwm = pwm);
+    }
+#endif
+
+    st.step_outbits.value = step_outbits.value;
+
+    // During a homing cycle, lock out and prevent desired axes from moving.
+    if (sys.state == STATE_HOMING)
+        st.step_outbits.value &= sys.homing_axis_lock.mask;
+
+    if (st.step_count == 0 || --st.step_count == 0) // Segment is complete.
+        st_segment_complete();
+}
+
+ISR_CODE void stepper_driver_interrupt_handler (void)
+{
+    uint32_t cycles = hal.get_cycle_count ? hal.get_cycle_count() : 0;
+
+    // Start a step pulse when there is a block to execute.
+    if(st.exec_block) {
+
+        hal.stepper.pulse_start(&st);
+
+        st.new_block = st.dir_change = false;
+
+        if (st.step_count == 0) // Segment is complete. Discard current segment.
+            st.exec_segment = NULL;
+    }
+
+    // If there is no step segment, attempt to pop one from the stepper buffer
+    if (st.exec_segment == NULL && !st_load_segment())
+        return;
+
+    st_step();
+
+    if(hal.get_cycle_count) {
+        cycles = hal.get_cycle_count() - cycles;
+        if(cycles < stats.isr_cycles_min)
+            stats.isr_cycles_min = cycles;
+        if(cycles > stats.isr_cycles_max)
+            stats.isr_cycles_max = cycles;
+        stats.isr_cycles_avg = stats.isr_cycles_avg + (int32_t)(cycles - stats.isr_cycles_avg) / 16;
+    }
+}
+
+// Fills pattern with up to count step bit patterns from the current segment, for drivers that output steps
+// by DMA or a timer driven pattern generator instead of an interrupt per step.
+// Updates count to the number of patterns generated and returns a pointer to the stepper data, cycles_per_tick
+// is set to the step rate of the segment. The direction bits to be output before the first step are in dir_outbits.
+// Returns NULL if there is nothing to stream or the streaming is not possible (homing or probing),
+// the driver should then fall back to calling stepper_driver_interrupt_handler() on each step.
+// NOTE: The machine position is updated ahead of the motion, one call never generates patterns spanning two segments.
+ISR_CODE stepper_t *st_stream_segment (axes_signals_t *pattern, uint_fast16_t *count, uint32_t *cycles_per_tick)
+{
+    uint_fast16_t n = 0;
+
+    if(sys.state == STATE_HOMING || sys_probing_state != Probing_Off)
+        return NULL;
+
+    st.new_block = st.dir_change = false;
+
+    if (st.exec_segment == NULL && !st_load_segment())
+        return NULL;
+
+    *cycles_per_tick = st.exec_segment->cycles_per_tick;
+
+    do {
+        st_step();
+        pattern[n++] = st.step_outbits;
+    } while(st.step_count && n < *count);
+
+    *count = n;
+    st.step_outbits.value = 0; // Already streamed, must not be output again by the stepper interrupt
+
+    if (st.step_count == 0) // Segment is complete. Discard current segment.
+        st.exec_segment = NULL;
+
+    return &st;
+}
+
+// Advances the Bresenham counters of the current segment by ticks without generating step patterns.
+// The number of steps taken by an axis is the number of times the counter exceeds step_event_count.
+ISR_CODE static inline void st_advance (uint32_t ticks)
+{
+    uint64_t total;
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        if((total = (uint64_t)st.counter[idx] + (uint64_t)ticks * st.steps[idx]))
+            st.counter[idx] = (uint32_t)(total - ((total - 1) / st.step_event_count) * st.step_event_count);
+    } while(idx);
+
+    st.step_count -= ticks;
+}
+
+// Executes motion for cycles step timer cycles and returns the commanded position in steps, for drivers that
+// stream positions to networked servo drives at a fixed rate instead of outputting step pulses.
+// The position includes the fraction of a step the Bresenham counters are into the next step, cycles not making up
+// a whole tick are carried over to the next call. Returns false when there is no motion to execute.
+// Called via hal.stepper.position_callback, the driver should start its fixed rate timer in hal.stepper.wake_up()
+// and call this on each period until hal.stepper.go_idle() is called.
+// NOTE: No step patterns are generated, homing, backlash compensation, laser raster output and
+//       laser PWM ramping are not supported. The probe is checked once per call.
+ISR_CODE bool st_sample_position (uint32_t cycles, float *position)
+{
+    bool moving = false;
+    uint_fast8_t idx;
+    uint32_t ticks, sec;
+    int32_t steps[N_AXIS];
+
+    if (sys_probing_state == Probing_Active && hal.probe.get_state().triggered) {
+        sys_probing_state = Probing_Off;
+        st_get_position(sys_probe_position);
+        bit_true(sys_rt_exec_state, EXEC_MOTION_CANCEL);
+    }
+
+    cycles += sample_cycles;
+    sample_cycles = 0;
+
+    while(cycles) {
+
+        st.new_block = st.dir_change = false;
+
+        if (st.exec_segment == NULL && !st_load_segment())
+            break;
+
+        moving = true;
+
+        if((ticks = cycles / st.exec_segment->cycles_per_tick) >= st.step_count) {
+            // Segment is complete within the period, continue with the next one.
+            cycles -= st.step_count * st.exec_segment->cycles_per_tick;
+            st_advance(st.step_count);
+            st_segment_complete();
+            st.exec_segment = NULL;
+        } else {
+            if(ticks)
+                st_advance(ticks);
+            sample_cycles = cycles - ticks * st.exec_segment->cycles_per_tick;
+            cycles = 0;
+        }
+    }
+
+    st_get_position(steps);
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        position[idx] = (float)steps[idx];
+        // Add the fraction of a step the axis is into the next step, counters start at half of step_event_count.
+        if(st.exec_block) {
+            sec = st.step_event_count;
+            float fraction = ((float)st.counter[idx] - (float)(sec >> 1)) / (float)sec;
+            if(st.exec_segment && sample_cycles)
+                fraction += (float)st.steps[idx] * (float)sample_cycles / ((float)st.exec_segment->cycles_per_tick * (float)sec);
+            position[idx] += (st.dir_outbits.mask & bit(idx)) ? -fraction : fraction;
+        }
+    } while(idx);
+
+    return moving;
+}
+
+#ifdef ENABLE_MOTION_SYNC
 
-    st.counter_x += st.steps[X_AXIS];
-    if (st.counter_x > st.step_event_count) {
-        step_outbits.x = On;
-        st.counter_x -= st.step_event_count;
+// Adds the Bresenham data of a block received from the master, segments added after refers to it.
+// Returns false if there is no free block, the segment buffer of the slave must be at least as large as that of the master.
+// NOTE: The steps and step event count are as adjusted by the master for AMASS.
+ISR_CODE bool st_sync_add_block (const uint32_t *steps, uint32_t step_event_count, axes_signals_t direction_bits)
+{
+    if (segment_next_head == segment_buffer_tail)
+        return false;
+
+    st_prep_block = st_prep_block->next;
+
+    memcpy(st_prep_block->steps, steps, sizeof(st_prep_block->steps));
+    st_prep_block->step_event_count = step_event_count;
+    st_prep_block->direction_bits = direction_bits;
+    st_prep_block->overrides.value = 0;
+    st_prep_block->steps_per_mm = 0.0f;
+    st_prep_block->ppi_interval = 0;
+    st_prep_block->millimeters = st_prep_block->programmed_rate = 0.0f;
+    st_prep_block->message = 0;
+    st_prep_block->output_commands = NULL;
+    st_prep_block->dynamic_rpm = false;
 #ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+    memset(st_prep_block->backlash_steps, 0, sizeof(st_prep_block->backlash_steps));
+#endif
+#ifdef ENABLE_LASER_RASTER
+    st_prep_block->raster = NULL;
+#endif
+
+    return true;
+}
+
+// Returns true if the steppers are idle and there are no segments pending execution.
+ISR_CODE bool st_sync_idle (void)
+{
+    return sync_idle && segment_buffer_head == segment_buffer_tail;
+}
+
+// Adds a segment received from the master for the last block added, the steppers are woken up if idle.
+// Returns false if the segment buffer is full.
+ISR_CODE bool st_sync_add_segment (uint_fast16_t n_step, uint32_t cycles_per_tick, uint_fast8_t amass_level)
+{
+    if (segment_next_head == segment_buffer_tail)
+        return false;
+
+    segment_t *segment = segment_buffer_head;
+
+    segment->exec_block = st_prep_block;
+    segment->n_step = n_step;
+    segment->cycles_per_tick = cycles_per_tick;
+    segment->current_rate = segment->target_position = 0.0f;
+    segment->amass_level = amass_level;
+    segment->update_rpm = segment->spindle_sync = segment->cruising = false;
+#ifdef ENABLE_FAST_JOG_CANCEL
+    segment->pl_block = NULL;
+#endif
+#ifdef ENABLE_LASER_PWM_TRACKING
+    segment->spindle_pwm_step = 0;
 #endif
-            sys_position[X_AXIS] = sys_position[X_AXIS] + (st.dir_outbits.x ? -1 : 1);
+
+    uint_fast8_t idx = N_AXIS;
+    do {
+        idx--;
+        segment->steps[idx] = st_prep_block->steps[idx] >> amass_level;
+    } while(idx);
+
+    segment_buffer_head = segment_next_head;
+    segment_next_head = segment_next_head->next;
+
+    if (sync_idle) {
+        sync_idle = false;
+        st_energize();
+        st_wake_up();
+    }
+
+    return true;
+}
+
+#endif
+
+// Reset instrumentation data
+static void stats_reset (void)
+{
+    memset((void *)&stats, 0, sizeof(st_stats_t));
+    stats.isr_cycles_min = UINT32_MAX;
+    stats.segment_buffer_min = segment_buffer_size - 1;
+    stats.planner_buffer_min = plan_get_block_buffer_size() - 1;
+}
+
+// Sets the segment buffer size from $389, allocates the buffers from the heap if larger than the default.
+// Falls back to the default size if not enough memory is available.
+static void st_alloc_buffers (void)
+{
+    uint_fast8_t segments = settings.segment_buffer_size;
+
+    if(segments < SEGMENT_BUFFER_SIZE_MIN || segments > SEGMENT_BUFFER_SIZE_MAX)
+        segments = SEGMENT_BUFFER_SIZE;
+
+    if(segments > SEGMENT_BUFFER_SIZE) {
+
+        segment_t *segment = malloc(segments * sizeof(segment_t));
+        st_block_t *block = segment ? malloc((segments - 1 + ST_BLOCK_BUFFER_EXTRA) * sizeof(st_block_t)) : NULL;
+
+        if(block) {
+            memset(segment, 0, segments * sizeof(segment_t));
+            memset(block, 0, (segments - 1 + ST_BLOCK_BUFFER_EXTRA) * sizeof(st_block_t));
+            segment_buffer = segment;
+            st_block_buffer = block;
+        } else {
+            if(segment)
+                free(segment);
+            segments = SEGMENT_BUFFER_SIZE;
+        }
+    }
+
+    segment_buffer_size = segments;
+    st_block_buffer_size = segments - 1 + ST_BLOCK_BUFFER_EXTRA;
+}
+
+// Reset and clear stepper subsystem variables
+void st_reset ()
+{
+    static THREAD_LOCAL bool soft_reset = false;
+
+    st_prep_lock(true);
+
+    // The buffers are sized on the first call and kept, a changed $389 setting takes effect after a hard reset.
+    // Instrumentation data is kept over soft resets.
+    if(!soft_reset) {
+        st_alloc_buffers();
+        stats_reset();
+        soft_reset = true;
+    }
+
+    if(hal.probe.configure)
+        hal.probe.configure(false, false);
+
+    if(message) {
+        pool_release_message(message);
+        message = 0;
+    }
+
+    // Initialize stepper driver idle state, clear step and direction port pins.
+    st_go_idle();
+   // hal.stepper.go_idle(true);
+
+    // NOTE: buffer indices starts from 1 for simpler driver coding!
+
+    // Set up stepper block ringbuffer as circular linked list and add id
+    uint_fast8_t idx;
+    for(idx = 0 ; idx < st_block_buffer_size ; idx++) {
+#ifdef ENABLE_LASER_RASTER
+        if(st_block_buffer[idx].raster) {
+            free(st_block_buffer[idx].raster);
+            st_block_buffer[idx].raster = NULL;
+        }
+#endif
+        st_block_buffer[idx].next = &st_block_buffer[idx == st_block_buffer_size - 1 ? 0 : idx + 1];
+        st_block_buffer[idx].id = idx + 1;
+    }
+
+    // Set up segments ringbuffer as circular linked list, add id and clear AMASS level
+    for(idx = 0 ; idx <= segment_buffer_size - 1 ; idx++) {
+        segment_buffer[idx].next = &segment_buffer[idx == segment_buffer_size - 1 ? 0 : idx + 1];
+        segment_buffer[idx].id = idx + 1;
+        segment_buffer[idx].amass_level = 0;
+    }
+
+    st_prep_block = &st_block_buffer[0];
+
+    // Initialize stepper algorithm variables.
+    pl_block = NULL;  // Planner block pointer used by segment buffer
+    segment_buffer_tail = segment_buffer_head = &segment_buffer[0]; // empty = tail
+    segment_next_head = segment_buffer_head->next;
+
+    memset(&prep, 0, sizeof(st_prep_t));
+    memset(&st, 0, sizeof(stepper_t));
+    memset(&seg_start, 0, sizeof(seg_start));
+#ifdef ENABLE_LASER_RASTER
+    memset(&raster, 0, sizeof(st_raster_t));
+#endif
+#ifdef ENABLE_LASER_PWM_TRACKING
+    memset(&pwm_ramp, 0, sizeof(pwm_ramp_t));
+#endif
+#ifdef ENABLE_JOG_VELOCITY
+    memset(&jog, 0, sizeof(jog_velocity_t));
+#endif
+#ifdef ENABLE_INPUT_SHAPING
+    memset(&shaper, 0, sizeof(input_shaper_t));
+#endif
+
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    // TODO: move to driver?
+    // AMASS_LEVEL0: Normal operation. No AMASS. No upper cutoff frequency. Starts at LEVEL1 cutoff frequency.
+    // Defined as step timer frequency / Cutoff frequency in Hz
+    amass.level_1 = hal.f_step_timer / 8000;
+    amass.level_2 = hal.f_step_timer / 4000;
+    amass.level_3 = hal.f_step_timer / 2000;
+#endif
+
+    cycles_per_min = (float)hal.f_step_timer * 60.0f;
+
+    prep_pending = motion_pending = false;
+#ifdef ENABLE_THREADING_PIPELINE
+    prep_synchronized = false;
+#endif
+#ifdef ENABLE_MOTION_SYNC
+    motion_sync_reset();
+#endif
+    st_prep_lock(false);
+}
+
+// Called by spindle_set_state() to inform about RPM changes.
+// Used by st_prep_buffer() to determine if spindle needs update when dynamic RPM is called for.
+void st_rpm_changed (float rpm)
+{
+    prep.current_spindle_rpm = rpm;
+#ifdef ENABLE_LASER_PWM_TRACKING
+    prep.spindle_pwm_valid = false; // Spindle is changed outside of the segment buffer, do not ramp from the last segment value.
+#endif
+}
+
+// Returns the laser PPI pulse interval for the given step rate in Bresenham step event units,
+// i.e. in the same scale as st_block_t step_event_count.
+static uint32_t st_ppi_interval (float steps_per_mm)
+{
+  #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    return (uint32_t)lroundf(steps_per_mm * laser_ppi_distance * 2.0f);
+  #else
+    return (uint32_t)lroundf(steps_per_mm * laser_ppi_distance * (float)(1 << MAX_AMASS_LEVEL));
+  #endif
+}
+
+// Called by gc_laser_ppi_enable() when laser PPI mode is changed, ppi is 0 when PPI mode is disabled.
+// Used by st_prep_buffer() to precompute the pulse interval of each block.
+void st_set_laser_ppi (uint_fast16_t ppi)
+{
+    laser_ppi_distance = ppi ? 25.4f / (float)ppi : 0.0f;
+}
+
+// Called by planner_recalculate() when the executing block is updated by the new plan.
+void st_update_plan_block_parameters ()
+{
+    st_prep_lock(true);
+
+    if (pl_block != NULL) { // Ignore if at start of a new block.
+        prep.recalculate.velocity_profile = On;
+        pl_block->entry_speed_sqr = prep.current_speed * prep.current_speed; // Update entry speed.
+        pl_block = NULL; // Flag st_prep_segment() to load and check active velocity profile.
+    }
+
+    st_prep_lock(false);
+}
+
+#ifdef ENABLE_FAST_JOG_CANCEL
+
+// Called on jog cancel before st_update_plan_block_parameters(). Discards the prepped segments following the next
+// segment to be executed and rewinds segment prep to the end of that segment, so that the hold deceleration
+// starts without waiting for the segment buffer to drain.
+// Only segments prepped from the planner block being prepped are discarded, the buffer is left as is otherwise.
+void st_truncate_buffer (void)
+{
+    segment_t *keep;
+
+    st_prep_lock(true);
+
+    if(pl_block && !sys.step_control.end_motion && !prep.recalculate.parking
+#ifdef ENABLE_INPUT_SHAPING
+        && !prep.shaped
+#endif
+      ) {
+
+        hal.irq_disable();
+
+        // The segment after the executing one may be loaded by the stepper ISR at any time, keep it.
+        keep = ((segment_t *)segment_buffer_tail)->next;
+
+        if(segment_buffer_tail != segment_buffer_head && keep != segment_buffer_head && keep->next != segment_buffer_head && keep->pl_block == pl_block) {
+            segment_buffer_head = keep->next;
+            segment_next_head = segment_buffer_head->next;
+            hal.irq_enable();
+            pl_block->millimeters = keep->mm_remaining;
+            prep.steps_remaining = keep->steps_remaining;
+            prep.dt_remainder = keep->dt_remainder;
+            prep.current_speed = keep->current_rate;
+        } else
+            hal.irq_enable();
+    }
+
+    st_prep_lock(false);
+}
+
+#endif
+
+// Changes the run state of the step segment buffer to execute the special parking motion.
+void st_parking_setup_buffer()
+{
+    st_prep_lock(true);
+
+    // Store step execution data of partially completed block, if necessary.
+    if (prep.recalculate.hold_partial_block) {
+        prep.last_st_block = st_prep_block;
+        prep.last_steps_remaining = prep.steps_remaining;
+        prep.last_dt_remainder = prep.dt_remainder;
+        prep.last_steps_per_mm = prep.steps_per_mm;
+    }
+    // Set flags to execute a parking motion
+    prep.recalculate.parking = On;
+    prep.recalculate.velocity_profile = Off;
+    pl_block = NULL; // Always reset parking motion to reload new block.
+
+    st_prep_lock(false);
+}
+
+
+// Restores the step segment buffer to the normal run state after a parking motion.
+void st_parking_restore_buffer()
+{
+    st_prep_lock(true);
+
+    // Restore step execution data and flags of partially completed block, if necessary.
+    if (prep.recalculate.hold_partial_block) {
+        st_prep_block = prep.last_st_block;
+        prep.steps_remaining = prep.last_steps_remaining;
+        prep.dt_remainder = prep.last_dt_remainder;
+        prep.steps_per_mm = prep.last_steps_per_mm;
+        prep.recalculate.flags = 0;
+        prep.recalculate.hold_partial_block = prep.recalculate.velocity_profile = On;
+        prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.steps_per_mm; // Recompute this value.
+    } else
+        prep.recalculate.flags = 0;
+
+    pl_block = NULL; // Set to reload next block.
+
+    st_prep_lock(false);
+}
+
+/* Prepares step segment buffer. Continuously called from main program.
+
+   The segment buffer is an intermediary buffer interface between the execution of steps
+   by the stepper algorithm and the velocity profiles generated by the planner. The stepper
+   algorithm only executes steps within the segment buffer and is filled by the main program
+   when steps are "checked-out" from the first block in the planner buffer. This keeps the
+   step execution and planning optimization processes atomic and protected from each other.
+   The number of steps "checked-out" from the planner buffer and the number of segments in
+   the segment buffer is sized and computed such that no operation in the main program takes
+   longer than the time it takes the stepper algorithm to empty it before refilling it.
+   Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
+   If the driver provides hal.stepper.prep_trigger the buffer is instead filled from a low priority
+   interrupt, pended by the stepper interrupt when the fill level drops below the prep watermark
+   and by the main program. The main program then cannot starve the segment buffer, it defers prep
+   by st_prep_lock() while it updates planner and prep data.
+   NOTE: Computation units are in steps, millimeters, and minutes.
+*/
+#ifdef ENABLE_NATIVE_ARCS
+
+// Computes the chord of an arc block from the end of the previous chord to the arc position at mm_remaining
+// from the end of the block. Returns the number of step events of the chord, if not zero the stepper block
+// data is loaded with the chord. Chords with no steps are not loaded unless at the end of the block.
+static uint32_t prep_arc_chord (float mm_remaining)
+{
+    plan_arc_t *arc = &pl_block->arc;
+    int32_t target[N_AXIS], delta[N_AXIS];
+    uint32_t step_event_count = 0;
+    uint_fast8_t idx = N_AXIS;
+
+    if(mm_remaining <= 0.0f) { // End of arc, target is the block end position
+        do {
+            idx--;
+            target[idx] = pl_block->direction_bits.mask & bit(idx) ? -(int32_t)pl_block->steps[idx] : (int32_t)pl_block->steps[idx];
+        } while(idx);
+    } else {
+        float f = 1.0f - mm_remaining / arc->millimeters;
+        float cos_a, sin_a;
+        sin_cos(arc->angular_travel * f, &sin_a, &cos_a);
+        memset(target, 0, sizeof(target));
+        target[arc->plane.axis_0] = lroundf((arc->offset[0] - arc->offset[0] * cos_a + arc->offset[1] * sin_a) * settings.axis[arc->plane.axis_0].steps_per_mm);
+        target[arc->plane.axis_1] = lroundf((arc->offset[1] - arc->offset[0] * sin_a - arc->offset[1] * cos_a) * settings.axis[arc->plane.axis_1].steps_per_mm);
+        target[arc->plane.axis_linear] = lroundf(arc->linear_travel * f * settings.axis[arc->plane.axis_linear].steps_per_mm);
+    }
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        delta[idx] = target[idx] - prep.arc_position[idx];
+        step_event_count = max(step_event_count, (uint32_t)labs(delta[idx]));
+    } while(idx);
+
+    if(step_event_count == 0 && mm_remaining > 0.0f)
+        return 0;
+
+    // The first chord uses the stepper block loaded with the planner block, a new one is used for the following chords.
+    if(prep.arc_chord) {
+        st_block_t *st_block = st_prep_block;
+        st_prep_block = st_prep_block->next;
+        st_prep_block->overrides = st_block->overrides;
+        st_prep_block->steps_per_mm = st_block->steps_per_mm;
+        st_prep_block->ppi_interval = st_block->ppi_interval;
+        st_prep_block->millimeters = st_block->millimeters;
+        st_prep_block->programmed_rate = st_block->programmed_rate;
+        st_prep_block->dynamic_rpm = st_block->dynamic_rpm;
+        st_prep_block->output_commands = NULL;
+        st_prep_block->message = 0;
+#ifdef ENABLE_LASER_RASTER
+        if(st_prep_block->raster) {
+            free(st_prep_block->raster);
+            st_prep_block->raster = NULL;
+        }
+#endif
+    }
+    prep.arc_chord = true;
+
+    st_prep_block->direction_bits.mask = 0;
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        prep.arc_position[idx] = target[idx];
+      #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        st_prep_block->steps[idx] = labs(delta[idx]) << 1;
+      #else
+        st_prep_block->steps[idx] = labs(delta[idx]) << MAX_AMASS_LEVEL;
+      #endif
+        if(delta[idx] < 0)
+            st_prep_block->direction_bits.mask |= bit(idx);
+    } while(idx);
+
+  #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    st_prep_block->step_event_count = step_event_count << 1;
+  #else
+    st_prep_block->step_event_count = step_event_count << MAX_AMASS_LEVEL;
+  #endif
+
+    return step_event_count;
+}
+
+#endif
+
+#ifdef ENABLE_JOG_VELOCITY
+
+// Adopts the pending target velocity as direction, speed and acceleration limits of the motion.
+static void jog_velocity_adopt (void)
+{
+    uint_fast8_t idx = N_AXIS;
+    float speed = 0.0f, target[N_AXIS];
+
+    jog.target_pending = false;
+
+    memcpy(jog.unit_vec, jog.target, sizeof(jog.unit_vec));
+    if((speed = convert_delta_vector_to_unit_vector(jog.unit_vec)) == 0.0f) {
+        jog.max_speed = 0.0f;
+        return;
+    }
+
+    jog.max_speed = speed;
+    jog.acceleration = jog.distance = SOME_LARGE_VALUE;
+
+    do {
+        idx--;
+        if(jog.unit_vec[idx] != 0.0f) {
+            jog.max_speed = min(jog.max_speed, fabsf(settings.axis[idx].max_rate / jog.unit_vec[idx]));
+            jog.acceleration = min(jog.acceleration, fabsf(settings.axis[idx].acceleration / jog.unit_vec[idx]));
+        }
+        target[idx] = (float)(jog.start[idx] + jog.steps[idx]) * mm_per_step[idx];
+    } while(idx);
+
+    // Distance to soft limits is the distance along the direction until the first axis is clipped.
+    if(settings.limits.flags.soft_enabled || settings.limits.flags.jog_soft_limited) {
+
+        float position[N_AXIS];
+
+        memcpy(position, target, sizeof(position));
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            target[idx] += jog.unit_vec[idx] * 1.0E+6f;
+        } while(idx);
+
+        system_apply_jog_limits(target);
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            if(jog.unit_vec[idx] != 0.0f)
+                jog.distance = min(jog.distance, max(0.0f, (target[idx] - position[idx]) / jog.unit_vec[idx]));
+        } while(idx);
+    }
+}
+
+// Generates segments for velocity jogging, a few segments ahead so that target velocity changes are picked up fast.
+// Velocity is ramped to the target at the acceleration limit, on direction changes the motion is decelerated to
+// standstill before the new direction is taken.
+static void prep_jog_velocity (void)
+{
+    while (segment_buffer_tail != segment_next_head &&
+            (segment_buffer_head->id + segment_buffer_size - segment_buffer_tail->id) % segment_buffer_size < JOG_VELOCITY_SEGMENTS) {
+
+        if (jog.target_pending && !sys.step_control.execute_hold) {
+            float target[N_AXIS];
+            memcpy(target, jog.target, sizeof(target));
+            if(jog.speed == 0.0f || convert_delta_vector_to_unit_vector(target) == 0.0f)
+                jog_velocity_adopt();
+            else {
+                float dot = 0.0f;
+                uint_fast8_t idx = N_AXIS;
+                do {
+                    idx--;
+                    dot += target[idx] * jog.unit_vec[idx];
+                } while(idx);
+                if(dot > 0.9999f)
+                    jog_velocity_adopt(); // Same direction, may change speed on the fly.
+            }
+        }
+
+        float speed = (sys.step_control.execute_hold || jog.target_pending) ? 0.0f : jog.max_speed;
+
+        // Limit speed so that motion can be stopped before soft limits are reached.
+        if(jog.distance < SOME_LARGE_VALUE)
+            speed = min(speed, sqrtf(2.0f * jog.acceleration * jog.distance));
+
+        float dv = jog.acceleration * DT_SEGMENT;
+        float speed_end = jog.speed < speed ? min(jog.speed + dv, speed) : max(jog.speed - dv, speed);
+        float mm = 0.5f * (jog.speed + speed_end) * DT_SEGMENT;
+
+        if(mm > jog.distance)
+            mm = jog.distance;
+
+        if(mm <= 0.0f) { // At standstill or at soft limit.
+            jog.speed = prep.current_speed = 0.0f;
+            if(jog.target_pending && !sys.step_control.execute_hold)
+                continue; // Take new direction.
+            jog.stopped = true;
+            if(sys.step_control.execute_hold)
+                sys.step_control.end_motion = On;
+            return;
+        }
+
+        jog.speed = prep.current_speed = speed_end;
+        if(jog.distance < SOME_LARGE_VALUE)
+            jog.distance -= mm;
+
+        // Set up stepper block for the segment.
+        int32_t delta[N_AXIS];
+        uint32_t step_event_count = 0;
+        uint_fast8_t idx = N_AXIS;
+
+        st_prep_block = st_prep_block->next;
+        st_prep_block->direction_bits.mask = 0;
+
+        do {
+            idx--;
+            jog.position[idx] += jog.unit_vec[idx] * mm * settings.axis[idx].steps_per_mm;
+            delta[idx] = (int32_t)lroundf(jog.position[idx]) - jog.steps[idx];
+            jog.steps[idx] += delta[idx];
+            step_event_count = max(step_event_count, (uint32_t)labs(delta[idx]));
+          #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            st_prep_block->steps[idx] = labs(delta[idx]) << 1;
+          #else
+            st_prep_block->steps[idx] = labs(delta[idx]) << MAX_AMASS_LEVEL;
+          #endif
+            if(delta[idx] < 0)
+                st_prep_block->direction_bits.mask |= bit(idx);
+#ifdef ENABLE_BACKLASH_COMPENSATION
+            st_prep_block->backlash_steps[idx] = 0;
+#endif
+        } while(idx);
+
+      #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        st_prep_block->step_event_count = step_event_count << 1;
+      #else
+        st_prep_block->step_event_count = step_event_count << MAX_AMASS_LEVEL;
+      #endif
+        st_prep_block->millimeters = mm;
+        st_prep_block->steps_per_mm = (float)step_event_count / mm;
+        st_prep_block->ppi_interval = 0;
+        st_prep_block->programmed_rate = jog.max_speed;
+        st_prep_block->overrides = sys.override.control;
+        st_prep_block->overrides.sync = Off;
+        st_prep_block->dynamic_rpm = false;
+        st_prep_block->output_commands = NULL;
+        st_prep_block->message = 0;
+#ifdef ENABLE_LASER_RASTER
+        if(st_prep_block->raster) {
+            free(st_prep_block->raster);
+            st_prep_block->raster = NULL;
+        }
+#endif
+
+        // Set up the segment, steps are output evenly spaced over the segment time.
+        segment_t *prep_segment = segment_buffer_head;
+
+        prep_segment->exec_block = st_prep_block;
+        prep_segment->update_rpm = false;
+        prep_segment->spindle_sync = prep_segment->cruising = false;
+        prep_segment->n_step = (uint_fast16_t)step_event_count;
+        prep_segment->current_rate = speed_end;
+#ifdef ENABLE_FAST_JOG_CANCEL
+        prep_segment->pl_block = NULL;
+#endif
+#ifdef ENABLE_LASER_PWM_TRACKING
+        prep_segment->spindle_pwm_step = 0;
+#endif
+
+        uint32_t cycles = (uint32_t)ceilf(cycles_per_min * DT_SEGMENT / (float)(step_event_count ? step_event_count : 1));
+
+      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        if (cycles < amass.level_1)
+            prep_segment->amass_level = 0;
+        else {
+            prep_segment->amass_level = cycles < amass.level_2 ? 1 : (cycles < amass.level_3 ? 2 : 3);
+            cycles >>= prep_segment->amass_level;
+            prep_segment->n_step <<= prep_segment->amass_level;
+        }
+      #endif
+
+        idx = N_AXIS;
+        do {
+            idx--;
+            prep_segment->steps[idx] = st_prep_block->steps[idx] >> prep_segment->amass_level;
+        } while(idx);
+
+        prep_segment->cycles_per_tick = cycles;
+
+#ifdef ENABLE_MOTION_SYNC
+        motion_sync_segment(prep_segment);
+#endif
+
+        segment_buffer_head = segment_next_head;
+        segment_next_head = segment_next_head->next;
+
+#ifdef ENABLE_MOTION_TRACE
+        motion_trace_segment(prep_segment, (segment_buffer_head->id + segment_buffer_size - segment_buffer_tail->id) % segment_buffer_size);
+#endif
+    }
+}
+
+// Sets target velocity per axis (mm/min) for velocity jogging, starts a velocity jog if not already active.
+// on_completed is called by the foreground process when motion has ended, it must call st_jog_velocity_end().
+// Returns false if the target cannot be set as motion has ended and on_completed is pending.
+// NOTE: The caller is responsible for setting the jog state and waking up the steppers when starting.
+bool st_jog_velocity (float *velocity, void (*on_completed)(uint_fast16_t state))
+{
+    bool start = !jog.active;
+
+    if(jog.ended)
+        return false;
+
+    st_prep_lock(true);
+
+    if(start) {
+        memset(&jog, 0, sizeof(jog_velocity_t));
+        memcpy(jog.start, sys_position, sizeof(jog.start));
+        jog.on_completed = on_completed;
+        prep.current_speed = 0.0f;
+        pl_block = NULL;
+        motion_pending = true;
+    }
+
+    memcpy(jog.target, velocity, sizeof(jog.target));
+    jog.target_pending = true;
+    jog.stopped = false;
+    jog.active = true;
+
+    st_prep_lock(false);
+
+    return true;
+}
+
+// Returns true while velocity jogging.
+bool st_jog_velocity_active (void)
+{
+    return jog.active;
+}
+
+// Ends velocity jogging, called by the foreground process when motion is complete.
+void st_jog_velocity_end (void)
+{
+    st_prep_lock(true);
+    jog.active = jog.ended = false;
+    st_prep_lock(false);
+}
+
+#endif
+
+// Sets the step rate of a prepped segment and the Bresenham axis increments adjusted for its AMASS level.
+static inline void segment_set_rate (segment_t *segment, uint32_t cycles)
+{
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    // Compute step timing and multi-axis smoothing level.
+    // NOTE: AMASS overdrives the timer with each level, so only one prescalar is required.
+    if (cycles < amass.level_1)
+        segment->amass_level = 0;
+    else {
+        segment->amass_level = cycles < amass.level_2 ? 1 : (cycles < amass.level_3 ? 2 : 3);
+        cycles >>= segment->amass_level;
+        segment->n_step <<= segment->amass_level;
+    }
+  #endif
+
+    // Precompute Bresenham axis increments for the segment, adjusted for the AMASS level.
+    uint_fast8_t idx = N_AXIS;
+    do {
+        idx--;
+        segment->steps[idx] = segment->exec_block->steps[idx] >> segment->amass_level;
+    } while(idx);
+
+    segment->cycles_per_tick = cycles;
+}
+
+// Makes the prepped segment at the head of the segment buffer available to the stepper ISR.
+static inline void segment_commit (segment_t *segment)
+{
+#ifdef ENABLE_MOTION_SYNC
+    motion_sync_segment(segment);
+#endif
+
+    segment_buffer_head = segment_next_head;
+    segment_next_head = segment_next_head->next;
+
+#ifdef ENABLE_MOTION_TRACE
+    motion_trace_segment(segment, (segment_buffer_head->id + segment_buffer_size - segment_buffer_tail->id) % segment_buffer_size);
+#endif
+}
+
+#ifdef ENABLE_INPUT_SHAPING
+
+#define SHAPER_SAMPLE(idx) shaper.sample[(shaper.sample_tail + (idx)) % INPUT_SHAPER_SAMPLES]
+#define SHAPER_BLOCK(idx) shaper.block[(shaper.block_tail + (idx)) % INPUT_SHAPER_BLOCKS]
+
+// Computes the shaper impulses from the settings, the shaper for the second frequency is convolved with the first.
+// Shaping is switched off if the duration exceeds what can be held by the input samples.
+static void shaper_configure (void)
+{
+    uint_fast8_t idx, i, j, n;
+    float amplitude[3], delay[3], a, d, k, df, td, sum;
+
+    shaper.n_impulses = 1;
+    shaper.amplitude[0] = 1.0f;
+    shaper.delay[0] = shaper.duration = 0.0f;
+
+    if(settings.input_shaper.type == InputShaper_None || settings.input_shaper.type > InputShaper_EI)
+        return;
+
+    df = sqrtf(1.0f - settings.input_shaper.damping * settings.input_shaper.damping);
+    k = expf(-settings.input_shaper.damping * M_PI / df);
+
+    for(idx = 0; idx < 2; idx++) {
+
+        if(settings.input_shaper.frequency[idx] <= 0.0f)
+            continue;
+
+        td = 1.0f / (settings.input_shaper.frequency[idx] * df * 60.0f); // Damped period of vibration (min)
+        delay[0] = 0.0f;
+        delay[1] = 0.5f * td;
+        delay[2] = td;
+        amplitude[0] = 1.0f;
+
+        switch(settings.input_shaper.type) {
+
+            case InputShaper_ZV:
+                n = 2;
+                amplitude[1] = k;
+                break;
+
+            case InputShaper_ZVD:
+                n = 3;
+                amplitude[1] = 2.0f * k;
+                amplitude[2] = k * k;
+                break;
+
+            default: // InputShaper_EI, 5% vibration tolerance
+                n = 3;
+                amplitude[0] = 0.25f * 1.05f;
+                amplitude[1] = 0.5f * 0.95f * k;
+                amplitude[2] = 0.25f * 1.05f * k * k;
+                break;
+        }
+
+        sum = 0.0f;
+        for(j = 0; j < n; j++)
+            sum += amplitude[j];
+
+        // Convolve the impulses in place, from the last so that impulses not yet convolved are not overwritten.
+        i = shaper.n_impulses;
+        do {
+            i--;
+            a = shaper.amplitude[i];
+            d = shaper.delay[i];
+            j = n;
+            do {
+                j--;
+                shaper.amplitude[i * n + j] = a * amplitude[j] / sum;
+                shaper.delay[i * n + j] = d + delay[j];
+            } while(j);
+        } while(i);
+
+        shaper.n_impulses *= n;
+        shaper.duration += delay[n - 1];
+    }
+
+    if(shaper.duration > SHAPER_DURATION_MAX) {
+        shaper.n_impulses = 1;
+        shaper.amplitude[0] = 1.0f;
+        shaper.delay[0] = shaper.duration = 0.0f;
+    }
+}
+
+// Returns true if the segments of the planner block are to be shaped.
+static inline bool shaper_is_shaping (plan_block_t *block)
+{
+    return shaper.duration > 0.0f && !(sys.step_control.execute_sys_motion || sys.state == STATE_HOMING ||
+                                        settings.mode == Mode_Laser || block->condition.spindle.synchronized ||
+                                         block->condition.dwell);
+}
+
+// Returns the input path position at time t, the position is held before the first and after the last sample.
+static float shaper_input_position (float t)
+{
+    uint_fast8_t idx = 0;
+    shaper_sample_t *sample = &SHAPER_SAMPLE(0), *prev;
+
+    if(t <= sample->t)
+        return sample->s;
+
+    while(++idx < shaper.n_samples) {
+        prev = sample;
+        sample = &SHAPER_SAMPLE(idx);
+        if(t <= sample->t)
+            return prev->s + (sample->s - prev->s) * (t - prev->t) / (sample->t - prev->t);
+    }
+
+    return sample->s;
+}
+
+// Returns the shaped path position at time t.
+static float shaper_position (float t)
+{
+    float s = 0.0f;
+    uint_fast8_t idx = shaper.n_impulses;
+
+    do {
+        idx--;
+        s += shaper.amplitude[idx] * shaper_input_position(t - shaper.delay[idx]);
+    } while(idx);
+
+    return s;
+}
+
+// Adds an input sample. Short segments are merged with the previous one to limit the number of samples,
+// the speed is then averaged over them. Only samples past the output are merged unless there is no room.
+static void shaper_add_sample (float t, float s)
+{
+    shaper_sample_t *last = &SHAPER_SAMPLE(shaper.n_samples - 1);
+
+    if(shaper.n_samples == INPUT_SHAPER_SAMPLES ||
+        (shaper.n_samples > 1 && SHAPER_SAMPLE(shaper.n_samples - 2).t >= shaper.t &&
+          last->t - SHAPER_SAMPLE(shaper.n_samples - 2).t < DT_SEGMENT * 0.5f)) {
+        last->t = t;
+        last->s = s;
+    } else {
+        last = &SHAPER_SAMPLE(shaper.n_samples);
+        last->t = t;
+        last->s = s;
+        shaper.n_samples++;
+    }
+}
+
+// Adds a segment generated from the planner block to the shaper input. mm_start and mm_end are the distances
+// from the end of the block at the start and the end of the segment, dt is the segment time.
+static void shaper_input (segment_t *segment, float mm_start, float mm_end, float dt)
+{
+    shaper_sample_t *sample;
+    shaper_block_t *block;
+
+    if(!shaper.active) {
+        shaper.active = true;
+        shaper.t = shaper.s = 0.0f;
+        shaper.sample_tail = shaper.block_tail = shaper.n_blocks = 0;
+        shaper.sample[0].t = shaper.sample[0].s = 0.0f;
+        shaper.n_samples = 1;
     }
 
-    st.counter_y += st.steps[Y_AXIS];
-    if (st.counter_y > st.step_event_count) {
-        step_outbits.y = On;
-        st.counter_y -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-            sys_position[Y_AXIS] = sys_position[Y_AXIS] + (st.dir_outbits.y ? -1 : 1);
+    sample = &SHAPER_SAMPLE(shaper.n_samples - 1);
+    block = shaper.n_blocks ? &SHAPER_BLOCK(shaper.n_blocks - 1) : NULL;
+
+    if(block == NULL || block->st_block != segment->exec_block) {
+        block = &SHAPER_BLOCK(shaper.n_blocks);
+        block->st_block = segment->exec_block;
+        block->end = sample->s + mm_start;
+        block->steps_per_mm = prep.steps_per_mm;
+        block->steps_remaining = prep.steps_remaining;
+        block->dt_remainder = 0.0f;
+        block->update_rpm = false;
+        shaper.n_blocks++;
+        shaper.stalled = false;
     }
 
-    st.counter_z += st.steps[Z_AXIS];
-    if (st.counter_z > st.step_event_count) {
-        step_outbits.z = On;
-        st.counter_z -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+    if(segment->update_rpm) {
+        block->update_rpm = true;
+#ifdef SPINDLE_PWM_DIRECT
+        block->spindle_pwm = segment->spindle_pwm;
+#else
+        block->spindle_rpm = segment->spindle_rpm;
 #endif
-            sys_position[Z_AXIS] = sys_position[Z_AXIS] + (st.dir_outbits.z ? -1 : 1);
     }
 
-  #ifdef A_AXIS
-      st.counter_a += st.steps[A_AXIS];
-      if (st.counter_a > st.step_event_count) {
-          step_outbits.a = On;
-          st.counter_a -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-              sys_position[A_AXIS] = sys_position[A_AXIS] + (st.dir_outbits.a ? -1 : 1);
-      }
-  #endif
-
-  #ifdef B_AXIS
-      st.counter_b += st.steps[B_AXIS];
-      if (st.counter_b > st.step_event_count) {
-          step_outbits.b = On;
-          st.counter_b -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-              sys_position[B_AXIS] = sys_position[B_AXIS] + (st.dir_outbits.b ? -1 : 1);
-      }
-  #endif
+    // If the output has passed the end of the input, e.g. on a stall, the position is held until the output time.
+    if(shaper.t > sample->t)
+        shaper_add_sample(shaper.t, sample->s);
 
-  #ifdef C_AXIS
-      st.counter_c += st.steps[C_AXIS];
-      if (st.counter_c > st.step_event_count) {
-          step_outbits.c = On;
-          st.counter_c -= st.step_event_count;
-#ifdef ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
-#endif
-              sys_position[C_AXIS] = sys_position[C_AXIS] + (st.dir_outbits.c ? -1 : 1);
-      }
-  #endif
+    shaper_add_sample(SHAPER_SAMPLE(shaper.n_samples - 1).t + dt, block->end - mm_end);
+}
 
-    st.step_outbits.value = step_outbits.value;
+// Removes the completed oldest block, position and time are rebased to the end of it to keep float precision.
+static void shaper_block_completed (void)
+{
+    uint_fast8_t idx;
+    float s = shaper.block[shaper.block_tail].end, t = shaper.t;
 
-    // During a homing cycle, lock out and prevent desired axes from moving.
-    if (sys.state == STATE_HOMING)
-        st.step_outbits.value &= sys.homing_axis_lock.mask;
+    shaper.block_tail = (shaper.block_tail + 1) % INPUT_SHAPER_BLOCKS;
+    shaper.n_blocks--;
 
-    if (st.step_count == 0 || --st.step_count == 0) {
-        // Segment is complete. Advance segment tail pointer.
-        segment_buffer_tail = segment_buffer_tail->next;
+    for(idx = 0; idx < shaper.n_samples; idx++) {
+        SHAPER_SAMPLE(idx).t -= t;
+        SHAPER_SAMPLE(idx).s -= s;
     }
+
+    for(idx = 0; idx < shaper.n_blocks; idx++)
+        SHAPER_BLOCK(idx).end -= s;
+
+    shaper.t = 0.0f;
+    shaper.s -= s;
 }
 
-// Reset and clear stepper subsystem variables
-void st_reset ()
+// Outputs a segment of shaped motion to the segment buffer, segments end at block ends and are extended until
+// at least one step is output. If flush is set no more input is pending and the output is run to the end of
+// the input. Returns false if more input is required or there is nothing to output, the shaper is then idle.
+static bool shaper_output (bool flush)
 {
-    if(hal.probe.configure)
-        hal.probe.configure(false, false);
+    if(!shaper.active)
+        return false;
+
+    bool complete;
+    float t = shaper.t, s, dt, step_dist_remaining, inv_rate;
+    uint32_t n_steps_remaining;
+    shaper_sample_t *last = &SHAPER_SAMPLE(shaper.n_samples - 1);
+    shaper_block_t *block = shaper.n_blocks ? &SHAPER_BLOCK(0) : NULL;
+
+    if(block == NULL) {
+        if(flush)
+            shaper.active = false;
+        return false;
+    }
 
-    if(message) {
-        free(message);
-        message = NULL;
+    do {
+        t += DT_SEGMENT;
+        if(!flush && t > last->t)
+            return false; // Input does not cover the segment.
+        if((complete = flush && t >= last->t + shaper.duration)) {
+            t = max(shaper.t, last->t + shaper.duration);
+            s = last->s;
+        } else
+            s = shaper_position(t);
+
+        if(s >= block->end) {
+            // Segment ends at the block end.
+            if(s > block->end && shaper.n_blocks > 1) {
+                t = shaper.t + (t - shaper.t) * (block->end - shaper.s) / (s - shaper.s);
+                complete = false;
+            }
+            s = block->end;
+            n_steps_remaining = 0;
+        } else
+            n_steps_remaining = min((uint32_t)ceilf(block->steps_per_mm * (block->end - s)), block->steps_remaining);
+
+    } while(n_steps_remaining == block->steps_remaining && !complete);
+
+    if(n_steps_remaining == block->steps_remaining) {
+        // Output is complete, remaining steps of a block ended by a feed hold are not output.
+        shaper.active = false;
+        return false;
     }
 
-    // Initialize stepper driver idle state, clear step and direction port pins.
-    st_go_idle();
-   // hal.stepper.go_idle(true);
+    segment_t *segment = segment_buffer_head;
 
-    // NOTE: buffer indices starts from 1 for simpler driver coding!
+    dt = t - shaper.t;
+    step_dist_remaining = block->steps_per_mm * (block->end - s);
+    inv_rate = (dt + block->dt_remainder) / ((float)block->steps_remaining - step_dist_remaining);
 
-    // Set up stepper block ringbuffer as circular linked list and add id
-    uint_fast8_t idx;
-    for(idx = 0 ; idx <= SEGMENT_BUFFER_SIZE - 2 ; idx++) {
-        st_block_buffer[idx].next = &st_block_buffer[idx == SEGMENT_BUFFER_SIZE - 2 ? 0 : idx + 1];
-        st_block_buffer[idx].id = idx + 1;
+    segment->exec_block = block->st_block;
+    segment->n_step = (uint_fast16_t)(block->steps_remaining - n_steps_remaining);
+    segment->current_rate = dt > 0.0f ? (s - shaper.s) / dt : 0.0f;
+    segment->spindle_sync = segment->cruising = false;
+#ifdef ENABLE_FAST_JOG_CANCEL
+    segment->pl_block = NULL;
+#endif
+    if((segment->update_rpm = block->update_rpm)) {
+        block->update_rpm = false;
+#ifdef SPINDLE_PWM_DIRECT
+        segment->spindle_pwm = block->spindle_pwm;
+#else
+        segment->spindle_rpm = block->spindle_rpm;
+#endif
     }
+#ifdef ENABLE_LASER_PWM_TRACKING
+    segment->spindle_pwm_step = 0;
+#endif
 
-    // Set up segments ringbuffer as circular linked list, add id and clear AMASS level
-    for(idx = 0 ; idx <= SEGMENT_BUFFER_SIZE - 1 ; idx++) {
-        segment_buffer[idx].next = &segment_buffer[idx == SEGMENT_BUFFER_SIZE - 1 ? 0 : idx + 1];
-        segment_buffer[idx].id = idx + 1;
-        segment_buffer[idx].amass_level = 0;
+    segment_set_rate(segment, (uint32_t)ceilf(cycles_per_min * inv_rate));
+    segment_commit(segment);
+
+    block->steps_remaining = n_steps_remaining;
+    block->dt_remainder = ((float)n_steps_remaining - step_dist_remaining) * inv_rate;
+    shaper.t = t;
+    shaper.s = s;
+
+    if(n_steps_remaining == 0) {
+        shaper_block_completed();
+        if(complete && shaper.n_blocks == 0)
+            shaper.active = false;
+    } else if(complete)
+        shaper.active = false;
+
+    // Discard samples no longer needed for the shaped position.
+    while(shaper.n_samples > 1 && SHAPER_SAMPLE(1).t <= shaper.t - shaper.duration) {
+        shaper.sample_tail = (shaper.sample_tail + 1) % INPUT_SHAPER_SAMPLES;
+        shaper.n_samples--;
     }
 
-    st_prep_block = &st_block_buffer[0];
+    return true;
+}
 
-    // Initialize stepper algorithm variables.
-    pl_block = NULL;  // Planner block pointer used by segment buffer
-    segment_buffer_tail = segment_buffer_head = &segment_buffer[0]; // empty = tail
-    segment_next_head = segment_buffer_head->next;
+// Returns the duration of the configured input shaper in seconds, 0 if shaping is off.
+float st_get_input_shaper_duration (void)
+{
+    if(!shaper.active)
+        shaper_configure();
 
-    memset(&prep, 0, sizeof(st_prep_t));
-    memset(&st, 0, sizeof(stepper_t));
+    return shaper.duration * 60.0f;
+}
 
-#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    // TODO: move to driver?
-    // AMASS_LEVEL0: Normal operation. No AMASS. No upper cutoff frequency. Starts at LEVEL1 cutoff frequency.
-    // Defined as step timer frequency / Cutoff frequency in Hz
-    amass.level_1 = hal.f_step_timer / 8000;
-    amass.level_2 = hal.f_step_timer / 4000;
-    amass.level_3 = hal.f_step_timer / 2000;
 #endif
 
-    cycles_per_min = (float)hal.f_step_timer * 60.0f;
-}
+#ifdef ENABLE_PLANNED_DWELL
 
-// Called by spindle_set_state() to inform about RPM changes.
-// Used by st_prep_buffer() to determine if spindle needs update when dynamic RPM is called for.
-void st_rpm_changed (float rpm)
+// Loads the stepper block data for a dwell block, the block has no steps.
+// NOTE: The step event count is set to 1 so that the step count of partially executed segments can be derived.
+static void prep_dwell_block (void)
 {
-    prep.current_spindle_rpm = rpm;
+    axes_signals_t direction_bits = st_prep_block->direction_bits; // Keep direction outputs unchanged.
+
+    st_prep_block = st_prep_block->next;
+
+    memset(st_prep_block->steps, 0, sizeof(st_prep_block->steps));
+    st_prep_block->step_event_count = 1;
+    st_prep_block->direction_bits = direction_bits;
+    st_prep_block->programmed_rate = st_prep_block->millimeters = st_prep_block->steps_per_mm = 0.0f;
+    st_prep_block->ppi_interval = 0;
+    st_prep_block->overrides = pl_block->overrides;
+    st_prep_block->dynamic_rpm = false;
+    st_prep_block->output_commands = NULL;
+    st_prep_block->message = 0;
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    memset(st_prep_block->backlash_steps, 0, sizeof(st_prep_block->backlash_steps));
+#endif
+#ifdef ENABLE_LASER_RASTER
+    if(st_prep_block->raster) {
+        free(st_prep_block->raster);
+        st_prep_block->raster = NULL;
+    }
+#endif
 }
 
-// Called by planner_recalculate() when the executing block is updated by the new plan.
-void st_update_plan_block_parameters ()
+// Outputs a segment without steps for the dwell block, discards the block when the dwell time has elapsed.
+// A feed hold pauses the dwell at the segment boundary, the remaining time is executed on resume.
+// Returns false if prep is to be ended.
+static bool prep_dwell (void)
 {
-    if (pl_block != NULL) { // Ignore if at start of a new block.
-        prep.recalculate.velocity_profile = On;
-        pl_block->entry_speed_sqr = prep.current_speed * prep.current_speed; // Update entry speed.
-        pl_block = NULL; // Flag st_prep_segment() to load and check active velocity profile.
+    if (sys.step_control.execute_hold) {
+        sys.step_control.end_motion = On;
+        return false;
     }
-}
 
-// Changes the run state of the step segment buffer to execute the special parking motion.
-void st_parking_setup_buffer()
-{
-    // Store step execution data of partially completed block, if necessary.
-    if (prep.recalculate.hold_partial_block) {
-        prep.last_st_block = st_prep_block;
-        prep.last_steps_remaining = prep.steps_remaining;
-        prep.last_dt_remainder = prep.dt_remainder;
-        prep.last_steps_per_mm = prep.steps_per_mm;
+    float dt = min(DT_SEGMENT, pl_block->dwell);
+    segment_t *prep_segment = segment_buffer_head;
+
+    prep_segment->exec_block = st_prep_block;
+    prep_segment->n_step = 1;
+    prep_segment->update_rpm = prep_segment->spindle_sync = prep_segment->cruising = false;
+    prep_segment->current_rate = 0.0f;
+#ifdef ENABLE_FAST_JOG_CANCEL
+    prep_segment->pl_block = NULL;
+#endif
+#ifdef ENABLE_LASER_PWM_TRACKING
+    prep_segment->spindle_pwm_step = 0;
+#endif
+
+    if (sys.step_control.update_spindle_rpm) {
+        // Rate adjusted laser power is off while dwelling as there is no motion.
+        float rpm = !pl_block->condition.spindle.on || (pl_block->condition.is_rpm_rate_adjusted && !pl_block->condition.is_laser_ppi_mode)
+                     ? 0.0f
+                     : spindle_set_rpm(pl_block->spindle_rpm, sys.override.spindle_rpm);
+        if(rpm != prep.current_spindle_rpm) {
+          #ifdef SPINDLE_PWM_DIRECT
+            prep.current_spindle_rpm = rpm;
+            prep_segment->spindle_pwm = hal.spindle.get_pwm(rpm);
+          #else
+            prep.current_spindle_rpm = prep_segment->spindle_rpm = rpm;
+          #endif
+          #ifdef ENABLE_LASER_PWM_TRACKING
+            prep.spindle_pwm = prep_segment->spindle_pwm;
+            prep.spindle_pwm_valid = true;
+          #endif
+            prep_segment->update_rpm = true;
+        }
+        sys.step_control.update_spindle_rpm = Off;
     }
-    // Set flags to execute a parking motion
-    prep.recalculate.parking = On;
-    prep.recalculate.velocity_profile = Off;
-    pl_block = NULL; // Always reset parking motion to reload new block.
-}
 
+    segment_set_rate(prep_segment, (uint32_t)ceilf(cycles_per_min * dt));
+    segment_commit(prep_segment);
 
-// Restores the step segment buffer to the normal run state after a parking motion.
-void st_parking_restore_buffer()
-{
-    // Restore step execution data and flags of partially completed block, if necessary.
-    if (prep.recalculate.hold_partial_block) {
-        st_prep_block = prep.last_st_block;
-        prep.steps_remaining = prep.last_steps_remaining;
-        prep.dt_remainder = prep.last_dt_remainder;
-        prep.steps_per_mm = prep.last_steps_per_mm;
-        prep.recalculate.flags = 0;
-        prep.recalculate.hold_partial_block = prep.recalculate.velocity_profile = On;
-        prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.steps_per_mm; // Recompute this value.
-    } else
-        prep.recalculate.flags = 0;
+    if ((pl_block->dwell -= dt) <= 0.0f) {
+        if(grbl.on_block_completed)
+            grbl.on_block_completed(pl_block);
+        pl_block = NULL;
+        plan_discard_current_block();
+        motion_pending = plan_get_current_block() != NULL;
+    }
 
-    pl_block = NULL; // Set to reload next block.
+    return true;
 }
 
-/* Prepares step segment buffer. Continuously called from main program.
+#endif
 
-   The segment buffer is an intermediary buffer interface between the execution of steps
-   by the stepper algorithm and the velocity profiles generated by the planner. The stepper
-   algorithm only executes steps within the segment buffer and is filled by the main program
-   when steps are "checked-out" from the first block in the planner buffer. This keeps the
-   step execution and planning optimization processes atomic and protected from each other.
-   The number of steps "checked-out" from the planner buffer and the number of segments in
-   the segment buffer is sized and computed such that no operation in the main program takes
-   longer than the time it takes the stepper algorithm to empty it before refilling it.
-   Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
-   NOTE: Computation units are in steps, millimeters, and minutes.
-*/
-void st_prep_buffer()
+static void prep_buffer (void)
 {
+#ifdef ENABLE_MOTION_SYNC
+    // Slaves only execute the segments received from the master.
+    if (motion_sync_role() == MotionSync_Slave)
+        return;
+#endif
+
     // Block step prep buffer, while in a suspend state and there is no suspend motion to execute.
-    if (sys.step_control.end_motion)
+    if (sys.step_control.end_motion) {
+#ifdef ENABLE_INPUT_SHAPING
+        // Shaped motion is output to the end of the forced deceleration.
+        while (segment_buffer_tail != segment_next_head && shaper_output(true));
+#endif
+        return;
+    }
+
+#ifdef ENABLE_JOG_VELOCITY
+    if (jog.active) {
+        if(!(jog.stopped || jog.ended))
+            prep_jog_velocity();
         return;
+    }
+#endif
 
     while (segment_buffer_tail != segment_next_head) { // Check if we need to fill the buffer.
 
@@ -610,8 +2220,71 @@ void st_prep_buffer()
 
             pl_block = sys.step_control.execute_sys_motion ? plan_get_system_motion_block() : plan_get_current_block();
 
-            if (pl_block == NULL)
+            motion_pending = pl_block != NULL;
+
+            if (pl_block == NULL) {
+#ifdef ENABLE_INPUT_SHAPING
+                // No more input, complete the shaped motion.
+                if (shaper_output(true)) {
+                    motion_pending = true;
+                    continue;
+                }
+#endif
                 return; // No planner blocks. Exit.
+            }
+
+#ifdef ENABLE_THREADING_PIPELINE
+            // A spindle synchronized motion following unsynchronized motion is held until the steppers are idle,
+            // the cycle is then restarted at the next spindle index pulse by the state machine.
+            if (!prep.recalculate.velocity_profile) {
+                if (pl_block->condition.spindle.synchronized && !prep_synchronized && !stepper_idle) {
+                    pl_block = NULL;
+                    motion_pending = false;
+                    return;
+                }
+                prep_synchronized = pl_block->condition.spindle.synchronized;
+            }
+#endif
+
+#ifdef ENABLE_INPUT_SHAPING
+            if (!shaper.active)
+                shaper_configure();
+
+            // Shaped motion is completed before motion that is not to be shaped is started, and before
+            // a new block is loaded when the shaper has no room for it.
+            prep.shaped = shaper_is_shaping(pl_block);
+            if (shaper.active && (!prep.shaped || (!prep.recalculate.velocity_profile && shaper.n_blocks == INPUT_SHAPER_BLOCKS))) {
+                if (prep.shaped && !shaper.stalled) {
+                    shaper.stalled = true;
+                    stats.shaper_stalls++;
+                }
+                pl_block = NULL;
+                shaper_output(true);
+                continue;
+            }
+#endif
+
+            if(!sys.step_control.execute_sys_motion) {
+                uint_fast16_t blocks = plan_get_block_buffer_size() - 1 - plan_get_block_buffer_available();
+                if(blocks < stats.planner_buffer_min)
+                    stats.planner_buffer_min = blocks;
+            }
+
+#ifdef ENABLE_MOTION_TRACE
+            motion_trace_block(pl_block, prep.recalculate.velocity_profile);
+#endif
+
+#ifdef ENABLE_PLANNED_DWELL
+            // A dwell block resumed after a feed hold continues with the remaining dwell time.
+            if (pl_block->condition.dwell) {
+                if (!prep.recalculate.velocity_profile)
+                    prep_dwell_block();
+                prep.recalculate.flags = 0;
+                prep.current_speed = 0.0f;
+                sys.step_control.update_spindle_rpm |= (settings.mode == Mode_Laser);
+                continue;
+            }
+#endif
 
             // Check if we need to only recompute the velocity profile or load a new block.
             if (prep.recalculate.velocity_profile) {
@@ -652,11 +2325,37 @@ void st_prep_buffer()
                 st_prep_block->programmed_rate = pl_block->programmed_rate;
                 st_prep_block->millimeters = pl_block->millimeters;
                 st_prep_block->steps_per_mm = (float)pl_block->step_event_count / pl_block->millimeters;
-                st_prep_block->output_commands = pl_block->output_commands;
+                st_prep_block->ppi_interval = laser_ppi_distance > 0.0f ? st_ppi_interval(st_prep_block->steps_per_mm) : 0;
                 st_prep_block->overrides = pl_block->overrides;
-                st_prep_block->backlash_motion = pl_block->condition.backlash_motion;
-                st_prep_block->message = pl_block->message;
-                pl_block->message= NULL;
+#ifdef ENABLE_BACKLASH_COMPENSATION
+                idx = N_AXIS;
+                do {
+                    idx--;
+                    st_prep_block->backlash_steps[idx] = (pl_block->backlash.mask & bit(idx)) ? (uint32_t)lroundf(settings.axis[idx].backlash * settings.axis[idx].steps_per_mm) : 0;
+                } while(idx);
+#endif
+
+#ifdef ENABLE_LASER_RASTER
+                // Release raster of the block previously held by the stepper block, it is no longer executing.
+                if(st_prep_block->raster) {
+                    free(st_prep_block->raster);
+                    st_prep_block->raster = NULL;
+                }
+#endif
+
+                plan_block_data_t *pl_data;
+                if((pl_data = plan_get_block_data(pl_block))) {
+                    st_prep_block->output_commands = pl_data->output_commands;
+                    st_prep_block->message = pl_data->message;
+                    pl_data->message = 0;
+#ifdef ENABLE_LASER_RASTER
+                    st_prep_block->raster = pl_data->raster;
+                    pl_data->raster = NULL;
+#endif
+                } else {
+                    st_prep_block->output_commands = NULL;
+                    st_prep_block->message = 0;
+                }
 
                 // Initialize segment buffer data for generating the segments.
                 prep.steps_per_mm = st_prep_block->steps_per_mm;
@@ -679,6 +2378,29 @@ void st_prep_buffer()
                     prep.inv_feedrate = pl_block->condition.is_laser_ppi_mode ? 1.0f : 1.0f / pl_block->programmed_rate;
                 else
                     st_prep_block->dynamic_rpm = pl_block->condition.is_rpm_pos_adjusted;
+
+#ifdef ENABLE_LASER_RASTER
+                // Pixel power is output by the stepper ISR relative to the programmed spindle speed with overrides applied.
+                // The block is flagged as rate controlled so that the laser is switched off on completion of motion.
+                if(st_prep_block->raster) {
+                    float rpm = pl_block->condition.spindle.on ? spindle_set_rpm(pl_block->spindle_rpm, sys.override.spindle_rpm) : 0.0f;
+                  #ifdef SPINDLE_PWM_DIRECT
+                    st_prep_block->raster_pwm_off = hal.spindle.get_pwm(0.0f);
+                    st_prep_block->raster_pwm_min = hal.spindle.get_pwm(settings.spindle.rpm_min);
+                    st_prep_block->raster_pwm_span = rpm > settings.spindle.rpm_min ? hal.spindle.get_pwm(rpm) - st_prep_block->raster_pwm_min : 0;
+                  #else
+                    st_prep_block->raster_rpm = rpm;
+                  #endif
+                    st_prep_block->dynamic_rpm = true;
+                }
+#endif
+
+#ifdef ENABLE_NATIVE_ARCS
+                if(pl_block->condition.arc_motion) {
+                    memset(prep.arc_position, 0, sizeof(prep.arc_position));
+                    prep.arc_chord = false;
+                }
+#endif
             }
 
             /* ---------------------------------------------------------------------------------
@@ -774,10 +2496,31 @@ void st_prep_buffer()
                 }
             }
 
+#ifdef ENABLE_JERK_ACCELERATION
+            if(prep.ramp_type == Ramp_Accel)
+                jerk_ramp_init(prep.current_speed, prep.maximum_speed, pl_block->millimeters, prep.accelerate_until, pl_block->jerk);
+            else if(prep.ramp_type == Ramp_Decel)
+                jerk_ramp_init(prep.current_speed, prep.exit_speed, pl_block->millimeters, prep.mm_complete, pl_block->jerk);
+#endif
+
             if(sys.state != STATE_HOMING)
                 sys.step_control.update_spindle_rpm |= (settings.mode == Mode_Laser); // Force update whenever updating block in laser mode.
         }
 
+#ifdef ENABLE_INPUT_SHAPING
+        // Output shaped motion while the input generated covers it.
+        if (prep.shaped && shaper_output(false))
+            continue;
+#endif
+
+#ifdef ENABLE_PLANNED_DWELL
+        if (pl_block->condition.dwell) {
+            if (!prep_dwell())
+                return;
+            continue;
+        }
+#endif
+
         // Initialize new segment
         segment_t *prep_segment = segment_buffer_head;
 
@@ -810,6 +2553,15 @@ void st_prep_buffer()
         if (minimum_mm < 0.0f)
             minimum_mm = 0.0f;
 
+#ifdef ENABLE_NATIVE_ARCS
+        // Limit segment time of arcs to keep the chord length within the arc tolerance.
+        if(pl_block->condition.arc_motion) {
+            speed_var = max(prep.current_speed, prep.maximum_speed);
+            if(speed_var * dt_max > pl_block->arc.chord_max)
+                time_var = dt_max = pl_block->arc.chord_max / speed_var;
+        }
+#endif
+
         do {
 
             switch (prep.ramp_type) {
@@ -830,6 +2582,17 @@ void st_prep_buffer()
 
                 case Ramp_Accel:
                     // NOTE: Acceleration ramp only computes during first do-while loop.
+#ifdef ENABLE_JERK_ACCELERATION
+                    if(!jerk_ramp_step(&time_var, &mm_remaining, &prep.current_speed)) {
+                        // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
+                        // NOTE: time_var is set to the remaining ramp time.
+                        mm_remaining = prep.accelerate_until; // NOTE: 0.0 at EOB
+                        prep.current_speed = prep.maximum_speed;
+                        if((prep.ramp_type = mm_remaining == prep.decelerate_after ? Ramp_Decel : Ramp_Cruise) == Ramp_Decel)
+                            jerk_ramp_init(prep.current_speed, prep.exit_speed, mm_remaining, prep.mm_complete, pl_block->jerk);
+                    }
+                    break;
+#endif
                     speed_var = pl_block->acceleration * time_var;
                     mm_remaining -= time_var * (prep.current_speed + 0.5f * speed_var);
                     if (mm_remaining < prep.accelerate_until) { // End of acceleration ramp.
@@ -852,11 +2615,25 @@ void st_prep_buffer()
                         time_var = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
                         mm_remaining = prep.decelerate_after; // NOTE: 0.0 at EOB
                         prep.ramp_type = Ramp_Decel;
+#ifdef ENABLE_JERK_ACCELERATION
+                        jerk_ramp_init(prep.maximum_speed, prep.exit_speed, mm_remaining, prep.mm_complete, pl_block->jerk);
+#endif
                     } else // Cruising only.
                         mm_remaining = mm_var;
                     break;
 
                 default: // case Ramp_Decel:
+#ifdef ENABLE_JERK_ACCELERATION
+                    if(jerk_ramp_step(&time_var, &mm_var, &speed_var) && mm_var > prep.mm_complete) {
+                        mm_remaining = mm_var;
+                        prep.current_speed = speed_var;
+                    } else {
+                        // End of block or end of forced-deceleration. NOTE: time_var is set to the remaining ramp time.
+                        mm_remaining = prep.mm_complete;
+                        prep.current_speed = prep.exit_speed;
+                    }
+                    break;
+#endif
                     // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
                     speed_var = pl_block->acceleration * time_var; // Used as delta speed (mm/min)
                     if (prep.current_speed > speed_var) { // Check if at or below zero speed.
@@ -890,24 +2667,48 @@ void st_prep_buffer()
 
         } while (mm_remaining > prep.mm_complete); // **Complete** Exit loop. Profile complete.
 
+#ifdef ENABLE_NATIVE_ARCS
+        uint32_t arc_steps = 0;
+
+        // Load the arc chord of the segment. If there are no steps to execute carry the segment time over to the next segment.
+        if(pl_block->condition.arc_motion && (arc_steps = prep_arc_chord(mm_remaining)) == 0 && mm_remaining > prep.mm_complete) {
+            prep.dt_remainder += dt;
+            pl_block->millimeters = mm_remaining;
+            continue;
+        }
+#endif
+
         /* -----------------------------------------------------------------------------------
            Compute spindle spindle speed for step segment
         */
 
+#ifdef ENABLE_LASER_RASTER
+        if (st_prep_block->raster) {
+            prep.current_spindle_rpm = -1.0f; // Power is set per pixel by the stepper ISR, force spindle update for the next block.
+  #ifdef ENABLE_LASER_PWM_TRACKING
+            prep.spindle_pwm_valid = false;
+  #endif
+        } else
+#endif
         if (sys.step_control.update_spindle_rpm || st_prep_block->dynamic_rpm) {
             float rpm;
-            if (pl_block->condition.spindle.on) {
+            plan_block_data_t *pl_data;
+            if (pl_block->condition.spindle.on && pl_block->condition.is_rpm_pos_adjusted && (pl_data = plan_get_block_data(pl_block))) {
+                // Constant Surface Speed: RPM is computed from the radial position at the middle of the segment.
+                float pos = pl_data->css.start_pos + pl_data->css.delta_pos *
+                             (1.0f - 0.5f * (pl_block->millimeters + mm_remaining) / st_prep_block->millimeters);
+                rpm = spindle_set_rpm(pos > 0.0f ? min(pl_data->css.max_rpm, pl_data->css.surface_speed / (pos * (float)(2.0f * M_PI)))
+                                                 : pl_data->css.max_rpm, sys.override.spindle_rpm);
+                // Small changes are held back, unless a spindle update is requested.
+                if(!sys.step_control.update_spindle_rpm && fabsf(rpm - prep.current_spindle_rpm) < rpm * (CSS_RPM_HYSTERESIS / 100.0f))
+                    rpm = prep.current_spindle_rpm;
+            } else if (pl_block->condition.spindle.on) {
                 // NOTE: Feed and rapid overrides are independent of PWM value and do not alter laser power/rate.
                 // If current_speed is zero, then may need to be rpm_min*(100/MAX_SPINDLE_RPM_OVERRIDE)
                 // but this would be instantaneous only and during a motion. May not matter at all.
                 rpm = spindle_set_rpm(pl_block->condition.is_rpm_rate_adjusted && !pl_block->condition.is_laser_ppi_mode
-                                       ? pl_block->spindle.rpm * prep.current_speed * prep.inv_feedrate
-                                       : pl_block->spindle.rpm, sys.override.spindle_rpm);
-
-                if(pl_block->condition.is_rpm_pos_adjusted) {
-                    float npos = (float)(pl_block->step_event_count - prep.steps_remaining) / (float)pl_block->step_event_count;
-                    rpm += (spindle_set_rpm(pl_block->spindle.css.target_rpm, sys.override.spindle_rpm) - prep.current_spindle_rpm) * npos;
-                }
+                                       ? pl_block->spindle_rpm * prep.current_speed * prep.inv_feedrate
+                                       : pl_block->spindle_rpm, sys.override.spindle_rpm);
             } else
                 sys.spindle_rpm = rpm = 0.0f;
 
@@ -936,6 +2737,12 @@ void st_prep_buffer()
         float step_dist_remaining = prep.steps_per_mm * mm_remaining; // Convert mm_remaining to steps
         uint32_t n_steps_remaining = (uint32_t)ceilf(step_dist_remaining); // Round-up current steps remaining
 
+#ifdef ENABLE_NATIVE_ARCS
+        if(pl_block->condition.arc_motion) {
+            prep_segment->exec_block = st_prep_block;
+            prep_segment->n_step = (uint_fast16_t)arc_steps;
+        } else
+#endif
         prep_segment->n_step = (uint_fast16_t)(prep.steps_remaining - n_steps_remaining); // Compute number of steps to execute.
 
         // Bail if we are at the end of a feed hold and don't have a step to execute.
@@ -958,40 +2765,67 @@ void st_prep_buffer()
         // outputs the exact acceleration and velocity profiles as computed by the planner.
         dt += prep.dt_remainder; // Apply previous segment partial step execute time
         float inv_rate = dt / ((float)prep.steps_remaining - step_dist_remaining); // Compute adjusted step rate inverse
+#ifdef ENABLE_NATIVE_ARCS
+        if(pl_block->condition.arc_motion) // Chords end on whole steps, no partial step compensation is required.
+            inv_rate = dt / (float)(arc_steps ? arc_steps : 1);
+#endif
 
         // Compute timer ticks per step for the prepped segment.
         uint32_t cycles = (uint32_t)ceilf(cycles_per_min * inv_rate); // (cycles/step)
 
         // Record end position of segment relative to block if spindle synchronized motion
+        prep_segment->cruising = prep.ramp_type == Ramp_Cruise;
         if((prep_segment->spindle_sync = pl_block->condition.spindle.synchronized)) {
             prep.target_position += dt * prep.target_feed;
-            prep_segment->cruising = prep.ramp_type == Ramp_Cruise;
             prep_segment->target_position = prep.target_position; //st_prep_block->millimeters - pl_block->millimeters;
         }
 
-      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-        // Compute step timing and multi-axis smoothing level.
-        // NOTE: AMASS overdrives the timer with each level, so only one prescalar is required.
-        if (cycles < amass.level_1)
-            prep_segment->amass_level = 0;
-        else {
-            prep_segment->amass_level = cycles < amass.level_2 ? 1 : (cycles < amass.level_3 ? 2 : 3);
-            cycles >>= prep_segment->amass_level;
-            prep_segment->n_step <<= prep_segment->amass_level;
-        }
-      #endif
-
-        prep_segment->cycles_per_tick = cycles;
+        segment_set_rate(prep_segment, cycles);
         prep_segment->current_rate = prep.current_speed;
 
+#ifdef ENABLE_LASER_PWM_TRACKING
+        // In rate adjusted laser mode ramp the power linearly over the step ticks of the segment, from the
+        // power at the end of the previous segment to the power at the end of this one, so that it tracks velocity.
+        prep_segment->spindle_pwm_step = 0;
+        if(prep_segment->update_rpm) {
+            if(prep.spindle_pwm_valid && prep_segment->n_step > 1 &&
+                pl_block->condition.is_rpm_rate_adjusted && !pl_block->condition.is_laser_ppi_mode) {
+                float step = (float)((int32_t)prep_segment->spindle_pwm - (int32_t)prep.spindle_pwm) * 65536.0f / (float)prep_segment->n_step;
+                if(fabsf(step) < 2.0e9f)
+                    prep_segment->spindle_pwm_step = (int32_t)step;
+            }
+            prep.spindle_pwm = prep_segment->spindle_pwm;
+            prep.spindle_pwm_valid = true;
+        }
+#endif
+
         // Segment complete! Increment segment pointers, so stepper ISR can immediately execute it.
-        segment_buffer_head = segment_next_head;
-        segment_next_head = segment_next_head->next;
+#ifdef ENABLE_INPUT_SHAPING
+        // Shaped segments are added to the shaper input instead, the motion is output by shaper_output().
+        if (prep.shaped)
+            shaper_input(prep_segment, pl_block->millimeters, mm_remaining, dt);
+        else
+#endif
+        segment_commit(prep_segment);
 
         // Update the appropriate planner and segment data.
         pl_block->millimeters = mm_remaining;
         prep.steps_remaining = n_steps_remaining;
         prep.dt_remainder = ((float)n_steps_remaining - step_dist_remaining) * inv_rate;
+#ifdef ENABLE_NATIVE_ARCS
+        if(pl_block->condition.arc_motion)
+            prep.dt_remainder = 0.0f;
+#endif
+#ifdef ENABLE_INPUT_SHAPING
+        if(prep.shaped)
+            prep.dt_remainder = 0.0f; // Partial steps are carried over by the shaper output.
+#endif
+#ifdef ENABLE_FAST_JOG_CANCEL
+        prep_segment->pl_block = pl_block;
+        prep_segment->mm_remaining = mm_remaining;
+        prep_segment->dt_remainder = prep.dt_remainder;
+        prep_segment->steps_remaining = n_steps_remaining;
+#endif
 
         // Check for exit conditions and flag to load next planner block.
         if (mm_remaining <= prep.mm_complete) {
@@ -1007,18 +2841,85 @@ void st_prep_buffer()
                 return; // Bail!
             } else { // End of planner block
                 // The planner block is complete. All steps are set to be executed in the segment buffer.
+                if(grbl.on_block_completed)
+                    grbl.on_block_completed(pl_block);
                 if (sys.step_control.execute_sys_motion) {
                     sys.step_control.end_motion = On;
                     return;
                 }
                 pl_block = NULL; // Set pointer to indicate check and load next planner block.
                 plan_discard_current_block();
+                motion_pending = plan_get_current_block() != NULL;
             }
         }
     }
 }
 
 
+// Fills the step segment buffer, or triggers the low priority interrupt that fills it.
+void st_prep_buffer (void)
+{
+    if(hal.stepper.prep_trigger)
+        hal.stepper.prep_trigger();
+    else
+        prep_buffer();
+}
+
+// Called from the low priority interrupt pended by hal.stepper.prep_trigger().
+ISR_CODE void st_prep_buffer_irq (void)
+{
+    if(prep_lock)
+        prep_pending = true;
+    else
+        prep_buffer();
+}
+
+// Defers interrupt driven segment prep while the main program updates shared data.
+// A deferred prep request is triggered again when the outermost lock is released.
+void st_prep_lock (bool lock)
+{
+    if(hal.stepper.prep_trigger == NULL)
+        return;
+
+    if(lock)
+        prep_lock++;
+    else if(prep_lock && --prep_lock == 0 && prep_pending) {
+        prep_pending = false;
+        hal.stepper.prep_trigger();
+    }
+}
+
+// Copies the instrumentation data for reporting, optionally resets it.
+void st_get_stats (st_stats_t *data, bool reset)
+{
+    hal.irq_disable();
+
+    memcpy(data, (void *)&stats, sizeof(st_stats_t));
+
+    if(reset)
+        stats_reset();
+
+    hal.irq_enable();
+}
+
+// Returns the number of segments allocated for the step segment buffer.
+uint_fast8_t st_get_segment_buffer_size (void)
+{
+    return segment_buffer_size;
+}
+
+// Returns the memory in bytes used by the step segment buffer and the stepper block data for the segments.
+uint32_t st_get_segment_buffer_memory (void)
+{
+    return segment_buffer_size * sizeof(segment_t) + st_block_buffer_size * sizeof(st_block_t);
+}
+
+// Returns the number of segments queued in the step segment buffer.
+uint_fast8_t st_get_segment_buffer_level (void)
+{
+    return (segment_buffer_head->id + segment_buffer_size - segment_buffer_tail->id) % segment_buffer_size;
+}
+
 // Called by realtime status reporting to fetch the current speed being executed. This value
 // however is not exactly the current speed, but the speed computed in the last step segment
 // in the segment buffer. It will always be behind by up to the number of segment blocks (-1)
@@ -26,10 +26,36 @@
 #ifndef _STEPPER_H_
 #define _STEPPER_H_
 
+// NOTE: The actual number is set by $389 at boot, this is the default and fallback value.
 #ifndef SEGMENT_BUFFER_SIZE
 #define SEGMENT_BUFFER_SIZE 10
 #endif
 
+// Limits for the number of segments that can be set by $389.
+#ifndef SEGMENT_BUFFER_SIZE_MIN
+#define SEGMENT_BUFFER_SIZE_MIN 4
+#endif
+#ifndef SEGMENT_BUFFER_SIZE_MAX
+#define SEGMENT_BUFFER_SIZE_MAX 64
+#endif
+
+// Segment buffer fill level that triggers segment prep from the stepper interrupt when the driver
+// provides interrupt driven segment prep, see hal.stepper.prep_trigger.
+// Defaults to half the number of segments set by $389 if not defined here.
+//#define SEGMENT_PREP_WATERMARK 5
+
+#ifdef ENABLE_INPUT_SHAPING
+// Number of path position samples and planner blocks kept by the input shaper. The samples limit the shaper
+// duration to (INPUT_SHAPER_SAMPLES - 8) / 2 segment times, the blocks the number of blocks shaped motion can
+// span within the shaper duration. Motion stalls until the oldest block is completed if more are required.
+#ifndef INPUT_SHAPER_SAMPLES
+#define INPUT_SHAPER_SAMPLES 32
+#endif
+#ifndef INPUT_SHAPER_BLOCKS
+#define INPUT_SHAPER_BLOCKS 16
+#endif
+#endif
+
 typedef enum {
     SquaringMode_Both = 0,
     SquaringMode_A,
@@ -48,54 +74,80 @@ typedef struct st_block {
     axes_signals_t direction_bits;
     gc_override_flags_t overrides;    // Block bitfield variable for overrides
     float steps_per_mm;
+    uint32_t ppi_interval;             // Laser PPI mode pulse interval in Bresenham step event units, 0 if not in PPI mode
     float millimeters;
     float programmed_rate;
-    char *message;                     // Message to be displayed when block is executed
+    uint8_t message;                   // Id of message to be displayed when block is executed, 0 if none
     output_command_t *output_commands; // Output commands (linked list) to be performed when block is executed
     bool dynamic_rpm;                  // Tracks motions that require dynamic RPM adjustment
-    bool backlash_motion;
+#ifdef ENABLE_BACKLASH_COMPENSATION
+    uint32_t backlash_steps[N_AXIS];   // Backlash takeup steps of reversing axes, output at the start of the block
+#endif
+#ifdef ENABLE_LASER_RASTER
+    laser_raster_t *raster;            // Laser pixel powers to be output evenly spaced over the block, NULL if none
+  #ifdef SPINDLE_PWM_DIRECT
+    uint_fast16_t raster_pwm_off;      // PWM value for zero power pixels
+    uint_fast16_t raster_pwm_min;      // PWM value at minimum spindle speed
+    uint_fast16_t raster_pwm_span;     // PWM range from minimum to programmed spindle speed
+  #else
+    float raster_rpm;                  // Spindle speed for full power pixels, overrides applied
+  #endif
+#endif
 } st_block_t;
 
 typedef struct st_segment {
     uint_fast8_t id;                // Id may be used by driver to track changes
     struct st_segment *next;        // Pointer to next element in cirular list of segments
     st_block_t *exec_block;         // Pointer to the block data for the segment
+    uint32_t steps[N_AXIS];         // Bresenham axis increments of the block, adjusted for the AMASS level of the segment
     uint32_t cycles_per_tick;       // Step distance traveled per ISR tick, aka step rate.
     float current_rate;
     float target_position;          // Target position of segment relative to block start, used by spindle sync code
     uint_fast16_t n_step;           // Number of step events to be executed for this segment
 #ifdef SPINDLE_PWM_DIRECT
     uint_fast16_t spindle_pwm;      // Spindle PWM to be set at the start of segment execution
+  #ifdef ENABLE_LASER_PWM_TRACKING
+    int32_t spindle_pwm_step;       // Fixed point (16.16) PWM increment per step tick when ramping to spindle_pwm, 0 if set at start
+  #endif
 #else
     float spindle_rpm;              // Spindle RPM to be set at the start of the segment execution
 #endif
     bool update_rpm;                // True if set spindle speed at the start of the segment execution
     bool spindle_sync;              // True if block is spindle synchronized
-    bool cruising;                  // True when in cruising part of profile, only set for spindle synced moves
+    bool cruising;                  // True when in cruising part of profile, false when accelerating or decelerating
     uint_fast8_t amass_level;       // Indicates AMASS level for the ISR to execute this segment
+#ifdef ENABLE_FAST_JOG_CANCEL
+    // Segment prep state at the end of the segment, used by st_truncate_buffer()
+    plan_block_t *pl_block;         // Planner block the segment was prepped from, NULL if not prepped from a planner block motion
+    float mm_remaining;             // Distance remaining in the planner block
+    float dt_remainder;
+    uint32_t steps_remaining;
+#endif
 } segment_t;
 
+// Stepper instrumentation data, updated by the stepper interrupt and segment prep.
+// NOTE: ISR cycle counts are only available if the driver provides hal.get_cycle_count.
+typedef struct {
+    uint32_t isr_cycles_min;            // Minimum stepper interrupt execution time in CPU cycles
+    uint32_t isr_cycles_max;            // Maximum stepper interrupt execution time in CPU cycles
+    uint32_t isr_cycles_avg;            // Moving average of stepper interrupt execution time in CPU cycles
+    uint32_t underruns;                 // Number of times the segment buffer ran dry with motion pending
+    uint_fast8_t segment_buffer_min;    // Lowest segment buffer fill level seen while a block was being prepped
+    uint_fast16_t planner_buffer_min;   // Lowest number of blocks in the planner buffer when a new block was loaded for prep
+#ifdef ENABLE_INPUT_SHAPING
+    uint32_t shaper_stalls;             // Number of times shaped motion was stalled by lack of room for planner blocks
+#endif
+} st_stats_t;
+
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
 typedef struct {
     // Used by the bresenham line algorithm
-    uint32_t counter_x,        // Counter variables for the bresenham line tracer
-             counter_y,
-             counter_z
-    #ifdef A_AXIS
-           , counter_a
-    #endif
-    #ifdef B_AXIS
-          , counter_b
-    #endif
-    #ifdef C_AXIS
-          , counter_c
-    #endif
-;
+    uint32_t counter[N_AXIS];       // Counter variables for the bresenham line tracer
     bool new_block;                 // Set to true when a new block is started, might be used by driver for advanced functionality
     bool dir_change;                // Set to true on direction changes, might be used by driver for advanced functionality
     axes_signals_t step_outbits;    // The next stepping-bits to be output
     axes_signals_t dir_outbits;     // The next direction-bits to be output
-    uint32_t steps[N_AXIS];
+    uint32_t steps[N_AXIS];         // Bresenham axis increments for this segment, copied from the segment
     uint_fast8_t amass_level;       // AMASS level for this segment
 //    uint_fast16_t spindle_pwm;
     uint_fast16_t step_count;       // Steps remaining in line segment motion
@@ -110,6 +162,9 @@ void stepper_init();
 // Enable steppers, but cycle does not start unless called by motion control or realtime command.
 void st_wake_up();
 
+// Enable stepper drivers only, to be called before the segment buffer is prepped for a new cycle.
+void st_energize (void);
+
 // Immediately disables steppers
 void st_go_idle();
 
@@ -119,6 +174,9 @@ void st_reset();
 // Called by spindle_set_state() to inform about RPM changes.
 void st_rpm_changed(float rpm);
 
+// Called by gc_laser_ppi_enable() to inform about laser PPI rate changes.
+void st_set_laser_ppi (uint_fast16_t ppi);
+
 // Changes the run state of the step segment buffer to execute the special parking motion.
 void st_parking_setup_buffer();
 
@@ -126,14 +184,73 @@ void st_parking_setup_buffer();
 void st_parking_restore_buffer();
 
 // Reloads step segment buffer. Called continuously by realtime execution system.
+// NOTE: If the driver provides interrupt driven segment prep this only triggers the low priority interrupt.
 void st_prep_buffer();
 
+// Reloads step segment buffer. Called from the low priority interrupt pended by hal.stepper.prep_trigger().
+void st_prep_buffer_irq (void);
+
+// Defers interrupt driven segment prep while the foreground updates shared planner and prep data. Calls may be nested.
+void st_prep_lock (bool lock);
+
+// Copies the stepper instrumentation data, optionally resets it.
+void st_get_stats (st_stats_t *stats, bool reset);
+
+// Returns the number of segments allocated for the step segment buffer.
+uint_fast8_t st_get_segment_buffer_size (void);
+
+// Returns the memory in bytes used by the step segment buffer and the stepper block data for the segments.
+uint32_t st_get_segment_buffer_memory (void);
+
+// Returns the number of segments queued in the step segment buffer.
+uint_fast8_t st_get_segment_buffer_level (void);
+
+#ifdef ENABLE_FAST_JOG_CANCEL
+// Discards the prepped segments following the next segment to be executed, the hold deceleration then starts from there.
+void st_truncate_buffer (void);
+#endif
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters();
 
 // Called by realtime status reporting if realtime rate reporting is enabled in config.h.
 float st_get_realtime_rate();
 
+#ifdef ENABLE_INPUT_SHAPING
+// Returns the duration of the configured input shaper in seconds, 0 if shaping is off.
+float st_get_input_shaper_duration (void);
+#endif
+
+// Copies the real-time machine position in steps, including the steps executed by the current segment.
+// NOTE: sys_position is only updated when a segment is complete, use this while motion may be in progress.
+void st_get_position (int32_t *position);
+
+#ifdef ENABLE_JOG_VELOCITY
+// Sets target velocity per axis (mm/min) for velocity jogging, starts a velocity jog if not already active.
+// Returns false if motion has ended and the completion callback is pending.
+bool st_jog_velocity (float *velocity, void (*on_completed)(uint_fast16_t state));
+
+// Returns true while velocity jogging.
+bool st_jog_velocity_active (void);
+
+// Ends velocity jogging, to be called from the completion callback.
+void st_jog_velocity_end (void);
+#endif
+
 void stepper_driver_interrupt_handler (void);
 
+// Generates step bit patterns for a segment for output by DMA or a timer driven pattern generator.
+stepper_t *st_stream_segment (axes_signals_t *pattern, uint_fast16_t *count, uint32_t *cycles_per_tick);
+
+// Executes motion for a fixed period and returns the commanded position in steps, for drivers that stream positions
+// to networked servo drives instead of outputting step pulses.
+bool st_sample_position (uint32_t cycles, float *position);
+
+#ifdef ENABLE_MOTION_SYNC
+// Adds a block and segments received from the master controller to the segment buffer of a slave, see motion_sync.h.
+bool st_sync_add_block (const uint32_t *steps, uint32_t step_event_count, axes_signals_t direction_bits);
+bool st_sync_add_segment (uint_fast16_t n_step, uint32_t cycles_per_tick, uint_fast8_t amass_level);
+bool st_sync_idle (void);
+#endif
+
 #endif
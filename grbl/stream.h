@@ -86,10 +86,60 @@ typedef struct {
 #ifdef SERIAL_RTS_HANDSHAKE
     volatile bool rts_state;
 #endif
-    bool backup;
+    bool backup;                        // Input is suspended for a tool change, pending data is kept between suspend_tail and suspend_head
+    uint_fast16_t suspend_tail;
+    uint_fast16_t suspend_head;
     char data[RX_BUFFER_SIZE];
 } stream_rx_buffer_t;
 
+// Marks the data in the receive buffer as suspended when CMD_TOOL_ACK is received, the buffer is then
+// empty for input received during the tool change. Called from the receive interrupt handler.
+static inline void stream_rx_suspend (stream_rx_buffer_t *rxbuffer)
+{
+    rxbuffer->suspend_tail = rxbuffer->tail;
+    rxbuffer->suspend_head = rxbuffer->head;
+    rxbuffer->backup = true;
+    rxbuffer->tail = rxbuffer->head;
+}
+
+// Discards input received during the tool change and restores the suspended data.
+static inline void stream_rx_resume (stream_rx_buffer_t *rxbuffer)
+{
+    if(rxbuffer->backup) {
+        rxbuffer->head = rxbuffer->suspend_head;
+        rxbuffer->tail = rxbuffer->suspend_tail;
+        rxbuffer->backup = false;
+    }
+}
+
+// Returns true if adding a character at next_head would overwrite unread or suspended data.
+static inline bool stream_rx_buffer_full (stream_rx_buffer_t *rxbuffer, uint_fast16_t next_head)
+{
+    return next_head == rxbuffer->tail || (rxbuffer->backup && next_head == rxbuffer->suspend_tail);
+}
+
+// Copies characters from the receive buffer up to and including the first end of line character,
+// returns the number of characters copied. May be used by drivers for implementing hal.stream.read_block.
+// NOTE: Stopping at the end of line ensures no input is held back by the caller when a line is executed,
+//       e.g. when the input stream is suspended for a tool change.
+static inline uint16_t stream_rx_buffer_read_block (stream_rx_buffer_t *rxbuffer, char *buf, uint16_t size)
+{
+    char c;
+    uint16_t count = 0;
+    uint_fast16_t tail = rxbuffer->tail, head = rxbuffer->head;
+
+    while(tail != head && count < size) {
+        c = buf[count++] = rxbuffer->data[tail];
+        tail = (tail + 1) & (RX_BUFFER_SIZE - 1);
+        if(c == '\n' || c == '\r')
+            break;
+    }
+
+    rxbuffer->tail = tail;
+
+    return count;
+}
+
 typedef struct {
     volatile uint_fast16_t head;
     volatile uint_fast16_t tail;
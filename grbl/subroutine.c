@@ -0,0 +1,521 @@
+/*
+  subroutine.c - O-word subroutines and repeat loops executed from a RAM cache
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Supported blocks, <n> is the O-word number:
+
+  O<n>SUB ... O<n>ENDSUB          - defines subroutine <n>, a previous definition is replaced.
+  O<n>CALL                        - executes subroutine <n>.
+  O<n>RETURN                      - returns from the subroutine being executed.
+  O<n>REPEAT[<count>] ... O<n>ENDREPEAT - executes the body <count> times.
+
+  With ENABLE_NGC_EXPRESSIONS also:
+
+  O<n>WHILE[<expression>] ... O<n>ENDWHILE - executes the body while the expression is not zero.
+  O<n>CALL[<expression>][<expression>]...  - assigns the argument values to #1, #2... before the call.
+
+  and the repeat count may be an expression.
+
+  Blocks between SUB and ENDSUB, or from REPEAT or WHILE to the matching end when received outside a subroutine
+  body, are stored in the cache as preprocessed by the protocol layer, ie. with whitespace and comments removed and
+  letters capitalized, and answered with ok. A loop is executed when its end block is received and is then
+  discarded from the cache. The status of an executed call or loop is returned for the CALL or end block,
+  execution stops at the first block that fails.
+
+  NOTE: IF and DO blocks are rejected as unsupported, as are WHILE blocks and call arguments without
+        ENABLE_NGC_EXPRESSIONS. System commands are executed when received, they cannot be part of a body.
+*/
+
+#include <string.h>
+
+#include "hal.h"
+#include "protocol.h"
+#include "subroutine.h"
+#include "ngc_expr.h"
+
+#ifdef ENABLE_SUBROUTINES
+
+typedef enum {
+    OWord_Sub = 0,
+    OWord_EndSub,
+    OWord_Call,
+    OWord_Return,
+    OWord_Repeat,
+    OWord_EndRepeat,
+    OWord_While,
+    OWord_EndWhile,
+    OWord_Unsupported
+} oword_op_t;
+
+typedef struct {
+    const char *keyword;
+    oword_op_t op;
+} oword_keyword_t;
+
+typedef struct {
+    uint32_t id;
+    uint16_t start;     // Offset of the first block in the cache
+    uint16_t length;    // Total length of the blocks including terminators
+} subroutine_t;
+
+static const oword_keyword_t keywords[] = {
+    { "ENDSUB",     OWord_EndSub },
+    { "ENDREPEAT",  OWord_EndRepeat },
+    { "SUB",        OWord_Sub },
+    { "CALL",       OWord_Call },
+    { "RETURN",     OWord_Return },
+    { "REPEAT",     OWord_Repeat },
+#ifdef ENABLE_NGC_EXPRESSIONS
+    { "ENDWHILE",   OWord_EndWhile },
+    { "WHILE",      OWord_While },
+#else
+    { "ENDWHILE",   OWord_Unsupported },
+    { "WHILE",      OWord_Unsupported },
+#endif
+    { "DO",         OWord_Unsupported },
+    { "ENDIF",      OWord_Unsupported },
+    { "ELSEIF",     OWord_Unsupported },
+    { "ELSE",       OWord_Unsupported },
+    { "IF",         OWord_Unsupported },
+    { "BREAK",      OWord_Unsupported },
+    { "CONTINUE",   OWord_Unsupported }
+};
+
+static THREAD_LOCAL struct {
+    uint_fast16_t used;         // Bytes of the cache in use
+    uint_fast8_t n_subs;
+    uint_fast8_t depth;         // Current call and loop nesting depth
+    bool returning;             // Set by RETURN, unwinds loops up to the call
+    struct {
+        bool active;
+        oword_op_t op;          // OWord_Sub, OWord_Repeat or OWord_While
+        uint32_t id;
+        uint_fast16_t start;
+    } recording;
+    subroutine_t sub[SUBROUTINE_MAX];
+    char cache[SUBROUTINE_CACHE_SIZE];
+} subs = {0};
+
+static char block_buffer[LINE_BUFFER_SIZE];
+
+// Parses an O-word block, on success args points to the text following the keyword.
+static status_code_t oword_parse (char *block, oword_op_t *op, uint32_t *id, char **args)
+{
+    uint_fast8_t idx = sizeof(keywords) / sizeof(oword_keyword_t);
+    size_t len = 0;
+
+    if(*block++ != 'O' || *block < '0' || *block > '9')
+        return Status_FlowControlSyntaxError;
+
+    *id = 0;
+    while(*block >= '0' && *block <= '9')
+        *id = *id * 10 + (uint32_t)(*block++ - '0');
+
+    while(idx) {
+        len = strlen(keywords[--idx].keyword);
+        if(!strncmp(block, keywords[idx].keyword, len))
+            break;
+        len = 0;
+    }
+
+    if(len == 0)
+        return Status_FlowControlSyntaxError;
+
+    if((*op = keywords[idx].op) == OWord_Unsupported)
+        return Status_GcodeUnsupportedCommand;
+
+    *args = block + len;
+
+    if(**args == '\0')
+        return *op == OWord_Repeat || *op == OWord_While ? Status_FlowControlSyntaxError : Status_OK;
+
+    switch(*op) {
+
+        case OWord_Repeat:
+        case OWord_While:
+            return **args == '[' ? Status_OK : Status_FlowControlSyntaxError;
+
+        case OWord_Call:
+#ifdef ENABLE_NGC_EXPRESSIONS
+            return **args == '[' ? Status_OK : Status_FlowControlSyntaxError;
+#else
+            return Status_GcodeUnsupportedCommand;
+#endif
+
+        default:
+            return Status_FlowControlSyntaxError;
+    }
+}
+
+// Evaluates a bracketed argument, args is advanced past it.
+static status_code_t read_argument (char **args, float *value)
+{
+#ifdef ENABLE_NGC_EXPRESSIONS
+    uint_fast8_t cc = 0;
+    status_code_t status = ngc_read_value(*args, &cc, value);
+
+    *args += cc;
+
+    return status;
+#else
+    uint32_t count = 0;
+    char *s = *args + 1;
+
+    if(*s < '0' || *s > '9')
+        return Status_FlowControlSyntaxError;
+
+    while(*s >= '0' && *s <= '9')
+        count = count * 10 + (uint32_t)(*s++ - '0');
+
+    if(*s++ != ']')
+        return Status_FlowControlSyntaxError;
+
+    *value = (float)count;
+    *args = s;
+
+    return Status_OK;
+#endif
+}
+
+static status_code_t read_count (char *args, uint32_t *count)
+{
+    float value;
+    status_code_t status;
+
+    if((status = read_argument(&args, &value)) == Status_OK) {
+        if(*args != '\0')
+            status = Status_FlowControlSyntaxError;
+        else if(value < 0.0f)
+            status = Status_NegativeValue;
+        else
+            *count = (uint32_t)value;
+    }
+
+    return status;
+}
+
+#ifdef ENABLE_NGC_EXPRESSIONS
+
+// Assigns the call arguments to #1, #2...
+static status_code_t assign_arguments (char *args)
+{
+    float value[NGC_ASSIGNMENTS_MAX];
+    uint_fast8_t idx = 0, n_args = 0;
+    status_code_t status = Status_OK;
+
+    // All arguments are evaluated before any is assigned.
+    while(*args && status == Status_OK) {
+        if(n_args == NGC_ASSIGNMENTS_MAX || n_args == NGC_PARAMETERS_MAX)
+            status = Status_OutOfMemory;
+        else if(*args != '[')
+            status = Status_FlowControlSyntaxError;
+        else
+            status = read_argument(&args, &value[n_args++]);
+    }
+
+    if(status == Status_OK) {
+        for(idx = 0; idx < n_args; idx++)
+            ngc_param_set(idx + 1, value[idx]);
+    }
+
+    return status;
+}
+
+#endif
+
+static subroutine_t *sub_find (uint32_t id)
+{
+    uint_fast8_t idx = subs.n_subs;
+
+    while(idx) {
+        if(subs.sub[--idx].id == id)
+            return &subs.sub[idx];
+    }
+
+    return NULL;
+}
+
+// Removes a subroutine and compacts the cache.
+static void sub_delete (subroutine_t *sub)
+{
+    uint_fast8_t idx;
+    uint_fast16_t start = sub->start, length = sub->length;
+
+    memmove(&subs.cache[start], &subs.cache[start + length], subs.used - start - length);
+    subs.used -= length;
+
+    memmove(sub, sub + 1, (uint8_t *)&subs.sub[--subs.n_subs] - (uint8_t *)sub);
+
+    idx = subs.n_subs;
+    while(idx--) {
+        if(subs.sub[idx].start > start)
+            subs.sub[idx].start -= length;
+    }
+}
+
+// Returns the offset in the cache of the end block op matching id, or end if not found.
+static uint_fast16_t find_end (uint_fast16_t start, uint_fast16_t end, uint32_t id, oword_op_t end_op)
+{
+    char *args;
+    oword_op_t op;
+    uint32_t oid;
+
+    while(start < end) {
+        if(subs.cache[start] == 'O' && oword_parse(&subs.cache[start], &op, &oid, &args) == Status_OK && op == end_op && oid == id)
+            break;
+        start += strlen(&subs.cache[start]) + 1;
+    }
+
+    return start;
+}
+
+static status_code_t execute (uint_fast16_t start, uint_fast16_t end);
+
+static status_code_t call (subroutine_t *sub, char *args)
+{
+    status_code_t status = Status_OK;
+
+    if(subs.depth == SUBROUTINE_NESTING_MAX)
+        return Status_FlowControlStackOverflow;
+
+#ifdef ENABLE_NGC_EXPRESSIONS
+    if((status = assign_arguments(args)) != Status_OK)
+        return status;
+#endif
+
+    subs.depth++;
+    status = execute(sub->start, sub->start + sub->length);
+    subs.returning = false;
+    subs.depth--;
+
+    return status;
+}
+
+// Executes the loop starting at the REPEAT or WHILE block at start, returns the offset of the block following the loop.
+static uint_fast16_t loop (uint_fast16_t start, uint_fast16_t end, oword_op_t op, uint32_t id, char *args, status_code_t *status)
+{
+    uint32_t count = 0;
+    uint_fast16_t body = start + strlen(&subs.cache[start]) + 1, loop_end;
+
+    if((loop_end = find_end(body, end, id, op == OWord_Repeat ? OWord_EndRepeat : OWord_EndWhile)) == end)
+        *status = Status_FlowControlSyntaxError;
+    else if(subs.depth == SUBROUTINE_NESTING_MAX)
+        *status = Status_FlowControlStackOverflow;
+    else if(op == OWord_Repeat && (*status = read_count(args, &count)) != Status_OK)
+        ;
+    else {
+        subs.depth++;
+        while(*status == Status_OK && !(subs.returning || ABORTED)) {
+#ifdef ENABLE_NGC_EXPRESSIONS
+            if(op == OWord_While) {
+                float value;
+                char *cond = args;
+                if((*status = read_argument(&cond, &value)) != Status_OK || *cond != '\0') {
+                    if(*status == Status_OK)
+                        *status = Status_FlowControlSyntaxError;
+                    break;
+                }
+                if(value == 0.0f)
+                    break;
+            } else
+#endif
+            if(count-- == 0)
+                break;
+            *status = execute(body, loop_end);
+        }
+        subs.depth--;
+    }
+
+    return loop_end + (loop_end < end ? strlen(&subs.cache[loop_end]) + 1 : 0);
+}
+
+// Executes the blocks in the cache from start up to end.
+static status_code_t execute (uint_fast16_t start, uint_fast16_t end)
+{
+    char *args;
+    uint32_t id;
+    oword_op_t op;
+    subroutine_t *sub;
+    uint_fast16_t next;
+    status_code_t status = Status_OK;
+
+    while(status == Status_OK && start < end && !subs.returning) {
+
+        next = start + strlen(&subs.cache[start]) + 1;
+
+        if(subs.cache[start] == 'O') {
+
+            if((status = oword_parse(&subs.cache[start], &op, &id, &args)) != Status_OK)
+                break;
+
+            switch(op) {
+
+                case OWord_Call:
+                    if((sub = sub_find(id)) == NULL)
+                        status = Status_FlowControlNotDefined;
+                    else
+                        status = call(sub, args);
+                    break;
+
+                case OWord_Return:
+                    subs.returning = subs.depth > 0;
+                    break;
+
+                case OWord_Repeat:
+                case OWord_While:
+                    next = loop(start, end, op, id, args, &status);
+                    break;
+
+                default: // Definitions are not allowed in a body, end blocks are unmatched.
+                    status = Status_FlowControlSyntaxError;
+                    break;
+            }
+        } else {
+            // Copy the block, the cache may not be modified by the parser.
+            strcpy(block_buffer, &subs.cache[start]);
+            status = gc_execute_block(block_buffer, NULL);
+        }
+
+        if(!protocol_execute_realtime())
+            break; // Aborted.
+
+        start = next;
+    }
+
+    return status;
+}
+
+static bool record_block (char *block)
+{
+    uint_fast16_t len = strlen(block) + 1;
+
+    if(subs.used + len > SUBROUTINE_CACHE_SIZE)
+        return false;
+
+    memcpy(&subs.cache[subs.used], block, len);
+    subs.used += len;
+
+    return true;
+}
+
+// Adds a block to the body being recorded, ends the recording when the matching end block is received.
+// Loops are recorded including the REPEAT or WHILE block and the end block, and are then executed.
+static status_code_t record (char *block)
+{
+    char *args;
+    uint32_t id;
+    oword_op_t op, end_op = subs.recording.op == OWord_Sub ? OWord_EndSub : (subs.recording.op == OWord_Repeat ? OWord_EndRepeat : OWord_EndWhile);
+    status_code_t status = Status_OK;
+    bool end = *block == 'O' && oword_parse(block, &op, &id, &args) == Status_OK && id == subs.recording.id && op == end_op;
+
+    if(!(end && subs.recording.op == OWord_Sub) && !record_block(block)) {
+        subs.recording.active = false;
+        subs.used = subs.recording.start;
+        status = Status_OutOfMemory;
+    } else if(end) {
+
+        subs.recording.active = false;
+
+        if(subs.recording.op == OWord_Sub) {
+            subs.sub[subs.n_subs].id = id;
+            subs.sub[subs.n_subs].start = (uint16_t)subs.recording.start;
+            subs.sub[subs.n_subs++].length = (uint16_t)(subs.used - subs.recording.start);
+        } else {
+            status = execute(subs.recording.start, subs.used);
+            subs.depth = 0;
+            subs.returning = false;
+            subs.used = subs.recording.start; // Discard the loop.
+        }
+    }
+
+    return status;
+}
+
+bool subroutine_claims_block (char *block)
+{
+    return *block == 'O' || subs.recording.active;
+}
+
+status_code_t subroutine_execute_block (char *block)
+{
+    char *args;
+    uint32_t id;
+    oword_op_t op;
+    subroutine_t *sub;
+    status_code_t status;
+
+    if(subs.recording.active)
+        return record(block);
+
+    if((status = oword_parse(block, &op, &id, &args)) != Status_OK)
+        return status;
+
+    switch(op) {
+
+        case OWord_Sub:
+            if((sub = sub_find(id)))
+                sub_delete(sub);
+            if(subs.n_subs == SUBROUTINE_MAX)
+                status = Status_OutOfMemory;
+            else {
+                subs.recording.active = true;
+                subs.recording.op = op;
+                subs.recording.id = id;
+                subs.recording.start = subs.used;
+            }
+            break;
+
+        case OWord_Repeat:
+        case OWord_While:
+            subs.recording.start = subs.used;
+            if(!record_block(block))
+                status = Status_OutOfMemory;
+            else {
+                subs.recording.active = true;
+                subs.recording.op = op;
+                subs.recording.id = id;
+            }
+            break;
+
+        case OWord_Call:
+            if((sub = sub_find(id)) == NULL)
+                status = Status_FlowControlNotDefined;
+            else {
+                status = call(sub, args);
+                subs.depth = 0;
+            }
+            break;
+
+        default: // ENDSUB, end of loop or RETURN outside a body.
+            status = Status_FlowControlSyntaxError;
+            break;
+    }
+
+    return status;
+}
+
+void subroutine_reset (void)
+{
+    subs.used = subs.n_subs = subs.depth = 0;
+    subs.returning = subs.recording.active = false;
+}
+
+#endif
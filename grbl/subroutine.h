@@ -0,0 +1,56 @@
+/*
+  subroutine.h - O-word subroutines and repeat loops executed from a RAM cache
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SUBROUTINE_H_
+#define _SUBROUTINE_H_
+
+#include "gcode.h"
+
+#ifdef ENABLE_SUBROUTINES
+
+// Size in bytes of the cache holding subroutine and repeat loop bodies, the preprocessed blocks are stored null terminated.
+#ifndef SUBROUTINE_CACHE_SIZE
+#define SUBROUTINE_CACHE_SIZE 2048
+#endif
+
+// Maximum number of subroutines defined at the same time.
+#ifndef SUBROUTINE_MAX
+#define SUBROUTINE_MAX 16
+#endif
+
+// Maximum nesting depth of calls and repeat loops.
+#ifndef SUBROUTINE_NESTING_MAX
+#define SUBROUTINE_NESTING_MAX 8
+#endif
+
+// Returns true if the block is to be handled by subroutine_execute_block(): an O-word block or a block received
+// while a subroutine or repeat loop body is being recorded.
+bool subroutine_claims_block (char *block);
+
+// Executes an O-word block or adds the block to the body being recorded. Called from gc_execute_block().
+status_code_t subroutine_execute_block (char *block);
+
+// Discards all subroutines and any body being recorded, called on soft reset.
+void subroutine_reset (void);
+
+#endif
+
+#endif
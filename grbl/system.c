@@ -31,6 +31,18 @@
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
+#ifdef ENABLE_HEIGHT_MAP
+#include "height_map.h"
+#endif
+#ifdef ENABLE_MOTION_TRACE
+#include "motion_trace.h"
+#endif
+#ifdef ENABLE_PID_TELEMETRY
+#include "pid.h"
+#endif
+#ifdef ENABLE_ALARM_SNAPSHOT
+#include "alarm_snapshot.h"
+#endif
 
 // Pin change interrupt for pin-out commands, i.e. cycle start, feed hold, and reset. Sets
 // only the realtime command execute variable to have the main program execute these when
@@ -65,7 +77,7 @@ ISR_CODE void control_interrupt_handler (control_signals_t signals)
                 } else
                     hal.probe.configure(false, false);
             } else if (signals.probe_disconnected) {
-                if(sys_probing_state == Probing_Active && sys.state == STATE_CYCLE) {
+                if(sys_probing_state != Probing_Off && sys.state == STATE_CYCLE) {
                     system_set_exec_state_flag(EXEC_FEED_HOLD);
                     sys.alarm_pending = Alarm_ProbeProtect;
                 }
@@ -95,6 +107,39 @@ void system_execute_startup (char *line)
 }
 
 
+static void memory_report (uint_fast16_t state)
+{
+    report_memory_usage();
+}
+
+static rt_task_t memory_report_task = {
+    .name = "Memory report",
+    .fn = memory_report
+};
+
+// Starts or stops the periodic memory usage report, $SM=<ms>. 0 stops, the minimum interval is 100 ms.
+// NOTE: Requires the driver to provide hal.get_elapsed_ticks.
+static status_code_t memory_report_interval (char *value)
+{
+    float interval;
+    uint_fast8_t counter = 0;
+
+    if(!read_float(value, &counter, &interval) || value[counter] != '\0')
+        return Status_BadNumberFormat;
+
+    if(!isintf(interval) || interval < 0.0f || interval > 65535.0f || (interval > 0.0f && (interval < 100.0f || !hal.get_elapsed_ticks)))
+        return Status_InvalidStatement;
+
+    protocol_remove_rt_task(&memory_report_task);
+
+    if(interval > 0.0f) {
+        memory_report_task.period = (uint16_t)interval;
+        protocol_add_rt_task(&memory_report_task);
+    }
+
+    return Status_OK;
+}
+
 // Directs and executes one line of formatted input from protocol_process. While mostly
 // incoming streaming g-code blocks, this also executes Grbl internal commands, such as
 // settings, initiating the homing cycle, and toggling switch states. This differs from
@@ -146,9 +191,9 @@ status_code_t system_execute_line (char *line)
                 retval =  Status_IdleError; // Block during cycle. Takes too long to print.
             else
 #if COMPATIBILITY_LEVEL <= 1
-            report_grbl_settings(true);
+            report_settings(true, true);
 #else
-            report_grbl_settings(line[1] == '+');
+            report_settings(line[1] == '+', true);
 #endif
             break;
 
@@ -170,8 +215,12 @@ status_code_t system_execute_line (char *line)
             }
             break;
 
-        case 'C': // Set check g-code mode [IDLE/CHECK]
+        case 'C': // Set check g-code mode [IDLE/CHECK], $CF for fast check mode
+#ifdef ENABLE_FAST_CHECK_MODE
+            if (line[2] != '\0' && !(line[2] == 'F' && line[3] == '\0'))
+#else
             if (line[2] != '\0')
+#endif
                 retval = Status_InvalidStatement;
             else if (sys.state == STATE_CHECK_MODE) {
                 // Perform reset when toggling off. Check g-code mode should only work if Grbl
@@ -181,6 +230,9 @@ status_code_t system_execute_line (char *line)
                 grbl.report.feedback_message(Message_Disabled);
             } else if (sys.state == STATE_IDLE) { // Requires idle mode.
                 set_state(STATE_CHECK_MODE);
+#ifdef ENABLE_FAST_CHECK_MODE
+                sys.check_mode_fast = line[2] == 'F';
+#endif
                 grbl.report.feedback_message(Message_Enabled);
             } else
                 retval = Status_IdleError;
@@ -286,8 +338,50 @@ status_code_t system_execute_line (char *line)
                 retval = Status_OK;
             break;
 
-        case 'S': // Puts Grbl to sleep [IDLE/ALARM]
-            if(!settings.flags.sleep_enable || !(line[2] == 'L' && line[3] == 'P' && line[4] == '\0'))
+        case 'S': // Puts Grbl to sleep [IDLE/ALARM], reports and resets stepper instrumentation data or reports buffer sizes
+            if(line[2] == 'M' && line[3] == '\0')
+                report_buffer_sizes();
+            else if(line[2] == 'M' && line[3] == '=')
+                retval = memory_report_interval(&line[4]);
+            else if(line[2] == 'S' && (line[3] == '\0' || (line[3] == 'R' && line[4] == '\0'))) {
+                st_stats_t stats;
+                if(line[3] == 'R') {
+                    st_get_stats(&stats, true);
+                    protocol_reset_rt_task_stats();
+#ifdef KINEMATICS_API
+                    memset(&kinematics.stats, 0, sizeof(kinematics_stats_t));
+#endif
+                } else
+                    report_stepper_stats();
+            } else if((line[2] == 'B' || line[2] == 'A' || line[2] == 'E' || line[2] == 'C' || line[2] == 'I') && (line[3] == '\0' || line[3] == '=')) {
+                // Bulk settings transaction: $SB, $SI=<offset>:<data>, $SC[=<size>:<checksum>], $SA and $SE.
+                if(!(sys.state == STATE_IDLE || (sys.state & (STATE_ALARM|STATE_ESTOP))))
+                    retval = Status_IdleError;
+                else if(line[3] == '=' ? !(line[2] == 'C' || line[2] == 'I') : line[2] == 'I')
+                    retval = Status_InvalidStatement;
+                else switch(line[2]) {
+
+                    case 'B':
+                        settings_begin_transaction();
+                        break;
+
+                    case 'A':
+                        settings_abort_transaction();
+                        break;
+
+                    case 'E':
+                        settings_export();
+                        break;
+
+                    case 'C':
+                        retval = settings_commit_transaction(line[3] == '=' ? &line[4] : &line[3]);
+                        break;
+
+                    case 'I':
+                        retval = settings_import(&line[4]);
+                        break;
+                }
+            } else if(!settings.flags.sleep_enable || !(line[2] == 'L' && line[3] == 'P' && line[4] == '\0'))
                 retval = Status_InvalidStatement;
             else if(!(sys.state == STATE_IDLE || sys.state == STATE_ALARM))
                 retval = Status_IdleError;
@@ -317,6 +411,14 @@ status_code_t system_execute_line (char *line)
                 retval = Status_OK;
             } else if(sys.tlo_reference_set.mask && line[2] == 'P' && line[3] == 'W')
                 retval = tc_probe_workpiece();
+#ifdef ENABLE_MOTION_TRACE
+            else if(!strncmp(&line[2], "RACE", 4) && (line[6] == '\0' || (line[6] == 'R' && line[7] == '\0'))) {
+                if(line[6] == 'R')
+                    motion_trace_reset();
+                else
+                    motion_trace_report();
+            }
+#endif
             else
                 retval = Status_InvalidStatement;
             break;
@@ -423,6 +525,41 @@ status_code_t system_execute_line (char *line)
                 retval = Status_IdleError;
             break;
 
+#ifdef ENABLE_HEIGHT_MAP
+        case 'M': // Probe grid, report or clear height map [IDLE]
+            if (sys.state != STATE_IDLE)
+                retval = Status_IdleError;
+            else if (line[2] == '\0')
+                height_map_report();
+            else if (line[2] == 'C' && line[3] == '\0')
+                height_map_clear();
+            else if (line[2] == '=')
+                retval = height_map_probe(&line[3]);
+            else
+                retval = Status_InvalidStatement;
+            break;
+#endif
+
+#ifdef ENABLE_PID_TELEMETRY
+        case 'P': // List PID telemetry channels or start/stop streaming
+            if (line[2] == 'I' && line[3] == 'D' && line[4] == 'T')
+                retval = pidf_telemetry_command(&line[5]);
+            else
+                retval = Status_InvalidStatement;
+            break;
+#endif
+
+#ifdef ENABLE_ALARM_SNAPSHOT
+        case 'A': // Report or clear the alarm snapshot
+            if(line[2] == 'S' && line[3] == '\0')
+                alarm_snapshot_report();
+            else if(line[2] == 'S' && line[3] == 'R' && line[4] == '\0')
+                alarm_snapshot_clear();
+            else
+                retval = Status_InvalidStatement;
+            break;
+#endif
+
 #ifdef DEBUGOUT
         case 'Q':
             nvs_memmap();
@@ -469,36 +606,74 @@ void system_flag_wco_change ()
 void system_convert_array_steps_to_mpos (float *position, int32_t *steps)
 {
 #ifdef KINEMATICS_API
-    kinematics.convert_array_steps_to_mpos(position, steps);
-#else
+    if(kinematics.convert_array_steps_to_mpos) {
+        kinematics.convert_array_steps_to_mpos(position, steps);
+        return;
+    }
+#endif
+    position[X_AXIS] = steps[X_AXIS] * mm_per_step[X_AXIS];
+    position[Y_AXIS] = steps[Y_AXIS] * mm_per_step[Y_AXIS];
+    position[Z_AXIS] = steps[Z_AXIS] * mm_per_step[Z_AXIS];
+#ifdef A_AXIS
+    position[A_AXIS] = steps[A_AXIS] * mm_per_step[A_AXIS];
+#endif
+#ifdef B_AXIS
+    position[B_AXIS] = steps[B_AXIS] * mm_per_step[B_AXIS];
+#endif
+#ifdef C_AXIS
+    position[C_AXIS] = steps[C_AXIS] * mm_per_step[C_AXIS];
+#endif
+}
+
+// Travel envelope in machine coordinates, axes without soft limits (max_travel not set) are unbounded.
+static THREAD_LOCAL struct {
+    float min[N_AXIS];
+    float max[N_AXIS];
+    float jog_min[N_AXIS];  // Jog envelope, the homing pulloff distance is subtracted when hard limits are enabled
+    float jog_max[N_AXIS];
+    axes_signals_t jog;     // Axes with a jog envelope
+} envelope;
+
+// NOTE: max_travel is stored as negative
+void system_update_travel_envelope (void)
+{
     uint_fast8_t idx = N_AXIS;
+
+    envelope.jog.mask = 0;
+
     do {
         idx--;
-        position[idx] = steps[idx] / settings.axis[idx].steps_per_mm;
+        if(settings.axis[idx].max_travel < -0.0f) {
+            float pulloff = settings.limits.flags.hard_enabled && bit_istrue(sys.homing.mask, bit(idx)) ? settings.homing.pulloff : 0.0f;
+            envelope.jog.mask |= bit(idx);
+            // When homing forced set origin is enabled, limits need to account for directionality.
+            if(settings.homing.flags.force_set_origin && bit_istrue(settings.homing.dir_mask.value, bit(idx))) {
+                envelope.min[idx] = envelope.jog_min[idx] = 0.0f;
+                envelope.max[idx] = -settings.axis[idx].max_travel;
+                envelope.jog_max[idx] = -(settings.axis[idx].max_travel + pulloff);
+            } else {
+                envelope.min[idx] = settings.axis[idx].max_travel;
+                envelope.max[idx] = 0.0f;
+                envelope.jog_min[idx] = settings.axis[idx].max_travel + pulloff;
+                envelope.jog_max[idx] = settings.homing.flags.force_set_origin ? 0.0f : -pulloff;
+            }
+        } else {
+            envelope.min[idx] = envelope.jog_min[idx] = -SOME_LARGE_VALUE;
+            envelope.max[idx] = envelope.jog_max[idx] = SOME_LARGE_VALUE;
+        }
     } while(idx);
-#endif
 }
 
 // Checks and reports if target array exceeds machine travel limits. Returns false if check failed.
-// NOTE: max_travel is stored as negative
 // TODO: only check homed axes?
 bool system_check_travel_limits (float *target)
 {
     bool failed = false;
     uint_fast8_t idx = N_AXIS;
 
-    if(settings.homing.flags.force_set_origin) {
-        do {
-            idx--;
-        // When homing forced set origin is enabled, soft limits checks need to account for directionality.
-            failed = settings.axis[idx].max_travel < -0.0f &&
-                      (bit_istrue(settings.homing.dir_mask.value, bit(idx))
-                        ? (target[idx] < 0.0f || target[idx] > -settings.axis[idx].max_travel)
-                        : (target[idx] > 0.0f || target[idx] < settings.axis[idx].max_travel));
-        } while(!failed && idx);
-    } else do {
+    do {
         idx--;
-        failed = settings.axis[idx].max_travel < -0.0f && (target[idx] > 0.0f || target[idx] < settings.axis[idx].max_travel);
+        failed = target[idx] < envelope.min[idx] || target[idx] > envelope.max[idx];
     } while(!failed && idx);
 
     return !failed;
@@ -506,33 +681,41 @@ bool system_check_travel_limits (float *target)
 
 // Limits jog commands to be within machine limits, homed axes only.
 // When hard limits are enabled pulloff distance is subtracted to avoid triggering limit switches.
-// NOTE: max_travel is stored as negative
 void system_apply_jog_limits (float *target)
 {
     uint_fast8_t idx = N_AXIS;
+    axes_signals_t axes = { .mask = sys.homed.mask & envelope.jog.mask };
 
-    if(sys.homed.mask) do {
+    if(axes.mask) do {
         idx--;
-        float pulloff = settings.limits.flags.hard_enabled && bit_istrue(sys.homing.mask, bit(idx)) ? settings.homing.pulloff : 0.0f;
-        if(bit_istrue(sys.homed.mask, bit(idx)) && settings.axis[idx].max_travel < -0.0f) {
-            if(settings.homing.flags.force_set_origin) {
-                if(bit_isfalse(settings.homing.dir_mask.value, bit(idx))) {
-                    if(target[idx] > 0.0f)
-                        target[idx] = 0.0f;
-                    else if(target[idx] < (settings.axis[idx].max_travel + pulloff))
-                        target[idx] = (settings.axis[idx].max_travel + pulloff);
-                } else {
-                    if(target[idx] < 0.0f)
-                        target[idx] = 0.0f;
-                    else if(target[idx] > -(settings.axis[idx].max_travel + pulloff))
-                        target[idx] = -(settings.axis[idx].max_travel + pulloff);
-                }
-            } else {
-                if(target[idx] > -pulloff)
-                    target[idx] = -pulloff;
-                else if(target[idx] < (settings.axis[idx].max_travel + pulloff))
-                    target[idx] = (settings.axis[idx].max_travel + pulloff);
-            }
+        if(bit_istrue(axes.mask, bit(idx))) {
+            if(target[idx] > envelope.jog_max[idx])
+                target[idx] = envelope.jog_max[idx];
+            else if(target[idx] < envelope.jog_min[idx])
+                target[idx] = envelope.jog_min[idx];
         }
     } while(idx);
 }
+
+#ifdef ENABLE_BOOT_TIMING
+
+static THREAD_LOCAL boot_timing_t boot_timing = {0};
+
+void system_boot_timestamp (boot_phase_t phase)
+{
+    boot_timing.ms[phase] = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+    boot_timing.cycles[phase] = hal.get_cycle_count ? hal.get_cycle_count() : 0;
+}
+
+void system_get_boot_timing (boot_timing_t *timing)
+{
+    uint_fast8_t idx = BootPhase_N;
+
+    do {
+        idx--;
+        timing->ms[idx] = boot_timing.ms[idx] - boot_timing.ms[BootPhase_DriverInit];
+        timing->cycles[idx] = boot_timing.cycles[idx] - boot_timing.cycles[BootPhase_DriverInit];
+    } while(idx);
+}
+
+#endif
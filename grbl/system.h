@@ -45,6 +45,12 @@
 #define EXEC_GCODE_REPORT   bit(11)
 #define EXEC_TLO_REPORT     bit(12)
 #define EXEC_RT_COMMAND     bit(13)
+#define EXEC_BINARY_REPORT  bit(14)
+
+// Requests that are executed by protocol_exec_rt_system() in any state, dispatched by bit number.
+#define EXEC_REPORTS (EXEC_STATUS_REPORT|EXEC_PID_REPORT|EXEC_GCODE_REPORT|EXEC_TLO_REPORT|EXEC_RT_COMMAND|EXEC_BINARY_REPORT)
+// Requests that are handled by the state machine.
+#define EXEC_STATE_EVENTS (EXEC_CYCLE_START|EXEC_CYCLE_COMPLETE|EXEC_FEED_HOLD|EXEC_SAFETY_DOOR|EXEC_MOTION_CANCEL|EXEC_SLEEP|EXEC_TOOL_CHANGE)
 
 // Define system state bit map. The state variable primarily tracks the individual functions
 // of Grbl to manage each without overlapping. It is also used as a messaging flag for
@@ -242,20 +248,23 @@ typedef struct {
     hold_state_t holding_state;         // Tracks holding state
     float home_position[N_AXIS];        // Home position for homed axes
     float spindle_rpm;
+#ifdef ENABLE_FAST_CHECK_MODE
+    bool check_mode_fast;               // Set when check mode is the fast variant, $CF
+#endif
 #ifdef PID_LOG
     pid_data_t pid_log;
 #endif
 } system_t;
 
-extern system_t sys;
+extern THREAD_LOCAL system_t sys;
 
 // NOTE: These position variables may need to be declared as volatiles, if problems arise.
-extern int32_t sys_position[N_AXIS];      // Real-time machine (aka home) position vector in steps.
-extern int32_t sys_probe_position[N_AXIS]; // Last probe position in machine coordinates and steps.
+extern THREAD_LOCAL int32_t sys_position[N_AXIS];      // Machine (aka home) position vector in steps, updated on segment completion. See st_get_position().
+extern THREAD_LOCAL int32_t sys_probe_position[N_AXIS]; // Last probe position in machine coordinates and steps.
 
-extern volatile probing_state_t sys_probing_state; // Probing state value.  Used to coordinate the probing cycle with stepper ISR.
-extern volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
-extern volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtimeate val executor bitflag variable for setting various alarms.
+extern THREAD_LOCAL volatile probing_state_t sys_probing_state; // Probing state value.  Used to coordinate the probing cycle with stepper ISR.
+extern THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_state;   // Global realtime executor bitflag variable for state management. See EXEC bitmasks.
+extern THREAD_LOCAL volatile uint_fast16_t sys_rt_exec_alarm;   // Global realtimeate val executor bitflag variable for setting various alarms.
 
 // Executes an internal system command, defined as a string starting with a '$'
 status_code_t system_execute_line(char *line);
@@ -271,6 +280,10 @@ void system_flag_wco_change();
 // Updates a machine 'position' array based on the 'step' array sent.
 void system_convert_array_steps_to_mpos(float *position, int32_t *steps);
 
+// Recalculates the travel envelope used by the soft limits check and jog clipping.
+// Called on settings changes and when the axes to home are set.
+void system_update_travel_envelope (void);
+
 // Checks and reports if target array exceeds machine travel limits.
 bool system_check_travel_limits(float *target);
 
@@ -286,4 +299,29 @@ void system_apply_jog_limits (float *target);
 
 void control_interrupt_handler (control_signals_t signals);
 
+#ifdef ENABLE_BOOT_TIMING
+
+typedef enum {
+    BootPhase_DriverInit = 0,   // driver_init() returned, timestamps are relative to this
+    BootPhase_NVSLoaded,
+    BootPhase_SettingsLoaded,
+    BootPhase_DriverSetup,
+    BootPhase_Ready,            // Welcome message sent
+    BootPhase_DeferredInit,     // Deferred initialization completed
+    BootPhase_N
+} boot_phase_t;
+
+typedef struct {
+    uint32_t ms[BootPhase_N];
+    uint32_t cycles[BootPhase_N];
+} boot_timing_t;
+
+// Records timestamp of startup phase.
+void system_boot_timestamp (boot_phase_t phase);
+
+// Returns startup phase timestamps, relative to BootPhase_DriverInit.
+void system_get_boot_timing (boot_timing_t *timing);
+
+#endif
+
 #endif
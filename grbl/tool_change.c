@@ -37,16 +37,16 @@
 #define TOOL_CHANGE_PROBE_RETRACT_DISTANCE 2.0f
 #endif
 
-static bool block_cycle_start;
-static volatile bool execute_posted = false;
-static volatile uint32_t spin_lock = 0;
-static float tool_change_position;
-static tool_data_t current_tool = {0}, *next_tool = NULL;
-static plane_t plane;
-static coord_data_t target = {0}, previous;
-static driver_reset_ptr driver_reset = NULL;
-static enqueue_realtime_command_ptr enqueue_realtime_command = NULL;
-static control_signals_callback_ptr control_interrupt_callback = NULL;
+static THREAD_LOCAL bool block_cycle_start;
+static THREAD_LOCAL volatile bool execute_posted = false;
+static THREAD_LOCAL volatile uint32_t spin_lock = 0;
+static THREAD_LOCAL float tool_change_position;
+static THREAD_LOCAL tool_data_t current_tool = {0}, *next_tool = NULL;
+static THREAD_LOCAL plane_t plane;
+static THREAD_LOCAL coord_data_t target = {0}, previous;
+static THREAD_LOCAL driver_reset_ptr driver_reset = NULL;
+static THREAD_LOCAL enqueue_realtime_command_ptr enqueue_realtime_command = NULL;
+static THREAD_LOCAL control_signals_callback_ptr control_interrupt_callback = NULL;
 
 // Set tool offset on successful $TPW probe, prompt for retry on failure.
 // Called via probe completed event.
@@ -392,9 +392,11 @@ void tc_init (void)
     if(settings.tool_change.mode == ToolChange_Disabled || settings.tool_change.mode == ToolChange_Ignore) {
         hal.tool.select = NULL;
         hal.tool.change = NULL;
+        hal.tool.prepare = NULL;
     } else {
         hal.tool.select = tool_select;
         hal.tool.change = tool_change;
+        hal.tool.prepare = NULL;
         if(driver_reset == NULL) {
             driver_reset = hal.driver_reset;
             hal.driver_reset = reset;
@@ -28,13 +28,19 @@
 
 #ifdef WALL_PLOTTER
 
+#include <math.h>
+#include <string.h>
+
 #include "settings.h"
 #include "planner.h"
 #include "kinematics.h"
 
 #define A_MOTOR X_AXIS // Must be X_AXIS
 #define B_MOTOR Y_AXIS // Must be Y_AXIS
-#define MAX_SEG_LENGTH_MM 2.0f
+#ifndef MAX_SEG_LENGTH_MM
+#define MAX_SEG_LENGTH_MM 10.0f // Max segment length, segments are shorter where the string length changes nonlinearly
+#endif
+#define MIN_SEG_LENGTH_MM 0.1f
 
 typedef struct {
     int32_t width;
@@ -52,7 +58,7 @@ typedef struct {
     float b;
 } coord_t;
 
-static machine_t machine = {0};
+static THREAD_LOCAL machine_t machine = {0};
 
 // Returns machine position in mm converted from system position steps.
 // TODO: perhaps change to double precision here - float calculation results in errors of a couple of micrometers.
@@ -96,19 +102,44 @@ static void wp_plan_target_to_steps (int32_t *target_steps, float *target)
     target_steps[B_MOTOR] = wp_convert_to_b_motor_steps(target);
 }
 
+// Returns the max length of a segment of the line from start along the unit vector u in the XY plane for which
+// the deviation from linear interpolation of the string length from the motor at m is within the arc tolerance.
+// The second derivative of the string length along the line is d^2 / |r|^3 where d is the distance from the
+// motor to the line and r the vector from the motor to the point on the line, max is where r is shortest.
+static float wp_segment_length (const float *m, const float *start, const float *u, float length)
+{
+    float rx = start[X_AXIS] - m[X_AXIS], ry = start[Y_AXIS] - m[Y_AXIS],
+          d = rx * u[Y_AXIS] - ry * u[X_AXIS],
+          t = -(rx * u[X_AXIS] + ry * u[Y_AXIS]);
+
+    t = t < 0.0f ? 0.0f : (t > length ? length : t); // closest point on the line
+
+    rx += u[X_AXIS] * t;
+    ry += u[Y_AXIS] * t;
+
+    float r2 = rx * rx + ry * ry, k = d * d;
+
+    if(k == 0.0f) // line through motor, string length is linear
+        return length;
+
+    k /= r2 * sqrtf(r2);
+
+    return sqrtf(8.0f * settings.arc_tolerance / k);
+}
+
 // Wall plotter is circular in motion, so long lines must be divided up
 static bool wp_segment_line (float *target, plan_line_data_t *pl_data, bool init)
 {
-    static uint_fast16_t iterations;
-    static bool segmented;
-    static float delta[N_AXIS], segment_target[N_AXIS];
+    static THREAD_LOCAL uint_fast16_t iterations;
+    static THREAD_LOCAL bool segmented;
+    static THREAD_LOCAL float delta[N_AXIS], segment_target[N_AXIS];
 //    static plan_line_data_t plan;
 
     uint_fast8_t idx = N_AXIS;
 
     if(init) {
 
-        float max_delta = 0.0f;
+        float max_delta = 0.0f, motor[2][2] = { { 0.0f, 0.0f }, { machine.width_mm, 0.0f } };
 
         do {
             idx--;
@@ -116,11 +147,21 @@ static bool wp_segment_line (float *target, plan_line_data_t *pl_data, bool init
             max_delta = max(max_delta, fabsf(delta[idx]));
         } while(idx);
 
-        if((segmented = !(pl_data->condition.rapid_motion || pl_data->condition.jog_motion) &&
-                           max_delta > MAX_SEG_LENGTH_MM && !(delta[X_AXIS] == 0.0f && delta[Y_AXIS] == 0.0f))) {
+        iterations = 1;
+
+        if(!(pl_data->condition.rapid_motion || pl_data->condition.jog_motion) && !(delta[X_AXIS] == 0.0f && delta[Y_AXIS] == 0.0f)) {
+
+            float length = sqrtf(delta[X_AXIS] * delta[X_AXIS] + delta[Y_AXIS] * delta[Y_AXIS]),
+                  u[2] = { delta[X_AXIS] / length, delta[Y_AXIS] / length },
+                  seg_length = min(wp_segment_length(motor[A_MOTOR], gc_state.position, u, length),
+                                    wp_segment_length(motor[B_MOTOR], gc_state.position, u, length));
+
+            iterations = (uint_fast16_t)max(ceilf(length / max(seg_length, MIN_SEG_LENGTH_MM)), ceilf(max_delta / MAX_SEG_LENGTH_MM));
+        }
+
+        if((segmented = iterations > 1)) {
 
             idx = N_AXIS;
-            iterations = (uint_fast16_t)ceilf(max_delta / MAX_SEG_LENGTH_MM);
 
             memcpy(segment_target, gc_state.position, sizeof(segment_target));
 //            memcpy(&plan, pl_data, sizeof(plan_line_data_t));
@@ -129,9 +170,7 @@ static bool wp_segment_line (float *target, plan_line_data_t *pl_data, bool init
                 delta[--idx] /= (float)iterations;
                 target[idx] = gc_state.position[idx];
             } while(idx);
-
-        } else
-            iterations = 1;
+        }
 
         iterations++; // return at least one iteration
 
@@ -235,7 +274,7 @@ static void wp_limits_set_machine_positions (axes_signals_t cycle)
 
 
 // Initialize API pointers for Wall Plotter kinematics
-void wall_plotter_init (void)
+static void wall_plotter_kinematics_init (void)
 {
     machine.width_mm = -settings.axis[A_MOTOR].max_travel;
     machine.width = (int32_t)(machine.width_mm * settings.axis[A_MOTOR].steps_per_mm);
@@ -258,4 +297,16 @@ void wall_plotter_init (void)
     kinematics.segment_line = wp_segment_line;
 }
 
+static kinematics_entry_t wall_plotter = {
+    .type = Kinematics_WallPlotter,
+    .name = "Wall plotter",
+    .init = wall_plotter_kinematics_init
+};
+
+// Add Wall Plotter kinematics to the kinematics registry
+void wall_plotter_init (void)
+{
+    kinematics_register(&wall_plotter);
+}
+
 #endif
@@ -22,7 +22,7 @@
 #ifndef _WALL_PLOTTER_H_
 #define _WALL_PLOTTER_H_
 
-// Initialize HAL pointers for Wall Plotter kinematics
+// Add Wall Plotter kinematics to the kinematics registry
 void wall_plotter_init (void);
 
 #endif
@@ -0,0 +1,442 @@
+/*
+
+  aux_axis.c - plugin for auxiliary axes moving independently of the main motion stream
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "driver.h"
+
+#if AUX_AXIS_ENABLE
+
+#include <math.h>
+#include <string.h>
+
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/report.h"
+#include "grbl/nvs_buffer.h"
+
+#include "aux_axis.h"
+
+#if AUX_AXIS_N_MAX > 2
+#error "Settings are only available for two auxiliary axes!"
+#endif
+
+#define AUX_AXIS_SETTINGS_INCREMENT (Setting_AuxAxis1_StepsPerMm - Setting_AuxAxis0_StepsPerMm)
+
+typedef struct {
+    int32_t target;             // Absolute target position in steps
+    float max_velocity;         // Steps per tick
+} aux_move_t;
+
+// Mini planner: each axis executes its queued moves with a trapezoidal velocity profile computed tick by tick,
+// decelerating to a stop at the end of each move. Moves are queued by the foreground process and consumed by the
+// timer interrupt.
+typedef struct {
+    aux_move_t move[AUX_AXIS_QUEUE_SIZE];
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    volatile int32_t position;  // Steps
+    volatile bool busy;         // A move is being executed
+    aux_move_t current;
+    bool reverse;
+    float velocity;             // Steps per tick
+    float acceleration;         // Steps per tick^2
+    float step_count;           // Fraction of step accumulated
+} aux_axis_t;
+
+static uint_fast8_t n_axis;
+static uint8_t dir_outbits = 0;
+static volatile bool running = false, hold = false;
+static aux_axis_t axis[AUX_AXIS_N_MAX];
+static aux_axis_settings_t aux_settings[AUX_AXIS_N_MAX];
+static user_mcode_ptrs_t user_mcode;
+static driver_setting_ptrs_t driver_settings;
+static driver_reset_ptr driver_reset;
+static on_state_change_ptr on_state_change;
+static on_realtime_report_ptr on_realtime_report;
+static on_report_options_ptr on_report_options;
+
+// Timer interrupt, advances the velocity profile of each axis by one tick and outputs the step pulses due.
+static void aux_stepper_interrupt (void)
+{
+    bool active = false;
+    uint_fast8_t idx = n_axis;
+    uint8_t step_outbits = 0, dir_prev = dir_outbits;
+
+    do {
+        aux_axis_t *aux = &axis[--idx];
+
+        if(!aux->busy) {
+            if(aux->tail == aux->head)
+                continue;
+            aux->current = aux->move[aux->tail];
+            aux->tail = (aux->tail + 1) % AUX_AXIS_QUEUE_SIZE;
+            if(aux->current.target == aux->position) {
+                active = true;
+                continue;
+            }
+            aux->busy = true;
+            aux->step_count = 0.0f;
+            aux->reverse = aux->current.target < aux->position;
+            if(aux->reverse != !!(dir_outbits & bit(idx))) {
+                dir_outbits ^= bit(idx); // Output direction change one tick before the first step.
+                active = true;
+                continue;
+            }
+        }
+
+        active = true;
+
+        float remaining = (float)(aux->reverse ? aux->position - aux->current.target : aux->current.target - aux->position);
+
+        if(hold || remaining <= aux->velocity * aux->velocity / (2.0f * aux->acceleration) + aux->velocity)
+            aux->velocity = hold ? max(aux->velocity - aux->acceleration, 0.0f) : max(aux->velocity - aux->acceleration, aux->acceleration);
+        else if(aux->velocity < aux->current.max_velocity)
+            aux->velocity = min(aux->velocity + aux->acceleration, aux->current.max_velocity);
+
+        if((aux->step_count += aux->velocity) >= 1.0f) {
+            aux->step_count -= 1.0f;
+            step_outbits |= bit(idx);
+            aux->position += aux->reverse ? -1 : 1;
+            if(aux->position == aux->current.target) {
+                aux->busy = false;
+                aux->velocity = 0.0f;
+            }
+        }
+    } while(idx);
+
+    if(step_outbits || dir_outbits != dir_prev)
+        hal.aux_stepper.output_step(step_outbits, dir_outbits);
+
+    if(!active) {
+        running = false;
+        hal.aux_stepper.stop();
+    }
+}
+
+static bool aux_axis_idle (uint_fast8_t idx)
+{
+    return !axis[idx].busy && axis[idx].tail == axis[idx].head;
+}
+
+// Waits for the axis to complete its queued moves, all axes if idx is n_axis. Returns false on abort.
+static bool aux_axis_wait (uint_fast8_t idx)
+{
+    uint_fast8_t first = idx == n_axis ? 0 : idx, last = idx == n_axis ? n_axis - 1 : idx;
+
+    for(idx = first; idx <= last; idx++) {
+        while(!aux_axis_idle(idx)) {
+            if(!protocol_execute_realtime())
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Queues a move to an absolute position in mm. Waits for room in the queue, returns false on abort.
+static bool aux_axis_queue_move (uint_fast8_t idx, float position, float rate)
+{
+    aux_axis_t *aux = &axis[idx];
+    uint_fast8_t next_head = (aux->head + 1) % AUX_AXIS_QUEUE_SIZE;
+
+    while(next_head == aux->tail) {
+        if(!protocol_execute_realtime())
+            return false;
+    }
+
+    if(rate <= 0.0f || rate > aux_settings[idx].max_rate)
+        rate = aux_settings[idx].max_rate;
+
+    aux->move[aux->head].target = lroundf(position * aux_settings[idx].steps_per_mm);
+    aux->move[aux->head].max_velocity = min(rate * aux_settings[idx].steps_per_mm / (60.0f * (float)AUX_AXIS_TICK_RATE), 1.0f);
+    aux->head = next_head;
+
+    if(!running) {
+        running = true;
+        hal.aux_stepper.start(AUX_AXIS_TICK_RATE);
+    }
+
+    return true;
+}
+
+static void aux_axis_configure (void)
+{
+    uint_fast8_t idx = n_axis;
+
+    do {
+        idx--;
+        axis[idx].acceleration = aux_settings[idx].acceleration * aux_settings[idx].steps_per_mm / ((float)AUX_AXIS_TICK_RATE * (float)AUX_AXIS_TICK_RATE);
+    } while(idx);
+}
+
+static user_mcode_t userMCodeCheck (user_mcode_t mcode)
+{
+    return mcode == AuxAxis_Move || mcode == AuxAxis_Wait || mcode == AuxAxis_SetPosition
+                     ? mcode
+                     : (user_mcode.check ? user_mcode.check(mcode) : UserMCode_Ignore);
+}
+
+static status_code_t userMCodeValidate (parser_block_t *gc_block, uint32_t *value_words)
+{
+    status_code_t state = Status_GcodeValueWordMissing;
+
+    switch(gc_block->user_mcode) {
+
+        case AuxAxis_Move:
+        case AuxAxis_SetPosition:
+            if(bit_istrue(*value_words, bit(Word_P)) && bit_istrue(*value_words, bit(Word_Q))) {
+                if(!isintf(gc_block->values.p) || gc_block->values.p < 0.0f || gc_block->values.p >= (float)n_axis)
+                    state = Status_GcodeValueOutOfRange;
+                else if(bit_istrue(*value_words, bit(Word_R)) && gc_block->values.r <= 0.0f)
+                    state = Status_GcodeValueOutOfRange;
+                else
+                    state = Status_OK;
+                bit_false(*value_words, bit(Word_P)|bit(Word_Q));
+                if(gc_block->user_mcode == AuxAxis_Move) {
+                    if(bit_isfalse(*value_words, bit(Word_R)))
+                        gc_block->values.r = 0.0f;
+                    bit_false(*value_words, bit(Word_R));
+                }
+            }
+            break;
+
+        case AuxAxis_Wait:
+            state = Status_OK;
+            if(bit_istrue(*value_words, bit(Word_P))) {
+                if(!isintf(gc_block->values.p) || gc_block->values.p < 0.0f || gc_block->values.p >= (float)n_axis)
+                    state = Status_GcodeValueOutOfRange;
+                bit_false(*value_words, bit(Word_P));
+            } else
+                gc_block->values.p = (float)n_axis;
+            break;
+
+        default:
+            state = Status_Unhandled;
+            break;
+    }
+
+    return state == Status_Unhandled && user_mcode.validate ? user_mcode.validate(gc_block, value_words) : state;
+}
+
+static void userMCodeExecute (uint_fast16_t state, parser_block_t *gc_block)
+{
+    bool handled = true;
+    float scale = gc_block->modal.units_imperial ? MM_PER_INCH : 1.0f;
+
+    if (state != STATE_CHECK_MODE)
+      switch(gc_block->user_mcode) {
+
+        case AuxAxis_Move:
+            aux_axis_queue_move((uint_fast8_t)gc_block->values.p, gc_block->values.q * scale, gc_block->values.r * scale);
+            break;
+
+        case AuxAxis_Wait:
+            aux_axis_wait((uint_fast8_t)gc_block->values.p);
+            break;
+
+        case AuxAxis_SetPosition:
+            if(aux_axis_wait((uint_fast8_t)gc_block->values.p))
+                axis[(uint_fast8_t)gc_block->values.p].position = lroundf(gc_block->values.q * scale * aux_settings[(uint_fast8_t)gc_block->values.p].steps_per_mm);
+            break;
+
+        default:
+            handled = false;
+            break;
+    }
+
+    if(!handled && user_mcode.execute)
+        user_mcode.execute(state, gc_block);
+}
+
+// Aborts all moves immediately, the position is kept.
+static void reset (void)
+{
+    uint_fast8_t idx = n_axis;
+
+    hal.aux_stepper.stop();
+    running = false;
+
+    do {
+        idx--;
+        axis[idx].tail = axis[idx].head;
+        axis[idx].busy = false;
+        axis[idx].velocity = 0.0f;
+    } while(idx);
+
+    driver_reset();
+}
+
+// Moves are decelerated to a stop and held on feed hold and safety door open, resumed on cycle start.
+static void onStateChanged (uint_fast16_t state)
+{
+    hold = state == STATE_HOLD || state == STATE_SAFETY_DOOR || state == STATE_SLEEP;
+
+    if(on_state_change)
+        on_state_change(state);
+}
+
+static void onRealtimeReport (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    uint_fast8_t idx;
+    float scale;
+
+    stream_write("|Aux:");
+
+    for(idx = 0; idx < n_axis; idx++) {
+        scale = settings.flags.report_inches ? aux_settings[idx].steps_per_mm * MM_PER_INCH : aux_settings[idx].steps_per_mm;
+        if(idx)
+            stream_write(",");
+        stream_write(ftoa((float)axis[idx].position / scale, settings.flags.report_inches ? N_DECIMAL_COORDVALUE_INCH : N_DECIMAL_COORDVALUE_MM));
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+static status_code_t aux_axis_setting (setting_type_t setting, float value, char *svalue)
+{
+    status_code_t status = Status_Unhandled;
+
+    if(setting >= Setting_AuxAxis0_StepsPerMm && setting < Setting_AuxAxis0_StepsPerMm + n_axis * AUX_AXIS_SETTINGS_INCREMENT) {
+
+        uint_fast8_t idx = (setting - Setting_AuxAxis0_StepsPerMm) / AUX_AXIS_SETTINGS_INCREMENT;
+
+        status = value > 0.0f ? Status_OK : Status_NegativeValue;
+
+        if(status == Status_OK) switch((setting - Setting_AuxAxis0_StepsPerMm) % AUX_AXIS_SETTINGS_INCREMENT) {
+
+            case 0:
+                aux_settings[idx].steps_per_mm = value;
+                break;
+
+            case 1:
+                aux_settings[idx].max_rate = value;
+                break;
+
+            default:
+                aux_settings[idx].acceleration = value;
+                break;
+        }
+
+        if(status == Status_OK) {
+            aux_axis_configure();
+            hal.nvs.memcpy_to_nvs(driver_settings.nvs_address, (uint8_t *)&aux_settings, sizeof(aux_settings), true);
+        }
+    }
+
+    return status == Status_Unhandled && driver_settings.set ? driver_settings.set(setting, value, svalue) : status;
+}
+
+static void aux_axis_settings_report (setting_type_t setting)
+{
+    if(setting >= Setting_AuxAxis0_StepsPerMm && setting < Setting_AuxAxis0_StepsPerMm + n_axis * AUX_AXIS_SETTINGS_INCREMENT) {
+
+        uint_fast8_t idx = (setting - Setting_AuxAxis0_StepsPerMm) / AUX_AXIS_SETTINGS_INCREMENT;
+
+        switch((setting - Setting_AuxAxis0_StepsPerMm) % AUX_AXIS_SETTINGS_INCREMENT) {
+
+            case 0:
+                report_float_setting(setting, aux_settings[idx].steps_per_mm, 3);
+                break;
+
+            case 1:
+                report_float_setting(setting, aux_settings[idx].max_rate, 1);
+                break;
+
+            default:
+                report_float_setting(setting, aux_settings[idx].acceleration, 1);
+                break;
+        }
+    } else if(driver_settings.report)
+        driver_settings.report(setting);
+}
+
+static void aux_axis_settings_restore (void)
+{
+    uint_fast8_t idx = AUX_AXIS_N_MAX;
+
+    do {
+        idx--;
+        aux_settings[idx].steps_per_mm = 100.0f;
+        aux_settings[idx].max_rate = 1000.0f;
+        aux_settings[idx].acceleration = 50.0f;
+    } while(idx);
+
+    hal.nvs.memcpy_to_nvs(driver_settings.nvs_address, (uint8_t *)&aux_settings, sizeof(aux_settings), true);
+
+    if(driver_settings.restore)
+        driver_settings.restore();
+}
+
+static void aux_axis_settings_load (void)
+{
+    if(hal.nvs.memcpy_from_nvs((uint8_t *)&aux_settings, driver_settings.nvs_address, sizeof(aux_settings), true) != NVS_TransferResult_OK)
+        aux_axis_settings_restore();
+
+    aux_axis_configure();
+
+    if(driver_settings.load)
+        driver_settings.load();
+}
+
+static void onReportOptions (void)
+{
+    on_report_options();
+    hal.stream.write("[PLUGIN:AUX AXIS v0.01]" ASCII_EOL);
+}
+
+bool aux_axis_init (void)
+{
+    if(hal.aux_stepper.n_axis && hal.aux_stepper.start && hal.aux_stepper.stop && hal.aux_stepper.output_step &&
+        (hal.driver_settings.nvs_address = nvs_alloc(sizeof(aux_settings)))) {
+
+        n_axis = min(hal.aux_stepper.n_axis, AUX_AXIS_N_MAX);
+        hal.aux_stepper.interrupt_callback = aux_stepper_interrupt;
+
+        memcpy(&driver_settings, &hal.driver_settings, sizeof(driver_setting_ptrs_t));
+        hal.driver_settings.set = aux_axis_setting;
+        hal.driver_settings.report = aux_axis_settings_report;
+        hal.driver_settings.load = aux_axis_settings_load;
+        hal.driver_settings.restore = aux_axis_settings_restore;
+
+        memcpy(&user_mcode, &hal.user_mcode, sizeof(user_mcode_ptrs_t));
+        hal.user_mcode.check = userMCodeCheck;
+        hal.user_mcode.validate = userMCodeValidate;
+        hal.user_mcode.execute = userMCodeExecute;
+
+        driver_reset = hal.driver_reset;
+        hal.driver_reset = reset;
+
+        on_state_change = grbl.on_state_change;
+        grbl.on_state_change = onStateChanged;
+
+        on_realtime_report = grbl.on_realtime_report;
+        grbl.on_realtime_report = onRealtimeReport;
+
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = onReportOptions;
+    }
+
+    return driver_settings.nvs_address != 0;
+}
+
+#endif
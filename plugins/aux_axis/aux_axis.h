@@ -0,0 +1,50 @@
+/*
+
+  aux_axis.h - plugin for auxiliary axes moving independently of the main motion stream
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _AUX_AXIS_H_
+#define _AUX_AXIS_H_
+
+// Maximum number of auxiliary axes, the driver may provide fewer.
+#ifndef AUX_AXIS_N_MAX
+#define AUX_AXIS_N_MAX 2
+#endif
+
+// Number of moves that may be queued per auxiliary axis.
+#ifndef AUX_AXIS_QUEUE_SIZE
+#define AUX_AXIS_QUEUE_SIZE 4
+#endif
+
+// Rate of the auxiliary stepper timer interrupt in Hz, also the maximum step rate.
+#ifndef AUX_AXIS_TICK_RATE
+#define AUX_AXIS_TICK_RATE 20000
+#endif
+
+typedef struct {
+    float steps_per_mm;
+    float max_rate;         // mm/min
+    float acceleration;     // mm/sec^2
+} aux_axis_settings_t;
+
+bool aux_axis_init (void);
+
+#endif
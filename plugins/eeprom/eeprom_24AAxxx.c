@@ -23,6 +23,8 @@
 
 */
 
+#include <string.h>
+
 #include "driver.h"
 
 #if EEPROM_ENABLE == 2
@@ -62,7 +64,8 @@ static void putByte (uint32_t addr, uint8_t new_value)
 static nvs_transfer_result_t writeBlock (uint32_t destination, uint8_t *source, uint32_t size, bool with_checksum)
 {
     uint32_t remaining = size;
-    uint8_t *target = source;
+    uint8_t *target = source, page[EEPROM_PAGE_SIZE];
+    bool add_checksum = size > 0 && with_checksum;
 
     while(remaining > 0) {
         i2c.address = EEPROM_I2C_ADDRESS;
@@ -74,33 +77,36 @@ static nvs_transfer_result_t writeBlock (uint32_t destination, uint8_t *source,
         target += i2c.count;
         destination += i2c.count;
 
+        // Append checksum to the last write if within the page, saves a write cycle
+        if(remaining == 0 && add_checksum && (destination & (EEPROM_PAGE_SIZE - 1))) {
+            memcpy(page, i2c.data, i2c.count);
+            page[i2c.count++] = calc_checksum(source, size);
+            i2c.data = page;
+            add_checksum = false;
+        }
+
         i2c_nvs_transfer(&i2c, false);
     }
 
-    if(size > 0 && with_checksum)
+    if(add_checksum)
         putByte(destination, calc_checksum(source, size));
 
     return NVS_TransferResult_OK;
 }
 
+// Reads the block in a single sequential read, the EEPROM address counter rolls over page boundaries.
 static nvs_transfer_result_t readBlock (uint8_t *destination, uint32_t source, uint32_t size, bool with_checksum)
 {
-    uint32_t remaining = size;
-    uint8_t *target = destination;
-
-    while(remaining) {
+    if(size) {
         i2c.address = EEPROM_I2C_ADDRESS;
         i2c.word_addr = source;
-        i2c.count = remaining > 255 ? 255 : (uint8_t)remaining;
-        i2c.data = target;
-        remaining -= i2c.count;
-        target += i2c.count;
-        source += i2c.count;
+        i2c.count = size;
+        i2c.data = destination;
 
         i2c_nvs_transfer(&i2c, true);
     }
 
-    return with_checksum ? (calc_checksum(destination, size) == getByte(source) ? NVS_TransferResult_OK : NVS_TransferResult_Failed) : NVS_TransferResult_OK;
+    return with_checksum ? (calc_checksum(destination, size) == getByte(source + size) ? NVS_TransferResult_OK : NVS_TransferResult_Failed) : NVS_TransferResult_OK;
 }
 
 void i2c_eeprom_init (void)
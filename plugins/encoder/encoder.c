@@ -38,6 +38,14 @@
 #include "grbl/nvs_buffer.h"
 #endif
 
+#ifdef ENABLE_JOG_VELOCITY
+#ifdef ARDUINO
+#include "../grbl/motion_control.h"
+#else
+#include "grbl/motion_control.h"
+#endif
+#endif
+
 #include <stdio.h>
 #include <string.h>
 
@@ -85,6 +93,7 @@ static int32_t npos[QEI_ENABLE] = {0};
 static mpg_t mpg[N_AXIS] = {0};
 static mpg_event_t mpg_events[N_AXIS] = {0};
 static encoder_t *override_encoder = NULL; // NULL when no Encoder_Universal available
+static bool has_mpg_encoder = false;
 static axes_signals_t mpg_event = {0};
 static volatile bool mpg_spin_lock = false;
 static on_realtime_report_ptr on_realtime_report = NULL;
@@ -94,6 +103,26 @@ static driver_setting_ptrs_t driver_settings;
 static encoder_settings_t encoders[QEI_ENABLE];
 static uint_fast8_t n_encoder;
 
+// Motor encoders, following error supervision.
+static struct {
+    encoder_t *encoder;
+    int32_t offset; // Commanded position in counts minus encoder count, resynchronized when not in motion
+} motor[N_AXIS] = {0};
+static axes_signals_t motor_axes = {0}, following_error = {0};
+
+#ifdef ENABLE_JOG_VELOCITY
+
+#ifndef MPG_VELOCITY_TIMEOUT
+#define MPG_VELOCITY_TIMEOUT 50 // ms, motion is stopped when no encoder counts are received within this time
+#endif
+
+static struct {
+    bool active;
+    uint32_t ms; // Time of last velocity update
+} mpg_velocity = {0};
+
+#endif
+
 static char *append (char *s)
 {
     while(*s)
@@ -200,6 +229,64 @@ serialWriteS(ASCII_EOL);
     return is_moving;
 }
 
+#ifdef ENABLE_JOG_VELOCITY
+
+// Passes the handwheel velocity to the step segment generator, no gcode is generated and parsed.
+// The velocity is the distance moved since the last update divided by the time elapsed.
+static bool mpg_jog_velocity (uint_fast16_t state, axes_signals_t axes)
+{
+    int32_t delta;
+    uint_fast8_t idx = 0;
+    float velocity[N_AXIS] = {0};
+    uint32_t ms = hal.get_elapsed_ticks(), dt = mpg_velocity.active ? ms - mpg_velocity.ms : MPG_VELOCITY_TIMEOUT;
+
+    if(dt == 0)
+        dt = 1;
+    else if(dt > MPG_VELOCITY_TIMEOUT)
+        dt = MPG_VELOCITY_TIMEOUT;
+
+    while(axes.mask) {
+
+        if(axes.mask & 0x01) {
+            if((delta = mpg[idx].position - npos[mpg[idx].encoder->id]) != 0) {
+                mpg[idx].position = npos[mpg[idx].encoder->id];
+                velocity[idx] = (float)delta * mpg[idx].scale_factor / 100.0f * 60000.0f / (float)dt;
+                if(fabsf(velocity[idx]) > settings.axis[idx].max_rate)
+                    velocity[idx] = velocity[idx] > 0.0f ? settings.axis[idx].max_rate : -settings.axis[idx].max_rate;
+            }
+        }
+
+        idx++;
+        axes.mask >>= 1;
+    }
+
+    if(mc_jog_velocity(velocity) == Status_OK) {
+        mpg_velocity.active = true;
+        mpg_velocity.ms = ms;
+    }
+
+    return mpg_velocity.active;
+}
+
+// Stops the velocity jog when the handwheel has stopped turning.
+static void mpg_jog_velocity_check (uint32_t ms)
+{
+    if(mpg_velocity.active && ms - mpg_velocity.ms > MPG_VELOCITY_TIMEOUT) {
+
+        float velocity[N_AXIS] = {0};
+        uint_fast8_t idx = N_AXIS;
+
+        mc_jog_velocity(velocity);
+        mpg_velocity.active = false;
+
+        do {
+            mpg[--idx].flags.moving = Off;
+        } while(idx);
+    }
+}
+
+#endif
+
 // End MPG encoder movement algorithms
 
 static inline void reset_override (encoder_mode_t mode)
@@ -247,12 +334,59 @@ static void encoder_report_mode (uint_fast16_t state)
     }
 }
 
+// Returns commanded position of axis in encoder counts.
+static inline int32_t motor_commanded_count (int32_t *position, uint_fast8_t axis)
+{
+    return (int32_t)lroundf((float)position[axis] * mm_per_step[axis] * (float)motor[axis].encoder->settings->cpr);
+}
+
+// Compares encoder counts of motor encoders against the commanded position, feed holds on excessive following error.
+// NOTE: the commanded position is updated at step segment boundaries, the limit (CPD) must cover the counts of a segment.
+static void motor_encoders_check (uint_fast16_t state)
+{
+    uint_fast8_t idx = N_AXIS;
+    int32_t position[N_AXIS], error;
+    bool moving = !!(state & (STATE_CYCLE|STATE_HOLD|STATE_JOG));
+
+    st_get_position(position);
+
+    do {
+        if(motor_axes.mask & bit(--idx)) {
+            if(!moving) {
+                motor[idx].offset = motor_commanded_count(position, idx) - hal.encoder.get_count(motor[idx].encoder->id);
+                following_error.mask &= ~bit(idx);
+            } else if(!(following_error.mask & bit(idx))) {
+                error = hal.encoder.get_count(motor[idx].encoder->id) + motor[idx].offset - motor_commanded_count(position, idx);
+                if((uint32_t)abs(error) > motor[idx].encoder->settings->cpd) {
+                    following_error.mask |= bit(idx);
+                    system_set_exec_state_flag(EXEC_FEED_HOLD);
+                    sprintf(gcode, "Following error %s: %ld counts", axis_letter[idx], (long)error);
+                    report_message(gcode, Message_Warning);
+                }
+            }
+        }
+    } while(idx);
+}
+
 static void encoder_execute_realtime (uint_fast16_t state)
 {
     static uint32_t elapsed = 0;
 
+    if(motor_axes.mask)
+        motor_encoders_check(state);
+
+    if(!has_mpg_encoder) {
+        on_execute_realtime(state);
+        return;
+    }
+
     uint32_t ms = hal.get_elapsed_ticks();
 
+#ifdef ENABLE_JOG_VELOCITY
+    if(!mpg_event.mask)
+        mpg_jog_velocity_check(ms);
+#endif
+
     if(ms != elapsed && mpg_event.mask && (state == STATE_IDLE || (state & STATE_JOG))) {
 
         bool move_action = false, stop_action = false;
@@ -315,7 +449,9 @@ serialWriteS(ASCII_EOL);
 
                     if(!mpg[idx].flags.moving) {
                         float target[N_AXIS];
-                        system_convert_array_steps_to_mpos(target, sys_position);
+                        int32_t position[N_AXIS];
+                        st_get_position(position);
+                        system_convert_array_steps_to_mpos(target, position);
                         mpg[idx].flags.moving = On;
                         mpg[idx].pos = target[idx] - gc_get_offset(idx);
                     }
@@ -346,6 +482,11 @@ static void encoder_event (encoder_t *encoder, int32_t position)
 {
     bool update_position = false;
 
+    if(encoder->settings->mode >= Encoder_Motor_X) { // Motor encoders are polled
+        encoder->event.events = 0;
+        return;
+    }
+
     if(encoder->event.click) {
 
         if(encoder->settings->mode == Encoder_Universal) {
@@ -531,7 +672,8 @@ static status_code_t encoder_setting (setting_type_t setting, float value, char
         if(encoder_idx < n_encoder) switch(setting_idx) {
 
             case Setting_EncoderMode:
-                if(isintf(value) && value != NAN && value >= (float)Encoder_Universal && value < (float)Encoder_Spindle_Position)
+                if(isintf(value) && value != NAN && value >= (float)Encoder_Universal &&
+                    (value < (float)Encoder_Spindle_Position || (value >= (float)Encoder_Motor_X && value < (float)(Encoder_Motor_X + N_AXIS) && hal.encoder.get_count)))
                     encoders[encoder_idx].mode = (encoder_mode_t)value;
                 else
                     status = Status_InvalidStatement;
@@ -632,12 +774,13 @@ static void encoder_settings_load (void)
 bool encoder_start (encoder_t *encoder)
 {
     uint_fast8_t idx;
-    bool has_mpg_encoder = false;
 
     if(n_encoder == 0)
         return false;
 
     override_encoder = NULL;
+    has_mpg_encoder = false;
+    motor_axes.mask = following_error.mask = 0;
 
     for(idx = 0; idx < n_encoder; idx++) {
 
@@ -702,16 +845,30 @@ bool encoder_start (encoder_t *encoder)
                 break;
 #endif
             default:
+                if(encoder[idx].settings->mode >= Encoder_Motor_X && encoder[idx].settings->mode < Encoder_Motor_X + N_AXIS && hal.encoder.get_count) {
+                    uint_fast8_t axis = encoder[idx].settings->mode - Encoder_Motor_X;
+                    motor[axis].encoder = &encoder[idx];
+                    motor_axes.mask |= bit(axis);
+                }
                 break;
         }
 
         hal.encoder.reset(idx);
     }
 
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(motor_axes.mask & bit(idx))
+            motor[idx].offset = 0;
+    }
+
     for(idx = 0; idx < N_AXIS; idx++) {
         mpg[idx].scale_factor = 1.0f;
 //        mpg[idx].handler = mpg_move_absolute;
+#ifdef ENABLE_JOG_VELOCITY
+        mpg[idx].handler = mpg_jog_velocity;
+#else
         mpg[idx].handler = mpg_jog_relative;
+#endif
     }
 
 #if COMPATIBILITY_LEVEL <= 1
@@ -726,7 +883,7 @@ bool encoder_start (encoder_t *encoder)
     }
 #endif
 
-    if(has_mpg_encoder) {
+    if(has_mpg_encoder || motor_axes.mask) {
         if(!on_execute_realtime) {
             on_execute_realtime = grbl.on_execute_realtime;
             grbl.on_execute_realtime = encoder_execute_realtime;
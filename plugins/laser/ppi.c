@@ -29,18 +29,18 @@
 
 #include "grbl/hal.h"
 
+// Pulse interval and distance to next pulse are in Bresenham step event units, precomputed per block
+// by the step segment generator. See st_block_t ppi_interval.
 typedef struct {
     uint_fast16_t ppi;
-    float ppi_distance;
-    float ppi_pos;
-    float next_pos;
+    uint32_t interval;
+    int32_t next_pulse;
     uint_fast16_t pulse_length; // uS
     bool on;
 } laser_ppi_t;
 
 static laser_ppi_t laser = {
-    .ppi = 600.0f,
-    .ppi_distance = 25.4f / 600.0f,
+    .ppi = 600,
     .pulse_length = 1500,
     .on = false
 };
@@ -57,24 +57,30 @@ spindle_update_rpm_ptr spindle_update_rpm;
 
 static void stepperWakeUp (void)
 {
-    laser.ppi_pos = laser.next_pos = 0.0f;
+    laser.next_pulse = 0;
 
     stepper_wake_up();
 }
 
+// Counts down the distance to the next pulse by the step event increment of each stepper interrupt,
+// the pulse length is timed by the driver.
 static void stepperPulseStartPPI (stepper_t *stepper)
 {
-    static float mm_per_step;
-//    static uint_fast16_t current_pwm = 0;
-
-    if(laser.on) {
-
-        if(stepper->new_block)
-            mm_per_step = 1.0f / (stepper->exec_block->steps_per_mm * (1 << stepper->amass_level));
+    if(stepper->new_block) {
+        // Rescale the remaining distance to the pulse interval of the new block.
+        if(laser.interval && stepper->exec_block->ppi_interval)
+            laser.next_pulse = (int32_t)((int64_t)laser.next_pulse * stepper->exec_block->ppi_interval / laser.interval);
+        laser.interval = stepper->exec_block->ppi_interval;
+    }
 
-        laser.ppi_pos += mm_per_step;
-        if(laser.ppi_pos >= laser.next_pos) {
-            laser.next_pos += laser.ppi_distance;
+    if(laser.on && laser.interval) {
+      #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        laser.next_pulse -= 1 << (MAX_AMASS_LEVEL - stepper->amass_level);
+      #else
+        laser.next_pulse -= 2;
+      #endif
+        if(laser.next_pulse <= 0) {
+            laser.next_pulse += laser.interval;
             hal.spindle.pulse_on(laser.pulse_length);
         }
     }
@@ -86,7 +92,7 @@ static void stepperPulseStartPPI (stepper_t *stepper)
 void ppiUpdatePWM (uint_fast16_t pwm)
 {
     if(!laser.on && pwm > 0)
-        laser.ppi_pos = laser.next_pos = 0.0f;
+        laser.next_pulse = 0;
 
     laser.on = pwm > 0;
 
@@ -97,7 +103,7 @@ void ppiUpdatePWM (uint_fast16_t pwm)
 void ppiUpdateRPM (float rpm)
 {
     if(!laser.on && rpm > 0.0f)
-        laser.ppi_pos = laser.next_pos = 0.0f;
+        laser.next_pulse = 0;
 
     laser.on = rpm > 0.0f;
 
@@ -144,6 +150,7 @@ static status_code_t userMCodeValidate (parser_block_t *gc_block, uint32_t *valu
         case LaserPPI_Enable:
             if(bit_istrue(*value_words, bit(Word_P))) {
                 state = Status_OK;
+                gc_block->user_mcode_sync = true;
                 bit_false(*value_words, bit(Word_P));
             }
             break;
@@ -187,8 +194,7 @@ static void userMCodeExecute (uint_fast16_t state, parser_block_t *gc_block)
             break;
 
         case LaserPPI_Rate:
-            if((laser.ppi = (uint_fast16_t)gc_block->values.p) != 0)
-                laser.ppi_distance = 25.4f / (float)laser.ppi;
+            laser.ppi = (uint_fast16_t)gc_block->values.p;
             enable_ppi(ppi_on && laser.ppi > 0 && laser.pulse_length > 0);
             break;
 
@@ -0,0 +1,122 @@
+/*
+
+  raster.c - plugin for laser raster runs, pixel powers output by the stepper ISR over a single G1 motion
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "driver.h"
+
+#if RASTER_ENABLE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "grbl/hal.h"
+
+#ifndef ENABLE_LASER_RASTER
+#error "Laser raster plugin requires ENABLE_LASER_RASTER to be defined in config.h!"
+#endif
+
+static on_unknown_sys_command_ptr on_unknown_sys_command;
+static on_report_options_ptr on_report_options;
+
+static inline int_fast16_t hex_digit (char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    return -1;
+}
+
+// $LR=<pixels> - queues a raster run for the next G1 motion, two hex digits per pixel.
+static status_code_t rasterLoad (char *data)
+{
+    size_t length = strlen(data);
+    laser_raster_t *raster;
+
+    if(length == 0 || (length & 1))
+        return Status_InvalidStatement;
+
+    length >>= 1;
+
+    if(length > UINT16_MAX)
+        return Status_Overflow;
+
+    if((raster = malloc(sizeof(laser_raster_t) + length)) == NULL)
+        return Status_Overflow;
+
+    raster->length = (uint16_t)length;
+
+    uint8_t *pixel = raster->pixel;
+    while(length--) {
+
+        int_fast16_t hi = hex_digit(*data++), lo = hex_digit(*data++);
+
+        if(hi < 0 || lo < 0) {
+            free(raster);
+            return Status_BadNumberFormat;
+        }
+
+        *pixel++ = (uint8_t)((hi << 4) | lo);
+    }
+
+    gc_laser_raster_add(raster);
+
+    return Status_OK;
+}
+
+static status_code_t commandExecute (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(line[1] == 'L' && line[2] == 'R' && line[3] == '=') {
+        if(settings.mode != Mode_Laser)
+            retval = Status_SettingDisabledLaser;
+        else if(state == STATE_CHECK_MODE)
+            retval = Status_OK;
+        else
+            retval = rasterLoad(&line[4]);
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+static void onReportOptions (void)
+{
+    on_report_options();
+    hal.stream.write("[PLUGIN:LASER RASTER v0.01]" ASCII_EOL);
+}
+
+void raster_init (void)
+{
+    on_unknown_sys_command = grbl.on_unknown_sys_command;
+    grbl.on_unknown_sys_command = commandExecute;
+
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = onReportOptions;
+}
+
+#endif
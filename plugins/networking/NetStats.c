@@ -0,0 +1,133 @@
+//
+// NetStats.c - network counters, reported by $NETSTATS
+//
+// v1.0 / 2020-11-10 / Io Engineering / Terje
+//
+
+/*
+
+Copyright (c) 2020, Terje Io
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+ Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+ Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+ Neither the name of the copyright holder nor the names of its contributors may
+be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+//
+// $NETSTATS reports one line per group of counters:
+//
+// [NETSTATS:TELNET,<rx refused>,<tx stalls>,<retransmits>] - Telnet stream, see tcp_stream_stats_t in TCPStream.h.
+// [NETSTATS:RTT,<average ms>,<max ms>,<samples>]           - Telnet stream round trip time, output sent until acknowledged.
+// [NETSTATS:LINK,<rx>,<tx>,<drop>,<memerr>]                - lwIP link level, requires LWIP_STATS and LINK_STATS.
+// [NETSTATS:TCP,<rx>,<tx>,<drop>,<memerr>]                 - lwIP TCP, requires LWIP_STATS and TCP_STATS.
+// [NETSTATS:PBUF_POOL,<used>,<max>,<avail>,<err>]          - lwIP packet buffer pool, err is the number of times it was exhausted.
+//                                                            Requires LWIP_STATS and MEMP_STATS.
+//
+// NOTE: lwIP counters are 16 bit unless LWIP_STATS_LARGE is set.
+//
+
+#include "networking.h"
+
+#if TELNET_ENABLE || WEBSOCKET_ENABLE
+
+#include <string.h>
+
+#include "lwip/init.h"
+
+#include "NetStats.h"
+
+#if TELNET_ENABLE
+#include "TCPStream.h"
+#endif
+
+static on_unknown_sys_command_ptr on_unknown_sys_command;
+
+static void reportCounters (const char *group, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t c4, bool four)
+{
+    hal.stream.write("[NETSTATS:");
+    hal.stream.write(group);
+    hal.stream.write(",");
+    hal.stream.write(uitoa(c1));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(c2));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(c3));
+    if(four) {
+        hal.stream.write(",");
+        hal.stream.write(uitoa(c4));
+    }
+    hal.stream.write("]" ASCII_EOL);
+}
+
+static void reportStats (void)
+{
+#if TELNET_ENABLE
+    const tcp_stream_stats_t *telnet = TCPStreamGetStats();
+
+    reportCounters("TELNET", telnet->rx_refused, telnet->tx_stalls, telnet->retransmits, 0, false);
+    reportCounters("RTT", telnet->rtt_avg, telnet->rtt_max, telnet->rtt_samples, 0, false);
+#endif
+
+#if LWIP_STATS
+  #if LINK_STATS
+    reportCounters("LINK", lwip_stats.link.recv, lwip_stats.link.xmit, lwip_stats.link.drop, lwip_stats.link.memerr, true);
+  #endif
+  #if TCP_STATS
+    reportCounters("TCP", lwip_stats.tcp.recv, lwip_stats.tcp.xmit, lwip_stats.tcp.drop, lwip_stats.tcp.memerr, true);
+  #endif
+  #if MEMP_STATS
+    #if LWIP_VERSION_MAJOR >= 2
+    const struct stats_mem *pool = lwip_stats.memp[MEMP_PBUF_POOL];
+    #else
+    const struct stats_mem *pool = &lwip_stats.memp[MEMP_PBUF_POOL];
+    #endif
+    reportCounters("PBUF_POOL", pool->used, pool->max, pool->avail, pool->err, true);
+  #endif
+#endif
+}
+
+static status_code_t commandExecute (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strcmp(&line[1], "NETSTATS")) {
+        reportStats();
+        retval = Status_OK;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+// Adds the $NETSTATS command, to be called once by the driver when the network is initialized.
+void NetStatsInit (void)
+{
+    if(on_unknown_sys_command == NULL) {
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = commandExecute;
+    }
+}
+
+#endif
@@ -71,6 +71,10 @@ typedef struct
     pbuf_entry_t queue[PBUF_POOL_SIZE];
     pbuf_entry_t *rcvTail;
     pbuf_entry_t *rcvHead;
+    pbuf_entry_t *rcvDone;      // Zero copy mode: first queued pbuf chain read but not yet acknowledged and freed
+    uint32_t rcvCount;          // Zero copy mode: number of characters received
+    uint32_t readCount;         // Zero copy mode: number of characters read
+    bool rxCancel;              // Zero copy mode: return ASCII_CAN on next read
     struct pbuf *pbufHead;
     struct pbuf *pbufCurrent;
     uint32_t bufferIndex;
@@ -105,6 +109,30 @@ static const sessiondata_t defaultSettings =
 };
 
 static sessiondata_t streamSession;
+static tcp_stream_stats_t streamStats = {0};
+
+// Round trip time sample, taken from output handed to lwIP until it is acknowledged by the client.
+static struct {
+    bool pending;
+    uint32_t seq;   // Sequence number acknowledging the sampled output
+    uint32_t ms;    // Time the sampled output was handed to lwIP
+} rttSample = {0};
+
+#if TELNET_MAX_OBSERVERS
+
+typedef struct
+{
+    struct tcp_pcb *pcb;
+    stream_tx_buffer_t txbuf;
+    bool line_open;             // Last character added to the TX buffer was not end of line
+    bool skip_line;             // Output is dropped until end of the current line
+    bool eol_pending;           // A line was truncated by dropping output, terminate it before adding more
+    uint32_t dropped;           // Number of writes dropped
+} observer_t;
+
+static observer_t observers[TELNET_MAX_OBSERVERS];
+
+#endif
 
 void TCPStreamInit (void)
 {
@@ -116,9 +144,98 @@ void TCPStreamInit (void)
         streamSession.queue[idx].next = &streamSession.queue[idx == PBUF_POOL_SIZE - 1 ? 0 : idx + 1];
     }
 
-    streamSession.rcvTail = streamSession.rcvHead = &streamSession.queue[0];
+    streamSession.rcvDone = streamSession.rcvTail = streamSession.rcvHead = &streamSession.queue[0];
+}
+
+#if TCP_STREAM_ZERO_COPY
+
+//
+// streamGetC - returns -1 if no data available, reads directly from the queued pbuf chains
+// NOTE: Real time commands has been replaced by '\0' on reception, these are skipped.
+//
+static inline int16_t streamGetC (void)
+{
+    char c;
+
+    if(streamSession.rxCancel) {
+        streamSession.rxCancel = false;
+        return ASCII_CAN;
+    }
+
+    do {
+        if(streamSession.pbufCurrent == NULL) {
+            if(streamSession.rcvTail == streamSession.rcvHead)
+                return -1; // no data available else EOF
+            streamSession.pbufCurrent = streamSession.rcvTail->pbuf;
+            streamSession.bufferIndex = 0;
+        }
+
+        c = ((char *)streamSession.pbufCurrent->payload)[streamSession.bufferIndex++];
+        streamSession.readCount++;
+
+        if(streamSession.bufferIndex >= streamSession.pbufCurrent->len) {
+            streamSession.bufferIndex = 0;
+            // When all data in chain is read hand it over to TCPStreamPoll() for acknowledge and release
+            if((streamSession.pbufCurrent = streamSession.pbufCurrent->next) == NULL)
+                streamSession.rcvTail = streamSession.rcvTail->next;
+        }
+    } while(c == '\0');
+
+    return (int16_t)c;
+}
+
+int16_t TCPStreamGetC (void)
+{
+    return streamGetC();
 }
 
+//
+// TCPStreamReadBlock - returns number of characters copied, stops after first end of line character
+//
+uint16_t TCPStreamReadBlock (char *buf, uint16_t size)
+{
+    int16_t c;
+    uint16_t count = 0;
+
+    while(count < size && (c = streamGetC()) != -1) {
+        buf[count++] = (char)c;
+        if(c == '\n' || c == '\r')
+            break;
+    }
+
+    return count;
+}
+
+uint16_t TCPStreamRxCount (void)
+{
+    uint32_t count = streamSession.rcvCount - streamSession.readCount;
+
+    return count > RX_BUFFER_SIZE - 1 ? RX_BUFFER_SIZE - 1 : (uint16_t)count;
+}
+
+// NOTE: Reports the free space of an equally sized receive buffer, the actual limit is the TCP receive window.
+uint16_t TCPStreamRxFree (void)
+{
+    return (RX_BUFFER_SIZE - 1) - TCPStreamRxCount();
+}
+
+// Discards queued input, the pbuf chains are released by TCPStreamPoll()
+void TCPStreamRxFlush (void)
+{
+    streamSession.pbufCurrent = NULL;
+    streamSession.bufferIndex = 0;
+    streamSession.rcvDone = streamSession.rcvTail = streamSession.rcvHead;
+    streamSession.readCount = streamSession.rcvCount;
+}
+
+void TCPStreamRxCancel (void)
+{
+    TCPStreamRxFlush();
+    streamSession.rxCancel = true;
+}
+
+#else
+
 //
 // TCPStreamGetC - returns -1 if no data available
 //
@@ -136,6 +253,14 @@ int16_t TCPStreamGetC (void)
     return data;
 }
 
+//
+// TCPStreamReadBlock - returns number of characters copied, stops after first end of line character
+//
+uint16_t TCPStreamReadBlock (char *buf, uint16_t size)
+{
+    return stream_rx_buffer_read_block(&streamSession.rxbuf, buf, size);
+}
+
 inline uint16_t TCPStreamRxCount (void)
 {
     uint_fast16_t head = streamSession.rxbuf.head, tail = streamSession.rxbuf.tail;
@@ -160,6 +285,10 @@ void TCPStreamRxCancel (void)
     streamSession.rxbuf.head = (streamSession.rxbuf.tail + 1) & (RX_BUFFER_SIZE - 1);
 }
 
+#endif // TCP_STREAM_ZERO_COPY
+
+#if !TCP_STREAM_ZERO_COPY
+
 static bool streamBufferRX (char c)
 {
     // discard input if MPG has taken over...
@@ -178,7 +307,63 @@ static bool streamBufferRX (char c)
     return !streamSession.rxbuf.overflow;
 }
 
-bool TCPStreamPutC (const char c)
+#endif
+
+// Copies data to the TX ring in at most two chunks, the caller must ensure there is room for it
+static void streamTxCopy (stream_tx_buffer_t *txbuf, const char *data, uint_fast16_t length)
+{
+    uint_fast16_t head = txbuf->head, chunk = TX_BUFFER_SIZE - head;
+
+    if(chunk > length)
+        chunk = length;
+
+    memcpy(&txbuf->data[head], data, chunk);
+    if(length > chunk)
+        memcpy(txbuf->data, data + chunk, length - chunk);
+
+    txbuf->head = (head + length) & (TX_BUFFER_SIZE - 1);
+}
+
+#if TELNET_MAX_OBSERVERS
+
+// Adds output to the observer TX buffers, never blocks.
+// If there is no room the data is dropped, as is the rest of the line it belongs to.
+static void observersWrite (const char *data, uint_fast16_t length)
+{
+    uint_fast8_t idx;
+    bool eol = length && data[length - 1] == '\n';
+
+    for(idx = 0; idx < TELNET_MAX_OBSERVERS; idx++) {
+
+        observer_t *observer = &observers[idx];
+
+        if(observer->pcb == NULL)
+            continue;
+
+        if(!observer->skip_line) {
+
+            uint_fast16_t head = observer->txbuf.head, tail = observer->txbuf.tail, eol_length = observer->eol_pending ? 2 : 0;
+
+            if(length + eol_length <= (TX_BUFFER_SIZE - 1) - BUFCOUNT(head, tail, TX_BUFFER_SIZE)) {
+                if(eol_length)
+                    streamTxCopy(&observer->txbuf, ASCII_EOL, eol_length);
+                streamTxCopy(&observer->txbuf, data, length);
+                observer->eol_pending = false;
+                observer->line_open = !eol;
+                continue;
+            }
+
+            observer->dropped++;
+            observer->eol_pending = observer->eol_pending || observer->line_open;
+        }
+
+        observer->skip_line = !eol;
+    }
+}
+
+#endif
+
+static bool streamPutC (const char c)
 {
     uint32_t next_head = (streamSession.txbuf.head + 1) & (TX_BUFFER_SIZE - 1);  // Get and update head pointer
 
@@ -193,12 +378,31 @@ bool TCPStreamPutC (const char c)
     return true;
 }
 
+bool TCPStreamPutC (const char c)
+{
+#if TELNET_MAX_OBSERVERS
+    observersWrite(&c, 1);
+#endif
+
+    return streamPutC(c);
+}
+
+//
+// TCPStreamWriteS - copies the string to the TX ring in at most two chunks if there is room, one character at a time otherwise
+//
 void TCPStreamWriteS (const char *data)
 {
     char c, *ptr = (char *)data;
+    uint_fast16_t length = strlen(data), head = streamSession.txbuf.head, tail = streamSession.txbuf.tail;
 
-    while((c = *ptr++) != '\0')
-        TCPStreamPutC(c);
+#if TELNET_MAX_OBSERVERS
+    observersWrite(data, length);
+#endif
+
+    if(length < (TX_BUFFER_SIZE - 1) - BUFCOUNT(head, tail, TX_BUFFER_SIZE))
+        streamTxCopy(&streamSession.txbuf, ptr, length);
+    else while((c = *ptr++) != '\0')
+        streamPutC(c);
 }
 
 void TCPStreamWriteLn (const char *data)
@@ -211,8 +415,12 @@ void TCPStreamWrite (const char *data, unsigned int length)
 {
     char *ptr = (char *)data;
 
+#if TELNET_MAX_OBSERVERS
+    observersWrite(data, length);
+#endif
+
     while(length--)
-        TCPStreamPutC(*ptr++);
+        streamPutC(*ptr++);
 }
 
 uint16_t TCPStreamTxCount(void) {
@@ -222,20 +430,6 @@ uint16_t TCPStreamTxCount(void) {
     return BUFCOUNT(head, tail, TX_BUFFER_SIZE);
 }
 
-static int16_t streamReadTXC (void)
-{
-    int16_t data;
-    uint_fast16_t bptr = streamSession.txbuf.tail;
-
-    if(bptr == streamSession.txbuf.head)
-        return -1; // no data available else EOF
-
-    data = streamSession.txbuf.data[bptr++];                 // Get next character, increment tmp pointer
-    streamSession.txbuf.tail = bptr & (TX_BUFFER_SIZE - 1);  // and update pointer
-
-    return data;
-}
-
 void TCPStreamTxFlush (void)
 {
     streamSession.txbuf.tail = streamSession.txbuf.head;
@@ -253,12 +447,21 @@ static void streamFreeBuffers (sessiondata_t *session)
         session->bufferIndex = 0;
     }
 
+#if TCP_STREAM_ZERO_COPY
+    session->pbufCurrent = NULL;
+    session->bufferIndex = 0;
+    session->rcvTail = session->rcvDone;
+    session->readCount = session->rcvCount;
+#endif
+
     // Free any queued buffer chains
     while(session->rcvTail != session->rcvHead) {
         pbuf_free(session->rcvTail->pbuf);
         session->rcvTail = session->rcvTail->next;
     }
 
+    session->rcvDone = session->rcvTail;
+
     SYS_ARCH_UNPROTECT(lev);
 }
 
@@ -283,7 +486,7 @@ static void streamError (void *arg, err_t err)
     session->bufferIndex = 0;
     session->lastSendTime = 0;
     session->linkLost = false;
-    session->rcvTail = session->rcvHead;
+    session->rcvDone = session->rcvTail = session->rcvHead;
 }
 
 static err_t streamPoll (void *arg, struct tcp_pcb *pcb)
@@ -327,19 +530,50 @@ static err_t streamReceive (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_
         sessiondata_t *session = arg;
 
         if(p) {
+#if TCP_STREAM_ZERO_COPY
+            // Discard input if MPG has taken over...
+            if(hal.stream.type == StreamType_MPG) {
+                tcp_recved(pcb, p->tot_len);
+                pbuf_free(p);
+                return ERR_OK;
+            }
+
+            // Queue full, refuse data. lwIP will hold on to it and retry later.
+            if(session->rcvHead->next == session->rcvDone) {
+                streamStats.rx_refused++;
+                return ERR_MEM;
+            }
+
+            // Process real time commands on reception, replace them by '\0' so they are skipped on read.
+            struct pbuf *q;
+            uint_fast16_t idx;
+
+            for(q = p; q != NULL; q = q->next) {
+                for(idx = 0; idx < q->len; idx++) {
+                    if(hal.stream.enqueue_realtime_command(((char *)q->payload)[idx]))
+                        ((char *)q->payload)[idx] = '\0';
+                }
+            }
+
+            session->rcvHead->pbuf = p;
+            session->rcvHead = session->rcvHead->next;
+            session->rcvCount += p->tot_len;
+#else
             // Attempt to queue data
             SYS_ARCH_DECL_PROTECT(lev);
             SYS_ARCH_PROTECT(lev);
 
             if(session->rcvHead->next == session->rcvTail) {
-                // Queue full, discard
+                // Queue full, refuse data. lwIP will hold on to it and retry later, freeing it would lose data already acknowledged.
                 SYS_ARCH_UNPROTECT(lev);
-                pbuf_free(p);
+                streamStats.rx_refused++;
+                return ERR_MEM;
             } else {
                 session->rcvHead->pbuf = p;
                 session->rcvHead = session->rcvHead->next;
                 SYS_ARCH_UNPROTECT(lev);
             }
+#endif
         } else // Null packet received, means close connection
             closeSocket(session, pcb);;
     }
@@ -351,9 +585,97 @@ static err_t streamSent (void *arg, struct tcp_pcb *pcb, u16_t ui16len)
 {
     ((sessiondata_t *)arg)->timeout = 0;
 
+    if(rttSample.pending && (int32_t)(pcb->lastack - rttSample.seq) >= 0) {
+
+        uint32_t rtt = hal.get_elapsed_ticks() - rttSample.ms;
+
+        rttSample.pending = false;
+        streamStats.rtt_avg = streamStats.rtt_samples++ ? (streamStats.rtt_avg * 7 + rtt) >> 3 : rtt;
+        if(rtt > streamStats.rtt_max)
+            streamStats.rtt_max = rtt;
+    }
+
+    return ERR_OK;
+}
+
+#if TELNET_MAX_OBSERVERS
+
+static void observerClose (observer_t *observer, bool abort)
+{
+    struct tcp_pcb *pcb = observer->pcb;
+
+    observer->pcb = NULL;
+
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_err(pcb, NULL);
+
+    if(abort)
+        tcp_abort(pcb);
+    else
+        tcp_close(pcb);
+}
+
+static void observerError (void *arg, err_t err)
+{
+    ((observer_t *)arg)->pcb = NULL; // pcb is already freed by lwIP
+}
+
+// Observers are read-only, only status report requests are acted upon.
+static err_t observerReceive (void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+    if(err == ERR_OK) {
+
+        if(p) {
+            struct pbuf *q;
+            uint_fast16_t idx;
+
+            for(q = p; q != NULL; q = q->next) {
+                for(idx = 0; idx < q->len; idx++) {
+                    char c = ((char *)q->payload)[idx];
+                    if(c == CMD_STATUS_REPORT_LEGACY || c == (char)CMD_STATUS_REPORT || c == (char)CMD_STATUS_REPORT_ALL)
+                        hal.stream.enqueue_realtime_command(c);
+                }
+            }
+
+            tcp_recved(pcb, p->tot_len);
+            pbuf_free(p);
+        } else // Null packet received, means close connection
+            observerClose((observer_t *)arg, false);
+    }
+
     return ERR_OK;
 }
 
+static err_t observerAccept (struct tcp_pcb *pcb)
+{
+    uint_fast8_t idx = TELNET_MAX_OBSERVERS;
+    observer_t *observer = NULL;
+
+    do {
+        if(observers[--idx].pcb == NULL)
+            observer = &observers[idx];
+    } while(idx && observer == NULL);
+
+    if(observer == NULL)
+        return ERR_CONN; // No free observer slot, refuse connection
+
+    memset(observer, 0, sizeof(observer_t));
+    observer->pcb = pcb;
+
+    tcp_accepted(pcb);
+
+    tcp_arg(pcb, observer);
+    tcp_setprio(pcb, TCP_PRIO_MIN);
+    tcp_nagle_disable(pcb);
+    tcp_recv(pcb, observerReceive);
+    tcp_err(pcb, observerError);
+
+    return ERR_OK;
+}
+
+#endif // TELNET_MAX_OBSERVERS
+
 static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
 {
     sessiondata_t *session = arg;
@@ -361,7 +683,11 @@ static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
     if(session->state != TCPState_Listen) {
 
         if(!session->linkLost)
+#if TELNET_MAX_OBSERVERS
+            return observerAccept(pcb); // Busy, accept as observer if there is room
+#else
             return ERR_CONN; // Busy, refuse connection
+#endif
 
         // Link was previously lost, abort current connection
 
@@ -380,8 +706,11 @@ static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
     TCPStreamRxFlush();
 
     session->timeout = 0;
+    rttSample.pending = false;
 
     tcp_setprio(pcb, TCP_PRIO_MIN);
+    // Output is batched by TCPStreamPoll(), disable Nagle's algorithm to avoid delaying status reports until previous data is ACKed.
+    tcp_nagle_disable(pcb);
     tcp_recv(pcb, streamReceive);
     tcp_err(pcb, streamError);
     tcp_poll(pcb, streamPoll, 1000 / TCP_SLOW_INTERVAL);
@@ -395,6 +724,15 @@ static err_t TCPStreamAccept (void *arg, struct tcp_pcb *pcb, err_t err)
 
 void TCPStreamClose (void)
 {
+#if TELNET_MAX_OBSERVERS
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < TELNET_MAX_OBSERVERS; idx++) {
+        if(observers[idx].pcb)
+            observerClose(&observers[idx], true);
+    }
+#endif
+
     if(streamSession.pcbConnect != NULL) {
         tcp_arg(streamSession.pcbConnect, NULL);
         tcp_recv(streamSession.pcbConnect, NULL);
@@ -414,7 +752,7 @@ void TCPStreamClose (void)
     streamSession.state = TCPState_Idle;
     streamSession.pcbConnect = streamSession.pcbListen = NULL;
     streamSession.timeout = 0;
-    streamSession.rcvTail = streamSession.rcvHead;
+    streamSession.rcvDone = streamSession.rcvTail = streamSession.rcvHead;
     streamSession.pbufHead = streamSession.pbufCurrent = NULL;
     streamSession.bufferIndex = 0;
     streamSession.lastSendTime = 0;
@@ -433,7 +771,7 @@ void TCPStreamListen (uint16_t port)
     streamSession.timeout = 0;
     streamSession.timeoutMax = SOCKET_TIMEOUT;
     streamSession.port = port;
-    streamSession.rcvTail = streamSession.rcvHead;
+    streamSession.rcvDone = streamSession.rcvTail = streamSession.rcvHead;
     streamSession.pbufHead = streamSession.pbufCurrent = NULL;
     streamSession.bufferIndex = 0;
     streamSession.lastSendTime = 0;
@@ -448,16 +786,72 @@ void TCPStreamListen (uint16_t port)
     tcp_accept(streamSession.pcbListen, TCPStreamAccept);
 }
 
+//
+// Hands TX ring data over to lwIP, returns true if any was sent.
+// The TX ring is handed to tcp_write() in at most two contiguous chunks and then sent as one segment
+// where possible, TCP_WRITE_FLAG_MORE is set on the first chunk if there is a second.
+//
+static bool streamSendTX (struct tcp_pcb *pcb, stream_tx_buffer_t *txbuf)
+{
+    uint_fast16_t head = txbuf->head, tail = txbuf->tail;
+    int_fast16_t TXCount = BUFCOUNT(head, tail, TX_BUFFER_SIZE);
+
+    if(TXCount && tcp_sndbuf(pcb) && pcb->snd_queuelen < TCP_SND_QUEUELEN) {
+
+        uint_fast16_t chunk;
+
+        if(TXCount > tcp_sndbuf(pcb))
+            TXCount = tcp_sndbuf(pcb);
+
+        while(TXCount && pcb->snd_queuelen < TCP_SND_QUEUELEN) {
+
+            chunk = TX_BUFFER_SIZE - tail;
+            if(chunk > TXCount)
+                chunk = TXCount;
+
+            if(tcp_write(pcb, &txbuf->data[tail], (u16_t)chunk, TCP_WRITE_FLAG_COPY|(chunk < TXCount ? TCP_WRITE_FLAG_MORE : 0)) != ERR_OK)
+                break;
+
+            TXCount -= chunk;
+            txbuf->tail = tail = (tail + chunk) & (TX_BUFFER_SIZE - 1);
+        }
+
+        tcp_output(pcb);
+
+        return true;
+    }
+
+    return false;
+}
+
 //
 // Process data for streaming
 //
 void TCPStreamPoll (void)
 {
-    static uint8_t tempBuffer[PBUF_POOL_BUFSIZE];
+#if TELNET_MAX_OBSERVERS
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < TELNET_MAX_OBSERVERS; idx++) {
+        if(observers[idx].pcb)
+            streamSendTX(observers[idx].pcb, &observers[idx].txbuf);
+    }
+#endif
 
     if(streamSession.state != TCPState_Connected)
         return;
 
+#if TCP_STREAM_ZERO_COPY
+
+    // 1. Acknowledge and release pbuf chains that has been read
+    while(streamSession.rcvDone != streamSession.rcvTail) {
+        tcp_recved(streamSession.pcbConnect, streamSession.rcvDone->pbuf->tot_len);
+        pbuf_free(streamSession.rcvDone->pbuf);
+        streamSession.rcvDone = streamSession.rcvDone->next;
+    }
+
+#else
+
     uint8_t *payload = streamSession.pbufCurrent ? streamSession.pbufCurrent->payload : NULL;
 
     SYS_ARCH_DECL_PROTECT(lev);
@@ -495,34 +889,32 @@ void TCPStreamPoll (void)
         }
     }
 
-//    tcp_output(streamSession.pcbConnect);
+#endif // TCP_STREAM_ZERO_COPY
 
-    int_fast16_t TXCount;
+//    tcp_output(streamSession.pcbConnect);
 
     // 2. Process output stream
-    if((TXCount = TCPStreamTxCount()) && tcp_sndbuf(streamSession.pcbConnect) && streamSession.pcbConnect->snd_queuelen < TCP_SND_QUEUELEN) {
-
-        uint_fast16_t idx;
-
-        if(TXCount > tcp_sndbuf(streamSession.pcbConnect))
-            TXCount = tcp_sndbuf(streamSession.pcbConnect);
+    if(streamSendTX(streamSession.pcbConnect, &streamSession.txbuf)) {
+        streamSession.lastSendTime = xTaskGetTickCount();
+        if(!rttSample.pending && hal.get_elapsed_ticks) {
+            rttSample.seq = streamSession.pcbConnect->snd_lbb;
+            rttSample.ms = hal.get_elapsed_ticks();
+            rttSample.pending = true;
+        }
+    } else if(streamSession.txbuf.head != streamSession.txbuf.tail)
+        streamStats.tx_stalls++;
 
-        while(TXCount && streamSession.pcbConnect->snd_queuelen < TCP_SND_QUEUELEN)
-        {
-            idx = 0;
+    // 3. Count retransmission timeouts, nrtx is incremented on each timeout and cleared when data is acknowledged.
+    static uint8_t nrtx = 0;
 
-            while(TXCount && idx < sizeof(tempBuffer)) {
-                tempBuffer[idx] = (uint8_t)streamReadTXC();
-                idx++;
-                TXCount--;
-            }
-
-            tcp_write(streamSession.pcbConnect, tempBuffer, (u16_t)idx, 1);
-        }
+    if(streamSession.pcbConnect->nrtx > nrtx)
+        streamStats.retransmits += streamSession.pcbConnect->nrtx - nrtx;
+    nrtx = streamSession.pcbConnect->nrtx;
+}
 
-        tcp_output(streamSession.pcbConnect);
-        streamSession.lastSendTime = xTaskGetTickCount();
-    }
+const tcp_stream_stats_t *TCPStreamGetStats (void)
+{
+    return &streamStats;
 }
 
 #endif
@@ -39,12 +39,22 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef __TCPSTREAM_H__
 #define __TCPSTREAM_H__
 
+typedef struct {
+    uint32_t rx_refused;    // Received data refused since the receive queue was full, lwIP holds on to it and retries
+    uint32_t tx_stalls;     // Polls with output pending that could not be sent since the TCP send buffer was full
+    uint32_t retransmits;   // Retransmission timeouts
+    uint32_t rtt_avg;       // Round trip time in ms, from output handed to lwIP until acknowledged. Moving average, includes any delayed ACK by the client
+    uint32_t rtt_max;       // Maximum round trip time in ms
+    uint32_t rtt_samples;   // Number of round trip times measured
+} tcp_stream_stats_t;
+
 void TCPStreamInit(void);
 void TCPStreamListen(uint16_t port);
 void TCPStreamClose(void);
 void TCPStreamPoll(void);
 void TCPStreamNotifyLinkStatus(bool bLinkStatusUp);
 int16_t TCPStreamGetC(void);
+uint16_t TCPStreamReadBlock(char *buf, uint16_t size);
 bool TCPStreamPutC(const char data);
 void TCPStreamWriteS(const char *data);
 void TCPStreamWriteLn(const char *data);
@@ -54,5 +64,6 @@ uint16_t TCPStreamRxCount(void);
 uint16_t TCPStreamRxFree(void);
 void TCPStreamRxFlush(void);
 void TCPStreamRxCancel(void);
+const tcp_stream_stats_t *TCPStreamGetStats(void);
 
 #endif
@@ -0,0 +1,202 @@
+//
+// UDPRealtime.c - lwIP UDP realtime command and telemetry channel
+//
+// v1.0 / 2020-11-10 / Io Engineering / Terje
+//
+
+/*
+
+Copyright (c) 2020, Terje Io
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+ Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+ Redistributions in binary form must reproduce the above copyright notice, this
+list of conditions and the following disclaimer in the documentation and/or
+other materials provided with the distribution.
+
+ Neither the name of the copyright holder nor the names of its contributors may
+be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+//
+// Realtime commands (status report request, feed hold, cycle start, overrides, jog cancel etc.) arriving
+// in datagrams starting with UDP_REALTIME_KEY are passed to the realtime command handler on reception,
+// avoiding the head-of-line blocking of the TCP streams.
+// The sender of the last accepted datagram receives a binary status report frame (see report.h) every
+// UDP_TELEMETRY_INTERVAL milliseconds until no datagram has been received from it for UDP_PEER_TIMEOUT
+// milliseconds, a datagram containing just the key may be used as keepalive.
+// NOTE: telemetry requires ENABLE_BINARY_STATUS_REPORT enabled in grbl/config.h.
+//
+
+#include "networking.h"
+
+#if UDP_REALTIME_ENABLE
+
+#include <string.h>
+
+#include "UDPRealtime.h"
+
+#include "grbl/report.h"
+#include "grbl/protocol.h"
+
+#ifndef UDP_REALTIME_KEY
+#error "UDP_REALTIME_KEY must be defined, only datagrams starting with the key are accepted"
+#endif
+
+#ifndef UDP_TELEMETRY_INTERVAL
+#define UDP_TELEMETRY_INTERVAL 100
+#endif
+
+#ifndef UDP_PEER_TIMEOUT
+#define UDP_PEER_TIMEOUT 5000
+#endif
+
+#define UDP_TELEMETRY_SIZE 256
+
+typedef struct
+{
+    struct udp_pcb *pcb;
+    ip_addr_t peer_addr;
+    u16_t peer_port;
+    volatile bool peer_valid;
+    volatile uint32_t peer_ms;  // Time of last datagram accepted from peer
+    volatile bool tx_ready;     // Telemetry frame is ready to be sent by UDPRealtimePoll()
+    uint_fast16_t tx_length;
+    char tx_buf[UDP_TELEMETRY_SIZE];
+} udp_session_t;
+
+static const char key[] = UDP_REALTIME_KEY;
+static udp_session_t udpSession = {0};
+
+static void udpReceive (void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
+{
+    if(p->tot_len >= sizeof(key) - 1 && pbuf_memcmp(p, 0, key, sizeof(key) - 1) == 0) {
+
+        u16_t idx;
+
+        for(idx = sizeof(key) - 1; idx < p->tot_len; idx++)
+            hal.stream.enqueue_realtime_command((char)pbuf_get_at(p, idx));
+
+        if(!udpSession.tx_ready) {
+            ip_addr_copy(udpSession.peer_addr, *addr);
+            udpSession.peer_port = port;
+        }
+        udpSession.peer_ms = hal.get_elapsed_ticks();
+        udpSession.peer_valid = true;
+    }
+
+    pbuf_free(p);
+}
+
+#ifdef ENABLE_BINARY_STATUS_REPORT
+
+// Collects the binary status frame, the frame is dropped if it does not fit.
+static void telemetryWrite (const char *s)
+{
+    size_t length = strlen(s);
+
+    if(udpSession.tx_length + length <= UDP_TELEMETRY_SIZE) {
+        memcpy(&udpSession.tx_buf[udpSession.tx_length], s, length);
+        udpSession.tx_length += length;
+    } else
+        udpSession.tx_length = UDP_TELEMETRY_SIZE + 1;
+}
+
+// Formats the binary status frame for UDPRealtimePoll() to send.
+static void telemetry (uint_fast16_t state)
+{
+    if(!udpSession.peer_valid || udpSession.tx_ready)
+        return;
+
+    if(hal.get_elapsed_ticks() - udpSession.peer_ms > UDP_PEER_TIMEOUT) {
+        udpSession.peer_valid = false;
+        return;
+    }
+
+    stream_write_ptr write = hal.stream.write, write_all = hal.stream.write_all;
+
+    udpSession.tx_length = 0;
+    hal.stream.write = hal.stream.write_all = telemetryWrite;
+
+    report_realtime_status_binary();
+
+    hal.stream.write = write;
+    hal.stream.write_all = write_all;
+
+    udpSession.tx_ready = udpSession.tx_length > 0 && udpSession.tx_length <= UDP_TELEMETRY_SIZE;
+}
+
+static rt_task_t telemetry_task = {
+    .name = "UDP telemetry",
+    .fn = telemetry,
+    .period = UDP_TELEMETRY_INTERVAL
+};
+
+#endif // ENABLE_BINARY_STATUS_REPORT
+
+void UDPRealtimeListen (uint16_t port)
+{
+    if(udpSession.pcb != NULL)
+        UDPRealtimeClose();
+
+    if((udpSession.pcb = udp_new()) != NULL) {
+        udp_bind(udpSession.pcb, IP_ADDR_ANY, port);
+        udp_recv(udpSession.pcb, udpReceive, NULL);
+#ifdef ENABLE_BINARY_STATUS_REPORT
+        protocol_add_rt_task(&telemetry_task);
+#endif
+    }
+}
+
+void UDPRealtimeClose (void)
+{
+#ifdef ENABLE_BINARY_STATUS_REPORT
+    protocol_remove_rt_task(&telemetry_task);
+#endif
+
+    if(udpSession.pcb != NULL) {
+        udp_remove(udpSession.pcb);
+        udpSession.pcb = NULL;
+    }
+
+    udpSession.peer_valid = udpSession.tx_ready = false;
+}
+
+//
+// Sends pending telemetry, to be called from the same context as TCPStreamPoll()
+//
+void UDPRealtimePoll (void)
+{
+    if(udpSession.tx_ready) {
+
+        struct pbuf *p;
+
+        if(udpSession.pcb && (p = pbuf_alloc(PBUF_TRANSPORT, udpSession.tx_length, PBUF_RAM)) != NULL) {
+            memcpy(p->payload, udpSession.tx_buf, udpSession.tx_length);
+            udp_sendto(udpSession.pcb, p, &udpSession.peer_addr, udpSession.peer_port);
+            pbuf_free(p);
+        }
+
+        udpSession.tx_ready = false;
+    }
+}
+
+#endif
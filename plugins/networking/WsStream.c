@@ -51,6 +51,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "strutils.h"
 
 #include "grbl/grbl.h"
+#include "grbl/protocol.h"
 
 //#define WSDEBUG
 
@@ -268,6 +269,33 @@ bool WsStreamRxInsert (char c)
     return !streamSession.rxbuf.overflow;
 }
 
+// Adds a block of data to the input buffer, the caller must ensure there is room for it.
+static void WsStreamRxInsertBlock (const uint8_t *data, uint32_t len)
+{
+    uint_fast16_t run, chunk;
+
+    // discard input if MPG has taken over...
+    if(hal.stream.type != StreamType_MPG) while(len) {
+        if((run = protocol_plain_run(data, len))) {                                  // Characters that are not realtime commands
+            len -= run;                                                              // are copied as a block,
+            while(run) {                                                             // split at the buffer wrap
+                chunk = min(run, RX_BUFFER_SIZE - streamSession.rxbuf.head);
+                memcpy(&streamSession.rxbuf.data[streamSession.rxbuf.head], data, chunk);
+                streamSession.rxbuf.head = (streamSession.rxbuf.head + chunk) & (RX_BUFFER_SIZE - 1);
+                data += chunk;
+                run -= chunk;
+            }
+            continue;
+        }
+        len--;
+        if(!hal.stream.enqueue_realtime_command((char)*data)) {                      // If not a real time command
+            streamSession.rxbuf.data[streamSession.rxbuf.head] = (char)*data;        // add data to buffer
+            streamSession.rxbuf.head = (streamSession.rxbuf.head + 1) & (RX_BUFFER_SIZE - 1); // and update pointer
+        }
+        data++;
+    }
+}
+
 bool WsStreamPutC (const char c) {
 
     uint32_t next_head = (streamSession.txbuf.head + 1) & (TX_BUFFER_SIZE - 1);  // Get and update head pointer
@@ -770,7 +798,9 @@ static void WsConnectionHandler (ws_sessiondata_t *session)
 
 static bool WsCollectFrame (frame_header_t *header, uint8_t *payload, uint32_t len)
 {
-    if(header->payload_rem > len && header->payload_rem == header->payload_len) {
+    uint32_t offset = header->payload_len - header->payload_rem;
+
+    if(header->payload_rem > len && offset == 0) {
         if((header->frame = malloc(header->payload_len + header->idx)))
             memcpy(header->frame, &header->data, header->idx);
     }
@@ -778,11 +808,41 @@ static bool WsCollectFrame (frame_header_t *header, uint8_t *payload, uint32_t l
     header->payload_rem -= len;
 
     if(header->frame)
-        memcpy(header->frame + header->idx + header->payload_len - header->payload_rem - 1, payload, len);
+        memcpy(header->frame + header->idx + offset, payload, len);
 
     return header->frame != NULL;
 }
 
+// Unmasks payload data in place, phase is the payload offset of the first byte modulo 4.
+// Bytes are unmasked one by one until the data is word aligned, the bulk a word at a time.
+static void WsUnmask (uint8_t *data, uint32_t len, uint32_t mask, uint_fast8_t phase)
+{
+    uint8_t m[8];
+    uint32_t wmask;
+
+    memcpy(m, &mask, sizeof(uint32_t));
+    memcpy(&m[4], &mask, sizeof(uint32_t));
+
+    while(len && ((uintptr_t)data & 0x03)) {
+        *data++ ^= m[phase];
+        phase = (phase + 1) & 0x03;
+        len--;
+    }
+
+    memcpy(&wmask, &m[phase], sizeof(uint32_t)); // Mask rotated to the phase of the first aligned byte
+
+    while(len >= sizeof(uint32_t)) {
+        *(uint32_t *)data ^= wmask;
+        data += sizeof(uint32_t);
+        len -= sizeof(uint32_t);
+    }
+
+    while(len--) {
+        *data++ ^= m[phase];
+        phase = (phase + 1) & 0x03;
+    }
+}
+
 static uint32_t WsParse (ws_sessiondata_t *session, uint8_t *payload, uint32_t len)
 {
     bool frame_done = false;
@@ -843,7 +903,6 @@ static uint32_t WsParse (ws_sessiondata_t *session, uint8_t *payload, uint32_t l
 
                 if (session->header.payload_rem) {
 
-                    uint8_t *mask = (uint8_t *)&session->header.mask;
                     uint_fast16_t payload_len = session->header.payload_rem > plen ? plen : session->header.payload_rem;
 
                     session->start.token = session->header.payload_rem > plen ? fs.token : FRAME_NONE;
@@ -858,18 +917,19 @@ static uint32_t WsParse (ws_sessiondata_t *session, uint8_t *payload, uint32_t l
                     DEBUG_PRINT(uitoa(payload_len));
                     DEBUG_PRINT("\r\n");
 */
-                    // Unmask and add data to input buffer
-                    uint_fast16_t i = session->header.rx_index;
-                    session->rxbuf.overflow = false;
-
-                    while (payload_len--) {
-                        if(!WsStreamRxInsert(*payload++ ^ mask[i % 4]))
-                            break; // If overflow pend buffering rest of data until next polling
-                        plen--;
-                        i++;
-                    }
+                    // Unmask and add as much data as there is room for to input buffer
+                    uint_fast16_t room = WsStreamRxFree();
+
+                    if((session->rxbuf.overflow = payload_len > room))
+                        payload_len = room; // Pend buffering rest of data until next polling
+
+                    if(session->header.masked)
+                        WsUnmask(payload, payload_len, session->header.mask, session->header.rx_index & 0x03);
+
+                    WsStreamRxInsertBlock(payload, payload_len);
 
-                    session->header.rx_index = i;
+                    plen -= payload_len;
+                    session->header.rx_index += payload_len;
                     frame_done = (session->header.payload_rem = session->header.payload_len - session->header.rx_index) == 0;
                 }
                 break;
@@ -16,8 +16,22 @@
 #endif
 
 #define SOCKET_TIMEOUT 0
+
+// Set to 1 to read Telnet input directly from the received packet buffers instead of copying it to the
+// stream receive buffer. Received data is then acknowledged when read so TCP windowing provides flow control.
+#ifndef TCP_STREAM_ZERO_COPY
+#define TCP_STREAM_ZERO_COPY 0
+#endif
 #define TCP_SLOW_INTERVAL 500
 
+// Number of read-only Telnet sessions (observers) accepted in addition to the session owning the stream.
+// Observers get a copy of all output, input is discarded except for status report requests.
+// Output to an observer is dropped, up to the end of the line, when its TX buffer is full so a slow
+// observer cannot hold up the owner. Each observer adds a TX buffer of TX_BUFFER_SIZE bytes.
+#ifndef TELNET_MAX_OBSERVERS
+#define TELNET_MAX_OBSERVERS 0
+#endif
+
 //*****************************************************************************
 
 #ifdef ARDUINO
@@ -34,6 +48,15 @@
 #include "WsSTream.h"
 #endif
 
+// Set to 1 to enable the UDP realtime command and telemetry channel, see UDPRealtime.c.
+#ifndef UDP_REALTIME_ENABLE
+#define UDP_REALTIME_ENABLE 0
+#endif
+
+#if UDP_REALTIME_ENABLE
+#include "UDPRealtime.h"
+#endif
+
 //*****************************************************************************
 //
 // Ensure that AUTOIP COOP option is configured correctly.
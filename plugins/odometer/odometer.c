@@ -51,42 +51,29 @@ static bool odometer_changed = false;
 static uint32_t odometers_address, odometers_address_prv;
 static odometer_data_t odometers, odometers_prv;
 static nvs_io_t nvs;
-static stepper_pulse_start_ptr stepper_pulse_start;
+static on_block_completed_ptr on_block_completed;
 static on_unknown_sys_command_ptr on_unknown_sys_command;
 static on_state_change_ptr on_state_change;
 static spindle_set_state_ptr spindle_set_state_;
 static settings_changed_ptr settings_changed;
 static on_report_options_ptr on_report_options;
 
-static void stepperPulseStart (stepper_t *stepper)
+// Accumulates the step counts of planner blocks as they are queued for execution,
+// keeps odometer bookkeeping out of the step pulse interrupt.
+// NOTE: may be called from the segment prep interrupt.
+static void onBlockCompleted (plan_block_t *block)
 {
-    odometer_changed = true;
-
-    if(stepper->step_outbits.x)
-        steps[X_AXIS]++;
-
-    if(stepper->step_outbits.y)
-        steps[Y_AXIS]++;
-
-    if(stepper->step_outbits.z)
-        steps[Z_AXIS]++;
+    uint_fast8_t idx = N_AXIS;
 
-#ifdef A_AXIS
-    if(stepper->step_outbits.a)
-        steps[A_AXIS]++;
-#endif
-
-#ifdef B_AXIS
-    if(stepper->step_outbits.b)
-        steps[B_AXIS]++;
-#endif
+    odometer_changed = true;
 
-#ifdef C_AXIS
-    if(stepper->step_outbits.b)
-        steps[C_AXIS]++;
-#endif
+    do {
+        idx--;
+        steps[idx] += block->steps[idx];
+    } while(idx);
 
-    stepper_pulse_start(stepper);
+    if(on_block_completed)
+        on_block_completed(block);
 }
 
 void onStateChanged (uint_fast16_t state)
@@ -103,6 +90,8 @@ void onStateChanged (uint_fast16_t state)
         odometer_changed = false;
         odometers.motors += (hal.get_elapsed_ticks() - ms);
 
+        st_prep_lock(true);
+
         do {
             if(steps[--idx]) {
                 odometers.distance[idx] += (float)steps[idx] / settings.axis[idx].steps_per_mm;
@@ -110,6 +99,8 @@ void onStateChanged (uint_fast16_t state)
             }
         } while(idx);
 
+        st_prep_lock(false);
+
         nvs.memcpy_to_nvs(odometers_address, (uint8_t *)&odometers, sizeof(odometer_data_t), true);
     }
 
@@ -148,11 +139,6 @@ static void onSettingsChanged (settings_t *settings)
         spindle_set_state_ = hal.spindle.set_state;
         hal.spindle.set_state = onSpindleSetState;
     }
-
-    if(hal.stepper.pulse_start != stepperPulseStart) {
-        stepper_pulse_start = hal.stepper.pulse_start;
-        hal.stepper.pulse_start = stepperPulseStart;
-    }
 }
 
 static void odometer_data_reset (bool backup)
@@ -217,7 +203,7 @@ static status_code_t commandExecute (uint_fast16_t state, char *line, char *lcli
 static void onReportOptions (void)
 {
     on_report_options();
-    hal.stream.write("[PLUGIN:ODOMETERS v0.02]"  ASCII_EOL);
+    hal.stream.write("[PLUGIN:ODOMETERS v0.03]"  ASCII_EOL);
 }
 
 static void odometer_warning1 (uint_fast16_t state)
@@ -261,8 +247,8 @@ void odometer_init()
         spindle_set_state_ = hal.spindle.set_state;
         hal.spindle.set_state = onSpindleSetState;
 
-        stepper_pulse_start = hal.stepper.pulse_start;
-        hal.stepper.pulse_start = stepperPulseStart;
+        on_block_completed = grbl.on_block_completed;
+        grbl.on_block_completed = onBlockCompleted;
     }
 }
 
@@ -49,6 +49,13 @@
 #define PLASMA_VOLTAGE_PORT       0
 #define PLASMA_FEED_OVERRIDE_PORT 3
 
+// Period of the PID control loop in microseconds, run from the step interrupt in modes 0 and 1.
+// NOTE: the arc voltage is read from the step interrupt, the driver must either read the ADC
+//       immediately or return the latest conversion, eg. from a DMA buffer.
+#ifndef PLASMA_THC_PID_PERIOD
+#define PLASMA_THC_PID_PERIOD 1000
+#endif
+
 typedef union {
     uint16_t value;
     struct {
@@ -81,6 +88,9 @@ static void state_vad_lock (void);
 
 static uint32_t thc_delay = 0;
 static pidf_t pid;
+static float z_velocity, z_steps, pid_time;         // Z correction velocity in steps/s, fractional steps and time since last PID update
+static float z_target_velocity;                     // Z correction velocity from the PID loop in steps/s
+static float z_steps_per_mm, z_max_rate, z_accel;   // Z axis steps/mm, max rate in steps/s and acceleration in steps/s^2
 static void (*volatile stateHandler)(void) = state_idle;
 static driver_reset_ptr driver_reset = NULL;
 static spindle_set_state_ptr spindle_set_state_ = NULL;
@@ -100,6 +110,12 @@ static void pause_on_error (void)
     protocol_execute_realtime();                    // Execute...
 }
 
+static void thc_pid_reset (void)
+{
+    pidf_reset(&pid);
+    pid_time = z_velocity = z_target_velocity = z_steps = 0.0f;
+}
+
 static void digital_out (uint8_t portnum, bool on)
 {
     switch(portnum) {
@@ -107,8 +123,11 @@ static void digital_out (uint8_t portnum, bool on)
         case PLASMA_THC_DISABLE_PORT:
             if(!(thc.enabled = !on))
                 stateHandler = state_idle;
-            else if(thc.arc_ok)
+            else if(thc.arc_ok) {
+                if(plasma.mode != Plasma_mode2)
+                    thc_pid_reset();
                 stateHandler = plasma.mode == Plasma_mode2 ? state_thc_adjust : state_thc_pid;
+            }
             break;
 
         case PLASMA_TORCH_DISABLE_PORT:
@@ -162,7 +181,7 @@ static void state_thc_delay (void)
         if(plasma.mode == Plasma_mode2)
             stateHandler = state_thc_adjust;
         else {
-            pidf_reset(&pid);
+            thc_pid_reset();
             set_target_voltage((float)port.wait_on_input(false, PLASMA_VOLTAGE_PORT, WaitMode_Immediate, 0.0f) * plasma.arc_voltage_scale);
             stateHandler = state_vad_lock;
             stateHandler();
@@ -183,39 +202,82 @@ static void state_thc_adjust (void)
         pause_on_error();
 }
 
+// Returns true if the motion being prepped by the step generator ends below the VAD threshold speed and the
+// deceleration to it is about to start, ie. the remaining distance to prep is within the deceleration distance.
+// Since prep runs ahead of execution THC is locked before the deceleration begins and not after the machine has slowed.
+static bool vad_lookahead (void)
+{
+    float exit_speed_sqr, nominal_speed;
+    plan_block_t *block = plan_get_current_block();
+
+    if(block == NULL)
+        return true; // End of motion
+
+    if((exit_speed_sqr = plan_get_exec_block_exit_speed_sqr()) >= fr_thr_vad * fr_thr_vad)
+        return false;
+
+    nominal_speed = plan_compute_profile_nominal_speed(block);
+
+    return block->millimeters <= (nominal_speed * nominal_speed - exit_speed_sqr) / (2.0f * block->acceleration);
+}
+
 static void state_vad_lock (void)
 {
-    if((thc.active = fr_actual >= fr_thr_99))
+    if((thc.active = fr_actual >= fr_thr_99) && !(thc.velocity_lock = vad_lookahead())) {
+        thc_pid_reset();
         stateHandler = state_thc_pid;
+    }
 }
 
+// Supervises the PID loop run by thc_pid_update() from the step interrupt.
 static void state_thc_pid (void)
 {
-    if(!(thc.active = fr_actual >= fr_thr_vad)) {
+    if(!(thc.active = fr_actual >= fr_thr_vad) || (thc.velocity_lock = vad_lookahead())) {
         stateHandler = state_vad_lock;
         return;
     }
 
-    if((thc.arc_ok = port.wait_on_input(true, PLASMA_ARC_OK_PORT, WaitMode_Immediate, 0.0f) == 1)) {
+    if(!(thc.arc_ok = port.wait_on_input(true, PLASMA_ARC_OK_PORT, WaitMode_Immediate, 0.0f) == 1))
+        pause_on_error();
+}
+
+/* end THC state machine */
+
+// PID control loop, called from the step interrupt while in state_thc_pid.
+// The PID output is the Z correction velocity in mm/min, deviations within the threshold are ignored.
+// Z steps are output at the correction velocity, ramped by the Z axis acceleration, as an offset to the
+// programmed motion at the rate of the step interrupt.
+static void thc_pid_update (stepper_t *stepper)
+{
+    float dt = (float)stepper->exec_segment->cycles_per_tick / (float)hal.f_step_timer, dv;
+
+    if((pid_time += dt) >= (float)PLASMA_THC_PID_PERIOD * 1e-6f) {
 
         arc_voltage = (float)port.wait_on_input(false, PLASMA_VOLTAGE_PORT, WaitMode_Immediate, 0.0f) * plasma.arc_voltage_scale;
 
-        if(arc_voltage >= arc_voltage_high)
-            hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){Z_AXIS_BIT});
-        else if(arc_voltage <= arc_voltage_low)
-            hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){0});
+        z_target_velocity = pidf(&pid, arc_vref, arc_voltage >= arc_voltage_high || arc_voltage <= arc_voltage_low ? arc_voltage : arc_vref, pid_time) * z_steps_per_mm / 60.0f;
+        z_target_velocity = max(min(z_target_velocity, z_max_rate), -z_max_rate);
+        pid_time = 0.0f;
+    }
 
-    } else
-        pause_on_error();
-/*
-    if(arc_voltage < arc_voltage_low || arc_voltage > arc_voltage_high) {
-        float err = pidf(&pid, arc_vref, arc_voltage, 1.0f);
-        // Move Z
+    if((dv = z_target_velocity - z_velocity) != 0.0f) {
+        float dv_max = z_accel * dt;
+        z_velocity += max(min(dv, dv_max), -dv_max);
     }
-    */
-}
 
-/* end THC state machine */
+    // At most one step is output per interrupt, the remainder is limited so that it does not accumulate.
+    z_steps = max(min(z_steps + z_velocity * dt, 2.0f), -2.0f);
+
+    if(z_steps >= 1.0f) {
+        z_steps -= 1.0f;
+        sys_position[Z_AXIS]++;
+        hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){0});
+    } else if(z_steps <= -1.0f) {
+        z_steps += 1.0f;
+        sys_position[Z_AXIS]--;
+        hal.stepper.output_step((axes_signals_t){Z_AXIS_BIT}, (axes_signals_t){Z_AXIS_BIT});
+    }
+}
 
 void onExecuteRealtime (uint_fast16_t state)
 {
@@ -261,7 +323,7 @@ static void arcSetState (spindle_state_t state, float rpm)
         if(plasma.pause_at_end > 0.0f)
             delay_sec(plasma.pause_at_end, DelayMode_Dwell);
         spindle_set_state_(state, rpm);
-        thc.torch_on = thc.arc_ok = thc.enabled = Off;
+        thc.torch_on = thc.arc_ok = thc.enabled = thc.velocity_lock = Off;
         stateHandler = state_idle;
     } else {
         uint_fast8_t retries = plasma.arc_retries;
@@ -307,6 +369,9 @@ static void stepperPulseStart (stepper_t *stepper)
     }
 
     stepper_pulse_start(stepper);
+
+    if(stateHandler == state_thc_pid && thc.arc_ok)
+        thc_pid_update(stepper);
 }
 
 // Reclaim entry points that may have been changed on settings change.
@@ -314,6 +379,11 @@ static void onSettingsChanged (settings_t *settings)
 {
     settings_changed(settings);
 
+    z_steps_per_mm = settings->axis[Z_AXIS].steps_per_mm;
+    z_max_rate = settings->axis[Z_AXIS].max_rate * z_steps_per_mm / 60.0f;
+    z_accel = settings->axis[Z_AXIS].acceleration * z_steps_per_mm / 3600.0f;
+    pidf_init(&pid, &plasma.pid);
+
     if(hal.spindle.set_state != arcSetState) {
         spindle_set_state_ = hal.spindle.set_state;
         hal.spindle.set_state = arcSetState;
@@ -483,7 +553,7 @@ static void plasma_settings_report (setting_type_t setting)
         case Setting_THC_Threshold:
             report_float_setting(setting, plasma.thc_threshold, 1);
             break;
-/*
+
         case Setting_THC_PGain:
             report_float_setting(setting, plasma.pid.p_gain, 1);
             break;
@@ -495,7 +565,7 @@ static void plasma_settings_report (setting_type_t setting)
         case Setting_THC_DGain:
             report_float_setting(setting, plasma.pid.d_gain, 3);
             break;
-*/
+
         case Setting_THC_VADThreshold:
             report_uint_setting(setting, (uint32_t)plasma.vad_threshold);
             break;
@@ -604,6 +674,7 @@ bool plasma_init (void)
 
                 memcpy(&port, &hal.port, sizeof(io_port_t));
                 hal.port.digital_out = digital_out;
+                hal.port.digital_out_mask = NULL; // Ports are claimed by digital_out(), outputs are set one at a time
                 hal.port.analog_out = analog_out;
                 hal.port.num_digital_out = max(port.num_digital_out, 3);
                 hal.port.num_analog_out = max(port.num_analog_out, 4);
@@ -642,6 +713,9 @@ bool plasma_init (void)
                 hal.driver_cap.spindle_at_speed = Off;
 
                 pidf_init(&pid, &plasma.pid);
+#ifdef ENABLE_PID_TELEMETRY
+                pidf_telemetry_register(&pid, "THC");
+#endif
             }
         }
     }
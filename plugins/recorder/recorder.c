@@ -0,0 +1,309 @@
+/*
+
+  recorder.c - machine data recorder, logs machine state to the SD card
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifdef ARDUINO
+#include "../driver.h"
+#else
+#include "driver.h"
+#endif
+
+#if RECORDER_ENABLE
+
+#if !SDCARD_ENABLE
+#error "Recorder plugin requires SD card support!"
+#endif
+
+#include <string.h>
+#include <stdio.h>
+
+#ifdef ARDUINO
+#include "../grbl/protocol.h"
+#include "../grbl/planner.h"
+#include "../grbl/stepper.h"
+#include "../sdcard/sdcard.h"
+#else
+#include "grbl/protocol.h"
+#include "grbl/planner.h"
+#include "grbl/stepper.h"
+#include "sdcard/sdcard.h"
+#endif
+
+#include "recorder.h"
+
+typedef enum {
+    Record_Padding = 0, // Fills the last block written before the file is synced, to be skipped by readers
+    Record_Header,      // Written when recording is started, axes holds the number of axes
+    Record_Sample,      // Periodic sample
+    Record_State        // State change
+} record_type_t;
+
+// Records are of fixed size so that a whole number of them fits in a block. The file is written in whole blocks only,
+// keeping writes sector aligned. All values are little endian, position is the machine position in mm.
+typedef union {
+    uint8_t data[64];
+    struct {
+        uint8_t type;
+        uint8_t axes;
+        uint16_t state;
+        uint32_t ms;
+        int32_t line_number;
+        float feed_rate;
+        float spindle_rpm;
+        uint8_t feed_override;
+        uint8_t rapid_override;
+        uint8_t spindle_override;
+        uint8_t reserved;
+        float position[N_AXIS];
+    };
+} record_t;
+
+#define RECORDS_PER_BLOCK (RECORDER_BLOCK_SIZE / sizeof(record_t))
+
+#if RECORDER_BLOCK_SIZE % 64 || RECORDER_BUFFER_SIZE % (RECORDER_BLOCK_SIZE / 64)
+#error "Recorder buffer size must be a multiple of the number of records per block!"
+#endif
+
+// Records are added at head and written from tail, both counters are free running so head - tail is the number of pending records.
+// The tail is only advanced by whole blocks, a block is thus always contiguous in the buffer.
+static struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    uint32_t written;
+    record_t data[RECORDER_BUFFER_SIZE];
+} buffer;
+
+static FIL file;
+static bool recording = false;
+static on_state_change_ptr on_state_change;
+static on_realtime_report_ptr on_realtime_report;
+static on_unknown_sys_command_ptr on_unknown_sys_command;
+static on_report_options_ptr on_report_options;
+
+PLUGIN_PERF_DEFINE(perf_execute, "REC_EXECUTE");
+
+static void record_add (record_type_t type)
+{
+    if(buffer.head - buffer.tail >= RECORDER_BUFFER_SIZE) {
+        buffer.dropped++;
+        return;
+    }
+
+    plan_block_t *block = plan_get_current_block();
+    record_t *record = &buffer.data[buffer.head % RECORDER_BUFFER_SIZE];
+
+    memset(record, 0, sizeof(record_t));
+
+    record->type = (uint8_t)type;
+    record->state = (uint16_t)sys.state;
+    record->ms = hal.get_elapsed_ticks();
+    record->line_number = block ? block->line_number : 0;
+    record->feed_rate = st_get_realtime_rate();
+    record->spindle_rpm = sys.spindle_rpm;
+    record->feed_override = sys.override.feed_rate;
+    record->rapid_override = sys.override.rapid_rate;
+    record->spindle_override = sys.override.spindle_rpm;
+    system_convert_array_steps_to_mpos(record->position, sys_position);
+
+    if(type == Record_Header)
+        record->axes = N_AXIS;
+
+    buffer.head++;
+}
+
+// Writes one block from the buffer, returns false on failure.
+static bool block_write (void)
+{
+    UINT bytes_written;
+
+    if(f_write(&file, &buffer.data[buffer.tail % RECORDER_BUFFER_SIZE], RECORDER_BLOCK_SIZE, &bytes_written) != FR_OK || bytes_written != RECORDER_BLOCK_SIZE)
+        return false;
+
+    buffer.tail += RECORDS_PER_BLOCK;
+    buffer.written += RECORDS_PER_BLOCK;
+
+    return true;
+}
+
+// Pads the last block and writes all pending records, then syncs the file.
+// NOTE: There is always room for the padding since the tail is block aligned.
+static bool recorder_flush (void)
+{
+    bool ok = true;
+
+    while(buffer.head % RECORDS_PER_BLOCK) {
+        memset(&buffer.data[buffer.head % RECORDER_BUFFER_SIZE], 0, sizeof(record_t));
+        buffer.head++;
+    }
+
+    while(ok && buffer.head != buffer.tail)
+        ok = block_write();
+
+    return ok && f_sync(&file) == FR_OK;
+}
+
+static void recorder_stop (void)
+{
+    if(recording) {
+        recording = false;
+        recorder_flush();
+        f_close(&file);
+    }
+}
+
+static void recorder_failed (uint_fast16_t state)
+{
+    report_message("Recorder: SD card write failed, recording stopped", Message_Warning);
+}
+
+// Samples at a fixed rate and writes whole blocks in idle slices: when the machine is not moving or
+// the planner buffer is full and no SD card read-ahead is pending, so the foreground is not needed for feeding the planner.
+// Writing is forced when the buffer is close to full.
+static void recorder_execute (uint_fast16_t state)
+{
+    uint32_t pending;
+    bool ok = true;
+
+    if(!recording)
+        return;
+
+    PLUGIN_PERF_START(perf_execute);
+
+    if(state & (STATE_CYCLE|STATE_HOLD|STATE_JOG|STATE_HOMING|STATE_SAFETY_DOOR|STATE_TOOL_CHANGE))
+        record_add(Record_Sample);
+
+    if((pending = buffer.head - buffer.tail) >= RECORDS_PER_BLOCK) {
+        if(!(state & (STATE_CYCLE|STATE_JOG|STATE_HOMING)) ||
+            (plan_check_full_buffer() && !sdcard_prefetch_pending()) ||
+             pending > RECORDER_BUFFER_SIZE - RECORDS_PER_BLOCK)
+            ok = block_write();
+    } else if(pending && state == STATE_IDLE)
+        ok = recorder_flush(); // Motion ended, commit the partial block to the card
+
+    PLUGIN_PERF_END(perf_execute);
+
+    if(!ok) {
+        recorder_stop();
+        protocol_enqueue_rt_command(recorder_failed);
+    }
+}
+
+static rt_task_t recorder_task = {
+    .name = "Recorder",
+    .fn = recorder_execute,
+    .period = RECORDER_SAMPLE_PERIOD
+};
+
+static bool recorder_start (void)
+{
+    if(recording)
+        return true;
+
+    if(sdcard_getfs() == NULL || f_open(&file, RECORDER_FILENAME, FA_WRITE|FA_OPEN_ALWAYS) != FR_OK)
+        return false;
+
+    // Append, keeping the file a whole number of blocks long.
+    if(f_lseek(&file, f_size(&file) - f_size(&file) % RECORDER_BLOCK_SIZE) != FR_OK) {
+        f_close(&file);
+        return false;
+    }
+
+    buffer.head = buffer.tail = 0;
+    buffer.dropped = buffer.written = 0;
+    recording = true;
+
+    record_add(Record_Header);
+
+    return true;
+}
+
+static void onStateChanged (uint_fast16_t state)
+{
+    if(recording)
+        record_add(Record_State);
+
+    if(on_state_change)
+        on_state_change(state);
+}
+
+static void onRealtimeReport (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    if(recording && report.all) {
+        char buf[26];
+        sprintf(buf, "|REC:%lu,%lu", (unsigned long)buffer.written, (unsigned long)buffer.dropped);
+        stream_write(buf);
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+static status_code_t commandExecute (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strncmp(&line[1], "REC", 3)) {
+
+        if(line[4] == '\0') {
+            char buf[50];
+            sprintf(buf, "RECORDER %s %lu,%lu", recording ? "ON" : "OFF", (unsigned long)buffer.written, (unsigned long)buffer.dropped);
+            report_message(buf, Message_Plain);
+            retval = Status_OK;
+        } else if(!strcmp(&line[4], "=ON"))
+            retval = recorder_start() ? Status_OK : Status_SDMountError;
+        else if(!strcmp(&line[4], "=OFF")) {
+            recorder_stop();
+            retval = Status_OK;
+        }
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+static void onReportOptions (void)
+{
+    on_report_options();
+    hal.stream.write("[PLUGIN:RECORDER v0.01]"  ASCII_EOL);
+}
+
+void recorder_init (void)
+{
+    if(hal.get_elapsed_ticks && protocol_add_rt_task(&recorder_task)) {
+
+        on_state_change = grbl.on_state_change;
+        grbl.on_state_change = onStateChanged;
+
+        on_realtime_report = grbl.on_realtime_report;
+        grbl.on_realtime_report = onRealtimeReport;
+
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = commandExecute;
+
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = onReportOptions;
+
+        PLUGIN_PERF_REGISTER(perf_execute);
+    }
+}
+
+#endif
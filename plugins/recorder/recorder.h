@@ -0,0 +1,48 @@
+/*
+
+  recorder.h - machine data recorder, logs machine state to the SD card
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+// Time between samples in milliseconds.
+#ifndef RECORDER_SAMPLE_PERIOD
+#define RECORDER_SAMPLE_PERIOD 100
+#endif
+
+// Number of records buffered in RAM, must be a multiple of the number of records per block.
+#ifndef RECORDER_BUFFER_SIZE
+#define RECORDER_BUFFER_SIZE 64
+#endif
+
+// Size of file writes in bytes, should match the SD card sector size.
+#ifndef RECORDER_BLOCK_SIZE
+#define RECORDER_BLOCK_SIZE 512
+#endif
+
+#ifndef RECORDER_FILENAME
+#define RECORDER_FILENAME "/recorder.bin"
+#endif
+
+void recorder_init (void);
+
+#endif
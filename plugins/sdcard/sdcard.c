@@ -34,6 +34,7 @@
 #ifdef ARDUINO
   #include "../grbl/report.h"
   #include "../grbl/protocol.h"
+  #include "../grbl/limits.h"
   #ifdef __IMXRT1062__
     #include "uSDFS.h"
     #define SDCARD_DEV "1:/"
@@ -42,6 +43,7 @@
 #else
   #include "grbl/report.h"
   #include "grbl/protocol.h"
+  #include "grbl/limits.h"
 #endif
 
 #ifdef __IMXRT1062__
@@ -58,6 +60,11 @@ const char *dev = "";
 #define UINT32FMT "%lu"
 #endif
 
+// Tokenized job files, created by $FC=<filename>, are only supported if FatFs is configured for write access.
+#if (defined(FF_FS_READONLY) && FF_FS_READONLY == 0) || (defined(_FS_READONLY) && _FS_READONLY == 0)
+#define SDCARD_COMPILE_ENABLE 1
+#endif
+
 #ifndef UINT32FMT
 #define UINT32FMT "%u"
 #endif
@@ -67,6 +74,49 @@ const char *dev = "";
 /* uses fatfs - http://www.elm-chan.org/fsw/ff/00index_e.html */
 
 #define MAX_PATHLEN 128
+
+// Size of each of the two read-ahead buffers, should be a multiple of the sector size (512 bytes).
+#ifndef SDCARD_READ_BUFFER_SIZE
+#define SDCARD_READ_BUFFER_SIZE 512
+#endif
+
+// Number of checkpoints in the line index used for resuming jobs by $F=<filename> L<line>, set to 0 to disable.
+// Each checkpoint holds a parser state snapshot, the index is allocated from the heap on first use.
+#ifndef SDCARD_INDEX_SIZE
+#define SDCARD_INDEX_SIZE 16
+#endif
+
+// Initial number of lines between checkpoints, doubled each time the index is full.
+#ifndef SDCARD_INDEX_INTERVAL
+#define SDCARD_INDEX_INTERVAL 1000
+#endif
+
+// Size in bytes of the directory cache used for file listings, set to 0 to disable. The cache is built when the card is mounted
+// and updated when files are added or deleted, listings fall back to scanning the card if the cache overflows.
+#ifndef SDCARD_DIR_CACHE_SIZE
+#define SDCARD_DIR_CACHE_SIZE 8192
+#endif
+
+// Set to 1 to check the whole job against the soft limits before it is started by $F=<filename>, requires soft limits enabled.
+// The job is parsed in check mode and rejected with error 15 (travel exceeded) if any motion, including arcs, is outside the limits.
+#ifndef SDCARD_TRAVEL_PRECHECK
+#define SDCARD_TRAVEL_PRECHECK 0
+#endif
+
+// Default number of files per page for paginated listings by $FL=<first>,<count>.
+#ifndef SDCARD_LIST_PAGE_SIZE
+#define SDCARD_LIST_PAGE_SIZE 20
+#endif
+
+// Tokenized job file format: the header followed by one record per non empty source line.
+// A record is a sequence of g-code words, each a letter followed by the value as a 4 byte float,
+// or a text token followed by the zero terminated source line, terminated by an end of line token.
+// Lines that cannot be tokenized, e.g. system commands and lines with messages, are stored as text.
+#define TOKEN_FILE_HEADER "GRBLTOK1"
+#define TOKEN_FILE_HEADER_LENGTH 8
+#define TOKEN_TEXT 0x01
+#define TOKEN_EOL '\n'
+#define TOKEN_DECIMALS 5
 #define LCAPS(c) ((c >= 'A' && c <= 'Z') ? c | 0x20 : c)
 
 #if FF_USE_LFN
@@ -81,6 +131,7 @@ char const *const filetypes[] = {
     "text",
     "tap",
     "ngc",
+    "gct",
     ""
 };
 
@@ -101,8 +152,18 @@ typedef struct
     size_t pos;
     uint32_t line;
     uint8_t eol;
+    bool eof;                   // No more data to be read from file to buffers
+    bool tokenized;             // File is a tokenized job file
 } file_t;
 
+typedef struct
+{
+    bool ready;                 // Buffer has been filled and may be consumed
+    UINT length;                // Number of bytes in buffer
+    UINT idx;                   // Index of next byte to be consumed
+    char data[SDCARD_READ_BUFFER_SIZE];
+} file_buffer_t;
+
 static file_t file = {
     .fs = NULL,
     .handle = NULL,
@@ -110,6 +171,44 @@ static file_t file = {
     .pos = 0
 };
 
+static file_buffer_t rdbuf[2];
+static uint_fast8_t rdbuf_active = 0;
+static struct {
+    uint_fast16_t idx;
+    char data[LINE_BUFFER_SIZE + 1];
+} tline = {0}; // Line decoded from a tokenized job file
+#if SDCARD_INDEX_SIZE
+typedef struct {
+    uint32_t line;              // Number of the line starting at the checkpoint
+    size_t pos;                 // File position of the line
+    parser_state_t state;       // Parser state before the line is executed
+} file_checkpoint_t;
+
+static struct {
+    char name[50];
+    size_t size;
+    uint32_t interval;
+    uint_fast16_t count;
+    file_checkpoint_t *checkpoint;
+} findex = {0}; // Line index of the last file resumed
+#endif
+#if SDCARD_DIR_CACHE_SIZE
+// Directory cache records are packed: path length including terminator, file status, size (4 bytes) and path.
+#define DIR_RECORD_HEADER 6
+
+static struct {
+    bool valid;
+    uint32_t length;            // Number of bytes used
+    uint32_t count;             // Number of files
+    uint8_t *data;
+} dcache = {0};
+#endif
+static struct {
+    uint32_t first;
+    uint32_t count;
+    uint32_t total;
+    bool paged;
+} listing;
 static bool frewind = false;
 static io_stream_t active_stream;
 static driver_reset_ptr driver_reset;
@@ -190,8 +289,12 @@ static inline char *get_name (FILINFO *file)
 #endif
 }
 
-static FRESULT scan_dir (char *path, uint_fast8_t depth, char *buf)
+typedef bool (*on_file_ptr)(const char *filename, uint32_t size, file_status_t status, char *buf);
+
+static FRESULT scan_dir (char *path, uint_fast8_t depth, char *buf, on_file_ptr on_file)
 {
+    static char filename[MAX_PATHLEN];
+
 #if defined(ESP_PLATFORM)
     FF_DIR dir;
 #else
@@ -219,12 +322,17 @@ static FRESULT scan_dir (char *path, uint_fast8_t depth, char *buf)
         subdirs |= fno.fattrib & AM_DIR;
 
         if(!(fno.fattrib & AM_DIR) && (status = allowed(get_name(&fno), true)) != Filename_Filtered) {
-            sprintf(buf, "[FILE:%s/%s|SIZE:" UINT32FMT "%s]" ASCII_EOL, path, get_name(&fno), (uint32_t)fno.fsize, status == Filename_Invalid ? "|UNUSABLE" : "");
-            hal.stream.write(buf);
+            if(strlen(path) + strlen(get_name(&fno)) > (MAX_PATHLEN - 2))
+                continue;
+            sprintf(filename, "%s/%s", path, get_name(&fno));
+            if(!on_file(filename, (uint32_t)fno.fsize, status, buf)) {
+                res = FR_NOT_ENOUGH_CORE;
+                break;
+            }
         }
     }
 
-    if((subdirs = (subdirs && --depth)))
+    if((subdirs = (res == FR_OK && subdirs && --depth)))
         f_readdir(&dir, NULL); // Rewind
 
     // Pass 2: Scan directories
@@ -238,7 +346,7 @@ static FRESULT scan_dir (char *path, uint_fast8_t depth, char *buf)
             if(pathlen + strlen(get_name(&fno)) > (MAX_PATHLEN - 1))
                 break;
             sprintf(&path[pathlen], "/%s", get_name(&fno));
-            if((res = scan_dir(path, depth, buf)) != FR_OK)
+            if((res = scan_dir(path, depth, buf, on_file)) != FR_OK)
                 break;
             path[pathlen] = '\0';
         }
@@ -251,6 +359,99 @@ static FRESULT scan_dir (char *path, uint_fast8_t depth, char *buf)
     return res;
 }
 
+#if SDCARD_DIR_CACHE_SIZE
+
+static inline uint8_t *dir_cache_next (uint8_t *record)
+{
+    return record + DIR_RECORD_HEADER + *record;
+}
+
+static bool dir_cache_insert (const char *filename, uint32_t size, file_status_t status, char *buf)
+{
+    uint8_t *record = dcache.data + dcache.length;
+    size_t len = strlen(filename) + 1;
+
+    if(!dcache.valid || dcache.length + DIR_RECORD_HEADER + len > SDCARD_DIR_CACHE_SIZE)
+        return dcache.valid = false;
+
+    record[0] = (uint8_t)len;
+    record[1] = (uint8_t)status;
+    memcpy(&record[2], &size, sizeof(uint32_t));
+    memcpy(&record[DIR_RECORD_HEADER], filename, len);
+
+    dcache.length += DIR_RECORD_HEADER + len;
+    dcache.count++;
+
+    return true;
+}
+
+// Scans the card and caches the file list, the cache is left invalid if the list does not fit.
+static void dir_cache_build (void)
+{
+    char path[MAX_PATHLEN] = ""; // NB! also used as work area when recursing directories
+
+    if(dcache.data == NULL)
+        dcache.data = malloc(SDCARD_DIR_CACHE_SIZE);
+
+    dcache.length = dcache.count = 0;
+
+    if((dcache.valid = dcache.data != NULL) && scan_dir(path, 10, NULL, dir_cache_insert) != FR_OK)
+        dcache.valid = false;
+}
+
+// Removes a file, or all files in a directory, from the directory cache.
+void sdcard_dir_cache_remove (const char *filename)
+{
+    uint8_t *record = dcache.data, *next;
+    size_t len = strlen(filename);
+    char *name;
+
+    if(!dcache.valid)
+        return;
+
+    while(record < dcache.data + dcache.length) {
+        next = dir_cache_next(record);
+        name = (char *)&record[DIR_RECORD_HEADER];
+        if(!strncmp(name, filename, len) && (name[len] == '\0' || name[len] == '/')) {
+            memmove(record, next, dcache.data + dcache.length - next);
+            dcache.length -= next - record;
+            dcache.count--;
+        } else
+            record = next;
+    }
+}
+
+// Adds or updates a file in the directory cache, files filtered from listings are ignored.
+void sdcard_dir_cache_add (const char *filename, uint32_t size)
+{
+    char name[MAX_PATHLEN];
+    const char *leafname = strrchr(filename, '/');
+    file_status_t status = allowed((char *)(leafname ? leafname + 1 : filename), true);
+
+    if(!dcache.valid || status == Filename_Filtered || strlen(filename) > MAX_PATHLEN - 2)
+        return;
+
+    *name = '\0';
+    if(*filename != '/')
+        strcpy(name, "/");
+    strcat(name, filename);
+
+    sdcard_dir_cache_remove(name);
+    dir_cache_insert(name, size, status, NULL);
+}
+
+#else
+
+void sdcard_dir_cache_add (const char *filename, uint32_t size)
+{
+}
+
+void sdcard_dir_cache_remove (const char *filename)
+{
+}
+
+#endif // SDCARD_DIR_CACHE_SIZE
+
 static void file_close (void)
 {
     if(file.handle) {
@@ -259,6 +460,52 @@ static void file_close (void)
     }
 }
 
+// Fills a read-ahead buffer with the next block of the file
+static void file_buffer_fill (file_buffer_t *buffer)
+{
+    buffer->idx = buffer->length = 0;
+
+    if(!file.eof && (f_read(file.handle, buffer->data, sizeof(buffer->data), &buffer->length) != FR_OK || buffer->length < sizeof(buffer->data)))
+        file.eof = true;
+
+    buffer->ready = true;
+}
+
+// Discards read-ahead data and fills the first buffer from the current file position.
+// When rewound to the start of the file the tokenized file header is skipped if present.
+static void file_buffers_reset (bool rewind)
+{
+    file.eof = false;
+    rdbuf_active = 0;
+    rdbuf[1].ready = false;
+    file_buffer_fill(&rdbuf[0]);
+
+    tline.data[tline.idx = 0] = '\0';
+
+    if(rewind && (file.tokenized = rdbuf[0].length >= TOKEN_FILE_HEADER_LENGTH && !memcmp(rdbuf[0].data, TOKEN_FILE_HEADER, TOKEN_FILE_HEADER_LENGTH)))
+        rdbuf[0].idx = file.pos = TOKEN_FILE_HEADER_LENGTH;
+}
+
+// Background refill of the read-ahead buffer not being consumed, called by the foreground process when idle or waiting
+static void file_prefetch (uint_fast16_t state)
+{
+    if(file.handle && !rdbuf[rdbuf_active ^ 1].ready)
+        file_buffer_fill(&rdbuf[rdbuf_active ^ 1]);
+}
+
+// Returns true while a job is streaming and the read-ahead buffer not being consumed is still to be refilled.
+// Used by uploads to the card to hold off writes until the job has its next block of data.
+bool sdcard_prefetch_pending (void)
+{
+    return file.handle != NULL && !rdbuf[rdbuf_active ^ 1].ready;
+}
+
+static rt_task_t prefetch_task = {
+    .name = "SD prefetch",
+    .fn = file_prefetch,
+    .period = 1
+};
+
 static bool file_open (char *filename)
 {
     if(file.handle)
@@ -270,6 +517,7 @@ static bool file_open (char *filename)
         file.pos = 0;
         file.line = 0;
         file.eol = false;
+        file_buffers_reset(true);
         char *leafname = strrchr(filename, '/');
         strncpy(file.name, leafname ? leafname + 1 : filename, sizeof(file.name));
         file.name[sizeof(file.name) - 1] = '\0';
@@ -278,28 +526,138 @@ static bool file_open (char *filename)
     return file.handle != NULL;
 }
 
+// Returns next byte from the read-ahead buffers, -1 at end of file. FatFs is only called on
+// buffer boundaries if the background refill has not been completed in time.
 static int16_t file_read (void)
 {
-    signed char c;
-    UINT count;
+    int16_t c;
+    file_buffer_t *buffer = &rdbuf[rdbuf_active];
+
+    if(buffer->idx >= buffer->length) {
+        buffer->ready = false;
+        buffer = &rdbuf[rdbuf_active ^= 1];
+        if(!buffer->ready)
+            file_buffer_fill(buffer);
+    }
 
-    if(f_read(file.handle, &c, 1, &count) == FR_OK && count == 1)
-        file.pos = f_tell(file.handle);
-    else
+    if(buffer->idx < buffer->length) {
+        c = (int16_t)(signed char)buffer->data[buffer->idx++];
+        file.pos++;
+    } else
         c = -1;
 
+    return c;
+}
+
+// Formats a word value with up to TOKEN_DECIMALS decimals, trailing zeros are removed.
+static char *token_ftoa (float value, char *s)
+{
+    char *start = s, *end;
+    uint32_t a, frac;
+
+    if(value < 0.0f) {
+        *s++ = '-';
+        value = -value;
+    }
+
+    a = (uint32_t)value;
+    if((frac = (uint32_t)((value - (float)a) * 100000.0f + 0.5f)) >= 100000) {
+        a++;
+        frac -= 100000;
+    }
+
+    strcpy(s, uitoa(a));
+    s += strlen(s);
+
+    if(frac) {
+        *s++ = '.';
+        end = s + TOKEN_DECIMALS;
+        while(end > s) {
+            *--end = '0' + frac % 10;
+            frac /= 10;
+        }
+        s += TOKEN_DECIMALS;
+        while(*(s - 1) == '0')
+            s--;
+    }
+
+    *s = '\0';
+
+    return start;
+}
+
+// Decodes the next record of a tokenized job file to a text line, returns false at end of file.
+static bool token_decode_line (void)
+{
+    int16_t c;
+    float value;
+    uint_fast16_t len = 0;
+    char *v, *s = tline.data, number[16];
+
+    while((c = file_read()) != -1 && c != TOKEN_EOL) {
+        if(c == TOKEN_TEXT) {
+            while((c = file_read()) != -1 && c != '\0') {
+                if(len < LINE_BUFFER_SIZE - 1)
+                    s[len++] = (char)c;
+            }
+        } else if(c >= 'A' && c <= 'Z') {
+            v = (char *)&value;
+            uint_fast8_t idx = sizeof(float);
+            do {
+                *v++ = (char)file_read();
+            } while(--idx);
+            token_ftoa(value, number);
+            if(len + strlen(number) < LINE_BUFFER_SIZE - 2) {
+                s[len++] = (char)c;
+                strcpy(&s[len], number);
+                len += strlen(number);
+            }
+        } else {
+            c = -1; // Corrupt file, end job
+            break;
+        }
+    }
+
+    if(c == -1 && len == 0)
+        return false;
+
+    s[len++] = '\n';
+    s[len] = '\0';
+    tline.idx = 0;
+
+    return true;
+}
+
+// Returns next character of the job file, decoded if the file is tokenized, -1 at end of file.
+static int16_t file_getc (void)
+{
+    int16_t c;
+
+    if(file.tokenized) {
+        if(tline.data[tline.idx] == '\0' && !token_decode_line())
+            c = -1;
+        else
+            c = (int16_t)tline.data[tline.idx++];
+    } else
+        c = file_read();
+
     if(c == '\r' || c == '\n')
         file.eol++;
     else
         file.eol = 0;
 
-    return (int16_t)c;
+    return c;
 }
 
 static bool sdcard_mount (void)
 {
 #ifdef __MSP432E401Y__
-    return SDFatFS_open(Board_SDFatFS0, 0) != NULL;
+    bool ok = SDFatFS_open(Board_SDFatFS0, 0) != NULL;
+  #if SDCARD_DIR_CACHE_SIZE
+    if(ok)
+        dir_cache_build();
+  #endif
+    return ok;
 #else
     if(file.fs == NULL)
   #ifdef __IMXRT1062__
@@ -323,15 +681,86 @@ static bool sdcard_mount (void)
         file.fs = NULL;
   #endif
 
+  #if SDCARD_DIR_CACHE_SIZE
+    if(file.fs)
+        dir_cache_build();
+  #endif
+
     return file.fs != NULL;
 #endif
 }
 
-static status_code_t sdcard_ls (char *buf)
+// Outputs a file in the current listing, paginated listings use the compact format [FL:<index>,<size>,<U if unusable>,<filename>].
+static bool list_file (const char *filename, uint32_t size, file_status_t status, char *buf)
+{
+    if(!listing.paged) {
+        sprintf(buf, "[FILE:%s|SIZE:" UINT32FMT "%s]" ASCII_EOL, filename, size, status == Filename_Invalid ? "|UNUSABLE" : "");
+        hal.stream.write(buf);
+    } else if(listing.total >= listing.first && listing.total - listing.first < listing.count) {
+        sprintf(buf, "[FL:" UINT32FMT "," UINT32FMT ",%s,%s]" ASCII_EOL, listing.total, size, status == Filename_Invalid ? "U" : "", filename);
+        hal.stream.write(buf);
+    }
+
+    listing.total++;
+
+    return true;
+}
+
+// Lists files from the directory cache if valid, else by scanning the card.
+// Paginated listings are terminated by [FILES:<first>,<count>,<total>].
+static status_code_t sdcard_ls (char *buf, bool paged, uint32_t first, uint32_t count)
 {
     char path[MAX_PATHLEN] = ""; // NB! also used as work area when recursing directories
+    status_code_t status = Status_OK;
+
+    listing.paged = paged;
+    listing.first = first;
+    listing.count = count;
+    listing.total = 0;
+
+#if SDCARD_DIR_CACHE_SIZE
+    if(dcache.valid) {
+        uint32_t size;
+        uint8_t *record = dcache.data;
+        while(record < dcache.data + dcache.length) {
+            memcpy(&size, &record[2], sizeof(uint32_t));
+            list_file((char *)&record[DIR_RECORD_HEADER], size, (file_status_t)record[1], buf);
+            record = dir_cache_next(record);
+        }
+    } else
+#endif
+    if(scan_dir(path, 10, buf, list_file) != FR_OK)
+        status = Status_SDFailedOpenDir;
 
-    return scan_dir(path, 10, buf) == FR_OK ? Status_OK : Status_SDFailedOpenDir;
+    if(status == Status_OK && paged) {
+        sprintf(buf, "[FILES:" UINT32FMT "," UINT32FMT "," UINT32FMT "]" ASCII_EOL, first, listing.total > first ? min(count, listing.total - first) : 0, listing.total);
+        hal.stream.write(buf);
+    }
+
+    return status;
+}
+
+// Parses the optional arguments of $FL[=<first>[,<count>]] and outputs the page.
+static status_code_t sdcard_ls_paged (char *args, char *buf)
+{
+    float value;
+    uint_fast8_t idx = 0;
+    uint32_t first = 0, count = SDCARD_LIST_PAGE_SIZE;
+
+    if(*args == '=') {
+        args++;
+        if(!read_float(args, &idx, &value) || value < 0.0f)
+            return Status_InvalidStatement;
+        first = (uint32_t)value;
+        if(args[idx] == ',') {
+            idx++;
+            if(!read_float(args, &idx, &value) || value < 1.0f)
+                return Status_InvalidStatement;
+            count = (uint32_t)value;
+        }
+    }
+
+    return args[idx] == '\0' ? sdcard_ls(buf, true, first, count) : Status_InvalidStatement;
 }
 
 static void sdcard_end_job (void)
@@ -347,6 +776,8 @@ static void sdcard_end_job (void)
     if(grbl.on_state_change == trap_state_change_request)
         grbl.on_state_change = state_change_requested;
 
+    protocol_remove_rt_task(&prefetch_task);
+
     memcpy(&hal.stream, &active_stream, sizeof(io_stream_t));   // Restore stream pointers
     hal.stream.reset_read_buffer();                             // and flush input buffer
     on_realtime_report = NULL;
@@ -367,7 +798,7 @@ static int16_t sdcard_read (void)
     if(file.handle) {
 
         if(sys.state == STATE_IDLE || (sys.state & (STATE_CYCLE|STATE_HOLD|STATE_CHECK_MODE)))
-            c = file_read();
+            c = file_getc();
 
         if(c == -1) { // EOF or error reading or grbl problem
             file_close();
@@ -454,6 +885,7 @@ static void sdcard_on_program_completed (program_flow_t program_flow)
         f_lseek(file.handle, 0);
         file.pos = file.line = 0;
         file.eol = false;
+        file_buffers_reset(true);
         hal.stream.read = await_cycle_start;
         if(grbl.on_state_change != trap_state_change_request) {
             state_change_requested = grbl.on_state_change;
@@ -474,10 +906,12 @@ static bool sdcard_suspend (bool suspend)
     if(suspend) {
         hal.stream.reset_read_buffer();
         hal.stream.read = active_stream.read;               // Restore normal stream input for tool change (jog etc)
+        hal.stream.read_block = active_stream.read_block;
         hal.stream.enqueue_realtime_command = active_stream.enqueue_realtime_command;
         grbl.report.status_message = report_status_message;  // as well as normal status messages reporting
     } else {
         hal.stream.read = sdcard_read;                      // Resume reading from SD card
+        hal.stream.read_block = NULL;
         hal.stream.enqueue_realtime_command = drop_input_stream;
         grbl.report.status_message = trap_status_report;     // and redirect status messages back to us
     }
@@ -486,6 +920,342 @@ static bool sdcard_suspend (bool suspend)
 }
 #endif
 
+// Strips whitespace and comments from a source line and converts it to uppercase, returns false if the line has a message.
+static bool line_strip (char *s, char *cline)
+{
+    char c;
+    bool comment = false, message = false;
+    uint_fast16_t idx = 0;
+
+    while((c = *s++)) {
+        if(comment)
+            comment = c != ')';
+        else if(c == '(') {
+            comment = true;
+            message = message || (CAPS(s[0]) == 'M' && CAPS(s[1]) == 'S' && CAPS(s[2]) == 'G' && s[3] == ',');
+        } else if(c == ';')
+            break;
+        else if(c > ' ' && idx < LINE_BUFFER_SIZE - 1)
+            cline[idx++] = CAPS(c);
+    }
+    cline[idx] = '\0';
+
+    return !message;
+}
+
+// Parses a line from the job file without executing it, system commands and program demarcation lines are skipped.
+static status_code_t file_parse_line (char *line)
+{
+    static char cline[LINE_BUFFER_SIZE];
+
+    while(*line && *line <= ' ')
+        line++;
+
+    if(*line == '$' || *line == '[' || *line == CMD_PROGRAM_DEMARCATION)
+        return Status_OK;
+
+    if(*line == '/') {
+        if(sys.flags.block_delete_enabled)
+            return Status_OK;
+        line++;
+    }
+
+    line_strip(line, cline);
+
+    return *cline ? gc_execute_block(cline, NULL) : Status_OK;
+}
+
+#if SDCARD_INDEX_SIZE
+
+// Adds a checkpoint for the line about to be read, when full every other checkpoint is dropped and the interval doubled.
+static void file_index_add (void)
+{
+    if(findex.count && findex.checkpoint[findex.count - 1].line >= file.line)
+        return;
+
+    if(findex.count == SDCARD_INDEX_SIZE) {
+        uint_fast16_t idx;
+        findex.interval <<= 1;
+        for(idx = 0; idx < SDCARD_INDEX_SIZE / 2; idx++)
+            memcpy(&findex.checkpoint[idx], &findex.checkpoint[idx * 2 + 1], sizeof(file_checkpoint_t));
+        findex.count = SDCARD_INDEX_SIZE / 2;
+        if(file.line % findex.interval)
+            return;
+    }
+
+    findex.checkpoint[findex.count].line = file.line;
+    findex.checkpoint[findex.count].pos = file.pos;
+    memcpy(&findex.checkpoint[findex.count].state, &gc_state, sizeof(parser_state_t));
+    findex.count++;
+}
+
+// Fast forwards the job file to the given line by parsing the lines before it in check mode, no motion is performed.
+// Parsing starts from the nearest preceding checkpoint in the index, checkpoints are added as lines are parsed.
+// NOTE: line numbers are the same as reported on errors and reset, the first line is line 0.
+static status_code_t file_seek_line (uint32_t line)
+{
+    static char buf[LINE_BUFFER_SIZE];
+
+    int16_t c;
+    uint_fast16_t idx, len = 0;
+    uint_fast16_t state = sys.state;
+    status_code_t status = Status_OK;
+    file_checkpoint_t *checkpoint = NULL;
+
+    if(findex.size != file.size || strcmp(findex.name, file.name)) {
+        strcpy(findex.name, file.name);
+        findex.size = file.size;
+        findex.interval = SDCARD_INDEX_INTERVAL;
+        findex.count = 0;
+    }
+
+    if(findex.checkpoint == NULL)
+        findex.checkpoint = malloc(sizeof(file_checkpoint_t) * SDCARD_INDEX_SIZE);
+
+    for(idx = 0; idx < findex.count && findex.checkpoint[idx].line <= line; idx++)
+        checkpoint = &findex.checkpoint[idx];
+
+    if(checkpoint) {
+        tool_data_t *tool = gc_state.tool;
+        uint32_t tool_pending = gc_state.tool_pending;
+        if(f_lseek(file.handle, checkpoint->pos) != FR_OK)
+            return Status_SDReadError;
+        file.pos = checkpoint->pos;
+        file.line = checkpoint->line;
+        file.eol = 2; // Line start, already counted
+        file_buffers_reset(false);
+        memcpy(&gc_state, &checkpoint->state, sizeof(parser_state_t));
+        gc_state.tool = tool;                   // Tool changes are not performed in check mode,
+        gc_state.tool_pending = tool_pending;   // keep current tool.
+    }
+
+    sys.state = STATE_CHECK_MODE;
+
+    while(status == Status_OK) {
+
+        if(file.eol == 1) {
+            file.line++;
+            file.eol = 2; // Line counted
+            if(findex.checkpoint && !(file.line % findex.interval))
+                file_index_add();
+        }
+
+        if(file.line >= line)
+            break;
+
+        if((c = file_getc()) == -1)
+            status = Status_InvalidStatement; // Line is beyond end of file
+        else if(c == '\r' || c == '\n') {
+            if(len) {
+                buf[len] = '\0';
+                status = file_parse_line(buf);
+                len = 0;
+            }
+        } else if(len < sizeof(buf) - 1)
+            buf[len++] = (char)c;
+        else
+            status = Status_Overflow;
+    }
+
+    sys.state = state;
+    gc_state.last_error = Status_OK;
+    gc_sync_position(); // Parser position is the machine position, the first motion is from there
+
+    if(status == Status_OK && state != STATE_CHECK_MODE) {
+        // Restore spindle and coolant state of the line about to be executed
+        if(!(spindle_sync(gc_state.modal.spindle, gc_state.spindle.rpm) && coolant_sync(gc_state.modal.coolant)))
+            status = Status_Reset;
+    }
+
+    return status;
+}
+
+#endif // SDCARD_INDEX_SIZE
+
+#if SDCARD_TRAVEL_PRECHECK
+
+// Parses the whole job file in check mode and checks all motion against the soft limits, the file is rewound when done.
+// The parser state is restored so that the job starts from the current state.
+static status_code_t file_check_travel (void)
+{
+    static char buf[LINE_BUFFER_SIZE];
+
+    int16_t c;
+    uint_fast16_t len = 0;
+    uint_fast16_t state = sys.state;
+    status_code_t status = Status_OK;
+    travel_extents_t extents;
+    parser_state_t *parser_state;
+
+    if(!settings.limits.flags.soft_enabled)
+        return Status_OK;
+
+    if((parser_state = malloc(sizeof(parser_state_t))) == NULL)
+        return Status_OK; // Not enough memory, soft limits are still checked when the job is run.
+
+    memcpy(parser_state, &gc_state, sizeof(parser_state_t));
+
+    sys.state = STATE_CHECK_MODE;
+    limits_travel_extents(&extents);
+
+    while(status == Status_OK && !extents.exceeded) {
+
+        if(file.eol == 1) {
+            file.line++;
+            file.eol = 2; // Line counted
+        }
+
+        if((c = file_getc()) == -1 || c == '\r' || c == '\n') {
+            if(len) {
+                buf[len] = '\0';
+                status = file_parse_line(buf);
+                len = 0;
+            }
+            if(c == -1)
+                break;
+        } else if(len < sizeof(buf) - 1)
+            buf[len++] = (char)c;
+        else
+            status = Status_Overflow;
+    }
+
+    limits_travel_extents(NULL);
+    sys.state = state;
+
+    memcpy(&gc_state, parser_state, sizeof(parser_state_t));
+    free(parser_state);
+    gc_state.last_error = Status_OK;
+
+    if(extents.exceeded) {
+        sprintf(buf, "[MSG:Travel exceeded at line " UINT32FMT "]" ASCII_EOL, file.line);
+        hal.stream.write(buf);
+        status = Status_TravelExceeded;
+    } else if(status != Status_OK) {
+        sprintf(buf, "[MSG:Travel check failed at line " UINT32FMT "]" ASCII_EOL, file.line);
+        hal.stream.write(buf);
+    }
+
+    // Rewind the file.
+    if(f_lseek(file.handle, 0) != FR_OK)
+        status = Status_SDReadError;
+
+    file.pos = 0;
+    file.line = 0;
+    file.eol = false;
+    file_buffers_reset(true);
+
+    return status;
+}
+
+#endif // SDCARD_TRAVEL_PRECHECK
+
+#if SDCARD_COMPILE_ENABLE
+
+static FIL tokfile;
+
+// Tokenizes a source line to a record, returns the record length.
+static uint_fast16_t token_encode_line (char *line, char *record)
+{
+    char c, *s = line, cline[LINE_BUFFER_SIZE];
+    bool text;
+    uint_fast8_t idx = 0;
+    uint_fast16_t len = 0;
+    float value;
+
+    while(*s && *s <= ' ')
+        s++;
+
+    // System and user commands, program demarcation and block delete lines are stored as text.
+    // Lines with messages are stored as text.
+    text = *s == '$' || *s == '[' || *s == '%' || *s == '/' || !line_strip(s, cline);
+
+    // Convert words, lines with anything else than letters followed by numbers are stored as text.
+    idx = 0;
+    while(!text && (c = cline[idx++])) {
+        if((text = c < 'A' || c > 'Z' || !read_float(cline, &idx, &value)))
+            break;
+        record[len++] = c;
+        memcpy(&record[len], &value, sizeof(float));
+        len += sizeof(float);
+    }
+
+    if(text) {
+        len = 0;
+        record[len++] = TOKEN_TEXT;
+        strcpy(&record[len], line);
+        len += strlen(line) + 1;
+    }
+
+    record[len++] = TOKEN_EOL;
+
+    return len;
+}
+
+// Creates a tokenized job file from the source file, the file name extension is replaced by .gct.
+static status_code_t sdcard_compile (char *filename)
+{
+    static char line[LINE_BUFFER_SIZE], record[LINE_BUFFER_SIZE * 3];
+
+    int16_t c;
+    UINT count;
+    uint_fast16_t len = 0;
+    char name[MAX_PATHLEN], *ext;
+    status_code_t status = Status_OK;
+
+    if(strlen(filename) + 5 > sizeof(name))
+        return Status_InvalidStatement;
+
+    strcpy(name, filename);
+    if((ext = strrchr(name, '.')) && !strchr(ext, '/'))
+        *ext = '\0';
+    strcat(name, ".gct");
+
+    if(!file_open(filename))
+        return Status_SDReadError;
+
+    if(file.tokenized || f_open(&tokfile, name, FA_WRITE|FA_CREATE_ALWAYS) != FR_OK) {
+        file_close();
+        return Status_SDReadError;
+    }
+
+    if(f_write(&tokfile, TOKEN_FILE_HEADER, TOKEN_FILE_HEADER_LENGTH, &count) != FR_OK)
+        status = Status_SDReadError;
+
+    // NOTE: Empty lines are skipped, these are not counted when reporting line numbers on errors.
+    while(status == Status_OK) {
+        if((c = file_read()) == -1 || c == '\n' || c == '\r') {
+            if(len) {
+                line[len] = '\0';
+                len = token_encode_line(line, record);
+                if(f_write(&tokfile, record, len, &count) != FR_OK || count != len)
+                    status = Status_SDReadError;
+                len = 0;
+            }
+            if(c == -1)
+                break;
+        } else if(len < sizeof(line) - 1)
+            line[len++] = (char)c;
+        else
+            status = Status_Overflow;
+    }
+
+    f_close(&tokfile);
+    file_close();
+
+    if(status != Status_OK)
+        f_unlink(name);
+#if SDCARD_DIR_CACHE_SIZE
+    else if(f_open(&tokfile, name, FA_READ) == FR_OK) {
+        sdcard_dir_cache_add(name, (uint32_t)f_size(&tokfile));
+        f_close(&tokfile);
+    }
+#endif
+
+    return status;
+}
+
+#endif // SDCARD_COMPILE_ENABLE
+
 static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline)
 {
     status_code_t retval = Status_Unhandled;
@@ -494,7 +1264,12 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
 
         case '\0':
             frewind = false;
-            retval = sdcard_ls(line); // (re)use line buffer for reporting filenames
+            retval = sdcard_ls(line, false, 0, 0); // (re)use line buffer for reporting filenames
+            break;
+
+        case 'L':
+            frewind = false;
+            retval = sdcard_ls_paged(&line[3], line); // Arguments are parsed before the line buffer is reused
             break;
 
         case 'M':
@@ -507,6 +1282,17 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
             retval = Status_OK;
             break;
 
+#if SDCARD_COMPILE_ENABLE
+        case 'C':
+            if(line[3] != '=')
+                retval = Status_InvalidStatement;
+            else if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
+                retval = Status_SystemGClock;
+            else
+                retval = sdcard_compile(&lcline[4]);
+            break;
+#endif
+
         case '<':
             if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
                 retval = Status_SystemGClock;
@@ -514,7 +1300,7 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
                 if(file_open(&lcline[3])) {
                     int16_t c;
                     char buf[2] = {0};
-                    while((c = file_read()) != -1) {
+                    while((c = file_getc()) != -1) {
                         buf[0] = (char)c;
                         hal.stream.write(buf);
                     }
@@ -529,12 +1315,39 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
             if (!(state == STATE_IDLE || state == STATE_CHECK_MODE))
                 retval = Status_SystemGClock;
             else {
+#if SDCARD_INDEX_SIZE
+                uint32_t line = 0;
+                char *resume;
+                if((resume = strchr(&lcline[3], ' '))) {    // Resume from line: $F=<filename> L<line>
+                    float value;
+                    uint_fast8_t idx = 1;
+                    *resume++ = '\0';
+                    while(*resume == ' ')
+                        resume++;
+                    if(CAPS(*resume) != 'L' || !read_float(resume, &idx, &value) || value < 0.0f || resume[idx] != '\0')
+                        return Status_InvalidStatement;
+                    line = (uint32_t)value;
+                }
+#endif
                 if(file_open(&lcline[3])) {
+#if SDCARD_TRAVEL_PRECHECK
+                    if((retval = file_check_travel()) != Status_OK) {
+                        file_close();
+                        return retval;
+                    }
+#endif
+#if SDCARD_INDEX_SIZE
+                    if(line && (retval = file_seek_line(line)) != Status_OK) {
+                        file_close();
+                        return retval;
+                    }
+#endif
                     gc_state.last_error = Status_OK;                            // Start with no errors
                     grbl.report.status_message(Status_OK);                      // and confirm command to originator
                     memcpy(&active_stream, &hal.stream, sizeof(io_stream_t));   // Save current stream pointers
                     hal.stream.type = StreamType_SDCard;                        // then redirect to read from SD card instead
                     hal.stream.read = sdcard_read;                              // ...
+                    hal.stream.read_block = NULL;                               // ...
                     hal.stream.enqueue_realtime_command = drop_input_stream;    // Drop input from current stream except realtime commands
 #if M6_ENABLE
                     hal.stream.suspend_read = sdcard_suspend;                   // ...
@@ -547,6 +1360,8 @@ static status_code_t sdcard_parse (uint_fast16_t state, char *line, char *lcline
                     on_program_completed = grbl.on_program_completed;
                     grbl.on_program_completed = sdcard_on_program_completed;
 
+                    protocol_add_rt_task(&prefetch_task);                       // Refill read-ahead buffers in the background
+
                     grbl.report.status_message = trap_status_report;             // Redirect status message reports here
                     retval = Status_OK;
                 } else
@@ -61,6 +61,9 @@
 
 void sdcard_init (void);
 FATFS *sdcard_getfs(void);
+void sdcard_dir_cache_add (const char *filename, uint32_t size);
+void sdcard_dir_cache_remove (const char *filename);
+bool sdcard_prefetch_pending (void);
 
 #endif // SDCARD_ENABLE
 
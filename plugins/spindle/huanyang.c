@@ -35,10 +35,14 @@
 #include "grbl/report.h"
 #endif
 
-#ifdef SPINDLE_PWM_DIRECT
+#if defined(SPINDLE_PWM_DIRECT) && !SPINDLE_SELECT_ENABLE
 #error Not supported!
 #endif
 
+#if SPINDLE_SELECT_ENABLE
+#include "selector.h"
+#endif
+
 #ifndef VFD_ADDRESS
 #define VFD_ADDRESS 0x01
 #endif
@@ -59,13 +63,16 @@ static on_report_options_ptr on_report_options;
 static uint32_t rpm_max = 0;
 #endif
 
-static void spindleSetRPM (float rpm, bool block)
+// Queues RPM change ahead of status polling, replaces RPM change not yet sent if any.
+static void spindleSetRPM (float rpm)
 {
     modbus_message_t rpm_cmd;
 
     if (rpm != rpm_programmed) {
 
         rpm_cmd.xx = (void *)VFD_SetRPM;
+        rpm_cmd.high_priority = true;
+        rpm_cmd.coalesce = true;
         rpm_cmd.adu[0] = VFD_ADDRESS;
 
 #if SPINDLE_HUANYANG == 2
@@ -95,27 +102,44 @@ static void spindleSetRPM (float rpm, bool block)
 
         vfd_state.at_speed = false;
 
-        modbus_send(&rpm_cmd, block);
-
-        if(settings.spindle.at_speed_tolerance > 0.0f) {
-            rpm_low_limit = rpm / (1.0f + settings.spindle.at_speed_tolerance);
-            rpm_high_limit = rpm * (1.0f + settings.spindle.at_speed_tolerance);
+        if(modbus_send(&rpm_cmd, false)) {
+            if(settings.spindle.at_speed_tolerance > 0.0f) {
+                rpm_low_limit = rpm / (1.0f + settings.spindle.at_speed_tolerance);
+                rpm_high_limit = rpm * (1.0f + settings.spindle.at_speed_tolerance);
+            }
+            rpm_programmed = rpm;
         }
-        rpm_programmed = rpm;
     }
 }
 
 static void spindleUpdateRPM (float rpm)
 {
-    spindleSetRPM(rpm, false);
+    spindleSetRPM(rpm);
+}
+
+#ifdef SPINDLE_PWM_DIRECT
+
+// Selected alongside a PWM spindle or laser, the "PWM value" passed by the core is the RPM.
+static uint_fast16_t spindleGetPWM (float rpm)
+{
+    return (uint_fast16_t)rpm;
 }
 
-// Start or stop spindle
+static void spindleUpdatePWM (uint_fast16_t pwm)
+{
+    spindleSetRPM((float)pwm);
+}
+
+#endif
+
+// Start or stop spindle, does not wait for the VFD to respond
 static void spindleSetState (spindle_state_t state, float rpm)
 {
     modbus_message_t mode_cmd;
 
     mode_cmd.xx = (void *)VFD_SetStatus;
+    mode_cmd.high_priority = true;
+    mode_cmd.coalesce = true;
     mode_cmd.adu[0] = VFD_ADDRESS;
 
 #if SPINDLE_HUANYANG == 2
@@ -139,8 +163,8 @@ static void spindleSetState (spindle_state_t state, float rpm)
 
 #endif
 
-    if(modbus_send(&mode_cmd, true))
-        spindleSetRPM(rpm, true);
+    if(modbus_send(&mode_cmd, false))
+        spindleSetRPM(rpm);
 }
 
 // Returns spindle state in a spindle_state_t variable
@@ -149,6 +173,8 @@ static spindle_state_t spindleGetState (void)
     modbus_message_t mode_cmd;
 
     mode_cmd.xx = (void *)VFD_GetRPM;
+    mode_cmd.high_priority = false;
+    mode_cmd.coalesce = true;
     mode_cmd.adu[0] = VFD_ADDRESS;
 
 #if SPINDLE_HUANYANG == 2
@@ -223,6 +249,30 @@ static void onReportOptions (void)
 
 void huanyang_init (modbus_stream_t *stream)
 {
+#if SPINDLE_SELECT_ENABLE
+
+    static const spindle_ptrs_t spindle = {
+        .set_state = spindleSetState,
+        .get_state = spindleGetState,
+  #ifdef SPINDLE_PWM_DIRECT
+        .get_pwm = spindleGetPWM,
+        .update_pwm = spindleUpdatePWM
+  #else
+        .update_rpm = spindleUpdateRPM
+  #endif
+    };
+
+    static const driver_cap_t cap = {
+        .variable_spindle = On,
+        .spindle_at_speed = On,
+        .spindle_dir = On
+    };
+
+    if(spindle_select_register("HUANYANG", &spindle, cap, false) < 0)
+        return;
+
+#else
+
     hal.spindle.set_state = spindleSetState;
     hal.spindle.get_state = spindleGetState;
     hal.spindle.reset_data = NULL;
@@ -232,6 +282,8 @@ void huanyang_init (modbus_stream_t *stream)
     hal.driver_cap.spindle_at_speed = On;
     hal.driver_cap.spindle_dir = On;
 
+#endif
+
     stream->on_rx_packet = rx_packet;
     stream->on_rx_exception = rx_exception;
 
@@ -243,6 +295,7 @@ void huanyang_init (modbus_stream_t *stream)
     modbus_message_t cmd;
 
     cmd.xx = VFD_GetMaxRPM;
+    cmd.high_priority = cmd.coalesce = false;
     cmd.adu[0] = VFD_ADDRESS;
     cmd.adu[1] = ModBus_ReadHoldingRegisters;
     cmd.adu[2] = 0xB0;
@@ -32,10 +32,13 @@
 
 #if SPINDLE_HUANYANG
 
+// The PWM spindle of the driver is kept when spindle selection is enabled.
+#if !SPINDLE_SELECT_ENABLE
 #ifdef VFD_SPINDLE
 #undef VFD_SPINDLE
 #endif
 #define VFD_SPINDLE 1
+#endif
 
 #include "modbus.h"
 
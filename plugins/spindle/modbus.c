@@ -27,15 +27,16 @@
 
 #ifdef ARDUINO
 #include "../grbl/hal.h"
+#include "../grbl/protocol.h"
 #else
 #include "grbl/hal.h"
+#include "grbl/protocol.h"
 #endif
 
 #include "modbus.h"
 
 typedef struct queue_entry {
     bool async;
-    bool sent;
     modbus_message_t msg;
     struct queue_entry *next;
 } queue_entry_t;
@@ -44,13 +45,16 @@ static modbus_stream_t *stream;
 static uint16_t rx_timeout = 0;
 static int16_t exception_code = 0;
 static queue_entry_t queue[MODBUS_QUEUE_LENGTH];
-static volatile bool spin_lock = false;
-static volatile queue_entry_t *tail, *head, *packet = NULL;
+static queue_entry_t *pending = NULL, *free_entries = NULL; // Queued messages, high priority first, and unused entries
+static volatile bool spin_lock = false, queue_lock = false;
+static volatile queue_entry_t *packet = NULL;
 static volatile modbus_state_t state = ModBus_Idle;
 static driver_reset_ptr driver_reset;
-static on_execute_realtime_ptr on_execute_realtime;
 static on_report_options_ptr on_report_options;
 
+PLUGIN_PERF_DEFINE_SPAN(perf_transaction, "MODBUS_RTT");
+PLUGIN_PERF_DEFINE(perf_timeout, "MODBUS_TIMEOUT");
+
 // Compute the MODBUS RTU CRC
 static uint16_t modbus_CRC16x (char *buf, uint_fast16_t len)
 {
@@ -79,6 +83,64 @@ static bool valid_crc (char *buf, uint_fast16_t len)
     return buf[len - 1] == (crc >> 8) && buf[len - 2] == (crc & 0xFF);
 }
 
+static void queue_init (void)
+{
+    uint_fast8_t idx;
+
+    pending = NULL;
+    free_entries = &queue[0];
+
+    for(idx = 0; idx < MODBUS_QUEUE_LENGTH; idx++)
+        queue[idx].next = idx == MODBUS_QUEUE_LENGTH - 1 ? NULL : &queue[idx + 1];
+}
+
+// Adds message to the queue, coalesced with a matching message not yet sent if requested. Returns false if the queue is full.
+// High priority messages are inserted after the last high priority message queued, other messages are added to the end of the queue.
+static bool queue_add (modbus_message_t *msg)
+{
+    queue_entry_t *entry, *prev = NULL, *match = NULL;
+
+    queue_lock = true;
+
+    for(entry = pending; entry && !match; entry = entry->next) {
+        if(msg->coalesce && entry->msg.xx == msg->xx && entry->msg.adu[0] == msg->adu[0])
+            match = entry;
+        else if(!msg->high_priority || entry->msg.high_priority)
+            prev = entry;
+    }
+
+    if(match)
+        memcpy(&match->msg, msg, sizeof(modbus_message_t));
+
+    else if((entry = free_entries)) {
+        free_entries = entry->next;
+        entry->async = true;
+        memcpy(&entry->msg, msg, sizeof(modbus_message_t));
+        if(prev) {
+            entry->next = prev->next;
+            prev->next = entry;
+        } else {
+            entry->next = pending;
+            pending = entry;
+        }
+    }
+
+    queue_lock = false;
+
+    return match || entry;
+}
+
+// Returns a sent async message to the unused entries when done
+static void packet_done (void)
+{
+    if(packet && packet->async) {
+        packet->next = free_entries;
+        free_entries = (queue_entry_t *)packet;
+    }
+
+    packet = NULL;
+}
+
 bool modbus_send (modbus_message_t *msg, bool block)
 {
     static queue_entry_t sync_msg = {0};
@@ -110,6 +172,7 @@ bool modbus_send (modbus_message_t *msg, bool block)
         sync_msg.async = false;
         stream->flush_rx_buffer();
         stream->write(sync_msg.msg.adu, sync_msg.msg.tx_length);
+        PLUGIN_PERF_MARK(perf_transaction);
 
         packet = &sync_msg;
 
@@ -131,8 +194,8 @@ bool modbus_send (modbus_message_t *msg, bool block)
                     break;
 
                 case ModBus_GotReply:
-                    if(packet)
-                        stream->on_rx_packet(&((queue_entry_t *)packet)->msg);
+                    PLUGIN_PERF_SPAN_END(perf_transaction);
+                    stream->on_rx_packet(&sync_msg.msg);
                     poll = block = false;
                     break;
 
@@ -143,14 +206,8 @@ bool modbus_send (modbus_message_t *msg, bool block)
 
         state = ModBus_Idle;
 
-    } else if(packet != &sync_msg) {
-        if(head->next != tail) {
-            head->async = true;
-            head->sent = false;
-            memcpy((void *)&(head->msg), msg, sizeof(modbus_message_t));
-            head = head->next;
-        }
-    }
+    } else
+        block = !queue_add(msg);
 
     return !block;
 }
@@ -168,7 +225,7 @@ void modbus_poll (uint_fast16_t grbl_state)
 
     uint32_t ms = hal.get_elapsed_ticks();
 
-    if(ms == last_ms) // check once every ms
+    if(ms == last_ms || queue_lock) // check once every ms, not while the queue is being updated
         return;
 
     spin_lock = true;
@@ -176,19 +233,19 @@ void modbus_poll (uint_fast16_t grbl_state)
     switch(state) {
 
         case ModBus_Idle:
-            if(tail != head && !packet) {
+            if(pending && !packet) {
 
-                packet = tail;
-                tail = tail->next;
+                packet = pending;
+                pending = pending->next;
                 state = ModBus_TX;
                 rx_timeout = stream->rx_timeout;
 
                 if(stream->set_direction)
                     stream->set_direction(true);
 
-                packet->sent = true;
                 stream->flush_rx_buffer();
                 stream->write(((queue_entry_t *)packet)->msg.adu, ((queue_entry_t *)packet)->msg.tx_length);
+                PLUGIN_PERF_MARK(perf_transaction);
             }
             break;
 
@@ -204,6 +261,8 @@ void modbus_poll (uint_fast16_t grbl_state)
 
         case ModBus_AwaitReply:
             if(rx_timeout && --rx_timeout == 0) {
+                PLUGIN_PERF_SPAN_CANCEL(perf_transaction);
+                PLUGIN_PERF_COUNT(perf_timeout);
                 if(packet->async)
                     state = ModBus_Idle;
                 else if(stream->read() == 1 && (stream->read() & 0x80)) {
@@ -211,7 +270,7 @@ void modbus_poll (uint_fast16_t grbl_state)
                     state = ModBus_Exception;
                 } else
                     state = ModBus_Timeout;
-                packet = NULL;
+                packet_done();
                 spin_lock = false;
                 return;
             }
@@ -224,10 +283,12 @@ void modbus_poll (uint_fast16_t grbl_state)
                     *buf++ = stream->read();
                 } while(--packet->msg.rx_length);
 
-                if((state = packet->async ? ModBus_Idle : ModBus_GotReply) == ModBus_Idle)
-                    stream->on_rx_packet(&((queue_entry_t *)packet)->msg);
+                if((state = packet->async ? ModBus_Idle : ModBus_GotReply) == ModBus_Idle) {
+                    PLUGIN_PERF_SPAN_END(perf_transaction);
+                    stream->on_rx_packet(&((queue_entry_t *)packet)->msg); // Completion callback for queued messages
+                }
 
-                packet = NULL;
+                packet_done();
             }
             break;
 
@@ -244,7 +305,7 @@ static void modbus_reset (void)
     while(spin_lock);
 
     packet = NULL;
-    tail = head;
+    queue_init();
     state = ModBus_Idle;
 
     stream->flush_tx_buffer();
@@ -256,13 +317,17 @@ static void modbus_reset (void)
 static void onReportOptions (void)
 {
     on_report_options();
-    hal.stream.write("[PLUGIN:MODBUS v0.01]" ASCII_EOL);
+    hal.stream.write("[PLUGIN:MODBUS v0.02]" ASCII_EOL);
 }
 
+static rt_task_t poll_task = {
+    .name = "ModBus",
+    .fn = modbus_poll,
+    .period = 1
+};
+
 void modbus_init (modbus_stream_t *mstream)
 {
-    uint_fast8_t idx;
-
     stream = mstream;
 
     if(driver_reset == NULL) {
@@ -270,15 +335,14 @@ void modbus_init (modbus_stream_t *mstream)
         driver_reset = hal.driver_reset;
         hal.driver_reset = modbus_reset;
 
-        on_execute_realtime = grbl.on_execute_realtime;
-        grbl.on_execute_realtime = modbus_poll;
+        protocol_add_rt_task(&poll_task);
 
         on_report_options = grbl.on_report_options;
         grbl.on_report_options = onReportOptions;
-    }
 
-    head = tail = &queue[0];
+        PLUGIN_PERF_REGISTER(perf_transaction);
+        PLUGIN_PERF_REGISTER(perf_timeout);
+    }
 
-    for(idx = 0; idx < MODBUS_QUEUE_LENGTH; idx++)
-        queue[idx].next = idx == MODBUS_QUEUE_LENGTH - 1 ? &queue[0] : &queue[idx + 1];
+    queue_init();
 }
@@ -25,7 +25,7 @@
 #define _MODBUS_H_
 
 #define MODBUS_ENABLE 1
-#define MODBUS_MAX_ADU_SIZE 10
+#define MODBUS_MAX_ADU_SIZE 21 // Room for reading up to 8 registers in one transaction
 #define MODBUS_QUEUE_LENGTH 8
 
 typedef enum {
@@ -51,6 +51,8 @@ typedef enum {
 typedef struct {
     uint8_t tx_length;
     uint8_t rx_length;
+    bool high_priority; // Queue ahead of normal priority messages, e.g. spindle speed changes ahead of status polling
+    bool coalesce;      // Replace a queued message with the same context (xx) and address that has not yet been sent
     void *xx;
     char adu[MODBUS_MAX_ADU_SIZE];
 } modbus_message_t;
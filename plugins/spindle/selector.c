@@ -0,0 +1,259 @@
+/*
+
+  selector.c - spindle and laser selection for machines with more than one spindle
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+//
+// Each device keeps its own entry points and capabilities, selecting one copies them to hal.spindle and hal.driver_cap
+// and sets the machine mode in RAM. Nothing is reconfigured, PWM tables precomputed by the driver are kept as is.
+//
+// M104 P<device> selects a device, the spindle must be stopped (M5). The switch is synchronized with motion since the stepper
+// interrupt calls the active device for queued segments. As M5 already waits for motion to complete this normally costs nothing.
+//
+// $SPINDLES lists the devices as [SPINDLE:<device>,<name>,<LASER|SPINDLE>], the active device is marked by a trailing ,*.
+//
+// NOTE: $32 is stored with the mode of the active device when settings are changed, select device 0 before changing settings.
+//
+
+#include "selector.h"
+
+#if SPINDLE_SELECT_ENABLE
+
+#include <string.h>
+
+#ifdef ARDUINO
+#include "../grbl/report.h"
+#else
+#include "grbl/report.h"
+#endif
+
+typedef struct {
+    const char *name;
+    bool is_laser;
+    driver_cap_t cap;
+    spindle_ptrs_t spindle;
+} spindle_device_t;
+
+// Driver capabilities belonging to the spindle, swapped with the device.
+static const driver_cap_t spindle_cap = {
+    .variable_spindle = On,
+    .spindle_dir = On,
+    .spindle_at_speed = On,
+    .laser_ppi_mode = On,
+    .spindle_sync = On,
+    .spindle_pwm_invert = On,
+    .spindle_pid = On,
+    .spindle_pwm_linearization = On
+};
+
+static uint_fast8_t n_devices = 0, active = 0;
+static machine_mode_t mode0 = Mode_Standard; // Mode of device 0, $32
+static spindle_device_t devices[N_SPINDLE_SELECTABLE];
+static user_mcode_ptrs_t user_mcode;
+static settings_changed_ptr settings_changed;
+static on_unknown_sys_command_ptr on_unknown_sys_command;
+static on_report_options_ptr on_report_options;
+
+static machine_mode_t device_mode (uint_fast8_t device)
+{
+    machine_mode_t mode = active == 0 ? settings.mode : mode0;
+
+    if(device == 0)
+        return mode;
+
+    return devices[device].is_laser ? Mode_Laser : (mode == Mode_Laser ? Mode_Standard : mode);
+}
+
+// Saves the entry points and capabilities of the active device, plugins may have changed them since it was selected.
+static void device_save (void)
+{
+    memcpy(&devices[active].spindle, &hal.spindle, sizeof(spindle_ptrs_t));
+    devices[active].cap.value = hal.driver_cap.value & spindle_cap.value;
+
+    if(active == 0)
+        mode0 = settings.mode;
+}
+
+static void device_load (uint_fast8_t device)
+{
+    machine_mode_t mode = device_mode(device);
+
+    active = device;
+
+    memcpy(&hal.spindle, &devices[device].spindle, sizeof(spindle_ptrs_t));
+    hal.driver_cap.value = (hal.driver_cap.value & ~spindle_cap.value) | devices[device].cap.value;
+    settings.mode = mode;
+}
+
+bool spindle_select (uint_fast8_t device)
+{
+    if(device >= n_devices)
+        return false;
+
+    if(device != active) {
+        device_save();
+        device_load(device);
+        hal.spindle.set_state((spindle_state_t){0}, 0.0f);
+    }
+
+    return true;
+}
+
+// The driver (re)configures its own spindle on settings changes, device 0 is made active while it does so.
+// A machine mode different from the active device mode means that $32 was changed, it then applies to device 0.
+static void onSettingsChanged (settings_t *settings)
+{
+    uint_fast8_t device = active;
+
+    if(device != 0) {
+        if(settings->mode != device_mode(device))
+            mode0 = settings->mode;
+        device_save();
+        device_load(0);
+    }
+
+    settings_changed(settings);
+
+    if(device != 0) {
+        device_save();
+        device_load(device);
+    }
+}
+
+static user_mcode_t userMCodeCheck (user_mcode_t mcode)
+{
+    return mcode == Spindle_Select
+                     ? mcode
+                     : (user_mcode.check ? user_mcode.check(mcode) : UserMCode_Ignore);
+}
+
+static status_code_t userMCodeValidate (parser_block_t *gc_block, uint32_t *value_words)
+{
+    status_code_t state = Status_GcodeValueWordMissing;
+
+    switch(gc_block->user_mcode) {
+
+        case Spindle_Select:
+            if(bit_istrue(*value_words, bit(Word_P))) {
+                if(gc_block->values.p < 0.0f || gc_block->values.p >= (float)n_devices || gc_block->values.p != (float)(uint32_t)gc_block->values.p)
+                    state = Status_GcodeValueOutOfRange;
+                else if(gc_block->modal.spindle.on)
+                    state = Status_InvalidStatement;
+                else {
+                    state = Status_OK;
+                    gc_block->user_mcode_sync = true;
+                }
+                bit_false(*value_words, bit(Word_P));
+            }
+            break;
+
+        default:
+            state = Status_Unhandled;
+            break;
+    }
+
+    return state == Status_Unhandled && user_mcode.validate ? user_mcode.validate(gc_block, value_words) : state;
+}
+
+static void userMCodeExecute (uint_fast16_t state, parser_block_t *gc_block)
+{
+    bool handled = true;
+
+    if (state != STATE_CHECK_MODE)
+      switch(gc_block->user_mcode) {
+
+        case Spindle_Select:
+            spindle_select((uint_fast8_t)gc_block->values.p);
+            break;
+
+        default:
+            handled = false;
+            break;
+    }
+
+    if(!handled && user_mcode.execute)
+        user_mcode.execute(state, gc_block);
+}
+
+static status_code_t commandExecute (uint_fast16_t state, char *line, char *lcline)
+{
+    status_code_t retval = Status_Unhandled;
+
+    if(!strcmp(&line[1], "SPINDLES")) {
+
+        uint_fast8_t device;
+
+        for(device = 0; device < n_devices; device++) {
+            hal.stream.write("[SPINDLE:");
+            hal.stream.write(uitoa(device));
+            hal.stream.write(",");
+            hal.stream.write(devices[device].name);
+            hal.stream.write(device_mode(device) == Mode_Laser ? ",LASER" : ",SPINDLE");
+            hal.stream.write(device == active ? ",*]" ASCII_EOL : "]" ASCII_EOL);
+        }
+
+        retval = Status_OK;
+    }
+
+    return retval == Status_Unhandled && on_unknown_sys_command ? on_unknown_sys_command(state, line, lcline) : retval;
+}
+
+static void onReportOptions (void)
+{
+    on_report_options();
+    hal.stream.write("[PLUGIN:SPINDLE SELECT v0.01]" ASCII_EOL);
+}
+
+int_fast8_t spindle_select_register (const char *name, const spindle_ptrs_t *spindle, driver_cap_t cap, bool is_laser)
+{
+    if(n_devices == 0) {
+
+        devices[0].name = "PWM";
+        n_devices = 1;
+
+        memcpy(&user_mcode, &hal.user_mcode, sizeof(user_mcode_ptrs_t));
+
+        hal.user_mcode.check = userMCodeCheck;
+        hal.user_mcode.validate = userMCodeValidate;
+        hal.user_mcode.execute = userMCodeExecute;
+
+        settings_changed = hal.settings_changed;
+        hal.settings_changed = onSettingsChanged;
+
+        on_unknown_sys_command = grbl.on_unknown_sys_command;
+        grbl.on_unknown_sys_command = commandExecute;
+
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = onReportOptions;
+    }
+
+    if(n_devices == N_SPINDLE_SELECTABLE)
+        return -1;
+
+    devices[n_devices].name = name;
+    devices[n_devices].is_laser = is_laser;
+    devices[n_devices].cap.value = cap.value & spindle_cap.value;
+    memcpy(&devices[n_devices].spindle, spindle, sizeof(spindle_ptrs_t));
+
+    return (int_fast8_t)n_devices++;
+}
+
+#endif
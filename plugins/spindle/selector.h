@@ -0,0 +1,58 @@
+/*
+
+  selector.h - spindle and laser selection for machines with more than one spindle
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _SPINDLE_SELECTOR_H_
+#define _SPINDLE_SELECTOR_H_
+
+#ifdef ARDUINO
+#include "../driver.h"
+#else
+#include "driver.h"
+#endif
+
+#if SPINDLE_SELECT_ENABLE
+
+#ifdef ARDUINO
+#include "../grbl/hal.h"
+#else
+#include "grbl/hal.h"
+#endif
+
+// Max number of devices, including the spindle provided by the driver.
+#ifndef N_SPINDLE_SELECTABLE
+#define N_SPINDLE_SELECTABLE 4
+#endif
+
+// Registers a spindle or laser to be selected by M104 P<device>, returns the device number or -1 if there is no room.
+// The spindle already in hal.spindle, normally the PWM spindle of the driver, becomes device 0 on the first call. Device 0
+// is in the mode set by $32, other devices are in laser mode if is_laser is set or in the $32 mode (standard if laser) if not.
+// Only the spindle related flags of cap are used.
+int_fast8_t spindle_select_register (const char *name, const spindle_ptrs_t *spindle, driver_cap_t cap, bool is_laser);
+
+// Makes the device the active spindle, returns false if not registered.
+// NOTE: the spindle must be stopped and the stepper idle when called, this is ensured by M104.
+bool spindle_select (uint_fast8_t device);
+
+#endif
+
+#endif
@@ -0,0 +1,493 @@
+/*
+
+  vfd.c - table driven ModBus VFD spindle support
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "vfd.h"
+
+#if SPINDLE_VFD
+
+#ifdef ARDUINO
+#include "../grbl/hal.h"
+#include "../grbl/state_machine.h"
+#include "../grbl/report.h"
+#else
+#include "grbl/hal.h"
+#include "grbl/state_machine.h"
+#include "grbl/report.h"
+#endif
+
+#if VFD_ADAPTIVE_FEED
+#include <math.h>
+#include <string.h>
+#ifdef ARDUINO
+#include "../grbl/planner.h"
+#include "../grbl/nvs_buffer.h"
+#else
+#include "grbl/planner.h"
+#include "grbl/nvs_buffer.h"
+#endif
+#endif
+
+#if defined(SPINDLE_PWM_DIRECT) && !SPINDLE_SELECT_ENABLE
+#error Not supported!
+#endif
+
+#if SPINDLE_SELECT_ENABLE
+#include "selector.h"
+#endif
+
+#ifndef VFD_ADDRESS
+#define VFD_ADDRESS 0x01
+#endif
+
+// VFD profile, describes the registers used for control and status and how values are scaled.
+// NOTE: VFDs using the standard function codes Write Single Register (6) and Read Holding Registers (3) are supported.
+//       Frequency scaling assumes a 2 pole motor, RPM = Hz * 60.
+typedef struct {
+    const char *name;
+    uint16_t control_register;  // Run/stop command register
+    uint16_t run_cw;            // Control register value for running clockwise (forward)
+    uint16_t run_ccw;           // Control register value for running counterclockwise (reverse)
+    uint16_t stop;              // Control register value for stopping
+    uint16_t speed_register;    // Speed or frequency setpoint register
+    float speed_scale;          // Setpoint register value per RPM, not used when max_rpm_register is set
+    uint16_t max_rpm_register;  // Register holding max RPM read on startup, setpoint is then relative to it. 0 if not used.
+    uint16_t speed_full_scale;  // Setpoint register value at max RPM when max_rpm_register is used
+    uint16_t status_register;   // First register of status block read when polling
+    uint8_t status_count;       // Number of registers in status block, batched in one transaction
+    uint8_t rpm_offset;         // Offset of the output speed or frequency register in the status block
+    float rpm_scale;            // RPM per output speed or frequency register count
+    uint8_t current_offset;     // Offset of the output current register in the status block
+    float current_scale;        // Amperes per output current register count, 0 if output current is not read
+    uint16_t poll_interval;     // Minimum time between status requests in milliseconds
+} vfd_profile_t;
+
+static const vfd_profile_t profiles[] = {
+    {   // Huanyang P2A, setpoint in 0.01% of max RPM, output speed in RPM
+        .name = "HUANYANG P2A",
+        .control_register = 0x2000, .run_cw = 0x01, .run_ccw = 0x02, .stop = 0x06,
+        .speed_register = 0x1000, .max_rpm_register = 0xB005, .speed_full_scale = 10000,
+        .status_register = 0x700C, .status_count = 1, .rpm_offset = 0, .rpm_scale = 1.0f,
+        .poll_interval = 100
+    },
+    {   // YL620A, setpoint and output frequency in 0.1 Hz, output current in 0.1 A
+        .name = "YL620A",
+        .control_register = 0x2000, .run_cw = 0x12, .run_ccw = 0x22, .stop = 0x01,
+        .speed_register = 0x2001, .speed_scale = 10.0f / 60.0f,
+        .status_register = 0x200B, .status_count = 2, .rpm_offset = 0, .rpm_scale = 60.0f / 10.0f,
+        .current_offset = 1, .current_scale = 0.1f,
+        .poll_interval = 100
+    }
+};
+
+typedef enum {
+    VFD_Idle = 0,
+    VFD_GetStatus,
+    VFD_SetRPM,
+    VFD_GetMaxRPM,
+    VFD_SetState
+} vfd_response_t;
+
+static const vfd_profile_t *vfd = &profiles[SPINDLE_VFD - 1];
+static float rpm, rpm_programmed = -1.0f, rpm_low_limit = 0.0f, rpm_high_limit = 0.0f;
+static uint32_t rpm_max = 0, last_poll = 0;
+static spindle_state_t vfd_state = {0};
+static on_report_options_ptr on_report_options;
+
+// Time from a speed change to the first status report within the at speed tolerance.
+PLUGIN_PERF_DEFINE_SPAN(perf_at_speed, "VFD_AT_SPEED");
+
+#if VFD_ADAPTIVE_FEED
+
+typedef struct {
+    float target_load;          // Target spindle load in percent of rated current, 0 to disable
+    float rated_current;        // Spindle rated current in amperes
+    uint8_t min_feed_override;  // Feed override range in percent
+    uint8_t max_feed_override;
+    float load_filter;          // Load filter time constant in seconds
+} vfd_adaptive_settings_t;
+
+static struct {
+    bool active;                // Set while the feed override is controlled by the spindle load
+    uint8_t feed_override;      // Feed override to restore when the cycle is completed
+    float load;                 // Filtered load in percent of rated current, negative when not sampled
+    uint32_t sample_ms;         // Time of last sample
+} adaptive = { .load = -1.0f };
+
+static vfd_adaptive_settings_t vfd_settings;
+static driver_setting_ptrs_t driver_settings;
+static on_execute_realtime_ptr on_execute_realtime;
+
+#endif
+
+// Queues a Write Single Register or Read Holding Registers request, value is the number of registers for reads.
+// Requests with the same context replace each other until sent.
+static bool vfd_send (vfd_response_t context, modbus_function_t function, uint16_t reg, uint16_t value, bool high_priority, bool block)
+{
+    modbus_message_t cmd;
+
+    cmd.xx = (void *)context;
+    cmd.high_priority = high_priority;
+    cmd.coalesce = true;
+    cmd.adu[0] = VFD_ADDRESS;
+    cmd.adu[1] = function;
+    cmd.adu[2] = reg >> 8;
+    cmd.adu[3] = reg & 0xFF;
+    cmd.adu[4] = value >> 8;
+    cmd.adu[5] = value & 0xFF;
+    cmd.tx_length = 8;
+    cmd.rx_length = function == ModBus_ReadHoldingRegisters ? 5 + value * 2 : 8;
+
+    return modbus_send(&cmd, block);
+}
+
+// Returns register value at offset from a Read Holding Registers response
+static inline uint16_t get_register (modbus_message_t *msg, uint_fast8_t offset)
+{
+    return ((uint8_t)msg->adu[3 + offset * 2] << 8) | (uint8_t)msg->adu[4 + offset * 2];
+}
+
+// Queues RPM change ahead of status polling, replaces RPM change not yet sent if any.
+static void spindleSetRPM (float rpm)
+{
+    if (rpm != rpm_programmed) {
+
+        uint16_t data = vfd->max_rpm_register
+                         ? (rpm_max ? (uint16_t)(rpm * (float)vfd->speed_full_scale / (float)rpm_max) : 0)
+                         : (uint16_t)(rpm * vfd->speed_scale);
+
+        vfd_state.at_speed = false;
+        PLUGIN_PERF_MARK(perf_at_speed);
+
+        if(vfd_send(VFD_SetRPM, ModBus_WriteRegister, vfd->speed_register, data, true, false)) {
+            if(settings.spindle.at_speed_tolerance > 0.0f) {
+                rpm_low_limit = rpm / (1.0f + settings.spindle.at_speed_tolerance);
+                rpm_high_limit = rpm * (1.0f + settings.spindle.at_speed_tolerance);
+            }
+            rpm_programmed = rpm;
+        }
+    }
+}
+
+static void spindleUpdateRPM (float rpm)
+{
+    spindleSetRPM(rpm);
+}
+
+#ifdef SPINDLE_PWM_DIRECT
+
+// Selected alongside a PWM spindle or laser, the "PWM value" passed by the core is the RPM.
+static uint_fast16_t spindleGetPWM (float rpm)
+{
+    return (uint_fast16_t)rpm;
+}
+
+static void spindleUpdatePWM (uint_fast16_t pwm)
+{
+    spindleSetRPM((float)pwm);
+}
+
+#endif
+
+// Start or stop spindle, does not wait for the VFD to respond
+static void spindleSetState (spindle_state_t state, float rpm)
+{
+    uint16_t cmd = (!state.on || rpm == 0.0f) ? vfd->stop : (state.ccw ? vfd->run_ccw : vfd->run_cw);
+
+    vfd_state.on = state.on;
+    vfd_state.ccw = state.ccw;
+
+    if(vfd_send(VFD_SetState, ModBus_WriteRegister, vfd->control_register, cmd, true, false))
+        spindleSetRPM(rpm);
+}
+
+// Returns spindle state in a spindle_state_t variable. Requests the status block from the VFD
+// if the spindle is on and the polling interval has elapsed, the status is updated when the response arrives.
+static spindle_state_t spindleGetState (void)
+{
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    if(vfd_state.on && (ms - last_poll) >= vfd->poll_interval) {
+        last_poll = ms;
+        vfd_send(VFD_GetStatus, ModBus_ReadHoldingRegisters, vfd->status_register, vfd->status_count, false, false);
+    }
+
+    return vfd_state; // return previous state as we do not want to wait for the response
+}
+
+#if VFD_ADAPTIVE_FEED
+
+// Adjusts the feed override towards the value that keeps the filtered spindle load at the target.
+// The override is changed by half of the computed correction per sample to damp the response of the cut.
+static void adaptive_feed_update (float current)
+{
+    uint32_t ms = hal.get_elapsed_ticks();
+    float load = current * 100.0f / vfd_settings.rated_current, dt = (float)(ms - adaptive.sample_ms) / 1000.0f;
+
+    adaptive.sample_ms = ms;
+    adaptive.load = adaptive.load < 0.0f || dt >= vfd_settings.load_filter
+                     ? load
+                     : adaptive.load + (load - adaptive.load) * dt / vfd_settings.load_filter;
+
+    if(sys.state != STATE_CYCLE || !vfd_state.on || sys.override.control.feed_rate_disable)
+        return;
+
+    if(!adaptive.active) {
+        adaptive.active = true;
+        adaptive.feed_override = sys.override.feed_rate;
+    }
+
+    float feed_override = (float)sys.override.feed_rate, target = adaptive.load > 0.0f
+                                                                   ? feed_override * vfd_settings.target_load / adaptive.load
+                                                                   : (float)vfd_settings.max_feed_override;
+
+    feed_override += 0.5f * (target - feed_override);
+    feed_override = max(min(feed_override, (float)vfd_settings.max_feed_override), (float)vfd_settings.min_feed_override);
+
+    if((uint8_t)lroundf(feed_override) != sys.override.feed_rate)
+        plan_feed_override((uint8_t)lroundf(feed_override), sys.override.rapid_rate);
+}
+
+// Polls the VFD status during cycles and restores the feed override when a cycle is completed.
+static void onExecuteRealtime (uint_fast16_t state)
+{
+    on_execute_realtime(state);
+
+    if(vfd_settings.target_load > 0.0f && vfd_settings.rated_current > 0.0f) {
+        if(state == STATE_CYCLE)
+            spindleGetState();
+        else if(adaptive.active && state != STATE_HOLD) {
+            adaptive.active = false;
+            adaptive.load = -1.0f;
+            plan_feed_override(adaptive.feed_override, sys.override.rapid_rate);
+        }
+    }
+}
+
+static status_code_t vfd_setting (setting_type_t setting, float value, char *svalue)
+{
+    status_code_t status = svalue ? Status_OK : Status_Unhandled;
+
+    if(svalue) switch(setting) {
+
+        case Setting_VFD_TargetLoad:
+            vfd_settings.target_load = value;
+            break;
+
+        case Setting_VFD_RatedCurrent:
+            vfd_settings.rated_current = value;
+            break;
+
+        case Setting_VFD_MinFeedOverride:
+            if(isintf(value) && value >= (float)MIN_FEED_RATE_OVERRIDE && value <= (float)DEFAULT_FEED_OVERRIDE)
+                vfd_settings.min_feed_override = (uint8_t)value;
+            else
+                status = Status_InvalidStatement;
+            break;
+
+        case Setting_VFD_MaxFeedOverride:
+            if(isintf(value) && value >= (float)DEFAULT_FEED_OVERRIDE && value <= (float)MAX_FEED_RATE_OVERRIDE)
+                vfd_settings.max_feed_override = (uint8_t)value;
+            else
+                status = Status_InvalidStatement;
+            break;
+
+        case Setting_VFD_LoadFilter:
+            vfd_settings.load_filter = value;
+            break;
+
+        default:
+            status = Status_Unhandled;
+            break;
+    }
+
+    if(status == Status_OK)
+        hal.nvs.memcpy_to_nvs(driver_settings.nvs_address, (uint8_t *)&vfd_settings, sizeof(vfd_adaptive_settings_t), true);
+
+    return status == Status_Unhandled && driver_settings.set ? driver_settings.set(setting, value, svalue) : status;
+}
+
+static void vfd_settings_report (setting_type_t setting)
+{
+    bool reported = true;
+
+    switch(setting) {
+
+        case Setting_VFD_TargetLoad:
+            report_float_setting(setting, vfd_settings.target_load, 1);
+            break;
+
+        case Setting_VFD_RatedCurrent:
+            report_float_setting(setting, vfd_settings.rated_current, 1);
+            break;
+
+        case Setting_VFD_MinFeedOverride:
+            report_uint_setting(setting, vfd_settings.min_feed_override);
+            break;
+
+        case Setting_VFD_MaxFeedOverride:
+            report_uint_setting(setting, vfd_settings.max_feed_override);
+            break;
+
+        case Setting_VFD_LoadFilter:
+            report_float_setting(setting, vfd_settings.load_filter, 1);
+            break;
+
+        default:
+            reported = false;
+            break;
+    }
+
+    if(!reported && driver_settings.report)
+        driver_settings.report(setting);
+}
+
+static void vfd_settings_restore (void)
+{
+    vfd_settings.target_load = 0.0f;
+    vfd_settings.rated_current = 0.0f;
+    vfd_settings.min_feed_override = 50;
+    vfd_settings.max_feed_override = 150;
+    vfd_settings.load_filter = 0.5f;
+
+    hal.nvs.memcpy_to_nvs(driver_settings.nvs_address, (uint8_t *)&vfd_settings, sizeof(vfd_adaptive_settings_t), true);
+
+    if(driver_settings.restore)
+        driver_settings.restore();
+}
+
+static void vfd_settings_load (void)
+{
+    if(hal.nvs.memcpy_from_nvs((uint8_t *)&vfd_settings, driver_settings.nvs_address, sizeof(vfd_adaptive_settings_t), true) != NVS_TransferResult_OK)
+        vfd_settings_restore();
+
+    if(driver_settings.load)
+        driver_settings.load();
+}
+
+#endif
+
+static void rx_packet (modbus_message_t *msg)
+{
+    if(!(msg->adu[1] & 0x80)) {
+
+        switch((vfd_response_t)msg->xx) {
+
+            case VFD_GetStatus:
+                rpm = (float)get_register(msg, vfd->rpm_offset) * vfd->rpm_scale;
+                vfd_state.at_speed = settings.spindle.at_speed_tolerance <= 0.0f || (rpm >= rpm_low_limit && rpm <= rpm_high_limit);
+                if(vfd_state.at_speed)
+                    PLUGIN_PERF_SPAN_END(perf_at_speed);
+#if VFD_ADAPTIVE_FEED
+                if(vfd->current_scale > 0.0f && vfd_settings.target_load > 0.0f && vfd_settings.rated_current > 0.0f)
+                    adaptive_feed_update((float)get_register(msg, vfd->current_offset) * vfd->current_scale);
+#endif
+                break;
+
+            case VFD_GetMaxRPM:
+                rpm_max = get_register(msg, 0);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void rx_exception (uint8_t code)
+{
+    set_state(STATE_ALARM); // Ensure alarm state is active.
+    report_alarm_message(Alarm_Spindle);
+}
+
+static void onReportOptions (void)
+{
+    on_report_options();
+    hal.stream.write("[PLUGIN:VFD ");
+    hal.stream.write(vfd->name);
+    hal.stream.write(" v0.02]" ASCII_EOL);
+}
+
+void vfd_init (modbus_stream_t *stream)
+{
+#if SPINDLE_SELECT_ENABLE
+
+    static const spindle_ptrs_t spindle = {
+        .set_state = spindleSetState,
+        .get_state = spindleGetState,
+  #ifdef SPINDLE_PWM_DIRECT
+        .get_pwm = spindleGetPWM,
+        .update_pwm = spindleUpdatePWM
+  #else
+        .update_rpm = spindleUpdateRPM
+  #endif
+    };
+
+    static const driver_cap_t cap = {
+        .variable_spindle = On,
+        .spindle_at_speed = On,
+        .spindle_dir = On
+    };
+
+    if(spindle_select_register(vfd->name, &spindle, cap, false) < 0)
+        return;
+
+#else
+
+    hal.spindle.set_state = spindleSetState;
+    hal.spindle.get_state = spindleGetState;
+    hal.spindle.reset_data = NULL;
+    hal.spindle.update_rpm = spindleUpdateRPM;
+
+    hal.driver_cap.variable_spindle = On;
+    hal.driver_cap.spindle_at_speed = On;
+    hal.driver_cap.spindle_dir = On;
+
+#endif
+
+    stream->on_rx_packet = rx_packet;
+    stream->on_rx_exception = rx_exception;
+
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = onReportOptions;
+
+    PLUGIN_PERF_REGISTER(perf_at_speed);
+
+#if VFD_ADAPTIVE_FEED
+    if(vfd->current_scale > 0.0f && (hal.driver_settings.nvs_address = nvs_alloc(sizeof(vfd_adaptive_settings_t)))) {
+
+        memcpy(&driver_settings, &hal.driver_settings, sizeof(driver_setting_ptrs_t));
+        hal.driver_settings.set = vfd_setting;
+        hal.driver_settings.report = vfd_settings_report;
+        hal.driver_settings.load = vfd_settings_load;
+        hal.driver_settings.restore = vfd_settings_restore;
+
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = onExecuteRealtime;
+    }
+#endif
+
+    if(vfd->max_rpm_register)
+        vfd_send(VFD_GetMaxRPM, ModBus_ReadHoldingRegisters, vfd->max_rpm_register, 1, false, true);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+
+  vfd.h - table driven ModBus VFD spindle support
+
+  Part of GrblHAL
+
+  Copyright (c) 2020 Terje Io
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _VFD_H_
+#define _VFD_H_
+
+#ifdef ARDUINO
+#include "../driver.h"
+#else
+#include "driver.h"
+#endif
+
+// Set SPINDLE_VFD to one of the profiles below to enable.
+#define VFD_PROFILE_HUANYANG_P2A 1
+#define VFD_PROFILE_YL620A       2
+
+// Set VFD_ADAPTIVE_FEED to 1 to enable adaptive feed control, the feed override is adjusted during cycles
+// to keep the spindle load at the target set by $380. Requires a profile that reads the VFD output current.
+#ifndef VFD_ADAPTIVE_FEED
+#define VFD_ADAPTIVE_FEED 0
+#endif
+
+#if SPINDLE_VFD
+
+// The PWM spindle of the driver is kept when spindle selection is enabled.
+#if !SPINDLE_SELECT_ENABLE
+#ifdef VFD_SPINDLE
+#undef VFD_SPINDLE
+#endif
+#define VFD_SPINDLE 1
+#endif
+
+#include "modbus.h"
+
+void vfd_init (modbus_stream_t *stream);
+
+#endif
+
+#endif // _VFD_H_
@@ -36,6 +36,7 @@
 #include "trinamic.h"
 
 #include "grbl/report.h"
+#include "grbl/protocol.h"
 #ifdef ARDUINO
   #if TRINAMIC_I2C
     #include "../i2c.h"
@@ -77,6 +78,56 @@ static struct {
 static TMC2130_datagram_t *reg_ptr = NULL;
 #endif
 
+#if TRINAMIC_SPI_CHAIN
+// DRV_STATUS telemetry for all chained drivers. Responses carry the data requested by the previous frame,
+// each sample is thus two back-to-back frames requesting DRV_STATUS.
+static struct {
+    uint_fast8_t length;
+    uint8_t axis[N_AXIS];                       // Axis index by chain position
+    volatile bool busy;
+    volatile bool primed;                       // Set when the first frame of a sample is transferred
+    volatile bool valid;                        // Set when DRV_STATUS shadow registers are updated by a sample
+    volatile axes_signals_t stalled;            // stallGuard flags from the last sample
+    uint32_t ms;
+    uint8_t tx[N_AXIS * TMC_DATAGRAM_SIZE];
+    uint8_t rx[N_AXIS * TMC_DATAGRAM_SIZE];
+} chain = {0};
+static on_execute_realtime_ptr on_execute_realtime_poll = NULL;
+#endif
+
+#if TRINAMIC_SG_AUTOTUNE
+// SG_RESULT tracking per axis for stall detection when homing, restarted when the motor is at standstill.
+typedef struct {
+    uint32_t ms;                                // Time the motor left standstill
+    uint32_t sum;
+    uint_fast16_t samples;
+    uint_fast16_t baseline;                     // Average SG_RESULT at the homing rate, 0 while learning
+    uint_fast16_t filtered;
+} sg_track_t;
+
+static sg_track_t sg_track[N_AXIS];
+#endif
+
+#if TRINAMIC_CURRENT_SCHEDULING
+// Run current scheduling, irun holds the current scale for the configured current.
+static struct {
+    volatile bool boost;                        // Set from the step interrupt when the executing segment is not cruising
+    bool boosted;                               // Current scale applied
+    bool pending;                               // Update not yet written
+    uint8_t irun[N_AXIS];
+#if TRINAMIC_SPI_CHAIN
+    uint8_t tx[N_AXIS * TMC_DATAGRAM_SIZE];
+    uint8_t rx[N_AXIS * TMC_DATAGRAM_SIZE];
+#endif
+} schedule = {0};
+static stepper_pulse_start_ptr schedule_pulse_start = NULL;
+#if !TRINAMIC_SPI_CHAIN
+static on_execute_realtime_ptr on_execute_realtime_schedule = NULL;
+#endif
+
+static void current_schedule_changed (void);
+#endif
+
 #if TRINAMIC_I2C
 TMCI2C_enable_dgr_t dgr_enable = {
     .addr.reg = TMC_I2CReg_ENABLE
@@ -111,6 +162,10 @@ void trinamic_configure (void)
             TMC2130_SetMicrosteps(&stepper[idx], trinamic.driver[idx].microsteps);
         }
     } while(idx);
+
+#if TRINAMIC_CURRENT_SCHEDULING
+    current_schedule_changed();
+#endif
 }
 
 // Parse and set driver specific parameters
@@ -294,6 +349,9 @@ static void report_sg_status (uint_fast16_t state)
 {
     if(report.sg_status) {
         report.sg_status = false;
+#if TRINAMIC_SPI_CHAIN
+        if(!chain.valid)
+#endif
         TMC2130_ReadRegister(&stepper[report.sg_status_axis], (TMC2130_datagram_t *)&stepper[report.sg_status_axis].drv_status);
         hal.stream.write("[SG:");
         hal.stream.write(uitoa((uint32_t)stepper[report.sg_status_axis].drv_status.reg.sg_result));
@@ -540,6 +598,9 @@ static void trinamic_MCodeExecute (uint_fast16_t state, parser_block_t *gc_block
                     TMC2130_SetCurrent(&stepper[idx], (uint16_t)gc_block->values.xyz[idx],
                                         isnan(gc_block->values.q) ? stepper[idx].hold_current_pct : (uint8_t)gc_block->values.q);
             } while(idx);
+#if TRINAMIC_CURRENT_SCHEDULING
+            current_schedule_changed();
+#endif
             break;
 
         case Trinamic_ReportPrewarnFlags:; // TODO: format grbl style?
@@ -615,6 +676,14 @@ static axes_signals_t trinamic_limits (void)
 
     signals.mask &= ~homing.mask;
 
+#if TRINAMIC_SPI_CHAIN
+    // Sampled continuously while homing, no need to wait for DIAG1.
+    if(chain.valid) {
+        signals.mask |= chain.stalled.mask & homing.mask;
+        return signals;
+    }
+#endif
+
     if(hal.clear_bits_atomic(&diag1_poll, 0)) {
         // TODO: read I2C bridge status register instead of polling drivers when using I2C comms
         uint_fast8_t idx = N_AXIS;
@@ -651,6 +720,12 @@ void trinamic_homing (bool enable)
             hal.limits.get_state = trinamic_limits;
         }
         diag1_poll = 0;
+#if TRINAMIC_SPI_CHAIN
+        chain.valid = false; // Use samples taken with stallGuard enabled only
+#endif
+#if TRINAMIC_SG_AUTOTUNE
+        memset(sg_track, 0, sizeof(sg_track));
+#endif
     } else if(limits_get_state != NULL) {
         hal.limits.get_state = limits_get_state;
         limits_get_state = NULL;
@@ -975,11 +1050,210 @@ bool trinamic_init (void)
     return driver_settings.nvs_address != 0;
 }
 
-void trinamic_start (bool allow_mixed)
+#if TRINAMIC_SPI_CHAIN
+
+#if TRINAMIC_SG_AUTOTUNE
+
+// Called from the interrupt context for each DRV_STATUS sample of a homing axis, returns true on stall.
+static bool sg_stalled (uint_fast8_t idx)
+{
+    sg_track_t *track = &sg_track[idx];
+    uint_fast16_t sg_result = stepper[idx].drv_status.reg.sg_result;
+
+    if(stepper[idx].drv_status.reg.stst) {
+        track->ms = 0;
+        return false;
+    }
+
+    if(track->ms == 0) {
+        // Left standstill, start a new homing pass
+        track->ms = hal.get_elapsed_ticks() | 1;
+        track->sum = track->samples = track->baseline = 0;
+        return false;
+    }
+
+    if(track->baseline == 0) {
+        if(hal.get_elapsed_ticks() - track->ms >= TMC_SG_SETTLE_TIME) {
+            track->sum += sg_result;
+            if(++track->samples == TMC_SG_LEARN_SAMPLES)
+                track->filtered = track->baseline = max(track->sum / TMC_SG_LEARN_SAMPLES, 1);
+        }
+        return false; // stallGuard is not reliable while accelerating
+    }
+
+    if(track->baseline < TMC_SG_MIN_BASELINE)
+        return stepper[idx].drv_status.reg.stallGuard;
+
+    track->filtered = (track->filtered * 3 + sg_result) >> 2;
+
+    return track->filtered * 100 < track->baseline * TMC_SG_STALL_PCT;
+}
+
+#endif
+
+// Called from the interrupt context when a chain frame is transferred.
+static void chain_transfer_completed (void)
+{
+    if(!chain.primed) {
+        // First frame only requested DRV_STATUS, transfer again to get the data.
+        chain.primed = true;
+        if(SPI_ChainTransfer(chain.tx, chain.rx, chain.length, chain_transfer_completed))
+            return;
+    } else {
+
+        uint_fast8_t pos = chain.length;
+        axes_signals_t stalled = {0};
+
+        do {
+            uint8_t *rx = &chain.rx[(chain.length - pos) * TMC_DATAGRAM_SIZE];
+            uint_fast8_t idx = chain.axis[--pos];
+            stepper[idx].drv_status.reg.value = ((uint32_t)rx[1] << 24) | ((uint32_t)rx[2] << 16) | ((uint32_t)rx[3] << 8) | rx[4];
+#if TRINAMIC_SG_AUTOTUNE
+            if(is_homing && bit_istrue(homing.mask, bit(idx))) {
+                if(sg_stalled(idx))
+                    stalled.mask |= bit(idx);
+            } else
+#endif
+            if(stepper[idx].drv_status.reg.stallGuard)
+                stalled.mask |= bit(idx);
+        } while(pos);
+
+        chain.stalled = stalled;
+        chain.valid = true;
+    }
+
+    chain.busy = false;
+}
+
+// Starts a DRV_STATUS sample of all chained drivers when due, the transfer runs in the background.
+static void trinamic_poll (uint_fast16_t state)
+{
+#if TRINAMIC_CURRENT_SCHEDULING
+    current_schedule(state);
+#endif
+
+    if(!chain.busy && chain.length && (is_homing || (state & (STATE_CYCLE|STATE_JOG|STATE_HOMING)) || report.sg_status_enable)) {
+
+        uint32_t ms = hal.get_elapsed_ticks();
+
+        if(is_homing || ms - chain.ms >= TRINAMIC_POLL_INTERVAL) {
+            chain.ms = ms;
+            chain.busy = true;
+            chain.primed = false;
+            if(!SPI_ChainTransfer(chain.tx, chain.rx, chain.length, chain_transfer_completed))
+                chain.busy = false;
+        }
+    }
+
+    on_execute_realtime_poll(state);
+}
+
+#endif
+
+#if TRINAMIC_CURRENT_SCHEDULING
+
+// Called from the step interrupt, the profile phase of the executing segment is picked up by current_schedule().
+static void current_schedule_pulse_start (stepper_t *motors)
+{
+    schedule.boost = !motors->exec_segment->cruising;
+
+    schedule_pulse_start(motors);
+}
+
+#if TRINAMIC_SPI_CHAIN
+static void current_transfer_completed (void)
+{
+    chain.busy = false;
+}
+#endif
+
+// Writes the run current scale for the current profile phase to all enabled drivers.
+static void current_schedule_write (bool boost)
+{
+    uint_fast8_t idx;
+    uint32_t pct = boost ? TMC_ACCEL_CURRENT_PCT : TMC_CRUISE_CURRENT_PCT;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(bit_istrue(trinamic.driver_enable.mask, bit(idx))) {
+            uint32_t irun = ((uint32_t)schedule.irun[idx] + 1) * pct / 100;
+            stepper[idx].ihold_irun.reg.irun = irun == 0 ? 0 : (irun > 32 ? 31 : irun - 1);
+#if !TRINAMIC_SPI_CHAIN
+            TMC2130_WriteRegister(&stepper[idx], (TMC2130_datagram_t *)&stepper[idx].ihold_irun);
+#endif
+        }
+    }
+
+#if TRINAMIC_SPI_CHAIN
+    // One frame with an IHOLD_IRUN write datagram for each driver.
+    for(idx = 0; idx < chain.length; idx++) {
+        uint8_t *tx = &schedule.tx[idx * TMC_DATAGRAM_SIZE];
+        uint32_t value = stepper[chain.axis[idx]].ihold_irun.reg.value;
+        tx[0] = stepper[chain.axis[idx]].ihold_irun.addr.reg | 0x80; // Write access
+        tx[1] = (uint8_t)(value >> 24);
+        tx[2] = (uint8_t)(value >> 16);
+        tx[3] = (uint8_t)(value >> 8);
+        tx[4] = (uint8_t)value;
+    }
+
+    chain.busy = true;
+    if(!SPI_ChainTransfer(schedule.tx, schedule.rx, chain.length, current_transfer_completed)) {
+        chain.busy = false;
+        return;
+    }
+#endif
+
+    schedule.boosted = boost;
+    schedule.pending = false;
+}
+
+// Called from the foreground, updates the run current when the profile phase changes.
+// Full current is used when homing, the cruise current when idle.
+static void current_schedule (uint_fast16_t state)
+{
+    bool boost = is_homing || (state & STATE_HOMING) ||
+                  ((state & (STATE_CYCLE|STATE_JOG|STATE_HOLD)) && sys.holding_state != Hold_Complete && schedule.boost);
+
+#if TRINAMIC_SPI_CHAIN
+    if((schedule.pending || boost != schedule.boosted) && !chain.busy)
+#else
+    if(schedule.pending || boost != schedule.boosted)
+#endif
+        current_schedule_write(boost);
+
+#if !TRINAMIC_SPI_CHAIN
+    on_execute_realtime_schedule(state);
+#endif
+}
+
+// Called when the configured current is changed, IRUN as set by the Trinamic library is used as the full current scale.
+static void current_schedule_changed (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        schedule.irun[idx] = stepper[idx].ihold_irun.reg.irun;
+
+    schedule.pending = true;
+    schedule.boosted = true;
+}
+
+#endif
+
+static void trinamic_drivers_init (bool allow_mixed)
 {
     uint_fast8_t idx = N_AXIS;
 
-#if !TRINAMIC_I2C
+#if TRINAMIC_SPI_CHAIN
+    chain.length = 0;
+    chain.valid = false;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(bit_istrue(trinamic.driver_enable.mask, bit(idx)))
+            chain.axis[chain.length++] = idx;
+    }
+
+    idx = N_AXIS;
+#elif !TRINAMIC_I2C
     static chip_select_t cs[N_AXIS];
 
     cs[X_AXIS].port = SPI_CS_PORT_X;
@@ -1000,7 +1274,11 @@ void trinamic_start (bool allow_mixed)
 
             TMC2130_SetDefaults(&stepper[idx]); // Init shadow registers to default values
 
-#if !TRINAMIC_I2C
+#if TRINAMIC_SPI_CHAIN
+            uint_fast8_t pos = chain.length;
+            while(chain.axis[--pos] != idx);
+            stepper[idx].cs_pin = (void *)(uint32_t)pos; // Chain position
+#elif !TRINAMIC_I2C
             stepper[idx].cs_pin = &cs[idx];
             GPIOPinTypeGPIOOutput(cs[idx].port, cs[idx].pin);
             GPIOPinWrite(cs[idx].port, cs[idx].pin, cs[idx].pin);
@@ -1014,6 +1292,7 @@ void trinamic_start (bool allow_mixed)
             switch(idx) {
 
                 case X_AXIS:
+                    stepper[idx].hold_current_pct = TMC_X_HOLD_CURRENT_PCT;
                   #ifdef TMC_X_ADVANCED
                     TMC_X_ADVANCED
                   #endif
@@ -1023,6 +1302,7 @@ void trinamic_start (bool allow_mixed)
                     break;
 
                 case Y_AXIS:
+                    stepper[idx].hold_current_pct = TMC_Y_HOLD_CURRENT_PCT;
                   #ifdef TMC_Y_ADVANCED
                     TMC_Y_ADVANCED
                   #endif
@@ -1032,6 +1312,7 @@ void trinamic_start (bool allow_mixed)
                     break;
 
                 case Z_AXIS:
+                    stepper[idx].hold_current_pct = TMC_Z_HOLD_CURRENT_PCT;
                   #ifdef TMC_Z_ADVANCED
                     TMC_Z_ADVANCED
                   #endif
@@ -1047,6 +1328,52 @@ void trinamic_start (bool allow_mixed)
           #endif
         }
     } while(idx);
+
+#if TRINAMIC_SPI_CHAIN
+    // All datagrams of the sampling frame are DRV_STATUS read requests.
+    memset(chain.tx, 0, sizeof(chain.tx));
+    for(idx = 0; idx < chain.length; idx++)
+        chain.tx[idx * TMC_DATAGRAM_SIZE] = stepper[chain.axis[idx]].drv_status.addr.reg;
+
+    if(on_execute_realtime_poll == NULL) {
+        on_execute_realtime_poll = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = trinamic_poll;
+    }
+#endif
+
+#if TRINAMIC_CURRENT_SCHEDULING
+    current_schedule_changed();
+
+    if(schedule_pulse_start == NULL) {
+        schedule_pulse_start = hal.stepper.pulse_start;
+        hal.stepper.pulse_start = current_schedule_pulse_start;
+  #if !TRINAMIC_SPI_CHAIN
+        on_execute_realtime_schedule = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = current_schedule;
+  #endif
+    }
+#endif
+}
+
+#ifdef ENABLE_DEFERRED_INIT
+
+static bool start_mixed;
+
+static void trinamic_start_deferred (uint_fast16_t state)
+{
+    trinamic_drivers_init(start_mixed);
+}
+
+#endif
+
+// Initializes the drivers, deferred until after the welcome message if ENABLE_DEFERRED_INIT is enabled.
+void trinamic_start (bool allow_mixed)
+{
+#ifdef ENABLE_DEFERRED_INIT
+    start_mixed = allow_mixed;
+    if(!protocol_enqueue_rt_command(trinamic_start_deferred))
+#endif
+    trinamic_drivers_init(allow_mixed);
 }
 
 // Interrupt handler for DIAG1 signal(s)
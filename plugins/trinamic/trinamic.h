@@ -36,6 +36,68 @@
 
 #if TRINAMIC_ENABLE
 
+// Set to 1 for SPI daisy-chained drivers sharing a single chip select, enabled drivers are chained in axis order
+// with the X driver (or the lowest enabled axis) connected to MOSI. Status is then sampled for all drivers in
+// one frame, see TRINAMIC_POLL_INTERVAL.
+#ifndef TRINAMIC_SPI_CHAIN
+#define TRINAMIC_SPI_CHAIN 0
+#endif
+
+#if TRINAMIC_SPI_CHAIN && TRINAMIC_I2C
+#error "TRINAMIC_SPI_CHAIN cannot be used with TRINAMIC_I2C!"
+#endif
+
+// Interval in milliseconds between DRV_STATUS samples of chained drivers during motion, sampling is continuous when homing.
+#ifndef TRINAMIC_POLL_INTERVAL
+#define TRINAMIC_POLL_INTERVAL 10
+#endif
+
+// Set to 1 for stall detection from the sampled SG_RESULT of chained drivers when homing, allows homing at higher seek rates.
+// The SG_RESULT baseline is learned at the homing rate for each homing pass: after the motor has left standstill samples are
+// skipped for TMC_SG_SETTLE_TIME milliseconds (acceleration), then TMC_SG_LEARN_SAMPLES are averaged.
+// A stall is reported when the filtered SG_RESULT drops below TMC_SG_STALL_PCT percent of the baseline.
+// The stallGuard flag is used when the baseline is below TMC_SG_MIN_BASELINE, the homing rate is then out of range.
+#ifndef TRINAMIC_SG_AUTOTUNE
+#define TRINAMIC_SG_AUTOTUNE 0
+#endif
+
+#ifndef TMC_SG_SETTLE_TIME
+#define TMC_SG_SETTLE_TIME 50
+#endif
+
+#ifndef TMC_SG_LEARN_SAMPLES
+#define TMC_SG_LEARN_SAMPLES 32
+#endif
+
+#ifndef TMC_SG_STALL_PCT
+#define TMC_SG_STALL_PCT 50
+#endif
+
+#ifndef TMC_SG_MIN_BASELINE
+#define TMC_SG_MIN_BASELINE 16
+#endif
+
+#if TRINAMIC_SG_AUTOTUNE && !TRINAMIC_SPI_CHAIN
+#error "TRINAMIC_SG_AUTOTUNE requires TRINAMIC_SPI_CHAIN!"
+#endif
+
+// Set to 1 to schedule the run current from the motion profile, the configured current is scaled by TMC_ACCEL_CURRENT_PCT
+// while accelerating or decelerating and by TMC_CRUISE_CURRENT_PCT when cruising or idle. Full current is used when homing.
+// Standstill current is still set by the hold current percentage.
+#ifndef TRINAMIC_CURRENT_SCHEDULING
+#define TRINAMIC_CURRENT_SCHEDULING 0
+#endif
+
+#ifndef TMC_ACCEL_CURRENT_PCT
+#define TMC_ACCEL_CURRENT_PCT 100
+#endif
+
+#ifndef TMC_CRUISE_CURRENT_PCT
+#define TMC_CRUISE_CURRENT_PCT 70
+#endif
+
+#define TMC_DATAGRAM_SIZE 5 // Address/status byte + 32 bit payload
+
 #define tmc_write_register(axis, reg, val) { TMC2130_datagram_t *p = TMC2130_GetRegPtr(&stepper[axis], reg); p->payload.value = val; TMC2130_WriteRegister(&stepper[ axis], p); }
 
 #define tmc_stealthChop(axis, val)      { stepper[axis].gconf.reg.en_pwm_mode = val; TMC2130_WriteRegister(&stepper[axis], (TMC2130_datagram_t *)&stepper[axis].gconf); }
@@ -146,6 +208,17 @@ typedef struct {
 // Init wrapper for physical interface
 void TMC_DriverInit (TMC_io_driver_t *driver);
 
+#if TRINAMIC_SPI_CHAIN
+// To be provided by the driver SPI code for daisy-chained drivers.
+// Register access by the Trinamic library is routed to the chain position set in .cs_pin, NOP datagrams are shifted
+// to the other drivers. Register access must wait for a pending chain transfer to complete.
+// SPI_ChainTransfer() starts a non-blocking, preferably DMA driven, transfer of one frame with a datagram per driver,
+// the datagram for the driver at the end of the chain first. tx and rx are to be left untouched until on_complete
+// is called from the interrupt context, returns false if a transfer is in progress. Must accept a new transfer
+// started from on_complete.
+bool SPI_ChainTransfer (uint8_t *tx, uint8_t *rx, uint_fast8_t datagrams, void (*on_complete)(void));
+#endif
+
 bool trinamic_init (void);
 void trinamic_start (bool allow_mixed);
 void trinamic_configure (void);
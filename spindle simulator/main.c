@@ -3,7 +3,7 @@
 //
 // For Texas Instruments MSP430 Value Line Launchpad
 //
-// v1.1 / 2020-11-04 / Io Engineering / Terje
+// v1.2 / 2020-11-10 / Io Engineering / Terje
 //
 
 /*
@@ -53,7 +53,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MSG_BADC  4U
 
 char const *const message[] = {
-    "\r\nSpindle Simulator 1.1\0",
+    "\r\nSpindle Simulator 1.2\0",
     "Error: missing parameters",
     "OK",
     "FAILED",
@@ -66,14 +66,59 @@ typedef struct {
     const bool report;
 } command_t;
 
-char cmdbuf[16];
-uint16_t ppr = 120, rpm = 400, max_rpm = 1000;
+// RPM profile entry, the output is ramped linearly from the previous entry RPM and then held.
+
+typedef struct {
+    uint16_t rpm;
+    uint16_t ramp;  // ms
+    uint16_t hold;  // ms
+} profile_entry_t;
+
+#define PROFILE_SIZE 8
+
+// Emulated VFD registers, matches the YL620A profile in the grblHAL VFD plugin.
+
+#define VFD_CONTROL     0x2000  // 0x12 run forward, 0x22 run reverse, other values stop
+#define VFD_SETPOINT    0x2001  // 0.1 Hz, RPM = Hz * 60
+#define VFD_FREQUENCY   0x200B  // 0.1 Hz, read only
+#define VFD_CURRENT     0x200C  // 0.1 A, read only
+#define VFD_REG_FIRST   VFD_CONTROL
+#define VFD_REG_LAST    VFD_CURRENT
+
+#define MODBUS_GAP 5    // ms without data ending a frame, > 3.5 characters at 9600 baud
+
+char cmdbuf[32];
+uint16_t ppr = 120, rpm = 400, max_rpm = 1000, out_rpm = 0, accel = 0, load = 0, jitter = 0;
 uint32_t pulse_period = 0;
 bool update_rpm = true;
 int16_t step = 0;
+volatile uint16_t ms = 0;
 
 bool manual = false, lock = false, invert = false;
 
+profile_entry_t profile[PROFILE_SIZE];
+
+struct {
+    uint8_t count;  // Number of entries to play, 0 when stopped
+    uint8_t entry;  // Current entry
+    bool loop;
+    uint16_t from;  // RPM at start of entry
+    uint16_t start; // ms at start of entry
+} play = {0};
+
+struct {
+    bool active;
+    int16_t rpm;
+    uint16_t load;
+    uint16_t end;
+} dist = {0};
+
+struct {
+    uint8_t addr;   // Slave address, 0 when Modbus mode is off
+    bool run;
+    uint16_t setpoint;
+} vfd = {0};
+
 void trigOut (void)
 {
     SPINDLE_TRIG_PORT_OUT |= SPINDLE_TRIG_BIT;
@@ -99,6 +144,22 @@ int parseInt (char *s)
     return negative ? -res : res;
 }
 
+// Parses up to count comma separated integers, returns the number of values found.
+uint16_t parseInts (char *s, int *values, uint16_t count)
+{
+    char *next;
+    uint16_t n = 0;
+
+    while(n < count && *s) {
+        if((next = strchr(s, ',')))
+            *next++ = '\0';
+        values[n++] = parseInt(s);
+        s = next ? next : s + strlen(s);
+    }
+
+    return n;
+}
+
 uint16_t read_adc (void)
 {
     uint16_t adc;
@@ -114,12 +175,15 @@ uint16_t read_adc (void)
     return adc;
 }
 
+// Sets encoder output from the RPM value, offset is ignored in lock mode. Any disturbance in progress is added.
 void setRPM (int value, int16_t offset)
 {
-    uint32_t new_period = ((2000000UL * 60UL) / (value + (lock ? 0 : offset)) / ppr);
+    int32_t output = (int32_t)value + (lock ? 0 : offset) + dist.rpm;
+    uint32_t new_period;
 
-    rpm = value;
-    pulse_period = pulse_period > (1UL << 16) ? (1UL << 16) - 1 : pulse_period;
+    out_rpm = output < 1 ? 1 : (uint16_t)output;
+    new_period = (2000000UL * 60UL) / out_rpm / ppr;
+    new_period = new_period > (1UL << 16) - 1 ? (1UL << 16) - 1 : new_period;
 
     if((update_rpm = new_period != pulse_period))
         pulse_period = new_period;
@@ -142,7 +206,8 @@ bool cmdSetPPR (char *params)
 
 bool cmdSetRPM (char *params)
 {
-    setRPM(parseInt(params), 0);
+    rpm = parseInt(params);
+    play.count = 0;
 
     return true;
 }
@@ -150,8 +215,10 @@ bool cmdSetRPM (char *params)
 void SpindleOn (bool on)
 {
     if(on) {
-        SPINDLE_PULSE_CTL |= MC0;       // Start timer in up mode and
-        trigOut();                      // output trigger pulse
+        if(!(SPINDLE_PULSE_CTL & MC0)) {
+            SPINDLE_PULSE_CTL |= MC0;   // Start timer in up mode and
+            trigOut();                  // output trigger pulse
+        }
     } else
         SPINDLE_PULSE_CTL &= ~MC0;      // Stop timer
 }
@@ -194,6 +261,117 @@ bool cmdStep (char *params)
     return true;
 }
 
+// PSET:<entry>,<rpm>,<ramp ms>,<hold ms>
+bool cmdProfileSet (char *params)
+{
+    int values[4];
+
+    if(parseInts(params, values, 4) != 4 || values[0] < 0 || values[0] >= PROFILE_SIZE || values[1] < 0 || values[2] < 0 || values[3] < 0)
+        return false;
+
+    profile[values[0]].rpm = values[1];
+    profile[values[0]].ramp = values[2];
+    profile[values[0]].hold = values[3];
+
+    return true;
+}
+
+// PLAY:<entries>, starts playback of the first entries in manual mode, 0 stops playback.
+bool cmdPlay (char *params)
+{
+    int count = parseInt(params);
+
+    if(count < 0 || count > PROFILE_SIZE)
+        return false;
+
+    play.entry = 0;
+    play.from = rpm;
+    play.start = ms;
+
+    if((play.count = count)) {
+        manual = true;
+        if(SPINDLE_PULSE_CTL & MC0)
+            trigOut();
+        else
+            SpindleOn(true);
+    }
+
+    return true;
+}
+
+bool cmdLoop (char *params)
+{
+    play.loop = parseInt(params);
+
+    return true;
+}
+
+// DIST:<rpm offset>,<ms>[,<load>], adds a temporary RPM offset and load current, outputs a trigger pulse at the start.
+bool cmdDisturbance (char *params)
+{
+    int values[3] = {0, 0, 0};
+
+    if(parseInts(params, values, 3) < 2 || values[1] <= 0)
+        return false;
+
+    dist.rpm = values[0];
+    dist.load = values[2] < 0 ? 0 : values[2];
+    dist.end = ms + values[1];
+    dist.active = true;
+
+    trigOut();
+
+    return true;
+}
+
+// JITTER:<us>, max random deviation of each encoder pulse period.
+bool cmdJitter (char *params)
+{
+    int value = parseInt(params);
+
+    jitter = value < 0 ? 0 : value << 1; // Timer runs at 2 MHz
+    update_rpm = true;
+
+    return true;
+}
+
+// ACCEL:<rpm/s>, rate of change of the output in manual and Modbus modes, 0 for instant.
+bool cmdAccel (char *params)
+{
+    int value = parseInt(params);
+
+    accel = value < 0 ? 0 : value;
+
+    return true;
+}
+
+// LOAD:<n>, output current in 0.1 A reported in Modbus mode while running.
+bool cmdLoad (char *params)
+{
+    int value = parseInt(params);
+
+    load = value < 0 ? 0 : value;
+
+    return true;
+}
+
+// MODBUS:<address>, switches the serial port to Modbus RTU VFD emulation until reset.
+bool cmdModbus (char *params)
+{
+    int addr = parseInt(params);
+
+    if(addr < 1 || addr > 247)
+        return false;
+
+    vfd.addr = addr;
+    vfd.run = false;
+    vfd.setpoint = 0;
+    manual = true;
+    play.count = 0;
+
+    return true;
+}
+
 void exeCommand (char *cmdline)
 {
     static const command_t commands[] = {
@@ -203,7 +381,15 @@ void exeCommand (char *cmdline)
         "AUTO:",    cmdAuto, true,
         "LOCK:",    cmdLock, true,
         "STEP:",    cmdStep, true,
-        "INVERT:",  cmdInvert, true
+        "INVERT:",  cmdInvert, true,
+        "PSET:",    cmdProfileSet, true,
+        "PLAY:",    cmdPlay, true,
+        "LOOP:",    cmdLoop, true,
+        "DIST:",    cmdDisturbance, true,
+        "JITTER:",  cmdJitter, true,
+        "ACCEL:",   cmdAccel, true,
+        "LOAD:",    cmdLoad, true,
+        "MODBUS:",  cmdModbus, true
     };
 
     static const uint16_t numcmds = sizeof(commands) / sizeof(command_t);
@@ -248,10 +434,185 @@ uint16_t read_rpm (void)
     return (uint16_t)(((uint32_t)adc * max_rpm) / 1024UL);
 }
 
+// Advances profile playback, a trigger pulse is output at the start of each entry.
+void profilePlay (uint16_t now)
+{
+    profile_entry_t *entry = &profile[play.entry];
+    uint16_t elapsed = now - play.start;
+
+    if(elapsed < entry->ramp)
+        rpm = play.from + (int16_t)(((int32_t)entry->rpm - play.from) * elapsed / entry->ramp);
+    else {
+        rpm = entry->rpm;
+        if(elapsed - entry->ramp >= entry->hold) {
+            if(++play.entry == play.count) {
+                play.entry = 0;
+                if(!play.loop)
+                    play.count = 0;
+            }
+            if(play.count) {
+                play.from = rpm;
+                play.start = now;
+                trigOut();
+            }
+        }
+    }
+}
+
+// Slews the output towards the target RPM at the ACCEL rate, emulating spindle inertia.
+uint16_t slewRPM (uint16_t target, uint16_t now)
+{
+    static uint16_t output = 0, last = 0;
+
+    uint32_t delta;
+
+    if(accel == 0 || output == target) {
+        output = target;
+        last = now;
+    } else if((delta = (uint32_t)accel * (uint16_t)(now - last) / 1000UL)) {
+        last = now;
+        if(output < target)
+            output = delta >= target - output ? target : output + delta;
+        else
+            output = delta >= output - target ? target : output - delta;
+    }
+
+    return output;
+}
+
+// Modbus RTU CRC, low byte is sent first
+uint16_t modbusCRC (uint8_t *buf, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    uint8_t i;
+
+    while(length--) {
+        crc ^= *buf++;
+        for(i = 8; i != 0; i--)
+            crc = crc & 0x0001 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+uint16_t vfdRead (uint16_t reg)
+{
+    bool running = (SPINDLE_PULSE_CTL & MC0) != 0;
+
+    switch(reg) {
+
+        case VFD_CONTROL:
+            return vfd.run ? 0x12 : 0x01;
+
+        case VFD_SETPOINT:
+            return vfd.setpoint;
+
+        case VFD_FREQUENCY:
+            return running ? out_rpm / 6 : 0;
+
+        case VFD_CURRENT:
+            return running ? load + dist.load : 0;
+    }
+
+    return 0;
+}
+
+bool vfdWrite (uint16_t reg, uint16_t value)
+{
+    switch(reg) {
+
+        case VFD_CONTROL:
+            vfd.run = value == 0x12 || value == 0x22;
+            break;
+
+        case VFD_SETPOINT:
+            vfd.setpoint = value;
+            rpm = value > 32767 / 6 ? 32767 / 6 * 6 : value * 6;
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+// Handles a request frame, supports Read Holding Registers (3) and Write Single Register (6).
+// Frames for other addresses and with a bad CRC are ignored.
+void modbusFrame (uint8_t *adu, uint16_t length)
+{
+    uint8_t exception = 0;
+    uint16_t reg, value, crc;
+
+    if(length != 8 || adu[0] != vfd.addr || modbusCRC(adu, 6) != (adu[6] | (adu[7] << 8)))
+        return;
+
+    reg = (adu[2] << 8) | adu[3];
+    value = (adu[4] << 8) | adu[5];
+
+    switch(adu[1]) {
+
+        case 0x03: // value is number of registers
+            if(value == 0 || value > 8)
+                exception = 3;
+            else if(reg < VFD_REG_FIRST || reg + value - 1 > VFD_REG_LAST)
+                exception = 2;
+            else {
+                adu[2] = value << 1;
+                for(length = 3; value; value--) {
+                    crc = vfdRead(reg++);
+                    adu[length++] = crc >> 8;
+                    adu[length++] = crc & 0xFF;
+                }
+            }
+            break;
+
+        case 0x06: // Reply is an echo of the request
+            if(!vfdWrite(reg, value))
+                exception = 2;
+            length = 6;
+            break;
+
+        default:
+            exception = 1;
+            break;
+    }
+
+    if(exception) {
+        adu[1] |= 0x80;
+        adu[2] = exception;
+        length = 3;
+    }
+
+    crc = modbusCRC(adu, length);
+    adu[length++] = crc & 0xFF;
+    adu[length++] = crc >> 8;
+
+    serialWrite((char *)adu, length);
+}
+
+// Collects request frames, a frame ends when no data has been received for MODBUS_GAP ms.
+void modbusPoll (uint16_t now)
+{
+    static uint16_t length = 0, last = 0;
+
+    while(serialRxCount()) {
+        char c = serialRead();
+        if(length < sizeof(cmdbuf))
+            cmdbuf[length++] = c;
+        last = now;
+    }
+
+    if(length && (uint16_t)(now - last) >= MODBUS_GAP) {
+        modbusFrame((uint8_t *)cmdbuf, length);
+        length = 0;
+    }
+}
+
 void main (void)
 {
     char c;
-    uint16_t cmdptr = 0;
+    uint16_t cmdptr = 0, now, output;
 
     WDTCTL = WDTPW | WDTHOLD;	        // Stop watchdog timer
 
@@ -290,6 +651,9 @@ void main (void)
 
     serialInit();
 
+    WDTCTL = WDT_MDLY_8;                    // Set watchdog to interval mode, 0.512 ms at 16MHz,
+    IE1 |= WDTIE;                           // for the ms tick
+
     _EINT();                                // Enable interrupts
 
     serialRxFlush();
@@ -297,13 +661,29 @@ void main (void)
 
     while(1) {
 
-        if(!manual) {
+        now = ms;
+
+        if(dist.active && (int16_t)(now - dist.end) >= 0) {
+            dist.active = false;
+            dist.rpm = 0;
+            dist.load = 0;
+        }
+
+        if(play.count)
+            profilePlay(now);
+
+        if(vfd.addr) {
+            modbusPoll(now);
+            output = slewRPM(vfd.run ? rpm : 0, now);
+            setRPM(output, 0);
+            SpindleOn(output != 0);
+        } else if(!manual) {
             SpindleOn((SPINDLE_ON_PORT_IN & SPINDLE_ON_BIT) != 0);
             setRPM(read_rpm(), step);
         } else
-            setRPM(rpm, (int16_t)(read_rpm() / 8) - 64);
+            setRPM(slewRPM(rpm, now), (int16_t)(read_rpm() / 8) - 64);
 
-        if(serialRxCount()) { // bytes waiting, process them
+        if(!vfd.addr && serialRxCount()) { // bytes waiting, process them
 
             c = serialRead();
 
@@ -322,7 +702,7 @@ void main (void)
             } else if(c == DEL) {
                 if(cmdptr > 0)
                     cmdptr--;
-            } else if(c >= ' ' && cmdptr < sizeof(cmdbuf))
+            } else if(c >= ' ' && cmdptr < sizeof(cmdbuf) - 1)
                 cmdbuf[cmdptr++] = c & (c >= 'a' && c <= 'z' ? 0x5F : 0xFF);
         }
 
@@ -348,6 +728,30 @@ __interrupt void TIMER_SP_ISR(void)
             INDEX_CCR1 = SPINDLE_PULSE_CCR1;
         }
     }
+
+    // Jitter, the next period is varied by up to +/- jitter counts, limited to a quarter period to keep it longer than the pulse.
+    if(jitter) {
+        static uint16_t lfsr = 0xACE1;
+
+        uint16_t period = (uint16_t)pulse_period, limit = jitter < (period >> 2) ? jitter : period >> 2;
+
+        if(limit > 0xFFFF - period)
+            limit = 0xFFFF - period;
+
+        lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+        SPINDLE_PULSE_CCR0 = period + (int16_t)(((int32_t)(int16_t)lfsr * limit) >> 15);
+    }
+}
+
+#pragma vector=WDT_VECTOR
+__interrupt void WDT_ISR(void)
+{
+    static uint16_t us = 0;
+
+    if((us += 512) >= 1000) {
+        us -= 1000;
+        ms++;
+    }
 }
 
 #pragma vector=INDEX_IRQH
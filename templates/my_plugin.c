@@ -156,5 +156,6 @@ void my_plugin_init (void)
         grbl.on_report_options = onReportOptions;
 
         // "Hook" into other HAL pointers here to provide functionality.
+        // Time spent in hooks may be measured with the PLUGIN_PERF_* macros in grbl/plugins.h, see ENABLE_PLUGIN_PERF in config.h.
     }
 }